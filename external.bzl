@@ -124,6 +124,17 @@ def _cc_dependencies():
         commit = "61f010d703b32de9bfb20ab90ece38ab2f25977f",
     )
 
+    maybe(
+        http_archive,
+        name = "com_google_benchmark",
+        strip_prefix = "benchmark-1.5.0",
+        sha256 = "3c6a165b6ecc948967a1ead710d4a181d7b0fbcaa183ef7ea84604994966221a",
+        urls = [
+            "https://mirror.bazel.build/github.com/google/benchmark/archive/v1.5.0.tar.gz",
+            "https://github.com/google/benchmark/archive/v1.5.0.tar.gz",
+        ],
+    )
+
     maybe(
         http_archive,
         name = "com_github_google_glog",
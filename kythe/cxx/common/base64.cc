@@ -0,0 +1,109 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/base64.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include <cstddef>
+
+#include "absl/strings/escaping.h"
+
+namespace kythe {
+namespace {
+
+#if defined(__SSSE3__)
+/// \brief Decodes the 16 alphabet characters at `src` into 12 bytes at `dst`.
+///
+/// Mula and Lemire's lookup kernel: each byte is classified by its nibbles
+/// to validate it, then a per-class offset maps it to its 6-bit value.
+/// Sixteen bytes are stored but only the first twelve are meaningful; the
+/// caller leaves room for the overspill.
+/// \return false if any character falls outside the base64 alphabet.
+inline bool DecodeBlockSsse3(const char* src, char* dst) {
+  const __m128i lut_lo =
+      _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                    0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi =
+      _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0,
+                                         0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_0f = _mm_set1_epi8(0x0f);
+  const __m128i mask_2f = _mm_set1_epi8(0x2f);
+  __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_0f);
+  __m128i lo_nibbles = _mm_and_si128(in, mask_0f);
+  __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+  __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+  if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+                                       _mm_setzero_si128())) != 0) {
+    return false;
+  }
+  __m128i eq_2f = _mm_cmpeq_epi8(in, mask_2f);
+  __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+  __m128i values = _mm_add_epi8(in, roll);
+  // Pack each lane's four 6-bit values into three big-endian bytes, then
+  // compact the twelve payload bytes to the front.
+  __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+  packed = _mm_shuffle_epi8(
+      packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+                            -1, -1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), packed);
+  return true;
+}
+#endif  // defined(__SSSE3__)
+
+}  // anonymous namespace
+
+bool Base64Decode(absl::string_view encoded, std::string* decoded) {
+#if defined(__SSSE3__)
+  // Whole four-character groups decode independently, so the bulk of the
+  // input decodes in sixteen-character blocks; the remainder (including any
+  // padding, which only ever appears in the final group) goes through absl's
+  // decoder below. A byte outside the alphabet sends the whole input to absl
+  // instead, so accepted inputs and their decodings stay identical.
+  if (encoded.size() >= 20) {
+    // Hold the final group back in case it carries padding.
+    const size_t bulk = (encoded.size() - 4) / 16 * 16;
+    decoded->clear();
+    decoded->resize(bulk / 4 * 3 + 4);
+    char* out = &(*decoded)[0];
+    size_t in_pos = 0;
+    for (; in_pos < bulk; in_pos += 16) {
+      if (!DecodeBlockSsse3(encoded.data() + in_pos, out)) {
+        break;
+      }
+      out += 12;
+    }
+    if (in_pos == bulk) {
+      decoded->resize(out - decoded->data());
+      std::string tail;
+      if (!absl::Base64Unescape(encoded.substr(bulk), &tail)) {
+        return false;
+      }
+      decoded->append(tail);
+      return true;
+    }
+  }
+#endif  // defined(__SSSE3__)
+  return absl::Base64Unescape(encoded, decoded);
+}
+
+}  // namespace kythe
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_COMMON_BASE64_H_
+#define KYTHE_CXX_COMMON_BASE64_H_
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace kythe {
+
+/// \brief Decodes standard-alphabet base64, like `absl::Base64Unescape`.
+///
+/// Clean input (the A-Za-z0-9+/ alphabet with at most trailing `=` padding)
+/// takes a vectorized bulk path on platforms that have one; anything else
+/// (embedded whitespace, invalid bytes) is handed to `absl::Base64Unescape`
+/// wholesale, so accepted inputs and their decodings match it exactly.
+/// \param encoded the base64 text to decode.
+/// \param decoded receives the decoded bytes; clobbered even on failure.
+/// \return false if `encoded` is not valid base64.
+bool Base64Decode(absl::string_view encoded, std::string* decoded);
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_BASE64_H_
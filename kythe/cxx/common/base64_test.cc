@@ -0,0 +1,72 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/base64.h"
+
+#include <string>
+
+#include "absl/strings/escaping.h"
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace {
+
+TEST(Base64Test, RoundTripsAllLengths) {
+  // Lengths on both sides of the vectorized bulk threshold, covering every
+  // padding shape and every block-remainder alignment.
+  std::string content;
+  for (int length = 0; length < 200; ++length) {
+    std::string encoded = absl::Base64Escape(content);
+    std::string decoded;
+    ASSERT_TRUE(Base64Decode(encoded, &decoded)) << "length " << length;
+    EXPECT_EQ(content, decoded) << "length " << length;
+    content.push_back(static_cast<char>(length * 7 + 1));
+  }
+}
+
+TEST(Base64Test, MatchesAbslOnUnusualInput) {
+  // Inputs the fast path refuses must decode (or fail) exactly as absl does.
+  const std::string kInputs[] = {
+      "",
+      "####",
+      "QUJD!UJDQUJDQUJDQUJDQUJDQUJDQUJDQUJD",
+      "QUJD\nQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJD",
+      "QUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQ===",
+      "A",
+  };
+  for (const std::string& input : kInputs) {
+    std::string expected;
+    bool expected_ok = absl::Base64Unescape(input, &expected);
+    std::string decoded;
+    EXPECT_EQ(expected_ok, Base64Decode(input, &decoded)) << input;
+    if (expected_ok) {
+      EXPECT_EQ(expected, decoded) << input;
+    }
+  }
+}
+
+TEST(Base64Test, DecodesLargeBuffer) {
+  std::string content;
+  for (int i = 0; i < 100000; ++i) {
+    content.push_back(static_cast<char>(i * 31));
+  }
+  std::string decoded;
+  ASSERT_TRUE(Base64Decode(absl::Base64Escape(content), &decoded));
+  EXPECT_EQ(content, decoded);
+}
+
+}  // namespace
+}  // namespace kythe
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/cas_index_writer.h"
+
+#include <openssl/sha.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "kythe/cxx/common/status.h"
+
+namespace kythe {
+namespace {
+
+constexpr absl::string_view kFileDir = "files";
+constexpr absl::string_view kUnitDir = "units";
+
+std::string SHA256Digest(absl::string_view content) {
+  std::array<unsigned char, SHA256_DIGEST_LENGTH> buf;
+  ::SHA256(reinterpret_cast<const unsigned char*>(content.data()),
+           content.size(), buf.data());
+  return absl::BytesToHexString(
+      absl::string_view(reinterpret_cast<const char*>(buf.data()), buf.size()));
+}
+
+/// \brief Creates `path` if absent; an existing directory is not an error.
+absl::Status MakeDirectory(const std::string& path) {
+  if (::mkdir(path.c_str(), 0755) == 0 || errno == EEXIST) {
+    return absl::OkStatus();
+  }
+  return ErrnoToStatus(errno);
+}
+
+bool PathExists(const std::string& path) {
+  struct stat buf;
+  return ::stat(path.c_str(), &buf) == 0;
+}
+
+/// \brief Writes `content` to a process-private temporary sibling of `path`
+/// and renames it into place, so readers never observe a partial blob.
+absl::Status WriteBlobFile(const std::string& path,
+                           absl::string_view content) {
+  std::string temp_path = absl::StrCat(path, ".", ::getpid(), ".tmp");
+  std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return ErrnoToStatus(errno);
+  }
+  size_t written = std::fwrite(content.data(), 1, content.size(), file);
+  if (std::fclose(file) != 0 || written != content.size()) {
+    ::unlink(temp_path.c_str());
+    return absl::InternalError(absl::StrCat("short write to ", temp_path));
+  }
+  if (::rename(temp_path.c_str(), path.c_str()) != 0) {
+    absl::Status status = ErrnoToStatus(errno);
+    ::unlink(temp_path.c_str());
+    return status;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+/* static */
+StatusOr<IndexWriter> CasIndexWriter::Create(absl::string_view root) {
+  std::string root_path(root);
+  for (const auto& dir :
+       {root_path, absl::StrCat(root_path, "/", kFileDir),
+        absl::StrCat(root_path, "/", kUnitDir)}) {
+    if (absl::Status status = MakeDirectory(dir); !status.ok()) {
+      return status;
+    }
+  }
+  return IndexWriter(absl::WrapUnique(new CasIndexWriter(root_path)));
+}
+
+StatusOr<std::string> CasIndexWriter::WriteUnit(
+    const kythe::proto::IndexedCompilation& unit) {
+  std::string contents;
+  if (!unit.SerializeToString(&contents)) {
+    return absl::InternalError("Failure serializing compilation unit");
+  }
+  return InsertBlob(kUnitDir, contents);
+}
+
+StatusOr<std::string> CasIndexWriter::WriteFile(absl::string_view content) {
+  return InsertBlob(kFileDir, content);
+}
+
+absl::Status CasIndexWriter::Close() { return absl::OkStatus(); }
+
+StatusOr<std::string> CasIndexWriter::InsertBlob(absl::string_view kind,
+                                                 absl::string_view content) {
+  std::string digest = SHA256Digest(content);
+  std::string fanout = absl::StrCat(
+      root_, "/", kind, "/", absl::string_view(digest).substr(0, 2));
+  std::string path = absl::StrCat(fanout, "/", digest);
+  // The hot path: the blob survived from a prior extraction.
+  if (PathExists(path)) {
+    return digest;
+  }
+  if (absl::Status status = MakeDirectory(fanout); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = WriteBlobFile(path, content); !status.ok()) {
+    return status;
+  }
+  return digest;
+}
+
+}  // namespace kythe
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_COMMON_CAS_INDEX_WRITER_H_
+#define KYTHE_CXX_COMMON_CAS_INDEX_WRITER_H_
+
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "kythe/cxx/common/index_writer.h"
+#include "kythe/cxx/common/status_or.h"
+#include "kythe/proto/analysis.pb.h"
+
+namespace kythe {
+
+/// \brief IndexWriter backed by a local content-addressed store.
+///
+/// Instead of embedding every required input in a per-compilation kzip,
+/// blobs land once in a store shared across extractions: file content at
+/// `<root>/files/<aa>/<digest>` and serialized `IndexedCompilation` protos at
+/// `<root>/units/<aa>/<digest>`, where `<aa>` is the first two hex digits of
+/// the content's SHA256 digest (a fanout that keeps directories small).
+/// Units reference their inputs by digest as usual, so readers resolve them
+/// against the store.
+///
+/// `WriteFile` stats the blob's path before writing; in incremental
+/// extraction nearly all inputs already exist from prior runs, so the common
+/// case is one stat rather than recompressing and rewriting the content.
+/// New blobs are written to a temporary file and renamed into place, so
+/// concurrent extractors sharing a store race benignly — both write
+/// identical bytes and the last rename wins.
+class CasIndexWriter : public IndexWriterInterface {
+ public:
+  /// \brief Constructs a CasIndexWriter rooted at `root`.
+  /// \param root Directory for the store; created (along with its `files`
+  /// and `units` subdirectories) if it does not already exist.
+  static StatusOr<IndexWriter> Create(absl::string_view root);
+
+  /// \brief Writes the unit into the store, returning its digest.
+  StatusOr<std::string> WriteUnit(
+      const kythe::proto::IndexedCompilation& unit) override;
+
+  /// \brief Ensures the file contents are present in the store, returning
+  /// their digest. Contents already present are not rewritten.
+  StatusOr<std::string> WriteFile(absl::string_view content) override;
+
+  /// \brief Nothing to finalize: every blob is durable once written.
+  absl::Status Close() override;
+
+ private:
+  explicit CasIndexWriter(std::string root) : root_(std::move(root)) {}
+
+  /// \brief Stores `content` under `<root>/<kind>/<aa>/<digest>` unless it
+  /// is already present, returning the digest.
+  StatusOr<std::string> InsertBlob(absl::string_view kind,
+                                   absl::string_view content);
+
+  /// Root directory of the store.
+  std::string root_;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_CAS_INDEX_WRITER_H_
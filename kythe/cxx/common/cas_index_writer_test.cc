@@ -0,0 +1,110 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/cas_index_writer.h"
+
+#include <sys/stat.h>
+#include <utime.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "gtest/gtest.h"
+#include "kythe/cxx/common/file_utils.h"
+
+namespace kythe {
+namespace {
+
+absl::string_view TestTmpdir() {
+  return absl::StripSuffix(std::getenv("TEST_TMPDIR"), "/");
+}
+
+std::string TestStoreRoot() {
+  const auto* test_info = testing::UnitTest::GetInstance()->current_test_info();
+  const auto dirname = absl::StrReplaceAll(
+      absl::StrCat(test_info->test_case_name(), "_", test_info->name(), "_cas"),
+      {{"/", "-"}});
+  return absl::StrCat(TestTmpdir(), "/", dirname);
+}
+
+time_t ModTime(const std::string& path) {
+  struct stat buf;
+  EXPECT_EQ(::stat(path.c_str(), &buf), 0) << path;
+  return buf.st_mtime;
+}
+
+TEST(CasIndexWriterTest, BlobsLandUnderTheirDigests) {
+  const std::string root = TestStoreRoot();
+  auto writer = CasIndexWriter::Create(root);
+  ASSERT_TRUE(writer.ok()) << writer.status();
+
+  auto file_digest = writer->WriteFile("file content");
+  ASSERT_TRUE(file_digest.ok()) << file_digest.status();
+  const std::string file_path = absl::StrCat(
+      root, "/files/", absl::string_view(*file_digest).substr(0, 2), "/",
+      *file_digest);
+  EXPECT_EQ(LoadFileOrDie(file_path), "file content");
+
+  kythe::proto::IndexedCompilation unit;
+  unit.mutable_unit()->set_output_key("output");
+  auto unit_digest = writer->WriteUnit(unit);
+  ASSERT_TRUE(unit_digest.ok()) << unit_digest.status();
+  const std::string unit_path = absl::StrCat(
+      root, "/units/", absl::string_view(*unit_digest).substr(0, 2), "/",
+      *unit_digest);
+  kythe::proto::IndexedCompilation read_unit;
+  ASSERT_TRUE(read_unit.ParseFromString(LoadFileOrDie(unit_path)));
+  EXPECT_EQ(read_unit.unit().output_key(), "output");
+
+  EXPECT_TRUE(writer->Close().ok());
+}
+
+TEST(CasIndexWriterTest, ExistingBlobsAreNotRewritten) {
+  const std::string root = TestStoreRoot();
+  std::string digest, path;
+  {
+    auto writer = CasIndexWriter::Create(root);
+    ASSERT_TRUE(writer.ok()) << writer.status();
+    auto result = writer->WriteFile("shared content");
+    ASSERT_TRUE(result.ok()) << result.status();
+    digest = *result;
+    path = absl::StrCat(root, "/files/",
+                        absl::string_view(digest).substr(0, 2), "/", digest);
+    EXPECT_TRUE(writer->Close().ok());
+  }
+  // Age the blob so a rewrite would be visible in its mtime.
+  const time_t first_write = ModTime(path);
+  struct utimbuf times = {first_write - 100, first_write - 100};
+  ASSERT_EQ(::utime(path.c_str(), &times), 0);
+  {
+    // A second extraction against the same store deduplicates by digest.
+    auto writer = CasIndexWriter::Create(root);
+    ASSERT_TRUE(writer.ok()) << writer.status();
+    auto result = writer->WriteFile("shared content");
+    ASSERT_TRUE(result.ok()) << result.status();
+    EXPECT_EQ(*result, digest);
+    EXPECT_EQ(ModTime(path), first_write - 100);
+    EXPECT_TRUE(writer->Close().ok());
+  }
+}
+
+}  // namespace
+}  // namespace kythe
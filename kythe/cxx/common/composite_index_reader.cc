@@ -0,0 +1,129 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/composite_index_reader.h"
+
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
+namespace kythe {
+
+StatusOr<IndexReader> CompositeIndexReader::Open(
+    std::vector<IndexReader> layers) {
+  if (layers.empty()) {
+    return absl::InvalidArgumentError(
+        "CompositeIndexReader requires at least one layer");
+  }
+  return IndexReader(
+      absl::WrapUnique(new CompositeIndexReader(std::move(layers))));
+}
+
+absl::Status CompositeIndexReader::Scan(const ScanCallback& callback) {
+  absl::flat_hash_set<std::string> seen;
+  for (size_t layer = 0; layer < layers_.size(); ++layer) {
+    bool keep_going = true;
+    absl::Status status = layers_[layer].Scan([&](absl::string_view digest) {
+      if (!seen.emplace(std::string(digest)).second) {
+        // Shadowed by an earlier layer.
+        return true;
+      }
+      layer_cache_.emplace(std::string(digest), layer);
+      keep_going = callback(digest);
+      return keep_going;
+    });
+    if (!status.ok()) {
+      return status;
+    }
+    if (!keep_going) {
+      break;
+    }
+  }
+  return absl::OkStatus();
+}
+
+StatusOr<kythe::proto::IndexedCompilation> CompositeIndexReader::ReadUnit(
+    absl::string_view digest) {
+  auto it = layer_cache_.find(digest);
+  if (it != layer_cache_.end()) {
+    return layers_[it->second].ReadUnit(digest);
+  }
+  for (size_t layer = 0; layer < layers_.size(); ++layer) {
+    StatusOr<kythe::proto::IndexedCompilation> unit =
+        layers_[layer].ReadUnit(digest);
+    if (unit.ok()) {
+      layer_cache_.emplace(std::string(digest), layer);
+      return unit;
+    }
+    if (unit.status().code() != absl::StatusCode::kNotFound) {
+      return unit;
+    }
+  }
+  return absl::NotFoundError(absl::StrCat("No unit with digest ", digest));
+}
+
+StatusOr<std::string> CompositeIndexReader::ReadFile(absl::string_view digest) {
+  std::string contents;
+  absl::Status status = ReadFileInto(digest, &contents);
+  if (!status.ok()) {
+    return status;
+  }
+  return contents;
+}
+
+absl::Status CompositeIndexReader::ReadFileInto(absl::string_view digest,
+                                                std::string* contents) {
+  auto it = layer_cache_.find(digest);
+  if (it != layer_cache_.end()) {
+    return layers_[it->second].ReadFileInto(digest, contents);
+  }
+  for (size_t layer = 0; layer < layers_.size(); ++layer) {
+    absl::Status status = layers_[layer].ReadFileInto(digest, contents);
+    if (status.ok()) {
+      layer_cache_.emplace(std::string(digest), layer);
+      return status;
+    }
+    if (status.code() != absl::StatusCode::kNotFound) {
+      return status;
+    }
+  }
+  return absl::NotFoundError(absl::StrCat("No file with digest ", digest));
+}
+
+StatusOr<absl::string_view> CompositeIndexReader::ReadFileView(
+    absl::string_view digest, std::string* scratch) {
+  auto it = layer_cache_.find(digest);
+  if (it != layer_cache_.end()) {
+    return layers_[it->second].ReadFileView(digest, scratch);
+  }
+  for (size_t layer = 0; layer < layers_.size(); ++layer) {
+    StatusOr<absl::string_view> view =
+        layers_[layer].ReadFileView(digest, scratch);
+    if (view.ok()) {
+      layer_cache_.emplace(std::string(digest), layer);
+      return view;
+    }
+    if (view.status().code() != absl::StatusCode::kNotFound) {
+      return view;
+    }
+  }
+  return absl::NotFoundError(absl::StrCat("No file with digest ", digest));
+}
+
+}  // namespace kythe
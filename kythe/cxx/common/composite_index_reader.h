@@ -0,0 +1,78 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_COMMON_COMPOSITE_INDEX_READER_H_
+#define KYTHE_CXX_COMMON_COMPOSITE_INDEX_READER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "kythe/cxx/common/index_reader.h"
+#include "kythe/cxx/common/status_or.h"
+#include "kythe/proto/analysis.pb.h"
+
+namespace kythe {
+
+/// \brief An IndexReader that overlays several readers, resolving each
+/// digest to the first layer that holds it.
+///
+/// Incremental pipelines layer a delta kzip over a base snapshot: opening
+/// {delta, base} serves updated units and files from the delta and
+/// everything else from the snapshot, with no archive merge step. A lookup
+/// that misses the first layer probes the rest in order, and the winning
+/// layer is remembered per digest so repeated reads (headers shared by
+/// many units) pay the probe once.
+class CompositeIndexReader : public IndexReaderInterface {
+ public:
+  /// \brief Wraps `layers` in a composite reader. Earlier layers shadow
+  /// later ones; at least one layer is required.
+  static StatusOr<IndexReader> Open(std::vector<IndexReader> layers);
+
+  /// \brief Invokes `callback` once per distinct unit digest, in layer
+  /// order; a digest present in several layers is reported for the first.
+  absl::Status Scan(const ScanCallback& callback) override;
+
+  StatusOr<kythe::proto::IndexedCompilation> ReadUnit(
+      absl::string_view digest) override;
+
+  StatusOr<std::string> ReadFile(absl::string_view digest) override;
+
+  absl::Status ReadFileInto(absl::string_view digest,
+                            std::string* contents) override;
+
+  /// \brief Returns a view from the resolved layer, preserving that
+  /// layer's zero-copy behavior when it has one.
+  StatusOr<absl::string_view> ReadFileView(absl::string_view digest,
+                                           std::string* scratch) override;
+
+ private:
+  explicit CompositeIndexReader(std::vector<IndexReader> layers)
+      : layers_(std::move(layers)) {}
+
+  /// The overlaid readers, highest priority first.
+  std::vector<IndexReader> layers_;
+  /// Maps digests (units and files alike; they never collide, as both are
+  /// content hashes) to the index of the layer that holds them.
+  absl::flat_hash_map<std::string, size_t> layer_cache_;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_COMPOSITE_INDEX_READER_H_
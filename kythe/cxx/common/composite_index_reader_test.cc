@@ -0,0 +1,149 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/composite_index_reader.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace {
+
+/// \brief A reader over in-memory maps. Units are keyed by digest and carry
+/// their value in the unit's corpus; files map digest to content.
+class FakeIndexReader : public IndexReaderInterface {
+ public:
+  FakeIndexReader(std::map<std::string, std::string> units,
+                  std::map<std::string, std::string> files)
+      : units_(std::move(units)), files_(std::move(files)) {}
+
+  absl::Status Scan(const ScanCallback& scan) override {
+    for (const auto& unit : units_) {
+      if (!scan(unit.first)) {
+        break;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  StatusOr<kythe::proto::IndexedCompilation> ReadUnit(
+      absl::string_view digest) override {
+    auto it = units_.find(std::string(digest));
+    if (it == units_.end()) {
+      return absl::NotFoundError(absl::StrCat("No unit ", digest));
+    }
+    kythe::proto::IndexedCompilation unit;
+    unit.mutable_unit()->mutable_v_name()->set_corpus(it->second);
+    return unit;
+  }
+
+  StatusOr<std::string> ReadFile(absl::string_view digest) override {
+    ++file_reads_;
+    auto it = files_.find(std::string(digest));
+    if (it == files_.end()) {
+      return absl::NotFoundError(absl::StrCat("No file ", digest));
+    }
+    return it->second;
+  }
+
+  /// \return the number of file lookups (hits and misses) seen so far.
+  int file_reads() const { return file_reads_; }
+
+ private:
+  std::map<std::string, std::string> units_;
+  std::map<std::string, std::string> files_;
+  int file_reads_ = 0;
+};
+
+TEST(CompositeIndexReaderTest, RequiresALayer) {
+  EXPECT_FALSE(CompositeIndexReader::Open({}).ok());
+}
+
+TEST(CompositeIndexReaderTest, FirstLayerShadowsLater) {
+  std::vector<IndexReader> layers;
+  layers.emplace_back(absl::make_unique<FakeIndexReader>(
+      std::map<std::string, std::string>{{"u1", "delta"}},
+      std::map<std::string, std::string>{}));
+  layers.emplace_back(absl::make_unique<FakeIndexReader>(
+      std::map<std::string, std::string>{{"u1", "base"}, {"u2", "base"}},
+      std::map<std::string, std::string>{}));
+  auto reader = CompositeIndexReader::Open(std::move(layers));
+  ASSERT_TRUE(reader.ok()) << reader.status();
+
+  std::vector<std::string> scanned;
+  ASSERT_TRUE(reader
+                  ->Scan([&](absl::string_view digest) {
+                    scanned.push_back(std::string(digest));
+                    return true;
+                  })
+                  .ok());
+  EXPECT_EQ((std::vector<std::string>{"u1", "u2"}), scanned);
+
+  auto u1 = reader->ReadUnit("u1");
+  ASSERT_TRUE(u1.ok()) << u1.status();
+  EXPECT_EQ("delta", u1->unit().v_name().corpus());
+  auto u2 = reader->ReadUnit("u2");
+  ASSERT_TRUE(u2.ok()) << u2.status();
+  EXPECT_EQ("base", u2->unit().v_name().corpus());
+  EXPECT_EQ(absl::StatusCode::kNotFound,
+            reader->ReadUnit("u3").status().code());
+}
+
+TEST(CompositeIndexReaderTest, FileLookupsResolveOnceAndAreCached) {
+  auto delta = absl::make_unique<FakeIndexReader>(
+      std::map<std::string, std::string>{},
+      std::map<std::string, std::string>{{"f1", "delta content"}});
+  auto base = absl::make_unique<FakeIndexReader>(
+      std::map<std::string, std::string>{},
+      std::map<std::string, std::string>{{"f1", "base content"},
+                                         {"f2", "base only"}});
+  FakeIndexReader* delta_layer = delta.get();
+  std::vector<IndexReader> layers;
+  layers.emplace_back(std::move(delta));
+  layers.emplace_back(std::move(base));
+  auto reader = CompositeIndexReader::Open(std::move(layers));
+  ASSERT_TRUE(reader.ok()) << reader.status();
+
+  auto f1 = reader->ReadFile("f1");
+  ASSERT_TRUE(f1.ok()) << f1.status();
+  EXPECT_EQ("delta content", *f1);
+  auto f2 = reader->ReadFile("f2");
+  ASSERT_TRUE(f2.ok()) << f2.status();
+  EXPECT_EQ("base only", *f2);
+
+  // "f2" lives in the base layer; the cache must keep the second read from
+  // probing the delta layer again.
+  const int delta_reads = delta_layer->file_reads();
+  ASSERT_TRUE(reader->ReadFile("f2").ok());
+  EXPECT_EQ(delta_reads, delta_layer->file_reads());
+
+  std::string scratch;
+  auto view = reader->ReadFileView("f1", &scratch);
+  ASSERT_TRUE(view.ok()) << view.status();
+  EXPECT_EQ("delta content", *view);
+  EXPECT_EQ(absl::StatusCode::kNotFound,
+            reader->ReadFile("f3").status().code());
+}
+
+}  // namespace
+}  // namespace kythe
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/entry_stream_reader.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <climits>
+
+#include "google/protobuf/io/coded_stream.h"
+
+namespace kythe {
+namespace {
+/// The buffer size used when the descriptor can't be mapped.
+constexpr int kStreamBufferSize = 1 << 20;
+}  // anonymous namespace
+
+EntryStreamReader::EntryStreamReader(int fd) {
+  struct stat stat_buf;
+  if (::fstat(fd, &stat_buf) == 0 && S_ISREG(stat_buf.st_mode) &&
+      stat_buf.st_size > 0) {
+    void* data =
+        ::mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      mapped_data_ = data;
+      mapped_size_ = stat_buf.st_size;
+      ::madvise(data, mapped_size_, MADV_SEQUENTIAL);
+      array_input_ = std::make_unique<google::protobuf::io::ArrayInputStream>(
+          mapped_data_, mapped_size_);
+      input_ = array_input_.get();
+      return;
+    }
+  }
+  file_input_ = std::make_unique<google::protobuf::io::FileInputStream>(
+      fd, kStreamBufferSize);
+  input_ = file_input_.get();
+}
+
+EntryStreamReader::~EntryStreamReader() {
+  // The streams back up into the mapping, so they must go first.
+  array_input_.reset();
+  file_input_.reset();
+  if (mapped_data_ != nullptr) {
+    ::munmap(mapped_data_, mapped_size_);
+  }
+}
+
+bool EntryStreamReader::ReadBatch(EntryBatch* batch, size_t max_entries) {
+  batch->Clear();
+  if (at_end_ || failed_) {
+    return false;
+  }
+  batch->entries.reserve(max_entries);
+  // CodedInputStream enforces a total byte limit, so use a fresh one for
+  // every batch; it backs its position up into `input_` on destruction.
+  google::protobuf::io::CodedInputStream coded_input(input_);
+  coded_input.SetTotalBytesLimit(INT_MAX, -1);
+  for (size_t i = 0; i < max_entries; ++i) {
+    google::protobuf::uint32 byte_size;
+    if (!coded_input.ReadVarint32(&byte_size)) {
+      at_end_ = true;
+      break;
+    }
+    auto* entry = google::protobuf::Arena::CreateMessage<kythe::proto::Entry>(
+        &batch->arena);
+    auto limit = coded_input.PushLimit(byte_size);
+    // Parsing straight from the coded stream reads out of the mapping (or
+    // the stream buffer) without staging each entry in its own string.
+    if (!entry->ParseFromCodedStream(&coded_input) ||
+        !coded_input.ConsumedEntireMessage()) {
+      at_end_ = true;
+      failed_ = true;
+      break;
+    }
+    coded_input.PopLimit(limit);
+    batch->entries.push_back(entry);
+  }
+  entry_count_ += batch->entries.size();
+  return !at_end_;
+}
+
+}  // namespace kythe
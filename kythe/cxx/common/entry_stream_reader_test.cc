@@ -0,0 +1,130 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/entry_stream_reader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "gtest/gtest.h"
+#include "kythe/proto/storage.pb.h"
+
+namespace kythe {
+namespace {
+
+/// \brief Appends `entry` to `out` in delimited form.
+void AppendDelimited(const proto::Entry& entry, std::string* out) {
+  std::string bytes;
+  ASSERT_TRUE(entry.SerializeToString(&bytes));
+  unsigned char prefix[5];  // The largest varint32 encoding.
+  unsigned char* end =
+      google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(
+          bytes.size(), prefix);
+  out->append(reinterpret_cast<char*>(prefix), end - prefix);
+  out->append(bytes);
+}
+
+/// \brief Builds a delimited stream of `count` distinct entries.
+std::string MakeStream(size_t count) {
+  std::string stream;
+  for (size_t i = 0; i < count; ++i) {
+    proto::Entry entry;
+    entry.mutable_source()->set_signature(absl::StrCat("sig", i));
+    entry.set_fact_name("/kythe/node/kind");
+    entry.set_fact_value("record");
+    AppendDelimited(entry, &stream);
+  }
+  return stream;
+}
+
+/// \brief Reads `data` through a pipe (the non-mmap path) or a temporary
+/// file (the mmap path) and checks the decoded entries.
+void CheckRoundTrip(const std::string& data, size_t count, bool use_file) {
+  int fd;
+  int write_end = -1;
+  std::string path;
+  if (use_file) {
+    path = absl::StrCat(::testing::TempDir(), "/entry_stream");
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::write(fd, data.data(), data.size()),
+              static_cast<ssize_t>(data.size()));
+    ASSERT_EQ(::lseek(fd, 0, SEEK_SET), 0);
+  } else {
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    fd = fds[0];
+    write_end = fds[1];
+    ASSERT_EQ(::write(write_end, data.data(), data.size()),
+              static_cast<ssize_t>(data.size()));
+    ::close(write_end);
+  }
+  EntryStreamReader reader(fd);
+  EntryBatch batch;
+  size_t seen = 0;
+  bool more = true;
+  while (more) {
+    more = reader.ReadBatch(&batch, 3);
+    for (const proto::Entry* entry : batch.entries) {
+      EXPECT_EQ(entry->source().signature(), absl::StrCat("sig", seen));
+      EXPECT_EQ(entry->fact_name(), "/kythe/node/kind");
+      ++seen;
+    }
+  }
+  EXPECT_FALSE(reader.error());
+  EXPECT_EQ(seen, count);
+  EXPECT_EQ(reader.entry_count(), count);
+  ::close(fd);
+  if (use_file) {
+    ::unlink(path.c_str());
+  }
+}
+
+TEST(EntryStreamReaderTest, ReadsMappedFile) {
+  CheckRoundTrip(MakeStream(10), 10, /*use_file=*/true);
+}
+
+TEST(EntryStreamReaderTest, ReadsPipe) {
+  CheckRoundTrip(MakeStream(10), 10, /*use_file=*/false);
+}
+
+TEST(EntryStreamReaderTest, EmptyStream) {
+  CheckRoundTrip("", 0, /*use_file=*/true);
+}
+
+TEST(EntryStreamReaderTest, ReportsTruncatedInput) {
+  std::string data = MakeStream(4);
+  data.resize(data.size() - 1);
+  int fds[2];
+  ASSERT_EQ(::pipe(fds), 0);
+  ASSERT_EQ(::write(fds[1], data.data(), data.size()),
+            static_cast<ssize_t>(data.size()));
+  ::close(fds[1]);
+  EntryStreamReader reader(fds[0]);
+  EntryBatch batch;
+  while (reader.ReadBatch(&batch, 256)) {
+  }
+  EXPECT_TRUE(reader.error());
+  EXPECT_EQ(reader.entry_count(), 3);
+  ::close(fds[0]);
+}
+
+}  // anonymous namespace
+}  // namespace kythe
@@ -16,9 +16,40 @@
 
 #include "file_utils.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <thread>
+#include <utility>
+
+#include "absl/status/status.h"
 #include "glog/logging.h"
+#include "kythe/cxx/common/status.h"
 
 namespace kythe {
+namespace {
+
+/// Reads all content from `fd` into `out`. Used for files that can't be
+/// mapped; `fd` may not support seeking.
+absl::Status ReadAll(int fd, std::string* out) {
+  char buffer[1 << 16];
+  for (;;) {
+    ssize_t nread = read(fd, buffer, sizeof(buffer));
+    if (nread < 0) {
+      if (errno == EINTR) continue;
+      return ErrnoToStatus(errno);
+    }
+    if (nread == 0) return absl::OkStatus();
+    out->append(buffer, nread);
+  }
+}
+
+}  // anonymous namespace
 
 std::string LoadFileOrDie(const std::string& file) {
   FILE* handle = fopen(file.c_str(), "rb");
@@ -34,4 +65,84 @@ std::string LoadFileOrDie(const std::string& file) {
   return content;
 }
 
+StatusOr<MappedFile> MappedFile::Open(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return ErrnoToStatus(errno);
+  MappedFile result;
+  struct stat stat_buf;
+  if (fstat(fd, &stat_buf) == 0 && S_ISREG(stat_buf.st_mode) &&
+      stat_buf.st_size > 0) {
+    void* mapping =
+        mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      result.mapped_ = static_cast<const char*>(mapping);
+      result.mapped_size_ = stat_buf.st_size;
+      close(fd);
+      return result;
+    }
+  }
+  absl::Status status = ReadAll(fd, &result.fallback_);
+  close(fd);
+  if (!status.ok()) return status;
+  return result;
+}
+
+std::vector<StatusOr<MappedFile>> MappedFile::OpenBatch(
+    const std::vector<std::string>& paths) {
+  std::vector<StatusOr<MappedFile>> results;
+  results.reserve(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    results.push_back(absl::UnknownError("unopened"));
+  }
+  size_t thread_count = std::min<size_t>(
+      paths.size(), std::max(1u, std::thread::hardware_concurrency()));
+  if (thread_count <= 1) {
+    for (size_t i = 0; i < paths.size(); ++i) {
+      results[i] = Open(paths[i]);
+    }
+    return results;
+  }
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  workers.reserve(thread_count);
+  for (size_t t = 0; t < thread_count; ++t) {
+    workers.emplace_back([&] {
+      for (size_t i = next.fetch_add(1); i < paths.size();
+           i = next.fetch_add(1)) {
+        results[i] = Open(paths[i]);
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+  return results;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : mapped_(other.mapped_),
+      mapped_size_(other.mapped_size_),
+      fallback_(std::move(other.fallback_)) {
+  other.mapped_ = nullptr;
+  other.mapped_size_ = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    if (mapped_ != nullptr) {
+      munmap(const_cast<char*>(mapped_), mapped_size_);
+    }
+    mapped_ = other.mapped_;
+    mapped_size_ = other.mapped_size_;
+    fallback_ = std::move(other.fallback_);
+    other.mapped_ = nullptr;
+    other.mapped_size_ = 0;
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  if (mapped_ != nullptr) {
+    munmap(const_cast<char*>(mapped_), mapped_size_);
+  }
+}
+
 }  // namespace kythe
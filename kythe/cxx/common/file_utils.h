@@ -17,13 +17,58 @@
 #ifndef KYTHE_CXX_COMMON_FILE_UTILS_H_
 #define KYTHE_CXX_COMMON_FILE_UTILS_H_
 
+#include <cstddef>
 #include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "kythe/cxx/common/status_or.h"
 
 namespace kythe {
 
 /// \brief Loads all data from a file or terminates the process.
 std::string LoadFileOrDie(const std::string& file);
 
+/// \brief A read-only view of a file's content.
+///
+/// The content is memory-mapped when possible, so loading copies nothing and
+/// pages are faulted in on demand. Files that can't be mapped (empty files,
+/// pipes, special files) fall back to an owned buffer read through the
+/// descriptor, so `content()` works uniformly either way.
+class MappedFile {
+ public:
+  /// \brief Opens `path` read-only.
+  static StatusOr<MappedFile> Open(const std::string& path);
+
+  /// \brief Opens every path in `paths`, spreading the opens over several
+  /// threads so cold reads overlap instead of serializing.
+  /// \return One result per path, in the same order as `paths`.
+  static std::vector<StatusOr<MappedFile>> OpenBatch(
+      const std::vector<std::string>& paths);
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  /// \brief The file's content; valid for this object's lifetime.
+  absl::string_view content() const {
+    return mapped_ != nullptr ? absl::string_view(mapped_, mapped_size_)
+                              : absl::string_view(fallback_);
+  }
+
+ private:
+  MappedFile() = default;
+
+  /// The mapping, or null if `fallback_` holds the content.
+  const char* mapped_ = nullptr;
+  /// Size of the mapping in bytes.
+  size_t mapped_size_ = 0;
+  /// Owned content for files that couldn't be mapped.
+  std::string fallback_;
+};
+
 }  // namespace kythe
 
 #endif  // KYTHE_CXX_COMMON_FILE_UTILS_H_
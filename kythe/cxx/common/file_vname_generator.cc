@@ -16,11 +16,61 @@
 
 #include "file_vname_generator.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+#include "absl/memory/memory.h"
 #include "glog/logging.h"
 #include "rapidjson/document.h"
 #include "rapidjson/error/en.h"
 
 namespace kythe {
+namespace {
+
+/// The header of a compiled binary rule file: a magic tag and a format
+/// version. The remainder is little-endian and length-prefixed throughout.
+constexpr char kBinaryConfigMagic[] = "KyVN";
+constexpr size_t kBinaryConfigMagicSize = 4;
+constexpr uint32_t kBinaryConfigVersion = 1;
+
+void AppendUint32(std::string* out, uint32_t value) {
+  out->push_back(static_cast<char>(value & 0xFF));
+  out->push_back(static_cast<char>((value >> 8) & 0xFF));
+  out->push_back(static_cast<char>((value >> 16) & 0xFF));
+  out->push_back(static_cast<char>((value >> 24) & 0xFF));
+}
+
+void AppendString(std::string* out, absl::string_view value) {
+  AppendUint32(out, value.size());
+  out->append(value.data(), value.size());
+}
+
+bool ReadUint32(absl::string_view* data, uint32_t* value) {
+  if (data->size() < 4) {
+    return false;
+  }
+  const auto* bytes = reinterpret_cast<const unsigned char*>(data->data());
+  *value = static_cast<uint32_t>(bytes[0]) |
+           static_cast<uint32_t>(bytes[1]) << 8 |
+           static_cast<uint32_t>(bytes[2]) << 16 |
+           static_cast<uint32_t>(bytes[3]) << 24;
+  data->remove_prefix(4);
+  return true;
+}
+
+bool ReadString(absl::string_view* data, absl::string_view* value) {
+  uint32_t size;
+  if (!ReadUint32(data, &size) || data->size() < size) {
+    return false;
+  }
+  *value = data->substr(0, size);
+  data->remove_prefix(size);
+  return true;
+}
+
+}  // anonymous namespace
 
 // FullMatchN supports "3..16 args"
 static constexpr int kMaxRegexArgs = 16;
@@ -83,8 +133,9 @@ bool FileVNameGenerator::ParseRule(const std::string& rule, int max_capture,
   return true;
 }
 
-kythe::proto::VName FileVNameGenerator::LookupBaseVName(
-    const std::string& path) const {
+bool FileVNameGenerator::MatchRule(const VNameRule& rule,
+                                   const std::string& path,
+                                   kythe::proto::VName* result) const {
   re2::StringPiece argv[kMaxRegexArgs];
   RE2::Arg args[kMaxRegexArgs];
   RE2::Arg* arg_pointers[kMaxRegexArgs];
@@ -92,22 +143,62 @@ kythe::proto::VName FileVNameGenerator::LookupBaseVName(
     args[n] = &argv[n];
     arg_pointers[n] = &args[n];
   }
+  // Invariant: capture_groups <= kMaxRegexArgs
+  // RE2 will fail to match if we provide more args than there are captures
+  // for a given regex.
+  int capture_groups = rule.pattern->NumberOfCapturingGroups();
+  if (!RE2::FullMatchN(path, *rule.pattern, arg_pointers, capture_groups)) {
+    return false;
+  }
+  if (!rule.corpus.empty()) {
+    result->set_corpus(ApplyRule(rule.corpus, argv, capture_groups));
+  }
+  if (!rule.root.empty()) {
+    result->set_root(ApplyRule(rule.root, argv, capture_groups));
+  }
+  if (!rule.path.empty()) {
+    result->set_path(ApplyRule(rule.path, argv, capture_groups));
+  }
+  return true;
+}
+
+void FileVNameGenerator::RebuildRuleSet() {
+  rule_set_ =
+      absl::make_unique<re2::RE2::Set>(RE2::DefaultOptions, RE2::ANCHOR_BOTH);
   for (const auto& rule : rules_) {
-    // Invariant: capture_groups <= kMaxRegexArgs
-    // RE2 will fail to match if we provide more args than there are captures
-    // for a given regex.
-    int capture_groups = rule.pattern->NumberOfCapturingGroups();
-    if (RE2::FullMatchN(path, *rule.pattern, arg_pointers, capture_groups)) {
-      kythe::proto::VName result;
-      if (!rule.corpus.empty()) {
-        result.set_corpus(ApplyRule(rule.corpus, argv, capture_groups));
-      }
-      if (!rule.root.empty()) {
-        result.set_root(ApplyRule(rule.root, argv, capture_groups));
-      }
-      if (!rule.path.empty()) {
-        result.set_path(ApplyRule(rule.path, argv, capture_groups));
-      }
+    if (rule_set_->Add(rule.pattern->pattern(), nullptr) < 0) {
+      rule_set_.reset();
+      break;
+    }
+  }
+  if (rule_set_ && !rule_set_->Compile()) {
+    rule_set_.reset();
+  }
+}
+
+kythe::proto::VName FileVNameGenerator::LookupBaseVName(
+    const std::string& path) const {
+  if (rules_.empty()) {
+    return default_vname_;
+  }
+  kythe::proto::VName result;
+  if (rule_set_ != nullptr) {
+    // Classify the path against all rule patterns in one pass; the
+    // lowest-numbered match preserves first-rule-wins semantics.
+    std::vector<int> matching_rules;
+    if (!rule_set_->Match(path, &matching_rules)) {
+      return default_vname_;
+    }
+    size_t first_match =
+        *std::min_element(matching_rules.begin(), matching_rules.end());
+    if (MatchRule(rules_[first_match], path, &result)) {
+      return result;
+    }
+    // The set and FullMatchN should agree; if they don't, fall through to
+    // the linear scan rather than misclassify.
+  }
+  for (const auto& rule : rules_) {
+    if (MatchRule(rule, path, &result)) {
       return result;
     }
   }
@@ -123,12 +214,12 @@ kythe::proto::VName FileVNameGenerator::LookupVName(
   return vname;
 }
 
-bool FileVNameGenerator::LoadJsonString(const std::string& data,
+bool FileVNameGenerator::LoadJsonString(absl::string_view data,
                                         std::string* error_text) {
   CHECK(error_text != nullptr);
   using Value = rapidjson::Value;
   rapidjson::Document document;
-  document.Parse(data.c_str());
+  document.Parse(data.data(), data.size());
   if (document.HasParseError()) {
     if (error_text) {
       *error_text = rapidjson::GetParseError_En(document.GetParseError());
@@ -201,6 +292,130 @@ bool FileVNameGenerator::LoadJsonString(const std::string& data,
     }
     rules_.push_back(next_rule);
   }
+  RebuildRuleSet();
+  return true;
+}
+
+bool FileVNameGenerator::IsBinaryConfig(absl::string_view data) {
+  return data.size() >= kBinaryConfigMagicSize &&
+         memcmp(data.data(), kBinaryConfigMagic, kBinaryConfigMagicSize) == 0;
+}
+
+void FileVNameGenerator::SerializeToBinary(std::string* out) const {
+  out->append(kBinaryConfigMagic, kBinaryConfigMagicSize);
+  AppendUint32(out, kBinaryConfigVersion);
+  AppendUint32(out, rules_.size());
+  for (const auto& rule : rules_) {
+    AppendString(out, rule.pattern->pattern());
+    for (const auto* cons : {&rule.corpus, &rule.root, &rule.path}) {
+      AppendUint32(out, cons->size());
+      for (const auto& node : *cons) {
+        if (node.kind == StringConsNode::Kind::kEmitText) {
+          out->push_back(0);
+          AppendString(out, node.raw_text);
+        } else {
+          out->push_back(1);
+          AppendUint32(out, node.capture_index);
+        }
+      }
+    }
+  }
+}
+
+bool FileVNameGenerator::LoadBinaryString(absl::string_view data,
+                                          std::string* error_text) {
+  CHECK(error_text != nullptr);
+  if (!IsBinaryConfig(data)) {
+    *error_text = "Missing binary vname configuration header.";
+    return false;
+  }
+  data.remove_prefix(kBinaryConfigMagicSize);
+  uint32_t version, rule_count;
+  if (!ReadUint32(&data, &version) || version != kBinaryConfigVersion) {
+    *error_text = "Unsupported binary vname configuration version.";
+    return false;
+  }
+  if (!ReadUint32(&data, &rule_count)) {
+    *error_text = "Truncated binary vname configuration.";
+    return false;
+  }
+  std::vector<VNameRule> loaded;
+  loaded.reserve(rule_count);
+  for (uint32_t n = 0; n < rule_count; ++n) {
+    absl::string_view pattern;
+    if (!ReadString(&data, &pattern)) {
+      *error_text = "Truncated binary vname configuration.";
+      return false;
+    }
+    VNameRule rule;
+    rule.pattern = std::make_shared<RE2>(re2::StringPiece(
+        pattern.data(), pattern.size()));
+    if (rule.pattern->error_code() != RE2::NoError) {
+      *error_text = rule.pattern->error();
+      return false;
+    }
+    int num_captures = rule.pattern->NumberOfCapturingGroups();
+    if (num_captures > kMaxRegexArgs) {
+      *error_text = "Too many captures in pattern.";
+      return false;
+    }
+    for (auto* cons : {&rule.corpus, &rule.root, &rule.path}) {
+      uint32_t node_count;
+      if (!ReadUint32(&data, &node_count)) {
+        *error_text = "Truncated binary vname configuration.";
+        return false;
+      }
+      for (uint32_t i = 0; i < node_count; ++i) {
+        if (data.empty()) {
+          *error_text = "Truncated binary vname configuration.";
+          return false;
+        }
+        const unsigned char kind = data[0];
+        data.remove_prefix(1);
+        StringConsNode node;
+        if (kind == 0) {
+          node.kind = StringConsNode::Kind::kEmitText;
+          absl::string_view text;
+          if (!ReadString(&data, &text)) {
+            *error_text = "Truncated binary vname configuration.";
+            return false;
+          }
+          node.raw_text = std::string(text);
+        } else if (kind == 1) {
+          node.kind = StringConsNode::Kind::kUseSubstitution;
+          uint32_t capture_index;
+          if (!ReadUint32(&data, &capture_index)) {
+            *error_text = "Truncated binary vname configuration.";
+            return false;
+          }
+          if (capture_index >= static_cast<uint32_t>(num_captures)) {
+            *error_text = "Capture index out of range: " +
+                          std::to_string(capture_index);
+            return false;
+          }
+          node.capture_index = capture_index;
+        } else {
+          *error_text = "Unknown node kind in binary vname configuration.";
+          return false;
+        }
+        cons->push_back(node);
+      }
+    }
+    loaded.push_back(std::move(rule));
+  }
+  if (!data.empty()) {
+    *error_text = "Trailing bytes in binary vname configuration.";
+    return false;
+  }
+  rules_.insert(rules_.end(), std::make_move_iterator(loaded.begin()),
+                std::make_move_iterator(loaded.end()));
+  RebuildRuleSet();
   return true;
 }
+
+bool FileVNameGenerator::LoadConfigString(absl::string_view data,
+                                          std::string* error_text) {
+  return IsBinaryConfig(data) ? LoadBinaryString(data, error_text)
+                              : LoadJsonString(data, error_text);
+}
 }  // namespace kythe
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks for FileVNameGenerator lookups. Extractors consult the vname
+// configuration once per required input, so a compilation with tens of
+// thousands of headers pays this path that many times; the rules below
+// mirror the shipped configuration's shape (anchored regexes with capture
+// substitutions), and lookups cycle matching and non-matching paths.
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "glog/logging.h"
+#include "kythe/cxx/common/file_vname_generator.h"
+
+namespace kythe {
+namespace {
+
+const char kBenchmarkConfig[] = R"([
+  {
+    "pattern": "bazel-out/[^/]+/genfiles/(.*)",
+    "vname": {
+      "corpus": "example",
+      "root": "GENERATED",
+      "path": "@1@"
+    }
+  },
+  {
+    "pattern": "(third_party/[^/]+)/include/(.*)",
+    "vname": {
+      "corpus": "third_party",
+      "root": "@1@",
+      "path": "@2@"
+    }
+  },
+  {
+    "pattern": "(/usr/include/c\\+\\+/[^/]+)/(.*)",
+    "vname": {
+      "corpus": "libstdcxx",
+      "root": "@1@",
+      "path": "@2@"
+    }
+  },
+  {
+    "pattern": "/usr/include/(.*)",
+    "vname": {
+      "corpus": "cstdlib",
+      "root": "/usr/include",
+      "path": "@1@"
+    }
+  },
+  {
+    "pattern": "(.*)",
+    "vname": {
+      "corpus": "example",
+      "path": "@1@"
+    }
+  }
+])";
+
+FileVNameGenerator MakeGenerator() {
+  FileVNameGenerator generator;
+  std::string error_text;
+  CHECK(generator.LoadJsonString(kBenchmarkConfig, &error_text)) << error_text;
+  return generator;
+}
+
+// Builds a lookup corpus cycling all the rule shapes, including paths that
+// fall through several patterns before matching.
+std::vector<std::string> MakePaths(int depth) {
+  std::string subdir;
+  for (int i = 0; i < depth; ++i) {
+    absl::StrAppend(&subdir, "nested_directory_", i, "/");
+  }
+  return {
+      absl::StrCat("bazel-out/k8-fastbuild/genfiles/", subdir, "gen.pb.h"),
+      absl::StrCat("third_party/somelib/include/", subdir, "header.h"),
+      absl::StrCat("/usr/include/c++/9/", subdir, "vector"),
+      absl::StrCat("/usr/include/", subdir, "stdio.h"),
+      absl::StrCat("kythe/cxx/common/", subdir, "source.cc"),
+  };
+}
+
+void BM_LookupVName(benchmark::State& state) {
+  const FileVNameGenerator generator = MakeGenerator();
+  const std::vector<std::string> paths = MakePaths(state.range(0));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(generator.LookupVName(paths[i]));
+    i = (i + 1) % paths.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LookupVName)->Range(1, 64);
+
+void BM_LookupBaseVName(benchmark::State& state) {
+  const FileVNameGenerator generator = MakeGenerator();
+  const std::vector<std::string> paths = MakePaths(8);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(generator.LookupBaseVName(paths[i]));
+    i = (i + 1) % paths.size();
+  }
+}
+BENCHMARK(BM_LookupBaseVName);
+
+}  // anonymous namespace
+}  // namespace kythe
+
+BENCHMARK_MAIN();
@@ -76,6 +76,23 @@ TEST(FileVNameGenerator, LookupOrdered) {
             generator.LookupBaseVName("dup/path2").DebugString());
 }
 
+TEST(FileVNameGenerator, LookupOrderedAfterFallback) {
+  FileVNameGenerator generator;
+  std::string error_text;
+  ASSERT_TRUE(generator.LoadJsonString(kSharedTestFile, &error_text))
+      << "Couldn't parse: " << error_text;
+  // Resolving a sibling path through the trailing catch-all first must not
+  // affect a later path that an earlier rule claims.
+  kythe::proto::VName dup_vname;
+  dup_vname.set_corpus("dup");
+  EXPECT_EQ(dup_vname.DebugString(),
+            generator.LookupBaseVName("dup/other").DebugString());
+  kythe::proto::VName first_vname;
+  first_vname.set_corpus("first");
+  EXPECT_EQ(first_vname.DebugString(),
+            generator.LookupBaseVName("dup/path").DebugString());
+}
+
 TEST(FileVNameGenerator, LookupGroups) {
   FileVNameGenerator generator;
   std::string error_text;
@@ -114,6 +131,43 @@ TEST(FileVNameGenerator, LookupGroups) {
           .DebugString());
 }
 
+TEST(FileVNameGenerator, BinaryRoundTrip) {
+  FileVNameGenerator generator;
+  std::string error_text;
+  ASSERT_TRUE(generator.LoadJsonString(kSharedTestFile, &error_text))
+      << "Couldn't parse: " << error_text;
+  std::string compiled;
+  generator.SerializeToBinary(&compiled);
+  ASSERT_TRUE(FileVNameGenerator::IsBinaryConfig(compiled));
+  FileVNameGenerator loaded;
+  ASSERT_TRUE(loaded.LoadConfigString(compiled, &error_text))
+      << "Couldn't load: " << error_text;
+  // The compiled form must classify paths exactly as the JSON it came from.
+  for (const char* path :
+       {"static/path", "dup/path", "dup/path2", "corpus/some/path/here",
+        "grp1/12345/endingGroup",
+        "bazel-bin/kythe/java/some/path/A.jar!/some/path/A.class",
+        "no/rule/matches/this"}) {
+    EXPECT_EQ(generator.LookupBaseVName(path).DebugString(),
+              loaded.LookupBaseVName(path).DebugString())
+        << "path: " << path;
+  }
+}
+
+TEST(FileVNameGenerator, BinaryRejectsCorruptData) {
+  FileVNameGenerator generator;
+  std::string error_text;
+  ASSERT_TRUE(generator.LoadJsonString(kSharedTestFile, &error_text))
+      << "Couldn't parse: " << error_text;
+  std::string compiled;
+  generator.SerializeToBinary(&compiled);
+  FileVNameGenerator loaded;
+  EXPECT_FALSE(loaded.LoadBinaryString(
+      compiled.substr(0, compiled.size() - 1), &error_text));
+  EXPECT_FALSE(loaded.LoadBinaryString(compiled + "x", &error_text));
+  EXPECT_FALSE(loaded.LoadBinaryString("KyVN", &error_text));
+}
+
 TEST(FileVNameGenerator, ActualConfigTests) {
   FileVNameGenerator generator;
   std::string error_text;
@@ -16,4 +16,34 @@
 
 #include "kythe/cxx/common/index_reader.h"
 
-// This file intentionally left blank.
+#include <string>
+#include <utility>
+
+namespace kythe {
+
+absl::Status IndexReaderInterface::ScanUnits(const UnitCallback& scan) {
+  return Scan([&](absl::string_view digest) {
+    return scan(digest, ReadUnit(digest));
+  });
+}
+
+absl::Status IndexReaderInterface::ReadFileInto(absl::string_view digest,
+                                                std::string* contents) {
+  auto data = ReadFile(digest);
+  if (!data.ok()) {
+    return data.status();
+  }
+  *contents = *std::move(data);
+  return absl::OkStatus();
+}
+
+StatusOr<absl::string_view> IndexReaderInterface::ReadFileView(
+    absl::string_view digest, std::string* scratch) {
+  absl::Status status = ReadFileInto(digest, scratch);
+  if (!status.ok()) {
+    return status;
+  }
+  return absl::string_view(*scratch);
+}
+
+}  // namespace kythe
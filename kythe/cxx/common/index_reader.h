@@ -34,6 +34,11 @@ class IndexReaderInterface {
   /// \brief Callback invoked for each available unit digest.
   using ScanCallback = std::function<bool(absl::string_view)>;
 
+  /// \brief Callback invoked for each unit digest and its decoded
+  /// IndexedCompilation (or the error encountered decoding it).
+  using UnitCallback = std::function<bool(
+      absl::string_view, StatusOr<kythe::proto::IndexedCompilation>)>;
+
   IndexReaderInterface() = default;
   // IndexReaderInterface is neither copyable nor movable.
   IndexReaderInterface(const IndexReaderInterface&) = delete;
@@ -44,6 +49,13 @@ class IndexReaderInterface {
   /// returns false.
   virtual absl::Status Scan(const ScanCallback& scan) = 0;
 
+  /// \brief Invokes `scan` for each unit digest and its decoded
+  /// IndexedCompilation, in scan order, or until it returns false.
+  ///
+  /// The default implementation is `Scan` followed by `ReadUnit` per digest;
+  /// implementations may override it to decode units concurrently.
+  virtual absl::Status ScanUnits(const UnitCallback& scan);
+
   /// \brief Reads and returns requested IndexCompilation.
   ///  Returns kNotFound if the digest isn't present.
   virtual StatusOr<kythe::proto::IndexedCompilation> ReadUnit(
@@ -52,12 +64,31 @@ class IndexReaderInterface {
   /// \brief Reads and returns the requested file data.
   ///  Returns kNotFound if the digest isn't present.
   virtual StatusOr<std::string> ReadFile(absl::string_view digest) = 0;
+
+  /// \brief Reads the requested file data into `contents`, reusing its
+  /// capacity. Callers iterating over many files should hold one buffer
+  /// across calls to avoid a string allocation and copy per file.
+  ///  Returns kNotFound if the digest isn't present.
+  ///
+  /// The default implementation delegates to `ReadFile`; implementations
+  /// should override it to decompress directly into `contents`.
+  virtual absl::Status ReadFileInto(absl::string_view digest,
+                                    std::string* contents);
+
+  /// \brief Returns a view of the requested file data, using `scratch` as
+  /// backing storage when the content is not already held in memory. The
+  /// view is valid only until `scratch` is next modified or the reader is
+  /// destroyed, whichever comes first.
+  ///  Returns kNotFound if the digest isn't present.
+  virtual StatusOr<absl::string_view> ReadFileView(absl::string_view digest,
+                                                   std::string* scratch);
 };
 
 /// \brief Pimpl wrapper around IndexReaderInterface.
 class IndexReader {
  public:
   using ScanCallback = IndexReaderInterface::ScanCallback;
+  using UnitCallback = IndexReaderInterface::UnitCallback;
 
   /// \brief Constructs an IndexReader from the provided implementation.
   explicit IndexReader(std::unique_ptr<IndexReaderInterface> impl)
@@ -71,6 +102,12 @@ class IndexReader {
   /// returns false.
   absl::Status Scan(const ScanCallback& scan) { return impl_->Scan(scan); }
 
+  /// \brief Invokes `scan` for each unit digest and its decoded
+  /// IndexedCompilation, in scan order, or until it returns false.
+  absl::Status ScanUnits(const UnitCallback& scan) {
+    return impl_->ScanUnits(scan);
+  }
+
   /// \brief Reads and returns requested IndexCompilation.
   ///  Returns kNotFound if the digest isn't present.
   StatusOr<kythe::proto::IndexedCompilation> ReadUnit(
@@ -84,6 +121,21 @@ class IndexReader {
     return impl_->ReadFile(digest);
   }
 
+  /// \brief Reads the requested file data into `contents`, reusing its
+  /// capacity.
+  ///  Returns kNotFound if the digest isn't present.
+  absl::Status ReadFileInto(absl::string_view digest, std::string* contents) {
+    return impl_->ReadFileInto(digest, contents);
+  }
+
+  /// \brief Returns a view of the requested file data, using `scratch` as
+  /// backing storage when the content is not already held in memory.
+  ///  Returns kNotFound if the digest isn't present.
+  StatusOr<absl::string_view> ReadFileView(absl::string_view digest,
+                                           std::string* scratch) {
+    return impl_->ReadFileView(digest, scratch);
+  }
+
  private:
   std::unique_ptr<IndexReaderInterface> impl_;
 };
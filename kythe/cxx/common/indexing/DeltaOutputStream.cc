@@ -0,0 +1,293 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/indexing/DeltaOutputStream.h"
+
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/io/coded_stream.h"
+
+namespace kythe {
+namespace {
+
+/// The number of delta-encoded VName components.
+constexpr int kComponents = 5;
+/// Header bit marking an edge record.
+constexpr unsigned char kEdgeBit = 1 << 5;
+/// Header bit marking an edge record that carries its kind.
+constexpr unsigned char kKindBit = 1 << 6;
+/// Header bit marking an ordinal edge range record.
+constexpr unsigned char kRangeBit = 1 << 7;
+
+void AppendVarint32(uint32_t value, std::string* out) {
+  unsigned char buffer[5];
+  unsigned char* end =
+      google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(value,
+                                                                    buffer);
+  out->append(reinterpret_cast<char*>(buffer), end - buffer);
+}
+
+void AppendLengthPrefixed(absl::string_view data, std::string* out) {
+  AppendVarint32(data.size(), out);
+  out->append(data.data(), data.size());
+}
+
+/// \brief Reads a varint32-length-prefixed string into `out`.
+bool ReadLengthPrefixed(google::protobuf::io::CodedInputStream* input,
+                        std::string* out) {
+  uint32_t length;
+  return input->ReadVarint32(&length) && input->ReadString(out, length);
+}
+
+/// \brief Points `field` at the `index`th component of `vname` in mask-bit
+/// order.
+std::string* MutableComponent(proto::VName* vname, int index) {
+  switch (index) {
+    case 0:
+      return vname->mutable_signature();
+    case 1:
+      return vname->mutable_corpus();
+    case 2:
+      return vname->mutable_root();
+    case 3:
+      return vname->mutable_path();
+    default:
+      return vname->mutable_language();
+  }
+}
+
+/// \brief Reads the components selected by `mask` into `vname`, leaving the
+/// unselected ones at their previous values.
+bool ReadVNameDelta(google::protobuf::io::CodedInputStream* input,
+                    unsigned char mask, proto::VName* vname) {
+  for (int i = 0; i < kComponents; ++i) {
+    if ((mask & (1 << i)) != 0 &&
+        !ReadLengthPrefixed(input, MutableComponent(vname, i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // anonymous namespace
+
+DeltaOutputStream::~DeltaOutputStream() {
+  FlushStaged();
+  stream_->Flush();
+}
+
+unsigned char DeltaOutputStream::DeltaVName(const VNameRef& vname,
+                                            VNameState* last,
+                                            std::string* record) {
+  const absl::string_view components[kComponents] = {
+      vname.signature(), vname.corpus(), vname.root(), vname.path(),
+      vname.language()};
+  unsigned char mask = 0;
+  for (int i = 0; i < kComponents; ++i) {
+    if (components[i] != last->components[i]) {
+      mask |= 1 << i;
+      AppendLengthPrefixed(components[i], record);
+      last->components[i].assign(components[i].data(), components[i].size());
+    }
+  }
+  return mask;
+}
+
+void DeltaOutputStream::Emit(const FactRef& fact) {
+  record_.clear();
+  record_.push_back('\0');  // Header byte, patched below.
+  unsigned char header = DeltaVName(*fact.source, &last_source_, &record_);
+  record_[0] = header;
+  AppendLengthPrefixed(fact.fact_name, &record_);
+  AppendLengthPrefixed(fact.fact_value, &record_);
+  StageRecord();
+}
+
+void DeltaOutputStream::Emit(const EdgeRef& edge) {
+  EmitEdge(*edge.source, edge.edge_kind, *edge.target);
+}
+
+void DeltaOutputStream::Emit(const OrdinalEdgeRef& edge) {
+  kind_scratch_ = absl::StrCat(edge.edge_kind, ".", edge.ordinal);
+  EmitEdge(*edge.source, kind_scratch_, *edge.target);
+}
+
+void DeltaOutputStream::Emit(const OrdinalEdgeRangeRef& range) {
+  if (range.target_count == 0) {
+    return;
+  }
+  if (range.target_count == 1) {
+    Emit(OrdinalEdgeRef{range.source, range.edge_kind, range.targets,
+                        range.first_ordinal});
+    return;
+  }
+  record_.clear();
+  record_.push_back('\0');  // Header byte, patched below.
+  AppendVarint32(range.target_count, &record_);
+  AppendVarint32(range.first_ordinal, &record_);
+  unsigned char header =
+      kEdgeBit | kRangeBit | DeltaVName(*range.source, &last_source_, &record_);
+  if (range.edge_kind != last_kind_) {
+    header |= kKindBit;
+    AppendLengthPrefixed(range.edge_kind, &record_);
+    last_kind_.assign(range.edge_kind.data(), range.edge_kind.size());
+  }
+  for (size_t i = 0; i < range.target_count; ++i) {
+    size_t mask_index = record_.size();
+    record_.push_back('\0');  // Target mask byte, patched below.
+    unsigned char target_mask =
+        DeltaVName(range.targets[i], &last_target_, &record_);
+    record_[mask_index] = target_mask;
+  }
+  record_[0] = header;
+  StageRecord();
+}
+
+void DeltaOutputStream::EmitEdge(const VNameRef& source,
+                                 absl::string_view kind,
+                                 const VNameRef& target) {
+  record_.clear();
+  record_.append(2, '\0');  // Header and target mask bytes, patched below.
+  unsigned char header =
+      kEdgeBit | DeltaVName(source, &last_source_, &record_);
+  unsigned char target_mask = DeltaVName(target, &last_target_, &record_);
+  if (kind != last_kind_) {
+    header |= kKindBit;
+    AppendLengthPrefixed(kind, &record_);
+    last_kind_.assign(kind.data(), kind.size());
+  }
+  record_[0] = header;
+  record_[1] = target_mask;
+  StageRecord();
+}
+
+void DeltaOutputStream::StageRecord() {
+  AppendVarint32(record_.size(), &staged_);
+  staged_.append(record_);
+  if (staged_.size() >= kStagedLimit) {
+    FlushStaged();
+  }
+}
+
+void DeltaOutputStream::FlushStaged() {
+  if (staged_.empty()) {
+    return;
+  }
+  {
+    google::protobuf::io::CodedOutputStream coded_stream(stream_);
+    coded_stream.WriteRaw(staged_.data(), staged_.size());
+  }
+  staged_.clear();
+}
+
+bool DecodeDeltaEntryStream(
+    google::protobuf::io::ZeroCopyInputStream* stream,
+    const std::function<bool(const proto::Entry&)>& callback) {
+  proto::VName source;
+  proto::VName target;
+  std::string kind;
+  std::string fact_name;
+  std::string fact_value;
+  proto::Entry entry;
+  for (;;) {
+    // A fresh CodedInputStream per record keeps its byte limits from
+    // accumulating over arbitrarily long streams; position is retained by
+    // the underlying stream.
+    google::protobuf::io::CodedInputStream input(stream);
+    uint32_t record_size;
+    if (!input.ReadVarint32(&record_size)) {
+      // A clean end of stream falls exactly on a record boundary; a failure
+      // after consuming bytes means a truncated length prefix.
+      return input.CurrentPosition() == 0;
+    }
+    auto limit = input.PushLimit(record_size);
+    unsigned char header;
+    if (!input.ReadRaw(&header, 1)) {
+      return false;
+    }
+    entry.Clear();
+    if ((header & kRangeBit) != 0) {
+      if ((header & kEdgeBit) == 0) {
+        return false;
+      }
+      uint32_t target_count;
+      uint32_t first_ordinal;
+      if (!input.ReadVarint32(&target_count) ||
+          !input.ReadVarint32(&first_ordinal) ||
+          !ReadVNameDelta(&input, header, &source)) {
+        return false;
+      }
+      // Range records store the bare edge kind; the ordinal suffix is
+      // reconstituted per target below.
+      if ((header & kKindBit) != 0 && !ReadLengthPrefixed(&input, &kind)) {
+        return false;
+      }
+      for (uint32_t i = 0; i < target_count; ++i) {
+        unsigned char target_mask;
+        if (!input.ReadRaw(&target_mask, 1) ||
+            !ReadVNameDelta(&input, target_mask, &target)) {
+          return false;
+        }
+        entry.Clear();
+        *entry.mutable_source() = source;
+        *entry.mutable_target() = target;
+        entry.set_edge_kind(absl::StrCat(kind, ".", first_ordinal + i));
+        entry.set_fact_name("/");
+        if (!callback(entry)) {
+          return true;
+        }
+      }
+      if (input.BytesUntilLimit() != 0) {
+        return false;
+      }
+      input.PopLimit(limit);
+      continue;
+    }
+    if ((header & kEdgeBit) != 0) {
+      unsigned char target_mask;
+      if (!input.ReadRaw(&target_mask, 1) ||
+          !ReadVNameDelta(&input, header, &source) ||
+          !ReadVNameDelta(&input, target_mask, &target)) {
+        return false;
+      }
+      if ((header & kKindBit) != 0 && !ReadLengthPrefixed(&input, &kind)) {
+        return false;
+      }
+      *entry.mutable_source() = source;
+      *entry.mutable_target() = target;
+      entry.set_edge_kind(kind);
+      // Edge entries in the flat stream carry the "/" fact name.
+      entry.set_fact_name("/");
+    } else {
+      if (!ReadVNameDelta(&input, header, &source) ||
+          !ReadLengthPrefixed(&input, &fact_name) ||
+          !ReadLengthPrefixed(&input, &fact_value)) {
+        return false;
+      }
+      *entry.mutable_source() = source;
+      entry.set_fact_name(fact_name);
+      entry.set_fact_value(fact_value);
+    }
+    if (input.BytesUntilLimit() != 0) {
+      return false;
+    }
+    input.PopLimit(limit);
+    if (!callback(entry)) {
+      return true;
+    }
+  }
+}
+
+}  // namespace kythe
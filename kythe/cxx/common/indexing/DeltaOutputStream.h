@@ -0,0 +1,130 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_COMMON_INDEXING_DELTA_OUTPUT_STREAM_H_
+#define KYTHE_CXX_COMMON_INDEXING_DELTA_OUTPUT_STREAM_H_
+
+#include <functional>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "kythe/cxx/common/indexing/KytheCachingOutput.h"
+#include "kythe/proto/storage.pb.h"
+
+namespace kythe {
+
+/// \brief A `KytheCachingOutput` that writes entries in a delta-encoded
+/// framing, eliding VName components repeated from the previous entry.
+///
+/// Successive entries nearly always share corpus, root, and path (and very
+/// often the whole source VName), yet the flat entry stream serializes every
+/// VName in full; the repeated components dominate output bytes. In this
+/// framing each record carries only the components that changed; an absent
+/// component repeats the previous entry's value. `DecodeDeltaEntryStream`
+/// re-expands the stream into ordinary `Entry` messages.
+///
+/// Each record is preceded by its varint32 length. A record begins with a
+/// header byte:
+///   bits 0-4  mask of source VName components present, in the order
+///             signature, corpus, root, path, language;
+///   bit 5     the record is an edge (otherwise a fact);
+///   bit 6     for edges: the edge kind is present (otherwise repeated).
+/// Edge records continue with a target mask byte (bits 0-4 as above), the
+/// present source components, the present target components, and the edge
+/// kind if present. Fact records continue with the present source components,
+/// the fact name, and the fact value. Every component, kind, and name is a
+/// varint32 length followed by that many bytes. Ordinal edge kinds are
+/// folded into the kind string ("kind.ordinal"), as in the flat stream.
+///
+/// Bit 7 of the header marks an ordinal edge range: a run of edges sharing
+/// a source and kind with consecutive ordinals (every parameter of a
+/// function, say). The record carries the target count and first ordinal as
+/// varint32s after the header, then the present source components, the bare
+/// edge kind if present (without the ".ordinal" suffix), and one delta-coded
+/// target per edge (a mask byte followed by the present components). The
+/// decoder re-expands the run into "kind.ordinal" entries, so a range is
+/// indistinguishable from the flat form downstream but never repeats the
+/// kind string per edge.
+///
+/// Buffer-stack deduplication is not supported in this mode: entries must
+/// reach the stream in emission order for the deltas to mean anything.
+class DeltaOutputStream : public KytheCachingOutput {
+ public:
+  explicit DeltaOutputStream(google::protobuf::io::FileOutputStream* stream)
+      : stream_(stream) {}
+
+  ~DeltaOutputStream() override;
+
+  void Emit(const FactRef& fact) override;
+  void Emit(const EdgeRef& edge) override;
+  void Emit(const OrdinalEdgeRef& edge) override;
+  void Emit(const OrdinalEdgeRangeRef& range) override;
+
+ private:
+  /// \brief The last-written value of each component of a VName.
+  struct VNameState {
+    /// Components in mask-bit order (signature, corpus, root, path,
+    /// language).
+    std::string components[5];
+  };
+
+  /// \brief Appends the components of `vname` that differ from `last` to
+  /// `record` (updating `last`) and returns their presence mask.
+  static unsigned char DeltaVName(const VNameRef& vname, VNameState* last,
+                                  std::string* record);
+
+  /// \brief Frames one edge record.
+  void EmitEdge(const VNameRef& source, absl::string_view kind,
+                const VNameRef& target);
+
+  /// \brief Stages `record_` (length-delimited) for the next coalesced
+  /// write.
+  void StageRecord();
+
+  /// \brief Writes any staged records to the output stream in one pass.
+  void FlushStaged();
+
+  /// The output stream to write on.
+  google::protobuf::io::FileOutputStream* stream_;
+  /// The source VName of the previous entry.
+  VNameState last_source_;
+  /// The target VName of the previous edge.
+  VNameState last_target_;
+  /// The kind of the previous edge.
+  std::string last_kind_;
+  /// Scratch storage for the record being framed.
+  std::string record_;
+  /// Scratch storage for ordinal edge kinds.
+  std::string kind_scratch_;
+  /// Records staged for the next coalesced write.
+  std::string staged_;
+  /// Flush `staged_` once it grows past this many bytes.
+  static constexpr size_t kStagedLimit = 64 * 1024;
+};
+
+/// \brief Decodes a delta-encoded entry stream, invoking `callback` with
+/// each re-expanded `Entry` in stream order.
+///
+/// Stops early (returning true) if `callback` returns false.
+/// \return false if the stream is malformed.
+bool DecodeDeltaEntryStream(
+    google::protobuf::io::ZeroCopyInputStream* stream,
+    const std::function<bool(const proto::Entry&)>& callback);
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_INDEXING_DELTA_OUTPUT_STREAM_H_
@@ -16,41 +16,171 @@
 
 #include "kythe/cxx/common/indexing/KytheCachingOutput.h"
 
+#include <unistd.h>
+
 #include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <sstream>
 
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "kythe/cxx/common/indexing/MemoryAccounting.h"
+#include "kythe/cxx/common/io_metrics.h"
 
 namespace kythe {
+namespace {
+/// \return the byte counter for framed entries staged in output buffers.
+MemoryCounter& OutputBufferCounter() {
+  static auto* counter = new MemoryCounter("output buffers");
+  return *counter;
+}
+
+/// \return the throughput metric for entry output: bytes handed to the
+/// stream (or async writer) and time the emitting thread spent doing so,
+/// including any stall waiting for in-flight writes.
+IoMetric& OutputWriteMetric() {
+  static auto* metric = new IoMetric("index.output");
+  return *metric;
+}
+}  // anonymous namespace
+
+AsyncBlockWriter::AsyncBlockWriter(int fd)
+    : fd_(fd), writer_([this] { WriteLoop(); }) {}
+
+AsyncBlockWriter::~AsyncBlockWriter() {
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    exiting_ = true;
+  }
+  wake_writer_.notify_one();
+  writer_.join();
+}
+
+std::vector<unsigned char> AsyncBlockWriter::SubmitBlock(
+    std::vector<unsigned char> block) {
+  std::vector<unsigned char> recycled;
+  std::unique_lock<std::mutex> lock(mu_);
+  write_completed_.wait(
+      lock, [this] { return in_flight_bytes_ < kMaxInFlightBytes; });
+  in_flight_bytes_ += block.size();
+  queue_.push_back(std::move(block));
+  if (!free_blocks_.empty()) {
+    recycled = std::move(free_blocks_.back());
+    free_blocks_.pop_back();
+  }
+  lock.unlock();
+  wake_writer_.notify_one();
+  return recycled;
+}
+
+void AsyncBlockWriter::Drain() {
+  std::unique_lock<std::mutex> lock(mu_);
+  write_completed_.wait(lock, [this] { return in_flight_bytes_ == 0; });
+}
+
+void AsyncBlockWriter::WriteLoop() {
+  std::unique_lock<std::mutex> lock(mu_);
+  for (;;) {
+    wake_writer_.wait(lock, [this] { return !queue_.empty() || exiting_; });
+    if (queue_.empty()) {
+      // `exiting_` is set and everything submitted has been written.
+      return;
+    }
+    std::vector<unsigned char> block = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    size_t written = 0;
+    while (written < block.size()) {
+      ssize_t result =
+          ::write(fd_, block.data() + written, block.size() - written);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        ::perror("Error writing output file");
+        ::exit(1);
+      }
+      written += static_cast<size_t>(result);
+    }
+    lock.lock();
+    in_flight_bytes_ -= block.size();
+    block.clear();
+    if (free_blocks_.size() < kMaxFreeBlocks) {
+      // Keep the storage (and its capacity) for the next submission.
+      free_blocks_.push_back(std::move(block));
+    }
+    write_completed_.notify_all();
+  }
+}
+
 std::string FileOutputStream::Stats::ToString() const {
   return absl::StrCat(
       buffers_merged_, " merged ", buffers_split_, " split ", buffers_retired_,
-      " retired ", hashes_matched_, " matches ",
+      " retired ", hashes_matched_, " matches ", buffers_allocated_,
+      " allocated ", windows_adapted_, " adaptations ",
       (buffers_retired_ ? (total_bytes_ / buffers_retired_) : 0),
       " bytes/buffer");
 }
 
+void FileOutputStream::set_compress_output(bool value) {
+  if (value && gzip_stream_ == nullptr) {
+    gzip_stream_ =
+        std::make_unique<google::protobuf::io::GzipOutputStream>(stream_);
+  } else if (!value) {
+    gzip_stream_.reset();
+  }
+}
+
+void FileOutputStream::set_async_write_fd(int fd) {
+  assert(gzip_stream_ == nullptr && "async writes bypass the compressor");
+  async_writer_ = std::make_unique<AsyncBlockWriter>(fd);
+}
+
 FileOutputStream::~FileOutputStream() {
   while (!buffers_.empty()) {
     // Shake out any less-than-minimum-sized buffers that remain.
     EmitAndReleaseTopBuffer();
   }
+  FlushDirectBuffer();
+  // Wait for any writes still in flight before the descriptor's owner can
+  // close it.
+  async_writer_.reset();
+  // Closing the gzip stream writes the member trailer; it must land before
+  // the file stream goes away.
+  gzip_stream_.reset();
   if (show_stats_) {
-    absl::FPrintF(stderr, "%s\n", stats_.ToString());
+    stats_.buffers_allocated_ = buffers_.fresh_allocations();
+    absl::FPrintF(stderr, "%s\n%s", stats_.ToString(),
+                  MemoryCounter::DumpAll());
     fflush(stderr);
   }
 }
 
 void FileOutputStream::EnqueueEntry(const proto::Entry& entry) {
   if (cache_ == &default_cache_ || buffers_.empty()) {
-    {
-      google::protobuf::io::CodedOutputStream coded_stream(stream_);
-      coded_stream.WriteVarint32(entry.ByteSize());
-      entry.SerializeToCodedStream(&coded_stream);
+    // Frame the entry into the staging buffer instead of constructing a
+    // CodedOutputStream (and paying a stream flush) per entry; the staged
+    // bytes go out in one coalesced write.
+    size_t entry_size = entry.ByteSize();
+    size_t size_size =
+        google::protobuf::io::CodedOutputStream::VarintSize32(entry_size);
+    size_t insertion_point = direct_buffer_.size();
+    direct_buffer_.resize(insertion_point + size_size + entry_size);
+    OutputBufferCounter().Add(size_size + entry_size);
+    unsigned char* buffer = &direct_buffer_[insertion_point];
+    google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(entry_size,
+                                                                  buffer);
+    if (!entry.SerializeToArray(&buffer[size_size], entry_size)) {
+      assert(0 && "bad proto size calculation");
     }
-    if (flush_after_each_entry_) {
-      stream_->Flush();
+    if (flush_after_each_entry_ || direct_buffer_.size() >= kDirectBufferLimit) {
+      FlushDirectBuffer();
+      if (flush_after_each_entry_) {
+        FlushStream();
+      }
     }
     return;
   }
@@ -67,6 +197,12 @@ void FileOutputStream::EnqueueEntry(const proto::Entry& entry) {
     assert(0 && "bad proto size calculation");
   }
   stats_.total_bytes_ += size_delta;
+  OutputBufferCounter().Add(size_delta);
+  if (cache_->RequiresCryptographicHash()) {
+    // Fold the freshly-serialized bytes into the running hash while they're
+    // still cache-hot instead of re-walking the whole buffer at emit time.
+    buffers_.HashPendingTop();
+  }
 
   if (buffers_.top_size() >= max_size_) {
     ++stats_.buffers_split_;
@@ -75,20 +211,83 @@ void FileOutputStream::EnqueueEntry(const proto::Entry& entry) {
   }
 }
 
+void FileOutputStream::FlushDirectBuffer() {
+  if (direct_buffer_.empty()) {
+    return;
+  }
+  OutputBufferCounter().Remove(direct_buffer_.size());
+  ScopedIoTimer timer(&OutputWriteMetric(), direct_buffer_.size());
+  if (async_writer_ != nullptr) {
+    // Hand the staged bytes to the writer thread and keep serializing into
+    // recycled storage while they're in flight.
+    direct_buffer_ = async_writer_->SubmitBlock(std::move(direct_buffer_));
+    return;
+  }
+  {
+    google::protobuf::io::CodedOutputStream coded_stream(out());
+    coded_stream.WriteRaw(direct_buffer_.data(), direct_buffer_.size());
+  }
+  direct_buffer_.clear();
+}
+
 void FileOutputStream::EmitAndReleaseTopBuffer() {
+  // Staged direct writes must land before any deduplicated buffer content to
+  // keep the entry stream in emission order.
+  FlushDirectBuffer();
   HashCache::Hash hash;
-  buffers_.HashTop(&hash);
+  buffers_.HashTop(&hash, cache_->RequiresCryptographicHash());
   if (!cache_->SawHash(hash)) {
-    buffers_.CopyTopToStream(stream_);
+    if (async_writer_ != nullptr) {
+      OutputBufferCounter().Add(buffers_.top_size());
+      buffers_.AppendTopToVector(&direct_buffer_);
+      FlushDirectBuffer();
+    } else {
+      ScopedIoTimer timer(&OutputWriteMetric(), buffers_.top_size());
+      buffers_.CopyTopToStream(out());
+    }
     if (flush_after_each_entry_) {
-      stream_->Flush();
+      FlushStream();
     }
     cache_->RegisterHash(hash);
   } else {
     ++stats_.hashes_matched_;
   }
+  OutputBufferCounter().Remove(buffers_.top_size());
   buffers_.Pop();
   ++stats_.buffers_retired_;
+  if (adaptive_size_limits_ &&
+      stats_.buffers_retired_ - adapted_at_retired_ >= kAdaptationInterval) {
+    AdaptSizeLimits();
+  }
+}
+
+void FileOutputStream::AdaptSizeLimits() {
+  // Bounds the controller may move the window within, regardless of the
+  // configured starting point.
+  constexpr size_t kSmallestWindow = 4 * 1024;
+  constexpr size_t kLargestWindow = 1024 * 1024;
+  // Hit fractions below which the window shrinks and above which it grows.
+  constexpr double kLowHitRate = 0.05;
+  constexpr double kHighHitRate = 0.25;
+  size_t retired = stats_.buffers_retired_ - adapted_at_retired_;
+  size_t matched = stats_.hashes_matched_ - adapted_at_matched_;
+  adapted_at_retired_ = stats_.buffers_retired_;
+  adapted_at_matched_ = stats_.hashes_matched_;
+  double hit_rate = static_cast<double>(matched) / retired;
+  size_t new_max = max_size_;
+  if (hit_rate < kLowHitRate) {
+    // Rarely matching: finer-grained buffers give dedup more chances.
+    new_max = std::max(max_size_ / 2, kSmallestWindow);
+  } else if (hit_rate > kHighHitRate) {
+    // Matching freely: larger buffers keep the matches while halving the
+    // number of hash probes and cache round trips.
+    new_max = std::min(max_size_ * 2, kLargestWindow);
+  }
+  if (new_max != max_size_) {
+    max_size_ = new_max;
+    min_size_ = max_size_ / 8;
+    ++stats_.windows_adapted_;
+  }
 }
 
 void FileOutputStream::PushBuffer() { buffers_.Push(max_size_); }
@@ -19,11 +19,20 @@
 
 #include <openssl/sha.h>
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "absl/strings/string_view.h"
 #include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "kythe/cxx/common/indexing/KytheOutputStream.h"
 #include "kythe/proto/common.pb.h"
@@ -40,6 +49,21 @@ class HashCache {
   virtual void RegisterHash(const Hash& hash) {}
   /// \return true if `hash` has been seen before.
   virtual bool SawHash(const Hash& hash) { return false; }
+  /// \brief Batched form of `SawHash`: sets `saw[i]` for each of the `count`
+  /// hashes in `hashes`. Remote caches can answer the whole batch in one
+  /// round trip; the default implementation loops over `SawHash`.
+  virtual void SawHashes(const Hash* hashes, size_t count, bool* saw) {
+    for (size_t i = 0; i < count; ++i) {
+      saw[i] = SawHash(hashes[i]);
+    }
+  }
+  /// \brief Whether this cache requires a cryptographic hash.
+  ///
+  /// Caches whose hashes never leave the indexing process don't need
+  /// collision resistance against adversarial input and may return false
+  /// here, allowing producers to substitute a much cheaper 128-bit mix.
+  /// Caches shared across processes or machines must keep the default.
+  virtual bool RequiresCryptographicHash() const { return true; }
   /// \brief Sets guidelines about the amount of source data per hash.
   /// \param min_size no fewer than this many bytes should be hashed.
   /// \param max_size no more than this many bytes should be hashed.
@@ -55,6 +79,170 @@ class HashCache {
   size_t max_size_ = 32 * 1024;
 };
 
+/// \brief A lock-free in-process `HashCache` backed by a fixed-size
+/// open-addressing table.
+///
+/// Each hash is reduced to a 64-bit tag stored in an atomic slot; lookups and
+/// inserts probe linearly and inserts publish with a single compare-exchange,
+/// so concurrent writers never block. The table does not grow: once a probe
+/// sequence is exhausted the hash is treated as unseen, which only costs a
+/// duplicate emit, never a dropped one.
+class LocalHashCache : public HashCache {
+ public:
+  /// \param min_slots The minimum number of table slots (rounded up to a
+  /// power of two).
+  explicit LocalHashCache(size_t min_slots = 1 << 20) {
+    size_t slots = 1;
+    while (slots < min_slots) {
+      slots *= 2;
+    }
+    mask_ = slots - 1;
+    table_ = std::make_unique<std::atomic<uint64_t>[]>(slots);
+    for (size_t i = 0; i <= mask_; ++i) {
+      table_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+  void RegisterHash(const Hash& hash) override {
+    uint64_t tag = Tag(hash);
+    size_t slot = tag & mask_;
+    for (size_t probe = 0; probe < kMaxProbes; ++probe) {
+      uint64_t expected = 0;
+      if (table_[slot].compare_exchange_strong(expected, tag,
+                                               std::memory_order_release,
+                                               std::memory_order_acquire) ||
+          expected == tag) {
+        return;
+      }
+      slot = (slot + 1) & mask_;
+    }
+    // Table region is full; drop the registration (safe, see class comment).
+  }
+  bool SawHash(const Hash& hash) override {
+    uint64_t tag = Tag(hash);
+    size_t slot = tag & mask_;
+    for (size_t probe = 0; probe < kMaxProbes; ++probe) {
+      uint64_t stored = table_[slot].load(std::memory_order_acquire);
+      if (stored == 0) {
+        return false;
+      }
+      if (stored == tag) {
+        return true;
+      }
+      slot = (slot + 1) & mask_;
+    }
+    return false;
+  }
+  /// This cache is strictly in-process, so a non-cryptographic hash is fine
+  /// (the table already folds hashes down to 64-bit tags).
+  bool RequiresCryptographicHash() const override { return false; }
+
+ private:
+  /// \brief Folds a full hash down to a nonzero 64-bit tag (zero marks an
+  /// empty slot).
+  static uint64_t Tag(const Hash& hash) {
+    uint64_t tag;
+    memcpy(&tag, hash, sizeof(tag));
+    return tag == 0 ? 1 : tag;
+  }
+  /// The longest linear probe sequence before giving up.
+  static constexpr size_t kMaxProbes = 64;
+  /// The table size minus one (the table size is a power of two).
+  size_t mask_;
+  /// The open-addressing slot array.
+  std::unique_ptr<std::atomic<uint64_t>[]> table_;
+};
+
+/// \brief A `HashCache` that layers a fast in-process cache in front of a
+/// remote one.
+///
+/// Probes are answered from the local layer when possible; only misses fall
+/// through to the remote layer, and remote hits are copied back into the
+/// local layer so they repeat for free. Registrations land in the local
+/// layer immediately and are forwarded to the remote layer in write-behind
+/// batches, so `SawHash` never pays a round trip for a hash this process
+/// registered, and registration cost is amortized over a batch (the remote
+/// layer's own request buffering overlaps the flush with server
+/// processing).
+class TieredHashCache : public HashCache {
+ public:
+  TieredHashCache(std::unique_ptr<HashCache> local,
+                  std::unique_ptr<HashCache> remote)
+      : local_(std::move(local)), remote_(std::move(remote)) {}
+  ~TieredHashCache() override { FlushRegistrations(); }
+  void RegisterHash(const Hash& hash) override {
+    if (local_->SawHash(hash)) {
+      // Already registered (and queued or forwarded) by this process.
+      return;
+    }
+    local_->RegisterHash(hash);
+    pending_registrations_.emplace_back();
+    memcpy(pending_registrations_.back().data(), hash, kHashSize);
+    if (pending_registrations_.size() >= kMaxPendingRegistrations) {
+      FlushRegistrations();
+    }
+  }
+  bool SawHash(const Hash& hash) override {
+    if (local_->SawHash(hash)) {
+      return true;
+    }
+    if (remote_->SawHash(hash)) {
+      local_->RegisterHash(hash);
+      return true;
+    }
+    return false;
+  }
+  void SawHashes(const Hash* hashes, size_t count, bool* saw) override {
+    // Answer what we can locally; only the misses go out in one batch.
+    std::vector<size_t> misses;
+    for (size_t i = 0; i < count; ++i) {
+      saw[i] = local_->SawHash(hashes[i]);
+      if (!saw[i]) {
+        misses.push_back(i);
+      }
+    }
+    if (misses.empty()) {
+      return;
+    }
+    std::vector<std::array<unsigned char, kHashSize>> miss_hashes(
+        misses.size());
+    for (size_t i = 0; i < misses.size(); ++i) {
+      memcpy(miss_hashes[i].data(), hashes[misses[i]], kHashSize);
+    }
+    std::unique_ptr<bool[]> remote_saw(new bool[misses.size()]);
+    remote_->SawHashes(reinterpret_cast<const Hash*>(miss_hashes.data()),
+                       misses.size(), remote_saw.get());
+    for (size_t i = 0; i < misses.size(); ++i) {
+      if (remote_saw[i]) {
+        saw[misses[i]] = true;
+        local_->RegisterHash(hashes[misses[i]]);
+      }
+    }
+  }
+  /// The remote layer's hashes leave the process, so the tier needs a
+  /// cryptographic hash whenever either layer does.
+  bool RequiresCryptographicHash() const override {
+    return local_->RequiresCryptographicHash() ||
+           remote_->RequiresCryptographicHash();
+  }
+
+ private:
+  /// \brief Forwards queued registrations to the remote layer.
+  void FlushRegistrations() {
+    for (const auto& hash : pending_registrations_) {
+      remote_->RegisterHash(*reinterpret_cast<const Hash*>(hash.data()));
+    }
+    pending_registrations_.clear();
+  }
+  /// The in-process front layer.
+  std::unique_ptr<HashCache> local_;
+  /// The shared back layer.
+  std::unique_ptr<HashCache> remote_;
+  /// Registrations not yet forwarded to the remote layer.
+  std::vector<std::array<unsigned char, kHashSize>> pending_registrations_;
+  /// Forward queued registrations after this many accumulate.
+  static constexpr size_t kMaxPendingRegistrations = 256;
+};
+
 // Interface for receiving Kythe data.
 class KytheCachingOutput : public KytheOutputStream {
  public:
@@ -76,15 +264,45 @@ class BufferStack {
  public:
   /// \brief Hashes the buffer at the top of the stack, returning the result
   /// in `hash`.
-  void HashTop(HashCache::Hash* hash) const {
+  ///
+  /// SHA-256 state already covers any bytes fed in through `HashPendingTop`,
+  /// so only bytes appended since then (plus any slabs merged in from below)
+  /// are walked here. Vector dispatch (SHA-NI/AVX2) happens inside
+  /// BoringSSL's block function, which selects an implementation at runtime.
+  ///
+  /// \param cryptographic If false, computes a cheap 128-bit
+  /// non-cryptographic fingerprint (zero-padded to hash width) instead of
+  /// SHA-256; only appropriate when the consuming `HashCache` is in-process
+  /// (see `HashCache::RequiresCryptographicHash`).
+  void HashTop(HashCache::Hash* hash, bool cryptographic = true) const {
     assert(buffers_ != nullptr);
-    ::SHA256_CTX sha;
-    ::SHA256_Init(&sha);
-    for (Buffer* joined = buffers_; joined; joined = joined->joined) {
+    if (!cryptographic) {
+      FingerprintTop(hash);
+      return;
+    }
+    ::SHA256_CTX sha = buffers_->sha;
+    ::SHA256_Update(&sha, buffers_->slab.data() + buffers_->hashed,
+                    buffers_->slab.size() - buffers_->hashed);
+    for (Buffer* joined = buffers_->joined; joined; joined = joined->joined) {
       ::SHA256_Update(&sha, joined->slab.data(), joined->slab.size());
     }
     ::SHA256_Final(reinterpret_cast<unsigned char*>(hash), &sha);
   }
+  /// \brief Folds any not-yet-hashed bytes of the top buffer's own slab into
+  /// its running SHA-256 state.
+  ///
+  /// Callers should invoke this right after serializing into storage returned
+  /// by `WriteToTop`, while the bytes are still cache-hot; `HashTop` then has
+  /// little or nothing left to walk. Only the top buffer's own slab is
+  /// hashed incrementally: it is the prefix of the buffer's logical content
+  /// even if buffers are later merged in below it, so the running state
+  /// stays a valid prefix hash.
+  void HashPendingTop() {
+    assert(buffers_ != nullptr);
+    ::SHA256_Update(&buffers_->sha, buffers_->slab.data() + buffers_->hashed,
+                    buffers_->slab.size() - buffers_->hashed);
+    buffers_->hashed = buffers_->slab.size();
+  }
   /// \brief Copies the buffer at the top of the stack to some `stream`.
   void CopyTopToStream(
       google::protobuf::io::ZeroCopyOutputStream* stream) const {
@@ -108,6 +326,12 @@ class BufferStack {
       }
     }
   }
+  /// \brief Appends the buffer at the top of the stack to `out`.
+  void AppendTopToVector(std::vector<unsigned char>* out) const {
+    for (Buffer* joined = buffers_; joined; joined = joined->joined) {
+      out->insert(out->end(), joined->slab.begin(), joined->slab.end());
+    }
+  }
   /// \brief Allocates space for writing data to the buffer on the top of
   /// the stack.
   /// \return A pointer to `bytes` bytes of storage.
@@ -121,17 +345,31 @@ class BufferStack {
   }
   /// \brief Pushes a new buffer to the stack.
   /// \param expected_size An estimate of the buffer's maximum size.
+  ///
+  /// Recycled buffers are kept in per-size-class free lists (classes are
+  /// powers of two of slab capacity), so a reused buffer always has at least
+  /// `expected_size` capacity and steady-state emission neither allocates
+  /// nor regrows slabs.
   void Push(size_t expected_size) {
-    Buffer* buffer = free_buffers_;
-    if (buffer) {
-      free_buffers_ = buffer->previous;
-    } else {
+    Buffer* buffer = nullptr;
+    for (size_t klass = SizeClassFor(expected_size); klass < kNumSizeClasses;
+         ++klass) {
+      if (free_buffers_[klass]) {
+        buffer = free_buffers_[klass];
+        free_buffers_[klass] = buffer->previous;
+        break;
+      }
+    }
+    if (buffer == nullptr) {
       buffer = new Buffer();
       buffer->slab.reserve(expected_size);
+      ++fresh_allocations_;
     }
     buffer->joined = nullptr;
     buffer->slab.clear();
     buffer->joined_size = 0;
+    ::SHA256_Init(&buffer->sha);
+    buffer->hashed = 0;
     buffer->previous = buffers_;
     buffers_ = buffer;
   }
@@ -145,14 +383,13 @@ class BufferStack {
     assert(buffers_);
     Buffer* joined = buffers_->joined;
     while (joined) {
-      joined->previous = free_buffers_;
-      free_buffers_ = joined;
-      joined = joined->joined;
+      Buffer* next = joined->joined;
+      FreeBuffer(joined);
+      joined = next;
     }
     Buffer* to_free = buffers_;
     buffers_ = to_free->previous;
-    to_free->previous = free_buffers_;
-    free_buffers_ = to_free;
+    FreeBuffer(to_free);
   }
   /// \brief Merge the buffer at the top of the stack with the one below it.
   ///
@@ -184,14 +421,19 @@ class BufferStack {
     return true;
   }
   bool empty() const { return buffers_ == nullptr; }
+  /// \brief The number of `Buffer`s allocated fresh rather than recycled;
+  /// flat in steady state.
+  size_t fresh_allocations() const { return fresh_allocations_; }
   ~BufferStack() {
     while (!empty()) {
       Pop();
     }
-    while (free_buffers_) {
-      Buffer* previous = free_buffers_->previous;
-      delete free_buffers_;
-      free_buffers_ = previous;
+    for (size_t klass = 0; klass < kNumSizeClasses; ++klass) {
+      while (free_buffers_[klass]) {
+        Buffer* previous = free_buffers_[klass]->previous;
+        delete free_buffers_[klass];
+        free_buffers_[klass] = previous;
+      }
     }
   }
 
@@ -205,11 +447,101 @@ class BufferStack {
     Buffer* previous;
     /// A link to the next buffer that was merged with this one.
     Buffer* joined;
+    /// Running hash state over the first `hashed` bytes of `slab`.
+    ::SHA256_CTX sha;
+    /// The number of bytes of `slab` already folded into `sha`.
+    size_t hashed;
   };
+
+  /// \brief Computes a 128-bit non-cryptographic fingerprint of the top
+  /// buffer (two independently-seeded 64-bit FNV-1a lanes), zero-padding the
+  /// rest of `hash`.
+  void FingerprintTop(HashCache::Hash* hash) const {
+    uint64_t lanes[2] = {0xcbf29ce484222325ULL, 0xaf63bd4c8601b7dfULL};
+    for (Buffer* joined = buffers_; joined; joined = joined->joined) {
+      for (unsigned char byte : joined->slab) {
+        lanes[0] = (lanes[0] ^ byte) * 0x100000001b3ULL;
+        lanes[1] = (lanes[1] ^ byte) * 0x100000001b3ULL;
+      }
+    }
+    memset(*hash, 0, sizeof(*hash));
+    memcpy(*hash, lanes, sizeof(lanes));
+  }
+  /// The number of size-class free lists; class `k` holds buffers whose slab
+  /// capacity is in [2^k, 2^(k+1)).
+  static constexpr size_t kNumSizeClasses = 32;
+
+  /// \brief Returns the lowest size class whose buffers are guaranteed to
+  /// have at least `size` bytes of capacity.
+  static size_t SizeClassFor(size_t size) {
+    size_t klass = 0;
+    while (klass + 1 < kNumSizeClasses && (size_t{1} << klass) < size) {
+      ++klass;
+    }
+    return klass;
+  }
+
+  /// \brief Returns `buffer` to the free list matching its slab capacity.
+  void FreeBuffer(Buffer* buffer) {
+    size_t klass = 0;
+    while (klass + 1 < kNumSizeClasses &&
+           (size_t{1} << (klass + 1)) <= buffer->slab.capacity()) {
+      ++klass;
+    }
+    buffer->previous = free_buffers_[klass];
+    free_buffers_[klass] = buffer;
+  }
+
   /// The stack of open buffers.
   Buffer* buffers_ = nullptr;
-  /// Inactive buffers ready for allocation.
-  Buffer* free_buffers_ = nullptr;
+  /// Inactive buffers ready for allocation, bucketed by slab capacity class.
+  Buffer* free_buffers_[kNumSizeClasses] = {};
+  /// The number of buffers ever allocated fresh.
+  size_t fresh_allocations_ = 0;
+};
+
+/// \brief Writes byte blocks to a file descriptor from a background thread.
+///
+/// Submitting a block hands its storage to the writer and returns a block
+/// whose write has already completed, so the producer and the writer recycle
+/// storage between them without per-block allocation. Submission applies
+/// backpressure once too many bytes are in flight; `Drain` waits for every
+/// submitted block to land.
+class AsyncBlockWriter {
+ public:
+  explicit AsyncBlockWriter(int fd);
+  /// Drains outstanding blocks and joins the writer thread.
+  ~AsyncBlockWriter();
+  /// \brief Queues `block` for writing, taking ownership of its storage.
+  /// \return an empty block recycled from a completed write, when one is
+  /// available.
+  std::vector<unsigned char> SubmitBlock(std::vector<unsigned char> block);
+  /// \brief Blocks until every submitted block has been written.
+  void Drain();
+
+ private:
+  /// \brief The writer thread's main loop.
+  void WriteLoop();
+  /// The descriptor written to.
+  int fd_;
+  std::mutex mu_;
+  /// Signalled when work arrives or the writer should exit.
+  std::condition_variable wake_writer_;
+  /// Signalled when a write completes (for backpressure and `Drain`).
+  std::condition_variable write_completed_;
+  /// Blocks waiting to be written, in submission order.
+  std::deque<std::vector<unsigned char>> queue_;
+  /// Storage from completed writes, ready for reuse.
+  std::vector<std::vector<unsigned char>> free_blocks_;
+  /// Bytes submitted but not yet written out.
+  size_t in_flight_bytes_ = 0;
+  /// Whether the destructor has asked the writer to exit.
+  bool exiting_ = false;
+  /// Cap on `in_flight_bytes_` before submission blocks.
+  static constexpr size_t kMaxInFlightBytes = 8 * 1024 * 1024;
+  /// Cap on recycled blocks retained in `free_blocks_`.
+  static constexpr size_t kMaxFreeBlocks = 4;
+  std::thread writer_;
 };
 
 // A `KytheCachingOutputStream` that records `Entry` instances to a
@@ -227,6 +559,28 @@ class FileOutputStream : public KytheCachingOutput {
   void set_flush_after_each_entry(bool value) {
     flush_after_each_entry_ = value;
   }
+  /// \brief gzip-compress the entry stream as it is written?
+  ///
+  /// The result is a single gzip member wrapping the usual delimited
+  /// stream, so `gunzip` recovers a byte-identical uncompressed stream.
+  /// Must be set before the first entry is emitted.
+  void set_compress_output(bool value);
+  /// \brief Adapt the dedup window bounds during the run.
+  ///
+  /// Every `kAdaptationInterval` retired buffers the observed hit rate is
+  /// inspected: a window that rarely matches is halved (finer-grained
+  /// buffers dedup more often), one that matches frequently is doubled
+  /// (fewer, larger hash probes for the same matches). The bounds from
+  /// `UseHashCache` serve only as the starting point.
+  void set_adaptive_size_limits(bool value) { adaptive_size_limits_ = value; }
+  /// \brief Write completed buffers to `fd` from a background thread.
+  ///
+  /// Serialization and deduplication then overlap with writes still in
+  /// flight instead of stalling on them; flushes wait only for queued bytes
+  /// to land. `fd` must be the descriptor under the wrapped stream, which is
+  /// bypassed entirely. Incompatible with `set_compress_output`; must be set
+  /// before the first entry is emitted.
+  void set_async_write_fd(int fd);
   void Emit(const FactRef& fact) override {
     fact.Expand(&fact_entry_);
     EnqueueEntry(fact_entry_);
@@ -258,6 +612,11 @@ class FileOutputStream : public KytheCachingOutput {
     size_t buffers_merged_ = 0;
     /// How many buffers we didn't emit because their hashes matched.
     size_t hashes_matched_ = 0;
+    /// How many buffers were allocated fresh instead of recycled from the
+    /// pool; flat in steady state.
+    size_t buffers_allocated_ = 0;
+    /// How many times the adaptive controller resized the dedup window.
+    size_t windows_adapted_ = 0;
     /// How many bytes in total we've seen (whether or not they were emitted).
     size_t total_bytes_ = 0;
     /// \brief Return a summary of these statistics as a string.
@@ -265,8 +624,33 @@ class FileOutputStream : public KytheCachingOutput {
   } stats_;
 
  private:
+  /// \brief The stream entry bytes should be written to: the compressor
+  /// when compression is on, the file stream otherwise.
+  google::protobuf::io::ZeroCopyOutputStream* out() {
+    return gzip_stream_ != nullptr
+               ? static_cast<google::protobuf::io::ZeroCopyOutputStream*>(
+                     gzip_stream_.get())
+               : stream_;
+  }
+  /// \brief Flushes written entries down to the output file.
+  void FlushStream() {
+    if (async_writer_ != nullptr) {
+      async_writer_->Drain();
+      return;
+    }
+    if (gzip_stream_ != nullptr) {
+      gzip_stream_->Flush();
+    }
+    stream_->Flush();
+  }
   /// The output stream to write on.
   google::protobuf::io::FileOutputStream* stream_;
+  /// When compressing, a gzip stream layered over `stream_`; entry bytes are
+  /// written through it instead of to `stream_` directly.
+  std::unique_ptr<google::protobuf::io::GzipOutputStream> gzip_stream_;
+  /// When writing asynchronously, the background writer every completed
+  /// buffer is handed to; `stream_` is bypassed.
+  std::unique_ptr<AsyncBlockWriter> async_writer_;
   /// A prototypical Kythe fact, used only to build other Kythe facts.
   proto::Entry fact_entry_;
   /// A prototypical Kythe edge, used only to build same.
@@ -274,10 +658,20 @@ class FileOutputStream : public KytheCachingOutput {
   /// Buffers we're holding back for deduplication.
   BufferStack buffers_;
 
+  /// Entries framed and staged for the next coalesced write.
+  std::vector<unsigned char> direct_buffer_;
+  /// Flush `direct_buffer_` once it grows past this many bytes.
+  static constexpr size_t kDirectBufferLimit = 64 * 1024;
+
   /// Emits all data from the top buffer (if the hash cache says it's relevant).
   void EmitAndReleaseTopBuffer();
+  /// Resizes the dedup window from the hit rate over the last adaptation
+  /// interval (see `set_adaptive_size_limits`).
+  void AdaptSizeLimits();
   /// Emits an entry or adds it to a buffer (if the stack is nonempty).
   void EnqueueEntry(const proto::Entry& entry);
+  /// Writes any staged entries to the output stream in one pass.
+  void FlushDirectBuffer();
   /// The minimum size a buffer must be to get emitted.
   size_t min_size_ = 0;
   /// The maximum size a buffer can reach before it's split.
@@ -285,6 +679,14 @@ class FileOutputStream : public KytheCachingOutput {
   /// Whether we should flush the output stream after each entry
   /// (when the buffer stack is empty).
   bool flush_after_each_entry_;
+  /// Whether the dedup window bounds adapt to the observed hit rate.
+  bool adaptive_size_limits_ = false;
+  /// `stats_.buffers_retired_` at the last adaptation.
+  size_t adapted_at_retired_ = 0;
+  /// `stats_.hashes_matched_` at the last adaptation.
+  size_t adapted_at_matched_ = 0;
+  /// Retired buffers between adaptations.
+  static constexpr size_t kAdaptationInterval = 256;
   /// The active hash cache;
   HashCache* cache_;
   /// The default hash cache.
@@ -16,79 +16,140 @@
 
 #include "KytheGraphRecorder.h"
 
+#include <openssl/sha.h>
+
+#include <cstdint>
+#include <string>
+
+#include "absl/base/macros.h"
+#include "kythe/cxx/common/indexing/MemoryAccounting.h"
 #include "kythe/proto/storage.pb.h"
 
 namespace kythe {
 
-static const std::string* const kNodeKindSpellings[] = {
-    new std::string("anchor"),     new std::string("file"),
-    new std::string("variable"),   new std::string("talias"),
-    new std::string("tapp"),       new std::string("tnominal"),
-    new std::string("record"),     new std::string("sum"),
-    new std::string("constant"),   new std::string("abs"),
-    new std::string("absvar"),     new std::string("function"),
-    new std::string("lookup"),     new std::string("macro"),
-    new std::string("interface"),  new std::string("package"),
-    new std::string("tsigma"),     new std::string("doc"),
-    new std::string("tbuiltin"),   new std::string("meta"),
-    new std::string("diagnostic"), new std::string("clang/usr")};
-
-static const std::string* kEdgeKindSpellings[] = {
-    new std::string("/kythe/edge/defines"),
-    new std::string("/kythe/edge/typed"),
-    new std::string("/kythe/edge/ref"),
-    new std::string("/kythe/edge/ref/implicit"),
-    new std::string("/kythe/edge/ref/imports"),
-    new std::string("/kythe/edge/param"),
-    new std::string("/kythe/edge/aliases"),
-    new std::string("/kythe/edge/aliases/root"),
-    new std::string("/kythe/edge/completes/uniquely"),
-    new std::string("/kythe/edge/completes"),
-    new std::string("/kythe/edge/childof"),
-    new std::string("/kythe/edge/specializes"),
-    new std::string("/kythe/edge/ref/call"),
-    new std::string("/kythe/edge/ref/call/implicit"),
-    new std::string("/kythe/edge/ref/expands"),
-    new std::string("/kythe/edge/undefines"),
-    new std::string("/kythe/edge/ref/includes"),
-    new std::string("/kythe/edge/ref/queries"),
-    new std::string("/kythe/edge/instantiates"),
-    new std::string("/kythe/edge/ref/expands/transitive"),
-    new std::string("/kythe/edge/extends/public"),
-    new std::string("/kythe/edge/extends/protected"),
-    new std::string("/kythe/edge/extends/private"),
-    new std::string("/kythe/edge/extends"),
-    new std::string("/kythe/edge/extends/public/virtual"),
-    new std::string("/kythe/edge/extends/protected/virtual"),
-    new std::string("/kythe/edge/extends/private/virtual"),
-    new std::string("/kythe/edge/extends/virtual"),
-    new std::string("/kythe/edge/extends/category"),
-    new std::string("/kythe/edge/specializes/speculative"),
-    new std::string("/kythe/edge/instantiates/speculative"),
-    new std::string("/kythe/edge/documents"),
-    new std::string("/kythe/edge/ref/doc"),
-    new std::string("/kythe/edge/generates"),
-    new std::string("/kythe/edge/defines/binding"),
-    new std::string("/kythe/edge/overrides"),
-    new std::string("/kythe/edge/overrides/root"),
-    new std::string("/kythe/edge/childof/context"),
-    new std::string("/kythe/edge/bounded/upper"),
-    new std::string("/kythe/edge/ref/init"),
-    new std::string("/kythe/edge/ref/init/implicit"),
-    new std::string("/kythe/edge/imputes"),
-    new std::string("/kythe/edge/tagged"),
-    new std::string("/kythe/edge/property/reads"),
-    new std::string("/kythe/edge/property/writes"),
-    new std::string("/clang/usr"),
-    new std::string("/kythe/edge/ref/id"),
-    new std::string("/kythe/edge/ref/writes"),
-    new std::string("/kythe/edge/ref/writes/implicit"),
-    new std::string("/kythe/edge/influences")};
+namespace {
+/// \return the byte counter for serialized marked-source code facts.
+MemoryCounter& MarkedSourceCounter() {
+  static auto* counter = new MemoryCounter("marked source");
+  return *counter;
+}
+
+/// \brief Digest of a file node's facts: the file's VName and content,
+/// length-framed so distinct pairs cannot collide by concatenation.
+std::string FileFactDigest(const VNameRef& file_vname,
+                           absl::string_view file_content) {
+  ::SHA256_CTX sha;
+  ::SHA256_Init(&sha);
+  auto update = [&sha](absl::string_view data) {
+    uint64_t size = data.size();
+    ::SHA256_Update(&sha, &size, sizeof(size));
+    ::SHA256_Update(&sha, data.data(), data.size());
+  };
+  update(file_vname.signature());
+  update(file_vname.corpus());
+  update(file_vname.root());
+  update(file_vname.path());
+  update(file_vname.language());
+  update(file_content);
+  std::string digest(SHA256_DIGEST_LENGTH, '\0');
+  ::SHA256_Final(reinterpret_cast<unsigned char*>(&digest[0]), &sha);
+  return digest;
+}
+
+}  // anonymous namespace
+
+// Spelling tables are indexed by the ordinal of the corresponding enum in
+// KytheGraphRecorder.h and must be kept in sync with it. As constexpr
+// string_views, spelling_of is an array load with a precomputed length.
+constexpr absl::string_view kNodeKindSpellings[] = {
+    "anchor",
+    "file",
+    "variable",
+    "talias",
+    "tapp",
+    "tnominal",
+    "record",
+    "sum",
+    "constant",
+    "abs",
+    "absvar",
+    "function",
+    "lookup",
+    "macro",
+    "interface",
+    "package",
+    "tsigma",
+    "doc",
+    "tbuiltin",
+    "meta",
+    "diagnostic",
+    "clang/usr",
+};
+
+constexpr absl::string_view kEdgeKindSpellings[] = {
+    "/kythe/edge/defines",
+    "/kythe/edge/typed",
+    "/kythe/edge/ref",
+    "/kythe/edge/ref/implicit",
+    "/kythe/edge/ref/imports",
+    "/kythe/edge/param",
+    "/kythe/edge/aliases",
+    "/kythe/edge/aliases/root",
+    "/kythe/edge/completes/uniquely",
+    "/kythe/edge/completes",
+    "/kythe/edge/childof",
+    "/kythe/edge/specializes",
+    "/kythe/edge/ref/call",
+    "/kythe/edge/ref/call/implicit",
+    "/kythe/edge/ref/expands",
+    "/kythe/edge/undefines",
+    "/kythe/edge/ref/includes",
+    "/kythe/edge/ref/queries",
+    "/kythe/edge/instantiates",
+    "/kythe/edge/ref/expands/transitive",
+    "/kythe/edge/extends/public",
+    "/kythe/edge/extends/protected",
+    "/kythe/edge/extends/private",
+    "/kythe/edge/extends",
+    "/kythe/edge/extends/public/virtual",
+    "/kythe/edge/extends/protected/virtual",
+    "/kythe/edge/extends/private/virtual",
+    "/kythe/edge/extends/virtual",
+    "/kythe/edge/extends/category",
+    "/kythe/edge/specializes/speculative",
+    "/kythe/edge/instantiates/speculative",
+    "/kythe/edge/documents",
+    "/kythe/edge/ref/doc",
+    "/kythe/edge/generates",
+    "/kythe/edge/defines/binding",
+    "/kythe/edge/overrides",
+    "/kythe/edge/overrides/root",
+    "/kythe/edge/childof/context",
+    "/kythe/edge/bounded/upper",
+    "/kythe/edge/ref/init",
+    "/kythe/edge/ref/init/implicit",
+    "/kythe/edge/imputes",
+    "/kythe/edge/tagged",
+    "/kythe/edge/property/reads",
+    "/kythe/edge/property/writes",
+    "/clang/usr",
+    "/kythe/edge/ref/id",
+    "/kythe/edge/ref/writes",
+    "/kythe/edge/ref/writes/implicit",
+    "/kythe/edge/influences",
+};
+
+static_assert(ABSL_ARRAYSIZE(kNodeKindSpellings) ==
+                  static_cast<size_t>(NodeKindID::kClangUsr) + 1,
+              "kNodeKindSpellings must cover every NodeKindID");
+static_assert(ABSL_ARRAYSIZE(kEdgeKindSpellings) ==
+                  static_cast<size_t>(EdgeKindID::kInfluences) + 1,
+              "kEdgeKindSpellings must cover every EdgeKindID");
 
 bool of_spelling(absl::string_view str, EdgeKindID* edge_id) {
   size_t edge_index = 0;
-  for (auto* edge : kEdgeKindSpellings) {
-    if (*edge == str) {
+  for (absl::string_view edge : kEdgeKindSpellings) {
+    if (edge == str) {
       *edge_id = static_cast<kythe::EdgeKindID>(edge_index);
       return true;
     }
@@ -97,48 +158,57 @@ bool of_spelling(absl::string_view str, EdgeKindID* edge_id) {
   return false;
 }
 
-static const std::string* const kPropertySpellings[] = {
-    new std::string("/kythe/loc"),
-    new std::string("/kythe/loc/uri"),
-    new std::string("/kythe/loc/start"),
-    new std::string("/kythe/loc/start/row"),
-    new std::string("/kythe/loc/start"),
-    new std::string("/kythe/loc/end"),
-    new std::string("/kythe/loc/end/row"),
-    new std::string("/kythe/loc/end"),
-    new std::string("/kythe/text"),
-    new std::string("/kythe/complete"),
-    new std::string("/kythe/subkind"),
-    new std::string("/kythe/node/kind"),
-    new std::string("/kythe/code"),
-    new std::string("/kythe/variance"),
-    new std::string("/kythe/param/default"),
-    new std::string("/kythe/tag/static"),
-    new std::string("/kythe/tag/deprecated"),
-    new std::string("/kythe/message"),
-    new std::string("/kythe/details"),
-    new std::string("/kythe/context/url"),
-    new std::string("/kythe/doc/uri"),
-    new std::string("/kythe/build/config"),
+constexpr absl::string_view kPropertySpellings[] = {
+    "/kythe/loc",
+    "/kythe/loc/uri",
+    "/kythe/loc/start",
+    "/kythe/loc/start/row",
+    "/kythe/loc/start",
+    "/kythe/loc/end",
+    "/kythe/loc/end/row",
+    "/kythe/loc/end",
+    "/kythe/text",
+    "/kythe/complete",
+    "/kythe/subkind",
+    "/kythe/node/kind",
+    "/kythe/code",
+    "/kythe/variance",
+    "/kythe/param/default",
+    "/kythe/tag/static",
+    "/kythe/tag/deprecated",
+    "/kythe/message",
+    "/kythe/details",
+    "/kythe/context/url",
+    "/kythe/doc/uri",
+    "/kythe/build/config",
 };
 
-static const std::string* const kEmptyStringSpelling = new std::string("");
-
-static const std::string* const kRootPropertySpelling = new std::string("/");
+static_assert(ABSL_ARRAYSIZE(kPropertySpellings) ==
+                  static_cast<size_t>(PropertyID::kBuildConfig) + 1,
+              "kPropertySpellings must cover every PropertyID");
 
 absl::string_view spelling_of(PropertyID property_id) {
-  const auto* str = kPropertySpellings[static_cast<ptrdiff_t>(property_id)];
-  return absl::string_view(str->data(), str->size());
+  return kPropertySpellings[static_cast<ptrdiff_t>(property_id)];
 }
 
 absl::string_view spelling_of(NodeKindID node_kind_id) {
-  const auto* str = kNodeKindSpellings[static_cast<ptrdiff_t>(node_kind_id)];
-  return absl::string_view(str->data(), str->size());
+  return kNodeKindSpellings[static_cast<ptrdiff_t>(node_kind_id)];
 }
 
 absl::string_view spelling_of(EdgeKindID edge_kind_id) {
-  const auto* str = kEdgeKindSpellings[static_cast<ptrdiff_t>(edge_kind_id)];
-  return absl::string_view(str->data(), str->size());
+  return kEdgeKindSpellings[static_cast<ptrdiff_t>(edge_kind_id)];
+}
+
+VNameHandle KytheGraphRecorder::InternVName(const VNameRef& vname) {
+  proto::VName full;
+  vname.Expand(&full);
+  auto [it, inserted] =
+      vname_handles_.emplace(full.SerializeAsString(), interned_vnames_.size());
+  if (inserted) {
+    interned_vnames_.push_back(std::move(full));
+    interned_refs_.emplace_back(interned_vnames_.back());
+  }
+  return it->second;
 }
 
 void KytheGraphRecorder::AddProperty(const VNameRef& node_vname,
@@ -156,10 +226,12 @@ void KytheGraphRecorder::AddProperty(const VNameRef& node_vname,
 void KytheGraphRecorder::AddMarkedSource(const VNameRef& node_vname,
                                          const MarkedSource& marked_source) {
   auto size = marked_source.ByteSize();
+  MarkedSourceCounter().Add(size);
   std::vector<char> buffer(size);
   marked_source.SerializeToArray(buffer.data(), size);
   stream_->Emit(FactRef{&node_vname, spelling_of(PropertyID::kCode),
                         absl::string_view(buffer.data(), buffer.size())});
+  MarkedSourceCounter().Remove(size);
 }
 
 void KytheGraphRecorder::AddEdge(const VNameRef& edge_from,
@@ -175,8 +247,36 @@ void KytheGraphRecorder::AddEdge(const VNameRef& edge_from,
       OrdinalEdgeRef{&edge_from, spelling_of(edge_kind_id), &edge_to, ordinal});
 }
 
+void KytheGraphRecorder::AddEdgeRange(const VNameRef& edge_from,
+                                      EdgeKindID edge_kind_id,
+                                      absl::Span<const VNameRef> edge_targets,
+                                      uint32_t first_ordinal) {
+  if (edge_targets.empty()) {
+    return;
+  }
+  // A run of one is just an ordinal edge; don't make streams with a range
+  // encoding frame a degenerate range.
+  if (edge_targets.size() == 1) {
+    AddEdge(edge_from, edge_kind_id, edge_targets.front(), first_ordinal);
+    return;
+  }
+  stream_->Emit(OrdinalEdgeRangeRef{&edge_from, spelling_of(edge_kind_id),
+                                    edge_targets.data(), edge_targets.size(),
+                                    first_ordinal});
+}
+
 void KytheGraphRecorder::AddFileContent(const VNameRef& file_vname,
                                         absl::string_view file_content) {
+  // A driver process indexing many compilation units re-emits the content
+  // facts of shared headers from every unit that claims them; file text
+  // dominates raw entrystream bytes. Identical file facts are written only
+  // once per output stream, keyed by a digest of the VName and content so
+  // the suppression is exact and independent of the hash cache's window.
+  // Drivers that reuse one stream for logically separate outputs reset the
+  // stream's registry at each output boundary.
+  if (!stream_->RecordFileFact(FileFactDigest(file_vname, file_content))) {
+    return;
+  }
   AddProperty(file_vname, PropertyID::kNodeKind,
               spelling_of(NodeKindID::kFile));
   AddProperty(file_vname, PropertyID::kText, file_content);
@@ -17,11 +17,20 @@
 #ifndef KYTHE_CXX_COMMON_INDEXING_KYTHE_GRAPH_RECORDER_H_
 #define KYTHE_CXX_COMMON_INDEXING_KYTHE_GRAPH_RECORDER_H_
 
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
 #include "KytheOutputStream.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 namespace kythe {
 
+/// \brief A compact handle for a VName interned by a `KytheGraphRecorder`.
+using VNameHandle = size_t;
+
 /// \brief Known node kinds. See the schema for details.
 enum class NodeKindID {
   kAnchor,
@@ -206,12 +215,68 @@ class KytheGraphRecorder {
   void AddEdge(const VNameRef& edge_from, EdgeKindID edge_kind_id,
                const VNameRef& edge_to, uint32_t edge_ordinal);
 
+  /// \brief Records a run of ordinal edges that share a source and kind.
+  ///
+  /// `edge_targets[i]` receives ordinal `first_ordinal + i`. The run reaches
+  /// the output stream as a single `OrdinalEdgeRangeRef`, which streams with
+  /// a range encoding write without repeating the source, kind, and ordinal
+  /// per edge.
+  ///
+  /// \param edge_from The `VNameRef` of the node at which the edges start.
+  /// \param edge_kind_id The `EdgeKindID` of the edges.
+  /// \param edge_targets The nodes at which the edges terminate, in ordinal
+  /// order.
+  /// \param first_ordinal The ordinal of the first target.
+  void AddEdgeRange(const VNameRef& edge_from, EdgeKindID edge_kind_id,
+                    absl::Span<const VNameRef> edge_targets,
+                    uint32_t first_ordinal);
+
   /// \brief Records the content of a file that was visited during compilation.
   /// \param file_vname The file's vname.
   /// \param file_content The buffer of this file's content.
   void AddFileContent(const VNameRef& file_vname,
                       absl::string_view file_content);
 
+  /// \brief Interns `vname`, assigning a compact handle on first sight.
+  ///
+  /// The recorder keeps one stable copy of each distinct VName; callers that
+  /// emit many facts or edges about the same node can intern it once and pass
+  /// the handle instead of rebuilding and re-copying the full VName each time.
+  VNameHandle InternVName(const VNameRef& vname);
+
+  /// \return the interned VName for `handle`. Valid for the life of the
+  /// recorder.
+  const VNameRef& vname(VNameHandle handle) const {
+    return interned_refs_[handle];
+  }
+
+  /// \copydoc KytheGraphRecorder::AddProperty(const
+  /// VNameRef&,PropertyID,std::string&)
+  void AddProperty(VNameHandle node, PropertyID property_id,
+                   absl::string_view property_value) {
+    AddProperty(vname(node), property_id, property_value);
+  }
+
+  /// \copydoc KytheGraphRecorder::AddProperty(const
+  /// VNameRef&,PropertyID,std::string&)
+  void AddProperty(VNameHandle node, NodeKindID node_kind_value) {
+    AddProperty(vname(node), node_kind_value);
+  }
+
+  /// \copydoc KytheGraphRecorder::AddEdge(const
+  /// VNameRef&,EdgeKindID,const VNameRef&)
+  void AddEdge(VNameHandle edge_from, EdgeKindID edge_kind_id,
+               VNameHandle edge_to) {
+    AddEdge(vname(edge_from), edge_kind_id, vname(edge_to));
+  }
+
+  /// \copydoc KytheGraphRecorder::AddEdge(const
+  /// VNameRef&,EdgeKindID,const VNameRef&,uint32_t)
+  void AddEdge(VNameHandle edge_from, EdgeKindID edge_kind_id,
+               VNameHandle edge_to, uint32_t edge_ordinal) {
+    AddEdge(vname(edge_from), edge_kind_id, vname(edge_to), edge_ordinal);
+  }
+
   /// \brief Stop using the last entry group pushed to the stack.
   void PopEntryGroup() { stream_->PopBuffer(); }
 
@@ -225,6 +290,13 @@ class KytheGraphRecorder {
  private:
   /// The `KytheOutputStream` to which new graph elements are written.
   KytheOutputStream* stream_;
+  /// Stable storage for interned VNames (`std::deque` never relocates
+  /// elements, so `interned_refs_` stays valid as the table grows).
+  std::deque<proto::VName> interned_vnames_;
+  /// `VNameRef` views over `interned_vnames_`, indexed by handle.
+  std::deque<VNameRef> interned_refs_;
+  /// Maps a serialized VName to its handle.
+  std::unordered_map<std::string, VNameHandle> vname_handles_;
 };
 
 }  // namespace kythe
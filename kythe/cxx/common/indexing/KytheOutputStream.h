@@ -17,6 +17,10 @@
 #ifndef KYTHE_CXX_COMMON_INDEXING_KYTHE_OUTPUT_STREAM_H_
 #define KYTHE_CXX_COMMON_INDEXING_KYTHE_OUTPUT_STREAM_H_
 
+#include <set>
+#include <string>
+#include <vector>
+
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
@@ -109,18 +113,98 @@ struct OrdinalEdgeRef {
   }
 };
 
+/// A collection of references to the components of a run of Kythe edges that
+/// share a source and edge kind and whose ordinals are consecutive.
+///
+/// Ordinal edges arrive in runs (every parameter of a function, every
+/// argument of a type application), so emitting the run as one unit lets
+/// streams with a compact encoding write the shared source, kind, and
+/// ordinal base once instead of once per edge.
+struct OrdinalEdgeRangeRef {
+  const VNameRef* source;
+  absl::string_view edge_kind;
+  /// The targets of the run in ordinal order: `targets[i]` receives ordinal
+  /// `first_ordinal + i`.
+  const VNameRef* targets;
+  size_t target_count;
+  uint32_t first_ordinal;
+};
+
 // Interface for receiving Kythe data.
 class KytheOutputStream {
  public:
   virtual void Emit(const FactRef& fact) = 0;
   virtual void Emit(const EdgeRef& edge) = 0;
   virtual void Emit(const OrdinalEdgeRef& edge) = 0;
+  /// \brief Emits a run of ordinal edges.
+  ///
+  /// The default implementation expands the run into individual ordinal
+  /// edges, so streams without a range encoding need no changes; streams
+  /// with one (see `DeltaOutputStream`) override it.
+  virtual void Emit(const OrdinalEdgeRangeRef& range) {
+    for (size_t i = 0; i < range.target_count; ++i) {
+      Emit(OrdinalEdgeRef{range.source, range.edge_kind, &range.targets[i],
+                          range.first_ordinal + static_cast<uint32_t>(i)});
+    }
+  }
   /// Add a buffer to the buffer stack to group facts, edges, and buffers
   /// together.
   virtual void PushBuffer() {}
   /// Pop the last buffer from the buffer stack.
   virtual void PopBuffer() {}
+  /// \brief Records that the file facts digested by `digest` are about to be
+  /// written to this stream.
+  /// \return false if an identical set of facts was already recorded, in
+  /// which case the caller should suppress the write (\sa
+  /// KytheGraphRecorder::AddFileContent).
+  bool RecordFileFact(const std::string& digest) {
+    return emitted_file_facts_.insert(digest).second;
+  }
+  /// \brief Forgets the file facts recorded by `RecordFileFact`.
+  ///
+  /// Drivers that serve several logically separate outputs over one stream
+  /// object (the persistent worker) must call this at each output boundary,
+  /// or later outputs lose the facts of files an earlier output emitted.
+  void ResetFileFactSuppression() { emitted_file_facts_.clear(); }
   virtual ~KytheOutputStream() {}
+
+ private:
+  /// Digests of file node facts already written to this stream.
+  std::set<std::string> emitted_file_facts_;
+};
+
+/// \brief A `KytheOutputStream` that buffers expanded entries in memory.
+///
+/// Useful for worker threads that cannot share an unsynchronized output
+/// stream: each worker emits into its own buffer, and the buffers are
+/// replayed into the real stream afterwards.
+class BufferingOutputStream : public KytheOutputStream {
+ public:
+  void Emit(const FactRef& fact) override { fact.Expand(&Append()); }
+  void Emit(const EdgeRef& edge) override { edge.Expand(&Append()); }
+  void Emit(const OrdinalEdgeRef& edge) override { edge.Expand(&Append()); }
+
+  /// \brief Re-emits the buffered entries through `output`.
+  void ReplayTo(KytheOutputStream* output) const {
+    for (const auto& entry : entries_) {
+      VNameRef source(entry.source());
+      if (entry.edge_kind().empty()) {
+        output->Emit(FactRef{&source, entry.fact_name(), entry.fact_value()});
+      } else {
+        // Edge ordinals were already folded into the edge kind by Expand.
+        VNameRef target(entry.target());
+        output->Emit(EdgeRef{&source, entry.edge_kind(), &target});
+      }
+    }
+  }
+
+ private:
+  proto::Entry& Append() {
+    entries_.emplace_back();
+    return entries_.back();
+  }
+
+  std::vector<proto::Entry> entries_;
 };
 
 }  // namespace kythe
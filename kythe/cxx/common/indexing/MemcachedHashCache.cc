@@ -18,59 +18,222 @@
 
 #include <libmemcached/memcached.h>
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <vector>
+
+#include "absl/strings/str_split.h"
 
 namespace kythe {
+namespace {
+/// \brief A 64-bit finalizing mixer (splitmix64); used to turn (key, shard)
+/// pairs into independent rendezvous scores.
+uint64_t Mix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+}  // anonymous namespace
 
 bool MemcachedHashCache::OpenMemcache(const std::string& spec) {
-  if (cache_) {
-    memcached_free(cache_);
-    cache_ = nullptr;
+  CloseShards();
+  for (absl::string_view shard_spec :
+       absl::StrSplit(spec, ';', absl::SkipEmpty())) {
+    std::string spec_amend(shard_spec);
+    spec_amend.append(" --BINARY-PROTOCOL");
+    ::memcached_st* conn = memcached(spec_amend.c_str(), spec_amend.size());
+    if (conn == nullptr) {
+      CloseShards();
+      return false;
+    }
+    // Pipeline requests: don't wait for each reply before sending the next
+    // command, and buffer registrations client-side so a batch goes out in
+    // one write.
+    memcached_behavior_set(conn, MEMCACHED_BEHAVIOR_NO_BLOCK, 1);
+    memcached_behavior_set(conn, MEMCACHED_BEHAVIOR_TCP_NODELAY, 1);
+    memcached_behavior_set(conn, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 1);
+    if (!memcached_success(memcached_version(conn))) {
+      memcached_free(conn);
+      CloseShards();
+      return false;
+    }
+    Shard shard;
+    shard.conn = conn;
+    shards_.push_back(shard);
   }
-  std::string spec_amend = spec;
-  spec_amend.append(" --BINARY-PROTOCOL");
-  cache_ = memcached(spec_amend.c_str(), spec_amend.size());
-  if (cache_ != nullptr) {
-    memcached_return_t remote_version = memcached_version(cache_);
-    return memcached_success(remote_version);
-  }
-  return false;
+  return !shards_.empty();
 }
 
 MemcachedHashCache::~MemcachedHashCache() {
-  if (cache_) {
-    memcached_free(cache_);
-    cache_ = nullptr;
+  FlushAllPendingAdds();
+  CloseShards();
+}
+
+void MemcachedHashCache::CloseShards() {
+  for (auto& shard : shards_) {
+    if (shard.conn) {
+      memcached_free(shard.conn);
+      shard.conn = nullptr;
+    }
+  }
+  shards_.clear();
+}
+
+MemcachedHashCache::Shard* MemcachedHashCache::ShardForHash(const Hash& hash) {
+  // The digests are uniformly distributed, so their first eight bytes make an
+  // adequate rendezvous key. Each key goes to the healthy shard it scores
+  // highest with; ejecting a shard moves only that shard's keys.
+  uint64_t key;
+  memcpy(&key, hash, sizeof(key));
+  Shard* best = nullptr;
+  uint64_t best_score = 0;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (shards_[i].ejected) {
+      continue;
+    }
+    uint64_t score = Mix64(key ^ Mix64(i + 1));
+    if (best == nullptr || score > best_score) {
+      best = &shards_[i];
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+void MemcachedHashCache::NoteShardResult(Shard* shard, bool success) {
+  if (success) {
+    shard->failures = 0;
+    return;
+  }
+  if (++shard->failures >= kMaxShardFailures && !shard->ejected) {
+    shard->ejected = true;
+    std::cerr << "ejecting memcached shard after " << shard->failures
+              << " consecutive failures\n";
+  }
+}
+
+void MemcachedHashCache::FlushPendingAdds(Shard* shard) {
+  if (!shard->conn || shard->pending_adds == 0) {
+    return;
+  }
+  memcached_return_t flush_result = memcached_flush_buffers(shard->conn);
+  if (!memcached_success(flush_result)) {
+    std::cerr << "memcached flush failed: "
+              << memcached_strerror(shard->conn, flush_result) << "\n";
+    NoteShardResult(shard, false);
+  } else {
+    NoteShardResult(shard, true);
+  }
+  shard->pending_adds = 0;
+}
+
+void MemcachedHashCache::FlushAllPendingAdds() {
+  for (auto& shard : shards_) {
+    FlushPendingAdds(&shard);
   }
 }
 
 void MemcachedHashCache::RegisterHash(const Hash& hash) {
-  if (!cache_) {
+  Shard* shard = ShardForHash(hash);
+  if (shard == nullptr) {
     return;
   }
   char value = 1;
   memcached_return_t add_result =
-      memcached_add(cache_, reinterpret_cast<const char*>(hash), kHashSize,
-                    &value, sizeof(value), 0, 0);
-  if (!memcached_success(add_result) && add_result != MEMCACHED_DATA_EXISTS) {
+      memcached_add(shard->conn, reinterpret_cast<const char*>(hash),
+                    kHashSize, &value, sizeof(value), 0, 0);
+  if (add_result == MEMCACHED_BUFFERED) {
+    if (++shard->pending_adds >= kMaxPendingAdds) {
+      FlushPendingAdds(shard);
+    }
+  } else if (!memcached_success(add_result) &&
+             add_result != MEMCACHED_DATA_EXISTS) {
     std::cerr << "memcached add failed: "
-              << memcached_strerror(cache_, add_result) << "\n";
+              << memcached_strerror(shard->conn, add_result) << "\n";
+    NoteShardResult(shard, false);
+  } else {
+    NoteShardResult(shard, true);
   }
 }
 
 bool MemcachedHashCache::SawHash(const Hash& hash) {
-  if (!cache_) {
+  Shard* shard = ShardForHash(hash);
+  if (shard == nullptr) {
     return false;
   }
-  memcached_return_t ex_result =
-      memcached_exist(cache_, reinterpret_cast<const char*>(hash), kHashSize);
+  FlushPendingAdds(shard);
+  memcached_return_t ex_result = memcached_exist(
+      shard->conn, reinterpret_cast<const char*>(hash), kHashSize);
   if (ex_result == MEMCACHED_SUCCESS) {
+    NoteShardResult(shard, true);
     return true;
   } else if (ex_result != MEMCACHED_NOTFOUND) {
     std::cerr << "memcached exist failed: "
-              << memcached_strerror(cache_, ex_result) << "\n";
+              << memcached_strerror(shard->conn, ex_result) << "\n";
+    NoteShardResult(shard, false);
+  } else {
+    NoteShardResult(shard, true);
   }
   return false;
 }
 
+void MemcachedHashCache::SawHashes(const Hash* hashes, size_t count,
+                                   bool* saw) {
+  for (size_t i = 0; i < count; ++i) {
+    saw[i] = false;
+  }
+  if (shards_.empty() || count == 0) {
+    return;
+  }
+  // Partition the batch by responsible shard, then issue one mget per shard.
+  std::vector<std::vector<size_t>> batches(shards_.size());
+  for (size_t i = 0; i < count; ++i) {
+    Shard* shard = ShardForHash(hashes[i]);
+    if (shard != nullptr) {
+      batches[shard - shards_.data()].push_back(i);
+    }
+  }
+  for (size_t s = 0; s < shards_.size(); ++s) {
+    const auto& batch = batches[s];
+    if (batch.empty()) {
+      continue;
+    }
+    Shard* shard = &shards_[s];
+    FlushPendingAdds(shard);
+    std::vector<const char*> keys(batch.size());
+    std::vector<size_t> key_lengths(batch.size(), kHashSize);
+    for (size_t i = 0; i < batch.size(); ++i) {
+      keys[i] = reinterpret_cast<const char*>(hashes[batch[i]]);
+    }
+    memcached_return_t mget_result = memcached_mget(
+        shard->conn, keys.data(), key_lengths.data(), batch.size());
+    if (!memcached_success(mget_result)) {
+      std::cerr << "memcached mget failed: "
+                << memcached_strerror(shard->conn, mget_result) << "\n";
+      NoteShardResult(shard, false);
+      continue;
+    }
+    char key[MEMCACHED_MAX_KEY];
+    size_t key_length;
+    size_t value_length;
+    uint32_t flags;
+    memcached_return_t fetch_result;
+    while (char* value =
+               memcached_fetch(shard->conn, key, &key_length, &value_length,
+                               &flags, &fetch_result)) {
+      for (size_t i : batch) {
+        if (key_length == kHashSize && memcmp(key, hashes[i], kHashSize) == 0) {
+          saw[i] = true;
+          break;
+        }
+      }
+      free(value);
+    }
+    NoteShardResult(shard, true);
+  }
+}
+
 }  // namespace kythe
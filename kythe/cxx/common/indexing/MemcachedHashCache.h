@@ -18,6 +18,7 @@
 #define KYTHE_CXX_COMMON_INDEXING_MEMCACHEDHASHCACHE_H_
 
 #include <string>
+#include <vector>
 
 #include "kythe/cxx/common/indexing/KytheCachingOutput.h"
 
@@ -27,20 +28,62 @@ struct memcached_st;
 
 namespace kythe {
 
-/// \brief A `HashCache` that uses a memcached server.
+/// \brief A `HashCache` that uses one or more memcached servers.
 class MemcachedHashCache : public HashCache {
  public:
   ~MemcachedHashCache() override;
 
-  /// \brief Use a memcached instance (e.g. "--SERVER=foo:1234")
+  /// \brief Use one or more memcached instances.
+  ///
+  /// `spec` names a single shard (e.g. "--SERVER=foo:1234") or several
+  /// shards separated by ';' (e.g. "--SERVER=foo:1234;--SERVER=bar:1234").
+  /// Keys are distributed over shards by rendezvous hashing of the digest,
+  /// so adding a shard moves only the keys it takes over. A shard that keeps
+  /// failing is ejected for the rest of the process and its keys fall to the
+  /// next-ranked shard.
   bool OpenMemcache(const std::string& spec);
 
   void RegisterHash(const Hash& hash) override;
 
   bool SawHash(const Hash& hash) override;
 
+  void SawHashes(const Hash* hashes, size_t count, bool* saw) override;
+
  private:
-  ::memcached_st* cache_ = nullptr;
+  /// \brief A connection to a single memcached shard.
+  struct Shard {
+    ::memcached_st* conn = nullptr;
+    /// The number of registrations buffered client-side but not yet sent.
+    size_t pending_adds = 0;
+    /// Consecutive failed operations; reaching `kMaxShardFailures` ejects
+    /// the shard.
+    size_t failures = 0;
+    /// Whether the shard has been ejected for repeated failures.
+    bool ejected = false;
+  };
+
+  /// \brief Returns the healthy shard responsible for `hash` under
+  /// rendezvous hashing, or null if every shard has been ejected.
+  Shard* ShardForHash(const Hash& hash);
+
+  /// \brief Records the outcome of an operation on `shard`, ejecting it
+  /// after `kMaxShardFailures` consecutive failures.
+  void NoteShardResult(Shard* shard, bool success);
+
+  /// \brief Sends any buffered registrations on `shard`.
+  void FlushPendingAdds(Shard* shard);
+
+  /// \brief Sends any buffered registrations on every healthy shard.
+  void FlushAllPendingAdds();
+
+  /// \brief Closes every shard connection.
+  void CloseShards();
+
+  std::vector<Shard> shards_;
+  /// Flush a shard's buffered registrations after this many accumulate.
+  static constexpr size_t kMaxPendingAdds = 128;
+  /// Eject a shard after this many consecutive failed operations.
+  static constexpr size_t kMaxShardFailures = 8;
 };
 
 }  // namespace kythe
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/indexing/MemoryAccounting.h"
+
+#include "absl/strings/str_cat.h"
+
+namespace kythe {
+namespace {
+/// The most recently registered counter, or null.
+std::atomic<MemoryCounter*> counter_head{nullptr};
+}  // anonymous namespace
+
+MemoryCounter::MemoryCounter(const char* name) : name_(name) {
+  next_ = counter_head.load(std::memory_order_relaxed);
+  while (!counter_head.compare_exchange_weak(
+      next_, this, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+}
+
+std::string MemoryCounter::DumpAll() {
+  std::string result;
+  for (const MemoryCounter* counter =
+           counter_head.load(std::memory_order_acquire);
+       counter != nullptr; counter = counter->next_) {
+    absl::StrAppend(&result, counter->name_, ": ", counter->live_bytes(),
+                    " live / ", counter->peak_bytes(), " peak / ",
+                    counter->total_bytes(), " total bytes\n");
+  }
+  return result;
+}
+
+}  // namespace kythe
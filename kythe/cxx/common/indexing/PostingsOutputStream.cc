@@ -0,0 +1,82 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/indexing/PostingsOutputStream.h"
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/gzip_stream.h"
+
+namespace kythe {
+
+PostingsOutputStream::~PostingsOutputStream() {
+  FlushBlock();
+  stream_->Flush();
+}
+
+void PostingsOutputStream::Emit(const FactRef& fact) {
+  fact.Expand(&fact_entry_);
+  EnqueueEntry(fact_entry_, /*is_edge=*/false);
+}
+
+void PostingsOutputStream::Emit(const EdgeRef& edge) {
+  edge.Expand(&edge_entry_);
+  EnqueueEntry(edge_entry_, /*is_edge=*/true);
+}
+
+void PostingsOutputStream::Emit(const OrdinalEdgeRef& edge) {
+  edge.Expand(&edge_entry_);
+  EnqueueEntry(edge_entry_, /*is_edge=*/true);
+}
+
+void PostingsOutputStream::EnqueueEntry(const proto::Entry& entry,
+                                        bool is_edge) {
+  Group& group = groups_[entry.source().SerializeAsString()];
+  std::string* pending = is_edge ? &group.edges : &group.facts;
+  size_t entry_size = entry.ByteSize();
+  size_t size_size =
+      google::protobuf::io::CodedOutputStream::VarintSize32(entry_size);
+  size_t insertion_point = pending->size();
+  pending->resize(insertion_point + size_size + entry_size);
+  unsigned char* buffer =
+      reinterpret_cast<unsigned char*>(&(*pending)[insertion_point]);
+  google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(entry_size,
+                                                                buffer);
+  entry.SerializeToArray(&buffer[size_size], entry_size);
+  pending_bytes_ += size_size + entry_size;
+  if (pending_bytes_ >= max_block_bytes_) {
+    FlushBlock();
+  }
+}
+
+void PostingsOutputStream::FlushBlock() {
+  if (groups_.empty()) {
+    return;
+  }
+  {
+    // Each block is its own gzip member; concatenated members form a valid
+    // gzip stream.
+    google::protobuf::io::GzipOutputStream gzip_stream(stream_);
+    google::protobuf::io::CodedOutputStream coded_stream(&gzip_stream);
+    for (const auto& [source, group] : groups_) {
+      coded_stream.WriteRaw(group.facts.data(), group.facts.size());
+      coded_stream.WriteRaw(group.edges.data(), group.edges.size());
+    }
+  }
+  groups_.clear();
+  pending_bytes_ = 0;
+}
+
+}  // namespace kythe
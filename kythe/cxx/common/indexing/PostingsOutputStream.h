@@ -0,0 +1,90 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_COMMON_INDEXING_POSTINGS_OUTPUT_STREAM_H_
+#define KYTHE_CXX_COMMON_INDEXING_POSTINGS_OUTPUT_STREAM_H_
+
+#include <map>
+#include <string>
+
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "kythe/cxx/common/indexing/KytheCachingOutput.h"
+#include "kythe/proto/storage.pb.h"
+
+namespace kythe {
+
+/// \brief A `KytheCachingOutput` that emits entries grouped by source VName.
+///
+/// Entries are accumulated in memory, bucketed by their source VName, and
+/// written out in source-sorted blocks: all facts for a node, then all edges
+/// leaving it, contiguously. Each block is an independently gzip-compressed
+/// run of varint-delimited `Entry` messages, so the overall file is a valid
+/// gzip stream of the same wire format as the flat entry stream — but
+/// consumers that group by source can process it without an external sort.
+///
+/// Blocks are flushed whenever the pending group data exceeds the block size
+/// bound, so grouping is exact within a block and approximate across blocks.
+class PostingsOutputStream : public KytheCachingOutput {
+ public:
+  /// \param stream The underlying stream to write compressed blocks to.
+  /// \param max_block_bytes Flush a block once this much entry data is
+  /// pending.
+  explicit PostingsOutputStream(google::protobuf::io::FileOutputStream* stream,
+                                size_t max_block_bytes = 8 * 1024 * 1024)
+      : stream_(stream), max_block_bytes_(max_block_bytes) {
+    edge_entry_.set_fact_name("/");
+  }
+
+  ~PostingsOutputStream() override;
+
+  void Emit(const FactRef& fact) override;
+  void Emit(const EdgeRef& edge) override;
+  void Emit(const OrdinalEdgeRef& edge) override;
+
+ private:
+  /// \brief Per-source pending output.
+  struct Group {
+    /// Delimited fact entries for this source.
+    std::string facts;
+    /// Delimited edge entries leaving this source.
+    std::string edges;
+  };
+
+  /// \brief Appends `entry` (delimited) to the pending group data for its
+  /// source, flushing a block if the bound is exceeded.
+  void EnqueueEntry(const proto::Entry& entry, bool is_edge);
+
+  /// \brief Writes all pending groups, in source order, as one compressed
+  /// block.
+  void FlushBlock();
+
+  /// The output stream to write on.
+  google::protobuf::io::FileOutputStream* stream_;
+  /// A prototypical Kythe fact, used only to build other Kythe facts.
+  proto::Entry fact_entry_;
+  /// A prototypical Kythe edge, used only to build same.
+  proto::Entry edge_entry_;
+  /// Pending groups keyed by serialized source VName (sorted).
+  std::map<std::string, Group> groups_;
+  /// Total bytes pending across all groups.
+  size_t pending_bytes_ = 0;
+  /// The block size bound.
+  size_t max_block_bytes_;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_INDEXING_POSTINGS_OUTPUT_STREAM_H_
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/indexing/ShmRingOutputStream.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include "google/protobuf/io/coded_stream.h"
+
+namespace kythe {
+namespace {
+
+/// Identifies an initialized ring header ("kyshmrng").
+constexpr uint64_t kMagic = 0x6b7973686d726e67ULL;
+
+/// Records start on this alignment; the pad arithmetic below relies on every
+/// record's footprint being a multiple of it.
+constexpr uint64_t kRecordAlign = 8;
+/// The record header is a single 64-bit word.
+constexpr uint64_t kRecordHeader = 8;
+
+// Record header word layout: bit 63 marks the record committed, bits 32-33
+// carry the kind, and bits 0-31 carry the payload size. A zero word marks a
+// slot the current lap has not written yet (the drainer re-zeroes slots as it
+// consumes them).
+constexpr uint64_t kCommitted = uint64_t{1} << 63;
+constexpr uint64_t kKindShift = 32;
+constexpr uint64_t kKindMask = 3;
+constexpr uint64_t kSizeMask = 0xffffffff;
+/// A batch of delimited entries.
+constexpr uint64_t kKindEntries = 1;
+/// Skipped space at the end of the data region (a record never wraps).
+constexpr uint64_t kKindPad = 2;
+/// A writer detached from the ring.
+constexpr uint64_t kKindClose = 3;
+
+/// \brief The footprint of a record with a `size`-byte payload.
+uint64_t RecordFootprint(uint64_t size) {
+  return (kRecordHeader + size + kRecordAlign - 1) & ~(kRecordAlign - 1);
+}
+
+/// \brief Publishes the record at `record`, whose payload is already in
+/// place, with release semantics.
+void PublishRecord(unsigned char* record, uint64_t kind, uint64_t size) {
+  auto* word = reinterpret_cast<std::atomic<uint64_t>*>(record);
+  word->store(kCommitted | (kind << kKindShift) | size,
+              std::memory_order_release);
+}
+
+}  // anonymous namespace
+
+struct ShmRingOutputStream::RingHeader {
+  /// `kMagic` once the creating process has finished initialization.
+  std::atomic<uint64_t> magic;
+  /// The size of the data region in bytes (a power of two).
+  uint64_t capacity;
+  /// The next byte position to reserve (monotonic; wraps via masking).
+  std::atomic<uint64_t> reserve;
+  /// The next byte position the drainer will read (monotonic).
+  std::atomic<uint64_t> consume;
+};
+
+std::pair<ShmRingOutputStream::RingHeader*, unsigned char*>
+ShmRingOutputStream::Attach(const std::string& name, size_t capacity) {
+  size_t rounded = 1;
+  while (rounded < capacity) {
+    rounded *= 2;
+  }
+  const size_t map_size = sizeof(RingHeader) + rounded;
+  // Whoever wins the O_EXCL creation race sizes and initializes the ring;
+  // everyone else waits for the magic word before trusting the header.
+  int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL,
+                      S_IRUSR | S_IWUSR);
+  const bool creator = fd >= 0;
+  if (!creator) {
+    if (errno != EEXIST) {
+      ::perror("Can't create shared ring");
+      return {nullptr, nullptr};
+    }
+    fd = ::shm_open(name.c_str(), O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+      ::perror("Can't open shared ring");
+      return {nullptr, nullptr};
+    }
+    // The creator may not have sized the object yet; mapping it too early
+    // would fault on first access.
+    struct stat ring_stat;
+    while (::fstat(fd, &ring_stat) == 0 &&
+           static_cast<size_t>(ring_stat.st_size) < map_size) {
+      ::sched_yield();
+    }
+  } else if (::ftruncate(fd, map_size) != 0) {
+    ::perror("Can't size shared ring");
+    ::close(fd);
+    return {nullptr, nullptr};
+  }
+  void* map =
+      ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    ::perror("Can't map shared ring");
+    return {nullptr, nullptr};
+  }
+  auto* header = static_cast<RingHeader*>(map);
+  auto* data = reinterpret_cast<unsigned char*>(header + 1);
+  if (creator) {
+    // ftruncate zero-filled the region, so all record slots start unwritten.
+    header->capacity = rounded;
+    header->reserve.store(0, std::memory_order_relaxed);
+    header->consume.store(0, std::memory_order_relaxed);
+    header->magic.store(kMagic, std::memory_order_release);
+  } else {
+    while (header->magic.load(std::memory_order_acquire) != kMagic) {
+      ::sched_yield();
+    }
+    if (header->capacity != rounded) {
+      ::fprintf(stderr, "Shared ring %s has capacity %llu, expected %llu\n",
+                name.c_str(),
+                static_cast<unsigned long long>(header->capacity),
+                static_cast<unsigned long long>(rounded));
+      ::munmap(map, map_size);
+      return {nullptr, nullptr};
+    }
+  }
+  return {header, data};
+}
+
+std::unique_ptr<ShmRingOutputStream> ShmRingOutputStream::Create(
+    const std::string& name, size_t capacity) {
+  auto ring = Attach(name, capacity);
+  if (ring.first == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<ShmRingOutputStream>(
+      new ShmRingOutputStream(ring.first, ring.second));
+}
+
+ShmRingOutputStream::ShmRingOutputStream(RingHeader* header,
+                                         unsigned char* data)
+    : header_(header), data_(data) {
+  edge_entry_.set_fact_name("/");
+}
+
+ShmRingOutputStream::~ShmRingOutputStream() {
+  FlushBatch();
+  AppendRecord(kKindClose, nullptr, 0);
+  ::munmap(header_, sizeof(RingHeader) + header_->capacity);
+}
+
+void ShmRingOutputStream::Emit(const FactRef& fact) {
+  fact.Expand(&fact_entry_);
+  EnqueueEntry(fact_entry_);
+}
+
+void ShmRingOutputStream::Emit(const EdgeRef& edge) {
+  edge.Expand(&edge_entry_);
+  EnqueueEntry(edge_entry_);
+}
+
+void ShmRingOutputStream::Emit(const OrdinalEdgeRef& edge) {
+  edge.Expand(&edge_entry_);
+  EnqueueEntry(edge_entry_);
+}
+
+void ShmRingOutputStream::EnqueueEntry(const proto::Entry& entry) {
+  size_t entry_size = entry.ByteSize();
+  size_t size_size =
+      google::protobuf::io::CodedOutputStream::VarintSize32(entry_size);
+  size_t insertion_point = batch_.size();
+  batch_.resize(insertion_point + size_size + entry_size);
+  unsigned char* buffer = &batch_[insertion_point];
+  google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(entry_size,
+                                                                buffer);
+  if (!entry.SerializeToArray(&buffer[size_size], entry_size)) {
+    assert(0 && "bad proto size calculation");
+  }
+  if (batch_.size() >= kBatchLimit) {
+    FlushBatch();
+  }
+}
+
+void ShmRingOutputStream::FlushBatch() {
+  if (batch_.empty()) {
+    return;
+  }
+  AppendRecord(kKindEntries, batch_.data(), batch_.size());
+  batch_.clear();
+}
+
+void ShmRingOutputStream::AppendRecord(uint64_t kind,
+                                       const unsigned char* payload,
+                                       size_t size) {
+  const uint64_t capacity = header_->capacity;
+  const uint64_t mask = capacity - 1;
+  const uint64_t total = RecordFootprint(size);
+  assert(total <= capacity && "record larger than the ring");
+  for (;;) {
+    uint64_t reserve = header_->reserve.load(std::memory_order_relaxed);
+    uint64_t offset = reserve & mask;
+    // A record never wraps; if it doesn't fit before the end of the data
+    // region, also reserve the tail and mark it as padding.
+    uint64_t pad = offset + total > capacity ? capacity - offset : 0;
+    uint64_t next = reserve + pad + total;
+    if (next - header_->consume.load(std::memory_order_acquire) > capacity) {
+      // The ring is full; wait for the drainer to catch up.
+      ::sched_yield();
+      continue;
+    }
+    if (!header_->reserve.compare_exchange_weak(reserve, next,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed)) {
+      continue;
+    }
+    if (pad != 0) {
+      PublishRecord(data_ + offset, kKindPad, pad - kRecordHeader);
+      offset = 0;
+    }
+    if (size != 0) {
+      memcpy(data_ + offset + kRecordHeader, payload, size);
+    }
+    PublishRecord(data_ + offset, kind, size);
+    return;
+  }
+}
+
+bool ShmRingOutputStream::Drain(const std::string& name, size_t writers,
+                                google::protobuf::io::FileOutputStream* stream,
+                                size_t capacity) {
+  auto ring = Attach(name, capacity);
+  if (ring.first == nullptr) {
+    return false;
+  }
+  RingHeader* header = ring.first;
+  unsigned char* data = ring.second;
+  const uint64_t mask = header->capacity - 1;
+  size_t closes = 0;
+  while (closes < writers) {
+    uint64_t consume = header->consume.load(std::memory_order_relaxed);
+    uint64_t offset = consume & mask;
+    auto* word = reinterpret_cast<std::atomic<uint64_t>*>(data + offset);
+    uint64_t record = word->load(std::memory_order_acquire);
+    if ((record & kCommitted) == 0) {
+      ::sched_yield();
+      continue;
+    }
+    uint64_t size = record & kSizeMask;
+    uint64_t kind = (record >> kKindShift) & kKindMask;
+    if (kind == kKindEntries && size != 0) {
+      google::protobuf::io::CodedOutputStream coded_stream(stream);
+      coded_stream.WriteRaw(data + offset + kRecordHeader, size);
+    } else if (kind == kKindClose) {
+      ++closes;
+    }
+    uint64_t total = RecordFootprint(size);
+    // Zero the slot before releasing it so its bytes can't masquerade as a
+    // committed record header after the ring wraps.
+    memset(data + offset, 0, total);
+    header->consume.store(consume + total, std::memory_order_release);
+  }
+  stream->Flush();
+  ::munmap(header, sizeof(RingHeader) + header->capacity);
+  return true;
+}
+
+}  // namespace kythe
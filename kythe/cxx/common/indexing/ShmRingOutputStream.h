@@ -0,0 +1,118 @@
+/*
+ * Copyright 2019 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_COMMON_INDEXING_SHM_RING_OUTPUT_STREAM_H_
+#define KYTHE_CXX_COMMON_INDEXING_SHM_RING_OUTPUT_STREAM_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "kythe/cxx/common/indexing/KytheCachingOutput.h"
+#include "kythe/proto/storage.pb.h"
+
+namespace kythe {
+
+/// \brief A `KytheCachingOutput` that appends entries to a shared-memory
+/// ring buffer written concurrently by several indexer processes.
+///
+/// The ring is a POSIX shared memory object (`shm_open`) laid out as a small
+/// header followed by a power-of-two data region. Writers batch
+/// varint-delimited `Entry` messages in a private buffer, reserve ring space
+/// for a batch with one compare-and-swap on a monotonic cursor, copy the
+/// bytes, and publish the batch by storing its record header word with
+/// release semantics; the emit path takes no locks. A single drainer process
+/// (see `Drain`) consumes records in reservation order and writes one merged
+/// delimited stream, replacing the downstream pass that concatenated
+/// per-process entry files.
+///
+/// The ring carries no recovery information: if a writer dies mid-record the
+/// drainer will wait on it forever, and a ring left over from a crashed run
+/// must be removed (`shm_unlink`) before it is reused.
+class ShmRingOutputStream : public KytheCachingOutput {
+ public:
+  /// The default size of the ring's data region.
+  static constexpr size_t kDefaultCapacity = size_t{64} * 1024 * 1024;
+
+  /// \brief Opens the shared ring `name` for writing, creating and
+  /// initializing it if it does not yet exist.
+  /// \param name A name suitable for `shm_open` (e.g. "/kythe-entries").
+  /// \param capacity The size of the ring's data region, rounded up to a
+  /// power of two. All processes sharing the ring must agree on this value.
+  /// \return null if the ring could not be opened or mapped.
+  static std::unique_ptr<ShmRingOutputStream> Create(
+      const std::string& name, size_t capacity = kDefaultCapacity);
+
+  /// Flushes any batched entries, appends a writer-close record, and
+  /// detaches from the ring.
+  ~ShmRingOutputStream() override;
+
+  void Emit(const FactRef& fact) override;
+  void Emit(const EdgeRef& edge) override;
+  void Emit(const OrdinalEdgeRef& edge) override;
+
+  /// \brief Drains the shared ring `name`, writing the merged delimited
+  /// entry stream to `stream`.
+  ///
+  /// Returns once `writers` writer-close records have been consumed (each
+  /// `ShmRingOutputStream` appends one when it is destroyed), so the caller
+  /// must know how many writer processes will attach.
+  /// \return false if the ring could not be opened or mapped.
+  static bool Drain(const std::string& name, size_t writers,
+                    google::protobuf::io::FileOutputStream* stream,
+                    size_t capacity = kDefaultCapacity);
+
+ private:
+  struct RingHeader;
+
+  ShmRingOutputStream(RingHeader* header, unsigned char* data);
+
+  /// \brief Frames `entry` into the pending batch, appending the batch to
+  /// the ring once it grows large enough.
+  void EnqueueEntry(const proto::Entry& entry);
+
+  /// \brief Appends the pending batch (if any) to the ring as one record.
+  void FlushBatch();
+
+  /// \brief Reserves ring space for one record of `kind`, copies `size`
+  /// bytes of `payload` into it, and publishes it. Spins (yielding) while
+  /// the ring is full, waiting on the drainer.
+  void AppendRecord(uint64_t kind, const unsigned char* payload, size_t size);
+
+  /// \brief Maps the ring `name`, initializing it on first creation.
+  /// \return {header, data} or {nullptr, nullptr} on failure.
+  static std::pair<RingHeader*, unsigned char*> Attach(const std::string& name,
+                                                       size_t capacity);
+
+  /// The mapped ring header.
+  RingHeader* header_;
+  /// The mapped data region (`header_->capacity` bytes).
+  unsigned char* data_;
+  /// A prototypical Kythe fact, used only to build other Kythe facts.
+  proto::Entry fact_entry_;
+  /// A prototypical Kythe edge, used only to build same.
+  proto::Entry edge_entry_;
+  /// Entries framed and staged for the next ring record.
+  std::vector<unsigned char> batch_;
+  /// Append a record once the pending batch grows past this many bytes.
+  static constexpr size_t kBatchLimit = 64 * 1024;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_INDEXING_SHM_RING_OUTPUT_STREAM_H_
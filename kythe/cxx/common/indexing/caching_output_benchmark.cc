@@ -0,0 +1,89 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks for FileOutputStream entry emission.
+
+#include <fcntl.h>
+
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "glog/logging.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "kythe/cxx/common/indexing/KytheCachingOutput.h"
+
+namespace kythe {
+namespace {
+
+void BM_EmitFacts(benchmark::State& state) {
+  int fd = ::open("/dev/null", O_WRONLY);
+  CHECK_GE(fd, 0);
+  {
+    google::protobuf::io::FileOutputStream raw_output(fd);
+    FileOutputStream output(&raw_output);
+    VNameRef source;
+    source.set_signature("signature#deadbeef");
+    source.set_corpus("kythe");
+    source.set_root("root");
+    source.set_path("kythe/cxx/common/indexing/caching_output_benchmark.cc");
+    source.set_language("c++");
+    const std::string fact_value(state.range(0), 'x');
+    FactRef fact;
+    fact.source = &source;
+    fact.fact_name = "/kythe/node/kind";
+    fact.fact_value = fact_value;
+    for (auto _ : state) {
+      output.Emit(fact);
+    }
+    state.SetBytesProcessed(state.iterations() * fact_value.size());
+  }
+  ::close(fd);
+}
+BENCHMARK(BM_EmitFacts)->Range(8, 8 << 10);
+
+void BM_EmitEdges(benchmark::State& state) {
+  int fd = ::open("/dev/null", O_WRONLY);
+  CHECK_GE(fd, 0);
+  {
+    google::protobuf::io::FileOutputStream raw_output(fd);
+    FileOutputStream output(&raw_output);
+    VNameRef source;
+    source.set_signature("source#deadbeef");
+    source.set_corpus("kythe");
+    source.set_path("kythe/cxx/common/indexing/caching_output_benchmark.cc");
+    source.set_language("c++");
+    VNameRef target;
+    target.set_signature("target#cafef00d");
+    target.set_corpus("kythe");
+    target.set_path("kythe/cxx/common/indexing/KytheCachingOutput.h");
+    target.set_language("c++");
+    EdgeRef edge;
+    edge.source = &source;
+    edge.edge_kind = "/kythe/edge/ref";
+    edge.target = &target;
+    for (auto _ : state) {
+      output.Emit(edge);
+    }
+  }
+  ::close(fd);
+}
+BENCHMARK(BM_EmitEdges);
+
+}  // namespace
+}  // namespace kythe
+
+BENCHMARK_MAIN();
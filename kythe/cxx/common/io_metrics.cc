@@ -0,0 +1,90 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "kythe/cxx/common/io_metrics.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#include "absl/strings/str_cat.h"
+
+namespace kythe {
+namespace {
+/// The most recently registered metric, or null.
+std::atomic<IoMetric*> metric_head{nullptr};
+
+/// \brief Writes the JSON dump to the file named by KYTHE_IO_METRICS, if set.
+void DumpAtExit() {
+  const char* path = getenv("KYTHE_IO_METRICS");
+  if (path == nullptr || *path == '\0') {
+    return;
+  }
+  std::string json = IoMetric::DumpAllJson();
+  if (std::string(path) == "-") {
+    fprintf(stderr, "%s\n", json.c_str());
+    return;
+  }
+  if (FILE* file = fopen(path, "w")) {
+    fprintf(file, "%s\n", json.c_str());
+    fclose(file);
+  } else {
+    fprintf(stderr, "Can't write I/O metrics to %s\n", path);
+  }
+}
+
+std::once_flag dump_registered;
+}  // anonymous namespace
+
+IoMetric::IoMetric(const char* name) : name_(name) {
+  next_ = metric_head.load(std::memory_order_relaxed);
+  while (!metric_head.compare_exchange_weak(
+      next_, this, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+  std::call_once(dump_registered, [] { atexit(DumpAtExit); });
+}
+
+std::string IoMetric::DumpAllJson() {
+  std::string result = "{";
+  bool first_metric = true;
+  for (const IoMetric* metric = metric_head.load(std::memory_order_acquire);
+       metric != nullptr; metric = metric->next_) {
+    absl::StrAppend(&result, first_metric ? "" : ",", "\"", metric->name_,
+                    "\":{\"ops\":",
+                    metric->ops_.load(std::memory_order_relaxed),
+                    ",\"bytes\":",
+                    metric->bytes_.load(std::memory_order_relaxed),
+                    ",\"nanos\":",
+                    metric->nanos_.load(std::memory_order_relaxed),
+                    ",\"size_histogram\":[");
+    bool first_bucket = true;
+    for (size_t bucket = 0; bucket < kNumSizeBuckets; ++bucket) {
+      uint64_t count =
+          metric->size_buckets_[bucket].load(std::memory_order_relaxed);
+      if (count == 0) {
+        continue;
+      }
+      absl::StrAppend(&result, first_bucket ? "" : ",", "[",
+                      uint64_t{1} << bucket, ",", count, "]");
+      first_bucket = false;
+    }
+    absl::StrAppend(&result, "]}");
+    first_metric = false;
+  }
+  absl::StrAppend(&result, "}");
+  return result;
+}
+
+}  // namespace kythe
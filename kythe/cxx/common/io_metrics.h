@@ -0,0 +1,113 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef KYTHE_CXX_COMMON_IO_METRICS_H_
+#define KYTHE_CXX_COMMON_IO_METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace kythe {
+
+/// \brief A process-wide throughput metric for one I/O stage.
+///
+/// Each stage (kzip reads, archive writes, entry output, ...) defines a
+/// metric with static storage duration and records (bytes, wall time) per
+/// operation as it goes; recording costs a few relaxed atomic adds, so the
+/// metrics stay enabled in production builds. Alongside the op/byte/time
+/// counters, a power-of-two histogram of operation sizes is kept.
+///
+/// When the environment variable `KYTHE_IO_METRICS` names a file ("-" for
+/// standard error), every registered metric is dumped there as JSON at
+/// process exit, giving per-stage throughput for the extract-to-index
+/// pipeline without external tracing.
+class IoMetric {
+ public:
+  /// \brief Registers a metric under `name`.
+  ///
+  /// `name` must have static storage duration, and the metric itself must
+  /// never be destroyed: registration links it into a global list.
+  explicit IoMetric(const char* name);
+
+  IoMetric(const IoMetric&) = delete;
+  IoMetric& operator=(const IoMetric&) = delete;
+
+  /// \brief Records one operation moving `bytes` bytes in `nanos` wall
+  /// nanoseconds (zero when the caller did not time it).
+  void Record(size_t bytes, uint64_t nanos = 0) {
+    ops_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    nanos_.fetch_add(nanos, std::memory_order_relaxed);
+    size_t bucket = 0;
+    while (bucket + 1 < kNumSizeBuckets && (size_t{1} << bucket) < bytes) {
+      ++bucket;
+    }
+    size_buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const char* name() const { return name_; }
+
+  /// \brief Returns every registered metric as a JSON object keyed by metric
+  /// name; histogram buckets are (upper bound, count) pairs with empty
+  /// buckets omitted.
+  static std::string DumpAllJson();
+
+ private:
+  /// The number of power-of-two operation-size buckets; bucket `k` counts
+  /// operations of at most 2^k bytes.
+  static constexpr size_t kNumSizeBuckets = 40;
+  /// The stage name; not owned.
+  const char* name_;
+  /// Operations recorded.
+  std::atomic<uint64_t> ops_{0};
+  /// Bytes moved across all operations.
+  std::atomic<uint64_t> bytes_{0};
+  /// Wall nanoseconds across all timed operations.
+  std::atomic<uint64_t> nanos_{0};
+  /// Histogram of operation sizes.
+  std::atomic<uint64_t> size_buckets_[kNumSizeBuckets] = {};
+  /// The previously registered metric, or null.
+  IoMetric* next_;
+};
+
+/// \brief Times a region and records it into an `IoMetric` on scope exit.
+class ScopedIoTimer {
+ public:
+  /// \param bytes The bytes the region will move, if already known;
+  /// otherwise call `set_bytes` before scope exit.
+  explicit ScopedIoTimer(IoMetric* metric, size_t bytes = 0)
+      : metric_(metric),
+        bytes_(bytes),
+        start_(std::chrono::steady_clock::now()) {}
+  void set_bytes(size_t bytes) { bytes_ = bytes; }
+  ~ScopedIoTimer() {
+    metric_->Record(
+        bytes_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start_)
+                    .count());
+  }
+
+ private:
+  IoMetric* metric_;
+  size_t bytes_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_IO_METRICS_H_
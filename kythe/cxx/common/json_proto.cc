@@ -16,6 +16,7 @@
 
 #include "json_proto.h"
 
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/escaping.h"
 #include "glog/logging.h"
@@ -112,6 +113,66 @@ JsonParseOptions DefaultParseOptions() {
 
 }  // namespace
 
+JsonCodec::~JsonCodec() = default;
+
+google::protobuf::util::TypeResolver* JsonCodec::ResolverFor(
+    const DescriptorPool* pool) {
+  if (pool != pool_ || resolver_ == nullptr) {
+    pool_ = pool;
+    if (pool == DescriptorPool::generated_pool()) {
+      owned_resolver_.reset();
+      resolver_ = GetGeneratedTypeResolver();
+    } else {
+      owned_resolver_ = absl::make_unique<PermissiveTypeResolver>(pool);
+      resolver_ = owned_resolver_.get();
+    }
+  }
+  return resolver_;
+}
+
+absl::Status JsonCodec::Parse(absl::string_view input,
+                              google::protobuf::Message* message) {
+  google::protobuf::io::ArrayInputStream stream(input.data(), input.size());
+  return Parse(&stream, message);
+}
+
+absl::Status JsonCodec::Parse(google::protobuf::io::ZeroCopyInputStream* input,
+                              google::protobuf::Message* message) {
+  auto* resolver = ResolverFor(message->GetDescriptor()->file()->pool());
+  binary_.clear();
+  google::protobuf::io::StringOutputStream output(&binary_);
+  auto status = google::protobuf::util::JsonToBinaryStream(
+      resolver, message->GetDescriptor()->full_name(), input, &output,
+      DefaultParseOptions());
+  if (!status.ok()) {
+    return absl::Status(static_cast<absl::StatusCode>(status.error_code()),
+                        std::string(status.error_message()));
+  }
+  if (!message->ParseFromString(binary_)) {
+    return absl::InvalidArgumentError(
+        "JSON transcoder produced invalid protobuf output.");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status JsonCodec::Write(const google::protobuf::Message& message,
+                              std::string* out) {
+  auto* resolver = ResolverFor(message.GetDescriptor()->file()->pool());
+  out->clear();
+  google::protobuf::util::JsonPrintOptions options;
+  options.preserve_proto_field_names = true;
+  if (!message.SerializeToString(&binary_)) {
+    return absl::InternalError("Failure serializing message.");
+  }
+  auto status = google::protobuf::util::BinaryToJsonString(
+      resolver, message.GetDescriptor()->full_name(), binary_, out, options);
+  if (!status.ok()) {
+    return absl::Status(static_cast<absl::StatusCode>(status.error_code()),
+                        std::string(status.error_message()));
+  }
+  return absl::OkStatus();
+}
+
 bool WriteMessageAsJsonToString(const google::protobuf::Message& message,
                                 std::string* out) {
   auto status = WriteMessageAsJsonToStringInternal(message, out);
@@ -17,6 +17,7 @@
 #ifndef KYTHE_CXX_COMMON_JSON_PROTO_H_
 #define KYTHE_CXX_COMMON_JSON_PROTO_H_
 
+#include <memory>
 #include <string>
 
 #include "absl/status/status.h"
@@ -27,8 +28,67 @@
 #include "google/protobuf/util/json_util.h"
 #include "kythe/cxx/common/status_or.h"
 
+namespace google {
+namespace protobuf {
+namespace util {
+class TypeResolver;
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
 namespace kythe {
 
+/// \brief A reusable JSON <-> protobuf transcoder.
+///
+/// The free ParseFromJson*/WriteMessageAsJson* functions below rebuild their
+/// type resolver and intermediate wire-format buffer on every call. A codec
+/// keeps both alive between calls, so loops that transcode many messages
+/// (e.g. reading every unit in a kzip) can hoist the setup out of the loop.
+/// A codec is not synchronized; use one per thread.
+class JsonCodec {
+ public:
+  JsonCodec() = default;
+  JsonCodec(const JsonCodec&) = delete;
+  JsonCodec& operator=(const JsonCodec&) = delete;
+  ~JsonCodec();
+
+  /// \brief Deserializes a protobuf from JSON text.
+  /// \param input The input text to parse.
+  /// \param message The message to parse.
+  /// \return The status message result of parsing.
+  absl::Status Parse(absl::string_view input,
+                     google::protobuf::Message* message);
+
+  /// \brief Deserializes a protobuf from a JSON text stream.
+  /// \param input The input stream from which to read.
+  /// \param message The message to parse.
+  /// \return The status message result of parsing.
+  absl::Status Parse(google::protobuf::io::ZeroCopyInputStream* input,
+                     google::protobuf::Message* message);
+
+  /// \brief Serializes a protobuf to JSON form with no wrapper.
+  /// \param message The protobuf to serialize.
+  /// \param out Set to the serialized message on success.
+  /// \return The status message result of serialization.
+  absl::Status Write(const google::protobuf::Message& message,
+                     std::string* out);
+
+ private:
+  /// \brief Returns a resolver for `pool`, rebuilding only if the codec last
+  /// saw a different pool.
+  google::protobuf::util::TypeResolver* ResolverFor(
+      const google::protobuf::DescriptorPool* pool);
+
+  const google::protobuf::DescriptorPool* pool_ = nullptr;
+  /// Either `owned_resolver_.get()` or the shared resolver for the generated
+  /// pool, which must not be deleted.
+  google::protobuf::util::TypeResolver* resolver_ = nullptr;
+  std::unique_ptr<google::protobuf::util::TypeResolver> owned_resolver_;
+  /// Scratch buffer for the wire-format leg of the transcode, reused across
+  /// calls.
+  std::string binary_;
+};
+
 /// \brief Deserializes a protobuf from JSON text.
 /// \param input The input text to parse.
 /// \param message The message to parse.
@@ -16,15 +16,22 @@
 
 #include "kythe/cxx/common/kythe_metadata_file.h"
 
+#include <openssl/sha.h>
+
 #include "absl/strings/escaping.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/strip.h"
 #include "absl/types/optional.h"
 #include "glog/logging.h"
 #include "google/protobuf/util/json_util.h"
+#include "kythe/cxx/common/base64.h"
 #include "kythe/cxx/common/json_proto.h"
 #include "kythe/cxx/common/schema/edges.h"
 #include "kythe/proto/metadata.pb.h"
 #include "kythe/proto/storage.pb.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/reader.h"
 
 namespace kythe {
 namespace {
@@ -75,7 +82,7 @@ absl::optional<std::string> LoadCommentMetadata(absl::string_view buf_string,
     break;
   }
   google::protobuf::string decoded;
-  return absl::Base64Unescape(raw_data, &decoded)
+  return Base64Decode(raw_data, &decoded)
              ? absl::optional<std::string>(std::string(decoded))
              : absl::nullopt;
 }
@@ -113,6 +120,362 @@ absl::optional<std::string> FindCommentMetadata(
   return LoadCommentMetadata(buffer, comment_start,
                              comment_start + 3 + search_string.size());
 }
+
+/// \brief SAX handler that converts a kythe0 GeneratedCodeInfo JSON document
+/// to metadata rules as tokens arrive.
+///
+/// Generated-code metadata runs to hundreds of megabytes for large trees;
+/// building a rapidjson DOM and a full GeneratedCodeInfo message first costs
+/// several times the input size in peak memory. This handler stages one
+/// MappingRule at a time and hands it to LoadMetaElement so the
+/// rule-conversion logic stays in one place. Field names are accepted in both
+/// proto (source_vname) and JSON camelCase (sourceVname) forms and enums are
+/// matched case-insensitively, mirroring the protobuf JSON parser's
+/// configuration; unknown fields are skipped. Any structural surprise aborts
+/// the parse and the caller falls back to the protobuf JSON path.
+class StreamingMetadataParser
+    : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>,
+                                          StreamingMetadataParser> {
+ public:
+  explicit StreamingMetadataParser(std::vector<MetadataFile::Rule>* rules)
+      : rules_(rules) {}
+
+  /// \return true if a whole, well-formed document was consumed.
+  bool complete() const { return state_ == State::kDone; }
+
+  bool StartObject() {
+    switch (state_) {
+      case State::kStart:
+        state_ = State::kTop;
+        return true;
+      case State::kMetaArray:
+        rule_.Clear();
+        state_ = State::kRule;
+        return true;
+      case State::kRuleVNameValue:
+        state_ = State::kVName;
+        return true;
+      case State::kSkip:
+        ++skip_depth_;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool EndObject(rapidjson::SizeType) {
+    switch (state_) {
+      case State::kTop:
+        state_ = State::kDone;
+        return true;
+      case State::kRule: {
+        auto converted = MetadataFile::LoadMetaElement(rule_);
+        if (!converted) {
+          return false;
+        }
+        rules_->push_back(*std::move(converted));
+        state_ = State::kMetaArray;
+        return true;
+      }
+      case State::kVName:
+        state_ = State::kRule;
+        return true;
+      case State::kSkip:
+        return PopSkip();
+      default:
+        return false;
+    }
+  }
+
+  bool StartArray() {
+    switch (state_) {
+      case State::kMetaValue:
+        state_ = State::kMetaArray;
+        return true;
+      case State::kSkip:
+        ++skip_depth_;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool EndArray(rapidjson::SizeType) {
+    switch (state_) {
+      case State::kMetaArray:
+        state_ = State::kTop;
+        return true;
+      case State::kSkip:
+        return PopSkip();
+      default:
+        return false;
+    }
+  }
+
+  bool Key(const char* str, rapidjson::SizeType length, bool) {
+    absl::string_view key(str, length);
+    switch (state_) {
+      case State::kTop:
+        if (key == "type") {
+          state_ = State::kTopTypeValue;
+        } else if (key == "meta") {
+          state_ = State::kMetaValue;
+        } else {
+          PushSkip();
+        }
+        return true;
+      case State::kRule:
+        if (key == "type") {
+          state_ = State::kRuleTypeValue;
+        } else if (key == "edge") {
+          state_ = State::kRuleEdgeValue;
+        } else if (key == "vname") {
+          vname_ = rule_.mutable_vname();
+          state_ = State::kRuleVNameValue;
+        } else if (key == "source_vname" || key == "sourceVname") {
+          vname_ = rule_.mutable_source_vname();
+          state_ = State::kRuleVNameValue;
+        } else if (!SelectUintField(key)) {
+          PushSkip();
+        }
+        return true;
+      case State::kVName:
+        if (!SelectVNameField(key)) {
+          PushSkip();
+        }
+        return true;
+      case State::kSkip:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool String(const char* str, rapidjson::SizeType length, bool) {
+    absl::string_view value(str, length);
+    switch (state_) {
+      case State::kTopTypeValue:
+        state_ = State::kTop;
+        return absl::EqualsIgnoreCase(value, "kythe0");
+      case State::kRuleTypeValue:
+        state_ = State::kRule;
+        if (absl::EqualsIgnoreCase(value, "nop")) {
+          rule_.set_type(proto::metadata::MappingRule::NOP);
+        } else if (absl::EqualsIgnoreCase(value, "anchor_defines")) {
+          rule_.set_type(proto::metadata::MappingRule::ANCHOR_DEFINES);
+        } else if (absl::EqualsIgnoreCase(value, "anchor_anchor")) {
+          rule_.set_type(proto::metadata::MappingRule::ANCHOR_ANCHOR);
+        } else if (!absl::EqualsIgnoreCase(value, "none")) {
+          return false;
+        }
+        return true;
+      case State::kRuleEdgeValue:
+        rule_.set_edge(std::string(value));
+        state_ = State::kRule;
+        return true;
+      case State::kRuleUintValue: {
+        // Protobuf JSON permits quoted numbers.
+        uint32_t number = 0;
+        if (!absl::SimpleAtoi(value, &number)) {
+          return false;
+        }
+        SetUintField(number);
+        state_ = State::kRule;
+        return true;
+      }
+      case State::kVNameFieldValue:
+        vname_field_->assign(value.data(), value.size());
+        state_ = State::kVName;
+        return true;
+      case State::kSkip:
+        return PopSkipIfScalar();
+      default:
+        return false;
+    }
+  }
+
+  bool Uint(unsigned value) {
+    switch (state_) {
+      case State::kTopTypeValue:
+        state_ = State::kTop;
+        return value == proto::metadata::GeneratedCodeInfo::KYTHE0;
+      case State::kRuleTypeValue:
+        if (!proto::metadata::MappingRule::Type_IsValid(value)) {
+          return false;
+        }
+        rule_.set_type(static_cast<proto::metadata::MappingRule::Type>(value));
+        state_ = State::kRule;
+        return true;
+      case State::kRuleUintValue:
+        SetUintField(value);
+        state_ = State::kRule;
+        return true;
+      case State::kSkip:
+        return PopSkipIfScalar();
+      default:
+        return false;
+    }
+  }
+
+  bool Int(int value) {
+    if (state_ == State::kSkip) {
+      return PopSkipIfScalar();
+    }
+    return value >= 0 && Uint(static_cast<unsigned>(value));
+  }
+
+  bool Null() {
+    // A null leaves the staged field at its default, as protobuf JSON does.
+    switch (state_) {
+      case State::kTopTypeValue:
+      case State::kMetaValue:
+        state_ = State::kTop;
+        return true;
+      case State::kRuleTypeValue:
+      case State::kRuleEdgeValue:
+      case State::kRuleUintValue:
+      case State::kRuleVNameValue:
+        state_ = State::kRule;
+        return true;
+      case State::kVNameFieldValue:
+        state_ = State::kVName;
+        return true;
+      case State::kSkip:
+        return PopSkipIfScalar();
+      default:
+        return false;
+    }
+  }
+
+  bool Bool(bool) { return state_ == State::kSkip && PopSkipIfScalar(); }
+  bool Int64(int64_t) { return state_ == State::kSkip && PopSkipIfScalar(); }
+  bool Uint64(uint64_t) {
+    return state_ == State::kSkip && PopSkipIfScalar();
+  }
+  bool Double(double) { return state_ == State::kSkip && PopSkipIfScalar(); }
+  bool Default() { return false; }
+
+ private:
+  enum class State {
+    kStart,           ///< Nothing consumed yet.
+    kTop,             ///< In the top-level object, awaiting a key.
+    kTopTypeValue,    ///< Awaiting the value for the top-level "type".
+    kMetaValue,       ///< Awaiting the array value for "meta".
+    kMetaArray,       ///< In the "meta" array, awaiting an element.
+    kRule,            ///< In a rule object, awaiting a key.
+    kRuleTypeValue,   ///< Awaiting a rule's "type" value.
+    kRuleEdgeValue,   ///< Awaiting a rule's "edge" value.
+    kRuleUintValue,   ///< Awaiting the offset field selected below.
+    kRuleVNameValue,  ///< Awaiting the object value for a VName field.
+    kVName,           ///< In a VName object, awaiting a key.
+    kVNameFieldValue, ///< Awaiting the string field selected below.
+    kSkip,            ///< Skipping one unknown value.
+    kDone,            ///< Consumed a whole document.
+  };
+
+  /// Rule offset fields a kRuleUintValue applies to.
+  enum class UintField {
+    kBegin,
+    kEnd,
+    kSourceBegin,
+    kSourceEnd,
+    kTargetBegin,
+    kTargetEnd,
+  };
+
+  bool SelectUintField(absl::string_view key) {
+    if (key == "begin") {
+      uint_field_ = UintField::kBegin;
+    } else if (key == "end") {
+      uint_field_ = UintField::kEnd;
+    } else if (key == "source_begin" || key == "sourceBegin") {
+      uint_field_ = UintField::kSourceBegin;
+    } else if (key == "source_end" || key == "sourceEnd") {
+      uint_field_ = UintField::kSourceEnd;
+    } else if (key == "target_begin" || key == "targetBegin") {
+      uint_field_ = UintField::kTargetBegin;
+    } else if (key == "target_end" || key == "targetEnd") {
+      uint_field_ = UintField::kTargetEnd;
+    } else {
+      return false;
+    }
+    state_ = State::kRuleUintValue;
+    return true;
+  }
+
+  void SetUintField(uint32_t value) {
+    switch (uint_field_) {
+      case UintField::kBegin:
+        rule_.set_begin(value);
+        break;
+      case UintField::kEnd:
+        rule_.set_end(value);
+        break;
+      case UintField::kSourceBegin:
+        rule_.set_source_begin(value);
+        break;
+      case UintField::kSourceEnd:
+        rule_.set_source_end(value);
+        break;
+      case UintField::kTargetBegin:
+        rule_.set_target_begin(value);
+        break;
+      case UintField::kTargetEnd:
+        rule_.set_target_end(value);
+        break;
+    }
+  }
+
+  bool SelectVNameField(absl::string_view key) {
+    if (key == "signature") {
+      vname_field_ = vname_->mutable_signature();
+    } else if (key == "corpus") {
+      vname_field_ = vname_->mutable_corpus();
+    } else if (key == "root") {
+      vname_field_ = vname_->mutable_root();
+    } else if (key == "path") {
+      vname_field_ = vname_->mutable_path();
+    } else if (key == "language") {
+      vname_field_ = vname_->mutable_language();
+    } else {
+      return false;
+    }
+    state_ = State::kVNameFieldValue;
+    return true;
+  }
+
+  void PushSkip() {
+    skip_return_ = state_;
+    skip_depth_ = 0;
+    state_ = State::kSkip;
+  }
+
+  bool PopSkipIfScalar() {
+    if (skip_depth_ == 0) {
+      state_ = skip_return_;
+    }
+    return true;
+  }
+
+  bool PopSkip() {
+    if (skip_depth_ == 0) {
+      return false;
+    }
+    if (--skip_depth_ == 0) {
+      state_ = skip_return_;
+    }
+    return true;
+  }
+
+  std::vector<MetadataFile::Rule>* rules_;
+  proto::metadata::MappingRule rule_;
+  proto::VName* vname_ = nullptr;
+  std::string* vname_field_ = nullptr;
+  State state_ = State::kStart;
+  State skip_return_ = State::kStart;
+  int skip_depth_ = 0;
+  UintField uint_field_ = UintField::kBegin;
+};
 }  // anonymous namespace
 
 absl::optional<MetadataFile::Rule> MetadataFile::LoadMetaElement(
@@ -164,6 +527,22 @@ absl::optional<MetadataFile::Rule> MetadataFile::LoadMetaElement(
 
 std::unique_ptr<MetadataFile> KytheMetadataSupport::LoadFromJSON(
     absl::string_view id, absl::string_view json) {
+  // Convert rules as the tokens stream by instead of materializing a DOM and
+  // a full GeneratedCodeInfo first; metadata for generated code can run to
+  // hundreds of megabytes.
+  {
+    std::vector<MetadataFile::Rule> rules;
+    StreamingMetadataParser handler(&rules);
+    rapidjson::MemoryStream stream(json.data(), json.size());
+    rapidjson::Reader reader;
+    if (reader.Parse(stream, handler) && handler.complete()) {
+      return MetadataFile::LoadFromRules(id, rules.begin(), rules.end());
+    }
+  }
+
+  // The streaming parser rejects anything structurally surprising; retry
+  // with the general protobuf JSON parser so such documents keep loading (or
+  // fail with its diagnostics).
   proto::metadata::GeneratedCodeInfo metadata;
   google::protobuf::util::JsonParseOptions options;
   // Existing implementations specify message types using lower-case enum names,
@@ -203,16 +582,42 @@ void MetadataSupports::UseVNameLookup(VNameLookup lookup) const {
   }
 }
 
-std::unique_ptr<kythe::MetadataFile> MetadataSupports::ParseFile(
+std::shared_ptr<const kythe::MetadataFile> MetadataSupports::ParseFile(
     const std::string& filename, absl::string_view buffer,
     const std::string& search_string) const {
+  // Supports key off the filename and bake it into the parsed rules, and the
+  // search string selects which comment decodes, so the cache key covers
+  // both alongside a digest of the encoded buffer. Keying on the encoded
+  // bytes (rather than the decoded payload) means a cache hit also skips
+  // comment scanning and base64 decoding, which dominate for headers that
+  // embed megabytes of metadata.
+  std::string cache_key = filename;
+  cache_key.push_back('\0');
+  cache_key.append(search_string);
+  cache_key.push_back('\0');
+  {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    ::SHA256(reinterpret_cast<const unsigned char*>(buffer.data()),
+             buffer.size(), digest);
+    cache_key.append(reinterpret_cast<const char*>(digest), sizeof(digest));
+  }
+  {
+    absl::MutexLock lock(&cache_mu_);
+    auto cached = parsed_cache_.find(cache_key);
+    if (cached != parsed_cache_.end()) {
+      return cached->second;
+    }
+  }
   std::string modified_filename = filename;
   absl::optional<std::string> decoded_buffer_storage;
   absl::string_view decoded_buffer = buffer;
   if (!search_string.empty()) {
     decoded_buffer_storage = FindCommentMetadata(buffer, search_string);
     if (!decoded_buffer_storage) {
-      return nullptr;
+      // Cache the miss so the buffer isn't rescanned for every unit.
+      absl::MutexLock lock(&cache_mu_);
+      return parsed_cache_.emplace(std::move(cache_key), nullptr)
+          .first->second;
     }
     decoded_buffer = *decoded_buffer_storage;
   }
@@ -226,13 +631,19 @@ std::unique_ptr<kythe::MetadataFile> MetadataSupports::ParseFile(
       modified_filename = filename.substr(0, filename.size() - 2);
     }
   }
+  std::shared_ptr<const kythe::MetadataFile> parsed;
   for (const auto& support : supports_) {
     if (auto metadata =
             support->ParseFile(filename, modified_filename, decoded_buffer)) {
-      return metadata;
+      parsed = std::move(metadata);
+      break;
     }
   }
-  return nullptr;
+  // Parsing happens outside the lock; if two units race on the same file, the
+  // first insert wins and the duplicate result is discarded.
+  absl::MutexLock lock(&cache_mu_);
+  return parsed_cache_.emplace(std::move(cache_key), std::move(parsed))
+      .first->second;
 }
 
 }  // namespace kythe
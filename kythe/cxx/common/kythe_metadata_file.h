@@ -17,12 +17,18 @@
 #ifndef KYTHE_CXX_COMMON_KYTHE_METADATA_FILE_H_
 #define KYTHE_CXX_COMMON_KYTHE_METADATA_FILE_H_
 
-#include <map>
+#include <algorithm>
 #include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "kythe/proto/metadata.pb.h"
 #include "kythe/proto/storage.pb.h"
 #include "rapidjson/document.h"
@@ -58,9 +64,16 @@ class MetadataFile {
       if (rule->whole_file) {
         meta_file->file_scope_rules_.push_back(*rule);
       } else {
-        meta_file->rules_.emplace(rule->begin, *rule);
+        meta_file->rules_.push_back(*rule);
       }
     }
+    // Sort stably so that rules with equal ranges apply in their original
+    // order; `FindRules` binary-searches this flattened array.
+    std::stable_sort(meta_file->rules_.begin(), meta_file->rules_.end(),
+                     [](const Rule& lhs, const Rule& rhs) {
+                       return std::tie(lhs.begin, lhs.end) <
+                              std::tie(rhs.begin, rhs.end);
+                     });
     return meta_file;
   }
 
@@ -68,8 +81,19 @@ class MetadataFile {
   static absl::optional<MetadataFile::Rule> LoadMetaElement(
       const kythe::proto::metadata::MappingRule& mapping);
 
-  /// Rules to apply keyed on `begin`.
-  const std::multimap<unsigned, Rule>& rules() const { return rules_; }
+  /// \brief Returns the rules whose range is exactly [`begin`, `end`).
+  ///
+  /// The rules are kept in a flat array sorted on (begin, end), so a lookup
+  /// is two binary searches with no per-rule pointer chasing.
+  absl::Span<const Rule> FindRules(unsigned begin, unsigned end) const {
+    auto range = std::equal_range(
+        rules_.begin(), rules_.end(), std::make_pair(begin, end),
+        [](const auto& lhs, const auto& rhs) {
+          return RuleKey(lhs) < RuleKey(rhs);
+        });
+    return absl::MakeConstSpan(rules_.data() + (range.first - rules_.begin()),
+                               range.second - range.first);
+  }
 
   /// File-scoped rules.
   const std::vector<Rule>& file_scope_rules() const {
@@ -79,8 +103,16 @@ class MetadataFile {
   absl::string_view id() const { return id_; }
 
  private:
-  /// Rules to apply keyed on `begin`.
-  std::multimap<unsigned, Rule> rules_;
+  static std::pair<unsigned, unsigned> RuleKey(const Rule& rule) {
+    return {rule.begin, rule.end};
+  }
+  static std::pair<unsigned, unsigned> RuleKey(
+      const std::pair<unsigned, unsigned>& key) {
+    return key;
+  }
+
+  /// Rules to apply, sorted on (begin, end).
+  std::vector<Rule> rules_;
 
   std::vector<Rule> file_scope_rules_;
 
@@ -143,7 +175,7 @@ class MetadataSupports {
     supports_.push_back(std::move(support));
   }
 
-  std::unique_ptr<kythe::MetadataFile> ParseFile(
+  std::shared_ptr<const kythe::MetadataFile> ParseFile(
       const std::string& filename, absl::string_view buffer,
       const std::string& search_string) const;
 
@@ -151,6 +183,21 @@ class MetadataSupports {
 
  private:
   std::vector<std::unique_ptr<MetadataSupport>> supports_;
+
+  /// Parsed files keyed by filename, search string, and a digest of the
+  /// encoded buffer, so a hit skips comment scanning and base64 decoding
+  /// along with the parse; one
+  /// `MetadataSupports` outlives every compilation unit a driver analyzes, so
+  /// the same companion metadata (often identical across thousands of units
+  /// in a shard) is parsed once and shared. A parse failure is cached as a
+  /// null entry so it isn't retried per unit. This assumes any `VNameLookup`
+  /// installed via `UseVNameLookup` resolves a given path the same way for
+  /// every unit in the run, which holds when all units share one vname
+  /// configuration.
+  mutable absl::Mutex cache_mu_;
+  mutable absl::flat_hash_map<std::string,
+                              std::shared_ptr<const kythe::MetadataFile>>
+      parsed_cache_;
 };
 
 /// \brief Enables support for raw JSON-encoded metadata files.
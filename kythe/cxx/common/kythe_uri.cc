@@ -29,13 +29,27 @@ constexpr char kHexDigits[] = "0123456789ABCDEF";
 constexpr char kUriScheme[] = "kythe";
 constexpr char kUriPrefix[] = "kythe:";
 
-/// \brief Returns whether a byte should be escaped.
-/// \param mode The escaping mode to use.
-/// \param c The byte to examine.
-bool should_escape(UriEscapeMode mode, char c) {
-  return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
-           (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' ||
-           c == '~' || (mode == UriEscapeMode::kEscapePaths && c == '/'));
+/// \brief A 256-entry table of bytes that should be escaped, built at
+/// compile time for one escaping mode.
+struct EscapeTable {
+  constexpr explicit EscapeTable(UriEscapeMode mode) : escape() {
+    for (int c = 0; c != 256; ++c) {
+      escape[c] = !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                    (c >= '0' && c <= '9') || c == '-' || c == '.' ||
+                    c == '_' || c == '~' ||
+                    (mode == UriEscapeMode::kEscapePaths && c == '/'));
+    }
+  }
+  bool escape[256];
+};
+
+constexpr EscapeTable kEscapeAllTable(UriEscapeMode::kEscapeAll);
+constexpr EscapeTable kEscapePathsTable(UriEscapeMode::kEscapePaths);
+
+/// \brief Returns the escape table for `mode`.
+const bool* escape_table(UriEscapeMode mode) {
+  return mode == UriEscapeMode::kEscapePaths ? kEscapePathsTable.escape
+                                             : kEscapeAllTable.escape;
 }
 
 /// \brief Returns the value of a hex digit.
@@ -60,56 +74,60 @@ std::pair<absl::string_view, absl::string_view> Split(absl::string_view input,
 }  // namespace
 
 std::string UriEscape(UriEscapeMode mode, absl::string_view uri) {
-  size_t num_escapes = 0;
-  for (char c : uri) {
-    if (should_escape(mode, c)) {
-      ++num_escapes;
-    }
-  }
   std::string result;
-  result.reserve(num_escapes * 2 + uri.size());
-  for (char c : uri) {
-    if (should_escape(mode, c)) {
-      result.push_back('%');
-      result.push_back(kHexDigits[(c >> 4) & 0xF]);
-      result.push_back(kHexDigits[c & 0xF]);
-    } else {
-      result.push_back(c);
+  result.reserve(uri.size());
+  UriEscape(mode, uri, &result);
+  return result;
+}
+
+void UriEscape(UriEscapeMode mode, absl::string_view uri,
+               std::string* result) {
+  const bool* escape = escape_table(mode);
+  // Scan for the next byte that needs escaping and bulk-copy the clean span
+  // before it; most components contain few (usually zero) escapes.
+  size_t clean_begin = 0;
+  for (size_t i = 0, s = uri.size(); i != s; ++i) {
+    unsigned char c = uri[i];
+    if (!escape[c]) {
+      continue;
     }
+    result->append(uri.data() + clean_begin, i - clean_begin);
+    result->push_back('%');
+    result->push_back(kHexDigits[c >> 4]);
+    result->push_back(kHexDigits[c & 0xF]);
+    clean_begin = i + 1;
   }
-  return result;
+  result->append(uri.data() + clean_begin, uri.size() - clean_begin);
 }
 
 /// \brief URI-unescapes a string.
 /// \param string The string to unescape.
 /// \return A pair of (success, error-or-unescaped-string).
-std::pair<bool, std::string> UriUnescape(absl::string_view string) {
-  size_t num_escapes = 0;
-  for (size_t i = 0, s = string.size(); i < s; ++i) {
-    if (string[i] == '%') {
-      ++num_escapes;
-      if (i + 3 > string.size()) {
-        return std::make_pair(false, "bad escape");
-      }
-      i += 2;
-    }
-  }
-  std::string result;
-  result.reserve(string.size() - num_escapes * 2);
-  for (size_t i = 0, s = string.size(); i < s; ++i) {
-    char c = string[i];
-    if (c != '%') {
-      result.push_back(c);
-      continue;
+/// \brief URI-unescapes a string into a caller-provided buffer.
+/// \param string The string to unescape.
+/// \param result The buffer to overwrite; its capacity is reused.
+/// \return false if `string` contains a malformed escape.
+bool UriUnescape(absl::string_view string, std::string* result) {
+  result->clear();
+  // find() lets the library scan for the next escape so clean spans are
+  // bulk-copied instead of moved a byte at a time.
+  size_t i = 0;
+  for (size_t next = string.find('%'); next != absl::string_view::npos;
+       next = string.find('%', i)) {
+    result->append(string.data() + i, next - i);
+    if (next + 3 > string.size()) {
+      return false;
     }
-    int high = value_for_hex_digit(string[++i]);
-    int low = value_for_hex_digit(string[++i]);
+    int high = value_for_hex_digit(string[next + 1]);
+    int low = value_for_hex_digit(string[next + 2]);
     if (high < 0 || low < 0) {
-      return std::make_pair(false, "bad hex digit");
+      return false;
     }
-    result.push_back((high << 4) | low);
+    result->push_back((high << 4) | low);
+    i = next + 3;
   }
-  return std::make_pair(true, result);
+  result->append(string.data() + i, string.size() - i);
+  return true;
 }
 
 std::string URI::ToString() const {
@@ -126,23 +144,23 @@ std::string URI::ToString() const {
   absl::string_view root = vname_.root();
   if (!corpus.empty()) {
     result.append("//");
-    result.append(UriEscape(UriEscapeMode::kEscapePaths, corpus));
+    UriEscape(UriEscapeMode::kEscapePaths, corpus, &result);
   }
   if (!language.empty()) {
     result.append("?lang=");
-    result.append(UriEscape(UriEscapeMode::kEscapeAll, language));
+    UriEscape(UriEscapeMode::kEscapeAll, language, &result);
   }
   if (!path.empty()) {
     result.append("?path=");
-    result.append(UriEscape(UriEscapeMode::kEscapePaths, CleanPath(path)));
+    UriEscape(UriEscapeMode::kEscapePaths, CleanPath(path), &result);
   }
   if (!root.empty()) {
     result.append("?root=");
-    result.append(UriEscape(UriEscapeMode::kEscapePaths, root));
+    UriEscape(UriEscapeMode::kEscapePaths, root, &result);
   }
   if (!signature.empty()) {
     result.push_back('#');
-    result.append(UriEscape(UriEscapeMode::kEscapeAll, signature));
+    UriEscape(UriEscapeMode::kEscapeAll, signature, &result);
   }
   return result;
 }
@@ -166,7 +184,8 @@ static std::pair<absl::string_view, absl::string_view> SplitScheme(
 
 URI::URI(const kythe::proto::VName& from_vname) : vname_(from_vname) {}
 
-bool URI::ParseString(absl::string_view uri) {
+bool ParseVNameUri(absl::string_view uri, kythe::proto::VName* vname) {
+  vname->Clear();
   auto head_fragment = Split(uri, '#');
   auto head = head_fragment.first, fragment = head_fragment.second;
   auto scheme_head = SplitScheme(head);
@@ -184,44 +203,67 @@ bool URI::ParseString(absl::string_view uri) {
   auto head_attrs = Split(head, '?');
   head = head_attrs.first;
   auto attrs = head_attrs.second;
-  std::string corpus;
   if (!head.empty()) {
     if (!absl::StartsWith(head, "//")) {
       return false;
     }
-    auto maybe_corpus = UriUnescape(head.substr(2));
-    if (!maybe_corpus.first) {
+    if (!UriUnescape(head.substr(2), vname->mutable_corpus())) {
       return false;
     }
-    corpus = maybe_corpus.second;
   }
-  auto maybe_sig = UriUnescape(fragment);
-  if (!maybe_sig.first) {
+  if (!UriUnescape(fragment, vname->mutable_signature())) {
     return false;
   }
-  auto signature = maybe_sig.second;
   while (!attrs.empty()) {
     auto attr_rest = Split(attrs, '?');
     auto attr = attr_rest.first;
     attrs = attr_rest.second;
     auto name_value = Split(attr, '=');
-    auto maybe_value = UriUnescape(name_value.second);
-    if (!maybe_value.first || maybe_value.second.empty()) {
-      return false;
-    }
+    const bool is_path = name_value.first == "path";
+    std::string* field = nullptr;
     if (name_value.first == "lang") {
-      vname_.set_language(maybe_value.second);
+      field = vname->mutable_language();
     } else if (name_value.first == "root") {
-      vname_.set_root(maybe_value.second);
-    } else if (name_value.first == "path") {
-      vname_.set_path(CleanPath(maybe_value.second));
+      field = vname->mutable_root();
+    } else if (is_path) {
+      field = vname->mutable_path();
     } else {
       return false;
     }
+    if (!UriUnescape(name_value.second, field) || field->empty()) {
+      return false;
+    }
+    if (is_path) {
+      CleanPathInPlace(field);
+    }
   }
-  vname_.set_signature(signature);
-  vname_.set_corpus(corpus);
   return true;
 }
 
+bool ParseVNameUriLines(
+    absl::string_view data,
+    const std::function<void(const kythe::proto::VName&)>& receiver) {
+  kythe::proto::VName vname;
+  bool all_parsed = true;
+  while (!data.empty()) {
+    size_t eol = data.find('\n');
+    absl::string_view line = data.substr(0, eol);
+    data = eol == absl::string_view::npos ? absl::string_view()
+                                          : data.substr(eol + 1);
+    if (line.empty()) {
+      continue;
+    }
+    if (ParseVNameUri(line, &vname)) {
+      receiver(vname);
+    } else {
+      all_parsed = false;
+    }
+  }
+  return all_parsed;
+}
+
+bool URI::ParseString(absl::string_view uri) {
+  return ParseVNameUri(uri, &vname_);
+}
+
 }  // namespace kythe
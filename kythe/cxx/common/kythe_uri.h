@@ -17,6 +17,7 @@
 #ifndef KYTHE_CXX_COMMON_KYTHE_URI_H_
 #define KYTHE_CXX_COMMON_KYTHE_URI_H_
 
+#include <functional>
 #include <string>
 
 #include "absl/strings/string_view.h"
@@ -36,6 +37,39 @@ enum class UriEscapeMode {
 /// \param string The string to escape.
 std::string UriEscape(UriEscapeMode mode, absl::string_view uri);
 
+/// \brief URI-escapes a string, appending the result to `result`.
+///
+/// Prefer this overload in loops that assemble a URI from several
+/// components; it avoids allocating a fresh string per component.
+/// \param mode The escaping mode to use.
+/// \param uri The string to escape.
+/// \param result The string to append to.
+void UriEscape(UriEscapeMode mode, absl::string_view uri, std::string* result);
+
+/// \brief Parses an encoded Kythe URI directly into `vname`.
+///
+/// Each component is unescaped straight into the storage of the `VName`
+/// field it names, so a parse allocates nothing beyond what the fields
+/// themselves retain; reusing one `VName` across calls reuses its buffers.
+/// \param uri The string to parse.
+/// \param vname The `VName` to overwrite; its contents are unspecified on
+/// failure.
+/// \return true on success.
+bool ParseVNameUri(absl::string_view uri, kythe::proto::VName* vname);
+
+/// \brief Parses a buffer of newline-delimited Kythe URIs.
+///
+/// Empty lines are skipped. `receiver` is called once per parsed line with
+/// a scratch `VName` that is overwritten by the next line; callers that
+/// retain it must copy.
+/// \param data The buffer to parse.
+/// \param receiver Called with each parsed `VName`.
+/// \return true if every nonempty line parsed; malformed lines are skipped
+/// without invoking `receiver`.
+bool ParseVNameUriLines(
+    absl::string_view data,
+    const std::function<void(const kythe::proto::VName&)>& receiver);
+
 /// \brief A Kythe URI.
 ///
 /// URIs are not in 1:1 correspondence with VNames--particularly because
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks for Kythe URI encoding and parsing. Ticket strings are built
+// and parsed for every node a serving pipeline touches, so these paths are
+// hot; the corpus below uses deep generated-file paths and characters that
+// need escaping, the shapes that dominate real tickets.
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "kythe/cxx/common/kythe_uri.h"
+#include "kythe/proto/storage.pb.h"
+
+namespace kythe {
+namespace {
+
+// Builds a VName with a path of `depth` components, including characters
+// that require percent-escaping.
+proto::VName MakeVName(int depth) {
+  proto::VName vname;
+  vname.set_corpus("github.com/example/project");
+  vname.set_root("bazel-out/k8-fastbuild/bin");
+  std::string path;
+  for (int i = 0; i < depth; ++i) {
+    absl::StrAppend(&path, i == 0 ? "" : "/", "component with spaces_", i);
+  }
+  vname.set_path(path);
+  vname.set_language("c++");
+  vname.set_signature("ns::Klass::method(int, const std::string&)#42");
+  return vname;
+}
+
+void BM_UriToString(benchmark::State& state) {
+  const URI uri(MakeVName(state.range(0)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(uri.ToString());
+  }
+}
+BENCHMARK(BM_UriToString)->Range(1, 64);
+
+void BM_UriFromString(benchmark::State& state) {
+  const std::string ticket = URI(MakeVName(state.range(0))).ToString();
+  for (auto _ : state) {
+    auto parsed = URI::FromString(ticket);
+    benchmark::DoNotOptimize(parsed.second);
+  }
+  state.SetBytesProcessed(state.iterations() * ticket.size());
+}
+BENCHMARK(BM_UriFromString)->Range(1, 64);
+
+void BM_UriRoundTrip(benchmark::State& state) {
+  const proto::VName vname = MakeVName(8);
+  for (auto _ : state) {
+    auto parsed = URI::FromString(URI(vname).ToString());
+    benchmark::DoNotOptimize(parsed.second);
+  }
+}
+BENCHMARK(BM_UriRoundTrip);
+
+}  // anonymous namespace
+}  // namespace kythe
+
+BENCHMARK_MAIN();
@@ -16,6 +16,8 @@
 
 #include "kythe/cxx/common/kythe_uri.h"
 
+#include <vector>
+
 #include "glog/logging.h"
 #include "gtest/gtest.h"
 #include "kythe/cxx/common/vname_ordering.h"
@@ -291,6 +293,41 @@ TEST(KytheUri, Strings) {
   }
 }
 
+TEST(KytheUri, ParseVNameUri) {
+  kythe::proto::VName vname;
+  ASSERT_TRUE(ParseVNameUri(
+      "kythe://corpus?lang=c%2B%2B?path=b/../c?root=R#sig%20nature", &vname));
+  EXPECT_TRUE(VNameEquals(MakeURI()
+                              .Corpus("corpus")
+                              .Language("c++")
+                              .Path("c")
+                              .Root("R")
+                              .Signature("sig nature")
+                              .v_name(),
+                          vname));
+  // A reused VName must be fully overwritten.
+  ASSERT_TRUE(ParseVNameUri("kythe://other", &vname));
+  EXPECT_TRUE(VNameEquals(MakeURI().Corpus("other").v_name(), vname));
+  EXPECT_FALSE(ParseVNameUri("kythe://corpus?bogus=attr", &vname));
+}
+
+TEST(KytheUri, ParseVNameUriLines) {
+  std::vector<kythe::proto::VName> parsed;
+  EXPECT_TRUE(ParseVNameUriLines(
+      "kythe://a\n\nkythe://b#s\n",
+      [&](const kythe::proto::VName& vname) { parsed.push_back(vname); }));
+  ASSERT_EQ(2, parsed.size());
+  EXPECT_TRUE(VNameEquals(MakeURI().Corpus("a").v_name(), parsed[0]));
+  EXPECT_TRUE(
+      VNameEquals(MakeURI().Corpus("b").Signature("s").v_name(), parsed[1]));
+  // A malformed line is reported without suppressing its neighbors.
+  parsed.clear();
+  EXPECT_FALSE(ParseVNameUriLines(
+      "kythe://a\nnot a uri:\nkythe://b",
+      [&](const kythe::proto::VName& vname) { parsed.push_back(vname); }));
+  EXPECT_EQ(2, parsed.size());
+}
+
 }  // anonymous namespace
 }  // namespace kythe
 
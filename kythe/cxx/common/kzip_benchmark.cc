@@ -0,0 +1,106 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks for kzip file reads and writes, the inner loop of extraction
+// and of every kzip-consuming indexer. File payloads are source-file-shaped
+// text at sizes from a small header to a multi-megabyte generated file, so
+// digesting and deflate both show up at realistic proportions.
+
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "glog/logging.h"
+#include "kythe/cxx/common/index_writer.h"
+#include "kythe/cxx/common/kzip_reader.h"
+#include "kythe/cxx/common/kzip_writer.h"
+
+namespace kythe {
+namespace {
+
+std::string TempKzipPath(absl::string_view tag) {
+  return absl::StrCat("/tmp/kzip_benchmark_", tag, "_", ::getpid(), ".kzip");
+}
+
+// Builds source-file-shaped text of at least `size` bytes; repetitive the
+// way code is, so compression ratios are realistic rather than degenerate.
+std::string MakeContent(size_t size, int seed) {
+  std::string content;
+  content.reserve(size + 64);
+  for (int line = 0; content.size() < size; ++line) {
+    absl::StrAppend(&content, "int benchmark_symbol_", seed, "_", line,
+                    " = compute_value(", line, ");\n");
+  }
+  return content;
+}
+
+void BM_KzipWriteFile(benchmark::State& state) {
+  const std::string path = TempKzipPath("write");
+  ::unlink(path.c_str());
+  auto writer = KzipWriter::Create(path);
+  CHECK(writer.ok()) << writer.status();
+  int seed = 0;
+  for (auto _ : state) {
+    // Vary the content so each write stores a fresh digest instead of
+    // deduplicating against the previous iteration.
+    state.PauseTiming();
+    const std::string content = MakeContent(state.range(0), seed++);
+    state.ResumeTiming();
+    auto digest = writer->WriteFile(content);
+    CHECK(digest.ok()) << digest.status();
+    benchmark::DoNotOptimize(*digest);
+  }
+  CHECK(writer->Close().ok());
+  ::unlink(path.c_str());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_KzipWriteFile)->Range(1 << 10, 4 << 20);
+
+void BM_KzipReadFile(benchmark::State& state) {
+  const std::string path = TempKzipPath("read");
+  ::unlink(path.c_str());
+  std::vector<std::string> digests;
+  {
+    auto writer = KzipWriter::Create(path);
+    CHECK(writer.ok()) << writer.status();
+    for (int i = 0; i < 8; ++i) {
+      auto digest = writer->WriteFile(MakeContent(state.range(0), i));
+      CHECK(digest.ok()) << digest.status();
+      digests.push_back(*digest);
+    }
+    CHECK(writer->Close().ok());
+  }
+  auto reader = KzipReader::Open(path);
+  CHECK(reader.ok()) << reader.status();
+  size_t i = 0;
+  for (auto _ : state) {
+    auto content = reader->ReadFile(digests[i]);
+    CHECK(content.ok()) << content.status();
+    benchmark::DoNotOptimize(*content);
+    i = (i + 1) % digests.size();
+  }
+  ::unlink(path.c_str());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_KzipReadFile)->Range(1 << 10, 4 << 20);
+
+}  // anonymous namespace
+}  // namespace kythe
+
+BENCHMARK_MAIN();
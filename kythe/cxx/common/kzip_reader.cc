@@ -16,9 +16,21 @@
 
 #include "kythe/cxx/common/kzip_reader.h"
 
+#include <fcntl.h>
 #include <openssl/sha.h>
-
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
@@ -32,6 +44,7 @@
 #include "glog/logging.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "kythe/cxx/common/io_metrics.h"
 #include "kythe/cxx/common/json_proto.h"
 #include "kythe/cxx/common/libzip/error.h"
 #include "kythe/proto/analysis.pb.h"
@@ -42,6 +55,19 @@ namespace {
 constexpr absl::string_view kJsonUnitsDir = "/units/";
 constexpr absl::string_view kProtoUnitsDir = "/pbunits/";
 
+/// \return the throughput metric for archive entry reads (decompression
+/// happens inside the timed zip_fread calls).
+IoMetric& KzipReadMetric() {
+  static auto* metric = new IoMetric("kzip.read");
+  return *metric;
+}
+
+/// \return the throughput metric for compilation unit reads and decodes.
+IoMetric& KzipUnitMetric() {
+  static auto* metric = new IoMetric("kzip.read_unit");
+  return *metric;
+}
+
 struct ZipFileClose {
   void operator()(zip_file_t* file) {
     if (file != nullptr) {
@@ -141,6 +167,9 @@ StatusOr<KzipOptions> Validate(zip_t* archive) {
       return absl::InvalidArgumentError(absl::StrCat(
           "Malformed kzip: multiple unit encodings but different entries"));
     }
+    // Both encodings carry identical units (same digests); read the proto
+    // side, which decodes much faster than JSON.
+    encoding = KzipEncoding::kProto;
   }
   return KzipOptions{root, encoding};
 }
@@ -155,17 +184,15 @@ absl::optional<zip_uint64_t> FileSize(zip_t* archive, zip_uint64_t index) {
   return sb.size;
 }
 
-StatusOr<std::string> ReadTextFile(zip_t* archive, const std::string& path) {
-  zip_int64_t index = zip_name_locate(archive, path.c_str(), 0);
-  if (index >= 0) {
-    if (auto file = ZipFile(zip_fopen_index(archive, index, 0))) {
-      if (auto size = FileSize(archive, index)) {
-        std::string result(*size, '\0');
-        if (zip_fread(file.get(), &result.front(), *size) == *size) {
-          return result;
-        } else {
-          return libzip::ToStatus(zip_file_get_error(file.get()));
-        }
+StatusOr<std::string> ReadTextFile(zip_t* archive, zip_int64_t index) {
+  if (auto file = ZipFile(zip_fopen_index(archive, index, 0))) {
+    if (auto size = FileSize(archive, index)) {
+      std::string result(*size, '\0');
+      ScopedIoTimer timer(&KzipReadMetric(), *size);
+      if (zip_fread(file.get(), &result.front(), *size) == *size) {
+        return result;
+      } else {
+        return libzip::ToStatus(zip_file_get_error(file.get()));
       }
     }
   }
@@ -173,7 +200,7 @@ StatusOr<std::string> ReadTextFile(zip_t* archive, const std::string& path) {
   if (!status.ok()) {
     return status;
   }
-  return absl::UnknownError(absl::StrCat("Unable to read: ", path));
+  return absl::UnknownError(absl::StrCat("Unable to read entry: ", index));
 }
 
 absl::string_view DirNameForEncoding(KzipEncoding encoding) {
@@ -190,6 +217,44 @@ absl::string_view DirNameForEncoding(KzipEncoding encoding) {
 
 }  // namespace
 
+struct MmappedKzip {
+  void* data = MAP_FAILED;
+  size_t size = 0;
+  ~MmappedKzip() {
+    if (data != MAP_FAILED) {
+      ::munmap(data, size);
+    }
+  }
+  /// \brief Maps the file at `path` read-only, or returns null on any error.
+  static std::unique_ptr<MmappedKzip> Map(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+      ::close(fd);
+      return nullptr;
+    }
+    auto contents = absl::make_unique<MmappedKzip>();
+    contents->size = st.st_size;
+    contents->data =
+        ::mmap(nullptr, contents->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (contents->data == MAP_FAILED) {
+      return nullptr;
+    }
+    ::madvise(contents->data, contents->size, MADV_WILLNEED);
+    return contents;
+  }
+};
+
+KzipReader::~KzipReader() {
+  // The archive reads from `contents_` when mapped, so discard it before the
+  // mapping goes away.
+  archive_.reset();
+}
+
 absl::optional<absl::string_view> KzipReader::UnitDigest(
     absl::string_view path) {
   if (!absl::ConsumePrefix(&path, unit_prefix_) || path.empty()) {
@@ -200,6 +265,27 @@ absl::optional<absl::string_view> KzipReader::UnitDigest(
 
 /* static */
 StatusOr<IndexReader> KzipReader::Open(absl::string_view path) {
+  // Prefer reading through a memory mapping: libzip then decodes straight out
+  // of the page cache with no per-read syscalls or buffer copies. Any mapping
+  // failure falls through to ordinary file I/O.
+  if (auto contents = MmappedKzip::Map(std::string(path))) {
+    libzip::Error zip_error;
+    if (zip_source_t* source = zip_source_buffer_create(
+            contents->data, contents->size, 0, zip_error.get())) {
+      if (auto archive = ZipHandle(
+              zip_open_from_source(source, ZIP_RDONLY, zip_error.get()))) {
+        if (auto options = Validate(archive.get())) {
+          auto reader = absl::WrapUnique(new KzipReader(
+              std::move(archive), options->root, options->encoding));
+          reader->contents_ = std::move(contents);
+          return IndexReader(std::move(reader));
+        } else {
+          return options.status();
+        }
+      }
+      zip_source_free(source);
+    }
+  }
   int error;
   if (auto archive =
           ZipHandle(zip_open(std::string(path).c_str(), ZIP_RDONLY, &error))) {
@@ -236,23 +322,43 @@ KzipReader::KzipReader(ZipHandle archive, absl::string_view root,
     : archive_(std::move(archive)),
       encoding_(encoding),
       files_prefix_(absl::StrCat(root, "/files/")),
-      unit_prefix_(absl::StrCat(root, DirNameForEncoding(encoding))) {}
+      unit_prefix_(absl::StrCat(root, DirNameForEncoding(encoding))) {
+  // Index the central directory up front: ReadFile and ReadUnit are called
+  // many times per entry over an indexing run, and a single pass here spares
+  // them per-call path construction and libzip name lookups.
+  for (zip_int64_t i = 0; i < zip_get_num_entries(archive_.get(), 0); ++i) {
+    absl::string_view name = zip_get_name(archive_.get(), i, 0);
+    if (absl::ConsumePrefix(&name, files_prefix_)) {
+      if (!name.empty()) {
+        file_index_.emplace(name, i);
+      }
+    } else if (absl::ConsumePrefix(&name, unit_prefix_)) {
+      if (!name.empty()) {
+        unit_index_.emplace(name, i);
+      }
+    }
+  }
+}
 
 StatusOr<proto::IndexedCompilation> KzipReader::ReadUnit(
     absl::string_view digest) {
-  std::string path = absl::StrCat(unit_prefix_, digest);
-
-  if (auto file = ZipFile(zip_fopen(archive(), path.c_str(), 0))) {
+  auto entry = unit_index_.find(digest);
+  if (entry == unit_index_.end()) {
+    return absl::NotFoundError(absl::StrCat("No such unit: ", digest));
+  }
+  if (auto file = ZipFile(zip_fopen_index(archive(), entry->second, 0))) {
     proto::IndexedCompilation unit;
     ZipFileInputStream input(file.get());
+    ScopedIoTimer timer(&KzipUnitMetric());
     absl::Status status;
     if (encoding_ == KzipEncoding::kJson) {
-      status = ParseFromJsonStream(&input, &unit);
+      status = json_codec_.Parse(&input, &unit);
     } else {
       if (!unit.ParseFromZeroCopyStream(&input)) {
         status = absl::InvalidArgumentError("Failure parsing proto unit");
       }
     }
+    timer.set_bytes(input.ByteCount());
     if (!status.ok()) {
       absl::Status zip_status =
           libzip::ToStatus(zip_file_get_error(file.get()));
@@ -272,7 +378,38 @@ StatusOr<proto::IndexedCompilation> KzipReader::ReadUnit(
 }
 
 StatusOr<std::string> KzipReader::ReadFile(absl::string_view digest) {
-  return ReadTextFile(archive(), absl::StrCat(files_prefix_, digest));
+  auto entry = file_index_.find(digest);
+  if (entry == file_index_.end()) {
+    return absl::NotFoundError(absl::StrCat("No such file: ", digest));
+  }
+  return ReadTextFile(archive(), entry->second);
+}
+
+absl::Status KzipReader::ReadFileInto(absl::string_view digest,
+                                      std::string* contents) {
+  auto entry = file_index_.find(digest);
+  if (entry == file_index_.end()) {
+    return absl::NotFoundError(absl::StrCat("No such file: ", digest));
+  }
+  if (auto file = ZipFile(zip_fopen_index(archive(), entry->second, 0))) {
+    if (auto size = FileSize(archive(), entry->second)) {
+      // resize keeps the buffer's capacity, so a caller reusing `contents`
+      // across files pays no allocation once it has grown to the largest
+      // entry seen.
+      contents->resize(*size);
+      ScopedIoTimer timer(&KzipReadMetric(), *size);
+      if (*size == 0 ||
+          zip_fread(file.get(), &contents->front(), *size) == *size) {
+        return absl::OkStatus();
+      }
+      return libzip::ToStatus(zip_file_get_error(file.get()));
+    }
+  }
+  absl::Status status = libzip::ToStatus(zip_get_error(archive()));
+  if (!status.ok()) {
+    return status;
+  }
+  return absl::UnknownError(absl::StrCat("Unable to read file ", digest));
 }
 
 absl::Status KzipReader::Scan(const ScanCallback& callback) {
@@ -286,4 +423,144 @@ absl::Status KzipReader::Scan(const ScanCallback& callback) {
   return absl::OkStatus();
 }
 
+namespace {
+/// \brief Decodes a single IndexedCompilation from `contents`.
+StatusOr<proto::IndexedCompilation> DecodeUnit(KzipEncoding encoding,
+                                               JsonCodec* codec,
+                                               const std::string& contents) {
+  proto::IndexedCompilation unit;
+  if (encoding == KzipEncoding::kJson) {
+    absl::Status status = codec->Parse(contents, &unit);
+    if (!status.ok()) {
+      return status;
+    }
+  } else if (!unit.ParseFromString(contents)) {
+    return absl::InvalidArgumentError("Failure parsing proto unit");
+  }
+  return unit;
+}
+}  // namespace
+
+absl::Status KzipReader::ScanUnits(const UnitCallback& callback) {
+  const size_t worker_count =
+      std::max<size_t>(1, std::thread::hardware_concurrency());
+  // Bounds units read from the archive but not yet delivered, keeping memory
+  // use proportional to the worker count rather than the archive size.
+  const size_t max_in_flight = 2 * worker_count;
+
+  // A unit read from the archive but not yet decoded.
+  struct Work {
+    size_t seq;
+    std::string digest;
+    std::string contents;
+  };
+  std::mutex mu;
+  // Signaled when `work` gains an entry or `done`/`cancelled` is set.
+  std::condition_variable work_ready;
+  // Signaled when a worker finishes decoding a unit.
+  std::condition_variable unit_decoded;
+  std::deque<Work> work;
+  // Decoded units awaiting in-order delivery, keyed by sequence number.
+  std::map<size_t, std::pair<std::string, StatusOr<proto::IndexedCompilation>>>
+      decoded;
+  size_t next_read = 0;     // Sequence number for the next unit read.
+  size_t next_deliver = 0;  // Sequence number of the next unit to deliver.
+  size_t in_flight = 0;     // Units read but not yet delivered.
+  bool done = false;        // No further units will be read.
+  bool cancelled = false;   // The callback asked us to stop.
+
+  std::vector<std::thread> workers;
+  workers.reserve(worker_count);
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.push_back(std::thread([&] {
+      JsonCodec codec;
+      std::unique_lock<std::mutex> lock(mu);
+      for (;;) {
+        work_ready.wait(lock,
+                        [&] { return !work.empty() || done || cancelled; });
+        if (cancelled || work.empty()) {
+          return;
+        }
+        Work item = std::move(work.front());
+        work.pop_front();
+        lock.unlock();
+        auto unit = DecodeUnit(encoding_, &codec, item.contents);
+        lock.lock();
+        decoded.emplace(item.seq, std::make_pair(std::move(item.digest),
+                                                 std::move(unit)));
+        unit_decoded.notify_one();
+      }
+    }));
+  }
+
+  // Hands all consecutively-decoded units to the callback. Must be called
+  // with `lock` held; drops it around each callback invocation.
+  auto deliver_ready = [&](std::unique_lock<std::mutex>& lock) {
+    for (auto it = decoded.find(next_deliver);
+         it != decoded.end() && !cancelled; it = decoded.find(next_deliver)) {
+      auto entry = std::move(it->second);
+      decoded.erase(it);
+      ++next_deliver;
+      --in_flight;
+      lock.unlock();
+      bool keep_going = callback(entry.first, std::move(entry.second));
+      lock.lock();
+      if (!keep_going) {
+        cancelled = true;
+        work_ready.notify_all();
+      }
+    }
+  };
+
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    for (int i = 0; i < zip_get_num_entries(archive(), 0) && !cancelled; ++i) {
+      auto digest = UnitDigest(zip_get_name(archive(), i, 0));
+      if (!digest) {
+        continue;
+      }
+      while (in_flight >= max_in_flight && !cancelled) {
+        deliver_ready(lock);
+        if (in_flight >= max_in_flight && !cancelled &&
+            decoded.find(next_deliver) == decoded.end()) {
+          unit_decoded.wait(lock);
+        }
+      }
+      if (cancelled) {
+        break;
+      }
+      lock.unlock();
+      StatusOr<std::string> contents = ReadTextFile(archive(), i);
+      lock.lock();
+      ++in_flight;
+      if (contents.ok()) {
+        work.push_back(
+            Work{next_read, std::string(*digest), std::move(*contents)});
+        work_ready.notify_one();
+      } else {
+        // Deliver read errors through the same ordered queue.
+        decoded.emplace(
+            next_read,
+            std::make_pair(std::string(*digest),
+                           StatusOr<proto::IndexedCompilation>(
+                               std::move(contents).status())));
+      }
+      ++next_read;
+      deliver_ready(lock);
+    }
+    done = true;
+    work_ready.notify_all();
+    while (next_deliver < next_read && !cancelled) {
+      deliver_ready(lock);
+      if (next_deliver < next_read && !cancelled) {
+        unit_decoded.wait(lock);
+      }
+    }
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace kythe
@@ -20,19 +20,28 @@
 #include <zip.h>
 
 #include <functional>
+#include <memory>
 #include <string>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "kythe/cxx/common/index_reader.h"
+#include "kythe/cxx/common/json_proto.h"
 #include "kythe/cxx/common/kzip_encoding.h"
 #include "kythe/cxx/common/status_or.h"
 #include "kythe/proto/analysis.pb.h"
 
 namespace kythe {
 
+/// \brief A read-only memory mapping of a kzip file, unmapped on destruction.
+struct MmappedKzip;
+
 class KzipReader : public IndexReaderInterface {
  public:
+  /// \brief Opens the kzip at `path`, memory-mapping it when possible so
+  /// archive reads are zero-copy out of the page cache; falls back to
+  /// ordinary file I/O if the mapping fails.
   static StatusOr<IndexReader> Open(absl::string_view path);
 
   /// \brief Constructs an `IndexReader` from the provided source.
@@ -45,11 +54,28 @@ class KzipReader : public IndexReaderInterface {
 
   absl::Status Scan(const ScanCallback& callback) override;
 
+  /// \brief Invokes `callback` for each unit digest and its decoded
+  /// IndexedCompilation, in archive order.
+  ///
+  /// Archive entries are read on the calling thread (libzip handles are not
+  /// thread-safe) while unit protos are decoded concurrently on a pool of
+  /// worker threads; decoded units are delivered to `callback` on the calling
+  /// thread through a bounded, order-preserving queue.
+  absl::Status ScanUnits(const UnitCallback& callback) override;
+
   StatusOr<kythe::proto::IndexedCompilation> ReadUnit(
       absl::string_view digest) override;
 
   StatusOr<std::string> ReadFile(absl::string_view digest) override;
 
+  /// \brief Decompresses the requested file directly into `contents`,
+  /// sized from the entry's zip stat; a buffer held across calls is
+  /// reallocated only when an entry outgrows it.
+  absl::Status ReadFileInto(absl::string_view digest,
+                            std::string* contents) override;
+
+  ~KzipReader() override;
+
  private:
   struct Discard {
     void operator()(zip_t* archive) {
@@ -69,6 +95,17 @@ class KzipReader : public IndexReaderInterface {
   KzipEncoding encoding_;
   std::string files_prefix_;
   std::string unit_prefix_;
+  /// Maps file content digests to entry indices in the archive's central
+  /// directory. Built once at construction so the many ReadFile calls of an
+  /// indexing run skip per-call path construction and libzip name lookups.
+  absl::flat_hash_map<std::string, zip_int64_t> file_index_;
+  /// Likewise for compilation unit digests.
+  absl::flat_hash_map<std::string, zip_int64_t> unit_index_;
+  /// When the archive was opened from a memory mapping, keeps the mapping
+  /// alive for the life of the reader.
+  std::unique_ptr<MmappedKzip> contents_;
+  /// Reused across ReadUnit calls for JSON-encoded archives.
+  JsonCodec json_codec_;
 };
 
 }  // namespace kythe
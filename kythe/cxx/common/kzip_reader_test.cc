@@ -18,6 +18,7 @@
 
 #include <functional>
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
@@ -122,6 +123,64 @@ TEST(KzipReaderTest, OpenAndReadSimpleKzip) {
                   .ok());
 }
 
+TEST(KzipReaderTest, ReadFileIntoMatchesReadFile) {
+  proto::GoDetails needed_for_proto_deserialization;
+
+  StatusOr<IndexReader> reader = KzipReader::Open(TestFile("stringset.kzip"));
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  std::string buffer;  // Reused across files, as in the indexer's input loop.
+  EXPECT_TRUE(reader
+                  ->Scan([&](absl::string_view digest) {
+                    auto unit = reader->ReadUnit(digest);
+                    EXPECT_TRUE(unit.ok()) << unit.status().ToString();
+                    if (!unit.ok()) return false;
+                    for (const auto& file : unit->unit().required_input()) {
+                      auto data = reader->ReadFile(file.info().digest());
+                      EXPECT_TRUE(data.ok()) << data.status().ToString();
+                      auto read =
+                          reader->ReadFileInto(file.info().digest(), &buffer);
+                      EXPECT_TRUE(read.ok()) << read;
+                      if (!data.ok() || !read.ok()) return false;
+                      EXPECT_EQ(buffer, *data);
+                      auto view =
+                          reader->ReadFileView(file.info().digest(), &buffer);
+                      EXPECT_TRUE(view.ok()) << view.status().ToString();
+                      if (!view.ok()) return false;
+                      EXPECT_EQ(*view, *data);
+                    }
+                    return true;
+                  })
+                  .ok());
+  EXPECT_FALSE(reader->ReadFileInto("no-such-digest", &buffer).ok());
+}
+
+TEST(KzipReaderTest, ScanUnitsMatchesSerialScan) {
+  // See OpenAndReadSimpleKzip for why this is needed.
+  proto::GoDetails needed_for_proto_deserialization;
+
+  StatusOr<IndexReader> reader = KzipReader::Open(TestFile("stringset.kzip"));
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  std::vector<std::string> scanned_digests;
+  ASSERT_TRUE(reader
+                  ->Scan([&](absl::string_view digest) {
+                    scanned_digests.push_back(std::string(digest));
+                    return true;
+                  })
+                  .ok());
+  std::vector<std::string> unit_digests;
+  EXPECT_TRUE(
+      reader
+          ->ScanUnits([&](absl::string_view digest,
+                          StatusOr<proto::IndexedCompilation> unit) {
+            EXPECT_TRUE(unit.ok()) << "Failed to read compilation unit: "
+                                   << unit.status().ToString();
+            unit_digests.push_back(std::string(digest));
+            return true;
+          })
+          .ok());
+  EXPECT_EQ(unit_digests, scanned_digests);
+}
+
 TEST(KzipReaderTest, FromSourceFailsIfSourceDoes) {
   libzip::Error error;
   {
@@ -28,6 +28,7 @@
 #include "absl/strings/ascii.h"
 #include "absl/strings/escaping.h"
 #include "glog/logging.h"
+#include "kythe/cxx/common/io_metrics.h"
 #include "kythe/cxx/common/json_proto.h"
 #include "kythe/cxx/common/kzip_encoding.h"
 #include "kythe/cxx/common/libzip/error.h"
@@ -36,6 +37,19 @@
 namespace kythe {
 namespace {
 
+/// \return the throughput metric for content staged into the archive.
+IoMetric& KzipWriteMetric() {
+  static auto* metric = new IoMetric("kzip.write");
+  return *metric;
+}
+
+/// \return the metric timing archive finalization, where libzip compresses
+/// and writes the staged content.
+IoMetric& KzipCloseMetric() {
+  static auto* metric = new IoMetric("kzip.close");
+  return *metric;
+}
+
 constexpr absl::string_view kRoot = "root/";
 constexpr absl::string_view kJsonUnitRoot = "root/units/";
 constexpr absl::string_view kProtoUnitRoot = "root/pbunits/";
@@ -43,6 +57,11 @@ constexpr absl::string_view kFileRoot = "root/files/";
 // Set all file modified times to 0 so zip file diffs only show content diffs,
 // not zip creation time diffs.
 constexpr time_t kModTime = 0;
+// Upper bound on content bytes queued for the async writer thread; callers
+// block once this much data is in flight. Two generously-sized buffers'
+// worth, so extraction and archive writing can overlap without unbounded
+// memory growth.
+constexpr size_t kMaxQueuedBytes = size_t{64} << 20;
 
 std::string SHA256Digest(absl::string_view content) {
   std::array<unsigned char, SHA256_DIGEST_LENGTH> buf;
@@ -52,14 +71,34 @@ std::string SHA256Digest(absl::string_view content) {
       absl::string_view(reinterpret_cast<const char*>(buf.data()), buf.size()));
 }
 
+/// \return the libzip compression method for `compression`, falling back
+/// to deflate when this libzip lacks the codec.
+zip_int32_t CompressionMethod(KzipCompression compression) {
+  switch (compression) {
+    case KzipCompression::kDeflate:
+      return ZIP_CM_DEFLATE;
+    case KzipCompression::kZstd:
+#if defined(ZIP_CM_ZSTD)
+      return ZIP_CM_ZSTD;
+#else
+      LOG(WARNING) << "libzip was built without zstd support; "
+                   << "writing deflate entries instead";
+      return ZIP_CM_DEFLATE;
+#endif
+  }
+  return ZIP_CM_DEFLATE;
+}
+
 absl::Status WriteTextFile(zip_t* archive, const std::string& path,
-                           absl::string_view content) {
+                           absl::string_view content, zip_int32_t method) {
+  ScopedIoTimer timer(&KzipWriteMetric(), content.size());
   if (auto source =
           zip_source_buffer(archive, content.data(), content.size(), 0)) {
     auto idx = zip_file_add(archive, path.c_str(), source, ZIP_FL_ENC_UTF_8);
     if (idx >= 0) {
-      // If a file was added, set the last modified time.
-      if (zip_file_set_mtime(archive, idx, kModTime, 0) == 0) {
+      // If a file was added, set the last modified time and codec.
+      if (zip_file_set_mtime(archive, idx, kModTime, 0) == 0 &&
+          zip_set_file_compression(archive, idx, method, 0) == 0) {
         return absl::OkStatus();
       }
     }
@@ -85,11 +124,14 @@ bool HasEncoding(KzipEncoding lhs, KzipEncoding rhs) {
 
 /* static */
 StatusOr<IndexWriter> KzipWriter::Create(absl::string_view path,
-                                         KzipEncoding encoding) {
+                                         KzipEncoding encoding,
+                                         bool async_writes,
+                                         KzipCompression compression) {
   int error;
   if (auto archive =
           zip_open(std::string(path).c_str(), ZIP_CREATE | ZIP_EXCL, &error)) {
-    return IndexWriter(absl::WrapUnique(new KzipWriter(archive, encoding)));
+    return IndexWriter(absl::WrapUnique(
+        new KzipWriter(archive, encoding, async_writes, compression)));
   }
   return libzip::Error(error).ToStatus();
 }
@@ -97,19 +139,31 @@ StatusOr<IndexWriter> KzipWriter::Create(absl::string_view path,
 /* static */
 StatusOr<IndexWriter> KzipWriter::FromSource(zip_source_t* source,
                                              KzipEncoding encoding,
-                                             const int flags) {
+                                             const int flags,
+                                             bool async_writes,
+                                             KzipCompression compression) {
   libzip::Error error;
   if (auto archive = zip_open_from_source(source, flags, error.get())) {
-    return IndexWriter(absl::WrapUnique(new KzipWriter(archive, encoding)));
+    return IndexWriter(absl::WrapUnique(
+        new KzipWriter(archive, encoding, async_writes, compression)));
   }
   return error.ToStatus();
 }
 
-KzipWriter::KzipWriter(zip_t* archive, KzipEncoding encoding)
-    : archive_(archive), encoding_(encoding) {}
+KzipWriter::KzipWriter(zip_t* archive, KzipEncoding encoding,
+                       bool async_writes, KzipCompression compression)
+    : archive_(archive),
+      encoding_(encoding),
+      compression_method_(CompressionMethod(compression)),
+      async_writes_(async_writes) {
+  if (async_writes_) {
+    writer_thread_ = std::thread(&KzipWriter::WriteLoop, this);
+  }
+}
 
 KzipWriter::~KzipWriter() {
   DCHECK(archive_ == nullptr) << "Disposing of open KzipWriter!";
+  DCHECK(!writer_thread_.joinable()) << "Disposing of open KzipWriter!";
 }
 
 // Creates entries for the three directories if not already present.
@@ -139,38 +193,52 @@ absl::Status KzipWriter::InitializeArchive(zip_t* archive) {
 
 StatusOr<std::string> KzipWriter::WriteUnit(
     const kythe::proto::IndexedCompilation& unit) {
-  if (!initialized_) {
+  // In async mode, initialization happens lazily on the writer thread;
+  // checking async_writes_ first keeps initialized_ (which that thread
+  // writes unsynchronized) from being read here.
+  if (!async_writes_ && !initialized_) {
     auto status = InitializeArchive(archive_);
     if (!status.ok()) {
       return status;
     }
     initialized_ = true;
   }
-  auto json = WriteMessageAsJsonToString(unit);
-  if (!json) {
-    return json.status();
-  }
-  auto digest = SHA256Digest(*json);
-  StatusOr<std::string> result = absl::InternalError("unsupported encoding");
-  ;
   if (HasEncoding(encoding_, KzipEncoding::kJson)) {
-    result = InsertFile(absl::StrCat(kJsonUnitRoot, digest), *json);
+    std::string json;
+    absl::Status json_status = json_codec_.Write(unit, &json);
+    if (!json_status.ok()) {
+      return json_status;
+    }
+    auto digest = SHA256Digest(json);
+    StatusOr<std::string> result =
+        InsertFile(absl::StrCat(kJsonUnitRoot, digest), json);
     if (!result) {
       return result;
     }
-  }
-  if (HasEncoding(encoding_, KzipEncoding::kProto)) {
-    std::string contents;
-    if (!unit.SerializeToString(&contents)) {
-      return absl::InternalError("Failure serializing compilation unit");
+    if (HasEncoding(encoding_, KzipEncoding::kProto)) {
+      std::string contents;
+      if (!unit.SerializeToString(&contents)) {
+        return absl::InternalError("Failure serializing compilation unit");
+      }
+      result = InsertFile(absl::StrCat(kProtoUnitRoot, digest), contents);
     }
-    result = InsertFile(absl::StrCat(kProtoUnitRoot, digest), contents);
+    return result;
   }
-  return result;
+  // Proto-only archives never touch the JSON codec; the unit digest is
+  // computed over the proto bytes instead. Digests only name archive
+  // entries, so the two bases never mix within one archive.
+  std::string contents;
+  if (!unit.SerializeToString(&contents)) {
+    return absl::InternalError("Failure serializing compilation unit");
+  }
+  return InsertFile(absl::StrCat(kProtoUnitRoot, SHA256Digest(contents)),
+                    contents);
 }
 
 StatusOr<std::string> KzipWriter::WriteFile(absl::string_view content) {
-  if (!initialized_) {
+  // As in WriteUnit: only the writer thread touches initialized_ in async
+  // mode.
+  if (!async_writes_ && !initialized_) {
     auto status = InitializeArchive(archive_);
     if (!status.ok()) {
       return status;
@@ -184,8 +252,24 @@ absl::Status KzipWriter::Close() {
   DCHECK(archive_ != nullptr);
 
   absl::Status result = absl::OkStatus();
+  if (async_writes_) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      finished_ = true;
+    }
+    queue_ready_.notify_all();
+    writer_thread_.join();
+    result = write_status_;
+  }
+  size_t staged_bytes = 0;
+  for (const auto& entry : contents_) {
+    staged_bytes += entry.second.size();
+  }
+  ScopedIoTimer close_timer(&KzipCloseMetric(), staged_bytes);
   if (zip_close(archive_) != 0) {
-    result = libzip::ToStatus(zip_get_error(archive_));
+    if (result.ok()) {
+      result = libzip::ToStatus(zip_get_error(archive_));
+    }
     zip_discard(archive_);
   }
 
@@ -196,13 +280,17 @@ absl::Status KzipWriter::Close() {
 
 StatusOr<std::string> KzipWriter::InsertFile(absl::string_view path,
                                              absl::string_view content) {
+  if (async_writes_) {
+    return InsertFileAsync(path, content);
+  }
   // Initially insert an empty string for the file content.
   auto insertion = contents_.emplace(std::string(path), "");
   if (insertion.second) {
     // Only copy in the real content if it was actually inserted into the map.
     auto& entry = insertion.first;
     entry->second = std::string(content);
-    auto status = WriteTextFile(archive_, entry->first, entry->second);
+    auto status = WriteTextFile(archive_, entry->first, entry->second,
+                                compression_method_);
     if (!status.ok()) {
       contents_.erase(entry->first);
       return status;
@@ -211,6 +299,54 @@ StatusOr<std::string> KzipWriter::InsertFile(absl::string_view path,
   return std::string(Basename(path));
 }
 
+StatusOr<std::string> KzipWriter::InsertFileAsync(absl::string_view path,
+                                                  absl::string_view content) {
+  std::unique_lock<std::mutex> lock(mu_);
+  auto insertion = contents_.emplace(std::string(path), "");
+  if (insertion.second) {
+    auto& entry = insertion.first;
+    entry->second = std::string(content);
+    // Apply backpressure so a fast producer can't queue unbounded content.
+    queue_space_.wait(lock, [this] { return queued_bytes_ < kMaxQueuedBytes; });
+    queued_bytes_ += entry->second.size();
+    queue_.push_back(WriteRequest{&entry->first, &entry->second});
+    queue_ready_.notify_one();
+  }
+  return std::string(Basename(path));
+}
+
+void KzipWriter::WriteLoop() {
+  for (;;) {
+    WriteRequest request;
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      queue_ready_.wait(lock, [this] { return finished_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      request = queue_.front();
+      queue_.pop_front();
+      queued_bytes_ -= request.content->size();
+    }
+    queue_space_.notify_all();
+    absl::Status status = absl::OkStatus();
+    if (!initialized_) {
+      status = InitializeArchive(archive_);
+      initialized_ = status.ok();
+    }
+    if (status.ok()) {
+      status = WriteTextFile(archive_, *request.path, *request.content,
+                             compression_method_);
+    }
+    if (!status.ok()) {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (write_status_.ok()) {
+        write_status_ = status;
+      }
+    }
+  }
+}
+
 /* static */
 KzipEncoding KzipWriter::DefaultEncoding() {
   if (const char* env_enc = getenv("KYTHE_KZIP_ENCODING")) {
@@ -229,4 +365,27 @@ KzipEncoding KzipWriter::DefaultEncoding() {
   return KzipEncoding::kProto;
 }
 
+/* static */
+bool KzipWriter::DefaultAsyncWrites() {
+  if (const char* env_async = getenv("KYTHE_KZIP_ASYNC_WRITES")) {
+    return std::string(env_async) == "1";
+  }
+  return false;
+}
+
+/* static */
+KzipCompression KzipWriter::DefaultCompression() {
+  if (const char* env_codec = getenv("KYTHE_KZIP_COMPRESSION")) {
+    std::string codec = absl::AsciiStrToUpper(env_codec);
+    if (codec == "ZSTD") {
+      return KzipCompression::kZstd;
+    }
+    if (codec == "DEFLATE") {
+      return KzipCompression::kDeflate;
+    }
+    LOG(ERROR) << "Unknown compression '" << codec << "', using DEFLATE";
+  }
+  return KzipCompression::kDeflate;
+}
+
 }  // namespace kythe
@@ -19,17 +19,32 @@
 
 #include <zip.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "kythe/cxx/common/index_writer.h"
+#include "kythe/cxx/common/json_proto.h"
 #include "kythe/cxx/common/kzip_encoding.h"
 #include "kythe/cxx/common/status_or.h"
 #include "kythe/proto/analysis.pb.h"
 
 namespace kythe {
 
+/// \brief Compression codec used for kzip archive entries.
+enum class KzipCompression {
+  /// zlib deflate; readable by every zip implementation.
+  kDeflate,
+  /// zstd; faster to compress and denser than deflate, but reading the
+  /// archive requires a zstd-aware libzip. Falls back to deflate when
+  /// libzip was built without zstd support.
+  kZstd,
+};
+
 /// \brief Kzip implementation of IndexWriter.
 /// see https://www.kythe.io/docs/kythe-kzip.html for format description.
 class KzipWriter : public IndexWriterInterface {
@@ -37,16 +52,28 @@ class KzipWriter : public IndexWriterInterface {
   /// \brief Constructs a Kzip IndexWriter which will create and write to
   /// \param path Path to the file to create. Must not currently exist.
   /// \param encoding Encoding to use for compilation units.
+  /// \param async_writes If true, archive updates happen on a dedicated
+  /// writer thread with a bounded queue, so WriteUnit and WriteFile only pay
+  /// for hashing on the caller's thread. Errors encountered by the writer
+  /// thread are reported from Close.
+  /// \param compression Codec used for archive entries. Readers decompress
+  /// by the method recorded in each entry, so no reader-side option exists.
   static StatusOr<IndexWriter> Create(
-      absl::string_view path, KzipEncoding encoding = DefaultEncoding());
+      absl::string_view path, KzipEncoding encoding = DefaultEncoding(),
+      bool async_writes = DefaultAsyncWrites(),
+      KzipCompression compression = DefaultCompression());
   /// \brief Constructs an IndexWriter from the libzip source pointer.
   /// \param source zip_source_t to use as backing store.
   /// See https://libzip.org/documentation/zip_source.html for ownership.
   /// \param flags Flags to use when opening `source`.
   /// \param encoding Encoding to use for compilation units.
+  /// \param async_writes See Create.
+  /// \param compression See Create.
   static StatusOr<IndexWriter> FromSource(
       zip_source_t* source, KzipEncoding encoding = DefaultEncoding(),
-      int flags = ZIP_CREATE | ZIP_EXCL);
+      int flags = ZIP_CREATE | ZIP_EXCL,
+      bool async_writes = DefaultAsyncWrites(),
+      KzipCompression compression = DefaultCompression());
 
   /// \brief Destroys the KzipWriter.
   ~KzipWriter() override;
@@ -67,14 +94,29 @@ class KzipWriter : public IndexWriterInterface {
   using Contents = std::string;
   using FileMap = std::unordered_map<Path, Contents>;
 
-  explicit KzipWriter(zip_t* archive, KzipEncoding encoding);
+  explicit KzipWriter(zip_t* archive, KzipEncoding encoding, bool async_writes,
+                      KzipCompression compression);
+
+  /// \brief A queued archive update, pointing into `contents_`.
+  struct WriteRequest {
+    const std::string* path;
+    const std::string* content;
+  };
 
   StatusOr<std::string> InsertFile(absl::string_view path,
                                    absl::string_view content);
+  /// \brief Queues `path`/`content` for the writer thread, deduplicating
+  /// against `contents_`. Blocks while the queue is full.
+  StatusOr<std::string> InsertFileAsync(absl::string_view path,
+                                        absl::string_view content);
+  /// \brief Writer-thread main loop; drains `queue_` into the archive.
+  void WriteLoop();
 
   absl::Status InitializeArchive(zip_t* archive);
 
   static KzipEncoding DefaultEncoding();
+  static bool DefaultAsyncWrites();
+  static KzipCompression DefaultCompression();
 
   bool initialized_ = false;  // Whether or not the `root` entry exists.
   zip_t* archive_;  // Owned, but must be manually deleted via `Close`.
@@ -84,6 +126,23 @@ class KzipWriter : public IndexWriterInterface {
   // contents.
   FileMap contents_;
   KzipEncoding encoding_;
+  /// The libzip compression method applied to each written entry.
+  zip_int32_t compression_method_;
+  /// Reused across WriteUnit calls for JSON-encoded archives.
+  JsonCodec json_codec_;
+
+  // State below is used only when `async_writes_` is set. All libzip calls
+  // (including lazy archive initialization) then happen on `writer_thread_`;
+  // `mu_` guards `contents_`, `queue_`, and the flags.
+  bool async_writes_;
+  std::thread writer_thread_;
+  std::mutex mu_;
+  std::condition_variable queue_ready_;
+  std::condition_variable queue_space_;
+  std::deque<WriteRequest> queue_;
+  size_t queued_bytes_ = 0;
+  bool finished_ = false;
+  absl::Status write_status_;  // The first failure seen by the writer thread.
 };
 
 }  // namespace kythe
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "kythe/cxx/common/mapped_claim_table.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace kythe {
+namespace {
+/// The first bytes of every mapped claim table.
+constexpr char kMagic[8] = {'K', 'y', 'C', 'l', 'a', 'i', 'm', '1'};
+/// Bytes before the entry array: magic plus entry count.
+constexpr size_t kHeaderSize = sizeof(kMagic) + sizeof(uint64_t);
+/// Bytes per (claimable fingerprint, claimant fingerprint) entry.
+constexpr size_t kEntrySize = 2 * sizeof(uint64_t);
+
+/// \brief Reads the claimable fingerprint of the `index`-th entry.
+uint64_t EntryClaimable(const char* entries, size_t index) {
+  uint64_t value;
+  memcpy(&value, entries + index * kEntrySize, sizeof(value));
+  return value;
+}
+
+/// \brief Reads the claimant fingerprint of the `index`-th entry.
+uint64_t EntryClaimant(const char* entries, size_t index) {
+  uint64_t value;
+  memcpy(&value, entries + index * kEntrySize + sizeof(uint64_t),
+         sizeof(value));
+  return value;
+}
+
+/// \brief Writes all of `data` to `fd`, retrying short writes.
+bool WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+}  // anonymous namespace
+
+std::unique_ptr<MappedClaimTable> MappedClaimTable::Open(
+    const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat fd_stat;
+  if (::fstat(fd, &fd_stat) != 0 ||
+      static_cast<size_t>(fd_stat.st_size) < kHeaderSize) {
+    ::close(fd);
+    return nullptr;
+  }
+  size_t size = fd_stat.st_size;
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping holds its own reference to the file.
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  const char* bytes = static_cast<const char*>(data);
+  uint64_t count;
+  memcpy(&count, bytes + sizeof(kMagic), sizeof(count));
+  if (memcmp(bytes, kMagic, sizeof(kMagic)) != 0 ||
+      size != kHeaderSize + count * kEntrySize) {
+    LOG(ERROR) << path << " is not a valid mapped claim table";
+    ::munmap(data, size);
+    return nullptr;
+  }
+  // Lookups are binary searches; don't let the kernel read ahead linearly.
+  ::madvise(data, size, MADV_RANDOM);
+  auto table = std::unique_ptr<MappedClaimTable>(new MappedClaimTable());
+  table->mapped_data_ = bytes;
+  table->mapped_size_ = size;
+  table->entries_ = bytes + kHeaderSize;
+  table->entry_count_ = count;
+  return table;
+}
+
+bool MappedClaimTable::SniffHeader(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  char header[sizeof(kMagic)];
+  bool matches = ::read(fd, header, sizeof(header)) == sizeof(header) &&
+                 memcmp(header, kMagic, sizeof(kMagic)) == 0;
+  ::close(fd);
+  return matches;
+}
+
+bool MappedClaimTable::Write(
+    int fd, std::vector<std::pair<uint64_t, uint64_t>> entries) {
+  // Sort by claimable fingerprint with claimant as a tiebreak so the output
+  // is deterministic; keep one claimant per claimable.
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end(),
+                            [](const std::pair<uint64_t, uint64_t>& lhs,
+                               const std::pair<uint64_t, uint64_t>& rhs) {
+                              return lhs.first == rhs.first;
+                            }),
+                entries.end());
+  std::string buffer;
+  buffer.reserve(kHeaderSize + entries.size() * kEntrySize);
+  buffer.append(kMagic, sizeof(kMagic));
+  uint64_t count = entries.size();
+  buffer.append(reinterpret_cast<const char*>(&count), sizeof(count));
+  for (const auto& entry : entries) {
+    buffer.append(reinterpret_cast<const char*>(&entry.first),
+                  sizeof(entry.first));
+    buffer.append(reinterpret_cast<const char*>(&entry.second),
+                  sizeof(entry.second));
+  }
+  return WriteAll(fd, buffer.data(), buffer.size());
+}
+
+MappedClaimTable::~MappedClaimTable() {
+  if (mapped_data_ != nullptr) {
+    ::munmap(const_cast<char*>(mapped_data_), mapped_size_);
+  }
+}
+
+bool MappedClaimTable::Lookup(uint64_t claimable_fingerprint,
+                              uint64_t* claimant_fingerprint) const {
+  size_t lo = 0, hi = entry_count_;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (EntryClaimable(entries_, mid) < claimable_fingerprint) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == entry_count_ ||
+      EntryClaimable(entries_, lo) != claimable_fingerprint) {
+    return false;
+  }
+  *claimant_fingerprint = EntryClaimant(entries_, lo);
+  return true;
+}
+
+}  // namespace kythe
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef KYTHE_CXX_COMMON_MAPPED_CLAIM_TABLE_H_
+#define KYTHE_CXX_COMMON_MAPPED_CLAIM_TABLE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace kythe {
+
+/// \brief A static claim table stored as a sorted fingerprint array,
+/// memory-mapped read-only.
+///
+/// The on-disk format is an 8-byte magic, a host-endian uint64 entry count,
+/// then `count` 16-byte entries of (claimable fingerprint, claimant
+/// fingerprint) sorted by claimable fingerprint (see `VNameFingerprint`).
+/// Opening the table is O(1) regardless of its size, lookups are binary
+/// searches over the mapping, and every process mapping the same file shares
+/// one physical copy of its pages. The format is a machine-local artifact and
+/// is not portable across byte orders.
+class MappedClaimTable {
+ public:
+  /// \brief Maps the table at `path` read-only.
+  /// \return null if the file can't be opened or isn't a valid table.
+  static std::unique_ptr<MappedClaimTable> Open(const std::string& path);
+
+  /// \brief Returns whether the file at `path` starts with this format's
+  /// magic (without mapping it).
+  static bool SniffHeader(const std::string& path);
+
+  /// \brief Writes `entries` (pairs of claimable and claimant fingerprint)
+  /// to `fd` in table format, sorting them and dropping duplicate
+  /// claimables.
+  /// \return false if writing failed.
+  static bool Write(int fd,
+                    std::vector<std::pair<uint64_t, uint64_t>> entries);
+
+  ~MappedClaimTable();
+
+  MappedClaimTable(const MappedClaimTable&) = delete;
+  MappedClaimTable& operator=(const MappedClaimTable&) = delete;
+
+  /// \brief Looks up `claimable_fingerprint`.
+  /// \param claimant_fingerprint Set to the assigned claimant's fingerprint
+  /// on success.
+  /// \return false if the claimable is not in the table.
+  bool Lookup(uint64_t claimable_fingerprint,
+              uint64_t* claimant_fingerprint) const;
+
+  /// \brief The number of assignments in the table.
+  size_t size() const { return entry_count_; }
+
+ private:
+  MappedClaimTable() = default;
+
+  /// The mapped file, including its header.
+  const char* mapped_data_ = nullptr;
+  /// Size of the mapping in bytes.
+  size_t mapped_size_ = 0;
+  /// The entry array within `mapped_data_`.
+  const char* entries_ = nullptr;
+  /// \sa size()
+  size_t entry_count_ = 0;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_MAPPED_CLAIM_TABLE_H_
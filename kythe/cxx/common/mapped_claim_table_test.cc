@@ -0,0 +1,104 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/mapped_claim_table.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace kythe {
+namespace {
+
+/// \brief Writes `entries` as a table file and returns its path.
+std::string WriteTable(std::vector<std::pair<uint64_t, uint64_t>> entries) {
+  std::string path =
+      ::testing::TempDir() + "/claims." + std::to_string(::getpid()) + "." +
+      std::to_string(entries.size());
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  EXPECT_GE(fd, 0);
+  EXPECT_TRUE(MappedClaimTable::Write(fd, std::move(entries)));
+  ::close(fd);
+  return path;
+}
+
+TEST(MappedClaimTableTest, RoundTripsEntries) {
+  std::string path = WriteTable({{30, 3}, {10, 1}, {20, 2}});
+  auto table = MappedClaimTable::Open(path);
+  ASSERT_NE(table, nullptr);
+  EXPECT_EQ(table->size(), 3);
+  uint64_t claimant = 0;
+  EXPECT_TRUE(table->Lookup(10, &claimant));
+  EXPECT_EQ(claimant, 1);
+  EXPECT_TRUE(table->Lookup(20, &claimant));
+  EXPECT_EQ(claimant, 2);
+  EXPECT_TRUE(table->Lookup(30, &claimant));
+  EXPECT_EQ(claimant, 3);
+  EXPECT_FALSE(table->Lookup(15, &claimant));
+  EXPECT_FALSE(table->Lookup(40, &claimant));
+  ::unlink(path.c_str());
+}
+
+TEST(MappedClaimTableTest, DeduplicatesClaimables) {
+  std::string path = WriteTable({{10, 1}, {10, 2}, {10, 3}});
+  auto table = MappedClaimTable::Open(path);
+  ASSERT_NE(table, nullptr);
+  EXPECT_EQ(table->size(), 1);
+  uint64_t claimant = 0;
+  EXPECT_TRUE(table->Lookup(10, &claimant));
+  ::unlink(path.c_str());
+}
+
+TEST(MappedClaimTableTest, HandlesEmptyTable) {
+  std::string path = WriteTable({});
+  auto table = MappedClaimTable::Open(path);
+  ASSERT_NE(table, nullptr);
+  EXPECT_EQ(table->size(), 0);
+  uint64_t claimant = 0;
+  EXPECT_FALSE(table->Lookup(10, &claimant));
+  ::unlink(path.c_str());
+}
+
+TEST(MappedClaimTableTest, SniffsHeader) {
+  std::string table_path = WriteTable({{10, 1}});
+  EXPECT_TRUE(MappedClaimTable::SniffHeader(table_path));
+  std::string text_path = ::testing::TempDir() + "/claims.not-a-table";
+  FILE* text = ::fopen(text_path.c_str(), "w");
+  ASSERT_NE(text, nullptr);
+  ::fputs("entries {}\n", text);
+  ::fclose(text);
+  EXPECT_FALSE(MappedClaimTable::SniffHeader(text_path));
+  EXPECT_FALSE(MappedClaimTable::SniffHeader(text_path + ".missing"));
+  ::unlink(table_path.c_str());
+  ::unlink(text_path.c_str());
+}
+
+TEST(MappedClaimTableTest, RejectsTruncatedTable) {
+  std::string path = WriteTable({{10, 1}, {20, 2}});
+  ASSERT_EQ(::truncate(path.c_str(), 24), 0);
+  EXPECT_EQ(MappedClaimTable::Open(path), nullptr);
+  ::unlink(path.c_str());
+}
+
+}  // anonymous namespace
+}  // namespace kythe
@@ -18,6 +18,8 @@
 
 #include <curl/curl.h>
 
+#include <utility>
+
 #include "glog/logging.h"
 #include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
@@ -30,6 +32,19 @@ namespace kythe {
 
 JsonClient::JsonClient() : curl_(::curl_easy_init()) {
   CHECK(curl_ != nullptr);
+  // Configure everything that doesn't change between requests here; Request
+  // only has to set the URL and method. Reusing the configured handle also
+  // lets libcurl keep the connection to the service open across calls.
+  ::curl_easy_setopt(curl_, CURLOPT_READFUNCTION, CurlReadCallback);
+  ::curl_easy_setopt(curl_, CURLOPT_READDATA, this);
+  ::curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, CurlWriteCallback);
+  ::curl_easy_setopt(curl_, CURLOPT_WRITEDATA, this);
+  // Offer all of the encodings curl was built with (gzip, deflate, ...);
+  // curl decompresses the response before CurlWriteCallback sees it.
+  ::curl_easy_setopt(curl_, CURLOPT_ACCEPT_ENCODING, "");
+  ::curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+  post_headers_ =
+      ::curl_slist_append(nullptr, "Content-Type: application/json");
 }
 
 JsonClient::~JsonClient() {
@@ -37,12 +52,20 @@ JsonClient::~JsonClient() {
     ::curl_easy_cleanup(curl_);
     curl_ = nullptr;
   }
+  ::curl_slist_free_all(post_headers_);
+  post_headers_ = nullptr;
 }
 
 void JsonClient::InitNetwork() {
   CHECK(::curl_global_init(CURL_GLOBAL_ALL) == 0);
 }
 
+void JsonClient::set_post_content_type(const std::string& content_type) {
+  ::curl_slist_free_all(post_headers_);
+  post_headers_ =
+      ::curl_slist_append(nullptr, ("Content-Type: " + content_type).c_str());
+}
+
 size_t JsonClient::CurlWriteCallback(void* data, size_t size, size_t nmemb,
                                      void* user) {
   JsonClient* client = static_cast<JsonClient*>(user);
@@ -77,11 +100,11 @@ bool JsonClient::Request(const std::string& uri, bool post,
 bool JsonClient::Request(const std::string& uri, bool post,
                          const std::string& request,
                          rapidjson::Document* response) {
-  std::string to_decode;
+  const std::string* to_decode = nullptr;
   if (!Request(uri, post, request, &to_decode)) {
     return false;
   }
-  response->Parse(to_decode.c_str());
+  response->Parse(to_decode->c_str());
   if (response->HasParseError()) {
     LOG(ERROR) << "(uri: " << uri << "): bad JSON at offset "
                << response->GetErrorOffset() << ": "
@@ -93,25 +116,33 @@ bool JsonClient::Request(const std::string& uri, bool post,
 
 bool JsonClient::Request(const std::string& uri, bool post,
                          const std::string& request, std::string* response) {
+  const std::string* borrowed = nullptr;
+  if (!Request(uri, post, request, &borrowed)) {
+    return false;
+  }
+  if (response) {
+    // Copy rather than move so `received_` keeps its capacity for the next
+    // request.
+    *response = *borrowed;
+  }
+  return true;
+}
+
+bool JsonClient::Request(const std::string& uri, bool post,
+                         const std::string& request,
+                         const std::string** response) {
   to_send_ = request;
   send_head_ = 0;
   received_.clear();
 
   ::curl_easy_setopt(curl_, CURLOPT_URL, uri.c_str());
   ::curl_easy_setopt(curl_, CURLOPT_POST, post ? 1L : 0L);
-  ::curl_easy_setopt(curl_, CURLOPT_READFUNCTION, CurlReadCallback);
-  ::curl_easy_setopt(curl_, CURLOPT_READDATA, this);
-  ::curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, CurlWriteCallback);
-  ::curl_easy_setopt(curl_, CURLOPT_WRITEDATA, this);
-  ::curl_slist* headers = nullptr;
+  ::curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, post ? post_headers_ : nullptr);
   if (post) {
-    headers = ::curl_slist_append(headers, "Content-Type: application/json");
-    ::curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers);
     ::curl_easy_setopt(curl_, CURLOPT_POSTFIELDSIZE, request.size());
   }
 
   ::CURLcode res = ::curl_easy_perform(curl_);
-  ::curl_slist_free_all(headers);
 
   if (res) {
     LOG(ERROR) << "(uri: " << uri << "): " << ::curl_easy_strerror(res);
@@ -129,7 +160,86 @@ bool JsonClient::Request(const std::string& uri, bool post,
     return false;
   }
   if (response) {
-    *response = received_;
+    *response = &received_;
+  }
+  return true;
+}
+
+bool LruReplyCache::Lookup(const std::string& key, std::string* reply_bytes) {
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  *reply_bytes = entries_.front().reply;
+  return true;
+}
+
+void LruReplyCache::Put(const std::string& key,
+                        const std::string& reply_bytes) {
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    entries_.splice(entries_.begin(), entries_, it->second);
+    bytes_ -= entries_.front().reply.size();
+    entries_.front().reply = reply_bytes;
+    bytes_ += reply_bytes.size();
+  } else {
+    if (key.size() + reply_bytes.size() > max_bytes_) {
+      return;
+    }
+    entries_.push_front(Entry{key, reply_bytes});
+    index_[absl::string_view(entries_.front().key)] = entries_.begin();
+    bytes_ += key.size() + reply_bytes.size();
+  }
+  EvictToBudget();
+}
+
+void LruReplyCache::EvictToBudget() {
+  while (bytes_ > max_bytes_ && !entries_.empty()) {
+    const Entry& victim = entries_.back();
+    bytes_ -= victim.key.size() + victim.reply.size();
+    index_.erase(absl::string_view(victim.key));
+    entries_.pop_back();
+  }
+}
+
+XrefsJsonClient::~XrefsJsonClient() {
+  VLOG(1) << "Nodes reply cache: " << nodes_cache_.hits() << " hits, "
+          << nodes_cache_.misses() << " misses, " << nodes_cache_.bytes()
+          << " bytes";
+  VLOG(1) << "Edges reply cache: " << edges_cache_.hits() << " hits, "
+          << edges_cache_.misses() << " misses, " << edges_cache_.bytes()
+          << " bytes";
+}
+
+bool XrefsJsonClient::CachedRoundtrip(const std::string& endpoint,
+                                      LruReplyCache* cache,
+                                      const google::protobuf::Message& request,
+                                      google::protobuf::Message* response,
+                                      std::string* error_text) {
+  if (!response) {
+    return Roundtrip(endpoint, request, response, error_text);
+  }
+  // Key on the deterministic serialization so semantically identical requests
+  // canonicalize to the same bytes regardless of in-memory layout.
+  cache_key_.clear();
+  {
+    google::protobuf::io::StringOutputStream stream(&cache_key_);
+    google::protobuf::io::CodedOutputStream coded_stream(&stream);
+    coded_stream.SetSerializationDeterministic(true);
+    request.SerializeToCodedStream(&coded_stream);
+  }
+  if (cache->Lookup(cache_key_, &cache_reply_)) {
+    return response->ParseFromString(cache_reply_);
+  }
+  if (!Roundtrip(endpoint, request, response, error_text)) {
+    return false;
+  }
+  cache_reply_.clear();
+  if (response->SerializeToString(&cache_reply_)) {
+    cache->Put(cache_key_, cache_reply_);
   }
   return true;
 }
@@ -138,23 +248,28 @@ bool XrefsJsonClient::Roundtrip(const std::string& endpoint,
                                 const google::protobuf::Message& request,
                                 google::protobuf::Message* response,
                                 std::string* error_text) {
-  std::string request_json;
-  if (!WriteMessageAsJsonToString(request, &request_json)) {
+  request_body_.clear();
+  if (transport_ == XrefsTransport::kProto
+          ? !request.SerializeToString(&request_body_)
+          : !WriteMessageAsJsonToString(request, &request_body_)) {
     if (error_text) {
       *error_text = "Couldn't serialize message.";
     }
     return false;
   }
-  std::string response_buffer;
-  if (!client_->Request(endpoint, true, request_json, &response_buffer)) {
+  const std::string* response_buffer = nullptr;
+  if (!client_->Request(endpoint, true, request_body_, &response_buffer)) {
     if (error_text) {
       *error_text = "Network client error.";
     }
     return false;
   }
   if (response) {
-    google::protobuf::io::ArrayInputStream stream(response_buffer.data(),
-                                                  response_buffer.size());
+    // If the caller allocated `response` on a protobuf arena, the parse below
+    // builds the whole reply tree on that arena; `DocumentNodesFromTicketList`
+    // in the doc pipeline relies on this to retire each reply in one free.
+    google::protobuf::io::ArrayInputStream stream(response_buffer->data(),
+                                                  response_buffer->size());
     google::protobuf::io::CodedInputStream coded_stream(&stream);
     if (!response->ParseFromCodedStream(&coded_stream)) {
       if (error_text) {
@@ -19,9 +19,12 @@
 
 #include <curl/curl.h>
 
+#include <list>
 #include <memory>
 #include <string>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
 #include "kythe/proto/graph.pb.h"
 #include "kythe/proto/storage.pb.h"
 #include "kythe/proto/xref.pb.h"
@@ -40,6 +43,10 @@ class JsonClient {
   /// \brief Call once to initialize the underlying network library.
   static void InitNetwork();
 
+  /// \brief Sets the Content-Type header sent with POST bodies
+  /// ("application/json" by default).
+  void set_post_content_type(const std::string& content_type);
+
   /// \brief Issue a request.
   /// \param uri The URI to request.
   /// \param post Issue this request as a post?
@@ -68,14 +75,29 @@ class JsonClient {
   bool Request(const std::string& uri, bool post, const std::string& request,
                std::string* response);
 
+  /// \brief Issue a request, borrowing the response from an internal buffer.
+  /// \param uri The URI to request.
+  /// \param post Issue this request as a post?
+  /// \param request The string to issue as the request.
+  /// \param response Set to point at the response bytes. The buffer stays
+  /// owned by the client and is valid only until the next `Request` call;
+  /// because it is never moved out, its capacity is reused across requests.
+  /// \return true on success and false on failure
+  bool Request(const std::string& uri, bool post, const std::string& request,
+               const std::string** response);
+
  private:
   static size_t CurlWriteCallback(void* data, size_t size, size_t nmemb,
                                   void* user);
   static size_t CurlReadCallback(void* data, size_t size, size_t nmemb,
                                  void* user);
 
-  /// The network context.
+  /// The network context. The handle is configured once at construction and
+  /// reused for every request, so libcurl keeps the connection to the service
+  /// alive between calls.
   CURL* curl_;
+  /// Headers sent with every POST, built once at construction.
+  ::curl_slist* post_headers_ = nullptr;
   /// A buffer used for communications.
   std::string to_send_;
   /// Where we are in the buffer.
@@ -84,6 +106,54 @@ class JsonClient {
   std::string received_;
 };
 
+/// \brief A bounded LRU cache of serialized RPC replies, keyed by request
+/// bytes.
+///
+/// LruReplyCache is not thread-safe.
+class LruReplyCache {
+ public:
+  /// \param max_bytes Budget for cached keys and replies combined; the least
+  /// recently used entries are evicted to stay under it.
+  explicit LruReplyCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+  /// \brief Looks up `key`, marking its entry most recently used.
+  /// \param reply_bytes Filled with the cached reply on a hit.
+  /// \return true on a hit.
+  bool Lookup(const std::string& key, std::string* reply_bytes);
+
+  /// \brief Inserts or replaces the entry for `key`, evicting older entries
+  /// as needed. Entries larger than the whole budget are not stored.
+  void Put(const std::string& key, const std::string& reply_bytes);
+
+  /// \brief Number of `Lookup` calls that hit.
+  size_t hits() const { return hits_; }
+  /// \brief Number of `Lookup` calls that missed.
+  size_t misses() const { return misses_; }
+  /// \brief Bytes of keys and replies currently cached.
+  size_t bytes() const { return bytes_; }
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string reply;
+  };
+
+  /// \brief Evicts least recently used entries until `bytes_` fits the
+  /// budget.
+  void EvictToBudget();
+
+  /// Cached entries, most recently used first.
+  std::list<Entry> entries_;
+  /// Maps each entry's key (viewing the string owned by the entry, which is
+  /// stable under list splices) to its position in `entries_`.
+  absl::flat_hash_map<absl::string_view, std::list<Entry>::iterator> index_;
+  /// \sa bytes()
+  size_t bytes_ = 0;
+  size_t max_bytes_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
+
 /// \brief A client for a Kythe xrefs service.
 class XrefsClient {
  public:
@@ -144,25 +214,47 @@ class XrefsClient {
   }
 };
 
-/// \brief A client for a Kythe xrefs service that talks JSON.
+/// \brief The request encoding an `XrefsJsonClient` puts on the wire.
+enum class XrefsTransport {
+  /// JSON-encoded request bodies.
+  kJson,
+  /// Binary-proto request bodies; skips the JSON codec entirely for
+  /// multi-megabyte requests and replies.
+  kProto,
+};
+
+/// \brief A client for a Kythe xrefs service over HTTP.
+///
+/// Replies arrive as binary protos either way (the "?proto=1" endpoints);
+/// `XrefsTransport` selects how requests are encoded.
 class XrefsJsonClient : public XrefsClient {
  public:
   /// \param client The JsonClient to use.
   /// \param base_uri The base URI of the service ("http://localhost:8080")
+  /// \param transport The request encoding to use.
   XrefsJsonClient(std::unique_ptr<JsonClient> client,
-                  const std::string& base_uri)
+                  const std::string& base_uri,
+                  XrefsTransport transport = XrefsTransport::kJson)
       : client_(std::move(client)),
+        transport_(transport),
         nodes_uri_(base_uri + "/nodes?proto=1"),
         edges_uri_(base_uri + "/edges?proto=1"),
         decorations_uri_(base_uri + "/decorations?proto=1"),
-        documentation_uri_(base_uri + "/documentation?proto=1") {}
+        documentation_uri_(base_uri + "/documentation?proto=1") {
+    if (transport_ == XrefsTransport::kProto) {
+      client_->set_post_content_type("application/x-protobuf");
+    }
+  }
+  ~XrefsJsonClient() override;
   bool Nodes(const proto::NodesRequest& request, proto::NodesReply* reply,
              std::string* error_text) override {
-    return Roundtrip(nodes_uri_, request, reply, error_text);
+    return CachedRoundtrip(nodes_uri_, &nodes_cache_, request, reply,
+                           error_text);
   }
   bool Edges(const proto::EdgesRequest& request, proto::EdgesReply* reply,
              std::string* error_text) override {
-    return Roundtrip(edges_uri_, request, reply, error_text);
+    return CachedRoundtrip(edges_uri_, &edges_cache_, request, reply,
+                           error_text);
   }
   bool Decorations(const proto::DecorationsRequest& request,
                    proto::DecorationsReply* reply,
@@ -175,16 +267,45 @@ class XrefsJsonClient : public XrefsClient {
     return Roundtrip(documentation_uri_, request, reply, error_text);
   }
 
+  /// \brief The reply cache consulted by `Nodes`.
+  const LruReplyCache& nodes_cache() const { return nodes_cache_; }
+  /// \brief The reply cache consulted by `Edges`.
+  const LruReplyCache& edges_cache() const { return edges_cache_; }
+
  private:
+  /// Default per-method reply cache budget, in bytes.
+  static constexpr size_t kDefaultCacheBytes = 64 * 1024 * 1024;
+
   bool Roundtrip(const std::string& endpoint,
                  const google::protobuf::Message& request,
                  google::protobuf::Message* response, std::string* error_text);
 
+  /// \brief Like `Roundtrip`, but consults `cache` (keyed by the request's
+  /// deterministic serialization) before touching the network and stores
+  /// successful replies back into it.
+  bool CachedRoundtrip(const std::string& endpoint, LruReplyCache* cache,
+                       const google::protobuf::Message& request,
+                       google::protobuf::Message* response,
+                       std::string* error_text);
+
   std::unique_ptr<JsonClient> client_;
+  /// \sa XrefsTransport
+  XrefsTransport transport_;
   std::string nodes_uri_;
   std::string edges_uri_;
   std::string decorations_uri_;
   std::string documentation_uri_;
+  /// Serialized request buffer (JSON or binary proto, per `transport_`),
+  /// reused across calls to avoid reallocating it for every RPC.
+  std::string request_body_;
+  /// Cache key and reply buffers for `CachedRoundtrip`, reused across calls.
+  std::string cache_key_;
+  std::string cache_reply_;
+  /// Per-method reply caches. Safe within one process run because the served
+  /// graph is static; popular requests (standard library types, common base
+  /// classes) repeat millions of times during doc generation.
+  LruReplyCache nodes_cache_{kDefaultCacheBytes};
+  LruReplyCache edges_cache_{kDefaultCacheBytes};
 };
 }  // namespace kythe
 
@@ -30,6 +30,27 @@ ABSL_FLAG(std::string, xrefs, "http://localhost:8080",
           "Base URI for xrefs service");
 
 namespace {
+void TestLruReplyCache() {
+  kythe::LruReplyCache cache(20);
+  std::string reply;
+  CHECK(!cache.Lookup("a", &reply));
+  cache.Put("a", "reply-a");
+  cache.Put("b", "reply-b");
+  CHECK(cache.Lookup("a", &reply));
+  CHECK_EQ("reply-a", reply);
+  // "b" is now least recently used; inserting "c" must evict it, not "a".
+  cache.Put("c", "reply-c");
+  CHECK(!cache.Lookup("b", &reply));
+  CHECK(cache.Lookup("a", &reply));
+  CHECK(cache.Lookup("c", &reply));
+  CHECK_EQ("reply-c", reply);
+  // Entries over the whole budget are not stored.
+  cache.Put("d", std::string(64, 'd'));
+  CHECK(!cache.Lookup("d", &reply));
+  CHECK_EQ(3, cache.hits());
+  CHECK_EQ(3, cache.misses());
+}
+
 void TestNodeRequest() {
   kythe::XrefsJsonClient client(absl::make_unique<kythe::JsonClient>(),
                                 absl::GetFlag(FLAGS_xrefs));
@@ -56,6 +77,7 @@ int main(int argc, char** argv) {
   google::InitGoogleLogging(argv[0]);
   absl::ParseCommandLine(argc, argv);
   kythe::JsonClient::InitNetwork();
+  TestLruReplyCache();
   TestNodeRequest();
   return 0;
 }
@@ -19,14 +19,10 @@
 #include <stdlib.h>
 #include <unistd.h>
 
-#include <vector>
-
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
-#include "absl/strings/str_join.h"
-#include "absl/strings/str_split.h"
 #include "glog/logging.h"
 #include "kythe/cxx/common/status.h"
 #include "kythe/cxx/common/status_or.h"
@@ -34,12 +30,6 @@
 namespace kythe {
 namespace {
 
-// Predicate used in CleanPath for skipping empty components
-// and components consistening of a single '.'.
-struct SkipEmptyDot {
-  bool operator()(absl::string_view sp) { return !(sp.empty() || sp == "."); }
-};
-
 // Deal with relative paths as well as '/' and '//'.
 absl::string_view PathPrefix(absl::string_view path) {
   int slash_count = 0;
@@ -114,14 +104,33 @@ PathParts SplitPath(absl::string_view path) {
 }  // namespace
 
 StatusOr<PathCleaner> PathCleaner::Create(absl::string_view root) {
+  absl::optional<std::string> cwd;
+  if (StatusOr<std::string> dir = GetCurrentDirectory()) {
+    cwd = *std::move(dir);
+  }
   if (StatusOr<std::string> resolved = MakeCleanAbsolutePath(root)) {
-    return PathCleaner(*std::move(resolved));
+    return PathCleaner(*std::move(resolved), std::move(cwd));
   } else {
     return resolved.status();
   }
 }
 
 StatusOr<std::string> PathCleaner::Relativize(absl::string_view path) const {
+  if (IsAbsolutePath(path)) {
+    return std::string(TrimPathPrefix(CleanPath(path), root_));
+  }
+  if (cwd_.has_value()) {
+    // Join and clean in one caller-owned buffer; this runs once per
+    // required input during extraction.
+    std::string joined;
+    joined.reserve(cwd_->size() + path.size() + 1);
+    joined.append(*cwd_);
+    AppendPath(&joined, path);
+    CleanPathInPlace(&joined);
+    return std::string(TrimPathPrefix(joined, root_));
+  }
+  // Fall back to querying the working directory (and potentially failing) if
+  // it couldn't be determined at creation.
   if (StatusOr<std::string> resolved = MakeCleanAbsolutePath(path)) {
     return std::string(TrimPathPrefix(*std::move(resolved), root_));
   } else {
@@ -167,6 +176,13 @@ StatusOr<std::string> PathRealizer::Relativize(absl::string_view path) const {
       });
 }
 
+void PathRealizer::Prewarm(absl::Span<const std::string> paths) const {
+  for (const auto& path : paths) {
+    // Failures are deliberately retained as negative cache entries.
+    (void)Relativize(path);
+  }
+}
+
 StatusOr<PathCanonicalizer> PathCanonicalizer::Create(absl::string_view root,
                                                       Policy policy) {
   StatusOr<PathCleaner> cleaner = PathCleaner::Create(root);
@@ -203,6 +219,12 @@ StatusOr<std::string> PathCanonicalizer::Relativize(
   return std::string(path);
 }
 
+void PathCanonicalizer::Prewarm(absl::Span<const std::string> paths) const {
+  if (realizer_.has_value()) {
+    realizer_->Prewarm(paths);
+  }
+}
+
 absl::optional<PathCanonicalizer::Policy> ParseCanonicalizationPolicy(
     absl::string_view policy) {
   using Policy = PathCanonicalizer::Policy;
@@ -247,21 +269,72 @@ std::string JoinPath(absl::string_view a, absl::string_view b) {
                       absl::StripPrefix(b, "/"));
 }
 
-std::string CleanPath(absl::string_view input) {
-  const bool is_absolute_path = absl::StartsWith(input, "/");
-  std::vector<absl::string_view> parts;
-  for (absl::string_view comp : absl::StrSplit(input, '/', SkipEmptyDot{})) {
+void AppendPath(std::string* a, absl::string_view b) {
+  if (!a->empty() && a->back() == '/') {
+    a->pop_back();
+  }
+  absl::ConsumePrefix(&b, "/");
+  a->push_back('/');
+  a->append(b.data(), b.size());
+}
+
+void CleanPathInPlace(std::string* path) {
+  std::string& p = *path;
+  const bool is_absolute_path = absl::StartsWith(p, "/");
+  // Deal with leading '//' as well as '/'; the prefix characters are already
+  // in place, so only its length matters.
+  const size_t prefix = PathPrefix(p).size();
+  // Components are copied down over the parts of the buffer that cleaning
+  // discards; `write` never passes `read`, so copies move characters only
+  // toward the front and a single forward pass suffices.
+  size_t write = prefix;
+  size_t read = prefix;
+  while (read < p.size()) {
+    if (p[read] == '/') {
+      ++read;
+      continue;
+    }
+    size_t comp_end = read;
+    while (comp_end < p.size() && p[comp_end] != '/') {
+      ++comp_end;
+    }
+    const absl::string_view comp(p.data() + read, comp_end - read);
+    if (comp == ".") {
+      read = comp_end;
+      continue;
+    }
     if (comp == "..") {
-      if (!parts.empty() && parts.back() != "..") {
-        parts.pop_back();
+      if (write > prefix) {
+        // Pop the previously written component unless it is itself a "..".
+        size_t slash = p.rfind('/', write - 1);
+        size_t prev_start =
+            (slash == std::string::npos || slash < prefix) ? prefix : slash + 1;
+        if (absl::string_view(p.data() + prev_start, write - prev_start) !=
+            "..") {
+          write = prev_start > prefix ? prev_start - 1 : prefix;
+          read = comp_end;
+          continue;
+        }
+      } else if (is_absolute_path) {
+        read = comp_end;
         continue;
       }
-      if (is_absolute_path) continue;
     }
-    parts.push_back(comp);
+    if (write > prefix) {
+      p[write++] = '/';
+    }
+    for (size_t i = read; i < comp_end; ++i) {
+      p[write++] = p[i];
+    }
+    read = comp_end;
   }
-  // Deal with leading '//' as well as '/'.
-  return absl::StrCat(PathPrefix(input), absl::StrJoin(parts, "/"));
+  p.resize(write);
+}
+
+std::string CleanPath(absl::string_view input) {
+  std::string result(input);
+  CleanPathInPlace(&result);
+  return result;
 }
 
 bool IsAbsolutePath(absl::string_view path) {
@@ -285,7 +358,10 @@ StatusOr<std::string> MakeCleanAbsolutePath(absl::string_view path) {
     return CleanPath(path);
   }
   if (StatusOr<std::string> dir = GetCurrentDirectory()) {
-    return CleanPath(JoinPath(*std::move(dir), path));
+    std::string joined = *std::move(dir);
+    AppendPath(&joined, path);
+    CleanPathInPlace(&joined);
+    return joined;
   } else {
     return dir.status();
   }
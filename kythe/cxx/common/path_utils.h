@@ -25,6 +25,7 @@
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "kythe/cxx/common/status_or.h"
 
 namespace kythe {
@@ -44,9 +45,14 @@ class PathCleaner {
   StatusOr<std::string> Relativize(absl::string_view path) const;
 
  private:
-  explicit PathCleaner(std::string root) : root_(std::move(root)) {}
+  explicit PathCleaner(std::string root, absl::optional<std::string> cwd)
+      : root_(std::move(root)), cwd_(std::move(cwd)) {}
 
   std::string root_;
+  // The working directory captured at creation, against which relative paths
+  // are resolved without a getcwd call each time; if you're chdir()ing during
+  // the build you're going to have a bad time.
+  absl::optional<std::string> cwd_;
 };
 
 /// \brief PathRealizer relativizes paths against a root using RealPath.
@@ -69,6 +75,11 @@ class PathRealizer {
   ///         an error if the path cannot be resolved.
   StatusOr<std::string> Relativize(absl::string_view path) const;
 
+  /// \brief Resolves each of `paths` into the cache ahead of use, including
+  ///        negative entries for paths which fail to resolve, so subsequent
+  ///        Relativize calls are pure in-memory lookups.
+  void Prewarm(absl::Span<const std::string> paths) const;
+
  private:
   class PathCache {
    public:
@@ -105,6 +116,11 @@ class PathCanonicalizer {
   ///        configured policy.
   StatusOr<std::string> Relativize(absl::string_view path) const;
 
+  /// \brief Resolves each of `paths` into the canonicalization cache ahead of
+  ///        use (a no-op under Policy::kCleanOnly, which never touches the
+  ///        filesystem per path).
+  void Prewarm(absl::Span<const std::string> paths) const;
+
  private:
   explicit PathCanonicalizer(Policy policy, PathCleaner cleaner,
                              absl::optional<PathRealizer> realizer)
@@ -138,6 +154,16 @@ absl::optional<PathCanonicalizer::Policy> ParseCanonicalizationPolicy(
 /// \brief Append path `b` to path `a`, cleaning and returning the result.
 std::string JoinPath(absl::string_view a, absl::string_view b);
 
+/// \brief Appends path `b` to the caller-owned buffer `a` in place, with the
+/// same separator handling as `JoinPath` but no temporary strings.
+void AppendPath(std::string* a, absl::string_view b);
+
+/// \brief Cleans `path` in place with the same semantics as `CleanPath`.
+///
+/// The cleaned path is never longer than the input, so normalization runs in
+/// a single pass over the caller-owned buffer without allocating.
+void CleanPathInPlace(std::string* path);
+
 /// \brief Returns the part of the path before the final '/'.
 absl::string_view Dirname(absl::string_view path);
 
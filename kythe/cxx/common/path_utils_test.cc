@@ -21,6 +21,7 @@
 
 #include <string>
 #include <system_error>
+#include <utility>
 
 #include "absl/status/status.h"
 #include "gtest/gtest.h"
@@ -70,12 +71,35 @@ TEST(PathUtilsTest, CleanPath) {
   EXPECT_EQ("..", CleanPath("a/../../"));
 }
 
+TEST(PathUtilsTest, CleanPathInPlace) {
+  // CleanPathInPlace must agree with CleanPath on the same inputs.
+  for (const char* input :
+       {"/../../a/c", "", "a/c", "a//c", "a/c/.", "a/c/b/..", "/../a/c",
+        "/../a/b/../././/c", "/Users", "//Users", "///Users", "a/../../",
+        "../..", "./", "/"}) {
+    std::string path = input;
+    CleanPathInPlace(&path);
+    EXPECT_EQ(CleanPath(input), path) << "input: " << input;
+  }
+}
+
 TEST(PathUtilsTest, JoinPath) {
   EXPECT_EQ("a/c", JoinPath("a", "c"));
   EXPECT_EQ("a/c", JoinPath("a/", "c"));
   EXPECT_EQ("a/c", JoinPath("a", "/c"));
 }
 
+TEST(PathUtilsTest, AppendPath) {
+  // AppendPath must agree with JoinPath on the same inputs.
+  const std::pair<const char*, const char*> cases[] = {
+      {"a", "c"}, {"a/", "c"}, {"a", "/c"}, {"", "c"}, {"a", ""}};
+  for (const auto& [a, b] : cases) {
+    std::string path = a;
+    AppendPath(&path, b);
+    EXPECT_EQ(JoinPath(a, b), path) << "a: " << a << " b: " << b;
+  }
+}
+
 TEST(PathUtilsTest, RelativizePath) {
   StatusOr<std::string> current_dir = GetCurrentDirectory();
   ASSERT_TRUE(current_dir.ok());
@@ -225,6 +249,26 @@ TEST_F(CanonicalizerTest, CanonicalizerPreferRelative) {
                 .value_or(""));
 }
 
+TEST_F(CanonicalizerTest, CanonicalizerPrewarm) {
+  AddDirectory("base");
+  AddDirectory("elsewhere");
+  AddDirectory("elsewhere/file");
+  AddSymlink("../elsewhere", "base/link");
+
+  const std::string base = JoinPath(root(), "base");
+  PathCanonicalizer canonicalizer =
+      PathCanonicalizer::Create(base, PathCanonicalizer::Policy::kPreferReal)
+          .ValueOrDie();
+  // Prewarmed paths (including negative entries for unresolvable ones)
+  // resolve identically to cold lookups.
+  canonicalizer.Prewarm(std::vector<std::string>{
+      JoinPath(base, "link/file"), JoinPath(base, "bad/file")});
+  EXPECT_EQ(JoinPath(root(), "elsewhere/file"),
+            canonicalizer.Relativize(JoinPath(base, "link/file")).value_or(""));
+  EXPECT_EQ("bad/file",
+            canonicalizer.Relativize(JoinPath(base, "bad/file")).value_or(""));
+}
+
 TEST_F(CanonicalizerTest, CanonicalizerPreferReal) {
   AddDirectory("base");
   AddDirectory("elsewhere");
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/sharded_index_writer.h"
+
+#include <array>
+#include <cstdint>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "glog/logging.h"
+#include "kythe/cxx/common/kzip_writer.h"
+#include "openssl/sha.h"
+
+namespace kythe {
+namespace {
+
+/// \brief Returns a stable shard number for `content` in [0, shards).
+///
+/// The routing hash only has to be deterministic for identical bytes; it
+/// need not equal the digest the shard writer stores the entry under.
+size_t ShardNumber(absl::string_view content, size_t shards) {
+  std::array<unsigned char, SHA256_DIGEST_LENGTH> buf;
+  ::SHA256(reinterpret_cast<const unsigned char*>(content.data()),
+           content.size(), buf.data());
+  uint64_t hash = 0;
+  for (int i = 0; i < 8; ++i) {
+    hash = (hash << 8) | buf[i];
+  }
+  return hash % shards;
+}
+
+}  // namespace
+
+/* static */
+std::string ShardedIndexWriter::ShardPath(absl::string_view path, size_t shard,
+                                          size_t shards) {
+  const std::string suffix = absl::StrFormat("-%05zu-of-%05zu", shard, shards);
+  auto dotpos = path.rfind('.');
+  if (dotpos == path.npos || path.find('/', dotpos) != path.npos) {
+    return absl::StrCat(path, suffix);
+  }
+  return absl::StrCat(path.substr(0, dotpos), suffix, path.substr(dotpos));
+}
+
+/* static */
+StatusOr<IndexWriter> ShardedIndexWriter::Create(absl::string_view path,
+                                                 size_t shards) {
+  return Create(shards, [path, shards](size_t shard) {
+    return KzipWriter::Create(ShardPath(path, shard, shards));
+  });
+}
+
+/* static */
+StatusOr<IndexWriter> ShardedIndexWriter::Create(size_t shards,
+                                                 const ShardFactory& factory) {
+  if (shards == 0) {
+    return absl::InvalidArgumentError("shard count must be positive");
+  }
+  std::vector<std::unique_ptr<Shard>> opened;
+  opened.reserve(shards);
+  for (size_t shard = 0; shard < shards; ++shard) {
+    auto writer = factory(shard);
+    if (!writer.ok()) {
+      // Close the shards already opened so their archives are well-formed.
+      for (auto& open : opened) {
+        absl::Status status = open->writer.Close();
+        if (!status.ok()) {
+          LOG(WARNING) << "Error closing shard: " << status;
+        }
+      }
+      return writer.status();
+    }
+    opened.push_back(absl::make_unique<Shard>(*std::move(writer)));
+  }
+  return IndexWriter(
+      absl::WrapUnique(new ShardedIndexWriter(std::move(opened))));
+}
+
+StatusOr<std::string> ShardedIndexWriter::WriteUnit(
+    const kythe::proto::IndexedCompilation& unit) {
+  // Route on the wire encoding of the unit: the stored digest depends on the
+  // shard writer's encoding, but any deterministic function of the contents
+  // keeps identical units on the same shard.
+  Shard& shard = SelectShard(unit.SerializeAsString());
+  std::unique_lock<std::mutex> lock(shard.mu);
+  return shard.writer.WriteUnit(unit);
+}
+
+StatusOr<std::string> ShardedIndexWriter::WriteFile(absl::string_view content) {
+  Shard& shard = SelectShard(content);
+  std::unique_lock<std::mutex> lock(shard.mu);
+  return shard.writer.WriteFile(content);
+}
+
+absl::Status ShardedIndexWriter::Close() {
+  absl::Status result = absl::OkStatus();
+  for (auto& shard : shards_) {
+    absl::Status status = shard->writer.Close();
+    if (result.ok() && !status.ok()) {
+      result = status;
+    }
+  }
+  return result;
+}
+
+ShardedIndexWriter::Shard& ShardedIndexWriter::SelectShard(
+    absl::string_view content) {
+  return *shards_[ShardNumber(content, shards_.size())];
+}
+
+}  // namespace kythe
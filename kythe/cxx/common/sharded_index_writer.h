@@ -0,0 +1,101 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_COMMON_SHARDED_INDEX_WRITER_H_
+#define KYTHE_CXX_COMMON_SHARDED_INDEX_WRITER_H_
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "kythe/cxx/common/index_writer.h"
+#include "kythe/cxx/common/status_or.h"
+#include "kythe/proto/analysis.pb.h"
+
+namespace kythe {
+
+/// \brief IndexWriter which fans entries across a fixed set of shard
+/// archives by content digest.
+///
+/// Each shard is an independent IndexWriter (typically a KzipWriter) with
+/// its own lock, so concurrent extractor threads writing through one
+/// ShardedIndexWriter only contend when they hash to the same shard; no
+/// single zip central directory or compression stream serializes all
+/// writes. Routing is by digest, so identical content always lands in the
+/// same shard and per-shard deduplication stays effective. Downstream
+/// readers can scan the shard archives in parallel and treat their union
+/// as one index.
+class ShardedIndexWriter : public IndexWriterInterface {
+ public:
+  /// \brief Opens one IndexWriter per shard. Called with the shard number,
+  /// in [0, shards).
+  using ShardFactory = std::function<StatusOr<IndexWriter>(size_t shard)>;
+
+  /// \brief Constructs a ShardedIndexWriter over `shards` kzip archives.
+  /// \param path Path of the archive set; shard `i` is written to `path`
+  /// with "-NNNNN-of-MMMMM" inserted before the extension (e.g.
+  /// "out-00002-of-00008.kzip"). No shard file may currently exist.
+  /// \param shards Number of shard archives; must be positive.
+  static StatusOr<IndexWriter> Create(absl::string_view path, size_t shards);
+
+  /// \brief Constructs a ShardedIndexWriter whose shards are opened by
+  /// `factory`, for shard stores other than the default kzip layout.
+  static StatusOr<IndexWriter> Create(size_t shards,
+                                      const ShardFactory& factory);
+
+  /// \brief Returns the path of shard `shard` of `shards` for `path`, as
+  /// used by Create.
+  static std::string ShardPath(absl::string_view path, size_t shard,
+                               size_t shards);
+
+  /// \brief Writes the unit to the shard selected by its digest.
+  StatusOr<std::string> WriteUnit(
+      const kythe::proto::IndexedCompilation& unit) override;
+
+  /// \brief Writes the file contents to the shard selected by their digest.
+  StatusOr<std::string> WriteFile(absl::string_view content) override;
+
+  /// \brief Closes all shards, returning the first error encountered.
+  /// Close must be called before the ShardedIndexWriter is destroyed!
+  absl::Status Close() override;
+
+ private:
+  /// \brief A shard archive and the lock serializing access to it.
+  struct Shard {
+    explicit Shard(IndexWriter writer) : writer(std::move(writer)) {}
+
+    std::mutex mu;
+    IndexWriter writer;
+  };
+
+  explicit ShardedIndexWriter(
+      std::vector<std::unique_ptr<Shard>> shards)
+      : shards_(std::move(shards)) {}
+
+  /// \brief Returns the shard owning entries with the given content.
+  Shard& SelectShard(absl::string_view content);
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_SHARDED_INDEX_WRITER_H_
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/common/sharded_index_writer.h"
+
+#include <cstdlib>
+#include <set>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "kythe/cxx/common/kzip_reader.h"
+
+namespace kythe {
+namespace {
+
+absl::string_view TestTmpdir() {
+  return absl::StripSuffix(std::getenv("TEST_TMPDIR"), "/");
+}
+
+std::string TestOutputFile(absl::string_view basename) {
+  const auto* test_info = testing::UnitTest::GetInstance()->current_test_info();
+  const auto filename =
+      absl::StrReplaceAll(absl::StrCat(test_info->test_case_name(), "_",
+                                       test_info->name(), "_", basename),
+                          {{"/", "-"}});
+  return absl::StrCat(TestTmpdir(), "/", filename);
+}
+
+TEST(ShardedIndexWriterTest, ShardPathInsertsShardBeforeExtension) {
+  EXPECT_EQ(ShardedIndexWriter::ShardPath("out/index.kzip", 2, 8),
+            "out/index-00002-of-00008.kzip");
+  EXPECT_EQ(ShardedIndexWriter::ShardPath("out.v1/index", 0, 2),
+            "out.v1/index-00000-of-00002");
+}
+
+TEST(ShardedIndexWriterTest, ShardsUnionToOneIndex) {
+  constexpr size_t kShards = 4;
+  const std::string output_file = TestOutputFile("sharded.kzip");
+  auto writer = ShardedIndexWriter::Create(output_file, kShards);
+  ASSERT_TRUE(writer.ok()) << writer.status();
+
+  std::set<std::string> written_files;
+  for (int i = 0; i < 32; ++i) {
+    auto digest = writer->WriteFile(absl::StrCat("contents ", i));
+    ASSERT_TRUE(digest.ok()) << digest.status();
+    written_files.insert(*digest);
+  }
+  std::set<std::string> written_units;
+  for (int i = 0; i < 32; ++i) {
+    kythe::proto::IndexedCompilation unit;
+    unit.mutable_unit()->set_output_key(absl::StrCat("output ", i));
+    auto digest = writer->WriteUnit(unit);
+    ASSERT_TRUE(digest.ok()) << digest.status();
+    written_units.insert(*digest);
+  }
+  // Identical content routes to the same shard and deduplicates there.
+  {
+    auto digest = writer->WriteFile("contents 0");
+    ASSERT_TRUE(digest.ok()) << digest.status();
+    EXPECT_TRUE(written_files.count(*digest));
+  }
+  {
+    auto status = writer->Close();
+    ASSERT_TRUE(status.ok()) << status;
+  }
+
+  // Each entry lives in exactly one shard; the shards' union covers every
+  // written digest.
+  std::set<std::string> read_files, read_units;
+  for (size_t shard = 0; shard < kShards; ++shard) {
+    auto reader = KzipReader::Open(
+        ShardedIndexWriter::ShardPath(output_file, shard, kShards));
+    ASSERT_TRUE(reader.ok()) << reader.status();
+    auto scan = reader->Scan([&](absl::string_view digest) {
+      EXPECT_TRUE(read_units.insert(std::string(digest)).second)
+          << "unit " << digest << " present in multiple shards";
+      auto unit = reader->ReadUnit(digest);
+      EXPECT_TRUE(unit.ok()) << unit.status();
+      return true;
+    });
+    ASSERT_TRUE(scan.ok()) << scan;
+    for (const auto& digest : written_files) {
+      if (reader->ReadFile(digest).ok()) {
+        EXPECT_TRUE(read_files.insert(digest).second)
+            << "file " << digest << " present in multiple shards";
+      }
+    }
+  }
+  EXPECT_EQ(read_files, written_files);
+  EXPECT_EQ(read_units, written_units);
+}
+
+TEST(ShardedIndexWriterTest, RejectsZeroShards) {
+  auto writer = ShardedIndexWriter::Create(TestOutputFile("none.kzip"), 0);
+  EXPECT_FALSE(writer.ok());
+}
+
+}  // namespace
+}  // namespace kythe
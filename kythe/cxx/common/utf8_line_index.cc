@@ -16,6 +16,8 @@
 
 #include "kythe/cxx/common/utf8_line_index.h"
 
+#include <cstdint>
+#include <cstring>
 #include <ostream>
 
 #include "absl/algorithm/container.h"
@@ -23,6 +25,25 @@
 #include "glog/logging.h"
 
 namespace kythe {
+namespace {
+
+constexpr uint64_t kLowBits = 0x0101010101010101ULL;
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+
+// Returns whether any byte of |word| is zero (standard SWAR zero-byte test).
+inline bool HasZeroByte(uint64_t word) {
+  return ((word - kLowBits) & ~word & kHighBits) != 0;
+}
+
+// Returns whether any byte of |word| is a line end ('\n' or '\r') or a
+// non-ASCII byte.  Words without such bytes are runs of one-column ASCII
+// characters and can be indexed without looking at individual bytes.
+inline bool HasLineEndOrNonAscii(uint64_t word) {
+  return (word & kHighBits) != 0 || HasZeroByte(word ^ (kLowBits * '\n')) ||
+         HasZeroByte(word ^ (kLowBits * '\r'));
+}
+
+}  // namespace
 
 std::ostream& operator<<(std::ostream& dest,
                          const CharacterPosition& position) {
@@ -55,14 +76,28 @@ void UTF8LineIndex::IndexContent() {
   line_begin_character_offsets_ = {0};
 
   int character_number = 0;
-  for (int byte_offset = 0; byte_offset < content_.size(); ++byte_offset) {
-    if (IsUTF8ContinuationByte(content_[byte_offset])) continue;
-
-    if (IsUTF8EndOfLineByte(byte_offset, content_)) {
-      line_begin_byte_offsets_.push_back(byte_offset + 1);
-      line_begin_character_offsets_.push_back(character_number + 1);
+  int byte_offset = 0;
+  const int size = static_cast<int>(content_.size());
+  while (byte_offset < size) {
+    // Fast path: consume eight bytes at a time while the word holds only
+    // ASCII bytes that can't end a line; each such byte is one character.
+    if (size - byte_offset >= 8) {
+      uint64_t word;
+      memcpy(&word, content_.data() + byte_offset, sizeof(word));
+      if (!HasLineEndOrNonAscii(word)) {
+        byte_offset += 8;
+        character_number += 8;
+        continue;
+      }
     }
-    ++character_number;
+    if (!IsUTF8ContinuationByte(content_[byte_offset])) {
+      if (IsUTF8EndOfLineByte(byte_offset, content_)) {
+        line_begin_byte_offsets_.push_back(byte_offset + 1);
+        line_begin_character_offsets_.push_back(character_number + 1);
+      }
+      ++character_number;
+    }
+    ++byte_offset;
   }
 }
 
@@ -88,10 +123,20 @@ CharacterPosition UTF8LineIndex::ComputePositionForByteOffset(
     position.line_number = LineNumber(byte_offset);
     auto line_begin_byte_offset =
         line_begin_byte_offsets_[position.line_number - 1];
-    // Count the characters in the line up to (and including) byte_offset.
-    position.column_number = -1;
-    for (int offset = line_begin_byte_offset; offset <= byte_offset; ++offset) {
-      if (!IsUTF8ContinuationByte(content_[offset])) ++position.column_number;
+    if (const LineColumnCache* cache =
+            CachedLineColumns(position.line_number)) {
+      // The column is the index of the character containing byte_offset,
+      // i.e., one less than the number of character starts at or before it.
+      const auto& starts = cache->character_begin_byte_offsets;
+      position.column_number = static_cast<int>(
+          absl::c_upper_bound(starts, byte_offset) - starts.begin() - 1);
+    } else {
+      // Count the characters in the line up to (and including) byte_offset.
+      position.column_number = -1;
+      for (int offset = line_begin_byte_offset; offset <= byte_offset;
+           ++offset) {
+        if (!IsUTF8ContinuationByte(content_[offset])) ++position.column_number;
+      }
     }
     auto line_begin_character_offset =
         line_begin_character_offsets_[position.line_number - 1];
@@ -132,8 +177,42 @@ int UTF8LineIndex::line_size(int line_number) const {
   }
 }
 
+const UTF8LineIndex::LineColumnCache* UTF8LineIndex::CachedLineColumns(
+    int line_number) const {
+  LineColumnCache& cache = line_column_caches_[line_number];
+  if (!cache.built) {
+    if (!cache.queried) {
+      // First query on this line: note it and keep the direct scan.
+      cache.queried = true;
+      return nullptr;
+    }
+    // Second query: record the byte offset of every character start on the
+    // line so this and later queries can binary-search instead of rescanning.
+    const int line_begin = line_begin_byte_offsets_[line_number - 1];
+    const int line_end =
+        line_number < static_cast<int>(line_begin_byte_offsets_.size())
+            ? line_begin_byte_offsets_[line_number]
+            : static_cast<int>(content_.size());
+    for (int offset = line_begin; offset < line_end; ++offset) {
+      if (!IsUTF8ContinuationByte(content_[offset])) {
+        cache.character_begin_byte_offsets.push_back(offset);
+      }
+    }
+    cache.built = true;
+  }
+  return &cache;
+}
+
 int UTF8LineIndex::ComputeByteOffset(int line, int column) const {
   if (line < 1 || line > line_begin_byte_offsets_.size()) return -1;
+  if (column > 0) {
+    if (const LineColumnCache* cache = CachedLineColumns(line)) {
+      const auto& starts = cache->character_begin_byte_offsets;
+      if (column < static_cast<int>(starts.size())) return starts[column];
+      // Columns at or past the end of the line fall through to the walk
+      // below, which handles the past-the-end position.
+    }
+  }
   int byte_offset = line_begin_byte_offsets_[line - 1];
   for (int i = 0; i < column; ++i) {
     // Skip over one character for each column, however many bytes that is.
@@ -21,6 +21,7 @@
 #include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/strings/string_view.h"
 
 namespace kythe {
@@ -68,6 +69,10 @@ std::ostream& operator<<(std::ostream& dest, const CharacterPosition& position);
 // next line starts with the next byte after the line terminator.  In other
 // words, the line terminator for a given line counts as part of that line,
 // not as part of the following line.
+//
+// Column lookups lazily cache per-line character positions (mutating state
+// under const methods), so an index must not be shared between threads
+// without external synchronization.
 class UTF8LineIndex {
  public:
   // Creates a UTF8LineIndex for a file.  The index retains a reference to
@@ -145,6 +150,24 @@ class UTF8LineIndex {
   absl::string_view str() const { return content_; }
 
  private:
+  // A lazily built cache of the character positions on one line.
+  struct LineColumnCache {
+    // Whether the line has been queried at least once.
+    bool queried = false;
+    // Whether character_begin_byte_offsets has been populated.
+    bool built = false;
+    // The byte offset (into the whole file) of the first byte of each
+    // character on the line, in order.
+    std::vector<int> character_begin_byte_offsets;
+  };
+
+  // Returns the column cache for a (1-based) line, or null if the line
+  // hasn't been queried before.  The cache is built on a line's second
+  // query: lines queried once keep the direct scan, while anchor-dense
+  // lines pay for one extra scan and then answer column lookups with a
+  // binary search instead of re-decoding from the line start.
+  const LineColumnCache* CachedLineColumns(int line_number) const;
+
   // Populates the index vectors based on content_.
   void IndexContent();
 
@@ -164,6 +187,10 @@ class UTF8LineIndex {
 
   // Character offsets corresponding to line_end_byte_offsets_.
   std::vector<int> line_begin_character_offsets_;
+
+  // Per-line column caches, keyed by 1-based line number.  \sa
+  // CachedLineColumns.
+  mutable absl::flat_hash_map<int, LineColumnCache> line_column_caches_;
 };
 
 }  // namespace kythe
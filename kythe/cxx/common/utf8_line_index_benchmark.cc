@@ -0,0 +1,93 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks for UTF8LineIndex construction and position lookups.
+
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "kythe/cxx/common/utf8_line_index.h"
+
+namespace kythe {
+namespace {
+
+// Builds a source-file-shaped corpus with the requested number of lines,
+// including some multibyte characters so column computation exercises the
+// UTF-8 decoding path.
+std::string MakeCorpus(int line_count) {
+  std::string content;
+  for (int line = 0; line < line_count; ++line) {
+    absl::StrAppend(&content, "int identifier_", line,
+                    " = 42;  // naïve résumé ümlaut\n");
+  }
+  return content;
+}
+
+void BM_IndexConstruction(benchmark::State& state) {
+  const std::string content = MakeCorpus(state.range(0));
+  for (auto _ : state) {
+    UTF8LineIndex index(content);
+    benchmark::DoNotOptimize(index.line_count());
+  }
+  state.SetBytesProcessed(state.iterations() * content.size());
+}
+BENCHMARK(BM_IndexConstruction)->Range(8, 8 << 10);
+
+void BM_ComputePositionForByteOffset(benchmark::State& state) {
+  const std::string content = MakeCorpus(state.range(0));
+  const UTF8LineIndex index(content);
+  int offset = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index.ComputePositionForByteOffset(offset));
+    offset = (offset + 97) % static_cast<int>(content.size());
+  }
+}
+BENCHMARK(BM_ComputePositionForByteOffset)->Range(8, 8 << 10);
+
+// Anchor-dense case: many column lookups landing on the same line, as when
+// emitting one anchor per reference on a long generated line.  After the
+// second query on a line the index answers from a per-line cache.
+void BM_RepeatedPositionsOnOneLine(benchmark::State& state) {
+  std::string content;
+  for (int i = 0; i < state.range(0); ++i) {
+    absl::StrAppend(&content, "naïve_member_", i, "(); ");
+  }
+  content.push_back('\n');
+  const UTF8LineIndex index(content);
+  int offset = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index.ComputePositionForByteOffset(offset));
+    offset = (offset + 97) % static_cast<int>(content.size());
+  }
+}
+BENCHMARK(BM_RepeatedPositionsOnOneLine)->Range(8, 8 << 10);
+
+void BM_LineNumber(benchmark::State& state) {
+  const std::string content = MakeCorpus(state.range(0));
+  const UTF8LineIndex index(content);
+  int offset = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index.LineNumber(offset));
+    offset = (offset + 97) % static_cast<int>(content.size());
+  }
+}
+BENCHMARK(BM_LineNumber)->Range(8, 8 << 10);
+
+}  // namespace
+}  // namespace kythe
+
+BENCHMARK_MAIN();
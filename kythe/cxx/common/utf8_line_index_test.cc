@@ -135,6 +135,28 @@ TEST(UTF8LineIndexTest, WorksForPlainASCIIFile) {
                                     std::string("your disc").find('c')));
 }
 
+TEST(UTF8LineIndexTest, WorksForLongAsciiLines) {
+  // Lines much longer than the eight-byte fast-path window, with line ends
+  // and multi-byte characters landing at assorted window offsets.
+  std::string content;
+  for (int line = 0; line < 5; ++line) {
+    content.append(std::string(29 + line, 'x'));
+    if (line == 3) content.append("\xC3\xA9");  // e-acute
+    content.append(1, '\n');
+  }
+  UTF8LineIndex index(content);
+  CheckRoundTrips(index);
+  EXPECT_EQ(6, index.line_count());
+  // The first 'x' of line 4 is at column 0.
+  const int line4_begin = index.ComputeByteOffset(4, 0);
+  EXPECT_EQ(4, index.ComputePositionForByteOffset(line4_begin).line_number);
+  EXPECT_EQ(0, index.ComputePositionForByteOffset(line4_begin).column_number);
+  // The e-acute on line 4 occupies one column after 32 'x's.
+  const int accent_offset = static_cast<int>(content.find("\xC3\xA9"));
+  EXPECT_EQ(4, index.ComputePositionForByteOffset(accent_offset).line_number);
+  EXPECT_EQ(32, index.ComputePositionForByteOffset(accent_offset).column_number);
+}
+
 TEST(UTF8LineIndexTest, WorksForFileWithMissingTerminalLineEnd) {
   const std::string ascii_content("Now is the {\nWinter of}\nyour disc");
   UTF8LineIndex index(ascii_content);
@@ -264,6 +286,36 @@ TEST(UTF8LineIndexTest, GetLineFromSmallFile) {
   EXPECT_EQ("", small_index.GetLine(999));
 }
 
+TEST(UTF8LineIndexTest, RepeatedQueriesOnALineAgreeWithTheFirst) {
+  // Repeated queries within one line take a cached path built on the line's
+  // second query; their answers must match the uncached scan byte for byte.
+  const std::string content(
+      "première ligne naïve\n"
+      "deuxième ligne: déjà vu\n"
+      "third line, plain ASCII\n");
+  UTF8LineIndex warm_index(content);
+  for (int pass = 0; pass < 3; ++pass) {
+    for (int byte_offset = 0; byte_offset < content.size(); ++byte_offset) {
+      // A fresh index answers each query exactly once, so it never builds
+      // a line cache.
+      UTF8LineIndex cold_index(content);
+      CharacterPosition cold =
+          cold_index.ComputePositionForByteOffset(byte_offset);
+      CharacterPosition warm =
+          warm_index.ComputePositionForByteOffset(byte_offset);
+      EXPECT_EQ(cold.line_number, warm.line_number)
+          << "at byte offset " << byte_offset << " on pass " << pass;
+      EXPECT_EQ(cold.column_number, warm.column_number)
+          << "at byte offset " << byte_offset << " on pass " << pass;
+      EXPECT_EQ(cold.character_number, warm.character_number)
+          << "at byte offset " << byte_offset << " on pass " << pass;
+      if (IsUTF8ContinuationByte(content[byte_offset])) continue;
+      EXPECT_EQ(byte_offset, warm_index.ComputeByteOffset(warm.line_number,
+                                                          warm.column_number));
+    }
+  }
+}
+
 TEST(UTF8LineIndexTest, ComputeByteOffsetAtEndOfUnterminatedFile) {
   // This is a regression test; migrating from ::string storage to using a
   // string_view means that peeking past the end of the buffer isn't allowed
@@ -274,6 +326,10 @@ TEST(UTF8LineIndexTest, ComputeByteOffsetAtEndOfUnterminatedFile) {
   UTF8LineIndex index(unterminated_file);
   EXPECT_EQ(unterminated_file.length(),
             index.ComputeByteOffset(2, strlen("Goodbye, unterminated world.")));
+  // Ask again: the repeated query answers from the line's column cache, which
+  // must handle the past-the-end column of an unterminated line too.
+  EXPECT_EQ(unterminated_file.length(),
+            index.ComputeByteOffset(2, strlen("Goodbye, unterminated world.")));
 }
 
 }  // anonymous namespace
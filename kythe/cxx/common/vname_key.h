@@ -0,0 +1,88 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef KYTHE_CXX_COMMON_VNAME_KEY_H_
+#define KYTHE_CXX_COMMON_VNAME_KEY_H_
+
+#include <cstdint>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+
+namespace kythe {
+
+/// \brief Buffer for a canonical VName key. Typical keys fit in the inline
+/// capacity, so encoding allocates nothing.
+using VNameKeyBuffer = absl::InlinedVector<char, 128>;
+
+/// \brief Appends `vname`'s identifying components to `buffer` as a
+/// canonical flat binary key.
+///
+/// Each component is preceded by its size as a 32-bit little-endian value,
+/// making the encoding injective for any component contents; two VNames
+/// produce the same key exactly when `VNameEquals` holds. The encoding is
+/// cheaper than proto serialization (no tags, no varints, no heap) and is
+/// the shared key format for claim tables and claim-cache hashing.
+template <typename VName>
+void EncodeVNameKey(const VName& vname, VNameKeyBuffer* buffer) {
+  auto append = [buffer](absl::string_view component) {
+    uint32_t size = component.size();
+    for (int shift = 0; shift < 32; shift += 8) {
+      buffer->push_back(static_cast<char>((size >> shift) & 0xff));
+    }
+    buffer->insert(buffer->end(), component.begin(), component.end());
+  };
+  append(vname.signature());
+  append(vname.corpus());
+  append(vname.root());
+  append(vname.path());
+  append(vname.language());
+}
+
+/// \brief Encodes `vname` into `buffer` (replacing its contents) and returns
+/// a view of the canonical key, valid until `buffer` is next modified.
+template <typename VName>
+absl::string_view VNameKey(const VName& vname, VNameKeyBuffer* buffer) {
+  buffer->clear();
+  EncodeVNameKey(vname, buffer);
+  return absl::string_view(buffer->data(), buffer->size());
+}
+
+/// \brief Returns a 64-bit FNV-1a fingerprint of `vname`'s identifying
+/// fields.
+///
+/// The fingerprint is a stable function of the VName's contents (never of
+/// pointer or process state), so it can be persisted: claim tables written by
+/// one process are probed with fingerprints computed by another.
+template <typename VName>
+uint64_t VNameFingerprint(const VName& vname) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  auto mix = [&hash](absl::string_view field) {
+    for (char c : field) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    hash = (hash ^ 0xff) * 0x100000001b3ULL;  // Field separator.
+  };
+  mix(vname.signature());
+  mix(vname.corpus());
+  mix(vname.root());
+  mix(vname.path());
+  mix(vname.language());
+  return hash;
+}
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_COMMON_VNAME_KEY_H_
@@ -20,7 +20,17 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
@@ -28,6 +38,7 @@
 #include "absl/memory/memory.h"
 #include "absl/strings/str_format.h"
 #include "glog/logging.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/text_format.h"
 #include "kythe/cxx/common/kythe_uri.h"
@@ -52,6 +63,15 @@ ABSL_FLAG(std::string, css, "",
           "Include this stylesheet path in the resulting HTML.");
 ABSL_FLAG(bool, common_signatures, false,
           "Render the MarkedSource proto from standard in.");
+ABSL_FLAG(std::string, ticket_list, "",
+          "Read one node ticket per line from this file ('-' for standard "
+          "input) and render documentation for all of them into one HTML "
+          "document.");
+ABSL_FLAG(int, ticket_batch, 64,
+          "Number of tickets per Documentation request in -ticket_list mode.");
+ABSL_FLAG(bool, proto_requests, false,
+          "Send RPC requests as binary protos instead of JSON. Requires an "
+          "xrefs service that accepts application/x-protobuf bodies.");
 
 namespace kythe {
 namespace {
@@ -69,7 +89,7 @@ constexpr char kDocFooter[] = R"(
 </html>
 )";
 
-int DocumentNodesFrom(const proto::DocumentationReply& doc_reply) {
+void WriteDocHeader() {
   ::fputs(kDocHeaderPrefix, stdout);
   if (!absl::GetFlag(FLAGS_css).empty()) {
     absl::FPrintF(stdout,
@@ -77,12 +97,15 @@ int DocumentNodesFrom(const proto::DocumentationReply& doc_reply) {
                   absl::GetFlag(FLAGS_css));
   }
   ::fputs(kDocHeaderSuffix, stdout);
-  DocumentHtmlRendererOptions options(doc_reply);
-  options.make_link_uri = [](const proto::Anchor& anchor) {
+}
+
+/// \brief Installs the link and kind-name callbacks used by every render.
+void ConfigureRendererOptions(DocumentHtmlRendererOptions* options) {
+  options->make_link_uri = [](const proto::Anchor& anchor) {
     return anchor.parent();
   };
-  options.kind_name = [&options](const std::string& ticket) {
-    if (const auto* node = options.node_info(ticket)) {
+  options->kind_name = [options](const std::string& ticket) {
+    if (const auto* node = options->node_info(ticket)) {
       for (const auto& fact : node->facts()) {
         if (fact.first == kythe::common::schema::kFactNodeKind) {
           return std::string(fact.second);
@@ -91,6 +114,12 @@ int DocumentNodesFrom(const proto::DocumentationReply& doc_reply) {
     }
     return std::string();
   };
+}
+
+/// \brief Renders every documented node in `doc_reply` to stdout.
+void RenderDocumentsFrom(const proto::DocumentationReply& doc_reply) {
+  DocumentHtmlRendererOptions options(doc_reply);
+  ConfigureRendererOptions(&options);
   for (const auto& document : doc_reply.document()) {
     if (document.has_text()) {
       auto html =
@@ -98,10 +127,98 @@ int DocumentNodesFrom(const proto::DocumentationReply& doc_reply) {
       ::fputs(html.c_str(), stdout);
     }
   }
+}
+
+int DocumentNodesFrom(const proto::DocumentationReply& doc_reply) {
+  WriteDocHeader();
+  RenderDocumentsFrom(doc_reply);
   ::fputs(kDocFooter, stdout);
   return 0;
 }
 
+/// \brief Renders documentation for every ticket in `input` (one per line)
+/// into one HTML document on stdout.
+///
+/// A fetch thread batches tickets into Documentation requests and feeds the
+/// replies through a bounded queue, so the next batch is in flight while the
+/// main thread renders the previous one. Each reply is allocated on its own
+/// protobuf arena: the parse in `XrefsJsonClient` then builds the reply tree
+/// on that arena, and retiring a rendered reply is a single arena teardown
+/// instead of a recursive destructor walk over the whole batch.
+int DocumentNodesFromTicketList(XrefsJsonClient* client, std::istream& input) {
+  constexpr size_t kMaxQueuedReplies = 4;
+  using QueuedReply = std::pair<std::unique_ptr<google::protobuf::Arena>,
+                                proto::DocumentationReply*>;
+  std::deque<QueuedReply> queue;
+  std::mutex mu;
+  std::condition_variable reply_ready;
+  std::condition_variable queue_space;
+  bool done = false;
+  bool failed = false;
+  const int batch_size = std::max(1, absl::GetFlag(FLAGS_ticket_batch));
+  std::thread fetcher([&] {
+    std::string line;
+    std::string error;
+    proto::DocumentationRequest request;
+    auto flush = [&] {
+      if (request.ticket_size() == 0) {
+        return true;
+      }
+      auto arena = absl::make_unique<google::protobuf::Arena>();
+      auto* reply =
+          google::protobuf::Arena::CreateMessage<proto::DocumentationReply>(
+              arena.get());
+      if (!client->Documentation(request, reply, &error)) {
+        absl::FPrintF(stderr, "Documentation error: %s\n", error);
+        return false;
+      }
+      request.clear_ticket();
+      std::unique_lock<std::mutex> lock(mu);
+      queue_space.wait(lock, [&] { return queue.size() < kMaxQueuedReplies; });
+      queue.emplace_back(std::move(arena), reply);
+      reply_ready.notify_one();
+      return true;
+    };
+    bool ok = true;
+    while (ok && std::getline(input, line)) {
+      if (line.empty()) {
+        continue;
+      }
+      request.add_ticket(line);
+      if (request.ticket_size() >= batch_size) {
+        ok = flush();
+      }
+    }
+    if (ok) {
+      ok = flush();
+    }
+    std::lock_guard<std::mutex> lock(mu);
+    done = true;
+    failed = !ok;
+    reply_ready.notify_one();
+  });
+  WriteDocHeader();
+  bool had_error = false;
+  for (;;) {
+    QueuedReply reply;
+    {
+      std::unique_lock<std::mutex> lock(mu);
+      reply_ready.wait(lock, [&] { return !queue.empty() || done; });
+      if (queue.empty()) {
+        had_error = failed;
+        break;
+      }
+      reply = std::move(queue.front());
+      queue.pop_front();
+      queue_space.notify_one();
+    }
+    RenderDocumentsFrom(*reply.second);
+  }
+  fetcher.join();
+  ::fputs(kDocFooter, stdout);
+  return had_error ? 1 : 0;
+}
+
 int DocumentNodesFromStdin() {
   proto::DocumentationReply doc_reply;
   google::protobuf::io::FileInputStream file_input_stream(STDIN_FILENO);
@@ -185,16 +302,36 @@ doc
 doc -common_signatures
   Renders the text-format proto::common::MarkedSource message provided on standard
   input into several common forms.
+doc -ticket_list tickets.txt
+  Formats documentation for every node ticket listed in tickets.txt (one per
+  line; pass - to read the list from standard input).
 )");
   absl::ParseCommandLine(argc, argv);
+  const kythe::XrefsTransport transport =
+      absl::GetFlag(FLAGS_proto_requests) ? kythe::XrefsTransport::kProto
+                                          : kythe::XrefsTransport::kJson;
   if (absl::GetFlag(FLAGS_common_signatures)) {
     return kythe::RenderMarkedSourceFromStdin();
+  } else if (!absl::GetFlag(FLAGS_ticket_list).empty()) {
+    kythe::JsonClient::InitNetwork();
+    kythe::XrefsJsonClient client(absl::make_unique<kythe::JsonClient>(),
+                                  absl::GetFlag(FLAGS_xrefs), transport);
+    const std::string list_path = absl::GetFlag(FLAGS_ticket_list);
+    if (list_path == "-") {
+      return kythe::DocumentNodesFromTicketList(&client, std::cin);
+    }
+    std::ifstream input(list_path);
+    if (!input) {
+      absl::FPrintF(stderr, "Couldn't open %s\n", list_path);
+      return 1;
+    }
+    return kythe::DocumentNodesFromTicketList(&client, input);
   } else if (absl::GetFlag(FLAGS_path).empty()) {
     return kythe::DocumentNodesFromStdin();
   } else {
     kythe::JsonClient::InitNetwork();
     kythe::XrefsJsonClient client(absl::make_unique<kythe::JsonClient>(),
-                                  absl::GetFlag(FLAGS_xrefs));
+                                  absl::GetFlag(FLAGS_xrefs), transport);
     auto ticket = kythe::URI::FromString(absl::GetFlag(FLAGS_path));
     if (!ticket.first) {
       ticket = kythe::URI::FromString(
@@ -16,8 +16,14 @@
 
 #include "kythe/cxx/doc/html_renderer.h"
 
+#include <algorithm>
 #include <stack>
+#include <utility>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "kythe/cxx/doc/markup_handler.h"
 
 namespace kythe {
@@ -184,12 +190,18 @@ const char* TagNameForStyle(PrintableSpan::Style style) {
   }
 }
 
-template <typename SourceString>
-void AppendEscapedHtmlString(const SourceString& source, std::string* dest) {
+void AppendEscapedHtmlString(absl::string_view source, std::string* dest) {
   dest->reserve(dest->size() + source.size());
-  for (char c : source) {
-    AppendEscapedHtmlCharacter(dest, c);
+  // Scan for the next character needing an entity and bulk-copy the clean
+  // span before it; most text contains no escapes at all.
+  size_t clean_begin = 0;
+  for (size_t pos = source.find_first_of("<>&"); pos != absl::string_view::npos;
+       pos = source.find_first_of("<>&", clean_begin)) {
+    dest->append(source.data() + clean_begin, pos - clean_begin);
+    AppendEscapedHtmlCharacter(dest, source[pos]);
+    clean_begin = pos + 1;
   }
+  dest->append(source.data() + clean_begin, source.size() - clean_begin);
 }
 
 /// Target buffer for RenderSimpleIdentifier.
@@ -389,6 +401,41 @@ void RenderSimpleParams(const proto::common::MarkedSource& sig,
       break;
   }
 }
+
+/// \brief Renders `sig` with only the given flags set, memoizing the result.
+///
+/// The context-free entry points (`RenderSimpleIdentifier` and
+/// `RenderSimpleQualifiedName`) depend only on the MarkedSource tree and two
+/// flag bits — never on per-document options or link state — so their results
+/// can be shared across every document rendered in one process. The same
+/// nodes (namespaces, enclosing classes, popular types) recur constantly
+/// across related documents, turning most renders into a single lookup. Keys
+/// are a flag tag plus the subtree's deterministic serialization, so hits are
+/// exact rather than probabilistic. Like the rest of the renderer, the cache
+/// is not thread-safe.
+const std::string& RenderSimpleCached(const proto::common::MarkedSource& sig,
+                                      bool render_identifier,
+                                      bool render_context) {
+  static auto* cache = new absl::flat_hash_map<std::string, std::string>();
+  std::string key(1, static_cast<char>((render_identifier ? 1 : 0) |
+                                       (render_context ? 2 : 0)));
+  {
+    google::protobuf::io::StringOutputStream stream(&key);
+    google::protobuf::io::CodedOutputStream coded_stream(&stream);
+    coded_stream.SetSerializationDeterministic(true);
+    sig.SerializeToCodedStream(&coded_stream);
+  }
+  auto it = cache->find(key);
+  if (it == cache->end()) {
+    RenderSimpleIdentifierTarget target;
+    RenderSimpleIdentifierState state;
+    state.render_identifier = render_identifier;
+    state.render_context = render_context;
+    RenderSimpleIdentifier(sig, &target, state, 0);
+    it = cache->emplace(std::move(key), target.buffer()).first;
+  }
+  return it->second;
+}
 }  // anonymous namespace
 
 const proto::common::NodeInfo* DocumentHtmlRendererOptions::node_info(
@@ -420,21 +467,14 @@ std::string RenderSignature(const HtmlRendererOptions& options,
 }
 
 std::string RenderSimpleIdentifier(const proto::common::MarkedSource& sig) {
-  RenderSimpleIdentifierTarget target;
-  RenderSimpleIdentifierState state;
-  state.render_identifier = true;
-  RenderSimpleIdentifier(sig, &target, state, 0);
-  return target.buffer();
+  return RenderSimpleCached(sig, /*render_identifier=*/true,
+                            /*render_context=*/false);
 }
 
 std::string RenderSimpleQualifiedName(const proto::common::MarkedSource& sig,
                                       bool include_identifier) {
-  RenderSimpleIdentifierTarget target;
-  RenderSimpleIdentifierState state;
-  state.render_identifier = include_identifier;
-  state.render_context = true;
-  RenderSimpleIdentifier(sig, &target, state, 0);
-  return target.buffer();
+  return RenderSimpleCached(sig, include_identifier,
+                            /*render_context=*/true);
 }
 
 std::string RenderInitializer(const proto::common::MarkedSource& sig) {
@@ -454,14 +494,9 @@ std::vector<std::string> RenderSimpleParams(
 
 std::string RenderHtml(const HtmlRendererOptions& options,
                        const Printable& printable) {
-  struct OpenSpan {
-    const PrintableSpan* span;
-    bool valid;
-  };
   struct FormatState {
     bool in_pre_block;
   };
-  std::stack<OpenSpan> open_spans;
   // To avoid entering multiple <pre> blocks, we keep track of whether we're
   // currently in a <pre> context. This does not affect escaping, since
   // tags can appear in a <pre>.
@@ -478,148 +513,135 @@ std::string RenderHtml(const HtmlRendererOptions& options,
   // `tag_blocks` (particularly, the one referenced by the top of `open_tags`)
   // if the stack is non-empty.
   TaggedText* out = &main_text;
-  PrintableSpan default_span(0, printable.text().size(),
-                             PrintableSpan::Semantic::Raw);
-  open_spans.push(OpenSpan{&default_span, true});
+  // Whether each currently open Link span emitted an <a> tag (parallel to the
+  // walker's span stack).
+  std::stack<bool> link_valid;
   format_states.push(FormatState{false});
-  size_t current_span = 0;
-  for (size_t i = 0; i <= printable.text().size(); ++i) {
-    // Normalized PrintableSpans have all empty or negative-length spans
-    // dropped.
-    while (!open_spans.empty() && open_spans.top().span->end() == i) {
-      switch (open_spans.top().span->semantic()) {
-        case PrintableSpan::Semantic::TagBlock: {
-          if (!open_tags.empty()) {
-            open_tags.pop();
-          }
-          out = open_tags.empty() ? &main_text : open_tags.top();
-        } break;
-        case PrintableSpan::Semantic::UriLink:
-          out->buffer.append("</a>");
-          break;
-        case PrintableSpan::Semantic::Uri:
-          out->buffer.append("\">");
-          break;
-        case PrintableSpan::Semantic::Link:
-          if (open_spans.top().valid) {
-            out->buffer.append("</a>");
-          }
-          break;
-        case PrintableSpan::Semantic::CodeRef:
-          out->buffer.append("</tt>");
-          break;
-        case PrintableSpan::Semantic::Paragraph:
-          out->buffer.append("</p>");
-          break;
-        case PrintableSpan::Semantic::ListItem:
-          out->buffer.append("</li>");
-          break;
-        case PrintableSpan::Semantic::UnorderedList:
-          out->buffer.append("</ul>");
-          break;
-        case PrintableSpan::Semantic::Styled:
-          out->buffer.append("</");
-          out->buffer.append(TagNameForStyle(open_spans.top().span->style()));
-          out->buffer.append(">");
-          break;
-        case PrintableSpan::Semantic::CodeBlock:
-          if (!format_states.empty()) {
-            format_states.pop();
-            if (!format_states.empty() && !format_states.top().in_pre_block) {
-              out->buffer.append("</pre>");
-            }
-          }
-          break;
-        default:
-          break;
-      }
-      open_spans.pop();
-    }
-    if (open_spans.empty() || i == printable.text().size()) {
-      // default_span is first to enter and last to leave; there also may
-      // be no empty spans.
-      break;
-    }
-    while (current_span < printable.spans().size() &&
-           printable.spans().span(current_span).begin() == i) {
-      open_spans.push({&printable.spans().span(current_span), true});
-      ++current_span;
-      switch (open_spans.top().span->semantic()) {
-        case PrintableSpan::Semantic::TagBlock: {
-          auto block = open_spans.top().span->tag_block();
-          out = &tag_blocks[block];
-          open_tags.push(out);
-        } break;
-        case PrintableSpan::Semantic::UriLink:
-          out->buffer.append("<a ");
-          break;
-        case PrintableSpan::Semantic::Uri:
-          out->buffer.append("href=\"");
-          break;
-        case PrintableSpan::Semantic::Link:
-          open_spans.top().valid = false;  // Invalid until proven otherwise.
-          if (open_spans.top().span->link().definition_size() != 0) {
-            const auto& definition =
-                open_spans.top().span->link().definition(0);
-            if (const auto* def_info = options.node_info(definition)) {
-              if (!def_info->definition().empty()) {
-                if (const auto* def_anchor =
-                        options.anchor_for_ticket(def_info->definition())) {
-                  open_spans.top().valid = true;
-                  out->buffer.append("<a href=\"");
-                  auto link_uri =
-                      options.make_semantic_link_uri(*def_anchor, definition);
-                  if (link_uri.empty()) {
-                    link_uri = options.make_link_uri(*def_anchor);
-                  }
-                  // + 2 for the closing ">.
-                  out->buffer.reserve(out->buffer.size() + link_uri.size() + 2);
-                  for (auto c : link_uri) {
-                    AppendEscapedHtmlCharacter(&out->buffer, c);
+  ForEachPrintableRegion(
+      printable.spans(), printable.text(),
+      [&](const PrintableSpan& span) {
+        switch (span.semantic()) {
+          case PrintableSpan::Semantic::TagBlock: {
+            auto block = span.tag_block();
+            out = &tag_blocks[block];
+            open_tags.push(out);
+          } break;
+          case PrintableSpan::Semantic::UriLink:
+            out->buffer.append("<a ");
+            break;
+          case PrintableSpan::Semantic::Uri:
+            out->buffer.append("href=\"");
+            break;
+          case PrintableSpan::Semantic::Link: {
+            bool valid = false;  // Invalid until proven otherwise.
+            if (span.link().definition_size() != 0) {
+              const auto& definition = span.link().definition(0);
+              if (const auto* def_info = options.node_info(definition)) {
+                if (!def_info->definition().empty()) {
+                  if (const auto* def_anchor =
+                          options.anchor_for_ticket(def_info->definition())) {
+                    valid = true;
+                    out->buffer.append("<a href=\"");
+                    auto link_uri =
+                        options.make_semantic_link_uri(*def_anchor, definition);
+                    if (link_uri.empty()) {
+                      link_uri = options.make_link_uri(*def_anchor);
+                    }
+                    AppendEscapedHtmlString(link_uri, &out->buffer);
+                    out->buffer.append("\">");
                   }
-                  out->buffer.append("\">");
                 }
               }
             }
-          }
-          break;
-        case PrintableSpan::Semantic::CodeRef:
-          out->buffer.append("<tt>");
-          break;
-        case PrintableSpan::Semantic::Paragraph:
-          out->buffer.append("<p>");
-          break;
-        case PrintableSpan::Semantic::ListItem:
-          out->buffer.append("<li>");
-          break;
-        case PrintableSpan::Semantic::UnorderedList:
-          out->buffer.append("<ul>");
-          break;
-        case PrintableSpan::Semantic::Styled:
-          out->buffer.append("<");
-          out->buffer.append(TagNameForStyle(open_spans.top().span->style()));
-          out->buffer.append(">");
-          break;
-        case PrintableSpan::Semantic::CodeBlock:
-          if (!format_states.empty() && !format_states.top().in_pre_block) {
-            out->buffer.append("<pre>");
-          }
-          format_states.push(FormatState{true});
-          break;
-        default:
-          break;
-      }
-    }
-    if (open_spans.top().span->semantic() == PrintableSpan::Semantic::Escaped) {
-      out->buffer.push_back(printable.text()[i]);
-    } else if (open_spans.top().span->semantic() !=
-               PrintableSpan::Semantic::Markup) {
-      char c = printable.text()[i];
-      AppendEscapedHtmlCharacter(&out->buffer, c);
-    }
-  }
+            link_valid.push(valid);
+          } break;
+          case PrintableSpan::Semantic::CodeRef:
+            out->buffer.append("<tt>");
+            break;
+          case PrintableSpan::Semantic::Paragraph:
+            out->buffer.append("<p>");
+            break;
+          case PrintableSpan::Semantic::ListItem:
+            out->buffer.append("<li>");
+            break;
+          case PrintableSpan::Semantic::UnorderedList:
+            out->buffer.append("<ul>");
+            break;
+          case PrintableSpan::Semantic::Styled:
+            out->buffer.append("<");
+            out->buffer.append(TagNameForStyle(span.style()));
+            out->buffer.append(">");
+            break;
+          case PrintableSpan::Semantic::CodeBlock:
+            if (!format_states.empty() && !format_states.top().in_pre_block) {
+              out->buffer.append("<pre>");
+            }
+            format_states.push(FormatState{true});
+            break;
+          default:
+            break;
+        }
+      },
+      [&](const PrintableSpan& span) {
+        switch (span.semantic()) {
+          case PrintableSpan::Semantic::TagBlock: {
+            if (!open_tags.empty()) {
+              open_tags.pop();
+            }
+            out = open_tags.empty() ? &main_text : open_tags.top();
+          } break;
+          case PrintableSpan::Semantic::UriLink:
+            out->buffer.append("</a>");
+            break;
+          case PrintableSpan::Semantic::Uri:
+            out->buffer.append("\">");
+            break;
+          case PrintableSpan::Semantic::Link:
+            if (!link_valid.empty()) {
+              if (link_valid.top()) {
+                out->buffer.append("</a>");
+              }
+              link_valid.pop();
+            }
+            break;
+          case PrintableSpan::Semantic::CodeRef:
+            out->buffer.append("</tt>");
+            break;
+          case PrintableSpan::Semantic::Paragraph:
+            out->buffer.append("</p>");
+            break;
+          case PrintableSpan::Semantic::ListItem:
+            out->buffer.append("</li>");
+            break;
+          case PrintableSpan::Semantic::UnorderedList:
+            out->buffer.append("</ul>");
+            break;
+          case PrintableSpan::Semantic::Styled:
+            out->buffer.append("</");
+            out->buffer.append(TagNameForStyle(span.style()));
+            out->buffer.append(">");
+            break;
+          case PrintableSpan::Semantic::CodeBlock:
+            if (!format_states.empty()) {
+              format_states.pop();
+              if (!format_states.empty() && !format_states.top().in_pre_block) {
+                out->buffer.append("</pre>");
+              }
+            }
+            break;
+          default:
+            break;
+        }
+      },
+      [&](const PrintableSpan& span, absl::string_view run) {
+        if (span.semantic() == PrintableSpan::Semantic::Escaped) {
+          out->buffer.append(run.data(), run.size());
+        } else if (span.semantic() != PrintableSpan::Semantic::Markup) {
+          AppendEscapedHtmlString(run, &out->buffer);
+        }
+      });
   RenderTagBlocks(options, tag_blocks, out);
-  return out->buffer;
+  return std::move(out->buffer);
 }
 
 std::string RenderDocument(
@@ -16,6 +16,9 @@
 
 #include "kythe/cxx/doc/javadoxygen_markup_handler.h"
 
+#include <array>
+#include <cstdint>
+
 #include "glog/logging.h"
 
 // See
@@ -95,19 +98,46 @@ constexpr JavadocTagInfo kJavadocTagList[] = {
     JAVADOC_TAGS(TAG_INFO)
 #undef TAG_INFO
 };
-constexpr size_t kJavadocTagCount =
-    sizeof(kJavadocTagList) / sizeof(JavadocTagInfo);
 constexpr DoxygenTagInfo kDoxygenTagList[] = {
 #define TAG_INFO(n, s, b, tb, i) \
   {string_length(s), s, DoxygenTag::n, b, tb, PrintableSpan::TagBlockId::i},
     DOXYGEN_TAGS(TAG_INFO)
 #undef TAG_INFO
 };
-constexpr size_t kDoxygenTagCount =
-    sizeof(kDoxygenTagList) / sizeof(DoxygenTagInfo);
+/// \brief Builds a table mapping each character to a bitmask of the tags in
+/// `tags` whose names start with it.
+///
+/// Dispatching on the first character after an `@` or `\` sentinel tests only
+/// the (usually zero or one) tags that can possibly match instead of
+/// comparing against the whole table.
+template <typename TagInfo, size_t N>
+std::array<uint32_t, 256> BuildFirstCharIndex(const TagInfo (&tags)[N]) {
+  static_assert(N <= 32, "tag index stores positions in uint32_t masks");
+  std::array<uint32_t, 256> index = {};
+  for (size_t tag = 0; tag < N; ++tag) {
+    index[static_cast<unsigned char>(tags[tag].name[0])] |= 1u << tag;
+  }
+  return index;
+}
+
+const std::array<uint32_t, 256> kJavadocTagIndex =
+    BuildFirstCharIndex(kJavadocTagList);
+const std::array<uint32_t, 256> kDoxygenTagIndex =
+    BuildFirstCharIndex(kDoxygenTagList);
+
+/// \brief Per-comment scan state shared by the parsing routines below.
+struct CommentScan {
+  /// The comment text being parsed.
+  const std::string& text;
+  /// Position of the last `}` in `text`, or npos if there is none. Brace
+  /// matching uses it to fail fast on unclosed `{@tag` blocks instead of
+  /// rescanning the rest of the comment for each of them.
+  size_t last_close_brace;
+};
 
 template <typename TagInfo>
-const TagInfo* ParseTag(const TagInfo* tag_list, size_t tag_count,
+const TagInfo* ParseTag(const TagInfo* tag_list,
+                        const std::array<uint32_t, 256>& first_char_index,
                         const std::string& buffer, size_t delimiter) {
   // Javadoc tags must start at the beginning of a line (modulo leading spaces
   // or an asterisk); otherwise they are treated like normal text. We strip
@@ -124,7 +154,12 @@ const TagInfo* ParseTag(const TagInfo* tag_list, size_t tag_count,
     // Not a Javadoc tag.
     return nullptr;
   }
-  for (size_t tag = 0; tag < tag_count; ++tag) {
+  uint32_t candidates =
+      first_char_index[static_cast<unsigned char>(buffer[delimiter + 1])];
+  for (size_t tag = 0; candidates != 0; ++tag, candidates >>= 1) {
+    if ((candidates & 1) == 0) {
+      continue;
+    }
     const auto& tag_info = tag_list[tag];
     if (tag_info.name_length == tag_end - delimiter - 1 &&
         !memcmp(tag_info.name, &buffer[delimiter + 1], tag_info.name_length)) {
@@ -134,22 +169,23 @@ const TagInfo* ParseTag(const TagInfo* tag_list, size_t tag_count,
   return nullptr;
 }
 
-size_t ParseJavadocBrace(const std::string& buffer, size_t open_brace,
+size_t ParseJavadocBrace(const CommentScan& scan, size_t open_brace,
                          size_t limit, PrintableSpans* out_spans);
 
-size_t EvaluateDoxygenTag(const std::string& buffer, size_t slash, size_t limit,
+size_t EvaluateDoxygenTag(const CommentScan& scan, size_t slash, size_t limit,
                           const DoxygenTagInfo* info,
                           PrintableSpans* out_spans);
 
-size_t ParseJavadocDescription(const std::string& buffer, size_t begin,
+size_t ParseJavadocDescription(const CommentScan& scan, size_t begin,
                                size_t limit, PrintableSpans* out_spans) {
+  const std::string& buffer = scan.text;
   CHECK(limit <= buffer.size());
   bool at_line_start = false;
   for (size_t end = begin; end < limit; ++end) {
     char c = buffer[end];
     switch (c) {
       case '{':
-        end = ParseJavadocBrace(buffer, end, limit, out_spans) - 1;
+        end = ParseJavadocBrace(scan, end, limit, out_spans) - 1;
         at_line_start = false;
         break;
       case '\n':
@@ -188,13 +224,13 @@ size_t ParseJavadocDescription(const std::string& buffer, size_t begin,
   return limit;
 }
 
-size_t EvaluateJavadocTag(const std::string& buffer, size_t at_sign,
+size_t EvaluateJavadocTag(const CommentScan& scan, size_t at_sign,
                           size_t limit, const JavadocTagInfo* info,
                           PrintableSpans* out_spans) {
   size_t content_start = at_sign + info->name_length + 1;
   if (info->is_tag_block) {
     size_t desc_end =
-        ParseJavadocDescription(buffer, content_start, limit, out_spans);
+        ParseJavadocDescription(scan, content_start, limit, out_spans);
     out_spans->Emplace(content_start, desc_end, info->block_id,
                        out_spans->next_tag_block_id(info->block_id));
     return desc_end;
@@ -214,7 +250,7 @@ size_t EvaluateJavadocTag(const std::string& buffer, size_t at_sign,
       //   @param <java-token> desc
       //   @throws java-qualified-name desc
       size_t desc_end =
-          ParseJavadocDescription(buffer, content_start, limit, out_spans);
+          ParseJavadocDescription(scan, content_start, limit, out_spans);
       auto block_id = info->tag == JavadocTag::Param
                           ? PrintableSpan::TagBlockId::Param
                           : PrintableSpan::TagBlockId::Throws;
@@ -227,22 +263,23 @@ size_t EvaluateJavadocTag(const std::string& buffer, size_t at_sign,
   }
 }
 
-size_t ParseDoxygenDescription(const std::string& buffer, size_t begin,
+size_t ParseDoxygenDescription(const CommentScan& scan, size_t begin,
                                size_t limit, PrintableSpans* out_spans) {
+  const std::string& buffer = scan.text;
   CHECK(limit <= buffer.size());
   for (size_t end = begin; end < limit; ++end) {
     char c = buffer[end];
     if (c == '{') {
-      end = ParseJavadocBrace(buffer, end, limit, out_spans) - 1;
+      end = ParseJavadocBrace(scan, end, limit, out_spans) - 1;
     } else if (c == '\\' || c == '@') {
       if (const auto* tag =
-              ParseTag(kDoxygenTagList, kDoxygenTagCount, buffer, end)) {
+              ParseTag(kDoxygenTagList, kDoxygenTagIndex, buffer, end)) {
         if (tag->begins_section) {
           return end;
         }
         out_spans->Emplace(end, end + tag->name_length + 1,
                            PrintableSpan::Semantic::Markup);
-        end = EvaluateDoxygenTag(buffer, end, limit, tag, out_spans) - 1;
+        end = EvaluateDoxygenTag(scan, end, limit, tag, out_spans) - 1;
       }
     } else if (c == '\n') {
       // Scan forward to see if the next line is blank.
@@ -293,7 +330,7 @@ size_t ParseDoxygenWord(const std::string& buffer, size_t begin, size_t limit,
 //   {}: extends to the next blank line or section indicator
 //   []: makes anything optional
 // See <https://www.stack.nl/~dimitri/doxygen/manual/commands.html>
-size_t EvaluateDoxygenTag(const std::string& buffer, size_t slash, size_t limit,
+size_t EvaluateDoxygenTag(const CommentScan& scan, size_t slash, size_t limit,
                           const DoxygenTagInfo* info,
                           PrintableSpans* out_spans) {
   size_t content_start = slash + info->name_length + 1;
@@ -301,7 +338,7 @@ size_t EvaluateDoxygenTag(const std::string& buffer, size_t slash, size_t limit,
   // \returns { description of the return value }
   if (info->is_tag_block) {
     size_t desc_end =
-        ParseDoxygenDescription(buffer, content_start, limit, out_spans);
+        ParseDoxygenDescription(scan, content_start, limit, out_spans);
     out_spans->Emplace(content_start, desc_end, info->block_id,
                        out_spans->next_tag_block_id(info->block_id));
     return desc_end;
@@ -310,7 +347,7 @@ size_t EvaluateDoxygenTag(const std::string& buffer, size_t slash, size_t limit,
     // \brief { brief description }
     case DoxygenTag::Brief: {
       size_t desc_end =
-          ParseDoxygenDescription(buffer, content_start, limit, out_spans);
+          ParseDoxygenDescription(scan, content_start, limit, out_spans);
       out_spans->Emplace(content_start, desc_end,
                          PrintableSpan::Semantic::Brief);
       return desc_end;
@@ -318,7 +355,7 @@ size_t EvaluateDoxygenTag(const std::string& buffer, size_t slash, size_t limit,
     // \c <word>
     case DoxygenTag::C: {
       size_t word_end =
-          ParseDoxygenWord(buffer, content_start, limit, out_spans);
+          ParseDoxygenWord(scan.text, content_start, limit, out_spans);
       out_spans->Emplace(content_start, word_end,
                          PrintableSpan::Semantic::CodeRef);
       return word_end;
@@ -334,8 +371,9 @@ size_t EvaluateDoxygenTag(const std::string& buffer, size_t slash, size_t limit,
 // a tag name. Curlies *do* nest arbitrarily; witness:
 //   {@code {@literal @}Clazz Clasz<R>}
 //   {@code {@link Clazz#Method()}.name}
-size_t ParseJavadocBrace(const std::string& buffer, size_t open_brace,
+size_t ParseJavadocBrace(const CommentScan& scan, size_t open_brace,
                          size_t limit, PrintableSpans* out_spans) {
+  const std::string& buffer = scan.text;
   // Try to find the tag for the brace.
   size_t tag_begin = open_brace + 1;
   for (; tag_begin < limit; ++tag_begin) {
@@ -347,13 +385,19 @@ size_t ParseJavadocBrace(const std::string& buffer, size_t open_brace,
     }
   }
   const auto* tag =
-      ParseTag(kJavadocTagList, kJavadocTagCount, buffer, tag_begin);
+      ParseTag(kJavadocTagList, kJavadocTagIndex, buffer, tag_begin);
   if (tag == nullptr) {
     // Invalid brace block.
     return open_brace + 1;
   }
   // Find the end of this brace block.
   size_t close_brace = tag_begin + tag->name_length + 1;
+  if (scan.last_close_brace == std::string::npos ||
+      scan.last_close_brace < close_brace) {
+    // No closing brace remains anywhere in the comment, so the scan below
+    // could only fail; don't re-walk the tail for every unclosed brace.
+    return open_brace + 1;
+  }
   size_t brace_stack = 1;
   for (; close_brace < limit; ++close_brace) {
     char c = buffer[close_brace];
@@ -373,7 +417,7 @@ size_t ParseJavadocBrace(const std::string& buffer, size_t open_brace,
                      PrintableSpan::Semantic::Markup);
   out_spans->Emplace(close_brace, close_brace + 1,
                      PrintableSpan::Semantic::Markup);
-  EvaluateJavadocTag(buffer, tag_begin, close_brace, tag, out_spans);
+  EvaluateJavadocTag(scan, tag_begin, close_brace, tag, out_spans);
   return close_brace + 1;
 }
 }  // namespace
@@ -381,6 +425,7 @@ size_t ParseJavadocBrace(const std::string& buffer, size_t open_brace,
 void ParseJavadoxygen(const Printable& in_message, const PrintableSpans&,
                       PrintableSpans* out_spans) {
   const auto& text = in_message.text();
+  const CommentScan scan{text, text.find_last_of('}')};
   // Are we at the start of the line (or the equivalent)?
   bool at_line_start = true;
   for (size_t i = 0; i < text.size(); ++i) {
@@ -388,38 +433,38 @@ void ParseJavadoxygen(const Printable& in_message, const PrintableSpans&,
     switch (c) {
       // NB: Escaping in Javadoc means using HTML entities.
       case '{':
-        i = ParseJavadocBrace(text, i, text.size(), out_spans);
+        i = ParseJavadocBrace(scan, i, text.size(), out_spans);
         break;
       case '@':
         if (at_line_start) {
           if (const auto* tag =
-                  ParseTag(kJavadocTagList, kJavadocTagCount, text, i)) {
+                  ParseTag(kJavadocTagList, kJavadocTagIndex, text, i)) {
             out_spans->Emplace(i, i + tag->name_length + 1,
                                PrintableSpan::Semantic::Markup);
-            i = EvaluateJavadocTag(text, i, text.size(), tag, out_spans) - 1;
+            i = EvaluateJavadocTag(scan, i, text.size(), tag, out_spans) - 1;
           } else if (const auto* tag =
-                         ParseTag(kDoxygenTagList, kDoxygenTagCount, text, i)) {
+                         ParseTag(kDoxygenTagList, kDoxygenTagIndex, text, i)) {
             // Fall back to trying to parse as a Doxygen tag.
             out_spans->Emplace(i, i + tag->name_length + 1,
                                PrintableSpan::Semantic::Markup);
-            i = EvaluateDoxygenTag(text, i, text.size(), tag, out_spans) - 1;
+            i = EvaluateDoxygenTag(scan, i, text.size(), tag, out_spans) - 1;
           }
         } else if (const auto* tag =
-                       ParseTag(kDoxygenTagList, kDoxygenTagCount, text, i)) {
+                       ParseTag(kDoxygenTagList, kDoxygenTagIndex, text, i)) {
           // Fall back to trying to parse as a Doxygen tag.
           out_spans->Emplace(i, i + tag->name_length + 1,
                              PrintableSpan::Semantic::Markup);
-          i = EvaluateDoxygenTag(text, i, text.size(), tag, out_spans) - 1;
+          i = EvaluateDoxygenTag(scan, i, text.size(), tag, out_spans) - 1;
         }
         break;
       case '\\':
         // Doxygen tags don't appear to care whether they start at the beginning
         // of a line.
         if (const auto* tag =
-                ParseTag(kDoxygenTagList, kDoxygenTagCount, text, i)) {
+                ParseTag(kDoxygenTagList, kDoxygenTagIndex, text, i)) {
           out_spans->Emplace(i, i + tag->name_length + 1,
                              PrintableSpan::Semantic::Markup);
-          i = EvaluateDoxygenTag(text, i, text.size(), tag, out_spans) - 1;
+          i = EvaluateDoxygenTag(scan, i, text.size(), tag, out_spans) - 1;
         }
         break;
       case '\n':
@@ -130,156 +130,145 @@ Printable HandleMarkup(const std::vector<MarkupHandler>& handlers,
 std::string PrintableSpans::Dump(const std::string& annotated_buffer) const {
   std::string text_out;
   text_out.reserve(annotated_buffer.size());
-  std::stack<const PrintableSpan*> open_spans;
-  PrintableSpan default_span(0, annotated_buffer.size(),
-                             PrintableSpan::Semantic::Raw);
-  open_spans.push(&default_span);
   text_out.append("[");
-  size_t current_span = 0;
-  for (size_t i = 0; i <= annotated_buffer.size(); ++i) {
-    while (!open_spans.empty() && open_spans.top()->end() == i) {
-      text_out.append("]");
-      open_spans.pop();
-    }
-    if (open_spans.empty() || i == annotated_buffer.size()) {
-      // default_span is first to enter and last to leave; there also may
-      // be no empty spans.
-      break;
-    }
-    while (current_span < spans_.size() && spans_[current_span].begin() == i) {
-      open_spans.push(&spans_[current_span++]);
-      switch (open_spans.top()->semantic()) {
-        case PrintableSpan::Semantic::Uri:
-          text_out.append("[uri ");
-          break;
-        case PrintableSpan::Semantic::Escaped:
-          text_out.append("[esc ");
-          break;
-        case PrintableSpan::Semantic::Styled: {
-          text_out.append("[s");
-          switch (open_spans.top()->style()) {
-            case PrintableSpan::Style::Bold:
-              text_out.append("B ");
-              break;
-            case PrintableSpan::Style::Italic:
-              text_out.append("I ");
-              break;
-            case PrintableSpan::Style::H1:
-              text_out.append("H1 ");
-              break;
-            case PrintableSpan::Style::H2:
-              text_out.append("H2 ");
-              break;
-            case PrintableSpan::Style::H3:
-              text_out.append("H3 ");
-              break;
-            case PrintableSpan::Style::H4:
-              text_out.append("H4 ");
-              break;
-            case PrintableSpan::Style::H5:
-              text_out.append("H5 ");
-              break;
-            case PrintableSpan::Style::H6:
-              text_out.append("H6 ");
-              break;
-            case PrintableSpan::Style::Big:
-              text_out.append("BIG ");
-              break;
-            case PrintableSpan::Style::Small:
-              text_out.append("SMALL ");
-              break;
-            case PrintableSpan::Style::Blockquote:
-              text_out.append("BQ ");
-              break;
-            case PrintableSpan::Style::Superscript:
-              text_out.append("SUP ");
-              break;
-            case PrintableSpan::Style::Subscript:
-              text_out.append("SUB ");
-              break;
-            case PrintableSpan::Style::Underline:
-              text_out.append("UL ");
-              break;
-          }
-        } break;
-        case PrintableSpan::Semantic::Link: {
-          text_out.append("[link");
-          switch (open_spans.top()->link().kind()) {
-            case proto::common::Link::DEFINITION:
-              text_out.append("D ");
-              break;
-            case proto::common::Link::LIST:
-              text_out.append("L ");
-              break;
-            case proto::common::Link::LIST_ITEM:
-              text_out.append("E ");
-              break;
-            case proto::common::Link::IMPORTANT:
-              text_out.append("I ");
-              break;
-            default:
-              text_out.append("? ");
-          }
-        } break;
-        case PrintableSpan::Semantic::CodeRef:
-          text_out.append("[coderef ");
-          break;
-        case PrintableSpan::Semantic::Paragraph:
-          text_out.append("[p ");
-          break;
-        case PrintableSpan::Semantic::ListItem:
-          text_out.append("[li ");
-          break;
-        case PrintableSpan::Semantic::UnorderedList:
-          text_out.append("[ul ");
-          break;
-        case PrintableSpan::Semantic::Raw:
-          text_out.append("[raw ");
-          break;
-        case PrintableSpan::Semantic::Brief:
-          text_out.append("[brief ");
-          break;
-        case PrintableSpan::Semantic::Markup:
-          text_out.append("[^ ");
-          break;
-        case PrintableSpan::Semantic::CodeBlock:
-          text_out.append("[cb ");
-          break;
-        case PrintableSpan::Semantic::UriLink:
-          text_out.append("[uril ");
-          break;
-        case PrintableSpan::Semantic::TagBlock: {
-          text_out.append("[tb");
-          switch (open_spans.top()->tag_block().first) {
-            case PrintableSpan::TagBlockId::Author:
-              text_out.append("Author");
-              break;
-            case PrintableSpan::TagBlockId::Returns:
-              text_out.append("Returns");
-              break;
-            case PrintableSpan::TagBlockId::Since:
-              text_out.append("Since");
-              break;
-            case PrintableSpan::TagBlockId::Version:
-              text_out.append("Version");
-              break;
-            case PrintableSpan::TagBlockId::Param:
-              text_out.append("Param");
-              break;
-            case PrintableSpan::TagBlockId::Throws:
-              text_out.append("Throws");
-              break;
-            case PrintableSpan::TagBlockId::See:
-              text_out.append("See");
-              break;
-          }
-          text_out.append(std::to_string(open_spans.top()->tag_block().second));
-          text_out.append(" ");
-        } break;
-      }
-    }
-    text_out.push_back(annotated_buffer[i]);
-  }
+  ForEachPrintableRegion(
+      *this, annotated_buffer,
+      [&](const PrintableSpan& span) {
+        switch (span.semantic()) {
+          case PrintableSpan::Semantic::Uri:
+            text_out.append("[uri ");
+            break;
+          case PrintableSpan::Semantic::Escaped:
+            text_out.append("[esc ");
+            break;
+          case PrintableSpan::Semantic::Styled: {
+            text_out.append("[s");
+            switch (span.style()) {
+              case PrintableSpan::Style::Bold:
+                text_out.append("B ");
+                break;
+              case PrintableSpan::Style::Italic:
+                text_out.append("I ");
+                break;
+              case PrintableSpan::Style::H1:
+                text_out.append("H1 ");
+                break;
+              case PrintableSpan::Style::H2:
+                text_out.append("H2 ");
+                break;
+              case PrintableSpan::Style::H3:
+                text_out.append("H3 ");
+                break;
+              case PrintableSpan::Style::H4:
+                text_out.append("H4 ");
+                break;
+              case PrintableSpan::Style::H5:
+                text_out.append("H5 ");
+                break;
+              case PrintableSpan::Style::H6:
+                text_out.append("H6 ");
+                break;
+              case PrintableSpan::Style::Big:
+                text_out.append("BIG ");
+                break;
+              case PrintableSpan::Style::Small:
+                text_out.append("SMALL ");
+                break;
+              case PrintableSpan::Style::Blockquote:
+                text_out.append("BQ ");
+                break;
+              case PrintableSpan::Style::Superscript:
+                text_out.append("SUP ");
+                break;
+              case PrintableSpan::Style::Subscript:
+                text_out.append("SUB ");
+                break;
+              case PrintableSpan::Style::Underline:
+                text_out.append("UL ");
+                break;
+            }
+          } break;
+          case PrintableSpan::Semantic::Link: {
+            text_out.append("[link");
+            switch (span.link().kind()) {
+              case proto::common::Link::DEFINITION:
+                text_out.append("D ");
+                break;
+              case proto::common::Link::LIST:
+                text_out.append("L ");
+                break;
+              case proto::common::Link::LIST_ITEM:
+                text_out.append("E ");
+                break;
+              case proto::common::Link::IMPORTANT:
+                text_out.append("I ");
+                break;
+              default:
+                text_out.append("? ");
+            }
+          } break;
+          case PrintableSpan::Semantic::CodeRef:
+            text_out.append("[coderef ");
+            break;
+          case PrintableSpan::Semantic::Paragraph:
+            text_out.append("[p ");
+            break;
+          case PrintableSpan::Semantic::ListItem:
+            text_out.append("[li ");
+            break;
+          case PrintableSpan::Semantic::UnorderedList:
+            text_out.append("[ul ");
+            break;
+          case PrintableSpan::Semantic::Raw:
+            text_out.append("[raw ");
+            break;
+          case PrintableSpan::Semantic::Brief:
+            text_out.append("[brief ");
+            break;
+          case PrintableSpan::Semantic::Markup:
+            text_out.append("[^ ");
+            break;
+          case PrintableSpan::Semantic::CodeBlock:
+            text_out.append("[cb ");
+            break;
+          case PrintableSpan::Semantic::UriLink:
+            text_out.append("[uril ");
+            break;
+          case PrintableSpan::Semantic::TagBlock: {
+            text_out.append("[tb");
+            switch (span.tag_block().first) {
+              case PrintableSpan::TagBlockId::Author:
+                text_out.append("Author");
+                break;
+              case PrintableSpan::TagBlockId::Returns:
+                text_out.append("Returns");
+                break;
+              case PrintableSpan::TagBlockId::Since:
+                text_out.append("Since");
+                break;
+              case PrintableSpan::TagBlockId::Version:
+                text_out.append("Version");
+                break;
+              case PrintableSpan::TagBlockId::Param:
+                text_out.append("Param");
+                break;
+              case PrintableSpan::TagBlockId::Throws:
+                text_out.append("Throws");
+                break;
+              case PrintableSpan::TagBlockId::See:
+                text_out.append("See");
+                break;
+            }
+            text_out.append(std::to_string(span.tag_block().second));
+            text_out.append(" ");
+          } break;
+        }
+      },
+      [&](const PrintableSpan& span) { text_out.append("]"); },
+      [&](const PrintableSpan& span, absl::string_view run) {
+        text_out.append(run.data(), run.size());
+      });
+  text_out.append("]");
   return text_out;
 }
 }  // namespace kythe
@@ -17,8 +17,11 @@
 #ifndef KYTHE_CXX_DOC_MARKUP_HANDLER_H_
 #define KYTHE_CXX_DOC_MARKUP_HANDLER_H_
 
+#include <algorithm>
 #include <functional>
+#include <stack>
 
+#include "absl/strings/string_view.h"
 #include "kythe/proto/common.pb.h"
 #include "kythe/proto/xref.pb.h"
 
@@ -139,6 +142,52 @@ class PrintableSpans {
   std::map<PrintableSpan::TagBlockId, size_t> max_tag_block_;
 };
 
+/// \brief Sweeps `spans` across `text` in one pass, firing events in document
+/// order.
+///
+/// `spans` must be sorted by begin offset (as produced by `HandleMarkup`) and
+/// properly nested. `open_span(span)` fires when a span begins and
+/// `close_span(span)` when it ends; `emit_text(span, run)` fires for each
+/// maximal run of characters with no span boundary inside it, where `span` is
+/// the innermost open span governing the run. A synthetic Raw span covering
+/// all of `text` sits at the bottom of the stack so `emit_text` always has a
+/// governing span; `open_span` and `close_span` do not fire for it.
+template <typename OpenSpanFn, typename CloseSpanFn, typename EmitTextFn>
+void ForEachPrintableRegion(const PrintableSpans& spans, absl::string_view text,
+                            OpenSpanFn&& open_span, CloseSpanFn&& close_span,
+                            EmitTextFn&& emit_text) {
+  std::stack<const PrintableSpan*> open;
+  PrintableSpan default_span(0, text.size(), PrintableSpan::Semantic::Raw);
+  open.push(&default_span);
+  size_t current = 0;
+  for (size_t i = 0; i <= text.size(); ++i) {
+    while (!open.empty() && open.top()->end() == i) {
+      if (open.top() != &default_span) {
+        close_span(*open.top());
+      }
+      open.pop();
+    }
+    if (open.empty() || i == text.size()) {
+      // default_span is first to enter and last to leave; there also may
+      // be no empty spans.
+      break;
+    }
+    while (current < spans.size() && spans.span(current).begin() == i) {
+      open.push(&spans.span(current++));
+      open_span(*open.top());
+    }
+    size_t run_end = std::min(open.top()->end(), text.size());
+    if (current < spans.size()) {
+      run_end = std::min(run_end, spans.span(current).begin());
+    }
+    if (run_end <= i) {
+      run_end = i + 1;
+    }
+    emit_text(*open.top(), text.substr(i, run_end - i));
+    i = run_end - 1;
+  }
+}
+
 class Printable {
  public:
   /// A policy bitmask for filtering spans.
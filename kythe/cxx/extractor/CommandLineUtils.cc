@@ -24,6 +24,7 @@
 #include <algorithm>
 #include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/strings/str_format.h"
@@ -68,6 +69,71 @@ class FullMatchRegex {
 
 }  // anonymous namespace
 
+ArgvPipeline& ArgvPipeline::Drop(Predicate predicate) {
+  rules_.push_back({Rule::kDrop, std::move(predicate), ""});
+  return *this;
+}
+
+ArgvPipeline& ArgvPipeline::DropWithFollower(Predicate predicate) {
+  rules_.push_back({Rule::kDropWithFollower, std::move(predicate), ""});
+  return *this;
+}
+
+ArgvPipeline& ArgvPipeline::StripPrefix(std::string prefix) {
+  rules_.push_back({Rule::kStripPrefix, Predicate(), std::move(prefix)});
+  return *this;
+}
+
+ArgvPipeline& ArgvPipeline::Append(std::string arg) {
+  appends_.push_back(std::move(arg));
+  return *this;
+}
+
+std::vector<std::string> ArgvPipeline::Apply(
+    const std::vector<std::string>& input) const {
+  std::vector<std::string> output;
+  output.reserve(input.size() + appends_.size());
+  // Per-rule state for kDropWithFollower: whether the rule still owes a
+  // follower drop. Tracking this per rule makes each stage behave as if it
+  // consumed the output stream of the stage before it.
+  std::vector<bool> skip_next(rules_.size(), false);
+  for (const auto& arg : input) {
+    const std::string* current = &arg;
+    std::string rewritten;
+    bool dropped = false;
+    for (size_t i = 0; i < rules_.size() && !dropped; ++i) {
+      const Rule& rule = rules_[i];
+      switch (rule.kind) {
+        case Rule::kDrop:
+          dropped = rule.predicate(*current);
+          break;
+        case Rule::kDropWithFollower:
+          if (skip_next[i]) {
+            skip_next[i] = false;
+            dropped = true;
+          } else if (rule.predicate(*current)) {
+            skip_next[i] = true;
+            dropped = true;
+          }
+          break;
+        case Rule::kStripPrefix:
+          if (current->compare(0, rule.prefix.size(), rule.prefix) == 0) {
+            rewritten = current->substr(rule.prefix.size());
+            current = &rewritten;
+          }
+          break;
+      }
+    }
+    if (!dropped) {
+      output.push_back(*current);
+    }
+  }
+  for (const auto& arg : appends_) {
+    output.push_back(arg);
+  }
+  return output;
+}
+
 // Decide what will the driver do based on the inputs found on the command
 // line.
 DriverAction DetermineDriverAction(const std::vector<std::string>& args) {
@@ -160,27 +226,20 @@ static std::vector<std::string> CopyOmittingMatchesAndFollowers(
   return output;
 }
 
-// Returns a copy of the input vector with the supplied prefix string removed
-// from any element of which it was a prefix.
-static std::vector<std::string> StripPrefix(
-    const std::string& prefix, const std::vector<std::string>& input) {
-  std::vector<std::string> output;
-  const size_t prefix_size = prefix.size();
-  for (const auto& arg : input) {
-    if (arg.compare(0, prefix_size, prefix) == 0) {
-      output.push_back(arg.substr(prefix_size));
-    } else {
-      output.push_back(arg);
-    }
-  }
-  return output;
+namespace {
+
+// Returns a pipeline predicate which is a full match of `re`. The regex must
+// outlive any pipeline the predicate is registered on.
+ArgvPipeline::Predicate Matches(const FullMatchRegex& re) {
+  return [&re](const std::string& arg) { return re.FullMatch(arg); };
 }
 
-std::vector<std::string> GCCArgsToClangArgs(
-    const std::vector<std::string>& gcc_args) {
+// Registers on `pipeline` the rules that drop GCC args Clang doesn't
+// understand and that unwrap -Xclang-only= args.
+ArgvPipeline& AddGCCToClangRules(ArgvPipeline& pipeline) {
   // These are GCC-specific arguments which Clang does not yet understand or
   // support without issuing ugly warnings, and cannot otherwise be suppressed.
-  const FullMatchRegex unsupported_args_re(
+  static const FullMatchRegex unsupported_args_re(
       "-W(no-)?(error=)?coverage-mismatch"
       "|-W(no-)?(error=)?frame-larger-than.*"
       "|-W(no-)?(error=)?maybe-uninitialized"
@@ -238,29 +297,19 @@ std::vector<std::string> GCCArgsToClangArgs(
                    // but figure out what to do to make this work properly.
       "|-mapcs-frame"
       "|-pass-exit-codes");
-  const FullMatchRegex unsupported_args_with_values_re("-wrapper");
+  static const FullMatchRegex unsupported_args_with_values_re("-wrapper");
 
-  return StripPrefix("-Xclang-only=",
-                     CopyOmittingMatchesAndFollowers(
-                         unsupported_args_with_values_re,
-                         CopyOmittingMatches(unsupported_args_re, gcc_args)));
+  return pipeline.Drop(Matches(unsupported_args_re))
+      .DropWithFollower(Matches(unsupported_args_with_values_re))
+      .StripPrefix("-Xclang-only=");
 }
 
-std::vector<std::string> GCCArgsToClangSyntaxOnlyArgs(
-    const std::vector<std::string>& gcc_args) {
-  return AdjustClangArgsForSyntaxOnly(GCCArgsToClangArgs(gcc_args));
-}
-
-std::vector<std::string> GCCArgsToClangAnalyzeArgs(
-    const std::vector<std::string>& gcc_args) {
-  return AdjustClangArgsForAnalyze(GCCArgsToClangArgs(gcc_args));
-}
-
-std::vector<std::string> AdjustClangArgsForSyntaxOnly(
-    const std::vector<std::string>& clang_args) {
+// Registers on `pipeline` the rules that drop args inapplicable to
+// '-fsyntax-only' behavior and append exactly one -fsyntax-only flag.
+ArgvPipeline& AddSyntaxOnlyRules(ArgvPipeline& pipeline) {
   // These are arguments which are inapplicable to '-fsyntax-only' behavior, but
   // are applicable to regular compilation.
-  const FullMatchRegex inapplicable_args_re(
+  static const FullMatchRegex inapplicable_args_re(
       "--analyze"
       "|-CC?"
       "|-E"
@@ -283,14 +332,39 @@ std::vector<std::string> AdjustClangArgsForSyntaxOnly(
       "|-nostartfiles"
       "|-s"
       "|-shared");
-  const FullMatchRegex inapplicable_args_with_values_re("-M[FTQ]");
+  static const FullMatchRegex inapplicable_args_with_values_re("-M[FTQ]");
 
-  std::vector<std::string> result = CopyOmittingMatchesAndFollowers(
-      inapplicable_args_with_values_re,
-      CopyOmittingMatches(inapplicable_args_re, clang_args));
-  result.push_back("-fsyntax-only");
+  return pipeline.Drop(Matches(inapplicable_args_re))
+      .DropWithFollower(Matches(inapplicable_args_with_values_re))
+      .Append("-fsyntax-only");
+}
 
-  return result;
+}  // anonymous namespace
+
+std::vector<std::string> GCCArgsToClangArgs(
+    const std::vector<std::string>& gcc_args) {
+  ArgvPipeline pipeline;
+  return AddGCCToClangRules(pipeline).Apply(gcc_args);
+}
+
+std::vector<std::string> GCCArgsToClangSyntaxOnlyArgs(
+    const std::vector<std::string>& gcc_args) {
+  // Both conversions run as stages of one pipeline, so the argument vector is
+  // swept once with no intermediate materialization.
+  ArgvPipeline pipeline;
+  AddGCCToClangRules(pipeline);
+  return AddSyntaxOnlyRules(pipeline).Apply(gcc_args);
+}
+
+std::vector<std::string> GCCArgsToClangAnalyzeArgs(
+    const std::vector<std::string>& gcc_args) {
+  return AdjustClangArgsForAnalyze(GCCArgsToClangArgs(gcc_args));
+}
+
+std::vector<std::string> AdjustClangArgsForSyntaxOnly(
+    const std::vector<std::string>& clang_args) {
+  ArgvPipeline pipeline;
+  return AddSyntaxOnlyRules(pipeline).Apply(clang_args);
 }
 
 std::vector<std::string> AdjustClangArgsForAnalyze(
@@ -43,6 +43,7 @@
 #ifndef LLVM_CLANG_LIB_DRIVER_COMMANDLINE_UTILS_H
 #define LLVM_CLANG_LIB_DRIVER_COMMANDLINE_UTILS_H
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -55,6 +56,45 @@ namespace common {
 bool HasCxxInputInCommandLineOrArgs(
     const std::vector<std::string>& command_line_or_args);
 
+// A composable argument-vector transformer applied in a single pass.
+//
+// Rules are registered up front and behave as a pipeline of stages: each
+// input argument flows through the rules in registration order, so the
+// result is identical to chaining the corresponding whole-vector
+// transformations, but the input is swept exactly once and only the
+// surviving arguments are materialized.
+class ArgvPipeline {
+ public:
+  using Predicate = std::function<bool(const std::string& arg)>;
+
+  // Drops every argument for which `predicate` returns true.
+  ArgvPipeline& Drop(Predicate predicate);
+
+  // Drops every argument for which `predicate` returns true along with the
+  // argument that follows it (as seen by this stage; arguments dropped by
+  // earlier rules are never counted as followers).
+  ArgvPipeline& DropWithFollower(Predicate predicate);
+
+  // Removes `prefix` from any argument of which it is a prefix.
+  ArgvPipeline& StripPrefix(std::string prefix);
+
+  // Appends `arg` to the result after the whole input has been processed.
+  ArgvPipeline& Append(std::string arg);
+
+  // Runs the pipeline over `input` in one sweep and returns the result.
+  std::vector<std::string> Apply(const std::vector<std::string>& input) const;
+
+ private:
+  struct Rule {
+    enum Kind { kDrop, kDropWithFollower, kStripPrefix } kind;
+    Predicate predicate;
+    std::string prefix;
+  };
+
+  std::vector<Rule> rules_;
+  std::vector<std::string> appends_;
+};
+
 // Converts GCC's arguments to Clang's arguments by dropping GCC args that
 // Clang doesn't understand.
 std::vector<std::string> GCCArgsToClangArgs(
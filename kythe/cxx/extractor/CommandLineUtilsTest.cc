@@ -61,6 +61,34 @@ TEST(HasCxxInputInCommandLineOrArgs, BadInputs) {
       HasCxxInputInCommandLineOrArgs({"base/timestamp.cc", "-Wl,@foo"}));
 }
 
+using ::kythe::common::AdjustClangArgsForSyntaxOnly;
+using ::kythe::common::ArgvPipeline;
+using ::kythe::common::GCCArgsToClangArgs;
+using ::kythe::common::GCCArgsToClangSyntaxOnlyArgs;
+
+TEST(ArgvPipeline, RulesBehaveAsChainedStages) {
+  ArgvPipeline pipeline;
+  pipeline.Drop([](const std::string& arg) { return arg == "-fgcse"; })
+      .DropWithFollower([](const std::string& arg) { return arg == "-wrapper"; })
+      .StripPrefix("-Xclang-only=")
+      .Append("-fsyntax-only");
+  // The follower of -wrapper is the next argument surviving the earlier
+  // rules, so -fgcse does not absorb the follower drop.
+  EXPECT_EQ((std::vector<std::string>{"a.cc", "-fsyntax-only"}),
+            pipeline.Apply({"-wrapper", "-fgcse", "ld", "a.cc"}));
+  EXPECT_EQ((std::vector<std::string>{"-O2", "-fsyntax-only"}),
+            pipeline.Apply({"-Xclang-only=-O2"}));
+}
+
+TEST(ArgvPipeline, SyntaxOnlyPipelineMatchesChainedTransforms) {
+  const std::vector<std::string> args = {
+      "-c",       "a.cc",     "-fgcse", "-Xclang-only=-fno-ident",
+      "-wrapper", "gdb",      "-MF",    "a.d",
+      "-g2",      "--param=x"};
+  EXPECT_EQ(AdjustClangArgsForSyntaxOnly(GCCArgsToClangArgs(args)),
+            GCCArgsToClangSyntaxOnlyArgs(args));
+}
+
 // TODO(zarko): Port additional tests.
 
 }  // namespace
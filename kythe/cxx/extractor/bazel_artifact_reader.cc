@@ -86,6 +86,60 @@ std::vector<ArtifactSelector> BazelArtifactReader::DefaultSelectors() {
   return {ExtraActionSelector{}};
 }
 
+PipelinedBazelArtifactReader::PipelinedBazelArtifactReader(
+    BazelEventReaderInterface* event_reader,
+    std::vector<ArtifactSelector> selectors, size_t capacity)
+    : event_reader_(CHECK_NOTNULL(event_reader)),
+      selectors_(std::move(selectors)),
+      capacity_(capacity == 0 ? 1 : capacity),
+      producer_(&PipelinedBazelArtifactReader::Produce, this) {
+  Fetch();
+}
+
+PipelinedBazelArtifactReader::~PipelinedBazelArtifactReader() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    cancelled_ = true;
+  }
+  space_.notify_all();
+  producer_.join();
+}
+
+void PipelinedBazelArtifactReader::Next() {
+  if (Done()) return;
+  Fetch();
+}
+
+void PipelinedBazelArtifactReader::Produce() {
+  // Decoding and selection both happen here; selection is cheap relative to
+  // decoding, so they share the thread.
+  BazelArtifactReader reader(event_reader_, std::move(selectors_));
+  for (; !reader.Done(); reader.Next()) {
+    std::unique_lock<std::mutex> lock(mu_);
+    space_.wait(lock,
+                [this] { return cancelled_ || queue_.size() < capacity_; });
+    if (cancelled_) return;
+    queue_.push_back(std::move(reader.Ref()));
+    ready_.notify_one();
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  final_status_ = reader.status();
+  finished_ = true;
+  ready_.notify_one();
+}
+
+void PipelinedBazelArtifactReader::Fetch() {
+  std::unique_lock<std::mutex> lock(mu_);
+  ready_.wait(lock, [this] { return finished_ || !queue_.empty(); });
+  if (queue_.empty()) {
+    value_ = final_status_;
+  } else {
+    value_ = std::move(queue_.front());
+    queue_.pop_front();
+    space_.notify_one();
+  }
+}
+
 bool ExtraActionSelector::operator()(
     const build_event_stream::BuildEvent& event, BazelArtifact* result) const {
   if (event.id().has_action_completed() && event.action().success() &&
@@ -16,8 +16,13 @@
 #ifndef KYTHE_CXX_EXTRACTOR_BAZEL_ARTIFACT_READER_H_
 #define KYTHE_CXX_EXTRACTOR_BAZEL_ARTIFACT_READER_H_
 
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
 #include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
@@ -85,6 +90,60 @@ class BazelArtifactReader {
   std::vector<ArtifactSelector> selectors_;
 };
 
+/// \brief A BazelArtifactReader-compatible iterator which decodes and filters
+/// build events on a background thread.
+///
+/// Event decoding and artifact selection run ahead of the consumer, queuing up
+/// to `capacity` selected artifacts, so fetching and processing the referenced
+/// artifact URIs overlaps with reading the (potentially very large) build
+/// event stream.
+class PipelinedBazelArtifactReader {
+ public:
+  using value_type = BazelArtifact;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+
+  explicit PipelinedBazelArtifactReader(
+      BazelEventReaderInterface* event_reader,
+      std::vector<ArtifactSelector> selectors =
+          BazelArtifactReader::DefaultSelectors(),
+      size_t capacity = 64);
+  /// \brief Stops the producer thread, discarding any unconsumed artifacts.
+  ~PipelinedBazelArtifactReader();
+
+  // Neither copyable nor movable; the producer thread retains `this`.
+  PipelinedBazelArtifactReader(const PipelinedBazelArtifactReader&) = delete;
+  PipelinedBazelArtifactReader& operator=(const PipelinedBazelArtifactReader&) =
+      delete;
+
+  void Next();
+
+  bool Done() const { return value_.index() != 0; }
+  reference Ref() { return absl::get<value_type>(value_); }
+  const_reference Ref() const { return absl::get<value_type>(value_); }
+  absl::Status status() const { return absl::get<absl::Status>(value_); }
+
+ private:
+  /// \brief Producer-thread main loop; decodes, filters, and enqueues.
+  void Produce();
+  /// \brief Pops the next artifact (or the final status) into `value_`.
+  void Fetch();
+
+  absl::variant<value_type, absl::Status> value_;
+  BazelEventReaderInterface* event_reader_;
+  std::vector<ArtifactSelector> selectors_;  // Consumed by the producer.
+  size_t capacity_;
+
+  std::mutex mu_;
+  std::condition_variable ready_;
+  std::condition_variable space_;
+  std::deque<value_type> queue_;
+  bool finished_ = false;
+  bool cancelled_ = false;
+  absl::Status final_status_;
+  std::thread producer_;
+};
+
 /// \brief An ArtifactSelector which selects artifacts emitted by extra
 /// actions.
 ///
@@ -84,5 +84,46 @@ TEST(BazelArtifactReaderTest, ReadsExpectedArtifacts) {
                                                     "file:///dummy/4.kzip")))));
 }
 
+TEST(PipelinedBazelArtifactReaderTest, ReadsExpectedArtifacts) {
+  static constexpr int kArtifactCount = 5;
+  std::stringstream stream;
+  for (int i = 0; i < kArtifactCount; i++) {
+    build_event_stream::BuildEvent event;
+    auto* id = event.mutable_id()->mutable_action_completed();
+    id->set_primary_output("local/path/to/file.kzip");
+    id->set_label(absl::StrCat("//id/label:", i));
+    auto* payload = event.mutable_action();
+    payload->set_success(true);
+    payload->set_type("extra_action");
+    payload->mutable_primary_output()->set_uri(
+        absl::StrCat("file:///dummy/", i, ".kzip"));
+    ASSERT_TRUE(SerializeDelimitedToOstream(event, &stream));
+  }
+
+  IstreamInputStream input(&stream);
+  BazelEventReader events(&input);
+  // Use a tiny capacity so the producer thread exercises backpressure.
+  PipelinedBazelArtifactReader reader(
+      &events, BazelArtifactReader::DefaultSelectors(), /*capacity=*/2);
+  std::vector<BazelArtifact> artifacts;
+  for (; !reader.Done(); reader.Next()) {
+    artifacts.push_back(std::move(reader.Ref()));
+  }
+  ASSERT_TRUE(reader.status().ok()) << reader.status();
+  EXPECT_THAT(
+      artifacts,
+      ElementsAre(
+          Artifact("//id/label:0", ElementsAre(File("local/path/to/file.kzip",
+                                                    "file:///dummy/0.kzip"))),
+          Artifact("//id/label:1", ElementsAre(File("local/path/to/file.kzip",
+                                                    "file:///dummy/1.kzip"))),
+          Artifact("//id/label:2", ElementsAre(File("local/path/to/file.kzip",
+                                                    "file:///dummy/2.kzip"))),
+          Artifact("//id/label:3", ElementsAre(File("local/path/to/file.kzip",
+                                                    "file:///dummy/3.kzip"))),
+          Artifact("//id/label:4", ElementsAre(File("local/path/to/file.kzip",
+                                                    "file:///dummy/4.kzip")))));
+}
+
 }  // namespace
 }  // namespace kythe
@@ -15,10 +15,13 @@
  */
 #include "kythe/cxx/extractor/bazel_event_reader.h"
 
+#include <cstdint>
 #include <utility>
 
 #include "absl/status/status.h"
+#include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/util/delimited_message_util.h"
+#include "google/protobuf/wire_format_lite.h"
 #include "src/main/java/com/google/devtools/build/lib/buildeventstream/proto/build_event_stream.pb.h"
 
 namespace kythe {
@@ -61,4 +64,71 @@ void BazelEventReader::Next() {
   }
 }
 
+void FlatBazelEventReader::Next() {
+  while (true) {
+    if (pos_ >= data_.size()) {
+      value_ = absl::OkStatus();
+      return;
+    }
+    // Decode the record-length varint by hand; a single CodedInputStream over
+    // the whole buffer would hit its 2 GiB total-size limit.
+    uint64_t size = 0;
+    size_t cursor = pos_;
+    for (int shift = 0;; shift += 7) {
+      if (cursor == data_.size() || shift > 63) {
+        value_ = absl::UnknownError("Error decoding BuildEvent from stream");
+        return;
+      }
+      const uint8_t byte = static_cast<uint8_t>(data_[cursor++]);
+      size |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) break;
+    }
+    if (size > data_.size() - cursor) {
+      value_ = absl::UnknownError("Error decoding BuildEvent from stream");
+      return;
+    }
+    const absl::string_view record = data_.substr(cursor, size);
+    pos_ = cursor + size;
+    if (id_filter_ != nullptr && !MatchesFilter(record)) {
+      continue;
+    }
+    event_->Clear();
+    if (!event_->ParseFromArray(record.data(), record.size())) {
+      value_ = absl::UnknownError("Error decoding BuildEvent from stream");
+      return;
+    }
+    value_ = event_;
+    return;
+  }
+}
+
+bool FlatBazelEventReader::MatchesFilter(absl::string_view record) {
+  using ::google::protobuf::internal::WireFormatLite;
+  CodedInputStream stream(reinterpret_cast<const uint8_t*>(record.data()),
+                          record.size());
+  for (uint32_t tag = stream.ReadTag(); tag != 0; tag = stream.ReadTag()) {
+    if (WireFormatLite::GetTagFieldNumber(tag) == BuildEvent::kIdFieldNumber &&
+        WireFormatLite::GetTagWireType(tag) ==
+            WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      uint32_t length;
+      if (!stream.ReadVarint32(&length)) {
+        // Malformed; decode fully so the error is reported from one place.
+        return true;
+      }
+      const auto limit = stream.PushLimit(length);
+      ::build_event_stream::BuildEventId id;
+      if (!id.ParseFromCodedStream(&stream)) {
+        return true;
+      }
+      stream.PopLimit(limit);
+      return id_filter_(id);
+    }
+    if (!WireFormatLite::SkipField(&stream, tag)) {
+      return true;
+    }
+  }
+  // No id field at all; let the caller decide on the default-constructed id.
+  return id_filter_(::build_event_stream::BuildEventId());
+}
+
 }  // namespace kythe
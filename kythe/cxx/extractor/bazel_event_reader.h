@@ -16,9 +16,15 @@
 #ifndef KYTHE_CXX_EXTRACTOR_BAZEL_EVENT_READER_H_
 #define KYTHE_CXX_EXTRACTOR_BAZEL_EVENT_READER_H_
 
+#include <cstddef>
+#include <functional>
+#include <utility>
+
 #include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/variant.h"
 #include "glog/logging.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "src/main/java/com/google/devtools/build/lib/buildeventstream/proto/build_event_stream.pb.h"
 
@@ -86,6 +92,59 @@ class BazelEventReader final : public BazelEventReaderInterface {
       stream_;
 };
 
+/// \brief Predicate deciding, from its id alone, whether a build event's
+/// payload is worth decoding at all.
+using BazelEventIdFilter =
+    std::function<bool(const ::build_event_stream::BuildEventId&)>;
+
+/// \brief Reads BuildEvent messages in place from a flat, memory-resident
+/// build event stream, such as a memory-mapped BEP file.
+///
+/// Events are decoded into an arena whose blocks are reused from record to
+/// record, so steady-state iteration allocates nothing. When an id filter is
+/// supplied, records whose id does not match are skipped without decoding
+/// their payload: only the small leading id field is parsed before the cursor
+/// advances to the next record. Unlike stream-based readers, flat input is
+/// not subject to CodedInputStream's 2 GiB total-size limit.
+class FlatBazelEventReader final : public BazelEventReaderInterface {
+ public:
+  /// \brief Constructs a reader over `data`, which must outlive it.
+  explicit FlatBazelEventReader(absl::string_view data,
+                                BazelEventIdFilter id_filter = nullptr)
+      : data_(data),
+        id_filter_(std::move(id_filter)),
+        event_(google::protobuf::Arena::CreateMessage<value_type>(&arena_)) {
+    Next();
+  }
+
+  // Neither copyable nor movable; `event_` lives on the member arena.
+  FlatBazelEventReader(const FlatBazelEventReader&) = delete;
+  FlatBazelEventReader& operator=(const FlatBazelEventReader&) = delete;
+
+  void Next() override;
+
+  bool Done() const override { return value_.index() != 0; }
+  reference Ref() override { return *absl::get<value_type*>(value_); }
+  const_reference Ref() const override {
+    return *absl::get<value_type*>(value_);
+  }
+  absl::Status status() const override {
+    return absl::get<absl::Status>(value_);
+  }
+
+ private:
+  /// \brief Returns true if `record` should be fully decoded, inspecting only
+  /// its id field.
+  bool MatchesFilter(absl::string_view record);
+
+  absl::string_view data_;
+  size_t pos_ = 0;
+  BazelEventIdFilter id_filter_;
+  google::protobuf::Arena arena_;
+  value_type* event_;  ///< Arena-owned; reused for every decoded record.
+  absl::variant<value_type*, absl::Status> value_;
+};
+
 }  // namespace kythe
 
 #endif  // KYTHE_CXX_EXTRACTOR_BAZEL_EVENT_READER_H_
@@ -48,5 +48,48 @@ TEST(BazelEventReaderTest, ReadsExpectedEvents) {
   EXPECT_THAT(events, ElementsAre("0", "1", "2", "3", "4"));
 }
 
+TEST(FlatBazelEventReaderTest, ReadsExpectedEvents) {
+  std::stringstream stream;
+  for (int i = 0; i < 5; i++) {
+    build_event_stream::BuildEvent event;
+    event.mutable_id()->mutable_unknown()->set_details(absl::StrCat(i));
+    ASSERT_TRUE(SerializeDelimitedToOstream(event, &stream));
+  }
+  const std::string data = stream.str();
+
+  std::vector<std::string> events;
+  FlatBazelEventReader reader(data);
+  for (; !reader.Done(); reader.Next()) {
+    events.push_back(reader.Ref().id().unknown().details());
+  }
+  ASSERT_TRUE(reader.status().ok()) << reader.status();
+  EXPECT_THAT(events, ElementsAre("0", "1", "2", "3", "4"));
+}
+
+TEST(FlatBazelEventReaderTest, FilterSkipsUnwantedEvents) {
+  std::stringstream stream;
+  for (int i = 0; i < 5; i++) {
+    build_event_stream::BuildEvent event;
+    if (i % 2 == 0) {
+      event.mutable_id()->mutable_unknown()->set_details(absl::StrCat(i));
+    } else {
+      event.mutable_id()->mutable_progress()->set_opaque_count(i);
+    }
+    ASSERT_TRUE(SerializeDelimitedToOstream(event, &stream));
+  }
+  const std::string data = stream.str();
+
+  std::vector<std::string> events;
+  FlatBazelEventReader reader(
+      data, [](const build_event_stream::BuildEventId& id) {
+        return id.has_unknown();
+      });
+  for (; !reader.Done(); reader.Next()) {
+    events.push_back(reader.Ref().id().unknown().details());
+  }
+  ASSERT_TRUE(reader.status().ok()) << reader.status();
+  EXPECT_THAT(events, ElementsAre("0", "2", "4"));
+}
+
 }  // namespace
 }  // namespace kythe
@@ -16,6 +16,10 @@
 
 #include "kythe/cxx/extractor/cxx_details.h"
 
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
 #include "glog/logging.h"
 
 namespace kythe {
@@ -24,8 +28,35 @@ namespace kythe {
 const char kCxxCompilationUnitDetailsURI[] =
     "kythe.io/proto/kythe.proto.CxxCompilationUnitDetails";
 
-void HeaderSearchInfo::CopyTo(
-    kythe::proto::CxxCompilationUnitDetails* cxx_details) const {
+void HeaderSearchInfo::CopyTo(kythe::proto::CxxCompilationUnitDetails* cxx_details,
+                              bool compact) const {
+  if (compact) {
+    auto* info = cxx_details->mutable_compact_header_search_info();
+    info->set_first_angled_dir(angled_dir_idx);
+    info->set_first_system_dir(system_dir_idx);
+    // Intern each distinct path once; directories and system prefixes refer
+    // to the table by index and carry their attributes in packed parallel
+    // arrays, which is considerably smaller on the wire than a submessage per
+    // entry.
+    absl::flat_hash_map<std::string, int> table;
+    auto intern = [&](const std::string& path) {
+      auto [iter, inserted] = table.emplace(path, info->path_size());
+      if (inserted) {
+        info->add_path(path);
+      }
+      return iter->second;
+    };
+    for (const auto& path : paths) {
+      info->add_dir_path_index(intern(path.path));
+      info->add_dir_characteristic_kind(path.characteristic_kind);
+      info->add_dir_is_framework(path.is_framework);
+    }
+    for (const auto& prefix : system_prefixes) {
+      info->add_system_prefix_path_index(intern(prefix.first));
+      info->add_system_prefix_is_system_header(prefix.second);
+    }
+    return;
+  }
   auto* info = cxx_details->mutable_header_search_info();
   info->set_first_angled_dir(angled_dir_idx);
   info->set_first_system_dir(system_dir_idx);
@@ -46,6 +77,41 @@ bool HeaderSearchInfo::CopyFrom(
     const kythe::proto::CxxCompilationUnitDetails& cxx_details) {
   paths.clear();
   system_prefixes.clear();
+  if (cxx_details.has_compact_header_search_info()) {
+    const auto& info = cxx_details.compact_header_search_info();
+    angled_dir_idx = info.first_angled_dir();
+    system_dir_idx = info.first_system_dir();
+    if (info.dir_path_index_size() != info.dir_characteristic_kind_size() ||
+        info.dir_path_index_size() != info.dir_is_framework_size() ||
+        info.system_prefix_path_index_size() !=
+            info.system_prefix_is_system_header_size()) {
+      return false;
+    }
+    paths.reserve(info.dir_path_index_size());
+    for (int i = 0; i < info.dir_path_index_size(); ++i) {
+      const int index = info.dir_path_index(i);
+      if (index < 0 || index >= info.path_size()) {
+        return false;
+      }
+      paths.emplace_back(HeaderSearchInfo::Path{
+          info.path(index),
+          static_cast<clang::SrcMgr::CharacteristicKind>(
+              info.dir_characteristic_kind(i)),
+          info.dir_is_framework(i)});
+    }
+    system_prefixes.reserve(info.system_prefix_path_index_size());
+    for (int i = 0; i < info.system_prefix_path_index_size(); ++i) {
+      const int index = info.system_prefix_path_index(i);
+      if (index < 0 || index >= info.path_size()) {
+        return false;
+      }
+      system_prefixes.emplace_back(info.path(index),
+                                   info.system_prefix_is_system_header(i));
+    }
+    return (angled_dir_idx <= system_dir_idx &&
+            system_dir_idx <= paths.size());
+  }
+  // Legacy encoding: a submessage per directory plus top-level prefixes.
   const auto& info = cxx_details.header_search_info();
   angled_dir_idx = info.first_angled_dir();
   system_dir_idx = info.first_system_dir();
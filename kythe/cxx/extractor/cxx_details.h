@@ -55,8 +55,13 @@ struct HeaderSearchInfo {
   /// data are well-formed; false if this object should not be used and
   /// has undefined state until the next successful CopyFrom completes.
   bool CopyFrom(const kythe::proto::CxxCompilationUnitDetails& cxx_details);
-  /// Copies HeaderSearchInfo to a serializable format.
-  void CopyTo(kythe::proto::CxxCompilationUnitDetails* cxx_details) const;
+  /// Copies HeaderSearchInfo to a serializable format. By default this is the
+  /// legacy `header_search_info` encoding, which every existing consumer
+  /// (including generated bindings in other languages) understands; pass
+  /// `compact` to emit the smaller `compact_header_search_info` encoding
+  /// instead, which only migrated consumers can read.
+  void CopyTo(kythe::proto::CxxCompilationUnitDetails* cxx_details,
+              bool compact = false) const;
 };
 
 /// The type URI for C++ details.
@@ -21,6 +21,13 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
@@ -32,6 +39,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendAction.h"
@@ -40,6 +48,7 @@
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Tooling/Tooling.h"
 #include "glog/logging.h"
+#include "google/protobuf/arena.h"
 #include "kythe/cxx/common/file_utils.h"
 #include "kythe/cxx/common/json_proto.h"
 #include "kythe/cxx/common/kzip_writer.h"
@@ -225,6 +234,25 @@ static std::string Sha256(const void* bytes, size_t length) {
   return LowercaseStringHexEncodeSha(sha_buf);
 }
 
+/// \brief Returns a fingerprint covering `digest` and the include transcripts
+/// recorded for `source_file`, suitable for keying memoized file contexts.
+std::string FileContextFingerprint(const std::string& digest,
+                                   const SourceFile& source_file) {
+  RunningHash hash;
+  hash.Update(digest);
+  for (const auto& row : source_file.include_history) {
+    hash.Update(row.first);
+    hash.Update(row.second.default_claim == ClaimDirective::AlwaysClaim
+                    ? "always_claim"
+                    : "claim_as_directed");
+    for (const auto& col : row.second.out_edges) {
+      hash.Update(col.first);
+      hash.Update(col.second);
+    }
+  }
+  return hash.CompleteAndReset();
+}
+
 /// \brief Returns a kzip-based IndexWriter or dies.
 IndexWriter OpenKzipWriterOrDie(const std::string& path) {
   auto writer = KzipWriter::Create(path);
@@ -548,6 +576,10 @@ void ExtractorPPCallbacks::AddFile(const clang::FileEntry* file,
         source_manager_->getMemoryBufferForFile(file);
     contents.first->second.file_content.assign(buffer->getBufferStart(),
                                                buffer->getBufferEnd());
+    // Hand the just-captured content to the background hasher (if enabled);
+    // the map node, and so the content, stays put until WriteIndex.
+    index_writer_->EnqueueDigest(contents.first->first,
+                                 contents.first->second.file_content);
     contents.first->second.vname.CopyFrom(
         index_writer_->VNameForPath(index_writer_->RelativizePath(path)));
     VLOG(1) << "added content for " << path << ": mapped to "
@@ -949,9 +981,9 @@ KzipWriterSink::~KzipWriterSink() {
   }
 }
 
-bool CompilationWriter::SetVNameConfiguration(const std::string& json) {
+bool CompilationWriter::SetVNameConfiguration(absl::string_view json) {
   std::string error_text;
-  if (!vname_generator_.LoadJsonString(json, &error_text)) {
+  if (!vname_generator_.LoadConfigString(json, &error_text)) {
     LOG(ERROR) << "Could not parse vname generator configuration: "
                << error_text;
     return false;
@@ -990,6 +1022,146 @@ std::string CompilationWriter::RelativizePath(absl::string_view path) {
   }
 }
 
+void CompilationWriter::LoadDigestCache() {
+  if (digest_cache_loaded_) {
+    return;
+  }
+  digest_cache_loaded_ = true;
+  std::ifstream cache(digest_cache_path_);
+  std::string line;
+  while (std::getline(cache, line)) {
+    std::istringstream fields(line);
+    DigestCacheEntry entry;
+    std::string path;
+    if (fields >> entry.size >> entry.mtime >> entry.digest &&
+        std::getline(fields >> std::ws, path) && !path.empty()) {
+      digest_cache_[path] = std::move(entry);
+    }
+  }
+}
+
+void CompilationWriter::SaveDigestCache() {
+  if (!digest_cache_dirty_) {
+    return;
+  }
+  std::ofstream cache(digest_cache_path_);
+  if (!cache) {
+    LOG(WARNING) << "Couldn't write digest cache to " << digest_cache_path_;
+    return;
+  }
+  for (const auto& entry : digest_cache_) {
+    cache << entry.second.size << '\t' << entry.second.mtime << '\t'
+          << entry.second.digest << '\t' << entry.first << '\n';
+  }
+  digest_cache_dirty_ = false;
+}
+
+std::string CompilationWriter::CachedDigest(const std::string& path,
+                                            const std::string& content) {
+  if (digest_cache_path_.empty()) {
+    return DigestFor(path, content);
+  }
+  LoadDigestCache();
+  struct stat file_stat;
+  if (::stat(path.c_str(), &file_stat) != 0 ||
+      static_cast<uint64_t>(file_stat.st_size) != content.size()) {
+    // Unstattable files (and files whose observed content doesn't match the
+    // filesystem, e.g. mapped buffers) aren't cacheable.
+    return DigestFor(path, content);
+  }
+  auto cached = digest_cache_.find(path);
+  if (cached != digest_cache_.end() &&
+      cached->second.size == static_cast<uint64_t>(file_stat.st_size) &&
+      cached->second.mtime == static_cast<int64_t>(file_stat.st_mtime)) {
+    return cached->second.digest;
+  }
+  DigestCacheEntry entry;
+  entry.size = file_stat.st_size;
+  entry.mtime = file_stat.st_mtime;
+  entry.digest = DigestFor(path, content);
+  digest_cache_[path] = entry;
+  digest_cache_dirty_ = true;
+  return entry.digest;
+}
+
+std::string CompilationWriter::DigestFor(const std::string& path,
+                                         const std::string& content) {
+  // The hashing thread has been joined by now, so the results can be read
+  // without holding hash_mu_.
+  auto hashed = hashed_digests_.find(path);
+  if (hashed != hashed_digests_.end()) {
+    return hashed->second;
+  }
+  return Sha256(content.c_str(), content.size());
+}
+
+void CompilationWriter::EnqueueDigest(const std::string& path,
+                                      absl::string_view content) {
+  if (!background_hashing_) {
+    return;
+  }
+  absl::MutexLock lock(&hash_mu_);
+  hash_queue_.push_back(DigestRequest{path, content});
+  if (!hash_thread_.joinable()) {
+    // Either the first enqueue, or a later compilation in this session
+    // re-starting the thread WriteIndex joined; re-arm the stop flag.
+    hash_done_ = false;
+    hash_thread_ = std::thread(&CompilationWriter::HashLoop, this);
+  }
+}
+
+void CompilationWriter::HashLoop() {
+  for (;;) {
+    DigestRequest request;
+    {
+      absl::MutexLock lock(&hash_mu_);
+      hash_mu_.Await(absl::Condition(
+          +[](CompilationWriter* writer) {
+            return writer->hash_done_ || !writer->hash_queue_.empty();
+          },
+          this));
+      if (hash_queue_.empty()) {
+        // hash_done_ is set and everything queued has been hashed.
+        return;
+      }
+      request = std::move(hash_queue_.front());
+      hash_queue_.pop_front();
+    }
+    std::string digest = Sha256(request.content.data(), request.content.size());
+    {
+      absl::MutexLock lock(&hash_mu_);
+      hashed_digests_[request.path] = std::move(digest);
+    }
+  }
+}
+
+void CompilationWriter::JoinBackgroundHashing() {
+  if (!hash_thread_.joinable()) {
+    return;
+  }
+  {
+    absl::MutexLock lock(&hash_mu_);
+    hash_done_ = true;
+  }
+  hash_thread_.join();
+}
+
+CompilationWriter::~CompilationWriter() { JoinBackgroundHashing(); }
+
+void CompilationWriter::RecordClosureEntry(const std::string& path,
+                                           const std::string& digest) {
+  struct stat file_stat;
+  if (path == "-" || ::stat(path.c_str(), &file_stat) != 0) {
+    // Closures containing stdin or unstattable paths can't be revalidated
+    // by a later run, so the unit must not be served from the cache.
+    include_closure_complete_ = false;
+    return;
+  }
+  include_closure_.push_back(
+      IncludeClosureEntry{path, static_cast<uint64_t>(file_stat.st_size),
+                          static_cast<int64_t>(file_stat.st_mtime), digest});
+}
+
 void CompilationWriter::FillFileInput(
     const std::string& clang_path, const SourceFile& source_file,
     kythe::proto::CompilationUnit::FileInput* file_input) {
@@ -1004,9 +1176,28 @@ void CompilationWriter::FillFileInput(
   // it. (clang also refers to standard input as <stdin>, so we're
   // consistent there.)
   file_info->set_path(clang_path == "-" ? "<stdin>" : clang_path);
-  file_info->set_digest(Sha256(source_file.file_content.c_str(),
-                               source_file.file_content.size()));
+  file_info->set_digest(CachedDigest(clang_path, source_file.file_content));
+  if (record_include_closure_) {
+    RecordClosureEntry(clang_path, file_info->digest());
+  }
+  if (source_file.include_history.empty()) {
+    return;
+  }
+  // Headers shared among the compilations in this session show up with
+  // identical include histories; reuse the packed context details rather than
+  // rebuilding them per compilation unit.
+  std::string fingerprint =
+      FileContextFingerprint(file_info->digest(), source_file);
+  auto cached = file_context_cache_.find(fingerprint);
+  if (cached != file_context_cache_.end()) {
+    *file_input->add_details() = cached->second;
+    return;
+  }
   AddFileContext(source_file, file_input);
+  if (file_input->details_size() == 1) {
+    file_context_cache_.emplace(std::move(fingerprint),
+                                file_input->details(0));
+  }
 }
 
 void CompilationWriter::InsertExtraIncludes(
@@ -1037,6 +1228,9 @@ void CompilationWriter::InsertExtraIncludes(
     required_input->mutable_info()->set_path(path);
     required_input->mutable_info()->set_digest(
         Sha256((*buffer)->getBufferStart(), (*buffer)->getBufferSize()));
+    if (record_include_closure_) {
+      RecordClosureEntry(path, required_input->info().digest());
+    }
     file_content->mutable_info()->CopyFrom(required_input->info());
     file_content->mutable_content()->assign((*buffer)->getBufferStart(),
                                             (*buffer)->getBufferEnd());
@@ -1103,6 +1297,52 @@ void CompilationWriter::ScrubIntermediateFiles(
   }
 }
 
+/// \brief Arguments dropped (together with their separate value argument)
+/// during unit canonicalization: they direct side outputs and don't affect
+/// the compilation's meaning.
+static bool IsCanonicallyIrrelevantArgWithValue(absl::string_view arg) {
+  return arg == "-MF" || arg == "-MT" || arg == "-MQ" || arg == "-o" ||
+         arg == "--serialize-diagnostics" || arg == "-dependency-file";
+}
+
+/// \brief Standalone arguments dropped during unit canonicalization.
+static bool IsCanonicallyIrrelevantArg(absl::string_view arg) {
+  return arg == "-M" || arg == "-MM" || arg == "-MD" || arg == "-MMD" ||
+         arg == "-MG" || arg == "-MP" || arg == "-MV" ||
+         absl::StartsWith(arg, "-frandom-seed=");
+}
+
+void CompilationWriter::CanonicalizeUnit(kythe::proto::CompilationUnit* unit) {
+  // Prune arguments per the policy table above. Argument order is
+  // meaningful to the compiler, so surviving arguments keep their order.
+  google::protobuf::RepeatedPtrField<std::string> kept_args;
+  for (int i = 0; i < unit->argument_size(); ++i) {
+    const std::string& arg = unit->argument(i);
+    if (IsCanonicallyIrrelevantArgWithValue(arg)) {
+      ++i;  // Also skip the flag's value.
+      continue;
+    }
+    if (IsCanonicallyIrrelevantArg(arg)) {
+      continue;
+    }
+    *kept_args.Add() = arg;
+  }
+  unit->mutable_argument()->Swap(&kept_args);
+  // The working directory is already absolute; remove dot components and
+  // trailing separators so spelling differences between otherwise identical
+  // builds don't change the unit digest.
+  llvm::SmallString<256> working_directory(
+      llvm::StringRef(unit->working_directory()));
+  llvm::sys::path::remove_dots(working_directory, /*remove_dot_dot=*/true);
+  while (working_directory.size() > 1 &&
+         llvm::sys::path::is_separator(working_directory.back())) {
+    working_directory.pop_back();
+  }
+  unit->set_working_directory(working_directory.c_str());
+  // required_input is already sorted into a stable content-based order by
+  // WriteIndex, so nothing further is needed there.
+}
+
 void CompilationWriter::WriteIndex(
     supported_language::Language lang,
     std::unique_ptr<CompilationWriterSink> sink,
@@ -1110,7 +1350,15 @@ void CompilationWriter::WriteIndex(
     const std::unordered_map<std::string, SourceFile>& source_files,
     const HeaderSearchInfo* header_search_info, bool had_errors,
     const std::string& clang_working_dir) {
-  kythe::proto::CompilationUnit unit;
+  // Digests queued during preprocessing are consumed below (via
+  // CachedDigest); wait for the hashing thread to finish them.
+  JoinBackgroundHashing();
+  // Build the unit on an arena: a ten-thousand-input unit otherwise pays a
+  // heap allocation per FileInput submessage and string.
+  google::protobuf::Arena arena;
+  auto* unit =
+      google::protobuf::Arena::CreateMessage<kythe::proto::CompilationUnit>(
+          &arena);
   std::string identifying_blob;
   identifying_blob.append(corpus_);
 
@@ -1135,12 +1383,12 @@ void CompilationWriter::WriteIndex(
 
   for (const auto& arg : final_args) {
     identifying_blob.append(arg);
-    unit.add_argument(arg);
+    unit->add_argument(arg);
   }
   identifying_blob.append(main_source_file);
   std::string identifying_blob_digest =
       Sha256(identifying_blob.c_str(), identifying_blob.size());
-  auto* unit_vname = unit.mutable_v_name();
+  auto* unit_vname = unit->mutable_v_name();
 
   kythe::proto::VName main_vname = VNameForPath(main_source_file);
   *unit_vname = main_vname;
@@ -1159,27 +1407,33 @@ void CompilationWriter::WriteIndex(
     build_details.set_build_config(build_config_);
     // Include the details, but only if any of the fields are meaningfully set.
     if (build_details.ByteSizeLong() > 0) {
-      PackAny(build_details, kBuildDetailsURI, unit.add_details());
+      PackAny(build_details, kBuildDetailsURI, unit->add_details());
     }
   }
 
   for (const auto& file : source_files) {
-    FillFileInput(file.first, file.second, unit.add_required_input());
-  }
-  std::sort(unit.mutable_required_input()->begin(),
-            unit.mutable_required_input()->end(),
-            OrderFileInputByVName(main_source_file));
+    FillFileInput(file.first, file.second, unit->add_required_input());
+  }
+  // Sort through the repeated field's pointer iterators; sorting the value
+  // iterators would deep-copy the messages at every swap.
+  std::sort(unit->mutable_required_input()->pointer_begin(),
+            unit->mutable_required_input()->pointer_end(),
+            [order = OrderFileInputByVName(main_source_file)](
+                const kythe::proto::CompilationUnit::FileInput* lhs,
+                const kythe::proto::CompilationUnit::FileInput* rhs) {
+              return order(*lhs, *rhs);
+            });
 
   kythe::proto::CxxCompilationUnitDetails cxx_details;
   if (header_search_info != nullptr) {
-    header_search_info->CopyTo(&cxx_details);
-  }
-  InsertExtraIncludes(&unit, &cxx_details);
-  PackAny(cxx_details, kCxxCompilationUnitDetailsURI, unit.add_details());
-  unit.set_entry_context(entry_context);
-  unit.set_has_compile_errors(had_errors);
-  unit.add_source_file(main_source_file);
-  unit.set_output_key(output_file);  // may be empty; that's OK
+    header_search_info->CopyTo(&cxx_details, compact_header_search_info_);
+  }
+  InsertExtraIncludes(unit, &cxx_details);
+  PackAny(cxx_details, kCxxCompilationUnitDetailsURI, unit->add_details());
+  unit->set_entry_context(entry_context);
+  unit->set_has_compile_errors(had_errors);
+  unit->add_source_file(main_source_file);
+  unit->set_output_key(output_file);  // may be empty; that's OK
   llvm::SmallString<256> absolute_working_directory(
       llvm::StringRef(clang_working_dir.data(), clang_working_dir.size()));
   std::error_code err =
@@ -1187,11 +1441,14 @@ void CompilationWriter::WriteIndex(
   if (err) {
     LOG(WARNING) << "Can't get working directory: " << err.message();
   } else {
-    unit.set_working_directory(absolute_working_directory.c_str());
+    unit->set_working_directory(absolute_working_directory.c_str());
+  }
+  if (canonicalize_units_) {
+    CanonicalizeUnit(unit);
   }
   sink->OpenIndex(identifying_blob_digest);
-  sink->WriteHeader(unit);
-  for (const auto& file_input : unit.required_input()) {
+  sink->WriteHeader(*unit);
+  for (const auto& file_input : unit->required_input()) {
     auto iter = source_files.find(file_input.info().path());
     if (iter != source_files.end()) {
       kythe::proto::FileData file_content;
@@ -1203,6 +1460,7 @@ void CompilationWriter::WriteIndex(
   for (const auto& data : extra_data_) {
     sink->WriteFileContent(data);
   }
+  SaveDigestCache();
 }
 
 std::unique_ptr<clang::FrontendAction> NewExtractor(
@@ -1222,7 +1480,9 @@ void MapCompilerResources(clang::tooling::ToolInvocation* invocation,
 }
 
 void ExtractorConfiguration::SetVNameConfig(const std::string& path) {
-  if (!index_writer_.SetVNameConfiguration(LoadFileOrDie(path))) {
+  auto config = MappedFile::Open(path);
+  if (!config.ok() ||
+      !index_writer_.SetVNameConfiguration(config->content())) {
     absl::FPrintF(stderr, "Couldn't configure vnames from %s\n", path);
     exit(1);
   }
@@ -1304,6 +1564,25 @@ void ExtractorConfiguration::InitializeFromEnvironment() {
   if (const char* env_kythe_build_config = getenv("KYTHE_BUILD_CONFIG")) {
     SetBuildConfig(env_kythe_build_config);
   }
+  if (const char* env_digest_cache = getenv("KYTHE_DIGEST_CACHE")) {
+    index_writer_.set_digest_cache_path(env_digest_cache);
+  }
+  if (const char* env_extraction_cache = getenv("KYTHE_EXTRACTION_CACHE")) {
+    SetExtractionCacheDir(env_extraction_cache);
+  }
+  if (const char* env_header_read_ahead = getenv("KYTHE_HEADER_READ_AHEAD")) {
+    SetHeaderReadAhead(true);
+  }
+  if (const char* env_compact_header_search_info =
+          getenv("KYTHE_COMPACT_HEADER_SEARCH_INFO")) {
+    index_writer_.set_compact_header_search_info(true);
+  }
+  if (const char* env_background_hashing = getenv("KYTHE_BACKGROUND_HASHING")) {
+    index_writer_.set_background_hashing(true);
+  }
+  if (const char* env_canonicalize_units = getenv("KYTHE_CANONICALIZE_UNITS")) {
+    index_writer_.set_canonicalize_units(true);
+  }
   if (const char* env_path_policy = getenv("KYTHE_CANONICALIZE_VNAME_PATHS")) {
     index_writer_.set_path_canonicalization_policy(
         ParseCanonicalizationPolicy(env_path_policy)
@@ -1311,29 +1590,126 @@ void ExtractorConfiguration::InitializeFromEnvironment() {
   }
 }
 
+/// \brief A vfs::File served from RecordingFS's extraction-scoped snapshot
+/// cache.
+class SnapshotFile : public llvm::vfs::File {
+ public:
+  /// \param content Owned by the cache, which outlives this object; its
+  /// backing store is NUL-terminated (std::string guarantees this).
+  SnapshotFile(llvm::vfs::Status status, llvm::StringRef content)
+      : status_(std::move(status)), content_(content) {}
+  llvm::ErrorOr<llvm::vfs::Status> status() override { return status_; }
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(
+      const llvm::Twine& name, int64_t file_size,
+      bool requires_null_terminator, bool is_volatile) override {
+    return llvm::MemoryBuffer::getMemBuffer(content_, name.str(),
+                                            requires_null_terminator);
+  }
+  std::error_code close() override { return {}; }
+
+ private:
+  llvm::vfs::Status status_;
+  llvm::StringRef content_;
+};
+
 /// Shims Clang's file system. We need to do this because other parts of the
 /// frontend (like the parts that autodetect the standard library and support
 /// for extensions like CUDA) request files separately from the preprocessor.
 /// We still want to keep track of file requests in the preprocessor so we can
 /// record information about transcripts, as these are important for claiming.
+///
+/// The shim also snapshots stat results and file content for the duration of
+/// the extraction: the driver, the standard library autodetection, and the
+/// preprocessor all request the same headers, and on a cold cache each
+/// repeated stat/open is a real syscall. Extraction treats the input tree as
+/// immutable, so the first answer is always the right one.
+///
+/// When read-ahead is enabled, the first header opened in a directory also
+/// queues that directory for a background thread to preload its other
+/// headers. Headers included together overwhelmingly live together, so by
+/// the time the preprocessor asks for the next sibling its content is
+/// usually already in memory; on high-latency filesystems (NFS build roots)
+/// this overlaps cold reads with parsing instead of serializing them.
+/// Prefetched files are only reported to the CompilationWriter if the
+/// preprocessor actually requests them, so the recorded compilation is
+/// identical either way.
 class RecordingFS : public llvm::vfs::FileSystem {
  public:
   RecordingFS(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base_file_system,
-              CompilationWriter* index_writer)
-      : base_file_system_(base_file_system), index_writer_(index_writer) {}
+              CompilationWriter* index_writer, bool header_read_ahead = false)
+      : base_file_system_(base_file_system),
+        index_writer_(index_writer),
+        read_ahead_enabled_(header_read_ahead) {}
+  ~RecordingFS() override {
+    if (read_ahead_thread_.joinable()) {
+      {
+        absl::MutexLock lock(&read_ahead_mu_);
+        read_ahead_done_ = true;
+      }
+      read_ahead_thread_.join();
+    }
+  }
   llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path) override {
+    std::string key = path.str();
+    auto cached = status_cache_.find(key);
+    if (cached != status_cache_.end()) {
+      return cached->second;
+    }
+    if (read_ahead_enabled_) {
+      absl::MutexLock lock(&read_ahead_mu_);
+      auto prefetched = prefetched_.find(key);
+      if (prefetched != prefetched_.end()) {
+        return status_cache_.emplace(std::move(key), prefetched->second.status)
+            .first->second;
+      }
+    }
     auto nested_result = base_file_system_->status(path);
     if (nested_result && nested_result->isDirectory()) {
-      index_writer_->DirectoryOpenedForStatus(path.str());
+      index_writer_->DirectoryOpenedForStatus(key);
     }
+    status_cache_.emplace(std::move(key), nested_result);
     return nested_result;
   }
   llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(
       const llvm::Twine& path) override {
+    std::string key = path.str();
+    auto cached = content_cache_.find(key);
+    if (cached != content_cache_.end()) {
+      return std::unique_ptr<llvm::vfs::File>(new SnapshotFile(
+          cached->second.status, cached->second.content));
+    }
+    if (read_ahead_enabled_ && IsHeaderPath(key)) {
+      MaybeScheduleReadAhead(key);
+      absl::MutexLock lock(&read_ahead_mu_);
+      auto prefetched = prefetched_.find(key);
+      if (prefetched != prefetched_.end()) {
+        // Only requested files are recorded; this is the request.
+        index_writer_->OpenedForRead(key);
+        auto entry =
+            content_cache_.emplace(std::move(key),
+                                   std::move(prefetched->second));
+        prefetched_.erase(prefetched);
+        return std::unique_ptr<llvm::vfs::File>(
+            new SnapshotFile(entry.first->second.status,
+                             entry.first->second.content));
+      }
+    }
     auto nested_result = base_file_system_->openFileForRead(path);
     if (nested_result) {
       // We expect to be able to open this file at this path in the future.
-      index_writer_->OpenedForRead(path.str());
+      index_writer_->OpenedForRead(key);
+      auto file_status = (*nested_result)->status();
+      auto buffer = (*nested_result)->getBuffer(key);
+      if (file_status && buffer) {
+        auto entry = content_cache_.emplace(
+            std::move(key),
+            Snapshot{*file_status,
+                     std::string((*buffer)->getBufferStart(),
+                                 (*buffer)->getBufferSize())});
+        return std::unique_ptr<llvm::vfs::File>(
+            new SnapshotFile(entry.first->second.status,
+                             entry.first->second.content));
+      }
     }
     return nested_result;
   }
@@ -1349,8 +1725,107 @@ class RecordingFS : public llvm::vfs::FileSystem {
   }
 
  private:
+  /// \brief The cached result of one successful open: the file's stat data
+  /// and its full content.
+  struct Snapshot {
+    llvm::vfs::Status status;
+    std::string content;
+  };
+  /// At most this many headers are preloaded per directory; huge generated
+  /// directories would otherwise swamp the cache with files nobody includes.
+  static constexpr int kReadAheadFilesPerDirectory = 128;
+
+  /// \brief Returns true if `path` names a plausible header (including the
+  /// extensionless standard library headers).
+  static bool IsHeaderPath(llvm::StringRef path) {
+    llvm::StringRef extension = llvm::sys::path::extension(path);
+    return extension.empty() || extension == ".h" || extension == ".H" ||
+           extension == ".hh" || extension == ".hpp" || extension == ".hxx" ||
+           extension == ".inc";
+  }
+
+  /// \brief Queues `header_path`'s directory for sibling preloading the
+  /// first time any header in it is opened.
+  void MaybeScheduleReadAhead(const std::string& header_path) {
+    std::string dir = llvm::sys::path::parent_path(header_path).str();
+    if (dir.empty()) return;
+    absl::MutexLock lock(&read_ahead_mu_);
+    if (!read_ahead_dirs_.insert(dir).second) return;
+    read_ahead_queue_.push_back(std::move(dir));
+    if (!read_ahead_thread_.joinable()) {
+      read_ahead_thread_ = std::thread(&RecordingFS::ReadAheadLoop, this);
+    }
+  }
+
+  /// \brief Background loop: drains the directory queue, preloading headers.
+  void ReadAheadLoop() {
+    for (;;) {
+      std::string dir;
+      {
+        absl::MutexLock lock(&read_ahead_mu_);
+        read_ahead_mu_.Await(absl::Condition(
+            +[](RecordingFS* fs) {
+              return fs->read_ahead_done_ || !fs->read_ahead_queue_.empty();
+            },
+            this));
+        if (read_ahead_done_) return;
+        dir = std::move(read_ahead_queue_.front());
+        read_ahead_queue_.pop_front();
+      }
+      PreloadDirectory(dir);
+    }
+  }
+
+  /// \brief Reads the headers in `dir` through the base filesystem into
+  /// `prefetched_`. Failures are silently skipped; a missed prefetch just
+  /// falls back to the ordinary synchronous open.
+  void PreloadDirectory(const std::string& dir) {
+    std::error_code error_code;
+    int budget = kReadAheadFilesPerDirectory;
+    for (auto entry = base_file_system_->dir_begin(dir, error_code);
+         !error_code && entry != llvm::vfs::directory_iterator() && budget > 0;
+         entry.increment(error_code)) {
+      std::string entry_path = entry->path().str();
+      if (!IsHeaderPath(entry_path)) continue;
+      {
+        absl::MutexLock lock(&read_ahead_mu_);
+        if (read_ahead_done_) return;
+        if (prefetched_.find(entry_path) != prefetched_.end()) continue;
+      }
+      auto file = base_file_system_->openFileForRead(entry_path);
+      if (!file) continue;
+      auto file_status = (*file)->status();
+      auto buffer = (*file)->getBuffer(entry_path);
+      if (!file_status || !buffer) continue;
+      --budget;
+      absl::MutexLock lock(&read_ahead_mu_);
+      prefetched_.emplace(
+          std::move(entry_path),
+          Snapshot{*file_status, std::string((*buffer)->getBufferStart(),
+                                             (*buffer)->getBufferSize())});
+    }
+  }
+
   llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base_file_system_;
   CompilationWriter* index_writer_;
+  /// Memoized stat results (successes and failures both). Main thread only.
+  std::map<std::string, llvm::ErrorOr<llvm::vfs::Status>> status_cache_;
+  /// Memoized file content keyed by path. Main thread only.
+  std::map<std::string, Snapshot> content_cache_;
+  /// Whether the background header read-ahead is enabled.
+  const bool read_ahead_enabled_;
+  /// Guards the read-ahead state below, which is shared with the worker.
+  absl::Mutex read_ahead_mu_;
+  /// Directories awaiting sibling preloading.
+  std::deque<std::string> read_ahead_queue_;
+  /// Directories ever scheduled, to keep each from being scanned twice.
+  std::set<std::string> read_ahead_dirs_;
+  /// Snapshots read by the worker but not yet requested by the compiler.
+  std::map<std::string, Snapshot> prefetched_;
+  /// Set during destruction to stop the worker.
+  bool read_ahead_done_ = false;
+  /// Lazily started when the first directory is scheduled.
+  std::thread read_ahead_thread_;
 };
 
 bool ExtractorConfiguration::Extract(
@@ -1359,7 +1834,8 @@ bool ExtractorConfiguration::Extract(
   llvm::IntrusiveRefCntPtr<clang::FileManager> file_manager(
       new clang::FileManager(
           file_system_options_,
-          new RecordingFS(llvm::vfs::getRealFileSystem(), &index_writer_)));
+          new RecordingFS(llvm::vfs::getRealFileSystem(), &index_writer_,
+                          header_read_ahead_)));
   index_writer_.set_target_name(target_name_);
   index_writer_.set_rule_type(rule_type_);
   index_writer_.set_build_config(build_config_);
@@ -1383,11 +1859,145 @@ bool ExtractorConfiguration::Extract(
   return invocation.run();
 }
 
+/// \brief Copies `from` to `to`, staging through a temporary so readers
+/// never observe a partial file.
+static bool CopyFileContents(const std::string& from, const std::string& to) {
+  auto content = MappedFile::Open(from);
+  if (!content.ok()) {
+    return false;
+  }
+  std::string temp_path = absl::StrCat(to, ".", getpid(), ".tmp");
+  FILE* out = fopen(temp_path.c_str(), "wb");
+  if (out == nullptr) {
+    return false;
+  }
+  absl::string_view bytes = content->content();
+  bool ok = bytes.empty() || fwrite(bytes.data(), bytes.size(), 1, out) == 1;
+  ok = (fclose(out) != EOF) && ok;
+  if (ok) {
+    ok = rename(temp_path.c_str(), to.c_str()) == 0;
+  }
+  if (!ok) {
+    unlink(temp_path.c_str());
+  }
+  return ok;
+}
+
+std::string ExtractorConfiguration::ExtractionCacheKey(
+    supported_language::Language lang) const {
+  std::string fingerprint;
+  for (const auto& arg : final_args_) {
+    fingerprint.append(arg);
+    fingerprint.push_back('\0');
+  }
+  fingerprint.append(supported_language::ToString(lang));
+  for (const std::string* field :
+       {&target_name_, &rule_type_, &build_config_,
+        &compilation_output_path_}) {
+    fingerprint.push_back('\0');
+    fingerprint.append(*field);
+  }
+  // Relative closure paths are resolved against the working directory, so
+  // runs from different directories must not share an entry.
+  if (StatusOr<std::string> cwd = GetCurrentDirectory()) {
+    fingerprint.push_back('\0');
+    fingerprint.append(*cwd);
+  }
+  return Sha256(fingerprint.c_str(), fingerprint.size());
+}
+
+bool ExtractorConfiguration::TryCachedExtraction(const std::string& key) {
+  const std::string manifest_path =
+      JoinPath(extraction_cache_dir_, key + ".closure");
+  const std::string cached_kzip_path =
+      JoinPath(extraction_cache_dir_, key + ".kzip");
+  std::ifstream manifest(manifest_path);
+  if (!manifest) {
+    return false;
+  }
+  std::string line;
+  bool any_entries = false;
+  while (std::getline(manifest, line)) {
+    std::istringstream fields(line);
+    uint64_t size;
+    int64_t mtime;
+    std::string digest, path;
+    if (!(fields >> size >> mtime >> digest) ||
+        !std::getline(fields >> std::ws, path) || path.empty()) {
+      return false;
+    }
+    any_entries = true;
+    struct stat file_stat;
+    if (::stat(path.c_str(), &file_stat) != 0 ||
+        static_cast<uint64_t>(file_stat.st_size) != size) {
+      return false;
+    }
+    if (static_cast<int64_t>(file_stat.st_mtime) == mtime) {
+      continue;
+    }
+    // The mtime moved (e.g. a fresh checkout); accept the file if its
+    // content is still byte-identical.
+    auto content = MappedFile::Open(path);
+    if (!content.ok() ||
+        Sha256(content->content().data(), content->content().size()) !=
+            digest) {
+      return false;
+    }
+  }
+  if (!any_entries || !CopyFileContents(cached_kzip_path, output_file_)) {
+    return false;
+  }
+  LOG(INFO) << "Serving extraction of " << output_file_ << " from cache";
+  return true;
+}
+
+void ExtractorConfiguration::StoreCachedExtraction(const std::string& key) {
+  if (!index_writer_.include_closure_complete() ||
+      index_writer_.include_closure().empty()) {
+    return;
+  }
+  // Store the kzip before the manifest so a manifest never names a missing
+  // kzip.
+  if (!CopyFileContents(output_file_,
+                        JoinPath(extraction_cache_dir_, key + ".kzip"))) {
+    return;
+  }
+  const std::string manifest_path =
+      JoinPath(extraction_cache_dir_, key + ".closure");
+  std::string temp_path = absl::StrCat(manifest_path, ".", getpid(), ".tmp");
+  std::ofstream manifest(temp_path);
+  if (!manifest) {
+    return;
+  }
+  for (const auto& entry : index_writer_.include_closure()) {
+    manifest << entry.size << '\t' << entry.mtime << '\t' << entry.digest
+             << '\t' << entry.path << '\n';
+  }
+  manifest.close();
+  if (!manifest || rename(temp_path.c_str(), manifest_path.c_str()) != 0) {
+    unlink(temp_path.c_str());
+  }
+}
+
 bool ExtractorConfiguration::Extract(supported_language::Language lang) {
   std::unique_ptr<CompilationWriterSink> sink;
   if (!output_file_.empty()) {
     CHECK(absl::EndsWith(output_file_, ".kzip"))
         << "Output file must have '.kzip' extension";
+    if (!extraction_cache_dir_.empty()) {
+      const std::string key = ExtractionCacheKey(lang);
+      if (TryCachedExtraction(key)) {
+        return true;
+      }
+      index_writer_.set_record_include_closure(true);
+      sink = absl::make_unique<KzipWriterSink>(
+          output_file_, KzipWriterSink::OutputPathType::SingleFile);
+      bool result = Extract(lang, std::move(sink));
+      if (result) {
+        StoreCachedExtraction(key);
+      }
+      return result;
+    }
     sink = absl::make_unique<KzipWriterSink>(
         output_file_, KzipWriterSink::OutputPathType::SingleFile);
   } else {
@@ -17,13 +17,19 @@
 #ifndef KYTHE_CXX_EXTRACTOR_EXTRACTOR_H_
 #define KYTHE_CXX_EXTRACTOR_EXTRACTOR_H_
 
+#include <deque>
+#include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <unordered_map>
 
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "clang/Tooling/Tooling.h"
 #include "glog/logging.h"
+#include "google/protobuf/any.pb.h"
 #include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/zero_copy_stream.h"
@@ -145,6 +151,7 @@ class KzipWriterSink : public CompilationWriterSink {
 /// writes it to an index file.
 class CompilationWriter {
  public:
+  ~CompilationWriter();
   /// \brief Set the arguments to be used for this compilation.
   ///
   /// `args` should be the `argv` (without terminating null) that would be
@@ -169,9 +176,10 @@ class CompilationWriter {
   }
   /// \brief Record the output path generated by this compilation.
   void set_output_path(const std::string& path) { output_path_ = path; }
-  /// \brief Configure vname generation using some JSON string.
+  /// \brief Configure vname generation using a JSON or compiled binary
+  /// configuration string.
   /// \return true on success, false on failure
-  bool SetVNameConfiguration(const std::string& json_string);
+  bool SetVNameConfiguration(absl::string_view json_string);
   /// \brief Configure the path used for the root.
   void set_root_directory(const std::string& dir) {
     canonicalizer_.reset();
@@ -190,6 +198,70 @@ class CompilationWriter {
   void set_exclude_autoconfiguration_files(bool exclude) {
     exclude_autoconfiguration_files_ = exclude;
   }
+  /// \brief Canonicalize emitted compilation units so that identical
+  /// compilations hash identically.
+  ///
+  /// Drops arguments from a policy table of flags that don't affect the
+  /// compilation's meaning (dependency-file generation, output paths,
+  /// diagnostics serialization) and normalizes the working directory, so
+  /// units that differ only in such incidentals deduplicate at the
+  /// kzip/store level instead of being indexed repeatedly.
+  void set_canonicalize_units(bool canonicalize) {
+    canonicalize_units_ = canonicalize;
+  }
+  /// \brief Use `path` as a persistent digest cache.
+  ///
+  /// The cache maps a file's path, size, and mtime to its SHA-256 digest, so
+  /// unchanged files (system headers in particular) skip re-hashing across
+  /// extractor invocations during incremental builds.
+  void set_digest_cache_path(const std::string& path) {
+    digest_cache_path_ = path;
+  }
+  /// \brief Emit header search state in the compact
+  /// `compact_header_search_info` encoding instead of the legacy
+  /// `header_search_info` submessages.
+  ///
+  /// Opt-in: the compact encoding is smaller on the wire but only readable
+  /// by consumers that have migrated to it (and to regenerated proto
+  /// bindings); everything else would silently see no header search info.
+  void set_compact_header_search_info(bool compact) {
+    compact_header_search_info_ = compact;
+  }
+  /// \brief Hash required inputs on a background thread as the preprocessor
+  /// records them, overlapping digest computation with preprocessing
+  /// instead of serializing it into WriteIndex (\sa EnqueueDigest).
+  void set_background_hashing(bool enabled) { background_hashing_ = enabled; }
+  /// \brief Queues the just-recorded `content` of `path` for background
+  /// hashing. A no-op unless background hashing is enabled.
+  ///
+  /// `content` must stay valid and unchanged until WriteIndex runs (file
+  /// content recorded in a `SourceFile` map qualifies: unordered_map
+  /// elements don't move).
+  void EnqueueDigest(const std::string& path, absl::string_view content);
+  /// \brief A file observed in the compilation's include closure.
+  struct IncludeClosureEntry {
+    /// The path to the file as seen by clang.
+    std::string path;
+    /// The file's size in bytes at extraction time.
+    uint64_t size;
+    /// The file's mtime at extraction time.
+    int64_t mtime;
+    /// The file content's SHA-256 digest.
+    std::string digest;
+  };
+  /// \brief Record the include closure of the next written unit so callers
+  /// can persist it (see ExtractorConfiguration::SetExtractionCacheDir).
+  void set_record_include_closure(bool record) {
+    record_include_closure_ = record;
+  }
+  /// \brief The include closure recorded during WriteIndex.
+  const std::vector<IncludeClosureEntry>& include_closure() const {
+    return include_closure_;
+  }
+  /// \brief Returns false if part of the closure could not be recorded with
+  /// a stattable path (stdin, mapped buffers); such units must not be
+  /// cached.
+  bool include_closure_complete() const { return include_closure_complete_; }
   /// \brief Write the index file to `sink`, consuming the sink in the process.
   void WriteIndex(
       supported_language::Language lang,
@@ -232,6 +304,9 @@ class CompilationWriter {
   /// Called to read and insert content for extra include files.
   void InsertExtraIncludes(kythe::proto::CompilationUnit* unit,
                            kythe::proto::CxxCompilationUnitDetails* details);
+  /// \brief Applies the canonicalization described at
+  /// `set_canonicalize_units` to a fully built `unit`.
+  void CanonicalizeUnit(kythe::proto::CompilationUnit* unit);
   /// The `FileVNameGenerator` used to generate file vnames.
   FileVNameGenerator vname_generator_;
   /// The arguments used for this compilation.
@@ -264,10 +339,87 @@ class CompilationWriter {
   bool exclude_empty_dirs_ = false;
   /// Don't include files read during the autoconfiguration phase.
   bool exclude_autoconfiguration_files_ = false;
+  /// \sa set_canonicalize_units
+  bool canonicalize_units_ = false;
+  /// \sa set_compact_header_search_info
+  bool compact_header_search_info_ = false;
 
   /// The canonicalizer to use when constructing relative paths.
   /// Lazily built from policy and root above.
   absl::optional<PathCanonicalizer> canonicalizer_;
+
+  /// \brief Memoized file context details, already packed into `Any` protos,
+  /// keyed by a fingerprint of the file's content digest and its include
+  /// transcripts.
+  ///
+  /// Widely-included headers recur with identical include histories across the
+  /// sibling compilations handled by one extractor session; sharing the packed
+  /// details avoids rebuilding and re-serializing the same transcript rows for
+  /// every compilation unit.
+  std::map<std::string, google::protobuf::Any> file_context_cache_;
+
+  /// \brief A persisted digest record for one file.
+  struct DigestCacheEntry {
+    /// The file's size when the digest was computed.
+    uint64_t size;
+    /// The file's mtime (in time_since_epoch ticks) when the digest was
+    /// computed.
+    int64_t mtime;
+    /// The file content's SHA-256 digest.
+    std::string digest;
+  };
+  /// \brief Returns the digest for `path` with content `content`, reusing a
+  /// cached digest if the file's size and mtime are unchanged.
+  std::string CachedDigest(const std::string& path, const std::string& content);
+  /// \brief Returns the background-computed digest for `path`, or hashes
+  /// `content` directly. Must only be called after `JoinBackgroundHashing`.
+  std::string DigestFor(const std::string& path, const std::string& content);
+  /// \brief Dequeues and hashes files until told to stop; runs on
+  /// `hash_thread_`.
+  void HashLoop();
+  /// \brief Stops the hashing thread once it has drained its queue, making
+  /// `hashed_digests_` safe to read. Called at the start of WriteIndex.
+  void JoinBackgroundHashing();
+  /// \brief Loads `digest_cache_path_` into `digest_cache_`, once.
+  void LoadDigestCache();
+  /// \brief Writes `digest_cache_` back out, if it changed.
+  void SaveDigestCache();
+  /// If nonempty, the path of the persistent digest cache.
+  std::string digest_cache_path_;
+  /// \brief One file queued for background hashing.
+  struct DigestRequest {
+    /// The path the file was recorded under.
+    std::string path;
+    /// The file's recorded content (owned by the caller of EnqueueDigest).
+    absl::string_view content;
+  };
+  /// \sa set_background_hashing
+  bool background_hashing_ = false;
+  /// Guards hash_queue_, hashed_digests_, and hash_done_.
+  absl::Mutex hash_mu_;
+  /// Files awaiting background hashing.
+  std::deque<DigestRequest> hash_queue_;
+  /// Digests computed in the background, by path.
+  std::map<std::string, std::string> hashed_digests_;
+  /// Tells the hashing thread to exit once its queue is drained.
+  bool hash_done_ = false;
+  /// The background hashing thread; started by the first enqueue.
+  std::thread hash_thread_;
+  /// Cached digests by path.
+  std::map<std::string, DigestCacheEntry> digest_cache_;
+  /// Whether `digest_cache_` has been loaded.
+  bool digest_cache_loaded_ = false;
+  /// Whether `digest_cache_` has entries not yet written back.
+  bool digest_cache_dirty_ = false;
+  /// \brief Appends `path` (with digest `digest`) to `include_closure_`, or
+  /// marks the closure incomplete if `path` can't be stat()ed.
+  void RecordClosureEntry(const std::string& path, const std::string& digest);
+  /// The include closure recorded during WriteIndex, if requested.
+  std::vector<IncludeClosureEntry> include_closure_;
+  /// Whether the include closure should be recorded.
+  bool record_include_closure_ = false;
+  /// Whether every closure member was recorded (\sa include_closure_complete).
+  bool include_closure_complete_ = true;
 };
 
 /// \brief Creates a `FrontendAction` that records information about a
@@ -311,6 +463,19 @@ class ExtractorConfiguration {
   void SetPathCanonizalizationPolicy(PathCanonicalizer::Policy policy) {
     index_writer_.set_path_canonicalization_policy(policy);
   }
+  /// \brief If true, asynchronously preload sibling headers of each opened
+  /// header into the extraction file cache.
+  void SetHeaderReadAhead(bool read_ahead) { header_read_ahead_ = read_ahead; }
+  /// \brief Use `dir` as a whole-extraction cache.
+  ///
+  /// A fingerprint of the argument vector and build metadata keys a
+  /// manifest of the previous run's include closure and a copy of the kzip
+  /// it produced. When every closure member is unchanged (checked by stat,
+  /// with a content-digest fallback when only the mtime moved), the cached
+  /// kzip is emitted without running the preprocessor at all.
+  void SetExtractionCacheDir(const std::string& dir) {
+    extraction_cache_dir_ = dir;
+  }
   /// \brief Executes the extractor with this configuration, returning true on
   /// success.
   bool Extract(supported_language::Language lang);
@@ -320,6 +485,15 @@ class ExtractorConfiguration {
                std::unique_ptr<CompilationWriterSink> sink);
 
  private:
+  /// \brief Returns the extraction-cache fingerprint for this configuration.
+  std::string ExtractionCacheKey(supported_language::Language lang) const;
+  /// \brief Emits the cached kzip for `key` if the recorded include closure
+  /// is unchanged.
+  /// \return true if the cached output was emitted.
+  bool TryCachedExtraction(const std::string& key);
+  /// \brief Stores the just-written kzip and its include closure under
+  /// `key`.
+  void StoreCachedExtraction(const std::string& key);
   /// The argument list to pass to Clang.
   std::vector<std::string> final_args_;
   /// The FileSystemOptions to use during extraction.
@@ -328,6 +502,8 @@ class ExtractorConfiguration {
   CompilationWriter index_writer_;
   /// True if we should use our internal system headers; false if not.
   bool map_builtin_resources_ = true;
+  /// True if sibling headers should be preloaded in the background.
+  bool header_read_ahead_ = false;
   /// The directory to use for index files.
   std::string output_directory_ = ".";
   /// If nonempty, emit kzip files to this exact path.
@@ -340,6 +516,8 @@ class ExtractorConfiguration {
   std::string compilation_output_path_;
   /// If nonempty, the name of the build config targeted by this compilation.
   std::string build_config_;
+  /// If nonempty, the directory of the whole-extraction cache.
+  std::string extraction_cache_dir_;
 };
 
 }  // namespace kythe
@@ -17,9 +17,6 @@
 // cxx_extractor_bazel is a C++ extractor meant to be run as a Bazel
 // extra_action.
 
-#include <fcntl.h>
-#include <sys/stat.h>
-
 #include <fstream>
 #include <string>
 
@@ -29,10 +26,12 @@
 #include "absl/strings/str_format.h"
 #include "cxx_extractor.h"
 #include "glog/logging.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/stubs/common.h"
+#include "kythe/cxx/common/file_utils.h"
 #include "kythe/cxx/common/path_utils.h"
 #include "kythe/cxx/extractor/language.h"
 #include "third_party/bazel/src/main/protobuf/extra_actions_base.pb.h"
@@ -44,19 +43,24 @@ ABSL_FLAG(kythe::PathCanonicalizer::Policy, canonicalize_vname_paths,
           "Policy to use when canonicalization VName paths: "
           "clean-only (default), prefer-relative, prefer-real.");
 
-static void LoadExtraAction(const std::string& path,
-                            blaze::ExtraActionInfo* info,
-                            blaze::CppCompileInfo* cpp_info) {
+// Parses the ExtraActionInfo at `path` into `arena`. The returned message
+// (and the CppCompileInfo extension reachable from it) is owned by the
+// arena, so no per-field heap allocations or extension copies are made.
+static const blaze::ExtraActionInfo* LoadExtraAction(
+    const std::string& path, google::protobuf::Arena* arena) {
   using namespace google::protobuf::io;
-  int fd = open(path.c_str(), O_RDONLY, S_IREAD | S_IWRITE);
-  CHECK_GE(fd, 0) << "Couldn't open input file " << path;
-  FileInputStream file_input_stream(fd);
-  CodedInputStream coded_input_stream(&file_input_stream);
+  auto content = kythe::MappedFile::Open(path);
+  CHECK(content.ok()) << "Couldn't open input file " << path << ": "
+                      << content.status();
+  auto* info =
+      google::protobuf::Arena::CreateMessage<blaze::ExtraActionInfo>(arena);
+  ArrayInputStream array_input_stream(
+      content->content().data(), static_cast<int>(content->content().size()));
+  CodedInputStream coded_input_stream(&array_input_stream);
   coded_input_stream.SetTotalBytesLimit(INT_MAX, -1);
   CHECK(info->ParseFromCodedStream(&coded_input_stream));
-  close(fd);
   CHECK(info->HasExtension(blaze::CppCompileInfo::cpp_compile_info));
-  *cpp_info = info->GetExtension(blaze::CppCompileInfo::cpp_compile_info);
+  return info;
 }
 
 int main(int argc, char* argv[]) {
@@ -72,9 +76,10 @@ int main(int argc, char* argv[]) {
   std::string extra_action_file = remain[1];
   std::string output_file = remain[2];
   std::string vname_config = remain[3];
-  blaze::ExtraActionInfo info;
-  blaze::CppCompileInfo cpp_info;
-  LoadExtraAction(extra_action_file, &info, &cpp_info);
+  google::protobuf::Arena arena;
+  const blaze::ExtraActionInfo* info = LoadExtraAction(extra_action_file, &arena);
+  const blaze::CppCompileInfo& cpp_info =
+      info->GetExtension(blaze::CppCompileInfo::cpp_compile_info);
 
   const std::string& source = cpp_info.source_file();
   if (absl::EndsWith(source, ".s") || absl::EndsWith(source, ".asm")) {
@@ -87,6 +92,7 @@ int main(int argc, char* argv[]) {
 
   kythe::ExtractorConfiguration config;
   std::vector<std::string> args;
+  args.reserve(cpp_info.compiler_option_size() + 2);
   args.push_back(cpp_info.tool());
   args.insert(args.end(), cpp_info.compiler_option().begin(),
               cpp_info.compiler_option().end());
@@ -99,7 +105,7 @@ int main(int argc, char* argv[]) {
   config.SetOutputFile(output_file);
   config.SetArgs(args);
   config.SetVNameConfig(vname_config);
-  config.SetTargetName(info.owner());
+  config.SetTargetName(info->owner());
   config.SetBuildConfig(absl::GetFlag(FLAGS_build_config));
   config.SetCompilationOutputPath(cpp_info.output_file());
   config.SetPathCanonizalizationPolicy(
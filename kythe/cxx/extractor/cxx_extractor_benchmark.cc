@@ -0,0 +1,308 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// cxx_extractor_benchmark replays a corpus of compile commands through
+// ExtractorConfiguration::Extract and reports per-phase wall times as JSON,
+// so extraction regressions show up in tracking rather than in production.
+//
+// The corpus is either recorded (--commands_file, one command per line with
+// arguments separated by tabs and without the leading compiler name, the
+// same format the extractor's server mode reads) or synthesized: with no
+// --commands_file the harness generates a deterministic source tree under
+// the work directory and compiles every unit in it, so the benchmark is
+// runnable and comparable with no setup.
+//
+// Phase attribution: "argument_setup" is SetArgs; "preprocess" is the time
+// from the start of Extract until the sink is first written, which covers
+// the Clang invocation and preprocessing; "kzip_write" is time spent inside
+// the kzip sink (including finalization); "hash" is the remainder of index
+// writing, which is dominated by content digesting. Hashing and writing
+// interleave per file, so the last two are attributions, not isolated
+// measurements, but they move independently enough to localize regressions.
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "glog/logging.h"
+#include "kythe/cxx/extractor/cxx_extractor.h"
+#include "kythe/cxx/extractor/language.h"
+
+ABSL_FLAG(std::string, commands_file, "",
+          "File of compile commands to replay, one command per line with "
+          "arguments separated by tabs and without the leading compiler "
+          "name. If empty, a synthetic corpus is generated.");
+ABSL_FLAG(std::string, work_dir, "/tmp/cxx_extractor_benchmark",
+          "Scratch directory for the synthetic tree and kzip output.");
+ABSL_FLAG(int, iterations, 3, "Times to replay the whole corpus.");
+ABSL_FLAG(int, synthetic_units, 8,
+          "Translation units in the generated corpus.");
+ABSL_FLAG(int, synthetic_headers, 64,
+          "Shared headers in the generated corpus.");
+ABSL_FLAG(std::string, json_output, "-",
+          "Where to write the JSON report; - for stdout.");
+
+namespace kythe {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double MillisecondsSince(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/// \brief Wall time per extraction phase, in milliseconds.
+struct PhaseTimings {
+  double argument_setup = 0;
+  double preprocess = 0;
+  double hash = 0;
+  double kzip_write = 0;
+
+  PhaseTimings& operator+=(const PhaseTimings& other) {
+    argument_setup += other.argument_setup;
+    preprocess += other.preprocess;
+    hash += other.hash;
+    kzip_write += other.kzip_write;
+    return *this;
+  }
+};
+
+/// \brief Forwards to a real sink while recording when writing began and how
+/// long the sink's calls (and finalization) took.
+class TimingSink : public CompilationWriterSink {
+ public:
+  TimingSink(std::unique_ptr<CompilationWriterSink> sink,
+             Clock::time_point* first_write, double* sink_ms)
+      : sink_(std::move(sink)), first_write_(first_write), sink_ms_(sink_ms) {}
+
+  void OpenIndex(const std::string& unit_hash) override {
+    Timed([&] { sink_->OpenIndex(unit_hash); });
+  }
+  void WriteHeader(const kythe::proto::CompilationUnit& header) override {
+    Timed([&] { sink_->WriteHeader(header); });
+  }
+  void WriteFileContent(const kythe::proto::FileData& content) override {
+    Timed([&] { sink_->WriteFileContent(content); });
+  }
+  ~TimingSink() override {
+    // Kzip central-directory and compression finalization happens when the
+    // wrapped sink is destroyed; charge it to writing.
+    Timed([&] { sink_.reset(); });
+  }
+
+ private:
+  template <typename Fn>
+  void Timed(const Fn& fn) {
+    auto start = Clock::now();
+    if (*first_write_ == Clock::time_point()) {
+      *first_write_ = start;
+    }
+    fn();
+    *sink_ms_ += MillisecondsSince(start, Clock::now());
+  }
+
+  std::unique_ptr<CompilationWriterSink> sink_;
+  Clock::time_point* first_write_;
+  double* sink_ms_;
+};
+
+/// \brief Splits a tab-separated compile command into an argument vector
+/// whose first element is this binary (standing in for the compiler).
+std::vector<std::string> ParseCommand(const char* self,
+                                      const std::string& line) {
+  std::vector<std::string> args;
+  args.push_back(self);
+  size_t begin = 0;
+  while (begin <= line.size()) {
+    size_t end = line.find('\t', begin);
+    if (end == std::string::npos) {
+      end = line.size();
+    }
+    if (end > begin) {
+      args.push_back(line.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+  return args;
+}
+
+void WriteFileOrDie(const std::string& path, const std::string& content) {
+  std::ofstream file(path);
+  CHECK(file.is_open()) << "Couldn't write " << path;
+  file << content;
+  CHECK(file.good()) << "Couldn't write " << path;
+}
+
+/// \brief Generates a deterministic source tree under `root` and returns one
+/// compile command per unit. Every unit includes every header through
+/// common.h, so extraction visits a realistically wide include set.
+std::vector<std::string> GenerateSyntheticCorpus(const std::string& root,
+                                                 int units, int headers) {
+  std::string src_root = root + "/src";
+  CHECK(::mkdir(src_root.c_str(), 0755) == 0 || errno == EEXIST)
+      << "Couldn't create " << src_root;
+  std::string common = "#ifndef SYNTHETIC_COMMON_H_\n#define "
+                       "SYNTHETIC_COMMON_H_\n";
+  for (int h = 0; h < headers; ++h) {
+    std::string header = absl::StrFormat(
+        "#ifndef SYNTHETIC_HDR_%03d_H_\n#define SYNTHETIC_HDR_%03d_H_\n"
+        "namespace synthetic {\n"
+        "struct Record%03d {\n  int id;\n  double weight;\n};\n"
+        "inline int Touch%03d(const Record%03d& r) { return r.id + %d; }\n"
+        "}  // namespace synthetic\n#endif\n",
+        h, h, h, h, h, h);
+    WriteFileOrDie(absl::StrFormat("%s/hdr_%03d.h", src_root, h), header);
+    absl::StrAppendFormat(&common, "#include \"hdr_%03d.h\"\n", h);
+  }
+  absl::StrAppend(&common, "#endif\n");
+  WriteFileOrDie(src_root + "/common.h", common);
+
+  std::vector<std::string> commands;
+  commands.reserve(units);
+  for (int u = 0; u < units; ++u) {
+    std::string unit = absl::StrFormat(
+        "#include \"common.h\"\n"
+        "namespace synthetic {\n"
+        "int Unit%03d() {\n"
+        "  Record%03d r{%d, 0.5};\n"
+        "  return Touch%03d(r);\n"
+        "}\n"
+        "}  // namespace synthetic\n",
+        u, u % std::max(1, headers), u, u % std::max(1, headers));
+    std::string path = absl::StrFormat("%s/unit_%03d.cc", src_root, u);
+    WriteFileOrDie(path, unit);
+    commands.push_back(
+        absl::StrFormat("-std=c++11\t-I%s\t-c\t%s", src_root, path));
+  }
+  return commands;
+}
+
+/// \brief Extracts one command to a throwaway kzip, filling `timings`.
+/// \return false if extraction failed.
+bool ExtractCommand(const char* self, const std::string& command,
+                    const std::string& output_path, PhaseTimings* timings) {
+  ExtractorConfiguration config;
+  auto args_start = Clock::now();
+  config.SetArgs(ParseCommand(self, command));
+  timings->argument_setup += MillisecondsSince(args_start, Clock::now());
+
+  Clock::time_point first_write;
+  double sink_ms = 0;
+  auto sink = absl::make_unique<TimingSink>(
+      absl::make_unique<KzipWriterSink>(
+          output_path, KzipWriterSink::OutputPathType::SingleFile),
+      &first_write, &sink_ms);
+  auto extract_start = Clock::now();
+  bool ok = config.Extract(supported_language::Language::kCpp,
+                           std::move(sink));
+  auto extract_end = Clock::now();
+  ::unlink(output_path.c_str());
+  if (!ok || first_write == Clock::time_point()) {
+    return false;
+  }
+  timings->preprocess += MillisecondsSince(extract_start, first_write);
+  timings->kzip_write += sink_ms;
+  timings->hash += MillisecondsSince(first_write, extract_end) - sink_ms;
+  return true;
+}
+
+std::string PhaseJson(const PhaseTimings& timings) {
+  return absl::StrFormat(
+      "{\"argument_setup_ms\": %.3f, \"preprocess_ms\": %.3f, "
+      "\"hash_ms\": %.3f, \"kzip_write_ms\": %.3f}",
+      timings.argument_setup, timings.preprocess, timings.hash,
+      timings.kzip_write);
+}
+
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  absl::SetProgramUsageMessage(
+      R"(Benchmark harness for the Kythe C++ extractor.
+
+Example:
+  cxx_extractor_benchmark --iterations 5 --json_output extraction.json)");
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string work_dir = absl::GetFlag(FLAGS_work_dir);
+  CHECK(::mkdir(work_dir.c_str(), 0755) == 0 || errno == EEXIST)
+      << "Couldn't create --work_dir " << work_dir;
+
+  std::vector<std::string> commands;
+  const std::string commands_file = absl::GetFlag(FLAGS_commands_file);
+  if (commands_file.empty()) {
+    commands = GenerateSyntheticCorpus(work_dir,
+                                       absl::GetFlag(FLAGS_synthetic_units),
+                                       absl::GetFlag(FLAGS_synthetic_headers));
+  } else {
+    std::ifstream file(commands_file);
+    CHECK(file.is_open()) << "Couldn't read " << commands_file;
+    for (std::string line; std::getline(file, line);) {
+      if (!line.empty()) {
+        commands.push_back(line);
+      }
+    }
+  }
+  CHECK(!commands.empty()) << "No compile commands to replay.";
+
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+  PhaseTimings total;
+  std::string iteration_json;
+  for (int i = 0; i < iterations; ++i) {
+    PhaseTimings iteration;
+    for (size_t c = 0; c < commands.size(); ++c) {
+      std::string output =
+          absl::StrFormat("%s/out_%d_%zu.kzip", work_dir, i, c);
+      CHECK(ExtractCommand(argv[0], commands[c], output, &iteration))
+          << "Extraction failed for command: " << commands[c];
+    }
+    absl::StrAppend(&iteration_json, i == 0 ? "" : ", ",
+                    PhaseJson(iteration));
+    total += iteration;
+  }
+
+  std::string report = absl::StrFormat(
+      "{\"iterations\": %d, \"units\": %d, \"total\": %s, "
+      "\"per_iteration\": [%s]}\n",
+      iterations, static_cast<int>(commands.size()), PhaseJson(total),
+      iteration_json);
+  const std::string json_output = absl::GetFlag(FLAGS_json_output);
+  if (json_output == "-") {
+    std::cout << report;
+  } else {
+    WriteFileOrDie(json_output, report);
+  }
+  return 0;
+}
+
+}  // anonymous namespace
+}  // namespace kythe
+
+int main(int argc, char* argv[]) { return kythe::main(argc, argv); }
@@ -35,8 +35,22 @@
 // If -resource-dir (a Clang argument) is *not* provided, versions of the
 // compiler header files embedded into the extractor's executable will be
 // mapped to /kythe_builtins and used.
+//
+// If KYTHE_EXTRACTOR_SERVER is set to a positive integer N, the extractor
+// instead reads compile commands from standard input (one command per line,
+// arguments separated by tabs, without the leading compiler name) and
+// extracts up to N compilations concurrently; it prints "OK <line>" or
+// "ERR <line>" to standard output as each command finishes. This lets build
+// integrations amortize process startup over many actions.
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "glog/logging.h"
@@ -44,13 +58,110 @@
 #include "kythe/cxx/extractor/cxx_extractor.h"
 #include "kythe/cxx/extractor/language.h"
 
+namespace {
+
+/// \brief Runs one extraction for the tab-separated compile command in
+/// `line`, as if the extractor had been invoked as `self` with those
+/// arguments.
+bool ExtractOneCommand(const char* self, const std::string& line) {
+  std::vector<std::string> args;
+  args.push_back(self);
+  size_t begin = 0;
+  while (begin <= line.size()) {
+    size_t end = line.find('\t', begin);
+    if (end == std::string::npos) {
+      end = line.size();
+    }
+    if (end > begin) {
+      args.push_back(line.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+  if (args.size() <= 1) {
+    return false;
+  }
+  kythe::ExtractorConfiguration config;
+  config.SetArgs(args);
+  config.InitializeFromEnvironment();
+  return config.Extract(kythe::supported_language::Language::kCpp);
+}
+
+/// \brief Serves a stream of compile commands from standard input on `jobs`
+/// worker threads.
+/// \return 0 if every command was extracted successfully.
+int RunServerMode(const char* self, int jobs) {
+  std::mutex queue_mutex;
+  std::condition_variable queue_ready;
+  std::deque<std::pair<size_t, std::string>> queue;
+  bool input_done = false;
+  std::atomic<bool> all_ok(true);
+  std::mutex output_mutex;
+  std::vector<std::thread> workers;
+  workers.reserve(jobs);
+  for (int i = 0; i < jobs; ++i) {
+    workers.emplace_back([&] {
+      for (;;) {
+        std::pair<size_t, std::string> command;
+        {
+          std::unique_lock<std::mutex> lock(queue_mutex);
+          queue_ready.wait(lock,
+                           [&] { return input_done || !queue.empty(); });
+          if (queue.empty()) {
+            return;
+          }
+          command = std::move(queue.front());
+          queue.pop_front();
+        }
+        bool ok = ExtractOneCommand(self, command.second);
+        if (!ok) {
+          all_ok = false;
+        }
+        std::lock_guard<std::mutex> lock(output_mutex);
+        std::cout << (ok ? "OK " : "ERR ") << command.first << std::endl;
+      }
+    });
+  }
+  std::string line;
+  for (size_t line_number = 1; std::getline(std::cin, line); ++line_number) {
+    if (line.empty()) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      queue.emplace_back(line_number, std::move(line));
+    }
+    queue_ready.notify_one();
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    input_done = true;
+  }
+  queue_ready.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return all_ok ? 0 : 1;
+}
+
+}  // anonymous namespace
+
 int main(int argc, char* argv[]) {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
   google::InitGoogleLogging(argv[0]);
-  kythe::ExtractorConfiguration config;
-  config.SetArgs(std::vector<std::string>(argv, argv + argc));
-  config.InitializeFromEnvironment();
-  bool success = config.Extract(kythe::supported_language::Language::kCpp);
+  int result;
+  int server_jobs = 0;
+  if (const char* server = getenv("KYTHE_EXTRACTOR_SERVER")) {
+    server_jobs = atoi(server);
+  }
+  if (server_jobs > 0) {
+    result = RunServerMode(argv[0], server_jobs);
+  } else {
+    kythe::ExtractorConfiguration config;
+    config.SetArgs(std::vector<std::string>(argv, argv + argc));
+    config.InitializeFromEnvironment();
+    result =
+        config.Extract(kythe::supported_language::Language::kCpp) ? 0 : 1;
+  }
   google::protobuf::ShutdownProtobufLibrary();
-  return success ? 0 : 1;
+  return result;
 }
@@ -13,20 +13,40 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "glog/logging.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "kythe/cxx/extractor/bazel_artifact_reader.h"
 
 ABSL_FLAG(std::string, build_event_binary_file, "",
           "Bazel event protocol file to read");
+ABSL_FLAG(std::string, output_directory, "",
+          "If set, fetch each listed artifact file into this directory "
+          "(which must exist) in addition to listing it.");
+ABSL_FLAG(int, fetch_jobs, 8,
+          "Maximum number of artifact fetches in flight when "
+          "--output_directory is set.");
 
 namespace kythe {
 namespace {
@@ -38,7 +58,175 @@ absl::string_view Basename(absl::string_view path) {
   return path;
 }
 
-int DumpArtifacts(const std::string filename) {
+/// \brief A bounded pool of worker threads which copy artifact files into an
+/// output directory, so that fetching overlaps with event decoding.
+///
+/// Supports `file:` URIs and workspace-local paths via local copy and `data:`
+/// URIs by decoding them; other schemes are reported and counted as failures.
+class ArtifactFetcher {
+ public:
+  ArtifactFetcher(std::string output_directory, size_t jobs)
+      : output_directory_(std::move(output_directory)) {
+    jobs = jobs == 0 ? 1 : jobs;
+    workers_.reserve(jobs);
+    for (size_t i = 0; i < jobs; ++i) {
+      workers_.emplace_back(&ArtifactFetcher::Work, this);
+    }
+  }
+  ~ArtifactFetcher() { Finish(); }
+
+  /// \brief Queues `file` for fetching, blocking if too many fetches are
+  /// already in flight.
+  void Enqueue(BazelArtifactFile file) {
+    std::unique_lock<std::mutex> lock(mu_);
+    space_.wait(lock, [this] { return queue_.size() < 2 * workers_.size(); });
+    queue_.push_back(std::move(file));
+    ready_.notify_one();
+  }
+
+  /// \brief Drains the queue and joins the workers; returns the number of
+  /// files which could not be fetched.
+  int Finish() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (done_) return failures_;
+      done_ = true;
+    }
+    ready_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+    return failures_;
+  }
+
+ private:
+  void Work() {
+    for (;;) {
+      BazelArtifactFile file;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        ready_.wait(lock, [this] { return done_ || !queue_.empty(); });
+        if (queue_.empty()) return;
+        file = std::move(queue_.front());
+        queue_.pop_front();
+        space_.notify_one();
+      }
+      if (!Fetch(file)) {
+        std::lock_guard<std::mutex> lock(mu_);
+        ++failures_;
+      }
+    }
+  }
+
+  bool Fetch(const BazelArtifactFile& file) {
+    const std::string dest =
+        output_directory_ + "/" +
+        std::string(Basename(file.uri.empty() ? file.local_path : file.uri));
+    absl::string_view uri = file.uri;
+    if (absl::ConsumePrefix(&uri, "data:base64,")) {
+      std::string content;
+      if (!absl::Base64Unescape(uri, &content)) {
+        LOG(ERROR) << "Malformed data URI for " << file.local_path;
+        return false;
+      }
+      std::ofstream out(dest, std::ios::binary | std::ios::trunc);
+      out << content;
+      out.close();
+      return out.good();
+    }
+    std::string source;
+    if (absl::ConsumePrefix(&uri, "file://")) {
+      source = std::string(uri);
+    } else if (!file.local_path.empty()) {
+      // Remote schemes are unsupported; fall back to the workspace-local
+      // path, which is valid when running where the build ran.
+      source = file.local_path;
+    } else {
+      LOG(WARNING) << "Unsupported artifact URI: " << file.uri;
+      return false;
+    }
+    return Copy(source, dest);
+  }
+
+  bool Copy(const std::string& source, const std::string& dest) {
+    struct stat source_info;
+    if (::stat(source.c_str(), &source_info) != 0) {
+      LOG(ERROR) << "Error opening " << source << ": "
+                 << std::strerror(errno);
+      return false;
+    }
+    // Artifact names embed their action's id, so a destination of the same
+    // name and size is an already-fetched copy and can be skipped.
+    struct stat dest_info;
+    if (::stat(dest.c_str(), &dest_info) == 0 &&
+        dest_info.st_size == source_info.st_size) {
+      return true;
+    }
+    std::ifstream in(source, std::ios::binary);
+    std::ofstream out(dest, std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+    out.close();
+    if (!in || !out) {
+      LOG(ERROR) << "Error copying " << source << " to " << dest;
+      return false;
+    }
+    return true;
+  }
+
+  const std::string output_directory_;
+
+  std::mutex mu_;
+  std::condition_variable ready_;
+  std::condition_variable space_;
+  std::deque<BazelArtifactFile> queue_;
+  bool done_ = false;
+  int failures_ = 0;
+  std::vector<std::thread> workers_;
+};
+
+template <typename Reader>
+int Drain(Reader& artifacts, ArtifactFetcher* fetcher) {
+  for (; !artifacts.Done(); artifacts.Next()) {
+    std::cout << artifacts.Ref().label << std::endl;
+    for (auto& file : artifacts.Ref().files) {
+      std::cout << "  " << Basename(file.uri) << std::endl;
+      if (fetcher != nullptr) {
+        fetcher->Enqueue(std::move(file));
+      }
+    }
+  }
+  int failures = fetcher != nullptr ? fetcher->Finish() : 0;
+  if (!artifacts.status().ok()) {
+    LOG(ERROR) << artifacts.status();
+  }
+
+  return !artifacts.status().ok() || failures != 0;
+}
+
+int DumpFromEvents(BazelEventReaderInterface& events) {
+  const std::string output_directory = absl::GetFlag(FLAGS_output_directory);
+  if (output_directory.empty()) {
+    BazelArtifactReader artifacts(&events);
+    return Drain(artifacts, nullptr);
+  }
+  // When fetching, decode and select on a background thread so that reading
+  // the event stream overlaps with copying artifacts.
+  ArtifactFetcher fetcher(output_directory,
+                          absl::GetFlag(FLAGS_fetch_jobs) < 1
+                              ? 1
+                              : absl::GetFlag(FLAGS_fetch_jobs));
+  PipelinedBazelArtifactReader artifacts(&events);
+  return Drain(artifacts, &fetcher);
+}
+
+/// \brief Returns true for event ids the stock artifact selectors inspect;
+/// everything else can be skipped without decoding its payload.
+bool IsArtifactEventId(const build_event_stream::BuildEventId& id) {
+  return id.has_action_completed() || id.has_named_set() ||
+         id.has_target_completed();
+}
+
+int DumpArtifactsFromStream(const std::string& filename) {
   std::ifstream file(filename);
   if (!file.is_open()) {
     LOG(ERROR) << "Error opening " << filename << ": " << std::strerror(errno);
@@ -47,18 +235,39 @@ int DumpArtifacts(const std::string filename) {
 
   google::protobuf::io::IstreamInputStream input(&file);
   BazelEventReader events(&input);
-  BazelArtifactReader artifacts(&events);
-  for (; !artifacts.Done(); artifacts.Next()) {
-    std::cout << artifacts.Ref().label << std::endl;
-    for (const auto& [local_path, uri] : artifacts.Ref().files) {
-      std::cout << "  " << Basename(uri) << std::endl;
-    }
+  return DumpFromEvents(events);
+}
+
+int DumpArtifacts(const std::string& filename) {
+  // Prefer decoding in place from a mapping of the (potentially multi-GiB)
+  // event file; fall back to the streaming reader when it can't be mapped.
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Error opening " << filename << ": " << std::strerror(errno);
+    return 1;
   }
-  if (!artifacts.status().ok()) {
-    LOG(ERROR) << artifacts.status();
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+    ::close(fd);
+    return DumpArtifactsFromStream(filename);
+  }
+  void* data =
+      ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, /*offset=*/0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return DumpArtifactsFromStream(filename);
   }
+  ::madvise(data, info.st_size, MADV_SEQUENTIAL);
 
-  return !artifacts.status().ok();
+  int result;
+  {
+    FlatBazelEventReader events(
+        absl::string_view(static_cast<const char*>(data), info.st_size),
+        IsArtifactEventId);
+    result = DumpFromEvents(events);
+  }
+  ::munmap(data, info.st_size);
+  return result;
 }
 }  // namespace
 }  // namespace kythe
@@ -16,9 +16,16 @@
 
 #include "objc_bazel_support.h"
 
+#include <llvm/ADT/StringExtras.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/Support/SHA1.h>
+#include <unistd.h>
 
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <sstream>
+#include <unordered_map>
 
 #include "re2/re2.h"
 
@@ -69,6 +76,56 @@ std::string RunScript(const std::string& cmd) {
   return std::string(llvm::StringRef(output).trim());
 }
 
+namespace {
+
+/// \brief Returns the on-disk cache path for `cmd`, or the empty string if
+/// disk caching is not configured.
+std::string ScriptResultCachePath(const std::string& cmd) {
+  const char* cache_dir = ::getenv("KYTHE_SCRIPT_RESULT_CACHE_DIR");
+  if (cache_dir == nullptr || cache_dir[0] == '\0') {
+    return "";
+  }
+  llvm::SHA1 hash;
+  hash.update(cmd);
+  return std::string(cache_dir) + "/" + llvm::toHex(hash.final());
+}
+
+}  // anonymous namespace
+
+std::string RunScriptCached(const std::string& cmd) {
+  static auto* memo = new std::unordered_map<std::string, std::string>();
+  auto existing = memo->find(cmd);
+  if (existing != memo->end()) {
+    return existing->second;
+  }
+  const std::string cache_path = ScriptResultCachePath(cmd);
+  if (!cache_path.empty()) {
+    std::ifstream cached(cache_path);
+    if (cached) {
+      std::stringstream content;
+      content << cached.rdbuf();
+      auto output = content.str();
+      (*memo)[cmd] = output;
+      return output;
+    }
+  }
+  auto output = RunScript(cmd);
+  (*memo)[cmd] = output;
+  if (!cache_path.empty() && !output.empty()) {
+    // Write-then-rename keeps concurrent extractor processes from observing
+    // a partially written entry.
+    std::string temp_path =
+        cache_path + ".tmp." + std::to_string(::getpid());
+    std::ofstream temp(temp_path, std::ios::trunc);
+    temp << output;
+    temp.close();
+    if (!temp || std::rename(temp_path.c_str(), cache_path.c_str()) != 0) {
+      std::remove(temp_path.c_str());
+    }
+  }
+  return output;
+}
+
 void FillWithFixedArgs(std::vector<std::string>& args,
                        const blaze::CppCompileInfo& ci,
                        const std::string& devdir, const std::string& sdkroot) {
@@ -49,6 +49,18 @@ std::string BuildEnvVarCommandPrefix(
 /// \brief Run a command and capture its (trimmed) stdout in a string.
 std::string RunScript(const std::string& cmd);
 
+/// \brief Like `RunScript`, but memoizes results keyed by the full command.
+///
+/// Results are cached in memory for the life of the process. If the
+/// KYTHE_SCRIPT_RESULT_CACHE_DIR environment variable names a directory, they
+/// are also cached there so the thousands of extractor processes spawned by a
+/// build each run a given resolution script at most once per build tree.
+/// Commands producing empty output are never cached on disk, so transient
+/// failures do not stick. Only use this for commands whose output depends
+/// solely on the command itself (like the SDK/developer-dir resolution
+/// scripts).
+std::string RunScriptCached(const std::string& cmd);
+
 // \brief Populate args with the arguments from ci where the magic bazel strings
 // have been replaced with their actual values.
 void FillWithFixedArgs(std::vector<std::string>& args,
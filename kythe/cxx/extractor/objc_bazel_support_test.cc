@@ -144,6 +144,13 @@ TEST(ObjcExtractorBazelMain, TestRunScriptThatFails) {
   EXPECT_EQ("", RunScript("ls --fail"));
 }
 
+// The cached variant should return the memoized output even if the command
+// would produce something different the second time.
+TEST(ObjcExtractorBazelMain, TestRunScriptCached) {
+  const std::string cmd = "date '+%s %N'";
+  EXPECT_EQ(RunScriptCached(cmd), RunScriptCached(cmd));
+}
+
 // This test passes on linux (2016-09-09). It seems too dangerous to call out
 // to an unknown binary, so this test is commented out so it does not run
 // automatically.
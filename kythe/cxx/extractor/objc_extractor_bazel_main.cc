@@ -66,19 +66,17 @@
 //    srcs = ["get_sdkroot.sh"],
 //  )
 
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <unistd.h>
-
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/strings/str_format.h"
 #include "cxx_extractor.h"
 #include "glog/logging.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/stubs/common.h"
+#include "kythe/cxx/common/file_utils.h"
 #include "kythe/cxx/common/path_utils.h"
 #include "kythe/cxx/extractor/language.h"
 #include "objc_bazel_support.h"
@@ -110,20 +108,18 @@ static bool ContainsUnsupportedArg(const std::vector<std::string>& args) {
 static bool LoadSpawnInfo(const XAState& xa_state,
                           const blaze::ExtraActionInfo& info,
                           kythe::ExtractorConfiguration& config) {
-  blaze::SpawnInfo spawn_info = info.GetExtension(blaze::SpawnInfo::spawn_info);
+  const blaze::SpawnInfo& spawn_info =
+      info.GetExtension(blaze::SpawnInfo::spawn_info);
 
   std::vector<std::string> args;
   // If the user didn't specify a script path, don't mutate the arguments in the
   // extra action.
   if (xa_state.devdir_script.empty() || xa_state.sdkroot_script.empty()) {
-    for (const auto& i : spawn_info.argument()) {
-      std::string arg = i;
-      args.push_back(arg);
-    }
+    args.assign(spawn_info.argument().begin(), spawn_info.argument().end());
   } else {
     auto cmdPrefix = kythe::BuildEnvVarCommandPrefix(spawn_info.variable());
-    auto devdir = kythe::RunScript(cmdPrefix + xa_state.devdir_script);
-    auto sdkroot = kythe::RunScript(cmdPrefix + xa_state.sdkroot_script);
+    auto devdir = kythe::RunScriptCached(cmdPrefix + xa_state.devdir_script);
+    auto sdkroot = kythe::RunScriptCached(cmdPrefix + xa_state.sdkroot_script);
 
     kythe::FillWithFixedArgs(args, spawn_info, devdir, sdkroot);
   }
@@ -147,22 +143,21 @@ static bool LoadSpawnInfo(const XAState& xa_state,
 static bool LoadCppInfo(const XAState& xa_state,
                         const blaze::ExtraActionInfo& info,
                         kythe::ExtractorConfiguration& config) {
-  blaze::CppCompileInfo cpp_info =
+  const blaze::CppCompileInfo& cpp_info =
       info.GetExtension(blaze::CppCompileInfo::cpp_compile_info);
 
   std::vector<std::string> args;
   // If the user didn't specify a script path, don't mutate the arguments in the
   // extra action.
   if (xa_state.devdir_script.empty() || xa_state.sdkroot_script.empty()) {
+    args.reserve(cpp_info.compiler_option_size() + 1);
     args.push_back(cpp_info.tool());
-    for (const auto& i : cpp_info.compiler_option()) {
-      std::string arg = i;
-      args.push_back(arg);
-    }
+    args.insert(args.end(), cpp_info.compiler_option().begin(),
+                cpp_info.compiler_option().end());
   } else {
     auto cmdPrefix = kythe::BuildEnvVarCommandPrefix(cpp_info.variable());
-    auto devdir = kythe::RunScript(cmdPrefix + xa_state.devdir_script);
-    auto sdkroot = kythe::RunScript(cmdPrefix + xa_state.sdkroot_script);
+    auto devdir = kythe::RunScriptCached(cmdPrefix + xa_state.devdir_script);
+    auto sdkroot = kythe::RunScriptCached(cmdPrefix + xa_state.sdkroot_script);
 
     kythe::FillWithFixedArgs(args, cpp_info, devdir, sdkroot);
   }
@@ -184,20 +179,25 @@ static bool LoadCppInfo(const XAState& xa_state,
 static bool LoadExtraAction(const XAState& xa_state,
                             kythe::ExtractorConfiguration& config) {
   using namespace google::protobuf::io;
-  blaze::ExtraActionInfo info;
-  int fd =
-      open(xa_state.extra_action_file.c_str(), O_RDONLY, S_IREAD | S_IWRITE);
-  CHECK_GE(fd, 0) << "Couldn't open input file " << xa_state.extra_action_file;
-  FileInputStream file_input_stream(fd);
-  CodedInputStream coded_input_stream(&file_input_stream);
+  auto content = kythe::MappedFile::Open(xa_state.extra_action_file);
+  CHECK(content.ok()) << "Couldn't open input file "
+                      << xa_state.extra_action_file << ": " << content.status();
+  // Parse into an arena so the decoded message (and the SpawnInfo or
+  // CppCompileInfo extension reachable from it) makes no per-field heap
+  // allocations and is freed in one shot.
+  google::protobuf::Arena arena;
+  auto* info =
+      google::protobuf::Arena::CreateMessage<blaze::ExtraActionInfo>(&arena);
+  ArrayInputStream array_input_stream(
+      content->content().data(), static_cast<int>(content->content().size()));
+  CodedInputStream coded_input_stream(&array_input_stream);
   coded_input_stream.SetTotalBytesLimit(INT_MAX);
-  CHECK(info.ParseFromCodedStream(&coded_input_stream));
-  close(fd);
+  CHECK(info->ParseFromCodedStream(&coded_input_stream));
 
-  if (info.HasExtension(blaze::SpawnInfo::spawn_info)) {
-    return LoadSpawnInfo(xa_state, info, config);
-  } else if (info.HasExtension(blaze::CppCompileInfo::cpp_compile_info)) {
-    return LoadCppInfo(xa_state, info, config);
+  if (info->HasExtension(blaze::SpawnInfo::spawn_info)) {
+    return LoadSpawnInfo(xa_state, *info, config);
+  } else if (info->HasExtension(blaze::CppCompileInfo::cpp_compile_info)) {
+    return LoadCppInfo(xa_state, *info, config);
   }
   LOG(ERROR)
       << "ObjcCompile Extra Action didn't have SpawnInfo or CppCompileInfo.";
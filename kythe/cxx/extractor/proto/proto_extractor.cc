@@ -174,9 +174,11 @@ void ProtoExtractor::ConfigureFromEnv() {
   // Configure VName generator.
   const char* vname_path = getenv("KYTHE_VNAMES");
   if (vname_path && strlen(vname_path) > 0) {
-    std::string json = LoadFileOrDie(vname_path);
+    auto json = MappedFile::Open(vname_path);
+    CHECK(json.ok()) << "Couldn't open vname configuration " << vname_path
+                     << ": " << json.status();
     std::string error_text;
-    CHECK(vname_gen.LoadJsonString(json, &error_text))
+    CHECK(vname_gen.LoadConfigString(json->content(), &error_text))
         << "Could not parse vname generator configuration: " << error_text;
   }
 }
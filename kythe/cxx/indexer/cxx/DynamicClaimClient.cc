@@ -18,21 +18,30 @@
 #include <libmemcached/memcached.h>
 #include <openssl/sha.h>
 
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
 #include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "kythe/cxx/common/vname_key.h"
 #include "kythe/cxx/common/vname_ordering.h"
 
 namespace kythe {
 namespace {
 using Hash = unsigned char[SHA256_DIGEST_LENGTH];
 
+/// \brief Hashes the canonical key encoding of `vname` (see `EncodeVNameKey`)
+/// together with `count`. The length-prefixed encoding keeps distinct VNames
+/// from colliding on concatenated field contents.
 void HashVName(const kythe::proto::VName& vname, size_t count, Hash* hash) {
+  VNameKeyBuffer key;
+  EncodeVNameKey(vname, &key);
   ::SHA256_CTX sha;
   ::SHA256_Init(&sha);
-  ::SHA256_Update(&sha, vname.signature().c_str(), vname.signature().size());
-  ::SHA256_Update(&sha, vname.path().c_str(), vname.path().size());
-  ::SHA256_Update(&sha, vname.language().c_str(), vname.language().size());
-  ::SHA256_Update(&sha, vname.root().c_str(), vname.root().size());
-  ::SHA256_Update(&sha, vname.corpus().c_str(), vname.corpus().size());
+  ::SHA256_Update(&sha, key.data(), key.size());
   ::SHA256_Update(&sha, &count, sizeof(count));
   ::SHA256_Final(reinterpret_cast<unsigned char*>(hash), &sha);
 }
@@ -47,6 +56,48 @@ DynamicClaimClient::~DynamicClaimClient() {
       stderr, "%8lu  %8lu claims approved/rejected (%f reject fraction)\n",
       request_count_ - rejected_requests_, rejected_requests_,
       request_count_ == 0 ? 0.0 : (double)rejected_requests_ / request_count_);
+  absl::FPrintF(
+      stderr,
+      "%8lu  %8lu claims cached/asked (%f hit fraction; %lu expired, %lu "
+      "evicted)\n",
+      cache_hits_, request_count_ - cache_hits_,
+      request_count_ == 0 ? 0.0 : (double)cache_hits_ / request_count_,
+      cache_expired_, cache_evictions_);
+}
+
+void DynamicClaimClient::StoreDecision(absl::string_view key,
+                                       const kythe::proto::VName& claimant,
+                                       absl::Time expires) {
+  if (decision_cache_max_entries_ != 0 &&
+      claim_table_.size() >= decision_cache_max_entries_ &&
+      !claim_table_.contains(key)) {
+    // Drop lapsed outcomes first; they would be discarded on lookup anyway.
+    const absl::Time now = absl::Now();
+    for (auto it = claim_table_.begin();
+         it != claim_table_.end() &&
+         claim_table_.size() >= decision_cache_max_entries_;) {
+      if (it->second.expires <= now) {
+        claim_table_.erase(it++);
+        ++cache_expired_;
+      } else {
+        ++it;
+      }
+    }
+    // Still full: evict arbitrary expirable entries. `AssignClaim` overrides
+    // never expire and are never evicted, as dropping one would change claim
+    // results rather than merely re-ask memcached.
+    for (auto it = claim_table_.begin();
+         it != claim_table_.end() &&
+         claim_table_.size() >= decision_cache_max_entries_;) {
+      if (it->second.expires != absl::InfiniteFuture()) {
+        claim_table_.erase(it++);
+        ++cache_evictions_;
+      } else {
+        ++it;
+      }
+    }
+  }
+  claim_table_[std::string(key)] = CachedDecision{claimant, expires};
 }
 
 bool DynamicClaimClient::OpenMemcache(const std::string& spec) {
@@ -58,6 +109,9 @@ bool DynamicClaimClient::OpenMemcache(const std::string& spec) {
   spec_amend.append(" --BINARY-PROTOCOL");
   cache_ = memcached(spec_amend.c_str(), spec_amend.size());
   if (cache_ != nullptr) {
+    // Pipeline commands instead of waiting for each reply in turn.
+    memcached_behavior_set(cache_, MEMCACHED_BEHAVIOR_NO_BLOCK, 1);
+    memcached_behavior_set(cache_, MEMCACHED_BEHAVIOR_TCP_NODELAY, 1);
     memcached_return_t remote_version = memcached_version(cache_);
     return memcached_success(remote_version);
   }
@@ -72,18 +126,67 @@ bool DynamicClaimClient::Claim(const kythe::proto::VName& claimant,
   // If a claim exists in the cache (and isn't in the local claim_table_),
   // regardless of whether it was ours, we assume that we do not own it.
   ++request_count_;
-  const auto lookup = claim_table_.find(vname);
+  VNameKeyBuffer key_buffer;
+  const absl::string_view key = VNameKey(vname, &key_buffer);
+  auto lookup = claim_table_.find(key);
+  if (lookup != claim_table_.end() && lookup->second.expires <= absl::Now()) {
+    // The outcome lapsed; ask memcached again.
+    claim_table_.erase(lookup);
+    lookup = claim_table_.end();
+    ++cache_expired_;
+  }
   if (lookup == claim_table_.end()) {
     if (!cache_) {
       // Fail open.
       return true;
     }
-    Hash claimant_hash, vname_hash;
+    Hash claimant_hash;
     HashVName(claimant, 0, &claimant_hash);
+    // Probe all claim slots in a single pipelined mget instead of issuing
+    // up to max_redundant_claims_ serial adds; only slots the batch reported
+    // as empty are then contended for with an add.
+    std::vector<std::array<unsigned char, SHA256_DIGEST_LENGTH>> try_hashes(
+        max_redundant_claims_);
+    std::vector<bool> slot_taken(max_redundant_claims_, false);
+    for (size_t tries = 0; tries < max_redundant_claims_; ++tries) {
+      HashVName(vname, tries, reinterpret_cast<Hash*>(try_hashes[tries].data()));
+    }
+    if (max_redundant_claims_ > 1) {
+      std::vector<const char*> keys(max_redundant_claims_);
+      std::vector<size_t> key_lengths(max_redundant_claims_,
+                                      SHA256_DIGEST_LENGTH);
+      for (size_t tries = 0; tries < max_redundant_claims_; ++tries) {
+        keys[tries] = reinterpret_cast<const char*>(try_hashes[tries].data());
+      }
+      memcached_return_t mget_result = memcached_mget(
+          cache_, keys.data(), key_lengths.data(), max_redundant_claims_);
+      if (memcached_success(mget_result)) {
+        char key[MEMCACHED_MAX_KEY];
+        size_t key_length;
+        size_t value_length;
+        uint32_t flags;
+        memcached_return_t fetch_result;
+        while (char* value = memcached_fetch(cache_, key, &key_length,
+                                             &value_length, &flags,
+                                             &fetch_result)) {
+          for (size_t tries = 0; tries < max_redundant_claims_; ++tries) {
+            if (key_length == SHA256_DIGEST_LENGTH &&
+                memcmp(key, try_hashes[tries].data(), SHA256_DIGEST_LENGTH) ==
+                    0) {
+              slot_taken[tries] = true;
+              break;
+            }
+          }
+          free(value);
+        }
+      }
+    }
     for (size_t tries = 0; tries < max_redundant_claims_; ++tries) {
-      HashVName(vname, tries, &vname_hash);
+      if (slot_taken[tries]) {
+        continue;
+      }
       memcached_return_t add_result = memcached_add(
-          cache_, reinterpret_cast<const char*>(&vname_hash),
+          cache_, reinterpret_cast<const char*>(try_hashes[tries].data()),
           SHA256_DIGEST_LENGTH, reinterpret_cast<const char*>(&claimant_hash),
           SHA256_DIGEST_LENGTH, 0, 0);
       if (!memcached_success(add_result) &&
@@ -93,17 +196,19 @@ bool DynamicClaimClient::Claim(const kythe::proto::VName& claimant,
                       memcached_strerror(cache_, add_result));
       }
       if (add_result != MEMCACHED_DATA_EXISTS) {
-        claim_table_[vname] = claimant;
+        StoreDecision(key, claimant, absl::Now() + decision_cache_ttl_);
         return true;
       }
     }
     // We failed all our tries, so assume we couldn't make a claim.
-    claim_table_[vname] = kythe::proto::VName();
+    StoreDecision(key, kythe::proto::VName(),
+                  absl::Now() + decision_cache_ttl_);
     ++rejected_requests_;
     return false;
   }
 
-  if (VNameEquals(lookup->second, claimant)) {
+  ++cache_hits_;
+  if (VNameEquals(lookup->second.claimant, claimant)) {
     return true;
   } else {
     ++rejected_requests_;
@@ -113,6 +218,7 @@ bool DynamicClaimClient::Claim(const kythe::proto::VName& claimant,
 
 void DynamicClaimClient::AssignClaim(const kythe::proto::VName& claimable,
                                      const kythe::proto::VName& claimant) {
-  claim_table_[claimable] = claimant;
+  VNameKeyBuffer key;
+  StoreDecision(VNameKey(claimable, &key), claimant, absl::InfiniteFuture());
 }
 }  // namespace kythe
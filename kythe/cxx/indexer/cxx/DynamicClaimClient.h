@@ -16,9 +16,11 @@
 #ifndef DYNAMIC_CXX_INDEXER_CXX_DYNAMIC_CLAIM_CLIENT_H_
 #define DYNAMIC_CXX_INDEXER_CXX_DYNAMIC_CLAIM_CLIENT_H_
 
-#include <map>
+#include <string>
 
-#include "kythe/cxx/common/vname_ordering.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "kythe/cxx/indexer/cxx/KytheClaimClient.h"
 #include "kythe/proto/storage.pb.h"
 
@@ -50,19 +52,60 @@ class DynamicClaimClient : public KytheClaimClient {
   /// Change how many times the same VName can be claimed.
   void set_max_redundant_claims(size_t value) { max_redundant_claims_ = value; }
 
+  /// \brief Limits the local decision cache to `value` entries (0 for
+  /// unbounded). Overrides stored by `AssignClaim` are never evicted.
+  void set_decision_cache_max_entries(size_t value) {
+    decision_cache_max_entries_ = value;
+  }
+
+  /// \brief Expires locally cached claim outcomes after `value`, after which
+  /// the claim question is asked of memcached again. Note that re-asking may
+  /// reject a claimable this process previously claimed; this class is
+  /// already permitted to drop entries.
+  void set_decision_cache_ttl(absl::Duration value) {
+    decision_cache_ttl_ = value;
+  }
+
   void Reset() override { claim_table_.clear(); }
 
  private:
-  /// A local map from claimables to claimants.
-  std::map<kythe::proto::VName, kythe::proto::VName, VNameLess> claim_table_;
+  /// \brief A locally cached claim outcome.
+  struct CachedDecision {
+    /// The claimant the claimable was resolved to; empty if the claim was
+    /// rejected everywhere.
+    kythe::proto::VName claimant;
+    /// When this outcome stops being trusted. Overrides from `AssignClaim`
+    /// never expire.
+    absl::Time expires = absl::InfiniteFuture();
+  };
+
+  /// \brief Records an outcome for the claimable with canonical key `key`,
+  /// evicting expired (then arbitrary expirable) entries to respect
+  /// `decision_cache_max_entries_`.
+  void StoreDecision(absl::string_view key,
+                     const kythe::proto::VName& claimant, absl::Time expires);
+
+  /// A local map from canonical claimable keys (see `VNameKey`) to cached
+  /// outcomes, consulted before the network.
+  absl::flat_hash_map<std::string, CachedDecision> claim_table_;
   /// A remote map used for dynamic queries.
   ::memcached_st* cache_ = nullptr;
   /// The maximum number of times a VName can be claimed.
   size_t max_redundant_claims_ = 1;
+  /// The maximum number of entries in `claim_table_` (0 for unbounded).
+  size_t decision_cache_max_entries_ = 1024 * 1024;
+  /// How long a cached outcome from memcached stays valid.
+  absl::Duration decision_cache_ttl_ = absl::InfiniteDuration();
   /// The number of claim requests ever made.
   size_t request_count_ = 0;
   /// The number of claim requests that were rejected (after all tries).
   size_t rejected_requests_ = 0;
+  /// The number of claim requests answered from `claim_table_`.
+  size_t cache_hits_ = 0;
+  /// The number of cached outcomes discarded because their TTL lapsed.
+  size_t cache_expired_ = 0;
+  /// The number of unexpired outcomes evicted to respect the size cap.
+  size_t cache_evictions_ = 0;
 };
 
 }  // namespace kythe
@@ -41,25 +41,18 @@ static bool SpellingLocIsImaginary(const clang::SourceManager& SM,
 /// name in the DECLARE_ or DEFINE_ macro that declared it; otherwise returns an
 /// invalid range.
 ///
-/// This function is used in two contexts: first, if you have a variable
-/// declaration statement, it will tell you whether that declaration came from a
-/// googleflags macro. Second, if you have a reference to a variable at some
-/// location in the source text (e.g., a DeclRefExpr), it will tell you
-/// whether the VarDecl came from a googleflags macro _and_ whether the location
-/// at which the reference expression was made was internal to googleflags.
-/// These internal references are googleflags implementation details and are
-/// uninteresting to index as high-level references to flag nodes.
+/// This function answers the declaration-side question only: given a variable
+/// declaration, it tells you whether that declaration came from a googleflags
+/// macro. Reference sites must separately reject locations internal to
+/// googleflags (see `RefLocIsInternal`); those references are googleflags
+/// implementation details and are uninteresting to index as high-level
+/// references to flag nodes.
 ///
 /// \param LO The LangOptions used to check the input AST.
-/// \param Decl The VarDecl that may belong to a flag.
-/// \param RefLoc If valid, the location of the reference made to Decl.
-static clang::SourceRange GetVarDeclFlagDeclLoc(
-    const clang::LangOptions& LO, const clang::VarDecl* Decl,
-    clang::SourceLocation RefLoc = clang::SourceLocation()) {
-  // Quickly bail out if this isn't "FLAGS_foo":
-  if (!Decl->getName().startswith("FLAGS_")) {
-    return clang::SourceLocation();
-  }
+/// \param Decl The VarDecl that may belong to a flag; its name must start
+/// with FLAGS_ (callers check this before consulting their cache).
+static clang::SourceRange GetVarDeclFlagDeclLoc(const clang::LangOptions& LO,
+                                                const clang::VarDecl* Decl) {
   clang::SourceLocation Loc = Decl->getLocation();
   // Look for an identifier that's a token paste (so it lives inside the
   // scratch buffer).
@@ -68,12 +61,6 @@ static clang::SourceRange GetVarDeclFlagDeclLoc(
   }
   const auto& Context = Decl->getASTContext();
   const auto& SM = Context.getSourceManager();
-  // Reject references that come from imaginary places (like token pastes in
-  // flags headers).
-  if (RefLoc.isValid() && RefLoc.isMacroID() &&
-      SpellingLocIsImaginary(SM, SM.getSpellingLoc(RefLoc))) {
-    return clang::SourceLocation();
-  }
   auto SpellingLoc = SM.getSpellingLoc(Loc);
   if (!SpellingLocIsImaginary(SM, SpellingLoc)) {
     return clang::SourceLocation();
@@ -163,6 +150,28 @@ static clang::SourceRange GetVarDeclFlagDeclLoc(
   return clang::SourceLocation();
 }
 
+/// \return true if the reference at `RefLoc` comes from an imaginary place
+/// (like token pastes in flags headers) and should not be indexed.
+static bool RefLocIsInternal(const clang::SourceManager& SM,
+                             clang::SourceLocation RefLoc) {
+  return RefLoc.isValid() && RefLoc.isMacroID() &&
+         SpellingLocIsImaginary(SM, SM.getSpellingLoc(RefLoc));
+}
+
+clang::SourceRange GoogleFlagsLibrarySupport::LookupFlagDeclLoc(
+    const clang::LangOptions& LO, const clang::VarDecl* Decl) {
+  // Quickly bail out if this isn't "FLAGS_foo"; this also keeps ordinary
+  // variables out of the cache.
+  if (!Decl->getName().startswith("FLAGS_")) {
+    return clang::SourceLocation();
+  }
+  auto [It, Inserted] = FlagDeclLocs.try_emplace(Decl);
+  if (Inserted) {
+    It->second = GetVarDeclFlagDeclLoc(LO, Decl);
+  }
+  return It->second;
+}
+
 /// \brief Given the NodeId of the primary variable defn or decl of a flag,
 /// returns a NodeId for the flag itself.
 /// \param VarId the NodeId for the flag's primary variable (not a _no or _nono)
@@ -180,7 +189,7 @@ void GoogleFlagsLibrarySupport::InspectVariable(
     return;
   }
   GraphObserver& GO = V.getGraphObserver();
-  auto Range = GetVarDeclFlagDeclLoc(*GO.getLangOptions(), Decl);
+  auto Range = LookupFlagDeclLoc(*GO.getLangOptions(), Decl);
   if (Range.isValid()) {
     auto FlagName = clang::Lexer::getSourceText(
         clang::Lexer::getAsCharRange(Range,
@@ -201,7 +210,7 @@ void GoogleFlagsLibrarySupport::InspectVariable(
       for (const auto& C : Compls) {
         if (const auto* NextDecl = llvm::dyn_cast<clang::VarDecl>(C.Decl)) {
           auto NextDeclRange =
-              GetVarDeclFlagDeclLoc(*GO.getLangOptions(), NextDecl);
+              LookupFlagDeclLoc(*GO.getLangOptions(), NextDecl);
           if (NextDeclRange.isValid()) {
             clang::FileID NextDeclFile =
                 GO.getSourceManager()->getFileID(NextDeclRange.getBegin());
@@ -228,8 +237,10 @@ void GoogleFlagsLibrarySupport::InspectDeclRef(
     // We only care about VarDecls.
     return;
   }
-  auto Range = GetVarDeclFlagDeclLoc(*GO.getLangOptions(), VD, DeclRefLocation);
-  if (Range.isValid()) {
+  auto Range = LookupFlagDeclLoc(*GO.getLangOptions(), VD);
+  if (Range.isValid() &&
+      !RefLocIsInternal(VD->getASTContext().getSourceManager(),
+                        DeclRefLocation)) {
     GO.recordDeclUseLocation(Ref, NodeIdForFlag(RefId),
                              GraphObserver::Claimability::Unclaimable,
                              V.IsImplicit(Ref));
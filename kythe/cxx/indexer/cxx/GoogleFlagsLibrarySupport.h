@@ -23,6 +23,7 @@
 #include "IndexerLibrarySupport.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/Expr.h"
+#include "llvm/ADT/DenseMap.h"
 
 namespace kythe {
 
@@ -46,6 +47,21 @@ class GoogleFlagsLibrarySupport : public LibrarySupport {
                       const GraphObserver::Range& Ref,
                       GraphObserver::NodeId& RefId,
                       const clang::NamedDecl* TargetDecl) override;
+
+ private:
+  /// \brief Returns the range covering `Decl`'s flag name in the DECLARE_ or
+  /// DEFINE_ macro that declared it, or an invalid range if `Decl` is not a
+  /// flag, memoizing the answer per decl.
+  clang::SourceRange LookupFlagDeclLoc(const clang::LangOptions& LO,
+                                       const clang::VarDecl* Decl);
+
+  // Whether a decl is a flag (and where its name was written) is determined
+  // by lexing around the decl's macro expansion, which is too slow to repeat
+  // for every reference in flag-heavy code. This maps each FLAGS_-prefixed
+  // VarDecl inspected so far to its flag-name range (invalid for the ones
+  // that turned out not to be flags). Variables without the FLAGS_ prefix
+  // are rejected before the cache, so it stays small.
+  llvm::DenseMap<const clang::VarDecl*, clang::SourceRange> FlagDeclLocs;
 };
 
 }  // namespace kythe
@@ -18,6 +18,8 @@
 
 #include <openssl/sha.h>  // for SHA256
 
+#include "absl/container/node_hash_set.h"
+#include "absl/memory/memory.h"
 #include "absl/strings/escaping.h"
 
 namespace kythe {
@@ -43,4 +45,39 @@ std::string CompressString(absl::string_view InString, bool Force) {
   return Result;
 }
 
+struct NodeIdentityInternTable {
+  absl::node_hash_set<std::string> Strings;
+};
+
+namespace {
+/// The table `InternNodeIdentity` currently draws from. Null until the first
+/// intern outside any `NodeIdentityInternScope`, in which case a
+/// process-lifetime fallback table is installed (this happens only in tests
+/// and tools that mint NodeIds without running a compilation).
+NodeIdentityInternTable* CurrentInternTable = nullptr;
+}  // anonymous namespace
+
+const std::string* InternNodeIdentity(const std::string& Identity) {
+  // `node_hash_set` guarantees pointer stability for its elements, so the
+  // returned pointer remains valid as long as its table does. Identities
+  // repeat heavily within a translation unit (type and template signatures in
+  // particular), so the table stays small relative to the number of NodeIds
+  // minted. NodeIds are only constructed from the thread driving the
+  // compilation, so the table is unsynchronized.
+  if (CurrentInternTable == nullptr) {
+    CurrentInternTable = new NodeIdentityInternTable();
+  }
+  return &*CurrentInternTable->Strings.insert(Identity).first;
+}
+
+NodeIdentityInternScope::NodeIdentityInternScope()
+    : Previous(CurrentInternTable),
+      Table(absl::make_unique<NodeIdentityInternTable>()) {
+  CurrentInternTable = Table.get();
+}
+
+NodeIdentityInternScope::~NodeIdentityInternScope() {
+  CurrentInternTable = Previous;
+}
+
 }  // namespace kythe
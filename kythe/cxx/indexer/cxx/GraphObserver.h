@@ -20,7 +20,10 @@
 /// \file
 /// \brief Defines the class kythe::GraphObserver
 
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
@@ -44,6 +47,37 @@ namespace kythe {
 /// \brief A one-way hash for `InString`.
 std::string CompressString(absl::string_view InString, bool Force = false);
 
+struct NodeIdentityInternTable;
+
+/// \brief Interns `Identity` in the current table of node identity strings.
+/// \return a pointer to the canonical copy of `Identity`, stable for the life
+/// of the table (see `NodeIdentityInternScope`). Interned identities make
+/// `NodeId` copies trivial pointer copies and equality a pointer comparison.
+const std::string* InternNodeIdentity(const std::string& Identity);
+
+/// \brief Installs a fresh node-identity intern table for the duration of
+/// one compilation unit.
+///
+/// Drivers that push many compilation units through one process (like
+/// `IndexerContext::EnumerateCompilations`) would otherwise retain every
+/// identity ever minted, including TU-local template-instantiation
+/// signatures, for the life of the run. `IndexCompilationUnit` opens one of
+/// these scopes around each unit; no `NodeId` may outlive the scope it was
+/// minted under.
+class NodeIdentityInternScope {
+ public:
+  NodeIdentityInternScope();
+  ~NodeIdentityInternScope();
+  NodeIdentityInternScope(const NodeIdentityInternScope&) = delete;
+  NodeIdentityInternScope& operator=(const NodeIdentityInternScope&) = delete;
+
+ private:
+  /// \brief The table to restore when this scope closes.
+  NodeIdentityInternTable* Previous;
+  /// \brief The table this scope installed.
+  std::unique_ptr<NodeIdentityInternTable> Table;
+};
+
 enum class ProfilingEvent {
   Enter,  ///< A profiling section was entered.
   Exit    ///< A profiling section was left.
@@ -126,8 +160,9 @@ class GraphObserver {
   class NodeId {
    public:
     NodeId(const ClaimToken* Token, const std::string& Identity)
-        : Token(Token), Identity(CompressString(Identity)) {}
-    NodeId(const NodeId& C) { *this = C; }
+        : Token(Token), Identity(InternNodeIdentity(CompressString(Identity))) {}
+    NodeId(const NodeId& C) = default;
+    NodeId& operator=(const NodeId& C) = default;
     NodeId& operator=(const NodeId* C) {
       Token = C->Token;
       Identity = C->Identity;
@@ -136,34 +171,35 @@ class GraphObserver {
     static NodeId CreateUncompressed(const ClaimToken* Token,
                                      const std::string& Identity) {
       NodeId NewId(Token, "");
-      NewId.Identity = Identity;
+      NewId.Identity = InternNodeIdentity(Identity);
       return NewId;
     }
     /// \brief Returns a string representation of this `NodeId`.
-    std::string ToString() const { return Identity; }
+    std::string ToString() const { return *Identity; }
     /// \brief Returns a string reference representation of this `NodeId`'s
     /// Identity.
-    /// This `NodeId` must outlive the `StringRef`.
     llvm::StringRef IdentityRef() const {
-      return llvm::StringRef(Identity.data(), Identity.size());
+      return llvm::StringRef(Identity->data(), Identity->size());
     }
     /// \brief Returns a string representation of this `NodeId`
     /// annotated by its claim token.
     std::string ToClaimedString() const {
-      return Token->StampIdentity(Identity);
+      return Token->StampIdentity(*Identity);
     }
     bool operator==(const NodeId& RHS) const {
+      // Identities are interned, so pointer equality decides string equality.
       return *Token == *RHS.Token && Identity == RHS.Identity;
     }
     bool operator!=(const NodeId& RHS) const {
       return *Token != *RHS.Token || Identity != RHS.Identity;
     }
-    const std::string& getRawIdentity() const { return Identity; }
+    const std::string& getRawIdentity() const { return *Identity; }
     const ClaimToken* getToken() const { return Token; }
 
    private:
     const ClaimToken* Token;
-    std::string Identity;
+    /// \brief The interned identity string; owned by the intern table.
+    const std::string* Identity;
   };
 
   /// \brief A range of source text, potentially associated with a node.
@@ -793,6 +829,59 @@ class GraphObserver {
   virtual void recordChildOfEdge(const NodeId& ChildNodeId,
                                  const NodeId& ParentNodeId) {}
 
+  /// \brief Related records about a single subject node, staged by a visitor
+  /// and committed together with `recordNodeBatch`.
+  ///
+  /// Batching the common per-declaration records lets an observer materialize
+  /// the subject's VName (and perform any associated claim checks) once per
+  /// declaration instead of once per fact. `NodeId` copies are interned
+  /// pointer copies, so staging is cheap; batches are intended to be
+  /// stack-allocated.
+  struct NodeBatch {
+    explicit NodeBatch(const NodeId& Subject) : Subject(Subject) {}
+    /// \brief Stages a type edge to `TypeId` (see `recordTypeEdge`).
+    void stageTypeEdge(const NodeId& TypeId) { Type = TypeId; }
+    /// \brief Stages a childof edge to `ParentId` (see `recordChildOfEdge`).
+    void stageChildOfEdge(const NodeId& ParentId) { Parent = ParentId; }
+    /// \brief Stages a param edge to `ParamId` (see `recordParamEdge`).
+    void stageParamEdge(uint32_t Ordinal, const NodeId& ParamId) {
+      Params.emplace_back(Ordinal, ParamId);
+    }
+    /// \brief Stages marked source for the subject (see `recordMarkedSource`).
+    void stageMarkedSource(const absl::optional<MarkedSource>& MS) {
+      Code = MS;
+    }
+
+    /// \brief The node all staged records are about.
+    NodeId Subject;
+    /// \brief The subject's type, if staged.
+    absl::optional<NodeId> Type;
+    /// \brief The subject's parent, if staged.
+    absl::optional<NodeId> Parent;
+    /// \brief The subject's parameters, if staged.
+    std::vector<std::pair<uint32_t, NodeId>> Params;
+    /// \brief The subject's marked source, if staged.
+    absl::optional<MarkedSource> Code;
+  };
+
+  /// \brief Commits every record staged in `Batch`.
+  ///
+  /// The default implementation replays the batch through the individual
+  /// record calls; implementations may override it to amortize per-subject
+  /// work across the batch.
+  virtual void recordNodeBatch(const NodeBatch& Batch) {
+    recordMarkedSource(Batch.Subject, Batch.Code);
+    if (Batch.Type) {
+      recordTypeEdge(Batch.Subject, *Batch.Type);
+    }
+    if (Batch.Parent) {
+      recordChildOfEdge(Batch.Subject, *Batch.Parent);
+    }
+    for (const auto& Param : Batch.Params) {
+      recordParamEdge(Batch.Subject, Param.first, Param.second);
+    }
+  }
+
   /// \brief Records that a record adds functionality to another record. In the
   /// case of Objective-C this occurs in a category where additional methods
   /// are added to a preexisting class.
@@ -1019,6 +1108,16 @@ class GraphObserver {
   /// redundant output instead of dropped output).
   virtual bool claimRange(const Range& R) { return true; }
 
+  /// \brief Checks whether the file containing `Loc`'s expansion has
+  /// exhausted its anchor budget and should degrade to declaration-only
+  /// emission.
+  ///
+  /// It is always safe to return `false` here (as this will result in full
+  /// traversal instead of bounded output).
+  virtual bool isFileOverAnchorBudget(clang::SourceLocation Loc) {
+    return false;
+  }
+
   /// \brief Returns a `ClaimToken` for intrinsics.
   ///
   /// By default, this will return the default claim token. This does not
@@ -155,8 +155,13 @@ void ImputedConstructorSupport::InspectCallExpr(
   const auto* callee = call_expr->getDirectCallee();
   if (callee == nullptr) return;
 
-  const auto qual_name = callee->getQualifiedNameAsString();
-  if (!allow_constructor_name_(qual_name)) {
+  auto inserted =
+      allowed_callees_.try_emplace(callee->getCanonicalDecl(), false);
+  if (inserted.second) {
+    inserted.first->second =
+        allow_constructor_name_(callee->getQualifiedNameAsString());
+  }
+  if (!inserted.first->second) {
     return;
   }
 
@@ -24,6 +24,7 @@
 #include "IndexerLibrarySupport.h"
 #include "absl/strings/string_view.h"
 #include "clang/AST/Expr.h"
+#include "llvm/ADT/DenseMap.h"
 
 namespace kythe {
 
@@ -46,6 +47,12 @@ class ImputedConstructorSupport : public LibrarySupport {
 
  private:
   const std::function<bool(absl::string_view)> allow_constructor_name_;
+
+  /// Memoized per-callee pattern decisions. Call expressions number in the
+  /// millions per TU but distinct callees do not; caching by canonical decl
+  /// reduces the per-call cost to a pointer-keyed map lookup instead of
+  /// rendering the qualified name and running the regex.
+  llvm::DenseMap<const clang::FunctionDecl*, bool> allowed_callees_;
 };
 
 }  // namespace kythe
@@ -17,6 +17,8 @@
 #include "IndexerASTHooks.h"
 
 #include <algorithm>
+#include <fstream>
+#include <map>
 #include <tuple>
 
 #include "GraphObserver.h"
@@ -49,6 +51,7 @@
 #include "clang/Lex/Lexer.h"
 #include "clang/Sema/Lookup.h"
 #include "indexed_parent_iterator.h"
+#include "kythe/cxx/common/indexing/MemoryAccounting.h"
 #include "kythe/cxx/common/scope_guard.h"
 #include "kythe/cxx/indexer/cxx/clang_range_finder.h"
 #include "kythe/cxx/indexer/cxx/clang_utils.h"
@@ -63,6 +66,13 @@ ABSL_FLAG(bool, experimental_threaded_claiming, false,
           "Defer answering claims and submit them in bulk when possible.");
 ABSL_FLAG(bool, emit_anchors_on_builtins, true,
           "Emit anchors on builtin types like int and float.");
+ABSL_FLAG(std::string, experimental_incremental_state_path, "",
+          "If nonempty, persist fingerprints of indexed top-level decls to "
+          "this file and skip traversal of decls whose fingerprints are "
+          "unchanged from a previous run.");
+ABSL_FLAG(bool, experimental_lazy_parent_map, false,
+          "Populate the AST parent map on demand per top-level decl subtree "
+          "instead of walking the whole translation unit up front.");
 
 namespace kythe {
 
@@ -397,12 +407,18 @@ class PruneCheck {
       // ** modulo wacky macros
       //
       GenerateCleanupId(decl);
+      if (CheckVisited()) {
+        return;
+      }
       if (absl::GetFlag(FLAGS_experimental_threaded_claiming) ||
           !visitor_->Observer.claimImplicitNode(cleanup_id_)) {
         can_prune_ = Prunability::kDeferred;
       }
     } else if (llvm::isa<clang::ClassTemplateSpecializationDecl>(decl)) {
       GenerateCleanupId(decl);
+      if (CheckVisited()) {
+        return;
+      }
       if (absl::GetFlag(FLAGS_experimental_threaded_claiming) ||
           !visitor_->Observer.claimImplicitNode(cleanup_id_)) {
         can_prune_ = Prunability::kDeferIncompleteFunctions;
@@ -423,6 +439,20 @@ class PruneCheck {
   const std::string& cleanup_id() { return cleanup_id_; }
 
  private:
+  /// \return true if a subtree with this cleanup identity was already
+  /// traversed (or enqueued) in this translation unit, marking this one
+  /// immediately prunable. Identical identities produce identical
+  /// subgraphs, so the earlier traversal's output covers this subtree.
+  bool CheckVisited() {
+    if (!visitor_->VisitedImplicitIds.insert(cleanup_id_).second) {
+      // The earlier traversal owns the claim; nothing to clean up here.
+      cleanup_id_.clear();
+      can_prune_ = Prunability::kImmediate;
+      return true;
+    }
+    return false;
+  }
+
   void GenerateCleanupId(const clang::Decl* decl) {
     // TODO(zarko): Check to see if non-function members of a class
     // can be traversed once per argument set.
@@ -463,6 +493,22 @@ class PruneCheck {
   IndexerASTVisitor* visitor_;
 };
 
+namespace {
+/// \return the byte counter for the visitor's memo tables.
+MemoryCounter& AstVisitorCounter() {
+  static auto* counter = new MemoryCounter("ast visitor");
+  return *counter;
+}
+}  // anonymous namespace
+
+void IndexerASTVisitor::CacheNodeId(const clang::Decl* Decl,
+                                    const GraphObserver::NodeId& Id) {
+  if (DeclToNodeId.insert({Decl, Id}).second) {
+    AstVisitorCounter().Add(
+        sizeof(std::pair<const clang::Decl*, GraphObserver::NodeId>));
+  }
+}
+
 const IndexedParentMap* IndexerASTVisitor::getAllParents() {
   if (!AllParents) {
     // We always need to run over the whole translation unit, as
@@ -470,7 +516,9 @@ const IndexedParentMap* IndexerASTVisitor::getAllParents() {
     // TODO(zarko): Is this relavant for naming?
     ProfileBlock block(Observer.getProfilingCallback(), "build_parent_map");
     AllParents = absl::make_unique<IndexedParentMap>(
-        IndexedParentMap::Build(Context.getTranslationUnitDecl()));
+        absl::GetFlag(FLAGS_experimental_lazy_parent_map)
+            ? IndexedParentMap::BuildLazy(Context.getTranslationUnitDecl())
+            : IndexedParentMap::Build(Context.getTranslationUnitDecl()));
   }
   return AllParents.get();
 }
@@ -502,7 +550,7 @@ bool IndexerASTVisitor::IsDefinition(const clang::VarDecl* VD) {
 clang::SourceRange IndexerASTVisitor::RangeForNameOfDeclaration(
     const clang::NamedDecl* Decl) const {
   return ClangRangeFinder(Observer.getSourceManager(),
-                          Observer.getLangOptions())
+                          Observer.getLangOptions(), &Ranges)
       .RangeForNameOf(Decl);
 }
 
@@ -740,6 +788,9 @@ void InsertAnchorMarks(std::string& Text, std::vector<MiniAnchor>& Anchors) {
 
 void IndexerASTVisitor::HandleFileLevelComments(
     clang::FileID Id, const GraphObserver::NodeId& FileNode) {
+  if (DocMode == BehaviorOnDocumentation::SkipDocumentation) {
+    return;
+  }
   const auto& RCL = Context.Comments;
   // Find the block of comments for the given file. This behavior is not well-
   // defined by Clang, which commits only to the RawComments being
@@ -912,6 +963,64 @@ void IndexerASTVisitor::VisitComment(
   }
 }
 
+const clang::RawComment* IndexerASTVisitor::GetRawCommentForDecl(
+    const clang::Decl* Decl) {
+  const auto& SM = *Observer.getSourceManager();
+  clang::SourceLocation BeginLoc = SM.getExpansionLoc(Decl->getBeginLoc());
+  if (BeginLoc.isInvalid()) {
+    return nullptr;
+  }
+  auto [DeclFile, DeclBegin] = SM.getDecomposedLoc(BeginLoc);
+  if (DeclFile.isInvalid()) {
+    return nullptr;
+  }
+  FileCommentIndex& Index = FileCommentIndices[DeclFile];
+  if (!Index.Built) {
+    Index.Built = true;
+    if (const std::map<unsigned, clang::RawComment*>* FileComments =
+            Context.Comments.getCommentsInFile(DeclFile)) {
+      Index.Offsets.reserve(FileComments->size());
+      for (const auto& Entry : *FileComments) {
+        Index.Offsets.emplace_back(
+            Entry.first,
+            SM.getFileOffset(Entry.second->getSourceRange().getEnd()));
+      }
+    }
+  }
+  if (Index.Offsets.empty()) {
+    return nullptr;
+  }
+  // Clang only attaches a comment that ends at most one line above the decl
+  // (a blank line between them breaks the association) or that trails the
+  // decl on its last line, so a comment anywhere else in the file lets us
+  // skip the full attachment search.
+  auto After =
+      std::upper_bound(Index.Offsets.begin(), Index.Offsets.end(),
+                       std::make_pair(DeclBegin, ~0u));
+  if (After != Index.Offsets.begin()) {
+    unsigned PrevEnd = std::prev(After)->second;
+    if (PrevEnd >= DeclBegin ||
+        SM.getLineNumber(DeclFile, DeclBegin) <=
+            SM.getLineNumber(DeclFile, PrevEnd) + 1) {
+      return Context.getRawCommentForDeclNoCache(Decl);
+    }
+  }
+  if (After != Index.Offsets.end()) {
+    clang::SourceLocation EndLoc =
+        SM.getExpansionLoc(Decl->getSourceRange().getEnd());
+    if (EndLoc.isInvalid()) {
+      return Context.getRawCommentForDeclNoCache(Decl);
+    }
+    auto [EndFile, DeclEnd] = SM.getDecomposedLoc(EndLoc);
+    if (EndFile != DeclFile ||
+        SM.getLineNumber(DeclFile, After->first) <=
+            SM.getLineNumber(DeclFile, DeclEnd)) {
+      return Context.getRawCommentForDeclNoCache(Decl);
+    }
+  }
+  return nullptr;
+}
+
 void IndexerASTVisitor::VisitAttributes(
     const clang::Decl* Decl, const GraphObserver::NodeId& TargetNode) {
   for (const auto& Attr : Decl->attrs()) {
@@ -927,7 +1036,12 @@ bool IndexerASTVisitor::VisitDecl(const clang::Decl* Decl) {
     // Template instantiation can't add any documentation text.
     return true;
   }
-  const auto* CommentOrNull = Context.getRawCommentForDeclNoCache(Decl);
+  // In reference-only mode, never look comments up: association alone is
+  // costly in comment-heavy headers, and VisitComment would drop the result.
+  const auto* CommentOrNull =
+      DocMode == BehaviorOnDocumentation::EmitDocumentation
+          ? GetRawCommentForDecl(Decl)
+          : nullptr;
   if (!CommentOrNull && !Decl->hasAttrs()) {
     // Fast path: if there are no attached documentation comments or attributes,
     // bail.
@@ -1029,6 +1143,83 @@ bool IndexerASTVisitor::TraverseCXXConstructorDecl(
          TraverseDeclarationNameInfo(DNI);
 }
 
+uint64_t IndexerASTVisitor::FileContentHash(clang::FileID FID) {
+  auto [It, Inserted] = FileContentHashes.try_emplace(FID, 0);
+  if (Inserted) {
+    bool Invalid = false;
+    llvm::StringRef Buffer =
+        Context.getSourceManager().getBufferData(FID, &Invalid);
+    if (!Invalid) {
+      // CompressString's digest is stable across runs, which the on-disk
+      // incremental state requires.
+      It->second = std::hash<std::string>()(CompressString(
+          absl::string_view(Buffer.data(), Buffer.size()), true));
+    }
+  }
+  return It->second;
+}
+
+uint64_t IndexerASTVisitor::SemanticDeclHash(const clang::Decl* Decl) {
+  uint64_t hash =
+      std::hash<std::string>()(BuildNodeIdForDecl(Decl).ToClaimedString());
+  if (const auto* RD = llvm::dyn_cast<clang::RecordDecl>(Decl)) {
+    hash ^= this->Hash(RD);
+  } else if (const auto* ED = llvm::dyn_cast<clang::EnumDecl>(Decl)) {
+    hash ^= this->Hash(ED);
+  } else if (const auto* VD = llvm::dyn_cast<clang::ValueDecl>(Decl)) {
+    hash ^= this->Hash(VD->getType());
+  }
+  // Anchors for this decl's subgraph are byte offsets into its file, so the
+  // fingerprint must change whenever those offsets would: fold in the decl's
+  // decomposed source range and the content digest of the file it lives in.
+  // An edit earlier in the file shifts the offsets; an equal-length edit
+  // inside the decl leaves them alone but changes the file digest.
+  const auto& SM = Context.getSourceManager();
+  auto Range = SM.getExpansionRange(Decl->getSourceRange());
+  auto Begin = SM.getDecomposedLoc(Range.getBegin());
+  auto End = SM.getDecomposedLoc(Range.getEnd());
+  hash ^= FileContentHash(Begin.first);
+  hash ^= std::hash<uint64_t>()((static_cast<uint64_t>(Begin.second) << 32) |
+                                End.second);
+  return hash;
+}
+
+void IndexerASTVisitor::LoadIncrementalState() {
+  const std::string path =
+      absl::GetFlag(FLAGS_experimental_incremental_state_path);
+  if (path.empty()) {
+    return;
+  }
+  std::ifstream state(path);
+  uint64_t hash;
+  while (state >> hash) {
+    PreviousDeclHashes.insert(hash);
+  }
+}
+
+void IndexerASTVisitor::SaveIncrementalState() {
+  const std::string path =
+      absl::GetFlag(FLAGS_experimental_incremental_state_path);
+  if (path.empty()) {
+    return;
+  }
+  std::ofstream state(path);
+  if (!state) {
+    LOG(WARNING) << "Couldn't write incremental state to " << path;
+    return;
+  }
+  // Keep hashes from other translation units (and from skipped decls) so the
+  // state file stays valid across a whole repository run.
+  for (uint64_t hash : PreviousDeclHashes) {
+    state << hash << '\n';
+  }
+  for (uint64_t hash : CurrentDeclHashes) {
+    if (PreviousDeclHashes.find(hash) == PreviousDeclHashes.end()) {
+      state << hash << '\n';
+    }
+  }
+}
+
 bool IndexerASTVisitor::TraverseDecl(clang::Decl* Decl) {
   if (ShouldStopIndexing()) {
     return false;
@@ -1036,6 +1227,18 @@ bool IndexerASTVisitor::TraverseDecl(clang::Decl* Decl) {
   if (Decl == nullptr) {
     return true;
   }
+  if (!absl::GetFlag(FLAGS_experimental_incremental_state_path).empty() &&
+      Job != nullptr && Decl != Job->Decl && Decl->getDeclContext() != nullptr &&
+      Decl->getDeclContext()->isTranslationUnit() &&
+      llvm::isa<clang::NamedDecl>(Decl)) {
+    uint64_t SemaHash = SemanticDeclHash(Decl);
+    CurrentDeclHashes.insert(SemaHash);
+    if (PreviousDeclHashes.find(SemaHash) != PreviousDeclHashes.end()) {
+      // An earlier run already emitted this decl's subgraph (its claimed ID
+      // and semantic hash are both unchanged), so skip its traversal.
+      return true;
+    }
+  }
 
   auto Scope = RestoreValue(Job->PruneIncompleteFunctions);
   if (Job->PruneIncompleteFunctions) {
@@ -1667,16 +1870,21 @@ IndexerASTVisitor::BuildNodeIdForDeclContext(const clang::DeclContext* DC) {
 }
 
 void IndexerASTVisitor::AddChildOfEdgeToDeclContext(
-    const clang::Decl* Decl, const GraphObserver::NodeId& DeclNode) {
+    const clang::Decl* Decl, const GraphObserver::NodeId& DeclNode,
+    GraphObserver::NodeBatch* Batch) {
   if (const DeclContext* DC = Decl->getDeclContext()) {
+    absl::optional<GraphObserver::NodeId> ContextId;
     if (absl::GetFlag(FLAGS_experimental_alias_template_instantiations)) {
       if (!Job->UnderneathImplicitTemplateInstantiation) {
-        if (auto ContextId = BuildNodeIdForRefToDeclContext(DC)) {
-          Observer.recordChildOfEdge(DeclNode, ContextId.value());
-        }
+        ContextId = BuildNodeIdForRefToDeclContext(DC);
       }
     } else {
-      if (auto ContextId = BuildNodeIdForDeclContext(DC)) {
+      ContextId = BuildNodeIdForDeclContext(DC);
+    }
+    if (ContextId) {
+      if (Batch != nullptr) {
+        Batch->stageChildOfEdge(ContextId.value());
+      } else {
         Observer.recordChildOfEdge(DeclNode, ContextId.value());
       }
     }
@@ -2316,10 +2524,12 @@ bool IndexerASTVisitor::VisitFieldDecl(const clang::FieldDecl* Decl) {
                               GraphObserver::VariableSubkind::Field,
                               Marks.GenerateMarkedSource(DeclNode));
   AssignUSR(DeclNode, Decl);
+  GraphObserver::NodeBatch Batch(DeclNode);
   if (auto TyNodeId = BuildNodeIdForType(Decl->getType())) {
-    Observer.recordTypeEdge(DeclNode, *TyNodeId);
+    Batch.stageTypeEdge(*TyNodeId);
   }
-  AddChildOfEdgeToDeclContext(Decl, DeclNode);
+  AddChildOfEdgeToDeclContext(Decl, DeclNode, &Batch);
+  Observer.recordNodeBatch(Batch);
   return true;
 }
 
@@ -2557,6 +2767,29 @@ bool IndexerASTVisitor::TraverseFunctionDecl(clang::FunctionDecl* FD) {
   }();
 }
 
+bool IndexerASTVisitor::TraverseStmt(clang::Stmt* S,
+                                     Base::DataRecursionQueue* Queue) {
+  if (S != nullptr &&
+      (llvm::isa<clang::CompoundStmt>(S) || llvm::isa<clang::CXXTryStmt>(S) ||
+       llvm::isa<clang::CoroutineBodyStmt>(S))) {
+    // A function body is always one of these statement kinds, and outside of
+    // a body they only appear in positions (like statement expressions) that
+    // declaration-only indexing also drops. Most bodies won't even reach this
+    // point: declaration-only mode parses with SkipFunctionBodies, so this
+    // only catches bodies Clang was forced to build anyway (e.g. for constant
+    // evaluation or template instantiation).
+    if (BodyMode == BehaviorOnFunctionBodies::SkipBodies) {
+      return true;
+    }
+    // Files over their anchor budget degrade to declaration-only traversal,
+    // bounding the worst case on machine-generated megafiles.
+    if (Observer.isFileOverAnchorBudget(S->getBeginLoc())) {
+      return true;
+    }
+  }
+  return Base::TraverseStmt(S, Queue);
+}
+
 bool IndexerASTVisitor::TraverseFunctionTemplateDecl(
     clang::FunctionTemplateDecl* FTD) {
   {
@@ -2602,7 +2835,7 @@ IndexerASTVisitor::ExpandedRangeInCurrentContext(clang::SourceRange SR) {
 clang::SourceRange IndexerASTVisitor::NormalizeRange(
     clang::SourceRange SR) const {
   return ClangRangeFinder(Observer.getSourceManager(),
-                          Observer.getLangOptions())
+                          Observer.getLangOptions(), &Ranges)
       .NormalizeRange(SR);
 }
 
@@ -3539,7 +3772,7 @@ GraphObserver::NodeId IndexerASTVisitor::BuildNodeIdForDecl(
       Ostream << "#builtin";
       GraphObserver::NodeId Id(Observer.getClaimTokenForBuiltin(),
                                Ostream.str());
-      DeclToNodeId.insert({Decl, Id});
+      CacheNodeId(Decl, Id);
       return Id;
     }
   }
@@ -3547,7 +3780,7 @@ GraphObserver::NodeId IndexerASTVisitor::BuildNodeIdForDecl(
   if (const auto* BTD = dyn_cast<BuiltinTemplateDecl>(Decl)) {
     Ostream << "#builtin";
     GraphObserver::NodeId Id(Observer.getClaimTokenForBuiltin(), Ostream.str());
-    DeclToNodeId.insert({Decl, Id});
+    CacheNodeId(Decl, Id);
     return Id;
   }
 
@@ -3557,7 +3790,7 @@ GraphObserver::NodeId IndexerASTVisitor::BuildNodeIdForDecl(
     // There's a special way to name type aliases but we want to handle type
     // parameters for Objective-C as "normal" named decls.
     if (auto TypedefNameId = BuildNodeIdForTypedefNameDecl(TND)) {
-      DeclToNodeId.insert({Decl, TypedefNameId.value()});
+      CacheNodeId(Decl, TypedefNameId.value());
       return TypedefNameId.value();
     }
   } else if (const auto* NS = dyn_cast<NamespaceDecl>(Decl)) {
@@ -3568,7 +3801,7 @@ GraphObserver::NodeId IndexerASTVisitor::BuildNodeIdForDecl(
             ? Observer.getAnonymousNamespaceClaimToken(NS->getLocation())
             : Observer.getNamespaceClaimToken(NS->getLocation()),
         Ostream.str());
-    DeclToNodeId.insert({Decl, Id});
+    CacheNodeId(Decl, Id);
     return Id;
   }
 
@@ -3645,14 +3878,14 @@ GraphObserver::NodeId IndexerASTVisitor::BuildNodeIdForDecl(
     if (Rec->getDefinition() == Rec && Rec->getDeclName()) {
       Ostream << "#" << HashToString(Hash(Rec));
       GraphObserver::NodeId Id(Token, Ostream.str());
-      DeclToNodeId.insert({Decl, Id});
+      CacheNodeId(Decl, Id);
       return Id;
     }
   } else if (const auto* Enum = dyn_cast<clang::EnumDecl>(Decl)) {
     if (Enum->getDefinition() == Enum) {
       Ostream << "#" << HashToString(Hash(Enum));
       GraphObserver::NodeId Id(Token, Ostream.str());
-      DeclToNodeId.insert({Decl, Id});
+      CacheNodeId(Decl, Id);
       return Id;
     }
   } else if (const auto* ECD = dyn_cast<clang::EnumConstantDecl>(Decl)) {
@@ -3660,7 +3893,7 @@ GraphObserver::NodeId IndexerASTVisitor::BuildNodeIdForDecl(
       if (E->getDefinition() == E) {
         Ostream << "#" << HashToString(Hash(E));
         GraphObserver::NodeId Id(Token, Ostream.str());
-        DeclToNodeId.insert({Decl, Id});
+        CacheNodeId(Decl, Id);
         return Id;
       }
     }
@@ -3702,7 +3935,7 @@ GraphObserver::NodeId IndexerASTVisitor::BuildNodeIdForDecl(
     Ostream << "invalid";
   }
   GraphObserver::NodeId Id(Token, Ostream.str());
-  DeclToNodeId.insert({Decl, Id});
+  CacheNodeId(Decl, Id);
   return Id;
 }
 
@@ -4486,6 +4719,11 @@ NodeSet IndexerASTVisitor::BuildNodeSetForType(const clang::TypeLoc& TL) {
 NodeSet IndexerASTVisitor::BuildNodeSetForType(const clang::QualType& QT) {
   CHECK(!QT.isNull());
   TypeKey Key(Context, QT, QT.getTypePtr());
+  // The empty placeholder is inserted before building so that a recursive
+  // reference to the same key (as can happen with self-referential types)
+  // terminates with an empty NodeSet instead of looping; the placeholder is
+  // overwritten with the fully-built NodeSet before any non-cyclic caller
+  // sees it.
   auto [iter, inserted] = TypeNodes.insert({Key, NodeSet::Empty()});
   if (inserted) {
     iter->second = QT.hasLocalQualifiers()
@@ -5274,10 +5512,12 @@ bool IndexerASTVisitor::VisitObjCPropertyDecl(
       GraphObserver::VariableSubkind::Field,
       Marks.GenerateMarkedSource(DeclNode));
   AssignUSR(DeclNode, Decl);
+  GraphObserver::NodeBatch Batch(DeclNode);
   if (auto TyNodeId = BuildNodeIdForType(Decl->getType())) {
-    Observer.recordTypeEdge(DeclNode, *TyNodeId);
+    Batch.stageTypeEdge(*TyNodeId);
   }
-  AddChildOfEdgeToDeclContext(Decl, DeclNode);
+  AddChildOfEdgeToDeclContext(Decl, DeclNode, &Batch);
+  Observer.recordNodeBatch(Batch);
   return true;
 }
 
@@ -23,6 +23,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "GraphObserver.h"
 #include "IndexerLibrarySupport.h"
@@ -37,6 +38,7 @@
 #include "glog/logging.h"
 #include "indexed_parent_map.h"
 #include "indexer_worklist.h"
+#include "kythe/cxx/indexer/cxx/clang_range_finder.h"
 #include "kythe/cxx/indexer/cxx/node_set.h"
 #include "kythe/cxx/indexer/cxx/recursive_type_visitor.h"
 #include "kythe/cxx/indexer/cxx/semantic_hash.h"
@@ -68,6 +70,21 @@ enum BehaviorOnTemplates : bool {
 /// associated with forward declarations.
 enum BehaviorOnFwdDeclComments : bool { Emit = true, Ignore = false };
 
+/// \brief Specifies whether the indexer should compute and emit marked
+/// source (code facts) and comment documentation. Consumers that only need
+/// the reference graph can skip both, which also skips their computation.
+enum BehaviorOnDocumentation : bool {
+  SkipDocumentation = false,  ///< Emit nodes, edges, and anchors only.
+  EmitDocumentation = true    ///< Also compute marked source and doc facts.
+};
+
+/// \brief Specifies whether the indexer should traverse function bodies.
+enum BehaviorOnFunctionBodies : bool {
+  SkipBodies = false,  ///< Index declarations only; skip function bodies.
+  VisitBodies = true   ///< Traverse function bodies, emitting references
+                       ///< found inside them.
+};
+
 /// \brief A byte range that links to some node.
 struct MiniAnchor {
   size_t Begin;
@@ -92,7 +109,9 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
   IndexerASTVisitor(clang::ASTContext& C, BehaviorOnUnimplemented B,
                     BehaviorOnTemplates T, Verbosity V,
                     BehaviorOnFwdDeclComments ObjC,
-                    BehaviorOnFwdDeclComments Cpp, const LibrarySupports& S,
+                    BehaviorOnFwdDeclComments Cpp,
+                    BehaviorOnFunctionBodies Bodies,
+                    BehaviorOnDocumentation Docs, const LibrarySupports& S,
                     clang::Sema& Sema, std::function<bool()> ShouldStopIndexing,
                     GraphObserver* GO = nullptr, int UsrByteSize = 0)
       : IgnoreUnimplemented(B),
@@ -100,11 +119,14 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
         Verbosity(V),
         ObjCFwdDocs(ObjC),
         CppFwdDocs(Cpp),
+        BodyMode(Bodies),
+        DocMode(Docs),
         Observer(GO ? *GO : NullObserver),
         Context(C),
         Supports(S),
         Sema(Sema),
-        MarkedSources(&Sema, &Observer),
+        MarkedSources(&Sema, &Observer,
+                      Docs == BehaviorOnDocumentation::EmitDocumentation),
         ShouldStopIndexing(std::move(ShouldStopIndexing)),
         UsrByteSize(UsrByteSize) {}
 
@@ -571,6 +593,10 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
       clang::VarTemplatePartialSpecializationDecl* TD);
 
   bool TraverseFunctionDecl(clang::FunctionDecl* FD);
+
+  /// \brief Skips function bodies wholesale in declaration-only mode.
+  bool TraverseStmt(clang::Stmt* S,
+                    Base::DataRecursionQueue* Queue = nullptr);
   bool TraverseFunctionTemplateDecl(clang::FunctionTemplateDecl* FTD);
 
   bool TraverseTypeAliasTemplateDecl(clang::TypeAliasTemplateDecl* TATD);
@@ -654,6 +680,7 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
 
   void Work(clang::Decl* InitialDecl,
             std::unique_ptr<IndexerWorklist> NewWorklist) {
+    LoadIncrementalState();
     Worklist = std::move(NewWorklist);
     Worklist->EnqueueJob(absl::make_unique<IndexJob>(InitialDecl));
     while (!ShouldStopIndexing() && Worklist->DoWork())
@@ -664,6 +691,7 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
           RunJob(absl::make_unique<IndexJob>(InitialDecl, Id, FileNode));
           return !ShouldStopIndexing();
         });
+    SaveIncrementalState();
     Worklist.reset();
   }
 
@@ -698,6 +726,12 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
   /// Should we emit documentation for forward decls in C++?
   BehaviorOnFwdDeclComments CppFwdDocs;
 
+  /// Should we traverse function bodies?
+  BehaviorOnFunctionBodies BodyMode;
+
+  /// Should we compute and emit marked source and documentation?
+  BehaviorOnDocumentation DocMode;
+
   NullGraphObserver NullObserver;
   GraphObserver& Observer;
   clang::ASTContext& Context;
@@ -818,6 +852,11 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
   /// Filled on the first call to `getIndexedParents`.
   std::unique_ptr<IndexedParentMap> AllParents;
 
+  /// Memoized token lengths and normalized ranges shared by the
+  /// ClangRangeFinders used for range normalization; mutable because
+  /// memoization happens in const accessors.
+  mutable ClangRangeFinder::RangeCache Ranges;
+
   /// Records information about the template `Template` wrapping the node
   /// `BodyId`, including the edge linking the template and its body. Returns
   /// the `NodeId` for the dominating template.
@@ -844,8 +883,11 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
   /// \brief Attempts to add a childof edge between DeclNode and its parent.
   /// \param Decl The (outer, in the case of a template) decl.
   /// \param DeclNode The (outer) `NodeId` for `Decl`.
+  /// \param Batch If non-null, the edge is staged there instead of being
+  /// recorded immediately.
   void AddChildOfEdgeToDeclContext(const clang::Decl* Decl,
-                                   const GraphObserver::NodeId& DeclNode);
+                                   const GraphObserver::NodeId& DeclNode,
+                                   GraphObserver::NodeBatch* Batch = nullptr);
 
   /// Points at the inner node of the DeclContext, if it's a template.
   /// Otherwise points at the DeclContext as a Decl.
@@ -945,9 +987,49 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
                               const clang::DeclContext* DCxt,
                               absl::optional<GraphObserver::NodeId> DCID);
 
+  /// \brief Computes a stable fingerprint for a top-level decl, combining its
+  /// claimed node ID, the semantic hash of its definition (when one is
+  /// available for the decl's kind), its byte offsets, and the content digest
+  /// of its file. The positional components matter: anchors emitted for the
+  /// decl depend on where its text lies, so an edit that shifts or rewrites
+  /// that text must invalidate the previous run's fingerprint.
+  uint64_t SemanticDeclHash(const clang::Decl* Decl);
+
+  /// \brief Returns a run-stable hash of the content of `FID`, memoized per
+  /// file (or 0 if the buffer is inaccessible).
+  uint64_t FileContentHash(clang::FileID FID);
+
+  /// \brief Loads the previous run's top-level decl fingerprints from
+  /// --experimental_incremental_state_path, if set.
+  void LoadIncrementalState();
+
+  /// \brief Writes the union of the previous and current runs' fingerprints
+  /// back to --experimental_incremental_state_path, if set. Stale entries are
+  /// discarded by deleting the state file.
+  void SaveIncrementalState();
+
+  /// \brief Fingerprints of top-level decls emitted by a previous run;
+  /// traversal of matching decls is skipped.
+  std::unordered_set<uint64_t> PreviousDeclHashes;
+
+  /// \brief Fingerprints of top-level decls seen during this run.
+  std::unordered_set<uint64_t> CurrentDeclHashes;
+
+  /// \brief Memoized per-file content hashes (\sa FileContentHash).
+  llvm::DenseMap<clang::FileID, uint64_t> FileContentHashes;
+
+  /// \brief Claim identities of implicit subtrees whose traversal this TU
+  /// already performed (or enqueued); a later subtree with an identical
+  /// identity would re-emit the same subgraph and is pruned outright.
+  std::unordered_set<std::string> VisitedImplicitIds;
+
   /// \brief Maps known Decls to their NodeIds.
   llvm::DenseMap<const clang::Decl*, GraphObserver::NodeId> DeclToNodeId;
 
+  /// \brief Inserts `Id` into `DeclToNodeId` (if `Decl` is not already
+  /// mapped), accounting the footprint of newly added entries.
+  void CacheNodeId(const clang::Decl* Decl, const GraphObserver::NodeId& Id);
+
   /// \brief Used for calculating semantic hashes.
   SemanticHash Hash{
       [this](const clang::Decl* Decl) {
@@ -977,6 +1059,26 @@ class IndexerASTVisitor : public RecursiveTypeVisitor<IndexerASTVisitor> {
   /// \brief Comments we've already visited.
   std::unordered_set<const clang::RawComment*> VisitedComments;
 
+  /// \brief Raw comment offsets for one file: (begin, end) per comment,
+  /// sorted by begin offset.
+  struct FileCommentIndex {
+    bool Built = false;
+    std::vector<std::pair<unsigned, unsigned>> Offsets;
+  };
+
+  /// \brief Per-file comment-offset indices, each built lazily by
+  /// `GetRawCommentForDecl` on the first comment query against its file.
+  llvm::DenseMap<clang::FileID, FileCommentIndex> FileCommentIndices;
+
+  /// \brief Returns the raw comment documenting `Decl`, if any.
+  ///
+  /// Consults a lazily built per-file sorted comment-offset index to decide
+  /// in O(log n) whether any comment could attach to `Decl` before falling
+  /// back to Clang's (per-call linear) attachment search. Files with no
+  /// comments, and decls with no comment adjacent to them, never pay for
+  /// the full search.
+  const clang::RawComment* GetRawCommentForDecl(const clang::Decl* Decl);
+
   /// \brief The number of (raw) bytes to use to represent a USR. If 0,
   /// no USRs will be recorded.
   int UsrByteSize = 0;
@@ -988,7 +1090,8 @@ class IndexerASTConsumer : public clang::SemaConsumer {
   explicit IndexerASTConsumer(
       GraphObserver* GO, BehaviorOnUnimplemented B, BehaviorOnTemplates T,
       Verbosity V, BehaviorOnFwdDeclComments ObjC,
-      BehaviorOnFwdDeclComments Cpp, const LibrarySupports& S,
+      BehaviorOnFwdDeclComments Cpp, BehaviorOnFunctionBodies Bodies,
+      BehaviorOnDocumentation Docs, const LibrarySupports& S,
       std::function<bool()> ShouldStopIndexing,
       std::function<std::unique_ptr<IndexerWorklist>(IndexerASTVisitor*)>
           CreateWorklist,
@@ -999,6 +1102,8 @@ class IndexerASTConsumer : public clang::SemaConsumer {
         Verbosity(V),
         ObjCFwdDocs(ObjC),
         CppFwdDocs(Cpp),
+        BodyMode(Bodies),
+        DocMode(Docs),
         Supports(S),
         ShouldStopIndexing(std::move(ShouldStopIndexing)),
         CreateWorklist(std::move(CreateWorklist)),
@@ -1007,8 +1112,9 @@ class IndexerASTConsumer : public clang::SemaConsumer {
   void HandleTranslationUnit(clang::ASTContext& Context) override {
     CHECK(Sema != nullptr);
     IndexerASTVisitor Visitor(Context, IgnoreUnimplemented, TemplateMode,
-                              Verbosity, ObjCFwdDocs, CppFwdDocs, Supports,
-                              *Sema, ShouldStopIndexing, Observer, UsrByteSize);
+                              Verbosity, ObjCFwdDocs, CppFwdDocs, BodyMode,
+                              DocMode, Supports, *Sema, ShouldStopIndexing,
+                              Observer, UsrByteSize);
     {
       ProfileBlock block(Observer->getProfilingCallback(), "traverse_tu");
       Visitor.Work(Context.getTranslationUnitDecl(), CreateWorklist(&Visitor));
@@ -1031,6 +1137,10 @@ class IndexerASTConsumer : public clang::SemaConsumer {
   BehaviorOnFwdDeclComments ObjCFwdDocs;
   /// Should we emit documentation for forward decls in C++?
   BehaviorOnFwdDeclComments CppFwdDocs;
+  /// Should we traverse function bodies?
+  BehaviorOnFunctionBodies BodyMode;
+  /// Should we compute and emit marked source and documentation?
+  BehaviorOnDocumentation DocMode;
   /// Which library supports are enabled.
   const LibrarySupports& Supports;
   /// The active Sema instance.
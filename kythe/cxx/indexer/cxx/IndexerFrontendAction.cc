@@ -100,7 +100,8 @@ std::string ExtractBuildConfig(const proto::CompilationUnit& Unit) {
 
 bool DecodeHeaderSearchInfo(const proto::CxxCompilationUnitDetails& Details,
                             HeaderSearchInfo& Info) {
-  if (!Details.has_header_search_info()) {
+  if (!Details.has_header_search_info() &&
+      !Details.has_compact_header_search_info()) {
     return false;
   }
   if (!Info.CopyFrom(Details)) {
@@ -145,6 +146,10 @@ std::string IndexCompilationUnit(
     const LibrarySupports* LibrarySupports,
     std::function<std::unique_ptr<IndexerWorklist>(IndexerASTVisitor*)>
         CreateWorklist) {
+  // All NodeIds minted for this unit (and their identity strings) are
+  // discarded when this scope closes, so drivers that enumerate many units
+  // don't accumulate every identity ever interned.
+  NodeIdentityInternScope InternScope;
   llvm::sys::path::Style Style =
       kythe::IndexVFS::DetectStyleFromAbsoluteWorkingDirectory(
           Unit.working_directory())
@@ -184,6 +189,12 @@ std::string IndexCompilationUnit(
   if (Options.DropInstantiationIndependentData) {
     Observer.DropRedundantWraiths();
   }
+  if (Options.AggregateAnchorEdges) {
+    Observer.AggregateAnchorEdges();
+  }
+  if (Options.FileAnchorBudget > 0) {
+    Observer.set_file_anchor_budget(Options.FileAnchorBudget);
+  }
   Observer.set_claimant(Unit.v_name());
   if (Options.UseCompilationCorpusAsDefault) {
     Observer.set_default_corpus(Unit.v_name().corpus());
@@ -223,6 +234,8 @@ std::string IndexCompilationUnit(
   Action->setVerbosity(Options.Verbosity);
   Action->setObjCFwdDeclEmitDocs(Options.ObjCFwdDocs);
   Action->setCppFwdDeclEmitDocs(Options.CppFwdDocs);
+  Action->setDocumentationMode(Options.DocumentationBehavior);
+  Action->setFunctionBodyMode(Options.BodyBehavior);
   Action->setUsrByteSize(Options.UsrByteSize);
   llvm::IntrusiveRefCntPtr<clang::FileManager> FileManager(
       new clang::FileManager(FSO, Options.AllowFSAccess ? nullptr : VFS));
@@ -233,6 +246,25 @@ std::string IndexCompilationUnit(
   if (!FixupArgument.empty()) {
     Args.insert(Args.begin() + 1, FixupArgument);
   }
+  if (!Options.ModuleCachePath.empty() && Options.AllowFSAccess) {
+    // Let Clang build and reuse implicit modules for the common header
+    // prefix. The cache is bucketed by a hash of the unit's header search
+    // state so units only share serialized ASTs when the search
+    // configuration that produced them is identical.
+    std::string SearchSignature;
+    for (const auto& Path : HSI.paths) {
+      absl::StrAppend(&SearchSignature, Path.path, "#",
+                      static_cast<int>(Path.characteristic_kind),
+                      Path.is_framework ? "F;" : ";");
+    }
+    absl::StrAppend(&SearchSignature, "@", HSI.angled_dir_idx, ":",
+                    HSI.system_dir_idx);
+    Args.insert(Args.begin() + 1,
+                absl::StrCat("-fmodules-cache-path=", Options.ModuleCachePath,
+                             "/", CompressString(SearchSignature, true)));
+    Args.insert(Args.begin() + 1, "-fimplicit-module-maps");
+    Args.insert(Args.begin() + 1, "-fmodules");
+  }
 
   // StdinAdjustSingleFrontendActionFactory takes ownership of its action.
   std::unique_ptr<StdinAdjustSingleFrontendActionFactory> Tool =
@@ -104,6 +104,15 @@ class IndexerFrontendAction : public clang::ASTFrontendAction {
   /// \param B Behavior to use.
   void setCppFwdDeclEmitDocs(BehaviorOnFwdDeclComments B) { CppFwdDocs = B; }
 
+  /// \brief Compute and emit marked source and documentation facts?
+  /// \param B Behavior to use.
+  void setDocumentationMode(BehaviorOnDocumentation B) { DocMode = B; }
+
+  /// \brief Traverse function bodies, or index declarations only?
+  /// \param B Behavior to use. Skipping bodies also enables Clang's
+  /// skip-function-bodies parsing for the translation unit.
+  void setFunctionBodyMode(BehaviorOnFunctionBodies B) { BodyMode = B; }
+
   /// \brief Use this many raw bytes for USRs.
   void setUsrByteSize(int S) { UsrByteSize = S; }
 
@@ -145,10 +154,17 @@ class IndexerFrontendAction : public clang::ASTFrontendAction {
     }
     return absl::make_unique<IndexerASTConsumer>(
         Observer, IgnoreUnimplemented, TemplateMode, Verbosity, ObjCFwdDocs,
-        CppFwdDocs, Supports, ShouldStopIndexing, CreateWorklist, UsrByteSize);
+        CppFwdDocs, BodyMode, DocMode, Supports, ShouldStopIndexing,
+        CreateWorklist, UsrByteSize);
   }
 
   bool BeginSourceFileAction(clang::CompilerInstance& CI) override {
+    if (BodyMode == BehaviorOnFunctionBodies::SkipBodies) {
+      // Declaration-only mode: don't parse function bodies at all. The few
+      // bodies Clang must still build (constant evaluation, template
+      // instantiation) are dropped during traversal by IndexerASTVisitor.
+      CI.getFrontendOpts().SkipFunctionBodies = true;
+    }
     if (Observer) {
       CI.getPreprocessor().addPPCallbacks(absl::make_unique<IndexerPPCallbacks>(
           CI.getPreprocessor(), *Observer, Verbosity, UsrByteSize));
@@ -172,6 +188,10 @@ class IndexerFrontendAction : public clang::ASTFrontendAction {
   BehaviorOnFwdDeclComments ObjCFwdDocs = BehaviorOnFwdDeclComments::Emit;
   /// Should we emit documentation for forward decls in C++?
   BehaviorOnFwdDeclComments CppFwdDocs = BehaviorOnFwdDeclComments::Emit;
+  /// Should we traverse function bodies?
+  BehaviorOnFunctionBodies BodyMode = BehaviorOnFunctionBodies::VisitBodies;
+  /// Should we compute and emit marked source and documentation?
+  BehaviorOnDocumentation DocMode = BehaviorOnDocumentation::EmitDocumentation;
   /// Configuration information for header search.
   HeaderSearchInfo HeaderConfig;
   /// Whether to use HeaderConfig.
@@ -250,11 +270,28 @@ struct IndexerOptions {
   BehaviorOnFwdDeclComments ObjCFwdDocs = BehaviorOnFwdDeclComments::Emit;
   /// \brief Should we emit documentation for forward decls in C++?
   BehaviorOnFwdDeclComments CppFwdDocs = BehaviorOnFwdDeclComments::Emit;
+  /// \brief Whether to compute and emit marked source and comment
+  /// documentation. Reference-only consumers can skip both; the computation
+  /// is skipped as well, not just the output.
+  BehaviorOnDocumentation DocumentationBehavior =
+      BehaviorOnDocumentation::EmitDocumentation;
+  /// \brief Whether to traverse function bodies. Skipping them parses with
+  /// Clang's skip-function-bodies option and indexes declarations only,
+  /// trading references inside bodies for much faster indexing.
+  BehaviorOnFunctionBodies BodyBehavior = BehaviorOnFunctionBodies::VisitBodies;
   /// \brief Whether to allow access to the raw filesystem.
   bool AllowFSAccess = false;
   /// \brief Whether to drop data found to be template instantiation
   /// independent.
   bool DropInstantiationIndependentData = false;
+  /// \brief Whether to buffer anchor edges and emit them grouped by
+  /// (file, edge kind) instead of interleaved in AST-visit order.
+  bool AggregateAnchorEdges = false;
+  /// \brief If positive, cap the anchors emitted per file: past the cap one
+  /// anchor in 128 is kept deterministically, a diagnostic node on the file
+  /// records the truncation, and over-budget files are traversed
+  /// declaration-only.
+  int64_t FileAnchorBudget = 0;
   /// \brief A function that is called as the indexer enters and exits various
   /// phases of execution (in strict LIFO order).
   ProfilingCallback ReportProfileEvent = [](const char*, ProfilingEvent) {};
@@ -268,6 +305,12 @@ struct IndexerOptions {
   /// \brief Whether or not to use the CompilationUnit VName corpus as the
   /// default corpus.
   bool UseCompilationCorpusAsDefault = false;
+  /// \brief If nonempty, reuse Clang implicit-module artifacts across the
+  /// compilation units of one driver invocation by pointing Clang's module
+  /// cache at this directory. Units are bucketed by a hash of their header
+  /// search state, so only units with an identical search configuration share
+  /// serialized ASTs. Requires filesystem access.
+  std::string ModuleCachePath;
 };
 
 /// \brief Indexes `Unit`, reading from `Files` in the assumed and writing
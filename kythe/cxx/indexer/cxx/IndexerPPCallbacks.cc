@@ -92,9 +92,11 @@ void IndexerPPCallbacks::FileChanged(clang::SourceLocation Loc,
   switch (Reason) {
     case clang::PPCallbacks::EnterFile:
       Observer.pushFile(LastInclusionHash, Loc);
+      CurrentFileClaimed = Observer.claimLocation(Loc);
       break;
     case clang::PPCallbacks::ExitFile:
       Observer.popFile();
+      CurrentFileClaimed = Observer.claimLocation(Loc);
       break;
     case clang::PPCallbacks::SystemHeaderPragma:
       break;
@@ -108,16 +110,17 @@ void IndexerPPCallbacks::FileChanged(clang::SourceLocation Loc,
 }
 
 void IndexerPPCallbacks::FilterAndEmitDeferredRecords() {
-  for (const auto& R : DeferredRecords) {
-    if (R.WasDefined) {
-      if (!R.Macro->getMacroInfo()->isUsedForHeaderGuard()) {
-        Observer.recordBoundQueryRange(
-            R.Range,
-            BuildNodeIdForMacro(R.MacroName, *R.Macro->getMacroInfo()));
+  for (const auto& Group : DeferredRecords) {
+    if (!Group.Macro->getMacroInfo()->isUsedForHeaderGuard()) {
+      const auto MacroId =
+          BuildNodeIdForMacro(Group.MacroName, *Group.Macro->getMacroInfo());
+      for (const auto& Range : Group.Ranges) {
+        Observer.recordBoundQueryRange(Range, MacroId);
       }
     }
   }
   DeferredRecords.clear();
+  DeferredRecordIndex.clear();
 }
 
 void IndexerPPCallbacks::EndOfMainFile() {
@@ -134,7 +137,7 @@ GraphObserver::Range IndexerPPCallbacks::RangeForTokenInCurrentContext(
 
 void IndexerPPCallbacks::MacroDefined(const clang::Token& Token,
                                       const clang::MacroDirective* Macro) {
-  if (Macro == nullptr) {
+  if (Macro == nullptr || !CurrentFileClaimed) {
     return;
   }
   const clang::MacroInfo& Info = *Macro->getMacroInfo();
@@ -172,7 +175,7 @@ void IndexerPPCallbacks::MacroDefined(const clang::Token& Token,
 void IndexerPPCallbacks::MacroUndefined(const clang::Token& MacroName,
                                         const clang::MacroDefinition& Macro,
                                         const clang::MacroDirective* Undef) {
-  if (!Macro) {
+  if (!Macro || !CurrentFileClaimed) {
     return;
   }
   const clang::MacroInfo& Info = *Macro.getMacroInfo();
@@ -185,12 +188,11 @@ void IndexerPPCallbacks::MacroExpands(const clang::Token& Token,
                                       const clang::MacroDefinition& Macro,
                                       clang::SourceRange Range,
                                       const clang::MacroArgs* Args) {
-  if (!Macro || Range.isInvalid()) {
+  if (!Macro || Range.isInvalid() || !CurrentFileClaimed) {
     return;
   }
 
   const clang::MacroInfo& Info = *Macro.getMacroInfo();
-  GraphObserver::NodeId MacroId = BuildNodeIdForMacro(Token, Info);
   if (!Range.getBegin().isFileID() || !Range.getEnd().isFileID()) {
     if (Verbosity) {
       auto NewBegin =
@@ -206,11 +208,30 @@ void IndexerPPCallbacks::MacroExpands(const clang::Token& Token,
       if (Range.isInvalid()) {
         return;
       }
-      Observer.recordIndirectlyExpandsRange(RangeInCurrentContext(Range),
-                                            MacroId);
+      const auto* ClaimTok = Observer.getClaimTokenForRange(Range);
+      if (RecordedExpansionSites
+              .insert({{&Info, ClaimTok}, Range.getBegin().getRawEncoding()})
+              .second) {
+        Observer.recordIndirectlyExpandsRange(
+            GraphObserver::Range(Range, ClaimTok),
+            BuildNodeIdForMacro(Token, Info));
+      }
     }
   } else {
-    Observer.recordExpandsRange(RangeForTokenInCurrentContext(Token), MacroId);
+    // Macro-dense headers are re-expanded at the same sites every time the
+    // preprocessor revisits them; deduplicate before building the node id
+    // so repeats cost one set probe instead of a full reference record.
+    const auto Start = Token.getLocation();
+    const clang::SourceRange TokenRange(
+        Start, Start.getLocWithOffset(Token.getLength()));
+    const auto* ClaimTok = Observer.getClaimTokenForRange(TokenRange);
+    if (RecordedExpansionSites
+            .insert({{&Info, ClaimTok}, Start.getRawEncoding()})
+            .second) {
+      Observer.recordExpandsRange(
+          GraphObserver::Range(TokenRange, ClaimTok),
+          BuildNodeIdForMacro(Token, Info));
+    }
   }
   // TODO(zarko): Index macro arguments.
 }
@@ -218,10 +239,23 @@ void IndexerPPCallbacks::MacroExpands(const clang::Token& Token,
 void IndexerPPCallbacks::Defined(const clang::Token& MacroName,
                                  const clang::MacroDefinition& Macro,
                                  clang::SourceRange Range) {
-  DeferredRecords.push_back(
-      DeferredRecord{MacroName, Macro ? Macro.getLocalDirective() : nullptr,
-                     Macro && Macro.getLocalDirective()->isDefined(),
-                     RangeForTokenInCurrentContext(MacroName)});
+  if (!CurrentFileClaimed) {
+    return;
+  }
+  const clang::MacroDirective* Directive =
+      Macro ? Macro.getLocalDirective() : nullptr;
+  if (Directive == nullptr || !Directive->isDefined()) {
+    // Queries of undefined macros are dropped by the end-of-file filter, so
+    // there's no need to remember them.
+    return;
+  }
+  auto Inserted =
+      DeferredRecordIndex.try_emplace(Directive, DeferredRecords.size());
+  if (Inserted.second) {
+    DeferredRecords.push_back(DeferredRecordGroup{MacroName, Directive, {}});
+  }
+  DeferredRecords[Inserted.first->second].Ranges.push_back(
+      RangeForTokenInCurrentContext(MacroName));
 }
 
 void IndexerPPCallbacks::Ifdef(clang::SourceLocation Location,
@@ -246,10 +280,22 @@ void IndexerPPCallbacks::InclusionDirective(
     const clang::Module* Imported, clang::SrcMgr::CharacteristicKind FileType) {
   // TODO(zarko) (Modules): Check if `Imported` is non-null; if so, this
   // was transformed to a module import.
-  if (FileEntry != nullptr) {
-    Observer.recordIncludesRange(
-        RangeInCurrentContext(FilenameRange.getAsRange()), FileEntry);
+  if (FileEntry != nullptr && CurrentFileClaimed) {
+    // Headers re-entered under a reused claim context replay their #include
+    // directives; deduplicate sites so revisits cost one set probe instead
+    // of a full reference record. The target file's VName is cached by the
+    // observer, so the record itself is the remaining repeated work.
+    const auto Range = FilenameRange.getAsRange();
+    const auto* ClaimTok = Observer.getClaimTokenForRange(Range);
+    if (RecordedInclusionSites
+            .insert({{FileEntry, ClaimTok}, Range.getBegin().getRawEncoding()})
+            .second) {
+      Observer.recordIncludesRange(GraphObserver::Range(Range, ClaimTok),
+                                   FileEntry);
+    }
   }
+  // Even when the current file is unclaimed we must remember the hash
+  // location: it blames the #include when we enter the included file.
   LastInclusionHash = HashLocation;
 }
 
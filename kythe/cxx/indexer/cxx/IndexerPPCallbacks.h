@@ -24,6 +24,8 @@
 #include "clang/Basic/SourceManager.h"
 #include "clang/Lex/PPCallbacks.h"
 #include "clang/Lex/Token.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 
 namespace kythe {
 
@@ -100,21 +102,52 @@ class IndexerPPCallbacks : public clang::PPCallbacks {
 
  private:
   /// Some heuristics (such as whether a macro is a header guard) can only
-  /// be determined when a file has been fully preprocessed. A `DeferredRecord`
-  /// keeps track of a macro that needs this kind of analysis.
-  struct DeferredRecord {
-    const clang::Token MacroName;        ///< The spelling site for this macro.
-    const clang::MacroDirective* Macro;  ///< The macro itself, if defined.
-    bool WasDefined;  ///< If true, the macro was defined at time of deferral.
-    GraphObserver::Range Range;  ///< The range covering the spelling site.
+  /// be determined when a file has been fully preprocessed. A `DeferredRecords`
+  /// entry keeps track of all reference sites to one macro directive that need
+  /// this kind of analysis. Grouping by directive lets the end-of-file pass
+  /// run the heuristics and build the macro's `NodeId` once per macro rather
+  /// than once per reference site.
+  struct DeferredRecordGroup {
+    const clang::Token MacroName;        ///< A spelling site for this macro.
+    const clang::MacroDirective* Macro;  ///< The macro itself.
+    /// The ranges covering each spelling site.
+    std::vector<GraphObserver::Range> Ranges;
   };
 
   /// \brief Emits the deferred macros that should be emitted according to
   /// heuristics.
   void FilterAndEmitDeferredRecords();
 
-  /// \brief Keeps track of all DeferredRecords we've made.
-  std::vector<DeferredRecord> DeferredRecords;
+  /// \brief Keeps track of all deferred record groups we've made, in order of
+  /// first reference.
+  std::vector<DeferredRecordGroup> DeferredRecords;
+
+  /// \brief Maps a macro directive to its group in `DeferredRecords`.
+  llvm::DenseMap<const clang::MacroDirective*, size_t> DeferredRecordIndex;
+
+  /// \brief Expansion sites already recorded, keyed by macro definition,
+  /// claim context, and site location.
+  ///
+  /// Headers re-entered under new transcripts reuse claim contexts within a
+  /// TU, and rescanned token streams re-expand macros at sites we've
+  /// already seen; such re-expansions would emit byte-identical references,
+  /// so one record per key is enough.
+  llvm::DenseSet<std::pair<
+      std::pair<const clang::MacroInfo*, const GraphObserver::ClaimToken*>,
+      unsigned>>
+      RecordedExpansionSites;
+
+  /// \brief Inclusion sites already recorded, keyed by included file, claim
+  /// context, and site location.
+  ///
+  /// The same #include directive is revisited whenever its surrounding
+  /// header is re-entered under a reused claim context; revisits would
+  /// resolve the same target file and emit a byte-identical ref/includes
+  /// record, so one record per key is enough.
+  llvm::DenseSet<std::pair<
+      std::pair<const clang::FileEntry*, const GraphObserver::ClaimToken*>,
+      unsigned>>
+      RecordedInclusionSites;
 
   /// \brief Returns `SR` as a `Range` in the `IndexerPPCallbacks`'s current
   /// RangeContext.
@@ -148,6 +181,11 @@ class IndexerPPCallbacks : public clang::PPCallbacks {
   /// \param Spelling A token representing the macro's spelling.
   GraphObserver::NameId BuildNameIdForMacro(const clang::Token& Spelling);
 
+  /// Whether the file we are currently preprocessing is claimed by this
+  /// analysis. Records in unclaimed files would be dropped by per-record
+  /// claim checks anyway (they are all `Claimability::Claimable`), so we
+  /// check once per `FileChanged` and skip generating them entirely.
+  bool CurrentFileClaimed = true;
   /// The location of the hash for the last-seen #include.
   clang::SourceLocation LastInclusionHash;
   /// The `clang::Preprocessor` to which this `IndexerPPCallbacks` is listening.
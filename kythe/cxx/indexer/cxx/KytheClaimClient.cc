@@ -16,6 +16,12 @@
 
 #include "KytheClaimClient.h"
 
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "kythe/cxx/common/vname_key.h"
+
 namespace kythe {
 namespace {
 constexpr char kArbitraryClaimantRoot[] = "KytheClaimClient";
@@ -37,9 +43,17 @@ bool KytheClaimClient::ClaimBatch(
 
 bool StaticClaimClient::Claim(const kythe::proto::VName& claimant,
                               const kythe::proto::VName& vname) {
-  const auto lookup = claim_table_.find(vname);
+  if (!claim_filter_.contains(VNameFingerprint(vname))) {
+    // We don't know who's responsible for this VName; skip building the
+    // full table key.
+    return process_unknown_status_;
+  }
+  // Heterogeneous lookup on the canonical key keeps the hit path free of
+  // heap allocation.
+  VNameKeyBuffer key;
+  const auto lookup = claim_table_.find(VNameKey(vname, &key));
   if (lookup == claim_table_.end()) {
-    // We don't know who's responsible for this VName.
+    // Fingerprint collision with some other claimable.
     return process_unknown_status_;
   }
   return VNameEquals(lookup->second, claimant);
@@ -47,7 +61,30 @@ bool StaticClaimClient::Claim(const kythe::proto::VName& claimant,
 
 void StaticClaimClient::AssignClaim(const kythe::proto::VName& claimable,
                                     const kythe::proto::VName& claimant) {
-  claim_table_[claimable] = claimant;
+  claim_filter_.insert(VNameFingerprint(claimable));
+  VNameKeyBuffer key;
+  claim_table_[std::string(VNameKey(claimable, &key))] = claimant;
+}
+
+bool MappedClaimClient::Claim(const kythe::proto::VName& claimant,
+                              const kythe::proto::VName& vname) {
+  const uint64_t claimable = VNameFingerprint(vname);
+  if (!overrides_.empty()) {
+    auto override_it = overrides_.find(claimable);
+    if (override_it != overrides_.end()) {
+      return override_it->second == VNameFingerprint(claimant);
+    }
+  }
+  uint64_t assigned;
+  if (!table_->Lookup(claimable, &assigned)) {
+    return process_unknown_status_;
+  }
+  return assigned == VNameFingerprint(claimant);
+}
+
+void MappedClaimClient::AssignClaim(const kythe::proto::VName& claimable,
+                                    const kythe::proto::VName& claimant) {
+  overrides_[VNameFingerprint(claimable)] = VNameFingerprint(claimant);
 }
 
 }  // namespace kythe
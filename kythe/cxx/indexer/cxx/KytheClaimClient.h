@@ -17,8 +17,11 @@
 #ifndef KYTHE_CXX_INDEXER_CXX_KYTHE_CLAIM_CLIENT_H_
 #define KYTHE_CXX_INDEXER_CXX_KYTHE_CLAIM_CLIENT_H_
 
-#include <map>
+#include <memory>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "kythe/cxx/common/mapped_claim_table.h"
 #include "kythe/cxx/common/vname_ordering.h"
 #include "kythe/proto/storage.pb.h"
 
@@ -77,11 +80,60 @@ class StaticClaimClient : public KytheClaimClient {
   void AssignClaim(const kythe::proto::VName& claimable,
                    const kythe::proto::VName& claimant) override;
 
-  void Reset() override { claim_table_.clear(); }
+  /// \brief Prepares the claim table to hold `count` assignments; useful when
+  /// bulk-loading a static claim file of known size.
+  void ReserveClaims(size_t count) {
+    claim_table_.reserve(count);
+    claim_filter_.reserve(count);
+  }
+
+  void Reset() override {
+    claim_table_.clear();
+    claim_filter_.clear();
+  }
+
+ private:
+  /// Maps from canonical claimable VName keys (see `VNameKey`) to claimants.
+  absl::flat_hash_map<std::string, kythe::proto::VName> claim_table_;
+  /// Fingerprints of every claimable in `claim_table_`. Most claim checks on
+  /// large claim tables miss; testing this set first keeps the common path to
+  /// a hash probe over 8-byte entries instead of full-key comparisons.
+  absl::flat_hash_set<uint64_t> claim_filter_;
+  /// Process data with unknown claim status?
+  bool process_unknown_status_ = true;
+};
+
+/// \brief A client backed by a memory-mapped static claim table.
+///
+/// Unlike `StaticClaimClient`, which parses the whole claim file into a heap
+/// map at startup, this client answers claims with binary searches over the
+/// mapping, so startup cost is independent of table size and all indexer
+/// processes on a machine share one physical copy of the table.
+class MappedClaimClient : public KytheClaimClient {
+ public:
+  explicit MappedClaimClient(std::unique_ptr<MappedClaimTable> table)
+      : table_(std::move(table)) {}
+
+  bool Claim(const kythe::proto::VName& claimant,
+             const kythe::proto::VName& vname) override;
+
+  /// \sa StaticClaimClient::set_process_unknown_status
+  void set_process_unknown_status(bool process_unknown_status) {
+    process_unknown_status_ = process_unknown_status;
+  }
+
+  /// \brief Overrides the mapped assignment for `claimable`.
+  void AssignClaim(const kythe::proto::VName& claimable,
+                   const kythe::proto::VName& claimant) override;
+
+  void Reset() override { overrides_.clear(); }
 
  private:
-  /// Maps from claimables to claimants.
-  std::map<kythe::proto::VName, kythe::proto::VName, VNameLess> claim_table_;
+  /// The mapped table; never null.
+  std::unique_ptr<MappedClaimTable> table_;
+  /// Assignments added after the table was built, keyed and valued by
+  /// fingerprint. Consulted before the table.
+  absl::flat_hash_map<uint64_t, uint64_t> overrides_;
   /// Process data with unknown claim status?
   bool process_unknown_status_ = true;
 };
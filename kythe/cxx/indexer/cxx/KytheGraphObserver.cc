@@ -16,6 +16,10 @@
 
 #include "KytheGraphObserver.h"
 
+#include <algorithm>
+#include <map>
+#include <string>
+
 #include "IndexerASTHooks.h"
 #include "absl/flags/flag.h"
 #include "absl/strings/str_cat.h"
@@ -42,6 +46,7 @@
 #include "clang/AST/TypeLoc.h"
 #include "clang/Basic/SourceManager.h"
 #include "kythe/cxx/common/indexing/KytheGraphRecorder.h"
+#include "kythe/cxx/common/indexing/MemoryAccounting.h"
 #include "kythe/cxx/common/path_utils.h"
 #include "kythe/cxx/common/schema/edges.h"
 #include "kythe/cxx/extractor/language.h"
@@ -54,6 +59,13 @@ ABSL_FLAG(bool, fail_on_unimplemented_builtin, false,
 namespace kythe {
 namespace {
 
+/// \return the byte counter for the observer's node/anchor deduplication
+/// sets.
+MemoryCounter& NodeSetCounter() {
+  static auto* counter = new MemoryCounter("graph observer node sets");
+  return *counter;
+}
+
 struct ClaimedStringFormatter {
   void operator()(std::string* out, const GraphObserver::NodeId& id) {
     out->append(id.ToClaimedString());
@@ -113,6 +125,13 @@ static const char* FunctionSubkindToString(
 
 kythe::proto::VName KytheGraphObserver::VNameFromFileEntry(
     const clang::FileEntry* file_entry) {
+  // FileEntries are stable for the life of the FileManager and their VNames
+  // are recomputed for every anchor, so build each file's VName once and
+  // serve later requests with a pointer lookup.
+  auto cached = file_vname_cache_.find(file_entry);
+  if (cached != file_vname_cache_.end()) {
+    return cached->second;
+  }
   kythe::proto::VName out_name;
   if (!vfs_->get_vname(file_entry, &out_name)) {
     llvm::StringRef working_directory = vfs_->working_directory();
@@ -125,7 +144,24 @@ kythe::proto::VName KytheGraphObserver::VNameFromFileEntry(
     }
     out_name.set_corpus(claimant_.corpus());
   }
-  return out_name;
+  return file_vname_cache_.try_emplace(file_entry, std::move(out_name))
+      .first->second;
+}
+
+const kythe::proto::VName* KytheGraphObserver::AnchorVNamePrefixForFile(
+    clang::FileID file) {
+  if (file.isInvalid()) {
+    return nullptr;
+  }
+  auto [iter, inserted] = anchor_vname_prefix_cache_.try_emplace(file);
+  if (inserted) {
+    if (const clang::FileEntry* file_entry =
+            SourceManager->getFileEntryForID(file)) {
+      iter->second = VNameFromFileEntry(file_entry);
+      iter->second->mutable_signature()->append("@");
+    }
+  }
+  return iter->second.has_value() ? &*iter->second : nullptr;
 }
 
 void KytheGraphObserver::AppendFileBufferSliceHashToStream(
@@ -269,19 +305,27 @@ kythe::proto::VName KytheGraphObserver::VNameFromRange(
     if (end.isMacroID()) {
       end = SourceManager->getExpansionLoc(end);
     }
-    if (const clang::FileEntry* file_entry =
-            SearchForFileEntry(begin, SourceManager)) {
-      out_name.CopyFrom(VNameFromFileEntry(file_entry));
-    } else if (range.Kind == GraphObserver::Range::RangeKind::Wraith) {
-      VNameRefFromNodeId(range.Context).Expand(&out_name);
+    const kythe::proto::VName* prefix = nullptr;
+    if (begin.isFileID()) {
+      prefix = AnchorVNamePrefixForFile(SourceManager->getFileID(begin));
+    }
+    if (prefix != nullptr) {
+      // The cached prefix already carries the file fields and the leading
+      // "@"; only the offsets remain to be appended.
+      out_name = *prefix;
+    } else {
+      if (const clang::FileEntry* file_entry =
+              SearchForFileEntry(begin, SourceManager)) {
+        out_name.CopyFrom(VNameFromFileEntry(file_entry));
+      } else if (range.Kind == GraphObserver::Range::RangeKind::Wraith) {
+        VNameRefFromNodeId(range.Context).Expand(&out_name);
+      }
+      out_name.mutable_signature()->append("@");
     }
     size_t begin_offset = SourceManager->getFileOffset(begin);
     size_t end_offset = SourceManager->getFileOffset(end);
     auto* const signature = out_name.mutable_signature();
-    signature->append("@");
-    signature->append(std::to_string(begin_offset));
-    signature->append(":");
-    signature->append(std::to_string(end_offset));
+    absl::StrAppend(signature, begin_offset, ":", end_offset);
     if (range.Kind == GraphObserver::Range::RangeKind::Wraith ||
         range.Kind == GraphObserver::Range::RangeKind::Implicit) {
       signature->append("@");
@@ -369,41 +413,167 @@ void KytheGraphObserver::recordVariableNode(
 void KytheGraphObserver::recordNamespaceNode(
     const NodeId& node, const absl::optional<MarkedSource>& marked_source) {
   VNameRef node_vname = VNameRefFromNodeId(node);
-  if (written_namespaces_.insert(node.ToClaimedString()).second) {
+  auto inserted = written_namespaces_.insert(node.ToClaimedString());
+  if (inserted.second) {
+    NodeSetCounter().Add(inserted.first->size());
     recorder_->AddProperty(node_vname, NodeKindID::kPackage);
     recorder_->AddProperty(node_vname, PropertyID::kSubkind, "namespace");
     AddMarkedSource(node_vname, marked_source);
   }
 }
 
+bool KytheGraphObserver::DeferredRangeSet::Insert(clang::FileID file,
+                                                  uint64_t key) {
+  FileRanges& ranges = files_[file];
+  for (uint64_t recent : ranges.pending) {
+    if (recent == key) {
+      return false;
+    }
+  }
+  if (std::binary_search(ranges.sorted.begin(), ranges.sorted.end(), key)) {
+    return false;
+  }
+  ranges.pending.push_back(key);
+  ++size_;
+  if (ranges.pending.size() >= kMergeBatch) {
+    auto middle = ranges.sorted.size();
+    ranges.sorted.insert(ranges.sorted.end(), ranges.pending.begin(),
+                         ranges.pending.end());
+    ranges.pending.clear();
+    std::sort(ranges.sorted.begin() + middle, ranges.sorted.end());
+    std::inplace_merge(ranges.sorted.begin(), ranges.sorted.begin() + middle,
+                       ranges.sorted.end());
+  }
+  return true;
+}
+
+size_t KytheGraphObserver::DeferredRangeSet::Clear() {
+  size_t size = size_;
+  files_.clear();
+  size_ = 0;
+  return size;
+}
+
 void KytheGraphObserver::RecordRange(const proto::VName& anchor_name,
                                      const GraphObserver::Range& range) {
-  if (!deferring_nodes_ || deferred_anchors_.insert(range).second) {
+  if (!deferring_nodes_) {
+    UnconditionalRecordRange(anchor_name, range);
+    return;
+  }
+  if (range.Kind == GraphObserver::Range::RangeKind::Physical &&
+      range.PhysicalRange.getBegin().isFileID() &&
+      range.PhysicalRange.getEnd().isFileID()) {
+    // The common case: a plain file range's identity is just its endpoints,
+    // so it dedups through the flat per-file arrays.
+    clang::FileID file =
+        SourceManager->getFileID(range.PhysicalRange.getBegin());
+    uint64_t key =
+        (uint64_t{range.PhysicalRange.getBegin().getRawEncoding()} << 32) |
+        range.PhysicalRange.getEnd().getRawEncoding();
+    if (deferred_anchor_ranges_.Insert(file, key)) {
+      NodeSetCounter().Add(sizeof(uint64_t));
+      UnconditionalRecordRange(anchor_name, range);
+    }
+    return;
+  }
+  if (deferred_anchors_.insert(range).second) {
+    NodeSetCounter().Add(sizeof(Range));
     UnconditionalRecordRange(anchor_name, range);
   }
 }
 
 void KytheGraphObserver::UnconditionalRecordRange(
     const proto::VName& anchor_name, const GraphObserver::Range& range) {
-  VNameRef anchor_name_ref(anchor_name);
-  recorder_->AddProperty(anchor_name_ref, NodeKindID::kAnchor);
-  if (range.Kind == GraphObserver::Range::RangeKind::Implicit) {
-    recorder_->AddProperty(anchor_name_ref, PropertyID::kSubkind, "implicit");
-  }
+  EnqueueAnchor(anchor_name, range);
+}
+
+void KytheGraphObserver::EnqueueAnchor(const proto::VName& anchor_name,
+                                       const GraphObserver::Range& range) {
+  PendingAnchor anchor;
+  anchor.name = anchor_name;
+  anchor.implicit = range.Kind == GraphObserver::Range::RangeKind::Implicit;
   if (range.PhysicalRange.getBegin().isValid()) {
-    RecordSourceLocation(anchor_name_ref, range.PhysicalRange.getBegin(),
-                         PropertyID::kLocationStartOffset);
-    RecordSourceLocation(anchor_name_ref, range.PhysicalRange.getEnd(),
-                         PropertyID::kLocationEndOffset);
+    // Resolve offsets now, while the file is still on the stack; the facts
+    // themselves are batched and written when the outermost file is popped.
+    clang::SourceLocation begin = range.PhysicalRange.getBegin();
+    clang::SourceLocation end = range.PhysicalRange.getEnd();
+    if (begin.isMacroID()) {
+      begin = SourceManager->getExpansionLoc(begin);
+    }
+    if (end.isMacroID()) {
+      end = SourceManager->getExpansionLoc(end);
+    }
+    anchor.has_range = true;
+    anchor.begin_offset = SourceManager->getFileOffset(begin);
+    anchor.end_offset = SourceManager->getFileOffset(end);
   }
   if (range.Kind == GraphObserver::Range::RangeKind::Wraith) {
-    recorder_->AddEdge(anchor_name_ref, EdgeKindID::kChildOfContext,
-                       VNameRefFromNodeId(range.Context));
+    anchor.context.emplace();
+    VNameRefFromNodeId(range.Context).Expand(&*anchor.context);
   }
-  if (!build_config_.empty()) {
-    recorder_->AddProperty(anchor_name_ref, PropertyID::kBuildConfig,
-                           build_config_);
+  pending_anchors_.push_back(std::move(anchor));
+}
+
+void KytheGraphObserver::FlushPendingAnchors() {
+  if (pending_anchors_.empty()) {
+    return;
+  }
+  // Ranges were deduplicated as they were deferred, but stamped and unstamped
+  // anchors are tracked in separate sets; drop any exact duplicates here so
+  // each anchor's facts are written once.
+  std::unordered_set<std::string> emitted;
+  for (const auto& anchor : pending_anchors_) {
+    if (!emitted.insert(anchor.name.SerializeAsString()).second) {
+      continue;
+    }
+    VNameRef anchor_name_ref(anchor.name);
+    recorder_->AddProperty(anchor_name_ref, NodeKindID::kAnchor);
+    if (anchor.implicit) {
+      recorder_->AddProperty(anchor_name_ref, PropertyID::kSubkind,
+                             "implicit");
+    }
+    if (anchor.has_range) {
+      recorder_->AddProperty(anchor_name_ref, PropertyID::kLocationStartOffset,
+                             anchor.begin_offset);
+      recorder_->AddProperty(anchor_name_ref, PropertyID::kLocationEndOffset,
+                             anchor.end_offset);
+    }
+    if (anchor.context) {
+      recorder_->AddEdge(anchor_name_ref, EdgeKindID::kChildOfContext,
+                         VNameRef(*anchor.context));
+    }
+    if (!build_config_.empty()) {
+      recorder_->AddProperty(anchor_name_ref, PropertyID::kBuildConfig,
+                             build_config_);
+    }
+  }
+  pending_anchors_.clear();
+}
+
+void KytheGraphObserver::RecordAnchorEdge(const proto::VName& anchor_name,
+                                          EdgeKindID anchor_edge_kind,
+                                          const VNameRef& target) {
+  if (!aggregate_anchor_edges_) {
+    recorder_->AddEdge(VNameRef(anchor_name), anchor_edge_kind, target);
+    return;
+  }
+  PendingEdge edge;
+  edge.source = anchor_name;
+  target.Expand(&edge.target);
+  pending_edges_[{anchor_name.path(), anchor_edge_kind}].push_back(
+      std::move(edge));
+}
+
+void KytheGraphObserver::FlushPendingEdges() {
+  // The map keeps runs in (file, edge kind) order; within a run, edges stay
+  // in visit order, which already tracks position within the file.
+  for (const auto& run : pending_edges_) {
+    for (const auto& edge : run.second) {
+      recorder_->AddEdge(VNameRef(edge.source), run.first.second,
+                         VNameRef(edge.target));
+    }
   }
+  pending_edges_.clear();
 }
 
 void KytheGraphObserver::MetaHookDefines(const MetadataFile& meta,
@@ -411,36 +581,34 @@ void KytheGraphObserver::MetaHookDefines(const MetadataFile& meta,
                                          unsigned range_begin,
                                          unsigned range_end,
                                          const VNameRef& decl) {
-  auto rules = meta.rules().equal_range(range_begin);
-  for (auto rule = rules.first; rule != rules.second; ++rule) {
-    if (rule->second.begin == range_begin && rule->second.end == range_end &&
-        (rule->second.edge_in == kythe::common::schema::kDefines ||
-         rule->second.edge_in == kythe::common::schema::kDefinesBinding)) {
-      VNameRef remote(rule->second.vname);
+  for (const auto& rule : meta.FindRules(range_begin, range_end)) {
+    if (rule.edge_in == kythe::common::schema::kDefines ||
+        rule.edge_in == kythe::common::schema::kDefinesBinding) {
+      VNameRef remote(rule.vname);
       EdgeKindID edge_kind;
       std::string new_signature;
-      if (rule->second.generate_anchor) {
+      if (rule.generate_anchor) {
         // Distinguish these anchors from ordinary ones for easier debugging.
         new_signature = "@@m";
-        new_signature.append(std::to_string(rule->second.anchor_begin));
+        new_signature.append(std::to_string(rule.anchor_begin));
         new_signature.append("-");
-        new_signature.append(std::to_string(rule->second.anchor_end));
+        new_signature.append(std::to_string(rule.anchor_end));
         remote.set_signature(new_signature);
         recorder_->AddProperty(remote, NodeKindID::kAnchor);
         recorder_->AddProperty(remote, PropertyID::kLocationStartOffset,
-                               rule->second.anchor_begin);
+                               rule.anchor_begin);
         recorder_->AddProperty(remote, PropertyID::kLocationEndOffset,
-                               rule->second.anchor_end);
+                               rule.anchor_end);
       }
-      if (of_spelling(rule->second.edge_out, &edge_kind)) {
-        if (rule->second.reverse_edge) {
+      if (of_spelling(rule.edge_out, &edge_kind)) {
+        if (rule.reverse_edge) {
           recorder_->AddEdge(remote, edge_kind, decl);
         } else {
           recorder_->AddEdge(decl, edge_kind, remote);
         }
       } else {
         absl::FPrintF(stderr, "Unknown edge kind %s from metadata\n",
-                      rule->second.edge_out);
+                      rule.edge_out);
       }
     }
   }
@@ -513,17 +681,102 @@ void KytheGraphObserver::ApplyMetadataRules(
   }
 }
 
+void KytheGraphObserver::NoteAnchorTruncation(clang::FileID file,
+                                              const std::string& message) {
+  const clang::FileEntry* entry = SourceManager->getFileEntryForID(file);
+  if (entry == nullptr) {
+    return;
+  }
+  proto::VName file_vname = VNameFromFileEntry(entry);
+  proto::VName diagnostic_vname = file_vname;
+  diagnostic_vname.set_signature("anchor_budget");
+  recorder_->AddProperty(VNameRef(diagnostic_vname), NodeKindID::kDiagnostic);
+  recorder_->AddProperty(VNameRef(diagnostic_vname),
+                         PropertyID::kDiagnosticMessage, message);
+  recorder_->AddEdge(VNameRef(file_vname), EdgeKindID::kTagged,
+                     VNameRef(diagnostic_vname));
+  LOG(WARNING) << entry->getName().str() << ": " << message;
+}
+
+bool KytheGraphObserver::AnchorBudgetAllows(
+    const GraphObserver::Range& range) {
+  if (file_anchor_budget_ <= 0 || !range.PhysicalRange.getBegin().isValid()) {
+    return true;
+  }
+  clang::SourceLocation begin = range.PhysicalRange.getBegin();
+  if (begin.isMacroID()) {
+    begin = SourceManager->getExpansionLoc(begin);
+  }
+  clang::FileID file = SourceManager->getFileID(begin);
+  if (file.isInvalid()) {
+    return true;
+  }
+  AnchorBudgetState& state = anchor_budget_states_[file];
+  ++state.seen;
+  if (state.seen <= file_anchor_budget_) {
+    return true;
+  }
+  if (!state.truncation_noted) {
+    state.truncation_noted = true;
+    NoteAnchorTruncation(
+        file, absl::StrCat("File exceeded the anchor budget of ",
+                           file_anchor_budget_, "; emitting 1 of every ",
+                           kAnchorSampleStride, " further anchors."));
+  }
+  // Sampling depends only on the anchor's position in emission order, which
+  // is fixed for a given compilation, so reruns produce identical output.
+  return (state.seen - file_anchor_budget_) % kAnchorSampleStride == 0;
+}
+
+bool KytheGraphObserver::isFileOverAnchorBudget(clang::SourceLocation loc) {
+  if (file_anchor_budget_ <= 0 || loc.isInvalid()) {
+    return false;
+  }
+  if (loc.isMacroID()) {
+    loc = SourceManager->getExpansionLoc(loc);
+  }
+  if (!loc.isValid() || !loc.isFileID()) {
+    return false;
+  }
+  clang::FileID file = SourceManager->getFileID(loc);
+  if (file.isInvalid()) {
+    return false;
+  }
+  AnchorBudgetState& state = anchor_budget_states_[file];
+  if (!state.prescanned) {
+    state.prescanned = true;
+    // Condemn pathological files from their size alone, before millions of
+    // anchors have already been spent on them.
+    if (static_cast<int64_t>(SourceManager->getFileIDSize(file)) >
+        file_anchor_budget_ * kPrescanBytesPerAnchor) {
+      state.skip_bodies = true;
+      if (!state.truncation_noted) {
+        state.truncation_noted = true;
+        NoteAnchorTruncation(
+            file,
+            absl::StrCat("File is too large for the anchor budget of ",
+                         file_anchor_budget_,
+                         "; switching to declaration-only indexing."));
+      }
+    }
+  }
+  return state.skip_bodies || state.seen > file_anchor_budget_;
+}
+
 void KytheGraphObserver::RecordStampedAnchor(
     const GraphObserver::Range& source_range,
     const GraphObserver::NodeId& primary_anchored_to_decl,
     const absl::optional<GraphObserver::NodeId>& primary_anchored_to_def,
     EdgeKindID anchor_edge_kind, const GraphObserver::NodeId& stamp) {
+  if (!AnchorBudgetAllows(source_range)) {
+    return;
+  }
   proto::VName anchor_name = StampedVNameFromRange(source_range, stamp);
   if (stamped_ranges_.emplace(source_range, stamp).second) {
     UnconditionalRecordRange(anchor_name, source_range);
   }
-  recorder_->AddEdge(VNameRef(anchor_name), anchor_edge_kind,
-                     VNameRefFromNodeId(primary_anchored_to_decl));
+  RecordAnchorEdge(anchor_name, anchor_edge_kind,
+                   VNameRefFromNodeId(primary_anchored_to_decl));
   ApplyMetadataRules(source_range, primary_anchored_to_decl,
                      primary_anchored_to_def, anchor_edge_kind, anchor_name);
 }
@@ -533,6 +786,9 @@ void KytheGraphObserver::RecordAnchor(
     const GraphObserver::NodeId& primary_anchored_to,
     EdgeKindID anchor_edge_kind, Claimability cl) {
   CHECK(!file_stack_.empty());
+  if (!AnchorBudgetAllows(source_range)) {
+    return;
+  }
   if (drop_redundant_wraiths_ &&
       !range_edges_
            .insert(RangeEdge{
@@ -549,8 +805,8 @@ void KytheGraphObserver::RecordAnchor(
     cl = Claimability::Unclaimable;
   }
   if (cl == Claimability::Unclaimable) {
-    recorder_->AddEdge(VNameRef(anchor_name), anchor_edge_kind,
-                       VNameRefFromNodeId(primary_anchored_to));
+    RecordAnchorEdge(anchor_name, anchor_edge_kind,
+                     VNameRefFromNodeId(primary_anchored_to));
     ApplyMetadataRules(source_range, primary_anchored_to, absl::nullopt,
                        anchor_edge_kind, anchor_name);
   }
@@ -561,14 +817,17 @@ void KytheGraphObserver::RecordAnchor(
     const kythe::proto::VName& primary_anchored_to, EdgeKindID anchor_edge_kind,
     Claimability cl) {
   CHECK(!file_stack_.empty());
+  if (!AnchorBudgetAllows(source_range)) {
+    return;
+  }
   proto::VName anchor_name = VNameFromRange(source_range);
   if (claimRange(source_range)) {
     RecordRange(anchor_name, source_range);
     cl = Claimability::Unclaimable;
   }
   if (cl == Claimability::Unclaimable) {
-    recorder_->AddEdge(VNameRef(anchor_name), anchor_edge_kind,
-                       VNameRef(primary_anchored_to));
+    RecordAnchorEdge(anchor_name, anchor_edge_kind,
+                     VNameRef(primary_anchored_to));
   }
 }
 
@@ -647,6 +906,35 @@ void KytheGraphObserver::recordTypeEdge(const NodeId& term_id,
                      VNameRefFromNodeId(type_id));
 }
 
+void KytheGraphObserver::recordNodeBatch(const NodeBatch& batch) {
+  // The subject's VName is materialized once for every staged record.
+  VNameRef subject_vname = VNameRefFromNodeId(batch.Subject);
+  AddMarkedSource(subject_vname, batch.Code);
+  if (batch.Type) {
+    recorder_->AddEdge(subject_vname, EdgeKindID::kHasType,
+                       VNameRefFromNodeId(*batch.Type));
+  }
+  if (batch.Parent) {
+    recorder_->AddEdge(subject_vname, EdgeKindID::kChildOf,
+                       VNameRefFromNodeId(*batch.Parent));
+  }
+  // Staged params are ordinal-ordered and almost always dense; emit each
+  // maximal consecutive run as one range.
+  std::vector<VNameRef> param_run;
+  for (size_t i = 0; i < batch.Params.size();) {
+    uint32_t first_ordinal = batch.Params[i].first;
+    param_run.clear();
+    param_run.push_back(VNameRefFromNodeId(batch.Params[i].second));
+    for (++i; i < batch.Params.size() &&
+              batch.Params[i].first == first_ordinal + param_run.size();
+         ++i) {
+      param_run.push_back(VNameRefFromNodeId(batch.Params[i].second));
+    }
+    recorder_->AddEdgeRange(subject_vname, EdgeKindID::kParam, param_run,
+                            first_ordinal);
+  }
+}
+
 void KytheGraphObserver::recordInfluences(const NodeId& influencer,
                                           const NodeId& influenced) {
   recorder_->AddEdge(VNameRefFromNodeId(influencer), EdgeKindID::kInfluences,
@@ -734,7 +1022,7 @@ GraphObserver::NodeId KytheGraphObserver::recordTypeAliasNode(
     const absl::optional<NodeId>& root_aliased_type,
     const absl::optional<MarkedSource>& marked_source) {
   if (!deferring_nodes_ ||
-      written_types_.insert(type_id.ToClaimedString()).second) {
+      MarkWritten(type_id, &written_types_)) {
     VNameRef type_vname(VNameRefFromNodeId(type_id));
     recorder_->AddProperty(type_vname, NodeKindID::kTAlias);
     AddMarkedSource(type_vname, marked_source);
@@ -762,14 +1050,17 @@ void KytheGraphObserver::recordDocumentationText(
   // characters appear in VName fields.
   NodeId doc_id(node.getToken(), CompressString(signature, true));
   VNameRef doc_vname(VNameRefFromNodeId(doc_id));
-  if (written_docs_.insert(doc_id.ToClaimedString()).second) {
+  auto inserted = written_docs_.insert(doc_id.ToClaimedString());
+  if (inserted.second) {
+    NodeSetCounter().Add(inserted.first->size());
     recorder_->AddProperty(doc_vname, NodeKindID::kDoc);
     recorder_->AddProperty(doc_vname, PropertyID::kText, doc_text);
-    size_t param_index = 0;
+    std::vector<VNameRef> link_vnames;
+    link_vnames.reserve(doc_links.size());
     for (const auto& link : doc_links) {
-      recorder_->AddEdge(doc_vname, EdgeKindID::kParam,
-                         VNameRefFromNodeId(link), param_index++);
+      link_vnames.push_back(VNameRefFromNodeId(link));
     }
+    recorder_->AddEdgeRange(doc_vname, EdgeKindID::kParam, link_vnames, 0);
   }
   recorder_->AddEdge(doc_vname, EdgeKindID::kDocuments,
                      VNameRefFromNodeId(node));
@@ -827,7 +1118,7 @@ GraphObserver::NodeId KytheGraphObserver::recordNominalTypeNode(
     const NodeId& name_id, const absl::optional<MarkedSource>& marked_source,
     const absl::optional<NodeId>& parent) {
   if (!deferring_nodes_ ||
-      written_types_.insert(name_id.ToClaimedString()).second) {
+      MarkWritten(name_id, &written_types_)) {
     VNameRef type_vname(VNameRefFromNodeId(name_id));
     AddMarkedSource(type_vname, marked_source);
     recorder_->AddProperty(type_vname, NodeKindID::kTNominal);
@@ -850,13 +1141,15 @@ GraphObserver::NodeId KytheGraphObserver::nodeIdForTsigmaNode(
 GraphObserver::NodeId KytheGraphObserver::recordTsigmaNode(
     const NodeId& tsigma_id, absl::Span<const NodeId> params) {
   if (!deferring_nodes_ ||
-      written_types_.insert(tsigma_id.ToClaimedString()).second) {
+      MarkWritten(tsigma_id, &written_types_)) {
     VNameRef tsigma_vname = VNameRefFromNodeId(tsigma_id);
     recorder_->AddProperty(tsigma_vname, NodeKindID::kTSigma);
-    for (uint32_t param_index = 0; param_index < params.size(); ++param_index) {
-      recorder_->AddEdge(tsigma_vname, EdgeKindID::kParam,
-                         VNameRefFromNodeId(params[param_index]), param_index);
+    std::vector<VNameRef> param_vnames;
+    param_vnames.reserve(params.size());
+    for (const NodeId& param : params) {
+      param_vnames.push_back(VNameRefFromNodeId(param));
     }
+    recorder_->AddEdgeRange(tsigma_vname, EdgeKindID::kParam, param_vnames, 0);
   }
   return tsigma_id;
 }
@@ -881,20 +1174,21 @@ GraphObserver::NodeId KytheGraphObserver::recordTappNode(
     absl::Span<const NodeId> params, unsigned first_default_param) {
   CHECK(first_default_param <= params.size());
   if (!deferring_nodes_ ||
-      written_types_.insert(tapp_id.ToClaimedString()).second) {
+      MarkWritten(tapp_id, &written_types_)) {
     VNameRef tapp_vname = VNameRefFromNodeId(tapp_id);
     recorder_->AddProperty(tapp_vname, NodeKindID::kTApp);
     if (first_default_param < params.size()) {
       recorder_->AddProperty(tapp_vname, PropertyID::kParamDefault,
                              first_default_param);
     }
-    recorder_->AddEdge(tapp_vname, EdgeKindID::kParam,
-                       VNameRefFromNodeId(tycon_id), 0);
-    for (uint32_t param_index = 0; param_index < params.size(); ++param_index) {
-      recorder_->AddEdge(tapp_vname, EdgeKindID::kParam,
-                         VNameRefFromNodeId(params[param_index]),
-                         param_index + 1);
+    // The type constructor is param 0; its arguments follow in one run.
+    std::vector<VNameRef> param_vnames;
+    param_vnames.reserve(params.size() + 1);
+    param_vnames.push_back(VNameRefFromNodeId(tycon_id));
+    for (const NodeId& param : params) {
+      param_vnames.push_back(VNameRefFromNodeId(param));
     }
+    recorder_->AddEdgeRange(tapp_vname, EdgeKindID::kParam, param_vnames, 0);
   }
   return tapp_id;
 }
@@ -1326,7 +1620,11 @@ void KytheGraphObserver::popFile() {
   FileState state = file_stack_.back();
   file_stack_.pop_back();
   if (file_stack_.empty()) {
+    FlushPendingAnchors();
+    FlushPendingEdges();
+    NodeSetCounter().Remove(sizeof(Range) * deferred_anchors_.size());
     deferred_anchors_.clear();
+    NodeSetCounter().Remove(sizeof(uint64_t) * deferred_anchor_ranges_.Clear());
   }
 }
 
@@ -1353,13 +1651,28 @@ bool KytheGraphObserver::claimLocation(clang::SourceLocation source_location) {
     source_location = SourceManager->getExpansionLoc(source_location);
   }
   CHECK(source_location.isFileID());
+  // Anchors cluster heavily by file, and a file's locations occupy one
+  // contiguous interval of the SLoc address space; remembering the interval
+  // of the file most recently checked answers repeat queries without the
+  // SourceManager's FileID binary search or any map lookup.
+  if (source_location.getRawEncoding() - claimed_interval_begin_ <=
+      claimed_interval_size_) {
+    return claimed_interval_result_;
+  }
   clang::FileID file = SourceManager->getFileID(source_location);
   if (file.isInvalid()) {
     return true;
   }
-  auto token = claim_checked_files_.find(file);
-  return token != claim_checked_files_.end() ? token->second.rough_claimed()
-                                             : false;
+  const KytheClaimToken* token = FindClaimTokenForFile(file);
+  if (token == nullptr) {
+    // Not memoized: the file may still be registered later.
+    return false;
+  }
+  claimed_interval_begin_ =
+      SourceManager->getLocForStartOfFile(file).getRawEncoding();
+  claimed_interval_size_ = SourceManager->getFileIDSize(file);
+  claimed_interval_result_ = token->rough_claimed();
+  return claimed_interval_result_;
 }
 
 void KytheGraphObserver::AddContextInformation(
@@ -1389,8 +1702,8 @@ const KytheClaimToken* KytheGraphObserver::getClaimTokenForLocation(
   if (file.isInvalid()) {
     return &default_token_;
   }
-  auto token = claim_checked_files_.find(file);
-  return token != claim_checked_files_.end() ? &token->second : &default_token_;
+  const KytheClaimToken* token = FindClaimTokenForFile(file);
+  return token != nullptr ? token : &default_token_;
 }
 
 const KytheClaimToken* KytheGraphObserver::getClaimTokenForRange(
@@ -1433,21 +1746,25 @@ KytheGraphObserver::getNamespaceTokens(clang::SourceLocation loc) const {
   return iter->second;
 }
 
-void KytheGraphObserver::RegisterBuiltins() {
-  auto RegisterBuiltin = [&](const std::string& name,
-                             const MarkedSource& marked_source) {
-    builtins_.emplace(name,
-                      Builtin{NodeId::CreateUncompressed(getDefaultClaimToken(),
-                                                         name + "#builtin"),
-                              marked_source, false});
-  };
-  auto RegisterTokenBuiltin = [&](const std::string& name,
-                                  const std::string& token) {
-    MarkedSource sig;
-    sig.set_kind(MarkedSource::IDENTIFIER);
-    sig.set_pre_text(token);
-    RegisterBuiltin(name, sig);
-  };
+namespace {
+/// \brief Returns the fixed table of builtin spellings and their marked
+/// source. The set of builtins and their renderings is known at compile
+/// time, so the table is built once per process and each translation
+/// unit's observer copies from it instead of rebuilding every proto.
+const std::map<std::string, MarkedSource>& BuiltinMarkedSources() {
+  static const auto* table = [] {
+    auto* result = new std::map<std::string, MarkedSource>();
+    auto RegisterBuiltin = [&](const std::string& name,
+                               const MarkedSource& marked_source) {
+      result->emplace(name, marked_source);
+    };
+    auto RegisterTokenBuiltin = [&](const std::string& name,
+                                    const std::string& token) {
+      MarkedSource sig;
+      sig.set_kind(MarkedSource::IDENTIFIER);
+      sig.set_pre_text(token);
+      RegisterBuiltin(name, sig);
+    };
   RegisterTokenBuiltin("void", "void");
   RegisterTokenBuiltin("bool", "bool");
   RegisterTokenBuiltin("_Bool", "_Bool");
@@ -1547,6 +1864,20 @@ void KytheGraphObserver::RegisterBuiltins() {
     vararg_keyword->set_kind(MarkedSource::IDENTIFIER);
     vararg_keyword->set_pre_text("vararg");
     RegisterBuiltin("fnvararg", function_tycon_builtin);
+    return result;
+  }();
+  return *table;
+}
+
+}  // anonymous namespace
+
+void KytheGraphObserver::RegisterBuiltins() {
+  for (const auto& entry : BuiltinMarkedSources()) {
+    builtins_.emplace(
+        entry.first,
+        Builtin{NodeId::CreateUncompressed(getDefaultClaimToken(),
+                                           entry.first + "#builtin"),
+                entry.second, false});
   }
 }
 
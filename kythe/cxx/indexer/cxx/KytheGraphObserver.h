@@ -17,10 +17,12 @@
 #ifndef KYTHE_CXX_INDEXER_CXX_KYTHE_GRAPH_OBSERVER_H_
 #define KYTHE_CXX_INDEXER_CXX_KYTHE_GRAPH_OBSERVER_H_
 
+#include <cstdint>
 #include <functional>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "GraphObserver.h"
 #include "absl/container/flat_hash_set.h"
@@ -33,6 +35,7 @@
 #include "kythe/cxx/indexer/cxx/KytheClaimClient.h"
 #include "kythe/cxx/indexer/cxx/KytheVFS.h"
 #include "kythe/proto/storage.pb.h"
+#include "llvm/ADT/DenseMap.h"
 
 namespace kythe {
 
@@ -153,6 +156,11 @@ class KytheGraphObserver : public GraphObserver {
     EmitMetaNodes();
   }
 
+  ~KytheGraphObserver() override {
+    FlushPendingAnchors();
+    FlushPendingEdges();
+  }
+
   NodeId getNodeIdForBuiltinType(
       const llvm::StringRef& spelling) const override;
 
@@ -164,6 +172,25 @@ class KytheGraphObserver : public GraphObserver {
                          const std::string& search_string) override;
   void StopDeferringNodes() { deferring_nodes_ = false; }
   void DropRedundantWraiths() { drop_redundant_wraiths_ = true; }
+
+  /// \brief Buffer anchor edges, grouped by (file, edge kind), and emit them
+  /// as sorted runs when the outermost file is popped instead of interleaved
+  /// in AST-visit order. The entry stream is unordered, so this only changes
+  /// the locality of the output, which downstream sorting phases can exploit.
+  void AggregateAnchorEdges() { aggregate_anchor_edges_ = true; }
+
+  /// \brief Caps the number of anchors emitted per file; 0 disables the cap.
+  ///
+  /// Past the cap, one anchor in `kAnchorSampleStride` is kept (the choice
+  /// depends only on emission order, so it is deterministic for a given
+  /// compilation), a diagnostic node tagged on the file records the
+  /// truncation, and `isFileOverAnchorBudget` steers the AST visitor to
+  /// declaration-only traversal of the file. This bounds the cost of
+  /// machine-generated megafiles that otherwise produce tens of millions of
+  /// anchors.
+  void set_file_anchor_budget(int64_t budget) { file_anchor_budget_ = budget; }
+
+  bool isFileOverAnchorBudget(clang::SourceLocation Loc) override;
   void Delimit() override { recorder_->PushEntryGroup(); }
   void Undelimit() override { recorder_->PopEntryGroup(); }
 
@@ -304,6 +331,8 @@ class KytheGraphObserver : public GraphObserver {
 
   void recordTypeEdge(const NodeId& term_id, const NodeId& type_id) override;
 
+  void recordNodeBatch(const NodeBatch& batch) override;
+
   void recordInfluences(const NodeId& influencer,
                         const NodeId& influenced) override;
 
@@ -492,6 +521,44 @@ class KytheGraphObserver : public GraphObserver {
                    const GraphObserver::Range& range);
   void UnconditionalRecordRange(const proto::VName& anchor_name,
                                 const GraphObserver::Range& range);
+  /// \brief A fully resolved anchor whose node facts have not yet been
+  /// written. Offsets are computed when the anchor is queued; the facts
+  /// themselves are batched up and emitted in one pass at file end.
+  struct PendingAnchor {
+    /// The anchor's VName.
+    kythe::proto::VName name;
+    /// Whether the anchor should carry the "implicit" subkind.
+    bool implicit = false;
+    /// Whether `begin_offset` and `end_offset` are valid.
+    bool has_range = false;
+    /// The anchor's starting byte offset.
+    size_t begin_offset = 0;
+    /// The anchor's ending byte offset.
+    size_t end_offset = 0;
+    /// If set, the context to attach with a childof_context edge.
+    absl::optional<kythe::proto::VName> context;
+  };
+  /// \brief Queues the node facts for `range`'s anchor for emission when the
+  /// outermost file is popped. Edges naming the anchor may still be emitted
+  /// eagerly; the entry stream is unordered.
+  void EnqueueAnchor(const proto::VName& anchor_name,
+                     const GraphObserver::Range& range);
+  /// \brief Emits all queued anchor facts, dropping exact duplicates.
+  void FlushPendingAnchors();
+  /// \brief An anchor edge whose emission has been deferred for grouping.
+  struct PendingEdge {
+    /// The anchor the edge originates from.
+    kythe::proto::VName source;
+    /// The edge's target node.
+    kythe::proto::VName target;
+  };
+  /// \brief Emits `anchor_edge_kind` from `anchor_name` to `target`, either
+  /// immediately or (if `aggregate_anchor_edges_`) buffered for grouped
+  /// emission at file end.
+  void RecordAnchorEdge(const proto::VName& anchor_name,
+                        EdgeKindID anchor_edge_kind, const VNameRef& target);
+  /// \brief Emits all buffered anchor edges in (file, edge kind) runs.
+  void FlushPendingEdges();
   /// Execute metadata actions for `defines` edges.
   void MetaHookDefines(const MetadataFile& meta, const VNameRef& anchor,
                        unsigned range_begin, unsigned range_end,
@@ -559,7 +626,7 @@ class KytheGraphObserver : public GraphObserver {
   /// The files we have entered but not left.
   std::vector<FileState> file_stack_;
   /// A map from FileIDs to associated metadata.
-  std::multimap<clang::FileID, std::shared_ptr<MetadataFile>> meta_;
+  std::multimap<clang::FileID, std::shared_ptr<const MetadataFile>> meta_;
   /// The metadata file ids for which we have already emitted file metadata.
   absl::flat_hash_set<
       std::tuple<std::string, std::string, std::string, std::string>>
@@ -577,6 +644,54 @@ class KytheGraphObserver : public GraphObserver {
   /// one context + header pair; then, many context + header pairs may
   /// map to a single file's VName.
   std::map<clang::FileID, KytheClaimToken> claim_checked_files_;
+  /// Fully-built file VNames keyed by FileEntry, populated on first touch
+  /// (see VNameFromFileEntry). Entries are stable for the life of the
+  /// FileManager, so per-anchor VName construction is a pointer lookup.
+  llvm::DenseMap<const clang::FileEntry*, kythe::proto::VName>
+      file_vname_cache_;
+  /// \brief Returns a cached VName carrying `file`'s file fields and the "@"
+  /// signature prefix shared by every anchor in the file, so building an
+  /// anchor VName only appends the offset pair; null if `file` is invalid or
+  /// has no FileEntry.
+  const kythe::proto::VName* AnchorVNamePrefixForFile(clang::FileID file);
+  /// Anchor VName prefixes per FileID (see AnchorVNamePrefixForFile); nullopt
+  /// entries record files without a FileEntry.
+  std::map<clang::FileID, absl::optional<kythe::proto::VName>>
+      anchor_vname_prefix_cache_;
+  /// \brief Returns the claim token recorded for `file`, or null if none has
+  /// been recorded.
+  ///
+  /// Emissions cluster heavily by file, so the most recent successful lookup
+  /// is memoized and usually answers the next one without touching the map.
+  /// Entries are only ever added to `claim_checked_files_` (values are
+  /// pointer-stable), so the memo cannot go stale; misses are not memoized
+  /// because the file may be registered later.
+  const KytheClaimToken* FindClaimTokenForFile(clang::FileID file) const {
+    if (last_claimed_token_ != nullptr && file == last_claimed_file_) {
+      return last_claimed_token_;
+    }
+    auto token = claim_checked_files_.find(file);
+    if (token == claim_checked_files_.end()) {
+      return nullptr;
+    }
+    last_claimed_file_ = file;
+    last_claimed_token_ = &token->second;
+    return last_claimed_token_;
+  }
+  /// The file most recently found in `claim_checked_files_`.
+  mutable clang::FileID last_claimed_file_;
+  /// The claim token for `last_claimed_file_`, or null if no lookup has
+  /// succeeded yet.
+  mutable const KytheClaimToken* last_claimed_token_ = nullptr;
+  /// The raw offset at which the file most recently checked by
+  /// `claimLocation` begins in the SLoc address space. A registered file's
+  /// claim status never changes, so this memo only goes stale when a lookup
+  /// in a different file displaces it.
+  unsigned claimed_interval_begin_ = 0;
+  /// The number of raw offsets covered by the memoized file.
+  unsigned claimed_interval_size_ = 0;
+  /// Whether the memoized file was claimed.
+  bool claimed_interval_result_ = false;
   /// Tokens for files (independent of language) that we've claimed.
   std::map<clang::FileID, KytheClaimToken> claimed_file_specific_tokens_;
   /// Maps from claim tokens to claim tokens with path and root dropped.
@@ -599,10 +714,56 @@ class KytheGraphObserver : public GraphObserver {
   /// Contains the `FileEntry`s for files we have already recorded.
   /// These pointers are not owned by the `KytheGraphObserver`.
   std::unordered_set<const clang::FileEntry*> recorded_files_;
+  /// \brief Flat per-file set of already-recorded physical ranges.
+  ///
+  /// Each file's ranges live in a sorted vector of packed (begin, end)
+  /// offset keys with a small unsorted tail batching recent insertions;
+  /// lookups scan the tail and binary-search the sorted run. This check
+  /// runs on every anchor emission, and a node-based hash set of millions
+  /// of Ranges per TU thrashes the allocator where these flat arrays stay
+  /// contiguous.
+  class DeferredRangeSet {
+   public:
+    /// \brief Inserts the packed range `key` for `file`.
+    /// \return false if the range was already present.
+    bool Insert(clang::FileID file, uint64_t key);
+    /// \brief Removes all entries, returning the number of keys removed.
+    size_t Clear();
+
+   private:
+    struct FileRanges {
+      /// Sorted, deduplicated keys.
+      std::vector<uint64_t> sorted;
+      /// Recent insertions not yet merged into `sorted`.
+      std::vector<uint64_t> pending;
+    };
+    /// Insertions batched up before `pending` is merged into `sorted`;
+    /// sized so the linear tail scan stays within a cache line or two.
+    static constexpr size_t kMergeBatch = 64;
+    std::map<clang::FileID, FileRanges> files_;
+    /// Total number of keys stored.
+    size_t size_ = 0;
+  };
+
   /// The set of anchor nodes with locations that have not yet been recorded.
   /// This allows the `GraphObserver` to limit the amount of redundant range
   /// information it emits should an anchor be the source of multiple edges.
+  /// Physical file ranges (the overwhelming majority) are instead tracked
+  /// in `deferred_anchor_ranges_`; this set keeps the wraith and implicit
+  /// ranges whose identity includes a semantic context.
   std::unordered_set<Range, RangeHash> deferred_anchors_;
+  /// \sa DeferredRangeSet
+  DeferredRangeSet deferred_anchor_ranges_;
+  /// Anchors accumulated for the files on `file_stack_`, emitted together
+  /// when the outermost file is popped (anchors are the most numerous node
+  /// kind we produce, so their facts are batched rather than written one
+  /// range at a time).
+  std::vector<PendingAnchor> pending_anchors_;
+  /// Anchor edges buffered for grouped emission, keyed by (anchor file path,
+  /// edge kind) so flushing walks the map in file-then-kind order. Only used
+  /// when `aggregate_anchor_edges_` is asserted.
+  std::map<std::pair<std::string, EdgeKindID>, std::vector<PendingEdge>>
+      pending_edges_;
   /// A set of (source range, edge kind, target node) tuples, used if
   /// drop_redundant_wraiths_ is asserted.
   std::unordered_set<RangeEdge, ContextFreeRangeEdgeHash> range_edges_;
@@ -615,17 +776,63 @@ class KytheGraphObserver : public GraphObserver {
   /// be dropped if they were previously emitted from the same location
   /// with the same edge kind to the same target.
   bool drop_redundant_wraiths_ = false;
+  /// If true, anchor edges are buffered in `pending_edges_` and emitted as
+  /// (file, edge kind) runs when the outermost file is popped.
+  bool aggregate_anchor_edges_ = false;
+  /// Per-file anchor accounting for `file_anchor_budget_`.
+  struct AnchorBudgetState {
+    /// Anchors attempted in this file, whether or not they were kept.
+    int64_t seen = 0;
+    /// Whether the size pre-scan already condemned this file to
+    /// declaration-only traversal.
+    bool skip_bodies = false;
+    /// Whether the size pre-scan ran.
+    bool prescanned = false;
+    /// Whether the truncation diagnostic was emitted.
+    bool truncation_noted = false;
+  };
+  /// Anchors to keep per file before sampling kicks in; 0 disables the cap.
+  int64_t file_anchor_budget_ = 0;
+  /// Past the budget, one anchor in this many is kept.
+  static constexpr int64_t kAnchorSampleStride = 128;
+  /// The size pre-scan assumes dense machine-generated code produces at
+  /// least one anchor per this many bytes; larger files are condemned
+  /// without waiting for their anchors to arrive.
+  static constexpr int64_t kPrescanBytesPerAnchor = 32;
+  /// Budget state per file, created on first anchor or budget query.
+  std::map<clang::FileID, AnchorBudgetState> anchor_budget_states_;
+  /// \brief Counts `range`'s anchor against its file's budget.
+  /// \return false if the anchor should be dropped (over budget and not
+  /// selected by sampling).
+  bool AnchorBudgetAllows(const GraphObserver::Range& range);
+  /// \brief Emits the once-per-file diagnostic node recording truncation.
+  void NoteAnchorTruncation(clang::FileID file, const std::string& message);
   /// Favor extra memory use during indexing over storing potentially redundant
   /// facts for certain frequently-used node kinds. Since these node kinds
   /// are defined to have structure equivalent to their names (modulo
   /// non-primary types in case of aliases, which may still be stored
   /// redundantly), this will not obscure conflicting-fact errors.
+  /// \brief A set of already-written nodes, identified by claim token and
+  /// interned identity pointer.
+  ///
+  /// Node identities are interned process-wide, so a (token, identity) pointer
+  /// pair identifies a node without materializing its claimed string. This
+  /// only deduplicates correctly for node kinds that share a single claim
+  /// token (like type nodes, which all use `type_token_`).
+  using WrittenNodeSet =
+      absl::flat_hash_set<std::pair<const ClaimToken*, const char*>>;
+
+  /// \brief Records that `id` has been written to `written`.
+  /// \return true if `id` had not been recorded before.
+  static bool MarkWritten(const NodeId& id, WrittenNodeSet* written) {
+    return written->insert({id.getToken(), id.IdentityRef().data()}).second;
+  }
+
   /// The set of doc nodes we've emitted so far (identified by
   /// `NodeId::ToString()`).
   std::unordered_set<std::string> written_docs_;
-  /// The set of type nodes we've emitted so far (identified by
-  /// `NodeId::ToString()`).
-  std::unordered_set<std::string> written_types_;
+  /// The set of type nodes we've emitted so far.
+  WrittenNodeSet written_types_;
   /// The set of namespace nodes we've emitted so far (identified by
   /// `NodeId::ToString()`).
   std::unordered_set<std::string> written_namespaces_;
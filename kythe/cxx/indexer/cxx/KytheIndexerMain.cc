@@ -23,6 +23,11 @@
 //       indexer -i foo.cc | verifier foo.cc
 //       indexer some/index.kindex
 
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <vector>
+
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/flags/usage.h"
@@ -33,6 +38,7 @@
 #include "kythe/cxx/indexer/cxx/GoogleFlagsLibrarySupport.h"
 #include "kythe/cxx/indexer/cxx/ImputedConstructorSupport.h"
 #include "kythe/cxx/indexer/cxx/IndexerFrontendAction.h"
+#include "kythe/cxx/indexer/cxx/KytheVFS.h"
 #include "kythe/cxx/indexer/cxx/ProtoLibrarySupport.h"
 #include "kythe/cxx/indexer/cxx/frontend.h"
 #include "kythe/cxx/indexer/cxx/indexer_worklist.h"
@@ -44,8 +50,15 @@ ABSL_FLAG(bool, experimental_drop_instantiation_independent_data, false,
           "instantiation-independent.");
 ABSL_FLAG(bool, report_profiling_events, false,
           "Write profiling events to standard error.");
+ABSL_FLAG(std::string, profile_json, "",
+          "If set, aggregate per-phase profiling data (event counts and "
+          "total wall time) and write it to this file as JSON.");
 ABSL_FLAG(bool, experimental_index_lite, false,
           "Drop uncommonly-used data from the index.");
+ABSL_FLAG(bool, experimental_decls_only, false,
+          "Index declarations only, skipping function body parsing and "
+          "traversal. Emits definition/declaration edges and anchors but no "
+          "references from inside bodies.");
 ABSL_FLAG(bool, experimental_drop_objc_fwd_class_docs, false,
           "Drop comments for Objective-C forward class declarations.");
 ABSL_FLAG(bool, experimental_drop_cpp_fwd_decl_docs, false,
@@ -54,8 +67,81 @@ ABSL_FLAG(int, experimental_usr_byte_size, 0,
           "Use this many bytes to represent a USR (or don't at all if 0).");
 ABSL_FLAG(bool, use_compilation_corpus_as_default, false,
           "Use the CompilationUnit VName corpus as the default.");
+ABSL_FLAG(std::string, experimental_module_cache_path, "",
+          "If set, reuse Clang implicit-module artifacts across compilation "
+          "units via a module cache rooted at this directory (requires "
+          "filesystem access).");
+ABSL_FLAG(bool, experimental_shared_file_contents, false,
+          "Share virtual file contents across compilation units, "
+          "deduplicated by digest.");
+ABSL_FLAG(int64_t, experimental_file_anchor_budget, 0,
+          "If positive, cap the anchors emitted per file. Past the cap, one "
+          "anchor in 128 is kept (deterministically, by emission order), a "
+          "diagnostic node on the file records the truncation, and "
+          "over-budget files are indexed declaration-only.");
+ABSL_FLAG(bool, experimental_aggregate_anchor_edges, false,
+          "Buffer anchor edges and emit them grouped by (file, edge kind) "
+          "instead of interleaved in AST-visit order.");
 
 namespace kythe {
+namespace {
+
+/// \brief Aggregates profiling events into per-phase counts and wall time.
+///
+/// Phases are the section labels reported through `ProfilingCallback`
+/// (e.g. "run_invocation", "traverse_tu", "build_parent_map"). Sections
+/// nest, so enters and exits pair up like a stack; a phase's time includes
+/// its nested phases. This only costs anything when --profile_json is set;
+/// otherwise the default no-op callback is left in place.
+class ProfileAggregator {
+ public:
+  void Event(const char* counter, ProfilingEvent event) {
+    auto now = std::chrono::steady_clock::now();
+    if (event == ProfilingEvent::Enter) {
+      open_sections_.push_back({counter, now});
+    } else if (!open_sections_.empty()) {
+      auto& phase = phases_[open_sections_.back().first];
+      ++phase.count;
+      phase.total_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            now - open_sections_.back().second)
+                            .count();
+      open_sections_.pop_back();
+    }
+  }
+
+  /// \brief Writes the aggregated phases to `path` as a JSON object mapping
+  /// phase labels to {"count": N, "total_ms": T}.
+  void Write(const std::string& path) const {
+    FILE* out = ::fopen(path.c_str(), "w");
+    if (out == nullptr) {
+      absl::FPrintF(stderr, "Unable to open %s for writing.\n", path);
+      return;
+    }
+    absl::FPrintF(out, "{");
+    bool first = true;
+    for (const auto& phase : phases_) {
+      absl::FPrintF(out, "%s\n  \"%s\": {\"count\": %u, \"total_ms\": %.3f}",
+                    first ? "" : ",", phase.first, phase.second.count,
+                    phase.second.total_ns / 1e6);
+      first = false;
+    }
+    absl::FPrintF(out, "\n}\n");
+    ::fclose(out);
+  }
+
+ private:
+  struct Phase {
+    size_t count = 0;
+    int64_t total_ns = 0;
+  };
+  /// Aggregated phases, sorted by label for stable output.
+  std::map<std::string, Phase> phases_;
+  /// Currently open sections and their start times, innermost last.
+  std::vector<std::pair<const char*, std::chrono::steady_clock::time_point>>
+      open_sections_;
+};
+
+}  // anonymous namespace
 
 int main(int argc, char* argv[]) {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -82,6 +168,13 @@ int main(int argc, char* argv[]) {
   options.CppFwdDocs = absl::GetFlag(FLAGS_experimental_drop_cpp_fwd_decl_docs)
                            ? kythe::BehaviorOnFwdDeclComments::Ignore
                            : kythe::BehaviorOnFwdDeclComments::Emit;
+  options.DocumentationBehavior =
+      context.emit_documentation()
+          ? kythe::BehaviorOnDocumentation::EmitDocumentation
+          : kythe::BehaviorOnDocumentation::SkipDocumentation;
+  options.BodyBehavior = absl::GetFlag(FLAGS_experimental_decls_only)
+                             ? kythe::BehaviorOnFunctionBodies::SkipBodies
+                             : kythe::BehaviorOnFunctionBodies::VisitBodies;
   options.UsrByteSize = absl::GetFlag(FLAGS_experimental_usr_byte_size) <= 0
                             ? 0
                             : absl::GetFlag(FLAGS_experimental_usr_byte_size);
@@ -89,13 +182,33 @@ int main(int argc, char* argv[]) {
       absl::GetFlag(FLAGS_use_compilation_corpus_as_default);
   options.DropInstantiationIndependentData =
       absl::GetFlag(FLAGS_experimental_drop_instantiation_independent_data);
+  options.AggregateAnchorEdges =
+      absl::GetFlag(FLAGS_experimental_aggregate_anchor_edges);
+  options.FileAnchorBudget =
+      absl::GetFlag(FLAGS_experimental_file_anchor_budget);
   options.AllowFSAccess = context.allow_filesystem_access();
+  options.ModuleCachePath = absl::GetFlag(FLAGS_experimental_module_cache_path);
+  if (absl::GetFlag(FLAGS_experimental_shared_file_contents)) {
+    IndexVFS::EnableSharedContentStore();
+  }
   if (absl::GetFlag(FLAGS_report_profiling_events)) {
     options.ReportProfileEvent = [](const char* counter, ProfilingEvent event) {
       absl::FPrintF(stderr, "%s: %s\n", counter,
                     event == ProfilingEvent::Enter ? "enter" : "exit");
     };
   }
+  ProfileAggregator profile_aggregator;
+  const std::string profile_json = absl::GetFlag(FLAGS_profile_json);
+  if (!profile_json.empty()) {
+    // Chain onto any stderr reporting requested above.
+    options.ReportProfileEvent = [&profile_aggregator,
+                                  inner = options.ReportProfileEvent](
+                                     const char* counter,
+                                     ProfilingEvent event) {
+      profile_aggregator.Event(counter, event);
+      inner(counter, event);
+    };
+  }
 
   bool had_errors = false;
   NullOutputStream null_stream;
@@ -112,6 +225,7 @@ int main(int argc, char* argv[]) {
     library_supports.push_back(absl::make_unique<GoogleProtoLibrarySupport>());
     library_supports.push_back(absl::make_unique<ImputedConstructorSupport>());
 
+    ProfileBlock block(options.ReportProfileEvent, "index_compilation_unit");
     std::string result = IndexCompilationUnit(
         job.unit, job.virtual_files, *context.claim_client(),
         context.hash_cache(),
@@ -128,6 +242,10 @@ int main(int argc, char* argv[]) {
     }
   });
 
+  if (!profile_json.empty()) {
+    profile_aggregator.Write(profile_json);
+  }
+
   return (had_errors ? 1 : 0);
 }
 
@@ -16,6 +16,9 @@
 
 #include "KytheVFS.h"
 
+#include <map>
+#include <mutex>
+
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
@@ -52,8 +55,40 @@ std::string FixupPath(llvm::StringRef path, llvm::sys::path::Style style) {
   }
   return std::string(path);
 }
+
+/// \brief Process-wide file contents keyed by digest (see
+/// `IndexVFS::EnableSharedContentStore`).
+class SharedContentStore {
+ public:
+  /// \brief Returns a stable reference to a single copy of `data`'s content.
+  llvm::StringRef Intern(const proto::FileData& data) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // std::map nodes are stable, so handing out references is safe.
+    const std::string& stored =
+        contents_.emplace(data.info().digest(), data.content()).first->second;
+    return llvm::StringRef(stored.data(), stored.size());
+  }
+
+ private:
+  /// Guards `contents_`.
+  std::mutex mutex_;
+  /// Maps digests to file content.
+  std::map<std::string, std::string> contents_;
+};
+
+/// Whether `EnableSharedContentStore` has been called.
+bool shared_content_store_enabled = false;
+
+SharedContentStore* GetSharedContentStore() {
+  static auto* store = new SharedContentStore();
+  return store;
+}
 }  // anonymous namespace
 
+void IndexVFS::EnableSharedContentStore() {
+  shared_content_store_enabled = true;
+}
+
 IndexVFS::IndexVFS(const std::string& working_directory,
                    const std::vector<proto::FileData>& virtual_files,
                    const std::vector<llvm::StringRef>& virtual_dirs,
@@ -69,8 +104,12 @@ IndexVFS::IndexVFS(const std::string& working_directory,
     std::string path = FixupPath(ToStringRef(data.info().path()), style);
     if (auto* record = FileRecordForPath(path, BehaviorOnMissing::kCreateFile,
                                          data.content().size())) {
-      record->data =
-          llvm::StringRef(data.content().data(), data.content().size());
+      if (shared_content_store_enabled && !data.info().digest().empty()) {
+        record->data = GetSharedContentStore()->Intern(data);
+      } else {
+        record->data =
+            llvm::StringRef(data.content().data(), data.content().size());
+      }
     }
   }
   for (llvm::StringRef dir : virtual_dirs) {
@@ -211,6 +250,19 @@ IndexVFS::FileRecord* IndexVFS::FileRecordForPath(llvm::StringRef path,
                                                   BehaviorOnMissing behavior,
                                                   size_t size) {
   using namespace llvm::sys::path;
+  std::string cache_key;
+  if (behavior == BehaviorOnMissing::kReturnError) {
+    // Pure lookups dominate once the tree is built: serve repeated probes
+    // (including the include search's many misses) from the path cache.
+    cache_key = std::string(path);
+    auto cached = path_lookup_cache_.find(cache_key);
+    if (cached != path_lookup_cache_.end()) {
+      return cached->second;
+    }
+  } else {
+    // Creating records can invalidate cached misses.
+    path_lookup_cache_.clear();
+  }
   std::vector<llvm::StringRef> path_components;
   int skip_count = 0;
 
@@ -254,6 +306,9 @@ IndexVFS::FileRecord* IndexVFS::FileRecordForPath(llvm::StringRef path,
         is_last ? eventual_type : llvm::sys::fs::file_type::directory_file,
         is_last ? eventual_size : 0);
   }
+  if (behavior == BehaviorOnMissing::kReturnError) {
+    path_lookup_cache_.emplace(std::move(cache_key), current_record);
+  }
   return current_record;
 }
 
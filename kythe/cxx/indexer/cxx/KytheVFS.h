@@ -17,6 +17,7 @@
 #ifndef KYTHE_CXX_COMMON_INDEXING_KYTHE_VFS_H_
 #define KYTHE_CXX_COMMON_INDEXING_KYTHE_VFS_H_
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/types/optional.h"
 #include "clang/Basic/FileManager.h"
 #include "kythe/proto/analysis.pb.h"
@@ -45,6 +46,16 @@ class IndexVFS : public llvm::vfs::FileSystem {
   /// detected; otherwise, the style of `awd`.
   static absl::optional<llvm::sys::path::Style>
   DetectStyleFromAbsoluteWorkingDirectory(const std::string& awd);
+  /// \brief Share file contents across every `IndexVFS` in this process,
+  /// deduplicated by content digest.
+  ///
+  /// When a driver processes many compilation units, each unit's virtual
+  /// files arrive as separate `FileData` copies even though most of them
+  /// (headers, in particular) are byte-identical. With sharing enabled,
+  /// records whose `FileData` carries a digest point at a single
+  /// process-wide copy of the content instead of the per-unit proto's
+  /// buffer. The shared copies live until process exit.
+  static void EnableSharedContentStore();
   ~IndexVFS();
   /// \brief Implements llvm::vfs::FileSystem::status.
   llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path) override;
@@ -75,6 +86,8 @@ class IndexVFS : public llvm::vfs::FileSystem {
   }
   std::error_code setCurrentWorkingDirectory(const llvm::Twine& Path) override {
     working_directory_ = Path.str();
+    // Cached relative-path lookups resolved against the old directory.
+    path_lookup_cache_.clear();
     return std::error_code();
   }
 
@@ -158,6 +171,13 @@ class IndexVFS : public llvm::vfs::FileSystem {
   std::map<std::string, FileRecord*> root_name_to_root_map_;
   /// Maps unique IDs to file records.
   std::map<std::pair<uint64_t, uint64_t>, FileRecord*> uid_to_record_map_;
+  /// Maps incoming (unnormalized) path strings to their resolved records;
+  /// nullptr records misses. A translation unit stats the same paths
+  /// hundreds of thousands of times, and the include search probes mostly
+  /// nonexistent paths, so both hits and misses resolve here with one hash
+  /// lookup instead of a per-component directory walk. Cleared whenever a
+  /// record is (or may be) created.
+  absl::flat_hash_map<std::string, FileRecord*> path_lookup_cache_;
 };
 
 }  // namespace kythe
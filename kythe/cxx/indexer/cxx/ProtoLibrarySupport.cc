@@ -71,12 +71,18 @@ class LogErrors : public google::protobuf::io::ErrorCollector {
 // nothing about the proto being parsed.
 class ParseTextProtoHandler {
  public:
-  // Parses the message and returns true on success.
+  using AccessorTableMap =
+      llvm::DenseMap<const clang::CXXRecordDecl*,
+                     GoogleProtoLibrarySupport::AccessorTable>;
+
+  // Parses the message and returns true on success. AccessorTables persists
+  // across parses; tables for newly seen message decls are added to it.
   static bool Parse(const ParseCallback& FoundField,
                     const clang::StringLiteral* Literal,
                     const clang::CXXRecordDecl& MsgDecl,
                     const clang::ASTContext& Context,
-                    const clang::LangOptions& LangOpts);
+                    const clang::LangOptions& LangOpts,
+                    AccessorTableMap* AccessorTables);
 
  private:
   struct LineColumnPair {
@@ -94,7 +100,8 @@ class ParseTextProtoHandler {
   ParseTextProtoHandler(const ParseCallback& FoundField,
                         const clang::StringLiteral* Literal,
                         const clang::ASTContext& Context,
-                        const clang::LangOptions& LangOpts);
+                        const clang::LangOptions& LangOpts,
+                        AccessorTableMap* AccessorTables);
 
   // Parses fields of a message with the given decl. Returns false on error. If
   // nested is true, then hitting a '}' token will return without error.
@@ -121,36 +128,51 @@ class ParseTextProtoHandler {
   // Index of token (line,column) to byte offset in the string literal. See
   // comment in constructor.
   std::map<LineColumnPair, int> LineColumnToOffset;
+  // Accessor tables shared across parses (owned by the library support).
+  AccessorTableMap* const AccessorTables;
 };
 
 const clang::CXXMethodDecl* FindAccessorDeclWithName(
-    const clang::CXXRecordDecl& MsgDecl, llvm::StringRef Name) {
-  for (const clang::CXXMethodDecl* Method : MsgDecl.methods()) {
-    // Accessors are user-provided, skip any compiler-generated operator/ctor.
-    if (Method->isUserProvided()) {
-      const auto MethodName = Method->getName();
-      // Field accessors will either be the same as the field name or, if they
-      // conflict with a language keyword, the field name with a trailing
-      // underscore.
-      if (MethodName == Name ||
-          (MethodName.size() == Name.size() + 1 &&
-           MethodName.startswith(Name) && MethodName.endswith("_"))) {
-        return Method;
+    const clang::CXXRecordDecl& MsgDecl, llvm::StringRef Name,
+    ParseTextProtoHandler::AccessorTableMap* AccessorTables) {
+  auto [TableIt, Inserted] =
+      AccessorTables->try_emplace(MsgDecl.getCanonicalDecl());
+  if (Inserted) {
+    for (const clang::CXXMethodDecl* Method : MsgDecl.methods()) {
+      // Accessors are user-provided, skip any compiler-generated
+      // operator/ctor. The first method with a given name wins, as in the
+      // scan this table replaces.
+      if (Method->isUserProvided()) {
+        TableIt->second.try_emplace(Method->getName(), Method);
       }
     }
   }
-  return nullptr;
+  // Callers get the accessor, never the table: parsing recurses into
+  // submessages, and adding their tables can rehash the map, so references
+  // into it must not outlive this function.
+  const GoogleProtoLibrarySupport::AccessorTable& Table = TableIt->second;
+  // Field accessors will either be the same as the field name or, if they
+  // conflict with a language keyword, the field name with a trailing
+  // underscore.
+  const auto AccessorIt = Table.find(Name);
+  if (AccessorIt != Table.end()) {
+    return AccessorIt->second;
+  }
+  const auto UnderscoreIt = Table.find(Name.str() + "_");
+  return UnderscoreIt == Table.end() ? nullptr : UnderscoreIt->second;
 }
 
 ParseTextProtoHandler::ParseTextProtoHandler(
     const ParseCallback& FoundField, const clang::StringLiteral* Literal,
-    const clang::ASTContext& Context, const clang::LangOptions& LangOpts)
+    const clang::ASTContext& Context, const clang::LangOptions& LangOpts,
+    AccessorTableMap* AccessorTables)
     : Literal(Literal),
       Context(Context),
       LangOpts(LangOpts),
       FoundField(FoundField),
       IStream(Literal->getBytes().data(), Literal->getBytes().size()),
-      TextTokenizer(&IStream, &Errors) {
+      TextTokenizer(&IStream, &Errors),
+      AccessorTables(AccessorTables) {
   // We're building this table so that we can map io::Tokenizer lines and
   // columns back to byte offsets in the string literal. See
   // Tokenizer::NextChar() for why we're doing this.
@@ -179,8 +201,10 @@ bool ParseTextProtoHandler::Parse(const ParseCallback& FoundField,
                                   const clang::StringLiteral* Literal,
                                   const clang::CXXRecordDecl& MsgDecl,
                                   const clang::ASTContext& Context,
-                                  const clang::LangOptions& LangOpts) {
-  ParseTextProtoHandler handler(FoundField, Literal, Context, LangOpts);
+                                  const clang::LangOptions& LangOpts,
+                                  AccessorTableMap* AccessorTables) {
+  ParseTextProtoHandler handler(FoundField, Literal, Context, LangOpts,
+                                AccessorTables);
   return handler.ParseMsg(MsgDecl, false);
 }
 
@@ -191,8 +215,8 @@ bool ParseTextProtoHandler::ParseMsg(const clang::CXXRecordDecl& MsgDecl,
     switch (Token.type) {
       case Tokenizer::TYPE_IDENTIFIER: {
         // Assume that this is a field name.
-        const auto* AccessorDecl =
-            FindAccessorDeclWithName(MsgDecl, ToStringRef(Token.text));
+        const auto* AccessorDecl = FindAccessorDeclWithName(
+            MsgDecl, ToStringRef(Token.text), AccessorTables);
         if (!AccessorDecl) {
           LOG(ERROR) << "Cannot find field " << Token.text << " for message "
                      << MsgDecl.getName().str();
@@ -424,7 +448,8 @@ void GoogleProtoLibrarySupport::InspectCallExpr(
   };
   ParseTextProtoHandler::Parse(
       Callback, Literal, *Expr->getType()->getAsCXXRecordDecl(),
-      V.getASTContext(), *V.getGraphObserver().getLangOptions());
+      V.getASTContext(), *V.getGraphObserver().getLangOptions(),
+      &AccessorTables);
 }
 
 }  // namespace kythe
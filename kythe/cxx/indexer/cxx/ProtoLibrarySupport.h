@@ -20,12 +20,17 @@
 #define KYTHE_CXX_INDEXER_CXX_PROTO_LIBRARY_SUPPORT_H_
 
 #include "IndexerLibrarySupport.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
 
 namespace kythe {
 
 /// \brief Indexes protobufs provided as string literals with ParseProtoHelper.
 class GoogleProtoLibrarySupport : public LibrarySupport {
  public:
+  /// Maps a field name to the message method that accesses it.
+  using AccessorTable = llvm::StringMap<const clang::CXXMethodDecl*>;
+
   GoogleProtoLibrarySupport() {}
 
   void InspectCallExpr(IndexerASTVisitor& V, const clang::CallExpr* CallExpr,
@@ -40,6 +45,13 @@ class GoogleProtoLibrarySupport : public LibrarySupport {
 
   bool Initialized = false;
   const clang::Decl* ParseProtoHelperDecl = nullptr;
+
+  // Accessor tables for message decls whose text protos have been parsed,
+  // built on first use and keyed by canonical decl. Parsing looks up an
+  // accessor per field occurrence, and generated messages recur across the
+  // text protos of a proto-heavy TU; the table turns each lookup into a hash
+  // probe instead of a scan over the message's methods.
+  llvm::DenseMap<const clang::CXXRecordDecl*, AccessorTable> AccessorTables;
 };
 
 }  // namespace kythe
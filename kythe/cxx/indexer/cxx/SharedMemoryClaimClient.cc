@@ -0,0 +1,165 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SharedMemoryClaimClient.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "glog/logging.h"
+#include "kythe/cxx/common/vname_key.h"
+
+namespace kythe {
+namespace {
+/// \brief The arena header, written once by whichever process first
+/// initializes the file.
+struct ArenaHeader {
+  /// `kArenaMagic` once the header (including `slot_count`) is complete.
+  std::atomic<uint64_t> magic;
+  /// Number of slots following the header.
+  uint64_t slot_count;
+};
+
+constexpr uint64_t kArenaMagic = 0x616e6572616d6873ULL;  // "shmarena"
+/// Probes past the home slot before declaring the arena too full and
+/// granting the claim to everyone.
+constexpr uint64_t kMaxProbes = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "arena slots must be lock-free to share across processes");
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+              "arena slots must be plain words in the mapping");
+}  // anonymous namespace
+
+SharedMemoryClaimClient::~SharedMemoryClaimClient() {
+  if (mapped_ != nullptr) {
+    ::munmap(mapped_, mapped_size_);
+  }
+}
+
+bool SharedMemoryClaimClient::OpenArena(const std::string& path,
+                                        size_t slots) {
+  CHECK(mapped_ == nullptr) << "arena already open";
+  CHECK_GT(slots, 0);
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    LOG(WARNING) << "couldn't open claim arena " << path << ": "
+                 << strerror(errno);
+    return false;
+  }
+  struct stat stat_buf;
+  if (::fstat(fd, &stat_buf) != 0) {
+    LOG(WARNING) << "couldn't stat claim arena " << path << ": "
+                 << strerror(errno);
+    ::close(fd);
+    return false;
+  }
+  size_t size = sizeof(ArenaHeader) + slots * sizeof(uint64_t);
+  if (static_cast<size_t>(stat_buf.st_size) > size) {
+    // An existing arena keeps its (larger) size; its header is
+    // authoritative for the slot count.
+    size = stat_buf.st_size;
+  } else if (static_cast<size_t>(stat_buf.st_size) < size) {
+    // ftruncate is idempotent across racing creators and zero-fills, so a
+    // fresh arena starts with every slot (and the magic) empty.
+    if (::ftruncate(fd, size) != 0) {
+      LOG(WARNING) << "couldn't size claim arena " << path << ": "
+                   << strerror(errno);
+      ::close(fd);
+      return false;
+    }
+  }
+  void* mapped =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    LOG(WARNING) << "couldn't map claim arena " << path << ": "
+                 << strerror(errno);
+    return false;
+  }
+  auto* header = static_cast<ArenaHeader*>(mapped);
+  uint64_t magic = header->magic.load(std::memory_order_acquire);
+  if (magic == 0) {
+    // Race to initialize; every creator writes the same slot count, so the
+    // losing stores are harmless.
+    header->slot_count = slots;
+    header->magic.store(kArenaMagic, std::memory_order_release);
+    magic = kArenaMagic;
+  }
+  if (magic != kArenaMagic || header->slot_count == 0 ||
+      sizeof(ArenaHeader) + header->slot_count * sizeof(uint64_t) > size) {
+    LOG(WARNING) << path << " is not a claim arena";
+    ::munmap(mapped, size);
+    return false;
+  }
+  mapped_ = mapped;
+  mapped_size_ = size;
+  slot_count_ = header->slot_count;
+  slots_ = reinterpret_cast<std::atomic<uint64_t>*>(header + 1);
+  return true;
+}
+
+bool SharedMemoryClaimClient::Claim(const kythe::proto::VName& claimant,
+                                    const kythe::proto::VName& vname) {
+  uint64_t claimable = VNameFingerprint(vname);
+  // Zero marks an empty slot; remap the (vanishingly unlikely) zero
+  // fingerprint rather than special-casing it in the probe loop.
+  if (claimable == 0) claimable = 1;
+  if (!overrides_.empty()) {
+    auto override_it = overrides_.find(claimable);
+    if (override_it != overrides_.end()) {
+      return override_it->second == VNameFingerprint(claimant);
+    }
+  }
+  if (slots_ == nullptr) {
+    return true;
+  }
+  if (own_claims_.contains(claimable)) {
+    return true;
+  }
+  uint64_t index = claimable % slot_count_;
+  for (uint64_t probe = 0; probe < kMaxProbes; ++probe) {
+    uint64_t expected = slots_[index].load(std::memory_order_relaxed);
+    if (expected == 0 &&
+        slots_[index].compare_exchange_strong(expected, claimable,
+                                              std::memory_order_relaxed)) {
+      own_claims_.insert(claimable);
+      return true;
+    }
+    if (expected == claimable) {
+      // Someone else's CAS won (or we'd have it in own_claims_).
+      return false;
+    }
+    index = (index + 1) % slot_count_;
+  }
+  // The probe window is exhausted; the arena is too full to decide, so fall
+  // back to redundant processing rather than dropping the claimable.
+  return true;
+}
+
+void SharedMemoryClaimClient::AssignClaim(
+    const kythe::proto::VName& claimable, const kythe::proto::VName& claimant) {
+  uint64_t fingerprint = VNameFingerprint(claimable);
+  if (fingerprint == 0) fingerprint = 1;
+  overrides_[fingerprint] = VNameFingerprint(claimant);
+}
+
+}  // namespace kythe
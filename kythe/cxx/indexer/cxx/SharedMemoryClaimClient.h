@@ -0,0 +1,95 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_INDEXER_CXX_SHARED_MEMORY_CLAIM_CLIENT_H_
+#define KYTHE_CXX_INDEXER_CXX_SHARED_MEMORY_CLAIM_CLIENT_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "kythe/cxx/indexer/cxx/KytheClaimClient.h"
+#include "kythe/proto/storage.pb.h"
+
+namespace kythe {
+
+/// \brief A client that coordinates dynamic claims between indexer processes
+/// on one machine through a shared-memory arena.
+///
+/// The arena is a memory-mapped file of fingerprint slots shared by every
+/// participating process. A claim is one compare-and-swap installing the
+/// claimable's fingerprint (see `VNameFingerprint`) into its hashed slot:
+/// the process whose CAS succeeds owns the claimable; everyone else sees the
+/// occupied slot and skips it. No locks, no waiting, and no network — where
+/// `DynamicClaimClient` pays a memcached round trip per novel claim, this
+/// pays one memory operation.
+///
+/// Like `DynamicClaimClient`, this client trades redundancy for speed rather
+/// than correctness: if the arena fills up (or two claimables collide under
+/// both hashing and probing), the affected claimables are granted to every
+/// claimant, so data may be emitted more than once but is never dropped.
+/// The arena is append-only for the duration of a run; stale arena files
+/// from previous runs must be removed by the launcher.
+class SharedMemoryClaimClient : public KytheClaimClient {
+ public:
+  ~SharedMemoryClaimClient() override;
+
+  /// \brief Maps (creating and sizing if necessary) the arena file at
+  /// `path`, shared with every other process that opens the same path.
+  /// \param slots Slot count used when this process creates the arena; an
+  /// existing arena keeps its original size. Sized well above the expected
+  /// claimable count — occupancy past ~90% degrades to redundant claims.
+  /// \return false (leaving the client claiming everything) on failure.
+  bool OpenArena(const std::string& path, size_t slots);
+
+  bool Claim(const kythe::proto::VName& claimant,
+             const kythe::proto::VName& vname) override;
+
+  /// \brief Stores a local override; the arena is not consulted for
+  /// statically assigned claimables.
+  void AssignClaim(const kythe::proto::VName& claimable,
+                   const kythe::proto::VName& claimant) override;
+
+  /// \brief Clears local state. The shared arena is untouched: claims in it
+  /// were answered to other processes and cannot be retracted.
+  void Reset() override {
+    own_claims_.clear();
+    overrides_.clear();
+  }
+
+ private:
+  /// The mapped arena file (header plus slots); null until OpenArena
+  /// succeeds, during which time every claim is granted.
+  void* mapped_ = nullptr;
+  /// Size of the mapping in bytes.
+  size_t mapped_size_ = 0;
+  /// The slot array within `mapped_`.
+  std::atomic<uint64_t>* slots_ = nullptr;
+  /// Number of slots in the arena.
+  uint64_t slot_count_ = 0;
+  /// Fingerprints of claimables this process won, so re-claims within the
+  /// process stay claimed without touching the arena.
+  absl::flat_hash_set<uint64_t> own_claims_;
+  /// Static assignments from `AssignClaim`, keyed and valued by
+  /// fingerprint. Consulted before the arena.
+  absl::flat_hash_map<uint64_t, uint64_t> overrides_;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_INDEXER_CXX_SHARED_MEMORY_CLAIM_CLIENT_H_
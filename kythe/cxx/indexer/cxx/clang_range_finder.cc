@@ -16,6 +16,7 @@
 #include "kythe/cxx/indexer/cxx/clang_range_finder.h"
 
 #include <string>
+#include <utility>
 
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclCXX.h"
@@ -167,20 +168,52 @@ SourceRange ClangRangeFinder::RangeForNamespace(
 }
 
 SourceRange ClangRangeFinder::NormalizeRange(SourceLocation start) const {
-  return ToCharRange(GetFileRange(source_manager(), start));
+  return NormalizeRange(SourceRange(start));
 }
 
 SourceRange ClangRangeFinder::NormalizeRange(SourceLocation start,
                                              SourceLocation end) const {
-  return ToCharRange(GetFileRange(source_manager(), SourceRange(start, end)));
+  return NormalizeRange(SourceRange(start, end));
 }
 
 SourceRange ClangRangeFinder::NormalizeRange(SourceRange range) const {
-  return ToCharRange(GetFileRange(source_manager(), range));
+  if (cache_ == nullptr) {
+    return ToCharRange(GetFileRange(source_manager(), range));
+  }
+  auto [iter, inserted] = cache_->normalized_.try_emplace(
+      std::make_pair(range.getBegin().getRawEncoding(),
+                     range.getEnd().getRawEncoding()),
+      SourceRange());
+  if (inserted) {
+    // ToCharRange only touches the token-length map, so this insertion
+    // cannot invalidate `iter`.
+    iter->second = ToCharRange(GetFileRange(source_manager(), range));
+  }
+  return iter->second;
 }
 
 SourceRange ClangRangeFinder::ToCharRange(clang::CharSourceRange range) const {
+  if (cache_ != nullptr && range.isTokenRange() && range.getEnd().isValid() &&
+      range.getEnd().isFileID()) {
+    // Equivalent to Lexer::getAsCharRange, but the token at the end of the
+    // range is only measured the first time it's seen.
+    unsigned length =
+        cache_->Measure(range.getEnd(), source_manager(), lang_options());
+    return SourceRange(range.getBegin(),
+                       range.getEnd().getLocWithOffset(length));
+  }
   return clang::Lexer::getAsCharRange(range, source_manager(), lang_options())
       .getAsRange();
 }
+
+unsigned ClangRangeFinder::RangeCache::Measure(
+    clang::SourceLocation loc, const clang::SourceManager& source_manager,
+    const clang::LangOptions& lang_options) {
+  auto [iter, inserted] = lengths_.try_emplace(loc.getRawEncoding(), 0);
+  if (inserted) {
+    iter->second =
+        clang::Lexer::MeasureTokenLength(loc, source_manager, lang_options);
+  }
+  return iter->second;
+}
 }  // namespace kythe
@@ -16,6 +16,8 @@
 #ifndef KYTHE_CXX_INDEXER_CXX_CLANG_RANGE_FINDER_H_
 #define KYTHE_CXX_INDEXER_CXX_CLANG_RANGE_FINDER_H_
 
+#include <utility>
+
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclCXX.h"
 #include "clang/AST/DeclObjC.h"
@@ -24,6 +26,7 @@
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Basic/SourceManager.h"
 #include "glog/logging.h"
+#include "llvm/ADT/DenseMap.h"
 
 namespace kythe {
 
@@ -33,12 +36,39 @@ namespace kythe {
 /// which is most suitable location to attribute to that entity.
 class ClangRangeFinder {
  public:
+  /// \brief Memoizes range-normalization work across ClangRangeFinder
+  /// instances: measured token lengths, so normalizing overlapping ranges
+  /// doesn't re-lex the same token ends, and fully normalized ranges, so
+  /// re-visited ranges (common under template instantiation) skip the macro
+  /// expansion walk entirely.
+  ///
+  /// Entries are tied to a particular SourceManager; use one cache per AST.
+  class RangeCache {
+   public:
+    /// \brief Returns the length of the token starting at the file location
+    /// `loc`, measuring it on the first query.
+    unsigned Measure(clang::SourceLocation loc,
+                     const clang::SourceManager& source_manager,
+                     const clang::LangOptions& lang_options);
+
+   private:
+    friend class ClangRangeFinder;
+    /// Measured token lengths, keyed by raw location encoding.
+    llvm::DenseMap<unsigned, unsigned> lengths_;
+    /// Normalized ranges, keyed by the raw encodings of the query range.
+    llvm::DenseMap<std::pair<unsigned, unsigned>, clang::SourceRange>
+        normalized_;
+  };
+
   /// \brief Constructs a new ClangRangeFinder using the provided SourceManager
-  /// and LangOptions.
+  /// and LangOptions. If `cache` is non-null, normalization work is memoized
+  /// there; it must outlive this object.
   explicit ClangRangeFinder(const clang::SourceManager* source_manager,
-                            const clang::LangOptions* lang_options)
+                            const clang::LangOptions* lang_options,
+                            RangeCache* cache = nullptr)
       : source_manager_(CHECK_NOTNULL(source_manager)),
-        lang_options_(CHECK_NOTNULL(lang_options)) {}
+        lang_options_(CHECK_NOTNULL(lang_options)),
+        cache_(cache) {}
 
   /// \brief Returns a range encompassing the name of the decl.
   clang::SourceRange RangeForNameOf(const clang::NamedDecl* decl) const;
@@ -72,6 +102,7 @@ class ClangRangeFinder {
 
   const clang::SourceManager* source_manager_;
   const clang::LangOptions* lang_options_;
+  RangeCache* cache_;  // Not owned; may be null.
 };
 
 }  // namespace kythe
@@ -220,6 +220,28 @@ TEST_F(ClangRangeFinderTest, ObjCNamedDecl) {
   }
 }
 
+TEST_F(ClangRangeFinderTest, CachedRangesMatchUncached) {
+  std::vector<NamedDeclTestCase> decls = {
+      {"class %s ;"},
+      {"namespace %s {}"},
+      {"int %s ;"},
+      {"void %s ();"},
+      {"#define CLASS(X) class X\nCLASS(%s) ;"},
+  };
+  for (const auto& test : decls) {
+    ASTUnit& ast = Parse(test.SourceText());
+    ClangRangeFinder::RangeCache cache;
+    ClangRangeFinder cached(&source_manager(), &lang_options(), &cache);
+    ClangRangeFinder uncached(&source_manager(), &lang_options());
+
+    // Query twice to exercise both the measuring and memoized paths.
+    EXPECT_EQ(cached.RangeForNameOf(test.FindDecl(ast)),
+              uncached.RangeForNameOf(test.FindDecl(ast)));
+    EXPECT_EQ(cached.RangeForNameOf(test.FindDecl(ast)),
+              uncached.RangeForNameOf(test.FindDecl(ast)));
+  }
+}
+
 TEST_F(ClangRangeFinderTest, NormalizeRangeExpandsZeroWidthRange) {
   ASTUnit& ast = Parse("void func();");
   ASSERT_EQ(
@@ -17,23 +17,45 @@
 #include "kythe/cxx/indexer/cxx/frontend.h"
 
 #include <fcntl.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <condition_variable>
 #include <cstdint>
+#include <fstream>
+#include <list>
+#include <map>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
 #include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "kythe/cxx/common/indexing/DeltaOutputStream.h"
 #include "kythe/cxx/common/indexing/MemcachedHashCache.h"
+#include "kythe/cxx/common/indexing/PostingsOutputStream.h"
+#include "kythe/cxx/common/indexing/ShmRingOutputStream.h"
 #include "kythe/cxx/common/kzip_reader.h"
+#include "kythe/cxx/common/mapped_claim_table.h"
 #include "kythe/cxx/common/path_utils.h"
 #include "kythe/cxx/indexer/cxx/DynamicClaimClient.h"
+#include "kythe/cxx/indexer/cxx/SharedMemoryClaimClient.h"
 #include "kythe/cxx/indexer/cxx/proto_conversions.h"
 #include "kythe/proto/buildinfo.pb.h"
 #include "kythe/proto/claim.pb.h"
@@ -43,14 +65,35 @@ ABSL_FLAG(std::string, o, "-", "Output filename");
 ABSL_FLAG(std::string, i, "-", "Input filename");
 ABSL_FLAG(bool, ignore_unimplemented, true,
           "Continue indexing even if we find something we don't support.");
+ABSL_FLAG(bool, emit_documentation, true,
+          "Compute and emit marked source (code facts) and comment "
+          "documentation. Pipelines that only consume the reference graph "
+          "can disable this to skip the work of producing these facts.");
 ABSL_FLAG(bool, flush_after_each_entry, true,
           "Flush output after writing each entry.");
+ABSL_FLAG(bool, experimental_async_writes, false,
+          "Write entry output from a background thread so serialization "
+          "overlaps writes still in flight (EXPERIMENTAL; ignored with "
+          "--compress_output).");
+ABSL_FLAG(bool, compress_output, false,
+          "gzip-compress the delimited entry stream as it is written, "
+          "avoiding a separate compression pass over the output. gunzip "
+          "recovers the usual uncompressed stream.");
 ABSL_FLAG(std::string, static_claim, "", "Use a static claim table.");
 ABSL_FLAG(bool, claim_unknown, true,
           "Process files with unknown claim status.");
 ABSL_FLAG(std::string, cache, "",
-          "Use a memcache instance (ex: \"--SERVER=foo:1234\")");
+          "Use one or more memcache shards, separated by ';' (ex: "
+          "\"--SERVER=foo:1234;--SERVER=bar:1234\")");
+ABSL_FLAG(int64_t, local_cache_slots, 0,
+          "If nonzero, deduplicate entry bundles with an in-process "
+          "lock-free hash cache of this many slots. When --cache names a "
+          "memcache instance, sizes the in-process layer in front of it "
+          "instead.");
 ABSL_FLAG(int32_t, min_size, 4096, "Minimum size of an entry bundle");
+ABSL_FLAG(bool, adaptive_bundle_sizes, false,
+          "Resize the entry-bundle dedup window during the run from observed "
+          "hit rates instead of holding --min_size/--max_size fixed.");
 ABSL_FLAG(int32_t, max_size, 1024 * 32, "Maximum size of an entry bundle");
 ABSL_FLAG(bool, cache_stats, false, "Show cache stats");
 ABSL_FLAG(std::string, icorpus, "",
@@ -69,8 +112,70 @@ ABSL_FLAG(std::string, experimental_dynamic_claim_cache, "",
 // between translation units.
 ABSL_FLAG(uint64_t, experimental_dynamic_overclaim, 1,
           "Maximum number of dynamic claims per claimable (EXPERIMENTAL)");
+ABSL_FLAG(uint64_t, experimental_dynamic_claim_cache_entries, 1024 * 1024,
+          "Maximum number of locally cached dynamic claim outcomes; 0 caches "
+          "without bound (EXPERIMENTAL)");
+ABSL_FLAG(uint64_t, experimental_dynamic_claim_ttl, 0,
+          "Seconds before a locally cached dynamic claim outcome is asked of "
+          "memcached again; 0 never re-asks (EXPERIMENTAL)");
+ABSL_FLAG(std::string, experimental_shm_claim_arena, "",
+          "Coordinate dynamic claims with other indexer processes on this "
+          "machine through the shared-memory arena file at this path, "
+          "instead of through memcached (EXPERIMENTAL)");
+ABSL_FLAG(uint64_t, experimental_shm_claim_arena_slots, 1 << 24,
+          "Slot count used when this process creates the claim arena; an "
+          "existing arena keeps its size (EXPERIMENTAL)");
 ABSL_FLAG(bool, test_claim, false,
           "Use an in-memory claim database for testing.");
+ABSL_FLAG(bool, experimental_delta_output, false,
+          "Write entries in the delta-encoded framing that elides VName "
+          "components repeated from the previous entry (see "
+          "DeltaOutputStream.h) instead of the flat entry stream.");
+ABSL_FLAG(bool, experimental_postings_output, false,
+          "Emit entries grouped by source VName in gzip-compressed blocks "
+          "instead of the flat entry stream, so downstream grouping can skip "
+          "its external sort.");
+ABSL_FLAG(std::string, experimental_shm_ring_output, "",
+          "Append entries to the shared-memory ring of this name (e.g. "
+          "\"/kythe-entries\") instead of writing them to -o, so several "
+          "indexer processes on one machine can share a single merged output "
+          "stream. One process must run with --experimental_shm_ring_drain "
+          "to write the merged stream out.");
+ABSL_FLAG(int32_t, experimental_shm_ring_drain, 0,
+          "If positive, don't index: drain --experimental_shm_ring_output "
+          "to -o, exiting once this many writer processes have detached "
+          "from the ring.");
+ABSL_FLAG(bool, experimental_persistent_worker, false,
+          "Serve as a long-lived worker: read varint-length-prefixed "
+          "kythe.proto.CompilationBundle requests from stdin and write each "
+          "unit's entry batch to -o, terminated by a zero-length record and "
+          "a varint-length-prefixed kythe.proto.AnalysisResult. Keeps one "
+          "process (and its LLVM initialization and vname configuration) "
+          "warm across compilation units. Requires the flat entry stream.");
+ABSL_FLAG(int64_t, file_cache_size_bytes, int64_t{256} * 1024 * 1024,
+          "Bound, in bytes, of the in-process cache of decompressed file "
+          "content shared across compilation units (0 disables the cache).");
+ABSL_FLAG(int32_t, parallel_jobs, 1,
+          "Fork this many analysis workers over the compilation units in the "
+          "input index files. Requires -o to name an output file; each worker "
+          "writes to its own shard file and the shards are merged when all "
+          "workers finish.");
+ABSL_FLAG(bool, resume, false,
+          "Resume an interrupted run. Completed unit digests are appended to "
+          "a done-log (<output>.done) as each unit's entries reach the output "
+          "file; on restart, units in the log are skipped and the output file "
+          "is truncated back to the last completed unit's end offset, so a "
+          "crash at unit 4,900 of 5,000 reruns 100 units instead of 5,000. "
+          "Requires -o to name an output file, kzip input, the flat entry "
+          "stream, and --flush_after_each_entry.");
+ABSL_FLAG(std::string, cost_model, "",
+          "Path to a per-compilation-unit cost model file (tab-separated "
+          "digest, wall micros, max RSS kb; one unit per line). When set, "
+          "--parallel_jobs assigns units to workers longest-known-first "
+          "instead of round-robin, so one slow unit doesn't determine the "
+          "whole run's tail latency, and the costs observed during this run "
+          "are written back to the file at exit. A missing file is an empty "
+          "model; unknown units are assumed to cost the model's median.");
 
 namespace kythe {
 
@@ -169,36 +274,329 @@ void DecodeIndexFile(const std::string& path,
 /// \param jobs A vector to add a job to for each compilation in the kzip.
 /// \param silent The silent flag is copied to each of the jobs created from the
 /// kzip file.
+/// \brief A byte-bounded LRU cache of decompressed file content keyed by
+/// digest.
+///
+/// Compilation units in one kzip overwhelmingly share their header set, so a
+/// header that appears in thousands of units is decompressed once and then
+/// served from memory until evicted.
+class FileContentCache {
+ public:
+  explicit FileContentCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+  /// \brief Returns a view of the content for `digest`, reading it with
+  /// `read` on a cache miss. On a hit the view aliases the cache entry; on
+  /// a miss it is whatever `read` returned. Either way it is valid only
+  /// until the next call to Get, so callers must copy it before then.
+  StatusOr<absl::string_view> Get(
+      absl::string_view digest,
+      const std::function<StatusOr<absl::string_view>(absl::string_view)>&
+          read) {
+    if (max_bytes_ == 0) {
+      return read(digest);
+    }
+    auto it = entries_.find(std::string(digest));
+    if (it != entries_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+      return absl::string_view(it->second.content);
+    }
+    StatusOr<absl::string_view> content = read(digest);
+    if (!content) {
+      return content;
+    }
+    lru_.push_front(std::string(digest));
+    total_bytes_ += content->size();
+    entries_.emplace(lru_.front(), Entry{std::string(*content), lru_.begin()});
+    while (total_bytes_ > max_bytes_ && !lru_.empty()) {
+      auto evict = entries_.find(lru_.back());
+      total_bytes_ -= evict->second.content.size();
+      entries_.erase(evict);
+      lru_.pop_back();
+    }
+    return content;
+  }
+
+ private:
+  struct Entry {
+    std::string content;
+    std::list<std::string>::iterator lru_position;
+  };
+  /// Digests in most-recently-used-first order.
+  std::list<std::string> lru_;
+  /// Cached content by digest.
+  std::map<std::string, Entry> entries_;
+  /// The total size of all cached content.
+  size_t total_bytes_ = 0;
+  /// The cache bound (0 disables caching).
+  size_t max_bytes_;
+};
+
+/// \return the process-wide decompressed-file cache.
+FileContentCache* GetFileContentCache() {
+  static auto* cache = new FileContentCache(
+      absl::GetFlag(FLAGS_file_cache_size_bytes) < 0
+          ? 0
+          : static_cast<size_t>(absl::GetFlag(FLAGS_file_cache_size_bytes)));
+  return cache;
+}
+
+/// \brief Historical cost of analyzing one compilation unit.
+struct CuCost {
+  uint64_t wall_micros = 0;
+  uint64_t max_rss_kb = 0;
+};
+
+/// Historical costs keyed by compilation unit digest.
+using CostModelMap = std::map<std::string, CuCost>;
+
+/// \brief Loads the cost model at `path` into `model`, overwriting entries
+/// for digests that already appear. A missing file is an empty model.
+void LoadCostModel(const std::string& path, CostModelMap* model) {
+  std::ifstream in(path);
+  if (!in) {
+    return;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string digest;
+    CuCost cost;
+    if (fields >> digest >> cost.wall_micros >> cost.max_rss_kb) {
+      (*model)[digest] = cost;
+    }
+  }
+}
+
+/// \brief Writes `model` to `path`, staging through a temporary so a
+/// concurrent reader never sees a partial model.
+void WriteCostModel(const std::string& path, const CostModelMap& model) {
+  std::string temp_path = absl::StrFormat("%s.%d.tmp", path, getpid());
+  std::ofstream out(temp_path);
+  if (!out) {
+    return;
+  }
+  for (const auto& entry : model) {
+    out << entry.first << '\t' << entry.second.wall_micros << '\t'
+        << entry.second.max_rss_kb << '\n';
+  }
+  out.close();
+  if (!out || ::rename(temp_path.c_str(), path.c_str()) != 0) {
+    ::unlink(temp_path.c_str());
+  }
+}
+
+/// \return the costs observed by this process, keyed by unit digest.
+CostModelMap* ObservedCosts() {
+  static auto* costs = new CostModelMap;
+  return costs;
+}
+
+/// \brief Calls `visit(job)` and, when a cost model is in use, records the
+/// unit's wall time and the process's peak RSS against `digest`.
+void VisitWithCostRecording(
+    const std::string& digest,
+    const IndexerContext::CompilationVisitCallback& visit, IndexerJob* job) {
+  if (absl::GetFlag(FLAGS_cost_model).empty()) {
+    visit(*job);
+    return;
+  }
+  absl::Time start = absl::Now();
+  visit(*job);
+  CuCost cost;
+  cost.wall_micros =
+      static_cast<uint64_t>(absl::ToInt64Microseconds(absl::Now() - start));
+  struct rusage usage;
+  if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+    cost.max_rss_kb = static_cast<uint64_t>(usage.ru_maxrss);
+  }
+  (*ObservedCosts())[digest] = cost;
+}
+
+/// \return true if the unit with running index `index` belongs to
+/// `shard_index`. With a shard plan the plan decides; otherwise units are
+/// dealt round-robin.
+bool IndexInShard(size_t index, size_t shard_index, size_t num_shards,
+                  const std::vector<size_t>* shard_plan) {
+  if (shard_plan != nullptr) {
+    return index < shard_plan->size() && (*shard_plan)[index] == shard_index;
+  }
+  return index % num_shards == shard_index;
+}
+
+/// \brief Assigns every compilation unit named by the positional inputs in
+/// `args` (starting at index 1) to one of `num_shards` workers.
+///
+/// Units are taken in decreasing order of their historical cost in `model`
+/// and each is placed on the least-loaded worker, so the most expensive
+/// units start first and the shards finish at roughly the same time. Units
+/// absent from the model are assumed to cost the model's median.
+/// \return the shard index for each unit, in input order.
+std::vector<size_t> BuildShardPlan(const std::vector<std::string>& args,
+                                   size_t num_shards,
+                                   const CostModelMap& model) {
+  // Gather the unit digests in the order the workers will count them.
+  std::vector<std::string> digests;
+  for (size_t arg = 1; arg < args.size(); ++arg) {
+    std::string name(strip_silent_input_prefix(args[arg]));
+    if (name.empty()) {
+      name = args[arg];
+    }
+    if (llvm::StringRef(args[arg]).endswith(".kzip")) {
+      StatusOr<IndexReader> reader = kythe::KzipReader::Open(name);
+      CHECK(reader) << "Couldn't open kzip from " << name;
+      auto status = reader->Scan([&](absl::string_view digest) {
+        digests.push_back(std::string(digest));
+        return true;
+      });
+      CHECK(status.ok()) << status.ToString();
+    } else {
+      // .kindex inputs hold one unit and have no digest to look up.
+      digests.push_back("");
+    }
+  }
+  uint64_t default_micros = 1;
+  if (!model.empty()) {
+    std::vector<uint64_t> times;
+    times.reserve(model.size());
+    for (const auto& entry : model) {
+      times.push_back(entry.second.wall_micros);
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2,
+                     times.end());
+    default_micros = std::max<uint64_t>(times[times.size() / 2], 1);
+  }
+  std::vector<uint64_t> costs(digests.size(), default_micros);
+  for (size_t i = 0; i < digests.size(); ++i) {
+    auto it = model.find(digests[i]);
+    if (it != model.end()) {
+      costs[i] = std::max<uint64_t>(it->second.wall_micros, 1);
+    }
+  }
+  std::vector<size_t> order(digests.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return costs[a] > costs[b]; });
+  // (current load, shard index), least-loaded first.
+  using Bin = std::pair<uint64_t, size_t>;
+  std::priority_queue<Bin, std::vector<Bin>, std::greater<Bin>> bins;
+  for (size_t shard = 0; shard < num_shards; ++shard) {
+    bins.push(Bin(0, shard));
+  }
+  std::vector<size_t> plan(digests.size(), 0);
+  for (size_t index : order) {
+    Bin bin = bins.top();
+    bins.pop();
+    plan[index] = bin.second;
+    bin.first += costs[index];
+    bins.push(bin);
+  }
+  return plan;
+}
+
+/// \param shard_index When sharded, only compilation units whose running
+/// index (tracked in `cu_counter`) falls in this shard are decoded.
+/// \param num_shards The total number of shards (1 if not sharded).
+/// \param cu_counter If non-null, a running count of compilation units seen.
+/// \param shard_plan If non-null, the per-index shard assignments to use
+/// instead of round-robin.
+/// \param context If non-null, consulted per unit for checkpointing: units
+/// completed by a previous run are skipped and each finished unit is
+/// recorded in the done-log (see --resume).
 void DecodeKZipFile(const std::string& path, bool silent,
-                    const IndexerContext::CompilationVisitCallback& visit) {
+                    const IndexerContext::CompilationVisitCallback& visit,
+                    size_t shard_index = 0, size_t num_shards = 1,
+                    size_t* cu_counter = nullptr,
+                    const std::vector<size_t>* shard_plan = nullptr,
+                    IndexerContext* context = nullptr) {
   StatusOr<IndexReader> reader = kythe::KzipReader::Open(path);
   CHECK(reader) << "Couldn't open kzip from " << path;
   bool compilation_read = false;
+  // Gather this worker's unit digests up front so loading can run ahead of
+  // analysis below.
+  std::vector<std::string> digests;
   auto status = reader->Scan([&](absl::string_view digest) {
-    IndexerJob job;
-    job.silent = silent;
-
-    auto compilation = reader->ReadUnit(digest);
-    for (const auto& file : compilation->unit().required_input()) {
-      auto content = reader->ReadFile(file.info().digest());
-      CHECK(content) << "Unable to read file with digest: "
-                     << file.info().digest() << ": " << content.status();
-      proto::FileData file_data;
-      file_data.set_content(*content);
-      file_data.mutable_info()->set_path(file.info().path());
-      file_data.mutable_info()->set_digest(file.info().digest());
-      job.virtual_files.push_back(std::move(file_data));
+    if ((cu_counter == nullptr ||
+         IndexInShard((*cu_counter)++, shard_index, num_shards, shard_plan)) &&
+        (context == nullptr || !context->UnitIsCompleted(digest))) {
+      digests.push_back(std::string(digest));
     }
-    job.unit = compilation->unit();
-
-    MaybeNormalizeFileVNames(&job);
-    visit(job);
-
     compilation_read = true;
     return true;
   });
   CHECK(status.ok()) << status.ToString();
   CHECK(compilation_read) << "Missing compilation in " << path;
+
+  // Load each compilation's virtual files one unit ahead of analysis on a
+  // background thread, so kzip reads and decompression overlap Clang
+  // analysis instead of serializing between compilations. The hand-off slot
+  // is one job deep: at most two compilations' file contents are in memory
+  // at a time, and the reader and file-content cache are only ever touched
+  // from the loader thread.
+  std::mutex mu;
+  std::condition_variable job_ready;
+  std::condition_variable job_taken;
+  absl::optional<IndexerJob> next_job;
+  bool loading_done = false;
+  std::thread loader([&] {
+    // Backing store for cache misses; reused across files, so loading pays
+    // no per-file allocation once it has grown to the largest input seen.
+    std::string scratch;
+    for (const auto& digest : digests) {
+      IndexerJob job;
+      job.silent = silent;
+
+      auto compilation = reader->ReadUnit(digest);
+      for (const auto& file : compilation->unit().required_input()) {
+        auto content = GetFileContentCache()->Get(
+            file.info().digest(), [&](absl::string_view file_digest) {
+              return reader->ReadFileView(file_digest, &scratch);
+            });
+        CHECK(content) << "Unable to read file with digest: "
+                       << file.info().digest() << ": " << content.status();
+        proto::FileData file_data;
+        file_data.set_content(content->data(), content->size());
+        file_data.mutable_info()->set_path(file.info().path());
+        file_data.mutable_info()->set_digest(file.info().digest());
+        job.virtual_files.push_back(std::move(file_data));
+      }
+      job.unit = compilation->unit();
+
+      MaybeNormalizeFileVNames(&job);
+
+      std::unique_lock<std::mutex> lock(mu);
+      job_taken.wait(lock, [&] { return !next_job.has_value(); });
+      next_job = std::move(job);
+      job_ready.notify_one();
+    }
+    std::unique_lock<std::mutex> lock(mu);
+    loading_done = true;
+    job_ready.notify_one();
+  });
+  // Jobs are handed off in `digests` order, so the consumer can recover
+  // each job's unit digest from its position.
+  size_t job_index = 0;
+  while (true) {
+    IndexerJob job;
+    {
+      std::unique_lock<std::mutex> lock(mu);
+      job_ready.wait(lock,
+                     [&] { return next_job.has_value() || loading_done; });
+      if (!next_job.has_value()) {
+        break;
+      }
+      job = *std::move(next_job);
+      next_job.reset();
+      job_taken.notify_one();
+    }
+    VisitWithCostRecording(digests[job_index], visit, &job);
+    if (context != nullptr) {
+      context->MarkUnitCompleted(digests[job_index]);
+    }
+    ++job_index;
+  }
+  loader.join();
 }
 }  // anonymous namespace
 
@@ -241,15 +639,23 @@ bool IndexerContext::HasIndexArguments() {
 }
 
 void IndexerContext::LoadDataFromIndex(const std::string& file_or_cu,
-                                       const CompilationVisitCallback& visit) {
+                                       const CompilationVisitCallback& visit,
+                                       size_t shard_index, size_t num_shards,
+                                       size_t* cu_counter,
+                                       const std::vector<size_t>* shard_plan) {
   std::string name(strip_silent_input_prefix(file_or_cu));
   const bool silent = !name.empty();
   if (name.empty()) {
     name = file_or_cu;
   }
   if (llvm::StringRef(file_or_cu).endswith(".kzip")) {
-    DecodeKZipFile(name, silent, visit);
+    DecodeKZipFile(name, silent, visit, shard_index, num_shards, cu_counter,
+                   shard_plan, this);
   } else {
+    if (cu_counter != nullptr &&
+        !IndexInShard((*cu_counter)++, shard_index, num_shards, shard_plan)) {
+      return;
+    }
     IndexerJob job;
     job.silent = silent;
     DecodeIndexFile(name, &job.virtual_files, &job.unit);
@@ -310,14 +716,40 @@ void IndexerContext::LoadDataFromUnpackedFile(
 }
 
 void IndexerContext::InitializeClaimClient() {
-  if (!absl::GetFlag(FLAGS_experimental_dynamic_claim_cache).empty()) {
+  if (!absl::GetFlag(FLAGS_experimental_shm_claim_arena).empty()) {
+    auto shm_claims = absl::make_unique<kythe::SharedMemoryClaimClient>();
+    CHECK(shm_claims->OpenArena(
+        absl::GetFlag(FLAGS_experimental_shm_claim_arena),
+        absl::GetFlag(FLAGS_experimental_shm_claim_arena_slots)))
+        << "Can't open claim arena";
+    claim_client_ = std::move(shm_claims);
+  } else if (!absl::GetFlag(FLAGS_experimental_dynamic_claim_cache).empty()) {
     auto dynamic_claims = absl::make_unique<kythe::DynamicClaimClient>();
     dynamic_claims->set_max_redundant_claims(
         absl::GetFlag(FLAGS_experimental_dynamic_overclaim));
+    dynamic_claims->set_decision_cache_max_entries(
+        absl::GetFlag(FLAGS_experimental_dynamic_claim_cache_entries));
+    if (uint64_t ttl = absl::GetFlag(FLAGS_experimental_dynamic_claim_ttl)) {
+      dynamic_claims->set_decision_cache_ttl(absl::Seconds(ttl));
+    }
     CHECK(dynamic_claims->OpenMemcache(
         absl::GetFlag(FLAGS_experimental_dynamic_claim_cache)))
         << "Can't open memcached";
     claim_client_ = std::move(dynamic_claims);
+  } else if (!absl::GetFlag(FLAGS_static_claim).empty() &&
+             kythe::MappedClaimTable::SniffHeader(
+                 absl::GetFlag(FLAGS_static_claim))) {
+    // Binary tables (written with static_claim --binary_table) are mapped
+    // instead of parsed, so startup cost is independent of table size.
+    auto table =
+        kythe::MappedClaimTable::Open(absl::GetFlag(FLAGS_static_claim));
+    CHECK(table != nullptr) << "Couldn't map claim table "
+                            << absl::GetFlag(FLAGS_static_claim);
+    auto mapped_claims =
+        absl::make_unique<kythe::MappedClaimClient>(std::move(table));
+    mapped_claims->set_process_unknown_status(
+        absl::GetFlag(FLAGS_claim_unknown));
+    claim_client_ = std::move(mapped_claims);
   } else {
     auto static_claims = absl::make_unique<kythe::StaticClaimClient>();
     if (!absl::GetFlag(FLAGS_static_claim).empty()) {
@@ -332,24 +764,164 @@ void IndexerContext::InitializeClaimClient() {
 
 void IndexerContext::OpenOutputStreams() {
   write_fd_ = STDOUT_FILENO;
+  const bool resume = absl::GetFlag(FLAGS_resume);
   if (absl::GetFlag(FLAGS_o) != "-") {
-    write_fd_ =
-        ::open(absl::GetFlag(FLAGS_o).c_str(), O_WRONLY | O_CREAT | O_TRUNC,
-               S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    // When resuming, the previous run's output is kept and truncated back
+    // to its last completed unit in InitializeCheckpoint.
+    const int flags = O_WRONLY | O_CREAT | (resume ? 0 : O_TRUNC);
+    write_fd_ = ::open(absl::GetFlag(FLAGS_o).c_str(), flags,
+                       S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
     if (write_fd_ == -1) {
       ::perror("Can't open output file");
       ::exit(1);
     }
+    if (resume) {
+      InitializeCheckpoint();
+    }
+  } else {
+    CHECK(!resume) << "--resume requires -o to name an output file.";
   }
   raw_output_ =
       absl::make_unique<google::protobuf::io::FileOutputStream>(write_fd_);
-  kythe_output_ = absl::make_unique<kythe::FileOutputStream>(raw_output_.get());
-  kythe_output_->set_show_stats(absl::GetFlag(FLAGS_cache_stats));
-  kythe_output_->set_flush_after_each_entry(
+  const int32_t ring_writers = absl::GetFlag(FLAGS_experimental_shm_ring_drain);
+  if (ring_writers > 0) {
+    // Drainer mode: merge the shared ring into -o and exit without indexing.
+    const std::string ring_name =
+        absl::GetFlag(FLAGS_experimental_shm_ring_output);
+    if (ring_name.empty()) {
+      absl::FPrintF(stderr,
+                    "--experimental_shm_ring_drain requires "
+                    "--experimental_shm_ring_output\n");
+      ::exit(1);
+    }
+    bool drained = ShmRingOutputStream::Drain(
+        ring_name, static_cast<size_t>(ring_writers), raw_output_.get());
+    raw_output_.reset();
+    if (::close(write_fd_) != 0) {
+      ::perror("Error closing output file");
+      drained = false;
+    }
+    ::exit(drained ? 0 : 1);
+  }
+  BuildKytheOutput();
+}
+
+void IndexerContext::BuildKytheOutput() {
+  const std::string ring_name =
+      absl::GetFlag(FLAGS_experimental_shm_ring_output);
+  if (!ring_name.empty()) {
+    auto ring_output = ShmRingOutputStream::Create(ring_name);
+    if (ring_output == nullptr) {
+      absl::FPrintF(stderr, "Can't open shared ring %s\n", ring_name);
+      ::exit(1);
+    }
+    kythe_output_ = std::move(ring_output);
+    return;
+  }
+  if (absl::GetFlag(FLAGS_experimental_delta_output)) {
+    kythe_output_ =
+        absl::make_unique<kythe::DeltaOutputStream>(raw_output_.get());
+    return;
+  }
+  if (absl::GetFlag(FLAGS_experimental_postings_output)) {
+    kythe_output_ =
+        absl::make_unique<kythe::PostingsOutputStream>(raw_output_.get());
+    return;
+  }
+  auto file_output =
+      absl::make_unique<kythe::FileOutputStream>(raw_output_.get());
+  file_output->set_show_stats(absl::GetFlag(FLAGS_cache_stats));
+  file_output->set_compress_output(absl::GetFlag(FLAGS_compress_output));
+  file_output->set_flush_after_each_entry(
       absl::GetFlag(FLAGS_flush_after_each_entry));
+  file_output->set_adaptive_size_limits(
+      absl::GetFlag(FLAGS_adaptive_bundle_sizes));
+  if (absl::GetFlag(FLAGS_experimental_async_writes) &&
+      !absl::GetFlag(FLAGS_compress_output)) {
+    file_output->set_async_write_fd(write_fd_);
+  }
+  kythe_output_ = std::move(file_output);
+}
+
+void IndexerContext::InitializeCheckpoint() {
+  CHECK(absl::GetFlag(FLAGS_experimental_shm_ring_output).empty() &&
+        !absl::GetFlag(FLAGS_experimental_delta_output) &&
+        !absl::GetFlag(FLAGS_experimental_postings_output) &&
+        !absl::GetFlag(FLAGS_compress_output))
+      << "--resume requires the flat entry stream.";
+  CHECK(absl::GetFlag(FLAGS_flush_after_each_entry))
+      << "--resume requires --flush_after_each_entry so a unit's entries are "
+         "on disk before the done-log names it complete.";
+  const std::string log_path =
+      absl::StrFormat("%s.done", absl::GetFlag(FLAGS_o));
+  // Parse whole lines only: a crash mid-append can leave a torn final line.
+  std::vector<std::pair<std::string, uint64_t>> entries;
+  uint64_t resume_offset = 0;
+  {
+    std::ifstream log(log_path);
+    std::string line;
+    while (std::getline(log, line)) {
+      std::istringstream fields(line);
+      std::string digest;
+      uint64_t end_offset;
+      if (fields >> digest >> end_offset) {
+        completed_units_.insert(digest);
+        entries.emplace_back(digest, end_offset);
+        resume_offset = end_offset;
+      }
+    }
+  }
+  // Rewrite the log from the parsed entries so a torn trailing line can't
+  // corrupt the next append.
+  const std::string temp_path = absl::StrFormat("%s.%d.tmp", log_path, getpid());
+  {
+    std::ofstream rewrite(temp_path);
+    CHECK(rewrite) << "Couldn't rewrite done-log " << log_path;
+    for (const auto& entry : entries) {
+      rewrite << entry.first << '\t' << entry.second << '\n';
+    }
+  }
+  CHECK_EQ(0, ::rename(temp_path.c_str(), log_path.c_str()))
+      << "Couldn't rewrite done-log " << log_path;
+  CHECK_EQ(0, ::ftruncate(write_fd_, static_cast<off_t>(resume_offset)))
+      << "Couldn't truncate output back to the last completed unit.";
+  CHECK_GE(::lseek(write_fd_, 0, SEEK_END), 0);
+  done_log_fd_ = ::open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND,
+                        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  CHECK_GE(done_log_fd_, 0) << "Couldn't open done-log " << log_path;
+  if (!completed_units_.empty()) {
+    LOG(INFO) << "Resuming: " << completed_units_.size()
+              << " units already complete.";
+  }
+}
+
+bool IndexerContext::UnitIsCompleted(absl::string_view digest) const {
+  return done_log_fd_ >= 0 &&
+         completed_units_.find(std::string(digest)) != completed_units_.end();
+}
+
+void IndexerContext::MarkUnitCompleted(absl::string_view digest) {
+  if (done_log_fd_ < 0) {
+    return;
+  }
+  // The flat stream flushes per entry, so pushing the stream buffer out
+  // makes the unit's entries durable before the log names it complete.
+  raw_output_->Flush();
+  off_t end_offset = ::lseek(write_fd_, 0, SEEK_CUR);
+  CHECK_GE(end_offset, 0);
+  const std::string line = absl::StrFormat(
+      "%s\t%d\n", digest, static_cast<int64_t>(end_offset));
+  CHECK_EQ(static_cast<ssize_t>(line.size()),
+           ::write(done_log_fd_, line.data(), line.size()))
+      << "Couldn't append to done-log";
+  ::fsync(done_log_fd_);
 }
 
 void IndexerContext::CloseOutputStreams() {
+  if (done_log_fd_ >= 0) {
+    ::close(done_log_fd_);
+    done_log_fd_ = -1;
+  }
   if (kythe_output_) {
     kythe_output_.reset();
     raw_output_.reset();
@@ -364,9 +936,24 @@ void IndexerContext::OpenHashCache() {
   if (!absl::GetFlag(FLAGS_cache).empty()) {
     auto memcache_hash_cache = absl::make_unique<MemcachedHashCache>();
     CHECK(memcache_hash_cache->OpenMemcache(absl::GetFlag(FLAGS_cache)));
-    memcache_hash_cache->SetSizeLimits(absl::GetFlag(FLAGS_min_size),
-                                       absl::GetFlag(FLAGS_max_size));
-    hash_cache_ = std::move(memcache_hash_cache);
+    // Front the network with an in-process layer so hashes this process
+    // registered or already probed never pay another round trip.
+    auto local_layer =
+        absl::GetFlag(FLAGS_local_cache_slots) > 0
+            ? absl::make_unique<LocalHashCache>(
+                  static_cast<size_t>(absl::GetFlag(FLAGS_local_cache_slots)))
+            : absl::make_unique<LocalHashCache>();
+    auto tiered_hash_cache = absl::make_unique<TieredHashCache>(
+        std::move(local_layer), std::move(memcache_hash_cache));
+    tiered_hash_cache->SetSizeLimits(absl::GetFlag(FLAGS_min_size),
+                                     absl::GetFlag(FLAGS_max_size));
+    hash_cache_ = std::move(tiered_hash_cache);
+  } else if (absl::GetFlag(FLAGS_local_cache_slots) > 0) {
+    auto local_hash_cache = absl::make_unique<LocalHashCache>(
+        static_cast<size_t>(absl::GetFlag(FLAGS_local_cache_slots)));
+    local_hash_cache->SetSizeLimits(absl::GetFlag(FLAGS_min_size),
+                                    absl::GetFlag(FLAGS_max_size));
+    hash_cache_ = std::move(local_hash_cache);
   }
 }
 
@@ -374,10 +961,14 @@ IndexerContext::IndexerContext(const std::vector<std::string>& args,
                                const std::string& default_filename)
     : args_(args),
       default_filename_(default_filename),
-      ignore_unimplemented_(absl::GetFlag(FLAGS_ignore_unimplemented)) {
+      ignore_unimplemented_(absl::GetFlag(FLAGS_ignore_unimplemented)),
+      emit_documentation_(absl::GetFlag(FLAGS_emit_documentation)) {
   args_.erase(std::remove(args_.begin(), args_.end(), std::string()),
               args_.end());
-  unpacked_inputs_ = !HasIndexArguments();
+  // Worker requests carry all of their file content, so they are treated
+  // like index inputs for filesystem access.
+  unpacked_inputs_ = !HasIndexArguments() &&
+                     !absl::GetFlag(FLAGS_experimental_persistent_worker);
 
   InitializeClaimClient();
   OpenOutputStreams();
@@ -388,12 +979,174 @@ IndexerContext::~IndexerContext() { CloseOutputStreams(); }
 
 void IndexerContext::EnumerateCompilations(
     const CompilationVisitCallback& visit) {
-  if (unpacked_inputs_) {
+  if (absl::GetFlag(FLAGS_experimental_persistent_worker)) {
+    RunPersistentWorker(visit);
+  } else if (unpacked_inputs_) {
     LoadDataFromUnpackedFile(default_filename_, visit);
+  } else if (absl::GetFlag(FLAGS_parallel_jobs) > 1) {
+    EnumerateCompilationsInParallel(absl::GetFlag(FLAGS_parallel_jobs), visit);
   } else {
     for (size_t arg = 1; arg < args_.size(); ++arg) {
       LoadDataFromIndex(args_[arg], visit);
     }
+    const std::string cost_model_path = absl::GetFlag(FLAGS_cost_model);
+    if (!cost_model_path.empty() && !ObservedCosts()->empty()) {
+      CostModelMap model;
+      LoadCostModel(cost_model_path, &model);
+      for (const auto& entry : *ObservedCosts()) {
+        model[entry.first] = entry.second;
+      }
+      WriteCostModel(cost_model_path, model);
+    }
+  }
+}
+
+void IndexerContext::RunPersistentWorker(
+    const CompilationVisitCallback& visit) {
+  CHECK(absl::GetFlag(FLAGS_experimental_shm_ring_output).empty() &&
+        !absl::GetFlag(FLAGS_experimental_delta_output) &&
+        !absl::GetFlag(FLAGS_experimental_postings_output) &&
+        !absl::GetFlag(FLAGS_compress_output))
+      << "--experimental_persistent_worker requires the flat entry stream.";
+  CHECK(absl::GetFlag(FLAGS_flush_after_each_entry))
+      << "--experimental_persistent_worker requires --flush_after_each_entry "
+         "so a unit's entries reach the scheduler before its result trailer.";
+  using namespace google::protobuf::io;
+  FileInputStream raw_input(STDIN_FILENO);
+  for (;;) {
+    proto::CompilationBundle bundle;
+    {
+      CodedInputStream coded_input(&raw_input);
+      coded_input.SetTotalBytesLimit(INT_MAX, -1);
+      google::protobuf::uint32 byte_size;
+      if (!coded_input.ReadVarint32(&byte_size)) {
+        // A clean end of stream falls on a request boundary: the scheduler
+        // closed our stdin and this worker is done.
+        CHECK_EQ(0, coded_input.CurrentPosition())
+            << "Truncated worker request on stdin.";
+        break;
+      }
+      auto limit = coded_input.PushLimit(byte_size);
+      CHECK(bundle.ParseFromCodedStream(&coded_input))
+          << "Malformed CompilationBundle on stdin.";
+      coded_input.PopLimit(limit);
+    }
+    IndexerJob job;
+    job.unit = std::move(*bundle.mutable_unit());
+    for (auto& file : *bundle.mutable_files()) {
+      job.virtual_files.push_back(std::move(file));
+    }
+    MaybeNormalizeFileVNames(&job);
+    visit(job);
+    // Each request's entries are consumed by the scheduler as a separate
+    // output, so per-stream suppression state must not leak into the next
+    // request's batch.
+    kythe_output_->ResetFileFactSuppression();
+    // Close the unit's batch: a zero-length record (no serialized Entry is
+    // ever empty) followed by the result trailer.
+    proto::AnalysisResult result;
+    result.set_status(proto::AnalysisResult::COMPLETE);
+    {
+      CodedOutputStream coded_output(raw_output_.get());
+      coded_output.WriteVarint32(0);
+      coded_output.WriteVarint32(result.ByteSizeLong());
+      result.SerializeWithCachedSizes(&coded_output);
+    }
+    raw_output_->Flush();
+  }
+}
+
+void IndexerContext::EnumerateCompilationsInParallel(
+    int jobs, const CompilationVisitCallback& visit) {
+  CHECK_NE("-", absl::GetFlag(FLAGS_o))
+      << "--parallel_jobs requires -o to name an output file.";
+  CHECK(!absl::GetFlag(FLAGS_resume))
+      << "--resume is not supported with --parallel_jobs; workers would race "
+         "on one done-log.";
+  const std::string cost_model_path = absl::GetFlag(FLAGS_cost_model);
+  CostModelMap cost_model;
+  std::vector<size_t> shard_plan;
+  if (!cost_model_path.empty()) {
+    LoadCostModel(cost_model_path, &cost_model);
+    shard_plan = BuildShardPlan(args_, static_cast<size_t>(jobs), cost_model);
+  }
+  std::vector<pid_t> workers;
+  std::vector<std::string> shard_paths;
+  for (int shard = 0; shard < jobs; ++shard) {
+    shard_paths.push_back(
+        absl::StrFormat("%s.shard.%d", absl::GetFlag(FLAGS_o), shard));
+    pid_t pid = ::fork();
+    CHECK_GE(pid, 0) << "Couldn't fork analysis worker " << shard;
+    if (pid != 0) {
+      workers.push_back(pid);
+      continue;
+    }
+    // In the worker: replace the inherited output stream with this shard's
+    // own file, then analyze every `jobs`th compilation unit.
+    kythe_output_.reset();
+    raw_output_.reset();
+    ::close(write_fd_);
+    write_fd_ = ::open(shard_paths.back().c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                       S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (write_fd_ == -1) {
+      ::perror("Can't open shard output file");
+      ::_exit(1);
+    }
+    raw_output_ =
+        absl::make_unique<google::protobuf::io::FileOutputStream>(write_fd_);
+    BuildKytheOutput();
+    size_t cu_counter = 0;
+    for (size_t arg = 1; arg < args_.size(); ++arg) {
+      LoadDataFromIndex(args_[arg], visit, static_cast<size_t>(shard),
+                        static_cast<size_t>(jobs), &cu_counter,
+                        shard_plan.empty() ? nullptr : &shard_plan);
+    }
+    if (!cost_model_path.empty()) {
+      // The parent folds the per-worker observations back into the model
+      // once every shard has finished.
+      WriteCostModel(absl::StrFormat("%s.shard.%d", cost_model_path, shard),
+                     *ObservedCosts());
+    }
+    CloseOutputStreams();
+    ::_exit(0);
+  }
+  bool worker_failed = false;
+  for (size_t shard = 0; shard < workers.size(); ++shard) {
+    int status = 0;
+    CHECK_EQ(workers[shard], ::waitpid(workers[shard], &status, 0));
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      absl::FPrintF(stderr, "Analysis worker %zu failed.\n", shard);
+      worker_failed = true;
+    }
+  }
+  CHECK(!worker_failed) << "One or more analysis workers failed.";
+  // The shard files are already framed entry streams, so merging is a
+  // byte-for-byte concatenation into the main output file.
+  for (const auto& shard_path : shard_paths) {
+    int shard_fd = ::open(shard_path.c_str(), O_RDONLY);
+    CHECK_GE(shard_fd, 0) << "Couldn't reopen shard file " << shard_path;
+    char buf[65536];
+    ssize_t amount_read;
+    while ((amount_read = ::read(shard_fd, buf, sizeof(buf))) > 0) {
+      ssize_t written = 0;
+      while (written < amount_read) {
+        ssize_t wrote = ::write(write_fd_, buf + written, amount_read - written);
+        CHECK_GE(wrote, 0) << "Error merging shard file " << shard_path;
+        written += wrote;
+      }
+    }
+    CHECK_GE(amount_read, 0) << "Error reading shard file " << shard_path;
+    ::close(shard_fd);
+    ::unlink(shard_path.c_str());
+  }
+  if (!cost_model_path.empty()) {
+    for (int shard = 0; shard < jobs; ++shard) {
+      const std::string shard_model =
+          absl::StrFormat("%s.shard.%d", cost_model_path, shard);
+      LoadCostModel(shard_model, &cost_model);
+      ::unlink(shard_model.c_str());
+    }
+    WriteCostModel(cost_model_path, cost_model);
   }
 }
 
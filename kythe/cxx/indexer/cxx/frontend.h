@@ -17,9 +17,11 @@
 #ifndef KYTHE_CXX_INDEXER_CXX_FRONTEND_H_
 #define KYTHE_CXX_INDEXER_CXX_FRONTEND_H_
 
+#include <set>
 #include <string>
 #include <vector>
 
+#include "absl/strings/string_view.h"
 #include "glog/logging.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "kythe/cxx/common/indexing/KytheCachingOutput.h"
@@ -69,6 +71,9 @@ class IndexerContext {
   }
   /// \brief If true, the indexer should handle unknown elements gracefully.
   bool ignore_unimplemented() const { return ignore_unimplemented_; }
+  /// \brief If true, the indexer should compute and emit marked source and
+  /// comment documentation; if false, only the reference graph is produced.
+  bool emit_documentation() const { return emit_documentation_; }
   /// \brief The claim client to use for this compilation. Not null.
   KytheClaimClient* claim_client() const {
     CHECK(claim_client_ != nullptr);
@@ -76,11 +81,20 @@ class IndexerContext {
   }
   /// \brief The output stream to use for this compilation. Not null; owned
   /// by `IndexerContext` and closed on destruction.
-  FileOutputStream* output() const {
+  KytheCachingOutput* output() const {
     CHECK(kythe_output_ != nullptr);
     return kythe_output_.get();
   }
 
+  /// \brief Returns true if the unit with `digest` completed in a previous
+  /// run and should be skipped (see --resume). Always false when not
+  /// resuming.
+  bool UnitIsCompleted(absl::string_view digest) const;
+  /// \brief Flushes the unit's entries to the output file and appends
+  /// `digest` and the file's end offset to the done-log. A no-op when
+  /// --resume is not set.
+  void MarkUnitCompleted(absl::string_view digest);
+
   /// \brief Generates a usage message for this indexer.
   /// \param program_title a description of the indexer
   /// ("the Kythe C++ indexer")
@@ -96,21 +110,52 @@ class IndexerContext {
   /// \param file_or_cu The name of the .kzip or .kindex (with extension) or the
   /// compilation unit hash.
   /// \param visit A callback to call for each compilation unit.
+  /// \param shard_index This process's shard of the compilation unit list.
+  /// \param num_shards The total number of shards (1 if not sharded).
+  /// \param cu_counter If non-null, a running count of compilation units seen
+  /// across all index files; only units whose index falls in this shard are
+  /// decoded and visited.
+  /// \param shard_plan If non-null, the cost-model shard assignment for each
+  /// compilation unit index, used instead of round-robin dealing (see
+  /// --cost_model).
   void LoadDataFromIndex(const std::string& file_or_cu,
-                         const CompilationVisitCallback& visit);
+                         const CompilationVisitCallback& visit,
+                         size_t shard_index = 0, size_t num_shards = 1,
+                         size_t* cu_counter = nullptr,
+                         const std::vector<size_t>* shard_plan = nullptr);
+  /// \brief Forks a pool of analysis workers that split the compilation unit
+  /// list, each writing to its own shard output file, then merges the shard
+  /// files into the main output stream.
+  /// \param jobs The number of worker processes to fork.
+  /// \param visit A callback to call (in a worker) for each compilation unit.
+  void EnumerateCompilationsInParallel(int jobs,
+                                       const CompilationVisitCallback& visit);
   /// \brief Load data from an unpacked file.
   /// \param default_filename The filename to use if we're reading from stdin.
   /// \param visit A callback to call for each compilation unit.
   void LoadDataFromUnpackedFile(const std::string& default_filename,
                                 const CompilationVisitCallback& visit);
+  /// \brief Serves varint-length-prefixed `CompilationBundle` requests from
+  /// stdin until end-of-stream, writing each unit's entry batch (followed by
+  /// a zero-length record and a varint-length-prefixed `AnalysisResult`) to
+  /// the output stream.
+  /// \param visit A callback to call for each compilation unit.
+  void RunPersistentWorker(const CompilationVisitCallback& visit);
   /// \brief Initialize a claim client.
   void InitializeClaimClient();
   /// \brief Prepare to write to output.
   void OpenOutputStreams();
+  /// \brief Construct the Kythe output wrapper over `raw_output_` (either the
+  /// flat entry stream or the grouped postings writer).
+  void BuildKytheOutput();
   /// \brief Flush output.
   void CloseOutputStreams();
   /// \brief Configure the hash cache (if one was requested).
   void OpenHashCache();
+  /// \brief Loads the done-log, truncates the output file back to the last
+  /// completed unit's end offset, and opens the log for appending (see
+  /// --resume). Called from OpenOutputStreams.
+  void InitializeCheckpoint();
 
   /// Command-line arguments, pruned of empty strings and gflags.
   std::vector<std::string> args_;
@@ -121,15 +166,21 @@ class IndexerContext {
   /// Wraps `write_fd_`.
   std::unique_ptr<google::protobuf::io::FileOutputStream> raw_output_;
   /// Wraps `raw_output_`.
-  std::unique_ptr<FileOutputStream> kythe_output_;
+  std::unique_ptr<KytheCachingOutput> kythe_output_;
   /// The claim client to use during analysis.
   std::unique_ptr<kythe::KytheClaimClient> claim_client_;
   /// The hash cache to use during analysis (or null).
   std::unique_ptr<HashCache> hash_cache_;
+  /// Unit digests completed by a previous run (see --resume).
+  std::set<std::string> completed_units_;
+  /// The done-log file descriptor, or -1 when not resuming.
+  int done_log_fd_ = -1;
   /// Whether the args specify an unpacked input file as opposed to an index.
   bool unpacked_inputs_ = false;
   /// Whether to ignore missing cases during analysis.
   bool ignore_unimplemented_ = false;
+  /// Whether to compute and emit marked source and documentation.
+  bool emit_documentation_ = true;
 };
 
 }  // namespace kythe
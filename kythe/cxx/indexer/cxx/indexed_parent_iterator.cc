@@ -46,7 +46,7 @@ RootTraversal::iterator RootTraversal::iterator::next() const {
     if (const auto* decl = GetDeclInContext(current_->decl)) {
       return iterator(parent_map_, decl);
     }
-    return iterator(parent_map_, current_->indexed_parent->parent);
+    return iterator(parent_map_, link_->next);
   }
   return iterator();
 }
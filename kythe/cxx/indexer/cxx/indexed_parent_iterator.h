@@ -17,6 +17,8 @@
 #define KYTHE_CXX_INDEXER_CXX_INDEXED_PARENT_ITERATOR_H_
 
 #include <iterator>
+#include <memory>
+#include <utility>
 
 #include "absl/types/optional.h"
 #include "clang/AST/ASTTypeTraits.h"
@@ -59,36 +61,38 @@ class RootTraversal {
    private:
     friend class RootTraversal;
 
-    explicit iterator(const IndexedParentMap* parent_map,
-                      clang::ast_type_traits::DynTypedNode node,
-                      const clang::Decl* decl, const IndexedParent* parent)
-        : parent_map_(parent_map), current_(value_type{node, decl, parent}) {
-      // If we would be constructed from a TranslationUnitDecl, stop.
-      if (decl && clang::isa<clang::TranslationUnitDecl>(decl)) {
-        parent_map_ = nullptr;
-        current_ = absl::nullopt;
+    explicit iterator(
+        const IndexedParentMap* parent_map,
+        std::shared_ptr<const IndexedParentMap::AncestorLink> link)
+        : parent_map_(parent_map), link_(std::move(link)) {
+      if (link_ != nullptr) {
+        const clang::Decl* decl = link_->node.get<clang::Decl>();
+        // If we would be constructed from a TranslationUnitDecl, stop.
+        if (decl == nullptr || !clang::isa<clang::TranslationUnitDecl>(decl)) {
+          current_ = value_type{link_->node, decl, link_->parent};
+          return;
+        }
       }
-    }
-
-    explicit iterator(const IndexedParentMap* parent_map,
-                      clang::ast_type_traits::DynTypedNode node,
-                      const clang::Decl* decl)
-        : iterator(parent_map, node, decl, parent_map->GetIndexedParent(node)) {
+      parent_map_ = nullptr;
+      link_ = nullptr;
     }
 
     explicit iterator(const IndexedParentMap* parent_map,
                       clang::ast_type_traits::DynTypedNode node)
-        : iterator(parent_map, node, node.get<clang::Decl>()) {}
+        : iterator(parent_map, parent_map->GetAncestorChain(node)) {}
 
     explicit iterator(const IndexedParentMap* parent_map,
                       const clang::Decl* decl)
         : iterator(parent_map,
-                   clang::ast_type_traits::DynTypedNode::create(*decl), decl) {}
+                   clang::ast_type_traits::DynTypedNode::create(*decl)) {}
 
     iterator next() const;
     void advance();
 
     const IndexedParentMap* parent_map_ = nullptr;
+    /// The memoized ancestor chain link for the current node; hops toward
+    /// the root follow `link_->next` instead of re-querying the parent map.
+    std::shared_ptr<const IndexedParentMap::AncestorLink> link_;
     absl::optional<value_type> current_ = absl::nullopt;
   };
 
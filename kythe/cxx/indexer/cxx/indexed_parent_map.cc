@@ -15,6 +15,10 @@
  */
 #include "indexed_parent_map.h"
 
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "glog/logging.h"
 #include "kythe/cxx/common/scope_guard.h"
@@ -61,12 +65,26 @@ class IndexedParentASTVisitor
     : private clang::RecursiveASTVisitor<IndexedParentASTVisitor<MappingType>> {
  public:
   static MappingType BuildIndexedParentMap(clang::TranslationUnitDecl* unit) {
-    IndexedParentASTVisitor visitor;
+    MappingType parents;
+    IndexedParentASTVisitor visitor(&parents);
     visitor.TraverseDecl(unit);
-    return std::move(visitor.parents_);
+    return parents;
+  }
+
+  /// \brief Records parent entries for the subtree rooted at `decl` into
+  /// `parents`, as if `decl` had been reached during a full traversal as
+  /// child `index` of `root`.
+  static void AppendSubtree(clang::Decl* decl,
+                            const clang::ast_type_traits::DynTypedNode& root,
+                            size_t index, MappingType* parents) {
+    IndexedParentASTVisitor visitor(parents);
+    visitor.parent_stack_.push_back({root, index});
+    visitor.TraverseDecl(decl);
   }
 
  private:
+  explicit IndexedParentASTVisitor(MappingType* parents) : parents_(parents) {}
+
   using VisitorBase = clang::RecursiveASTVisitor<IndexedParentASTVisitor>;
   friend class clang::RecursiveASTVisitor<IndexedParentASTVisitor>;
 
@@ -86,7 +104,7 @@ class IndexedParentASTVisitor
     using ::clang::ast_type_traits::DynTypedNode;
     if (node == nullptr) return true;
     if (!parent_stack_.empty()) {
-      auto& parent = parents_[node];
+      auto& parent = (*parents_)[node];
       if (parent.getPointer() == nullptr) {
         parent.setPointer(new IndexedParent(parent_stack_.back()));
       }
@@ -96,7 +114,7 @@ class IndexedParentASTVisitor
     auto scope = MakeScopeGuard([&] {
       if (claimable_at_this_depth_ || IsClaimableForTraverse(node)) {
         claimable_at_this_depth_ = true;  // for depth
-        parents_[node].setInt(1);
+        (*parents_)[node].setInt(1);
       } else {
         claimable_at_this_depth_ = saved_claimable;
       }
@@ -124,10 +142,26 @@ class IndexedParentASTVisitor
     });
   }
 
-  MappingType parents_;
+  MappingType* parents_;
   llvm::SmallVector<IndexedParent, 16> parent_stack_;
   bool claimable_at_this_depth_ = false;
 };
+
+/// \return the ancestor of `decl` whose lexical context is the translation
+/// unit, or null if there isn't one (e.g. for decls from other units).
+const clang::Decl* TopLevelAncestor(const clang::Decl* decl) {
+  for (const clang::Decl* current = decl; current != nullptr;) {
+    const auto* context = current->getLexicalDeclContext();
+    if (context == nullptr) {
+      return nullptr;
+    }
+    if (llvm::isa<clang::TranslationUnitDecl>(context)) {
+      return current;
+    }
+    current = clang::Decl::castFromDeclContext(context);
+  }
+  return nullptr;
+}
 }  // namespace
 
 /* static */
@@ -136,11 +170,48 @@ IndexedParentMap IndexedParentMap::Build(clang::TranslationUnitDecl* unit) {
       IndexedParentASTVisitor<MappingType>::BuildIndexedParentMap(unit));
 }
 
+/* static */
+IndexedParentMap IndexedParentMap::BuildLazy(clang::TranslationUnitDecl* unit) {
+  return IndexedParentMap(unit);
+}
+
+void IndexedParentMap::EnsureIndexed(
+    const clang::ast_type_traits::DynTypedNode& node) const {
+  if (parents_.count(node.getMemoizationData()) != 0) {
+    return;
+  }
+  // Decls can be mapped back to their top-level subtree through their lexical
+  // contexts; other node kinds force indexing of the remaining subtrees in
+  // order until the node is found.
+  const clang::Decl* top_level = nullptr;
+  if (const auto* decl = node.get<clang::Decl>()) {
+    top_level = TopLevelAncestor(decl);
+  }
+  const auto tu_node = clang::ast_type_traits::DynTypedNode::create(*unit_);
+  size_t index = 0;
+  for (clang::Decl* child : unit_->decls()) {
+    if (top_level == nullptr || child == top_level) {
+      if (indexed_decls_.insert(child).second) {
+        IndexedParentASTVisitor<MappingType>::AppendSubtree(child, tu_node,
+                                                            index, &parents_);
+      }
+      if (top_level != nullptr ||
+          parents_.count(node.getMemoizationData()) != 0) {
+        return;
+      }
+    }
+    ++index;
+  }
+}
+
 const IndexedParent* IndexedParentMap::GetIndexedParent(
     const clang::ast_type_traits::DynTypedNode& node) const {
   CHECK(node.getMemoizationData() != nullptr)
       << "Invariant broken: only nodes that support memoization may be "
          "used in the parent map.";
+  if (unit_ != nullptr) {
+    EnsureIndexed(node);
+  }
   const auto iter = parents_.find(node.getMemoizationData());
   if (iter == parents_.end()) {
     return nullptr;
@@ -148,9 +219,51 @@ const IndexedParent* IndexedParentMap::GetIndexedParent(
   return iter->second.getPointer();
 }
 
+std::shared_ptr<const IndexedParentMap::AncestorLink>
+IndexedParentMap::GetAncestorChain(
+    const clang::ast_type_traits::DynTypedNode& node) const {
+  {
+    const auto iter = ancestor_chains_.find(node.getMemoizationData());
+    if (iter != ancestor_chains_.end()) {
+      return iter->second;
+    }
+  }
+  // Walk toward the root until we reach it or a node with a memoized chain,
+  // then build and memoize links back down to `node`. Each link's tail is its
+  // parent's chain, so the whole path is shared rather than copied.
+  std::vector<std::pair<clang::ast_type_traits::DynTypedNode,
+                        const IndexedParent*>>
+      path;
+  clang::ast_type_traits::DynTypedNode current = node;
+  std::shared_ptr<const AncestorLink> chain;
+  for (;;) {
+    const IndexedParent* parent = GetIndexedParent(current);
+    path.emplace_back(current, parent);
+    if (parent == nullptr) {
+      break;
+    }
+    const auto iter =
+        ancestor_chains_.find(parent->parent.getMemoizationData());
+    if (iter != ancestor_chains_.end()) {
+      chain = iter->second;
+      break;
+    }
+    current = parent->parent;
+  }
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    chain = std::make_shared<AncestorLink>(
+        AncestorLink{it->first, it->second, std::move(chain)});
+    ancestor_chains_[it->first.getMemoizationData()] = chain;
+  }
+  return chain;
+}
+
 bool IndexedParentMap::DeclDominatesPrunableSubtree(
     const clang::Decl* decl) const {
   const auto node = clang::ast_type_traits::DynTypedNode::create(*decl);
+  if (unit_ != nullptr) {
+    EnsureIndexed(node);
+  }
   const auto iter = parents_.find(node.getMemoizationData());
   if (iter == parents_.end()) {
     return false;  // Safe default.
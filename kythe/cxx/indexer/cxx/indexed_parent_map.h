@@ -16,9 +16,12 @@
 #ifndef KYTHE_CXX_INDEXER_CXX_INDEXED_PARENT_MAP_H_
 #define KYTHE_CXX_INDEXER_CXX_INDEXED_PARENT_MAP_H_
 
+#include <memory>
+
 #include "clang/AST/ASTTypeTraits.h"
 #include "clang/AST/Decl.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/PointerIntPair.h"
 
 namespace kythe {
@@ -50,6 +53,15 @@ class IndexedParentMap {
   /// \brief Builds and returns the translation unit's indexed parent map.
   static IndexedParentMap Build(clang::TranslationUnitDecl* unit);
 
+  /// \brief Returns a map which fills in parent entries on demand, one
+  /// top-level decl subtree at a time, instead of walking the whole
+  /// translation unit up front.
+  ///
+  /// When claiming means most of the translation unit is never visited,
+  /// subtrees that are never asked about are never indexed. Lazy population
+  /// is not thread-safe; don't share a lazy map across worklist threads.
+  static IndexedParentMap BuildLazy(clang::TranslationUnitDecl* unit);
+
   // IndexedParentMap retains ownership of the contained IndexedParents and
   // thus is move-only.
   IndexedParentMap(IndexedParentMap&&) = default;
@@ -72,6 +84,30 @@ class IndexedParentMap {
     return GetIndexedParent(clang::ast_type_traits::DynTypedNode::create(node));
   }
 
+  /// \brief A link in a memoized, immutable chain of ancestors running from
+  /// a node to the translation unit root.
+  ///
+  /// A node's tail is exactly its parent's chain, so chains are shared:
+  /// memoizing a subtree costs one link per node, and each descendant holds
+  /// a pointer into the same immutable ancestor sequence.
+  struct AncestorLink {
+    /// The node this link describes.
+    clang::ast_type_traits::DynTypedNode node;
+    /// The node's IndexedParent, or null at the root.
+    const IndexedParent* parent;
+    /// The chain for `parent`'s node; null at the root.
+    std::shared_ptr<const AncestorLink> next;
+  };
+
+  /// \brief Returns the memoized ancestor chain beginning at `node`.
+  ///
+  /// The first call for a subtree walks to the root (or to the nearest
+  /// already-memoized ancestor) once; afterwards any node on the chain
+  /// resolves in a single lookup and each hop toward the root is a pointer
+  /// dereference instead of a map lookup.
+  std::shared_ptr<const AncestorLink> GetAncestorChain(
+      const clang::ast_type_traits::DynTypedNode& node) const;
+
   /// \return true if `Decl` and all of the nodes underneath it are prunable.
   ///
   /// A subtree is prunable if it's "the same" in all possible indexer runs.
@@ -100,8 +136,21 @@ class IndexedParentMap {
 
   explicit IndexedParentMap(MappingType parents)
       : parents_(std::move(parents)) {}
-
-  MappingType parents_;
+  explicit IndexedParentMap(clang::TranslationUnitDecl* unit) : unit_(unit) {}
+
+  /// \brief Indexes the top-level subtree containing `node` if it can be
+  /// determined (or the remaining unindexed subtrees if it cannot).
+  void EnsureIndexed(const clang::ast_type_traits::DynTypedNode& node) const;
+
+  mutable MappingType parents_;
+  /// If non-null, parent entries are populated lazily from this unit.
+  clang::TranslationUnitDecl* unit_ = nullptr;
+  /// Top-level decls whose subtrees have been indexed; used only when `unit_`
+  /// is non-null.
+  mutable llvm::DenseSet<const clang::Decl*> indexed_decls_;
+  /// Memoized ancestor chains, keyed like `parents_`.
+  mutable llvm::DenseMap<const void*, std::shared_ptr<const AncestorLink>>
+      ancestor_chains_;
 };
 
 }  // namespace kythe
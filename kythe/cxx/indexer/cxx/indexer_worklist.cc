@@ -16,10 +16,94 @@
 
 #include "kythe/cxx/indexer/cxx/indexer_worklist.h"
 
+#include <string>
+
+#include "absl/container/flat_hash_set.h"
 #include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
 #include "kythe/cxx/indexer/cxx/IndexerASTHooks.h"
 
 namespace kythe {
+namespace {
+
+/// \brief A slab pool recycling `IndexJob` storage.
+///
+/// Jobs are carved out of fixed-size slabs, so a burst of enqueues lays its
+/// jobs out contiguously in enqueue order, and freed jobs go on a free list
+/// for reuse instead of back to the heap. The pool is process-wide rather
+/// than per-worklist because jobs outlive their worklist (the visitor holds
+/// the running job, and file-comment jobs run after the worklist is
+/// destroyed); its high-water mark is the peak live job count.
+class JobSlabPool {
+ public:
+  static JobSlabPool& Instance() {
+    static auto* pool = new JobSlabPool;
+    return *pool;
+  }
+
+  void* Allocate() {
+    absl::MutexLock lock(&mutex_);
+    if (free_list_ != nullptr) {
+      FreeNode* node = free_list_;
+      free_list_ = node->next;
+      return node;
+    }
+    if (next_slot_ == kSlabJobs) {
+      slabs_.push_back(absl::make_unique<Slab>());
+      next_slot_ = 0;
+    }
+    return &slabs_.back()->storage[(next_slot_++) * sizeof(IndexJob)];
+  }
+
+  void Recycle(void* ptr) {
+    absl::MutexLock lock(&mutex_);
+    auto* node = static_cast<FreeNode*>(ptr);
+    node->next = free_list_;
+    free_list_ = node;
+  }
+
+ private:
+  /// Number of jobs per slab.
+  static constexpr size_t kSlabJobs = 256;
+
+  /// \brief Links recycled job slots into the free list, reusing their own
+  /// storage.
+  struct FreeNode {
+    FreeNode* next;
+  };
+  static_assert(sizeof(IndexJob) >= sizeof(FreeNode),
+                "job slots must be able to hold a free-list link");
+
+  struct Slab {
+    alignas(IndexJob) unsigned char storage[kSlabJobs * sizeof(IndexJob)];
+  };
+
+  absl::Mutex mutex_;
+  std::vector<std::unique_ptr<Slab>> slabs_;
+  /// Next unused slot in the most recent slab; kSlabJobs when full.
+  size_t next_slot_ = kSlabJobs;
+  /// Recycled slots ready for reuse.
+  FreeNode* free_list_ = nullptr;
+};
+
+}  // anonymous namespace
+
+void* IndexJob::operator new(size_t size) {
+  if (size != sizeof(IndexJob)) {
+    // Not a plain IndexJob; leave unusual requests to the heap.
+    return ::operator new(size);
+  }
+  return JobSlabPool::Instance().Allocate();
+}
+
+void IndexJob::operator delete(void* ptr, size_t size) {
+  if (size != sizeof(IndexJob)) {
+    ::operator delete(ptr);
+    return;
+  }
+  JobSlabPool::Instance().Recycle(ptr);
+}
+
 namespace {
 class IndexerWorklistImpl : public IndexerWorklist {
  public:
@@ -28,8 +112,20 @@ class IndexerWorklistImpl : public IndexerWorklist {
   void EnqueueJobForImplicitDecl(clang::Decl* decl,
                                  bool set_prune_incomplete_functions,
                                  const std::string& id) override {
-    worklist_.emplace_back(absl::make_unique<IndexJob>(
-        indexer_->getCurrentJob(), decl, set_prune_incomplete_functions, id));
+    if (!id.empty() && !enqueued_ids_.insert(id).second) {
+      // A job with the same semantic identity was already enqueued and
+      // covers this subtree; don't build another one.
+      return;
+    }
+    auto job = absl::make_unique<IndexJob>(
+        indexer_->getCurrentJob(), decl, set_prune_incomplete_functions, id);
+    if (id.empty()) {
+      worklist_.emplace_back(std::move(job));
+    } else {
+      // Traversal speculatively assumed ownership of this subtree; the claim
+      // is resolved in a batch before the job can run.
+      pending_claims_.emplace_back(std::move(job));
+    }
   }
 
   void EnqueueJob(std::unique_ptr<IndexJob> job) override {
@@ -37,17 +133,50 @@ class IndexerWorklistImpl : public IndexerWorklist {
   }
 
   bool DoWork() override {
+    ResolvePendingClaims();
     std::vector<std::unique_ptr<IndexJob>> jobs = std::move(worklist_);
     for (auto& job : jobs) {
       indexer_->RunJob(std::move(job));
     }
-    return !worklist_.empty();
+    return !worklist_.empty() || !pending_claims_.empty();
   }
 
  private:
+  /// \brief Resolves all pending implicit-node claims with one `claimBatch`
+  /// call, enqueueing the jobs whose claims were won and dropping the rest
+  /// (they never ran, so there is no output to retract).
+  void ResolvePendingClaims() {
+    if (pending_claims_.empty()) {
+      return;
+    }
+    std::vector<std::unique_ptr<IndexJob>> batch = std::move(pending_claims_);
+    pending_claims_.clear();
+    std::vector<std::pair<std::string, bool>> pairs;
+    pairs.reserve(batch.size());
+    // Enqueue-time deduplication guarantees each identifier appears at most
+    // once across all batches, which claimBatch (not being idempotent)
+    // requires.
+    for (const auto& job : batch) {
+      pairs.emplace_back(job->ClaimId, false);
+    }
+    indexer_->getGraphObserver().claimBatch(&pairs);
+    for (size_t i = 0; i < batch.size(); ++i) {
+      if (pairs[i].second) {
+        worklist_.emplace_back(std::move(batch[i]));
+      }
+    }
+  }
+
   /// \brief All queued work.
   std::vector<std::unique_ptr<IndexJob>> worklist_;
 
+  /// \brief Jobs waiting on a batched implicit-node claim.
+  std::vector<std::unique_ptr<IndexJob>> pending_claims_;
+
+  /// \brief Claim identifiers of implicit jobs ever enqueued; duplicates
+  /// are dropped at enqueue time.
+  absl::flat_hash_set<std::string> enqueued_ids_;
+
   /// \brief The indexer that will execute jobs.
   IndexerASTVisitor* indexer_;
 };
@@ -105,6 +105,13 @@ struct IndexJob {
 
   /// \brief The current stack of influence sets.
   std::vector<absl::flat_hash_set<const clang::Decl*>> InfluenceSets;
+
+  /// Jobs are allocated from a slab pool (see indexer_worklist.cc): TUs
+  /// with hundreds of thousands of implicit-decl jobs would otherwise hit
+  /// the general-purpose allocator once per job in each direction, and
+  /// slabs keep batches of pending jobs contiguous.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
 };
 
 class IndexerASTVisitor;
@@ -27,11 +27,15 @@
 #include "google/protobuf/stubs/common.h"
 #include "kythe/cxx/indexer/cxx/clang_range_finder.h"
 #include "kythe/cxx/indexer/cxx/clang_utils.h"
+#include "kythe/cxx/indexer/cxx/marked_source_cache.h"
 
 ABSL_FLAG(bool, reformat_marked_source, false,
           "Reformat source code used in MarkedSource (experimental).");
 ABSL_FLAG(bool, pretty_print_function_prototypes, false,
           "Synthesize new function prototypes (experimental).");
+ABSL_FLAG(int, marked_source_max_nodes, 0,
+          "If positive, limit each MarkedSource tree to this many nodes, "
+          "dropping the deepest trailing children (experimental).");
 
 namespace kythe {
 namespace {
@@ -71,6 +75,51 @@ llvm::StringRef GetTextRange(const clang::SourceManager& source_manager,
   return llvm::StringRef(begin, end - begin);
 }
 
+/// \brief A 64-bit FNV-1a hash builder with length-framed fields so field
+/// boundaries can't alias.
+///
+/// The persistent marked-source cache needs fingerprints that are stable
+/// across processes and machines, which neither llvm nor absl hashing
+/// guarantees.
+class StableFingerprint {
+ public:
+  void Append(llvm::StringRef data) {
+    AppendInteger(data.size());
+    for (char byte : data) {
+      Mix(static_cast<unsigned char>(byte));
+    }
+  }
+
+  void AppendInteger(uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+      Mix(static_cast<unsigned char>(value >> (i * 8)));
+    }
+  }
+
+  uint64_t value() const { return hash_; }
+
+ private:
+  void Mix(unsigned char byte) {
+    hash_ = (hash_ ^ byte) * 0x100000001b3ull;
+  }
+
+  uint64_t hash_ = 0xcbf29ce484222325ull;
+};
+
+/// \brief Drops (pre-order) children of `node` in excess of `*remaining`
+/// nodes. Subtree-level fields like pre_text are preserved, so truncated
+/// signatures degrade to their outer structure rather than disappearing.
+void ApplyNodeBudget(MarkedSource* node, int* remaining) {
+  for (int i = 0; i < node->child_size(); ++i) {
+    if (*remaining <= 0) {
+      node->mutable_child()->DeleteSubrange(i, node->child_size() - i);
+      return;
+    }
+    --*remaining;
+    ApplyNodeBudget(node->mutable_child(i), remaining);
+  }
+}
+
 /// \brief The filename to use to refer to code being formatted.
 constexpr char kReplacementFile[] = "x.cc";
 
@@ -526,6 +575,9 @@ class DeclAnnotator : public clang::DeclVisitor<DeclAnnotator> {
 }  // anonymous namespace
 
 bool MarkedSourceGenerator::WillGenerateMarkedSource() const {
+  if (!cache_->enabled()) {
+    return false;
+  }
   // Be conservative in which kinds of marked source we'll generate.
   // We can enable more AST node flavors as necessary.
   if (decl_->isImplicit() || implicit_) {
@@ -707,81 +759,97 @@ bool MarkedSourceGenerator::ReplaceMarkedSourceWithQualifiedName(
     // Avoid creating an unnecessary BOX if there are no context nodes.
     auto* parents = node->add_child();
     self = node->add_child();
-    parents->set_kind(MarkedSource::CONTEXT);
-    parents->set_add_final_list_token(true);
-    parents->set_post_child_text("::");
-    auto policy = clang::PrintingPolicy(cache_->lang_options());
-    for (const auto* decl_context : reverse(contexts)) {
-      auto* parent = parents->add_child();
-      if (const auto* spec =
-              llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(
-                  decl_context)) {
-        parent->set_kind(MarkedSource::BOX);
-        auto* class_name = parent->add_child();
-        class_name->set_kind(MarkedSource::IDENTIFIER);
-        std::string pre_text;
-        {
-          llvm::raw_string_ostream stream(pre_text);
-          stream << spec->getName();
-        }
-        *class_name->mutable_pre_text() = pre_text;
-        ReplaceMarkedSourceWithTemplateArgumentList(parent->add_child(), spec);
-      } else {
-        parent->set_kind(MarkedSource::IDENTIFIER);
-        std::string pre_text;
-        {
-          llvm::raw_string_ostream stream(pre_text);
-          if (const auto* namespace_decl =
-                  llvm::dyn_cast<clang::NamespaceDecl>(decl_context)) {
-            if (namespace_decl->isAnonymousNamespace()) {
-              stream << (policy.MSVCFormatting ? "`anonymous namespace\'"
-                                               : "(anonymous namespace)");
-            } else {
-              stream << *namespace_decl;
-            }
-          } else if (const auto* record_decl =
-                         llvm::dyn_cast<clang::RecordDecl>(decl_context)) {
-            if (!record_decl->getIdentifier())
-              stream << "(anonymous " << record_decl->getKindName() << ')';
-            else
-              stream << *record_decl;
-          } else if (const auto* function_decl =
-                         llvm::dyn_cast<clang::FunctionDecl>(decl_context)) {
-            stream << *function_decl;
-          } else if (const auto* enum_decl =
-                         llvm::dyn_cast<clang::EnumDecl>(decl_context)) {
-            stream << *enum_decl;
-          } else if (const auto* cat_decl =
-                         llvm::dyn_cast<clang::ObjCCategoryDecl>(
-                             decl_context)) {
-            // Print categories methods as
-            // 'InterfaceName(CategoryName)::Method'.
-            if (const auto* i = cat_decl->getClassInterface()) {
+    // Decls sharing a decl context share its rendering; only build the
+    // CONTEXT subtree for a scope the first time we see it.
+    auto* context_cache = cache_->qualified_context_cache();
+    auto iter = context_cache->find(contexts.front());
+    if (iter == context_cache->end()) {
+      MarkedSource context;
+      BuildQualifiedNameContext(&context, contexts);
+      iter = context_cache->try_emplace(contexts.front(), std::move(context))
+                 .first;
+    }
+    *parents = iter->second;
+  }
+  self->set_kind(MarkedSource::IDENTIFIER);
+  self->set_pre_text(GetDeclName(cache_->lang_options(), decl_));
+  return true;
+}
+
+void MarkedSourceGenerator::BuildQualifiedNameContext(
+    MarkedSource* parents,
+    const llvm::SmallVectorImpl<const clang::DeclContext*>& contexts) {
+  parents->set_kind(MarkedSource::CONTEXT);
+  parents->set_add_final_list_token(true);
+  parents->set_post_child_text("::");
+  auto policy = clang::PrintingPolicy(cache_->lang_options());
+  for (const auto* decl_context : reverse(contexts)) {
+    auto* parent = parents->add_child();
+    if (const auto* spec =
+            llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(
+                decl_context)) {
+      parent->set_kind(MarkedSource::BOX);
+      auto* class_name = parent->add_child();
+      class_name->set_kind(MarkedSource::IDENTIFIER);
+      std::string pre_text;
+      {
+        llvm::raw_string_ostream stream(pre_text);
+        stream << spec->getName();
+      }
+      *class_name->mutable_pre_text() = pre_text;
+      ReplaceMarkedSourceWithTemplateArgumentList(parent->add_child(), spec);
+    } else {
+      parent->set_kind(MarkedSource::IDENTIFIER);
+      std::string pre_text;
+      {
+        llvm::raw_string_ostream stream(pre_text);
+        if (const auto* namespace_decl =
+                llvm::dyn_cast<clang::NamespaceDecl>(decl_context)) {
+          if (namespace_decl->isAnonymousNamespace()) {
+            stream << (policy.MSVCFormatting ? "`anonymous namespace\'"
+                                             : "(anonymous namespace)");
+          } else {
+            stream << *namespace_decl;
+          }
+        } else if (const auto* record_decl =
+                       llvm::dyn_cast<clang::RecordDecl>(decl_context)) {
+          if (!record_decl->getIdentifier())
+            stream << "(anonymous " << record_decl->getKindName() << ')';
+          else
+            stream << *record_decl;
+        } else if (const auto* function_decl =
+                       llvm::dyn_cast<clang::FunctionDecl>(decl_context)) {
+          stream << *function_decl;
+        } else if (const auto* enum_decl =
+                       llvm::dyn_cast<clang::EnumDecl>(decl_context)) {
+          stream << *enum_decl;
+        } else if (const auto* cat_decl =
+                       llvm::dyn_cast<clang::ObjCCategoryDecl>(
+                           decl_context)) {
+          // Print categories methods as
+          // 'InterfaceName(CategoryName)::Method'.
+          if (const auto* i = cat_decl->getClassInterface()) {
+            stream << i->getName();
+          }
+          stream << "(" << cat_decl->getName() << ")";
+        } else if (const auto* cat_impl =
+                       llvm::dyn_cast<clang::ObjCCategoryImplDecl>(
+                           decl_context)) {
+          // Print categories methods as
+          // 'InterfaceName(CategoryName)::Method'.
+          if (const auto* decl = cat_impl->getCategoryDecl()) {
+            if (const auto* i = decl->getClassInterface()) {
               stream << i->getName();
             }
-            stream << "(" << cat_decl->getName() << ")";
-          } else if (const auto* cat_impl =
-                         llvm::dyn_cast<clang::ObjCCategoryImplDecl>(
-                             decl_context)) {
-            // Print categories methods as
-            // 'InterfaceName(CategoryName)::Method'.
-            if (const auto* decl = cat_impl->getCategoryDecl()) {
-              if (const auto* i = decl->getClassInterface()) {
-                stream << i->getName();
-              }
-            }
-            stream << "(" << cat_impl->getName() << ")";
-          } else {
-            stream << *llvm::cast<clang::NamedDecl>(decl_context);
           }
+          stream << "(" << cat_impl->getName() << ")";
+        } else {
+          stream << *llvm::cast<clang::NamedDecl>(decl_context);
         }
-        *parent->mutable_pre_text() = pre_text;
       }
+      *parent->mutable_pre_text() = pre_text;
     }
   }
-  self->set_kind(MarkedSource::IDENTIFIER);
-  self->set_pre_text(GetDeclName(cache_->lang_options(), decl_));
-  return true;
 }
 
 absl::optional<MarkedSource>
@@ -854,6 +922,31 @@ MarkedSource MarkedSourceGenerator::GenerateMarkedSourceForNamedDecl() {
   return out;
 }
 
+uint64_t MarkedSourceGenerator::ComputeCacheFingerprint(
+    const GraphObserver::NodeId& decl_id) {
+  StableFingerprint fingerprint;
+  // The node identity already folds in the decl's semantic hash, so two
+  // decls share a fingerprint only when they'd render identically--provided
+  // the source text and the flags that steer rendering also agree.
+  fingerprint.Append(decl_id.getRawIdentity());
+  auto start_loc = decl_->getSourceRange().getBegin();
+  if (start_loc.isMacroID()) {
+    start_loc = cache_->source_manager().getExpansionLoc(start_loc);
+  }
+  auto end_loc = end_loc_.isMacroID()
+                     ? cache_->source_manager().getExpansionLoc(end_loc_)
+                     : end_loc_;
+  fingerprint.Append(GetTextRange(cache_->source_manager(),
+                                  clang::SourceRange(start_loc, end_loc)));
+  fingerprint.AppendInteger(render_variant_);
+  fingerprint.AppendInteger(absl::GetFlag(FLAGS_reformat_marked_source) ? 1
+                                                                        : 0);
+  fingerprint.AppendInteger(
+      absl::GetFlag(FLAGS_pretty_print_function_prototypes) ? 1 : 0);
+  fingerprint.AppendInteger(absl::GetFlag(FLAGS_marked_source_max_nodes));
+  return fingerprint.value();
+}
+
 absl::optional<MarkedSource> MarkedSourceGenerator::GenerateMarkedSource(
     const GraphObserver::NodeId& decl_id) {
   // MarkedSource generation is expensive. If we're not going to write out the
@@ -862,6 +955,50 @@ absl::optional<MarkedSource> MarkedSourceGenerator::GenerateMarkedSource(
   if (!WillGenerateMarkedSource()) {
     return absl::nullopt;
   }
+  // Redeclarations and template instantiations sharing a canonical decl
+  // render the same signature, so completed renders are cached per
+  // (canonical decl, render variant) for the lifetime of the AST.
+  auto key = std::make_pair(
+      static_cast<const clang::Decl*>(decl_->getCanonicalDecl()),
+      render_variant_);
+  auto* render_cache = cache_->completed_marked_source();
+  auto cached = render_cache->find(key);
+  if (cached != render_cache->end()) {
+    return cached->second;
+  }
+  // With --marked_source_cache, identical decls seen in other compilation
+  // units or earlier runs can be served without rendering at all.
+  PersistentMarkedSourceCache* persistent =
+      PersistentMarkedSourceCache::Default();
+  uint64_t fingerprint = 0;
+  if (persistent != nullptr) {
+    fingerprint = ComputeCacheFingerprint(decl_id);
+    MarkedSource stored;
+    if (persistent->Lookup(fingerprint, &stored)) {
+      absl::optional<MarkedSource> result = std::move(stored);
+      (*render_cache)[key] = result;
+      return result;
+    }
+  }
+  absl::optional<MarkedSource> result = GenerateMarkedSourceImpl(decl_id);
+  int budget = absl::GetFlag(FLAGS_marked_source_max_nodes);
+  if (result.has_value() && budget > 0) {
+    --budget;  // The root costs one node.
+    ApplyNodeBudget(&*result, &budget);
+  }
+  // Only persist completed (post-budget) renders; failures stay cheap to
+  // retry and may succeed under a different AST.
+  if (persistent != nullptr && result.has_value()) {
+    persistent->Insert(fingerprint, *result);
+  }
+  // Generation can invalidate iterators into the cache (qualified-name
+  // rendering recurses), so insert only after it completes.
+  (*render_cache)[key] = result;
+  return result;
+}
+
+absl::optional<MarkedSource> MarkedSourceGenerator::GenerateMarkedSourceImpl(
+    const GraphObserver::NodeId& decl_id) {
   if (llvm::isa<clang::VarDecl>(decl_) || llvm::isa<clang::FieldDecl>(decl_)) {
     return GenerateMarkedSourceUsingSource(decl_id);
   } else if (const auto* func = llvm::dyn_cast<clang::FunctionDecl>(decl_)) {
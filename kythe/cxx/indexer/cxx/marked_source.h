@@ -17,6 +17,9 @@
 #ifndef KYTHE_CXX_INDEXER_CXX_MARKED_SOURCE_H_
 #define KYTHE_CXX_INDEXER_CXX_MARKED_SOURCE_H_
 
+#include <cstdint>
+#include <utility>
+
 #include "absl/types/optional.h"
 #include "clang/AST/Decl.h"
 #include "clang/Basic/SourceManager.h"
@@ -45,6 +48,11 @@ class MarkedSourceGenerator {
   /// Sets the range that covers the decl's (unqualified) name.
   void set_name_range(const clang::SourceRange& range) { name_range_ = range; }
 
+  /// Sets the render variant used as part of the cache key. Renders of the
+  /// same canonical decl under different variants (e.g. instantiation-specific
+  /// template argument substitutions) are cached separately.
+  void set_render_variant(unsigned variant) { render_variant_ = variant; }
+
   /// \return true if GenerateMarkedSource will do work.
   /// \note This does not guarantee that GenerateMarkedSource != None.
   bool WillGenerateMarkedSource() const;
@@ -60,6 +68,15 @@ class MarkedSourceGenerator {
   MarkedSourceGenerator(MarkedSourceCache* cache, const clang::NamedDecl* decl)
       : cache_(cache), decl_(decl) {}
 
+  /// Generate marked source (without applying any node budget).
+  absl::optional<MarkedSource> GenerateMarkedSourceImpl(
+      const GraphObserver::NodeId& decl_id);
+
+  /// \brief Computes the persistent-cache fingerprint for this render: a
+  /// stable hash of the decl's node identity, its source text, the render
+  /// variant, and the flags that change rendering.
+  uint64_t ComputeCacheFingerprint(const GraphObserver::NodeId& decl_id);
+
   /// Attempt to generate marked source using the original source code.
   absl::optional<MarkedSource> GenerateMarkedSourceUsingSource(
       const GraphObserver::NodeId& decl_id);
@@ -100,6 +117,12 @@ class MarkedSourceGenerator {
   /// \return false on failure
   bool ReplaceMarkedSourceWithQualifiedName(MarkedSource* marked_source_node);
 
+  /// \brief Fill `parents` with a CONTEXT node for the enclosing `contexts`
+  /// (ordered from innermost to outermost).
+  void BuildQualifiedNameContext(
+      MarkedSource* parents,
+      const llvm::SmallVectorImpl<const clang::DeclContext*>& contexts);
+
   /// The cache to consult (and to use to get at ::Sema and friends).
   MarkedSourceCache* cache_;
 
@@ -114,6 +137,9 @@ class MarkedSourceGenerator {
 
   /// The decl in question is implicit.
   bool implicit_ = false;
+
+  /// The render variant; see `set_render_variant`.
+  unsigned render_variant_ = 0;
 };
 
 /// \brief Caches marked source generation information.
@@ -121,11 +147,15 @@ class MarkedSourceGenerator {
 /// Cached values are tied to a particular AST and `Sema` instance.
 class MarkedSourceCache {
  public:
-  MarkedSourceCache(clang::Sema* sema, GraphObserver* graph_observer)
+  /// \param enabled If false, generators returned by `Generate` produce no
+  /// marked source (and skip the work of computing it).
+  MarkedSourceCache(clang::Sema* sema, GraphObserver* graph_observer,
+                    bool enabled = true)
       : source_manager_(*graph_observer->getSourceManager()),
         lang_options_(*graph_observer->getLangOptions()),
         sema_(sema),
-        observer_(graph_observer) {}
+        observer_(graph_observer),
+        enabled_(enabled) {}
 
   /// \brief Return a new `MarkedSourceGenerator` for the given decl.
   MarkedSourceGenerator Generate(const clang::NamedDecl* decl) {
@@ -136,10 +166,20 @@ class MarkedSourceCache {
   const clang::LangOptions& lang_options() const { return lang_options_; }
   clang::Sema* sema() { return sema_; }
   GraphObserver* observer() { return observer_; }
+  bool enabled() const { return enabled_; }
   llvm::DenseMap<const clang::ClassTemplateSpecializationDecl*, unsigned>*
   first_default_template_argument() {
     return &first_default_template_argument_;
   }
+  llvm::DenseMap<const clang::DeclContext*, MarkedSource>*
+  qualified_context_cache() {
+    return &qualified_context_cache_;
+  }
+  llvm::DenseMap<std::pair<const clang::Decl*, unsigned>,
+                 absl::optional<MarkedSource>>*
+  completed_marked_source() {
+    return &completed_marked_source_;
+  }
 
  private:
   const clang::SourceManager& source_manager_;
@@ -147,10 +187,26 @@ class MarkedSourceCache {
   clang::Sema* sema_;
   GraphObserver* observer_;
 
+  /// Whether marked source should be generated at all.
+  bool enabled_;
+
   /// Maps from class template specializations to the first of that
   /// specialization's arguments that is default.
   llvm::DenseMap<const clang::ClassTemplateSpecializationDecl*, unsigned>
       first_default_template_argument_;
+
+  /// Maps from a decl context to the prebuilt CONTEXT subtree naming it, so
+  /// decls sharing an enclosing scope (every member of a namespace or class)
+  /// share one qualified-name rendering instead of rebuilding it apiece.
+  llvm::DenseMap<const clang::DeclContext*, MarkedSource>
+      qualified_context_cache_;
+
+  /// Maps from (canonical decl, render variant) to the completed (budgeted)
+  /// marked source for it, or None if generation failed. Redeclarations and
+  /// template instantiations sharing a canonical decl collapse to a lookup.
+  llvm::DenseMap<std::pair<const clang::Decl*, unsigned>,
+                 absl::optional<MarkedSource>>
+      completed_marked_source_;
 };
 }  // namespace kythe
 
@@ -0,0 +1,237 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kythe/cxx/indexer/cxx/marked_source_cache.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+
+ABSL_FLAG(std::string, marked_source_cache, "",
+          "If nonempty, a file caching rendered MarkedSource across runs, "
+          "keyed by a fingerprint of each decl's identity and source text. "
+          "Loaded when it exists; renders produced during this run are "
+          "merged back in at exit (experimental).");
+ABSL_FLAG(int64_t, marked_source_cache_max_bytes, 64 * 1024 * 1024,
+          "Size budget for --marked_source_cache. This run's renders are "
+          "kept first, then previously stored entries until the budget is "
+          "reached.");
+
+namespace kythe {
+namespace {
+
+constexpr char kCacheMagic[8] = {'K', 'y', 'M', 'k', 'S', 'r', 'C', '1'};
+constexpr uint32_t kEndianCheck = 0x01020304;
+
+/// \brief The fixed-size header at the start of a cache file. Record and
+/// value regions follow it directly.
+struct CacheHeader {
+  char magic[8];
+  /// Written as kEndianCheck; a mismatch on load means the file was written
+  /// on a machine with different byte order.
+  uint32_t endian;
+  uint32_t reserved;
+  uint64_t record_count;
+  uint64_t value_bytes;
+};
+
+}  // namespace
+
+PersistentMarkedSourceCache* PersistentMarkedSourceCache::Default() {
+  // A function-local static so the cache is flushed (via its destructor)
+  // when the process exits normally.
+  static std::unique_ptr<PersistentMarkedSourceCache> cache = [] {
+    const std::string path = absl::GetFlag(FLAGS_marked_source_cache);
+    if (path.empty()) {
+      return std::unique_ptr<PersistentMarkedSourceCache>();
+    }
+    return std::make_unique<PersistentMarkedSourceCache>(
+        path, std::max<int64_t>(
+                  0, absl::GetFlag(FLAGS_marked_source_cache_max_bytes)));
+  }();
+  return cache.get();
+}
+
+PersistentMarkedSourceCache::PersistentMarkedSourceCache(std::string path,
+                                                         uint64_t max_bytes)
+    : path_(std::move(path)), max_bytes_(max_bytes) {
+  auto file = MappedFile::Open(path_);
+  if (!file) {
+    // A missing (or unreadable) file just means a cold cache.
+    return;
+  }
+  // Validate the file completely before adopting it; a corrupt or truncated
+  // cache degrades to a cold one rather than failing the run.
+  absl::string_view content = file->content();
+  CacheHeader header;
+  if (content.size() < sizeof(header)) {
+    return;
+  }
+  memcpy(&header, content.data(), sizeof(header));
+  if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+      header.endian != kEndianCheck) {
+    return;
+  }
+  const uint64_t available = content.size() - sizeof(header);
+  if (header.record_count > available / sizeof(MarkedSourceCacheRecord)) {
+    return;
+  }
+  const uint64_t records_bytes =
+      header.record_count * sizeof(MarkedSourceCacheRecord);
+  if (header.value_bytes > available - records_bytes) {
+    return;
+  }
+  const auto* records = reinterpret_cast<const MarkedSourceCacheRecord*>(
+      content.data() + sizeof(header));
+  for (uint64_t i = 0; i < header.record_count; ++i) {
+    const MarkedSourceCacheRecord& record = records[i];
+    if (record.value_offset > header.value_bytes ||
+        record.value_length > header.value_bytes - record.value_offset) {
+      return;
+    }
+    // Lookups binary-search on fingerprint, so the table must be strictly
+    // increasing.
+    if (i > 0 && record.fingerprint <= records[i - 1].fingerprint) {
+      return;
+    }
+  }
+  file_ = std::make_unique<MappedFile>(*std::move(file));
+  records_ = reinterpret_cast<const MarkedSourceCacheRecord*>(
+      file_->content().data() + sizeof(header));
+  record_count_ = header.record_count;
+  values_ = file_->content().data() + sizeof(header) + records_bytes;
+}
+
+PersistentMarkedSourceCache::~PersistentMarkedSourceCache() {
+  // Write failures degrade to uncached behavior on the next run.
+  if (dirty_ && !Flush()) {
+    LOG(WARNING) << "Could not write marked-source cache " << path_;
+  }
+}
+
+bool PersistentMarkedSourceCache::Lookup(
+    uint64_t fingerprint, proto::common::MarkedSource* out) const {
+  auto added = added_.find(fingerprint);
+  if (added != added_.end()) {
+    return out->ParseFromString(added->second);
+  }
+  if (record_count_ == 0) {
+    return false;
+  }
+  const MarkedSourceCacheRecord* end = records_ + record_count_;
+  const MarkedSourceCacheRecord* it = std::lower_bound(
+      records_, end, fingerprint,
+      [](const MarkedSourceCacheRecord& record, uint64_t fingerprint) {
+        return record.fingerprint < fingerprint;
+      });
+  if (it == end || it->fingerprint != fingerprint) {
+    return false;
+  }
+  return out->ParseFromArray(values_ + it->value_offset, it->value_length);
+}
+
+void PersistentMarkedSourceCache::Insert(
+    uint64_t fingerprint, const proto::common::MarkedSource& value) {
+  std::string bytes;
+  if (!value.SerializeToString(&bytes) ||
+      bytes.size() > std::numeric_limits<uint32_t>::max()) {
+    return;
+  }
+  if (added_.emplace(fingerprint, std::move(bytes)).second) {
+    dirty_ = true;
+  }
+}
+
+bool PersistentMarkedSourceCache::Flush() {
+  // Select entries within the byte budget: this run's renders first (they're
+  // the freshest), then stored entries that weren't re-rendered.
+  std::vector<std::pair<uint64_t, absl::string_view>> entries;
+  entries.reserve(added_.size() + record_count_);
+  uint64_t bytes = sizeof(CacheHeader);
+  auto try_add = [&](uint64_t fingerprint, absl::string_view value) {
+    const uint64_t cost = sizeof(MarkedSourceCacheRecord) + value.size();
+    if (bytes + cost > max_bytes_) {
+      return;
+    }
+    entries.emplace_back(fingerprint, value);
+    bytes += cost;
+  };
+  for (const auto& added : added_) {
+    try_add(added.first, added.second);
+  }
+  for (size_t i = 0; i < record_count_; ++i) {
+    const MarkedSourceCacheRecord& record = records_[i];
+    if (added_.contains(record.fingerprint)) {
+      continue;
+    }
+    try_add(record.fingerprint,
+            absl::string_view(values_ + record.value_offset,
+                              record.value_length));
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const std::pair<uint64_t, absl::string_view>& lhs,
+               const std::pair<uint64_t, absl::string_view>& rhs) {
+              return lhs.first < rhs.first;
+            });
+
+  // Write-then-rename so concurrent runs never observe a torn file. (When
+  // several runs flush at once the last rename wins; the others' renders
+  // are regenerated next time.)
+  std::string tmp_path = absl::StrCat(path_, ".", getpid(), ".tmp");
+  FILE* out = fopen(tmp_path.c_str(), "wb");
+  if (out == nullptr) {
+    return false;
+  }
+  auto write_all = [&](const void* data, size_t size) {
+    return fwrite(data, 1, size, out) == size;
+  };
+  CacheHeader header = {};
+  memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+  header.endian = kEndianCheck;
+  header.record_count = entries.size();
+  for (const auto& entry : entries) {
+    header.value_bytes += entry.second.size();
+  }
+  bool ok = write_all(&header, sizeof(header));
+  uint32_t offset = 0;
+  for (const auto& entry : entries) {
+    MarkedSourceCacheRecord record = {
+        entry.first, offset, static_cast<uint32_t>(entry.second.size())};
+    ok = ok && write_all(&record, sizeof(record));
+    offset += entry.second.size();
+  }
+  for (const auto& entry : entries) {
+    ok = ok && write_all(entry.second.data(), entry.second.size());
+  }
+  ok = (fclose(out) == 0) && ok;
+  if (!ok || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  dirty_ = false;
+  return true;
+}
+
+}  // namespace kythe
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_INDEXER_CXX_MARKED_SOURCE_CACHE_H_
+#define KYTHE_CXX_INDEXER_CXX_MARKED_SOURCE_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "kythe/cxx/common/file_utils.h"
+#include "kythe/proto/common.pb.h"
+
+namespace kythe {
+
+/// \brief One fixed-size record in a persistent marked-source cache file,
+/// pointing at a serialized MarkedSource in the file's value region.
+struct MarkedSourceCacheRecord {
+  uint64_t fingerprint;   ///< The render's fingerprint.
+  uint32_t value_offset;  ///< Byte offset of the value in the value region.
+  uint32_t value_length;  ///< Byte length of the value.
+};
+
+/// \brief A persistent cache of rendered MarkedSource trees keyed by
+/// fingerprint, shared across compilation units and indexer runs.
+///
+/// The cache file holds a header, a fingerprint-sorted record table, and a
+/// region of serialized MarkedSource values. It is memory-mapped on load, so
+/// a lookup binary-searches the mapping and parses a proto only on a hit.
+/// Renders produced during a run are merged back into the file by `Flush`,
+/// which keeps it under `max_bytes` by preferring this run's renders and
+/// then previously stored entries. A missing or corrupt file starts empty.
+///
+/// PersistentMarkedSourceCache is not thread-safe.
+class PersistentMarkedSourceCache {
+ public:
+  /// \brief Returns the process-wide cache configured by
+  /// --marked_source_cache, or null when the flag is empty. The returned
+  /// cache is flushed when the process exits normally.
+  static PersistentMarkedSourceCache* Default();
+
+  /// \param path The cache file; loaded when it exists and rewritten by
+  /// `Flush`.
+  /// \param max_bytes Size budget for the written file.
+  PersistentMarkedSourceCache(std::string path, uint64_t max_bytes);
+  ~PersistentMarkedSourceCache();
+
+  /// \brief Looks up `fingerprint`, checking renders inserted this run
+  /// before the mapped file.
+  /// \return true and fills `out` on a hit.
+  bool Lookup(uint64_t fingerprint, proto::common::MarkedSource* out) const;
+
+  /// \brief Records `value` for `fingerprint`. It is visible to `Lookup`
+  /// immediately and persisted by `Flush`; the first insertion for a
+  /// fingerprint wins.
+  void Insert(uint64_t fingerprint, const proto::common::MarkedSource& value);
+
+  /// \brief Writes the merged cache back to its file (write-then-rename, so
+  /// concurrent readers never observe a torn file).
+  /// \return false if the file could not be written.
+  bool Flush();
+
+ private:
+  /// The cache file's path.
+  std::string path_;
+  /// \sa Flush
+  uint64_t max_bytes_;
+  /// The mapped cache file, or null when none was loaded.
+  std::unique_ptr<MappedFile> file_;
+  /// Records in the mapped file, sorted by fingerprint.
+  const MarkedSourceCacheRecord* records_ = nullptr;
+  size_t record_count_ = 0;
+  /// The mapped file's value region.
+  const char* values_ = nullptr;
+  /// Serialized renders inserted this run, keyed by fingerprint.
+  absl::flat_hash_map<uint64_t, std::string> added_;
+  /// Whether `Flush` has anything new to write.
+  bool dirty_ = false;
+};
+
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_INDEXER_CXX_MARKED_SOURCE_CACHE_H_
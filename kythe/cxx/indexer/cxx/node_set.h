@@ -27,6 +27,10 @@ namespace kythe {
 // and a particular declaration when constructing references in
 // accordance with:
 // https://kythe.io/docs/schema#_references_to_definitions_and_declarations_of_types
+//
+// NodeIds are interned pointer pairs and both slots are stored inline, so
+// NodeSet is cheap to copy and never allocates; it is consulted on every node
+// emission and stored by value in per-type memo tables.
 class NodeSet {
   using Claimability = GraphObserver::Claimability;
   using NodeId = GraphObserver::NodeId;
@@ -17,10 +17,12 @@
 #define KYTHE_CXX_INDEXER_CXX_RECURSIVE_TYPE_VISITOR_H_
 
 #include <algorithm>
+#include <utility>
 
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/AST/Type.h"
 #include "clang/AST/TypeLoc.h"
+#include "llvm/ADT/SmallVector.h"
 
 namespace kythe {
 
@@ -69,9 +71,15 @@ class RecursiveTypeVisitor : public clang::RecursiveASTVisitor<Derived> {
     return Base::TraverseTypeLoc(TL);
   }
 
-  /// Recursively vist a type-as-written with location in parallel
-  /// with the derived type, by dispatching to Traverse*TypePair()
-  /// based on the TypeLoc argument's getTypeClass() property.
+  /// Visit a type-as-written with location in parallel with the derived
+  /// type, by dispatching to Traverse*TypePair() based on the TypeLoc
+  /// argument's getTypeClass() property.
+  ///
+  /// Traversal is driven by an explicit worklist rather than the call
+  /// stack: the outermost call drains pairs in depth-first preorder, and
+  /// reentrant calls (from child traversals such as template arguments)
+  /// enqueue their pair and return. Pathologically nested types (thousands
+  /// of template levels) therefore traverse in bounded stack.
   ///
   /// \returns false if the visitation was terminated early,
   /// true otherwise (including when the argument is a Null type location).
@@ -106,6 +114,17 @@ class RecursiveTypeVisitor : public clang::RecursiveASTVisitor<Derived> {
     return getDerived().Visit##CLASS##TypeLoc(TL);                \
   }
 #include "clang/AST/TypeNodes.inc"
+
+ private:
+  /// Dispatches a single pair to the Traverse*TypePair() member for its
+  /// type class, without touching the worklist.
+  bool DispatchTypePair(clang::TypeLoc TL, clang::QualType T);
+
+  /// Pending (type-as-written, resolved type) pairs, innermost last.
+  llvm::SmallVector<std::pair<clang::TypeLoc, clang::QualType>, 16>
+      type_pair_worklist_;
+  /// Whether a TraverseTypePair drain loop is active on this visitor.
+  bool draining_type_pairs_ = false;
 };
 
 template <typename Derived>
@@ -115,7 +134,35 @@ bool RecursiveTypeVisitor<Derived>::TraverseTypePair(clang::TypeLoc TL,
   if (T.isNull()) {
     T = TL.getType();
   }
+  if (draining_type_pairs_) {
+    // Reentrant call from a child traversal: hand the pair to the active
+    // drain loop below instead of deepening the call stack.
+    type_pair_worklist_.emplace_back(TL, T);
+    return true;
+  }
+  draining_type_pairs_ = true;
+  type_pair_worklist_.emplace_back(TL, T);
+  bool result = true;
+  while (!type_pair_worklist_.empty()) {
+    auto [CurTL, CurT] = type_pair_worklist_.pop_back_val();
+    size_t mark = type_pair_worklist_.size();
+    if (!DispatchTypePair(CurTL, CurT)) {
+      result = false;
+      break;
+    }
+    // The dispatch enqueued this pair's children in source order; reverse
+    // them so LIFO draining preserves depth-first preorder.
+    std::reverse(type_pair_worklist_.begin() + mark,
+                 type_pair_worklist_.end());
+  }
+  type_pair_worklist_.clear();
+  draining_type_pairs_ = false;
+  return result;
+}
 
+template <typename Derived>
+bool RecursiveTypeVisitor<Derived>::DispatchTypePair(clang::TypeLoc TL,
+                                                     clang::QualType T) {
   switch (TL.getTypeLocClass()) {
     case clang::TypeLoc::Qualified:
       return getDerived().TraverseQualifiedTypePair(
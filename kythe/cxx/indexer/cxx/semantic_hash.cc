@@ -22,7 +22,13 @@
 namespace kythe {
 
 uint64_t SemanticHash::HashTemplateDeclish(const clang::Decl* decl) const {
-  return std::hash<std::string>()(decl_string_(decl));
+  // Memoized: rendering the decl string walks the whole name path and any
+  // template arguments, and claim probes rehash the same templates often.
+  auto it = template_decl_cache_.find(decl);
+  if (it != template_decl_cache_.end()) return it->second;
+  uint64_t hash = std::hash<std::string>()(decl_string_(decl));
+  template_decl_cache_[decl] = hash;
+  return hash;
 }
 
 uint64_t SemanticHash::Hash(const clang::TemplateName& name) const {
@@ -95,7 +101,14 @@ uint64_t SemanticHash::Hash(const clang::TemplateArgument& arg) const {
 }
 
 uint64_t SemanticHash::Hash(const clang::QualType& type) const {
-  return std::hash<std::string>()(type.getCanonicalType().getAsString());
+  // Canonical types are uniqued by the ASTContext, so their opaque pointers
+  // are stable memo keys and spare us reprinting the type per hash.
+  const clang::QualType canonical = type.getCanonicalType();
+  auto it = type_cache_.find(canonical.getAsOpaquePtr());
+  if (it != type_cache_.end()) return it->second;
+  uint64_t hash = std::hash<std::string>()(canonical.getAsString());
+  type_cache_[canonical.getAsOpaquePtr()] = hash;
+  return hash;
 }
 
 uint64_t SemanticHash::Hash(const clang::EnumDecl* decl) const {
@@ -124,6 +137,11 @@ uint64_t SemanticHash::Hash(const clang::TemplateArgumentList* arg_list) const {
 }
 
 uint64_t SemanticHash::Hash(const clang::RecordDecl* decl) const {
+  // Memoize record hashes: every claim probe for an implicit member rehashes
+  // the enclosing record in template-instantiation-heavy TUs.
+  auto it = record_cache_.find(decl);
+  if (it != record_cache_.end()) return it->second;
+
   // TODO(zarko): Do we need a better hash function? We may need to
   // hash the type variable context all the way up to the root template.
   uint64_t hash = 0;
@@ -151,6 +169,7 @@ uint64_t SemanticHash::Hash(const clang::RecordDecl* decl) const {
           clang::dyn_cast<clang::ClassTemplateSpecializationDecl>(decl)) {
     hash ^= Hash(clang::QualType(spec_decl->getTypeForDecl(), 0));
   }
+  record_cache_[decl] = hash;
   return hash;
 }
 
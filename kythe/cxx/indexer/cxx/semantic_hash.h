@@ -101,6 +101,15 @@ class SemanticHash {
 
   /// \brief Maps EnumDecls to semantic hashes.
   mutable llvm::DenseMap<const clang::EnumDecl*, uint64_t> enum_cache_;
+
+  /// \brief Maps RecordDecls to semantic hashes.
+  mutable llvm::DenseMap<const clang::RecordDecl*, uint64_t> record_cache_;
+
+  /// \brief Maps template-like Decls to semantic hashes.
+  mutable llvm::DenseMap<const clang::Decl*, uint64_t> template_decl_cache_;
+
+  /// \brief Maps canonical types (by opaque pointer) to semantic hashes.
+  mutable llvm::DenseMap<const void*, uint64_t> type_cache_;
 };
 
 }  // namespace kythe
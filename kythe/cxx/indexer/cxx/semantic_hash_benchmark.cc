@@ -0,0 +1,156 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks for SemanticHash over declarations from a representative
+// translation unit.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
+#include "glog/logging.h"
+#include "kythe/cxx/indexer/cxx/semantic_hash.h"
+#include "llvm/Support/Casting.h"
+
+namespace kythe {
+namespace {
+
+constexpr char kTestInput[] = R"cc(
+  enum class Color { kRed, kGreen, kBlue };
+  enum Legacy { KAPPA = 10, LAMBDA = 20, MU = 40 };
+
+  struct Point {
+    int x;
+    int y;
+    float weight;
+  };
+
+  class Shape {
+   public:
+    virtual ~Shape() {}
+    virtual float Area() const = 0;
+    Point center() const { return center_; }
+
+   private:
+    Point center_;
+  };
+
+  class Circle : public Shape {
+   public:
+    float Area() const override { return 3.14159f * radius_ * radius_; }
+
+   private:
+    float radius_ = 1.0f;
+  };
+
+  template <typename T, int N>
+  struct Array {
+    T values[N];
+    Color tint = Color::kRed;
+  };
+
+  using SmallArray = Array<Point, 4>;
+  SmallArray MakeArray(const Circle& circle, Legacy mode);
+)cc";
+
+// The parsed input and the declarations harvested from it. Parsing happens
+// once; the benchmarks below only measure hashing.
+struct Corpus {
+  std::unique_ptr<clang::ASTUnit> ast;
+  std::vector<const clang::RecordDecl*> records;
+  std::vector<const clang::EnumDecl*> enums;
+  std::vector<clang::QualType> types;
+};
+
+const Corpus& GetCorpus() {
+  static const Corpus* const corpus = [] {
+    auto* result = new Corpus();
+    result->ast = clang::tooling::buildASTFromCode(kTestInput, "input.cc");
+    CHECK(result->ast != nullptr);
+    for (clang::Decl* decl : result->ast->getASTContext()
+                                 .getTranslationUnitDecl()
+                                 ->decls()) {
+      if (auto* record = llvm::dyn_cast<clang::CXXRecordDecl>(decl)) {
+        if (record->isCompleteDefinition()) {
+          result->records.push_back(record);
+          result->types.emplace_back(record->getTypeForDecl(), 0);
+        }
+      } else if (auto* enum_decl = llvm::dyn_cast<clang::EnumDecl>(decl)) {
+        result->enums.push_back(enum_decl);
+        result->types.emplace_back(enum_decl->getTypeForDecl(), 0);
+      } else if (auto* fn = llvm::dyn_cast<clang::FunctionDecl>(decl)) {
+        result->types.push_back(fn->getType());
+      }
+    }
+    CHECK(!result->records.empty());
+    CHECK(!result->enums.empty());
+    return result;
+  }();
+  return *corpus;
+}
+
+SemanticHash MakeHasher() {
+  // The indexer derives the declaration string from its NameId; a cheap
+  // stand-in keeps the benchmark focused on the hash itself.
+  return SemanticHash(
+      [](const clang::Decl* decl) {
+        return std::string(decl->getDeclKindName());
+      },
+      SemanticHash::OnUnimplemented::Continue);
+}
+
+void BM_HashRecordDecl(benchmark::State& state) {
+  const Corpus& corpus = GetCorpus();
+  const SemanticHash hash = MakeHasher();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        hash.Hash(corpus.records[i++ % corpus.records.size()]));
+  }
+}
+BENCHMARK(BM_HashRecordDecl);
+
+void BM_HashEnumDecl(benchmark::State& state) {
+  const Corpus& corpus = GetCorpus();
+  const SemanticHash hash = MakeHasher();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        hash.Hash(corpus.enums[i++ % corpus.enums.size()]));
+  }
+}
+BENCHMARK(BM_HashEnumDecl);
+
+void BM_HashQualType(benchmark::State& state) {
+  const Corpus& corpus = GetCorpus();
+  const SemanticHash hash = MakeHasher();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        hash.Hash(corpus.types[i++ % corpus.types.size()]));
+  }
+}
+BENCHMARK(BM_HashQualType);
+
+}  // namespace
+}  // namespace kythe
+
+BENCHMARK_MAIN();
@@ -17,12 +17,12 @@
 #ifndef KYTHE_CXX_INDEXER_PROTO_FILE_DESCRIPTOR_WALKER_H_
 #define KYTHE_CXX_INDEXER_PROTO_FILE_DESCRIPTOR_WALKER_H_
 
-#include <map>
 #include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "glog/logging.h"
@@ -221,8 +221,13 @@ class FileDescriptorWalker {
   const kythe::UTF8LineIndex line_index_;
   ProtoGraphBuilder* builder_;
   URI uri_;
-  std::map<std::vector<int>, std::vector<int> > location_map_;
-  std::map<std::vector<int>, google::protobuf::SourceCodeInfo::Location>
+  // Location lookups are keyed by SourceCodeInfo path vectors. Every visited
+  // element resolves its span through these tables, so they are hash maps
+  // (built once per file in BuildLocationMap) rather than ordered maps, which
+  // would re-compare path vectors lexicographically on every descent.
+  absl::flat_hash_map<std::vector<int>, std::vector<int>> location_map_;
+  absl::flat_hash_map<std::vector<int>,
+                      google::protobuf::SourceCodeInfo::Location>
       path_location_map_;
 
   // Set of messages for which their fields are already visited.
@@ -16,7 +16,12 @@
 
 #include "kythe/cxx/indexer/proto/indexer_frontend.h"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "kythe/cxx/common/file_vname_generator.h"
 #include "kythe/cxx/common/indexing/KytheGraphRecorder.h"
 #include "kythe/cxx/common/path_utils.h"
@@ -29,10 +34,7 @@ namespace kythe {
 
 std::string IndexProtoCompilationUnit(const proto::CompilationUnit& unit,
                                       const std::vector<proto::FileData>& files,
-                                      KytheOutputStream* output) {
-  FileVNameGenerator file_vnames;
-  KytheGraphRecorder recorder(output);
-
+                                      KytheOutputStream* output, int jobs) {
   std::vector<std::string> unprocessed_args;
   std::vector<std::pair<std::string, std::string>> path_substitutions;
   ::kythe::lang_proto::ParsePathSubstitutions(
@@ -41,33 +43,105 @@ std::string IndexProtoCompilationUnit(const proto::CompilationUnit& unit,
     path_substitutions.push_back({"", CleanPath(unit.working_directory())});
   }
 
-  absl::flat_hash_map<std::string, std::string> file_substitution_cache;
-  PreloadedProtoFileTree file_reader(&path_substitutions,
-                                     &file_substitution_cache);
-  google::protobuf::compiler::SourceTreeDescriptorDatabase descriptor_db(
-      &file_reader);
-  for (const auto& file_data : files) {
-    file_reader.AddFile(file_data.info().path(), file_data.content());
-  }
-  lang_proto::ProtoAnalyzer analyzer(&unit, &descriptor_db, &file_vnames,
-                                     &recorder, &file_substitution_cache);
   if (unit.source_file().empty()) {
     return "Error: no source_files in CompilationUnit.";
   }
+
   std::string errors;
+  if (jobs <= 1) {
+    FileVNameGenerator file_vnames;
+    KytheGraphRecorder recorder(output);
+    absl::flat_hash_map<std::string, std::string> file_substitution_cache;
+    PreloadedProtoFileTree file_reader(&path_substitutions,
+                                       &file_substitution_cache);
+    google::protobuf::compiler::SourceTreeDescriptorDatabase descriptor_db(
+        &file_reader);
+    for (const auto& file_data : files) {
+      file_reader.AddFile(file_data.info().path(), file_data.content());
+    }
+    lang_proto::ProtoAnalyzer analyzer(&unit, &descriptor_db, &file_vnames,
+                                       &recorder, &file_substitution_cache);
+    for (const std::string& file_path : unit.source_file()) {
+      if (file_path.empty()) {
+        errors += "\n empty source_file.";
+        continue;
+      }
+      std::string file_contents;
+      if (!file_reader.Read(file_path, &file_contents)) {
+        errors += "\n source_file " + file_path + " not in FileData.";
+        continue;
+      }
+      if (!analyzer.Parse(file_path, file_contents)) {
+        errors += "\n Analyzer failed on " + file_path;
+      }
+    }
+    if (!errors.empty()) {
+      return "Errors during indexing:" + errors;
+    }
+    return "";
+  }
+
+  // Drop empty and repeated entries up front; the serial path leaves repeat
+  // suppression to the analyzer's per-replica claiming, which worker-local
+  // analyzers cannot see across threads.
+  std::vector<std::string> source_files;
+  absl::flat_hash_set<std::string> seen_files;
   for (const std::string& file_path : unit.source_file()) {
     if (file_path.empty()) {
       errors += "\n empty source_file.";
       continue;
     }
-    std::string file_contents;
-    if (!file_reader.Read(file_path, &file_contents)) {
-      errors += "\n source_file " + file_path + " not in FileData.";
-      continue;
+    if (seen_files.insert(file_path).second) {
+      source_files.push_back(file_path);
     }
-    if (!analyzer.Parse(file_path, file_contents)) {
-      errors += "\n Analyzer failed on " + file_path;
+  }
+
+  std::vector<BufferingOutputStream> file_outputs(source_files.size());
+  std::vector<std::string> file_errors(source_files.size());
+  std::atomic<size_t> next_file{0};
+  auto worker = [&] {
+    // Descriptor pools and the path-substitution cache are unsynchronized,
+    // so each worker builds its own; the source file contents themselves are
+    // immutable and shared through `files`.
+    absl::flat_hash_map<std::string, std::string> file_substitution_cache;
+    PreloadedProtoFileTree file_reader(&path_substitutions,
+                                       &file_substitution_cache);
+    google::protobuf::compiler::SourceTreeDescriptorDatabase descriptor_db(
+        &file_reader);
+    for (const auto& file_data : files) {
+      file_reader.AddFile(file_data.info().path(), file_data.content());
     }
+    FileVNameGenerator file_vnames;
+    for (size_t i = next_file.fetch_add(1); i < source_files.size();
+         i = next_file.fetch_add(1)) {
+      const std::string& file_path = source_files[i];
+      std::string file_contents;
+      if (!file_reader.Read(file_path, &file_contents)) {
+        file_errors[i] = "\n source_file " + file_path + " not in FileData.";
+        continue;
+      }
+      KytheGraphRecorder recorder(&file_outputs[i]);
+      lang_proto::ProtoAnalyzer analyzer(&unit, &descriptor_db, &file_vnames,
+                                         &recorder, &file_substitution_cache);
+      if (!analyzer.Parse(file_path, file_contents)) {
+        file_errors[i] = "\n Analyzer failed on " + file_path;
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  size_t worker_count = std::min<size_t>(jobs, source_files.size());
+  workers.reserve(worker_count);
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back(worker);
+  }
+  for (auto& thread : workers) {
+    thread.join();
+  }
+  // Replaying in source_file order keeps the output independent of how the
+  // files were distributed over the workers.
+  for (size_t i = 0; i < source_files.size(); ++i) {
+    file_outputs[i].ReplayTo(output);
+    errors += file_errors[i];
   }
   if (!errors.empty()) {
     return "Errors during indexing:" + errors;
@@ -30,10 +30,13 @@ class FileData;
 
 // Indexes `unit`, reading file paths and content from `files` and writing
 // Kythe artifacts to `output`. Returns an empty string if OK; otherwise,
-// an error description.
+// an error description. If `jobs` is greater than one, the unit's source
+// files are partitioned over that many worker threads; output is buffered
+// per file and emitted in source_file order, so results do not depend on
+// the thread count.
 std::string IndexProtoCompilationUnit(const proto::CompilationUnit& unit,
                                       const std::vector<proto::FileData>& files,
-                                      KytheOutputStream* output);
+                                      KytheOutputStream* output, int jobs = 1);
 
 }  // namespace kythe
 
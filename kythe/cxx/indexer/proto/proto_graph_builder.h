@@ -23,6 +23,7 @@
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "glog/logging.h"
 #include "google/protobuf/io/printer.h"
 #include "google/protobuf/io/zero_copy_stream_impl_lite.h"
@@ -68,10 +69,22 @@ class ProtoGraphBuilder {
   // Returns a VName for the given protobuf descriptor. Descriptors share
   // various member names but do not participate in any sort of inheritance
   // hierarchy, so we're stuck with a template.
+  //
+  // Results are interned per descriptor pointer for the builder's lifetime.
+  // Building a descriptor VName re-walks its location path and
+  // re-concatenates its signature, and the walker asks again for every
+  // enclosing scope of every member, so files with thousands of nested
+  // messages otherwise pay quadratic signature assembly.
   template <typename SomeDescriptor>
   proto::VName VNameForDescriptor(const SomeDescriptor* descriptor) {
-    return ::kythe::lang_proto::VNameForDescriptor(descriptor,
-                                                   vname_for_rel_path_);
+    auto it = vname_cache_.find(descriptor);
+    if (it == vname_cache_.end()) {
+      it = vname_cache_
+               .emplace(descriptor, ::kythe::lang_proto::VNameForDescriptor(
+                                        descriptor, vname_for_rel_path_))
+               .first;
+    }
+    return it->second;
   }
 
   // Sets the source text for this file.
@@ -160,6 +173,11 @@ class ProtoGraphBuilder {
   // A function to resolve relative paths to VNames.
   std::function<proto::VName(const std::string&)> vname_for_rel_path_;
 
+  // Interned descriptor VNames; see VNameForDescriptor. Descriptor pointers
+  // are stable and unique for the lifetime of their pool, which outlives the
+  // builder.
+  absl::flat_hash_map<const void*, proto::VName> vname_cache_;
+
   // The text of the current file being analyzed.
   std::string current_file_contents_;
 };
@@ -16,11 +16,22 @@
 
 #include "analyzer.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_split.h"
 #include "absl/strings/strip.h"
 #include "absl/types/optional.h"
@@ -98,7 +109,13 @@ class TextprotoAnalyzer {
         textproto_content_(textproto),
         line_index_(textproto),
         file_substitution_cache_(file_substitution_cache),
-        descriptor_pool_(pool) {}
+        descriptor_pool_(pool) {
+    // VNameForRelPath runs for every field occurrence; index the unit's
+    // inputs once instead of rescanning required_input per lookup.
+    for (const auto& input : unit->required_input()) {
+      path_to_vname_.emplace(input.info().path(), &input.v_name());
+    }
+  }
 
   // disallow copy and assign
   TextprotoAnalyzer(const TextprotoAnalyzer&) = delete;
@@ -167,6 +184,9 @@ class TextprotoAnalyzer {
   // DescriptorPool is used to lookup descriptors for messages inside
   // protobuf.Any types.
   const DescriptorPool* descriptor_pool_;
+  // Maps each required input's path to its VName in `unit_`, which outlives
+  // this analyzer (see the constructor note).
+  absl::flat_hash_map<absl::string_view, const proto::VName*> path_to_vname_;
 };
 
 absl::optional<proto::VName> TextprotoAnalyzer::VNameForRelPath(
@@ -178,7 +198,11 @@ absl::optional<proto::VName> TextprotoAnalyzer::VNameForRelPath(
   } else {
     full_path = simplified_path;
   }
-  return LookupVNameForFullPath(full_path, *unit_);
+  auto vname = path_to_vname_.find(full_path);
+  if (vname == path_to_vname_.end()) {
+    return absl::nullopt;
+  }
+  return *vname->second;
 }
 
 absl::Status TextprotoAnalyzer::AnalyzeMessage(
@@ -571,11 +595,152 @@ std::string FullPathToRelative(
   return std::string(full_path);
 }
 
+/// \brief Appends `file` and its unvisited transitive dependencies to `out`
+/// in dependency-first order, suitable for replay through
+/// `DescriptorPool::BuildFile`.
+void CollectFileDescriptors(
+    const google::protobuf::FileDescriptor* file,
+    absl::flat_hash_set<const google::protobuf::FileDescriptor*>* seen,
+    std::vector<const google::protobuf::FileDescriptor*>* out) {
+  if (!seen->insert(file).second) {
+    return;
+  }
+  for (int i = 0; i < file->dependency_count(); ++i) {
+    CollectFileDescriptors(file->dependency(i), seen, out);
+  }
+  out->push_back(file);
+}
+
+/// \brief Names the cache file for `schema_key` under `dir`.
+///
+/// The file name is a fingerprint of the key; the full key is stored inside
+/// the file and verified on load, so a fingerprint collision degrades to a
+/// cache miss rather than the wrong schema.
+std::string PersistentSchemaPath(const std::string& dir,
+                                 const std::string& schema_key) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : schema_key) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+  }
+  return absl::StrCat(dir, "/schema.", absl::Hex(hash, absl::kZeroPad16),
+                      ".fds");
+}
+
+/// \brief Loads the compiled schema cached at `path` into `set`.
+///
+/// The file holds a host-endian length-prefixed copy of the schema key
+/// followed by a serialized FileDescriptorSet; it is mapped rather than read
+/// so the (often multi-megabyte) bytes are paged in once and shared between
+/// concurrently starting indexer processes.
+/// \return false if the file is missing, damaged, or keyed differently.
+bool LoadPersistentSchema(const std::string& path,
+                          const std::string& schema_key,
+                          google::protobuf::FileDescriptorSet* set) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat stat_buf;
+  if (::fstat(fd, &stat_buf) != 0) {
+    ::close(fd);
+    return false;
+  }
+  const size_t size = stat_buf.st_size;
+  if (size < sizeof(uint64_t) + schema_key.size()) {
+    ::close(fd);
+    return false;
+  }
+  void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  const char* data = static_cast<const char*>(mapping);
+  uint64_t key_size;
+  memcpy(&key_size, data, sizeof(key_size));
+  bool ok = key_size == schema_key.size() &&
+            memcmp(data + sizeof(key_size), schema_key.data(), key_size) == 0;
+  if (ok) {
+    const char* payload = data + sizeof(key_size) + key_size;
+    ok = set->ParseFromArray(payload,
+                             size - sizeof(key_size) - key_size);
+  }
+  ::munmap(mapping, size);
+  return ok;
+}
+
+/// \brief Writes `set` to `path` (via a temporary plus rename, so concurrent
+/// writers and readers only ever see complete files).
+void SavePersistentSchema(const std::string& path,
+                          const std::string& schema_key,
+                          const google::protobuf::FileDescriptorSet& set) {
+  static std::atomic<int> counter{0};
+  const std::string tmp_path =
+      absl::StrCat(path, ".tmp.", getpid(), ".", counter.fetch_add(1));
+  int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return;
+  }
+  std::string buffer;
+  const uint64_t key_size = schema_key.size();
+  buffer.append(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+  buffer.append(schema_key);
+  bool ok = set.AppendToString(&buffer);
+  if (ok) {
+    size_t written = 0;
+    while (written < buffer.size()) {
+      ssize_t wrote =
+          ::write(fd, buffer.data() + written, buffer.size() - written);
+      if (wrote < 0) {
+        ok = false;
+        break;
+      }
+      written += wrote;
+    }
+  }
+  ::close(fd);
+  if (!ok || ::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    ::unlink(tmp_path.c_str());
+  }
+}
+
 }  // namespace
 
+struct DescriptorPoolCache::Schema {
+  explicit Schema(std::vector<std::pair<std::string, std::string>> substitutions)
+      : path_substitutions(std::move(substitutions)),
+        file_reader(&path_substitutions, &file_substitution_cache),
+        importer(&file_reader, &error_collector) {}
+
+  /// \brief The schema's descriptor pool: the one replayed from the
+  /// persistent cache when present, otherwise the importer's.
+  const DescriptorPool* pool() const {
+    return loaded_pool != nullptr ? loaded_pool.get() : importer.pool();
+  }
+
+  std::vector<std::pair<std::string, std::string>> path_substitutions;
+  absl::flat_hash_map<std::string, std::string> file_substitution_cache;
+  PreloadedProtoFileTree file_reader;
+  LoggingMultiFileErrorCollector error_collector;
+  google::protobuf::compiler::Importer importer;
+  /// Pool rebuilt from a cached FileDescriptorSet; null when the schema was
+  /// compiled from source through `importer`.
+  std::unique_ptr<DescriptorPool> loaded_pool;
+};
+
+DescriptorPoolCache::DescriptorPoolCache() = default;
+DescriptorPoolCache::~DescriptorPoolCache() = default;
+
 absl::Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
                                     const std::vector<proto::FileData>& files,
                                     KytheGraphRecorder* recorder) {
+  return AnalyzeCompilationUnit(unit, files, recorder, nullptr);
+}
+
+absl::Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
+                                    const std::vector<proto::FileData>& files,
+                                    KytheGraphRecorder* recorder,
+                                    DescriptorPoolCache* pool_cache) {
   if (unit.source_file().size() != 1) {
     return absl::FailedPreconditionError(
         "Expected Unit to contain 1 source file");
@@ -588,7 +753,6 @@ absl::Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
   const std::string textproto_name = unit.source_file(0);
 
   // Parse path substitutions from arguments.
-  absl::flat_hash_map<std::string, std::string> file_substitution_cache;
   std::vector<std::pair<std::string, std::string>> path_substitutions;
   std::vector<std::string> args;
   ::kythe::lang_proto::ParsePathSubstitutions(unit.argument(),
@@ -606,49 +770,145 @@ absl::Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
   }
   LOG(INFO) << "Proto message name: " << message_name;
 
-  // Load all proto files into in-memory SourceTree.
-  PreloadedProtoFileTree file_reader(&path_substitutions,
-                                     &file_substitution_cache);
-  std::vector<std::string> proto_filenames;
+  // Partition the inputs and derive the key identifying the schema: the
+  // .proto files (by path and content digest) plus the path substitutions
+  // that control how they import each other.
+  std::vector<const proto::FileData*> proto_files;
   const proto::FileData* textproto_file_data = nullptr;
+  std::string schema_key;
+  bool schema_key_valid = pool_cache != nullptr;
+  for (const auto& substitution : path_substitutions) {
+    schema_key += substitution.first;
+    schema_key += '\0';
+    schema_key += substitution.second;
+    schema_key += '\0';
+  }
   for (const auto& file : files) {
     // Skip textproto - only proto files go in the descriptor db.
     if (file.info().path() == textproto_name) {
       textproto_file_data = &file;
       continue;
     }
-
-    VLOG(1) << "Added file to descriptor db: " << file.info().path();
-    if (!file_reader.AddFile(file.info().path(), file.content())) {
-      return absl::UnknownError("Unable to add file to SourceTree.");
+    proto_files.push_back(&file);
+    if (file.info().digest().empty()) {
+      // Without digests the schema can't be identified cheaply; build an
+      // unshared pool below.
+      schema_key_valid = false;
+    } else {
+      schema_key += file.info().path();
+      schema_key += '\0';
+      schema_key += file.info().digest();
+      schema_key += '\0';
     }
-    proto_filenames.push_back(file.info().path());
   }
   if (textproto_file_data == nullptr) {
     return absl::NotFoundError("Couldn't find textproto source in file data.");
   }
 
-  // Build proto descriptor pool with top-level protos.
-  LoggingMultiFileErrorCollector error_collector;
-  google::protobuf::compiler::Importer proto_importer(&file_reader,
-                                                      &error_collector);
-  for (const std::string& fname : proto_filenames) {
-    // The proto importer gets confused if the same proto file is Import()'d
-    // under two different file paths. For example, if subdir/some.proto is
-    // imported as "subdir/some.proto" in one place and "some.proto" in another
-    // place, the importer will see duplicate symbol definitions and fail. To
-    // work around this, we use relative paths for importing because the
-    // "import" statements in proto files are also relative to the proto
-    // compiler search path. This ensures that the importer doesn't see the same
-    // file twice under two different names.
-    std::string relpath =
-        FullPathToRelative(fname, path_substitutions, &file_substitution_cache);
-    if (!proto_importer.Import(relpath)) {
-      return absl::UnknownError("Error importing proto file: " + relpath);
+  // Reuse a previously built descriptor pool for this schema if the cache has
+  // one; otherwise build it, loading the .proto files into an in-memory
+  // SourceTree and importing the top-level protos.
+  DescriptorPoolCache::Schema* schema = nullptr;
+  std::unique_ptr<DescriptorPoolCache::Schema> owned_schema;
+  if (schema_key_valid) {
+    auto it = pool_cache->schemas_.find(schema_key);
+    if (it != pool_cache->schemas_.end()) {
+      schema = it->second.get();
+    }
+  }
+  const bool persist = schema_key_valid && !pool_cache->persistent_dir_.empty();
+  std::string persistent_path;
+  if (persist) {
+    persistent_path =
+        PersistentSchemaPath(pool_cache->persistent_dir_, schema_key);
+  }
+  if (schema == nullptr && persist) {
+    // Replay a previously compiled copy of this schema from disk, skipping
+    // descriptor compilation entirely.
+    google::protobuf::FileDescriptorSet descriptor_set;
+    if (LoadPersistentSchema(persistent_path, schema_key, &descriptor_set)) {
+      owned_schema =
+          absl::make_unique<DescriptorPoolCache::Schema>(path_substitutions);
+      owned_schema->loaded_pool = absl::make_unique<DescriptorPool>();
+      bool built = true;
+      for (const auto& file_proto : descriptor_set.file()) {
+        if (owned_schema->loaded_pool->BuildFile(file_proto) == nullptr) {
+          built = false;
+          break;
+        }
+      }
+      if (built) {
+        schema = owned_schema.get();
+        // Replaying skips the importer, so rebuild the relative-path mapping
+        // the analyzer uses to recover full input paths.
+        for (const proto::FileData* file : proto_files) {
+          FullPathToRelative(file->info().path(), schema->path_substitutions,
+                             &schema->file_substitution_cache);
+        }
+        pool_cache->schemas_[schema_key] = std::move(owned_schema);
+      } else {
+        // A stale or truncated cache entry must not poison the analysis;
+        // fall through to compiling from source.
+        owned_schema.reset();
+      }
+    }
+  }
+  if (schema == nullptr) {
+    owned_schema = absl::make_unique<DescriptorPoolCache::Schema>(
+        std::move(path_substitutions));
+    schema = owned_schema.get();
+    for (const proto::FileData* file : proto_files) {
+      VLOG(1) << "Added file to descriptor db: " << file->info().path();
+      if (!schema->file_reader.AddFile(file->info().path(), file->content())) {
+        return absl::UnknownError("Unable to add file to SourceTree.");
+      }
+    }
+    std::vector<std::string> imported_relpaths;
+    for (const proto::FileData* file : proto_files) {
+      // The proto importer gets confused if the same proto file is Import()'d
+      // under two different file paths. For example, if subdir/some.proto is
+      // imported as "subdir/some.proto" in one place and "some.proto" in
+      // another place, the importer will see duplicate symbol definitions and
+      // fail. To work around this, we use relative paths for importing
+      // because the "import" statements in proto files are also relative to
+      // the proto compiler search path. This ensures that the importer
+      // doesn't see the same file twice under two different names.
+      std::string relpath =
+          FullPathToRelative(file->info().path(), schema->path_substitutions,
+                             &schema->file_substitution_cache);
+      if (!schema->importer.Import(relpath)) {
+        return absl::UnknownError("Error importing proto file: " + relpath);
+      }
+      VLOG(1) << "Added proto to descriptor pool: " << relpath;
+      imported_relpaths.push_back(std::move(relpath));
+    }
+    if (persist) {
+      // Serialize the compiled schema (with source locations, which comment
+      // analysis needs) in dependency-first order so a later run can replay
+      // it straight into a pool.
+      google::protobuf::FileDescriptorSet descriptor_set;
+      absl::flat_hash_set<const google::protobuf::FileDescriptor*> seen;
+      std::vector<const google::protobuf::FileDescriptor*> ordered;
+      for (const auto& relpath : imported_relpaths) {
+        const auto* file = schema->importer.pool()->FindFileByName(relpath);
+        if (file != nullptr) {
+          CollectFileDescriptors(file, &seen, &ordered);
+        }
+      }
+      for (const auto* file : ordered) {
+        auto* file_proto = descriptor_set.add_file();
+        file->CopyTo(file_proto);
+        file->CopySourceCodeInfoTo(file_proto);
+      }
+      SavePersistentSchema(persistent_path, schema_key, descriptor_set);
+    }
+    if (schema_key_valid) {
+      // Only fully built schemas are cached; a failed build above must not
+      // satisfy a later lookup.
+      pool_cache->schemas_[std::move(schema_key)] = std::move(owned_schema);
     }
-    VLOG(1) << "Added proto to descriptor pool: " << relpath;
   }
-  const DescriptorPool* descriptor_pool = proto_importer.pool();
+  const DescriptorPool* descriptor_pool = schema->pool();
 
   // Get a descriptor for the top-level Message.
   const Descriptor* descriptor =
@@ -691,7 +951,7 @@ absl::Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
 
   // Analyze!
   TextprotoAnalyzer analyzer(&unit, textproto_file_data->content(),
-                             &file_substitution_cache, recorder,
+                             &schema->file_substitution_cache, recorder,
                              descriptor_pool);
 
   absl::Status status =
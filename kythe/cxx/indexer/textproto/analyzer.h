@@ -18,8 +18,10 @@
 #define KYTHE_CXX_INDEXER_TEXTPROTO_ANALYZER_H_
 
 #include <cstdio>
+#include <memory>
 #include <string>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "kythe/cxx/common/file_vname_generator.h"
 #include "kythe/cxx/common/indexing/KytheGraphRecorder.h"
@@ -31,6 +33,50 @@ namespace lang_textproto {
 // The canonical name for the textproto language in Kythe.
 extern const absl::string_view kLanguageName;
 
+class DescriptorPoolCache;
+
+/// \copydoc AnalyzeCompilationUnit()
+/// If `pool_cache` is non-null, the descriptor pool built from the unit's
+/// .proto inputs is looked up there first and stored there after a miss, so a
+/// batch driver can analyze many textprotos sharing one schema without
+/// re-importing it per unit. The cache is not synchronized; use one per
+/// thread.
+absl::Status AnalyzeCompilationUnit(const proto::CompilationUnit& unit,
+                                    const std::vector<proto::FileData>& files,
+                                    KytheGraphRecorder* recorder,
+                                    DescriptorPoolCache* pool_cache);
+
+/// Caches built proto descriptor pools, keyed by the schema inputs (proto
+/// file paths and digests plus path substitutions) that determine their
+/// contents. Entries own the pools and their backing source trees and stay
+/// valid for the cache's lifetime.
+class DescriptorPoolCache {
+ public:
+  DescriptorPoolCache();
+  ~DescriptorPoolCache();
+
+  // disallow copy and assign
+  DescriptorPoolCache(const DescriptorPoolCache&) = delete;
+  void operator=(const DescriptorPoolCache&) = delete;
+
+  /// \brief Persists compiled schemas under `dir` (which must exist) and
+  /// consults it on in-memory misses, so later invocations against the same
+  /// schema skip descriptor compilation entirely. Entries are keyed by the
+  /// same schema inputs as the in-memory cache and verified on load.
+  void set_persistent_dir(std::string dir) { persistent_dir_ = std::move(dir); }
+
+ private:
+  friend absl::Status AnalyzeCompilationUnit(
+      const proto::CompilationUnit& unit,
+      const std::vector<proto::FileData>& files, KytheGraphRecorder* recorder,
+      DescriptorPoolCache* pool_cache);
+
+  struct Schema;
+  absl::flat_hash_map<std::string, std::unique_ptr<Schema>> schemas_;
+  /// \sa set_persistent_dir(); empty disables the on-disk layer.
+  std::string persistent_dir_;
+};
+
 /// Analyzes the textproto file described by @unit and emits graph facts to
 /// @recorder.
 ///
@@ -14,11 +14,17 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
@@ -36,6 +42,14 @@ ABSL_FLAG(std::string, o, "-", "Output filename.");
 ABSL_FLAG(bool, flush_after_each_entry, true,
           "Flush output after writing each entry.");
 ABSL_FLAG(std::string, index_file, "", "Path to a KZip file to index.");
+ABSL_FLAG(int, jobs, 1,
+          "Analyze the kzip's compilation units with this many threads. Each "
+          "worker reuses descriptor pools across the units it analyzes and "
+          "writes each finished unit's entries to the output as a group.");
+ABSL_FLAG(std::string, descriptor_cache_dir, "",
+          "If nonempty, cache compiled proto schemas in this directory "
+          "(created if missing) and reuse them across indexer invocations, "
+          "skipping descriptor compilation for already-seen schemas.");
 
 namespace kythe {
 namespace lang_textproto {
@@ -50,6 +64,26 @@ using CompilationVisitCallback = std::function<void(
 /// the kzip.
 // TODO(justbuchanan): Refactor so that this function is shared with the cxx
 // indexer. It was initially copied from cxx/indexer/frontend.cc.
+void ReadCompilation(IndexReader* reader, absl::string_view digest,
+                     proto::CompilationUnit* unit,
+                     std::vector<proto::FileData>* virtual_files) {
+  auto compilation = reader->ReadUnit(digest);
+  CHECK(compilation.ok()) << compilation.status();
+  // Reused across required inputs to avoid a string allocation per file.
+  std::string content;
+  for (const auto& file : compilation->unit().required_input()) {
+    auto read = reader->ReadFileInto(file.info().digest(), &content);
+    CHECK(read.ok()) << "Unable to read file with digest: "
+                     << file.info().digest() << ": " << read;
+    proto::FileData file_data;
+    file_data.set_content(content);
+    file_data.mutable_info()->set_path(file.info().path());
+    file_data.mutable_info()->set_digest(file.info().digest());
+    virtual_files->push_back(std::move(file_data));
+  }
+  *unit = compilation->unit();
+}
+
 void DecodeKzipFile(const std::string& path,
                     const CompilationVisitCallback& visit) {
   // This forces the BuildDetails proto descriptor to be added to the pool so
@@ -61,21 +95,9 @@ void DecodeKzipFile(const std::string& path,
   bool compilation_read = false;
   auto status = reader->Scan([&](absl::string_view digest) {
     std::vector<proto::FileData> virtual_files;
-    auto compilation = reader->ReadUnit(digest);
-    CHECK(compilation.ok()) << compilation.status();
-    for (const auto& file : compilation->unit().required_input()) {
-      auto content = reader->ReadFile(file.info().digest());
-      CHECK(content) << "Unable to read file with digest: "
-                     << file.info().digest() << ": " << content.status();
-      proto::FileData file_data;
-      file_data.set_content(*content);
-      file_data.mutable_info()->set_path(file.info().path());
-      file_data.mutable_info()->set_digest(file.info().digest());
-      virtual_files.push_back(std::move(file_data));
-    }
-
-    visit(compilation->unit(), std::move(virtual_files));
-
+    proto::CompilationUnit unit;
+    ReadCompilation(&*reader, digest, &unit, &virtual_files);
+    visit(unit, std::move(virtual_files));
     compilation_read = true;
     return true;
   });
@@ -109,15 +131,80 @@ Example:
   FileOutputStream kythe_output(&raw_output);
   kythe_output.set_flush_after_each_entry(
       absl::GetFlag(FLAGS_flush_after_each_entry));
-  KytheGraphRecorder recorder(&kythe_output);
-
-  DecodeKzipFile(absl::GetFlag(FLAGS_index_file),
-                 [&](const proto::CompilationUnit& unit,
-                     std::vector<proto::FileData> file_data) {
-                   absl::Status status = lang_textproto::AnalyzeCompilationUnit(
-                       unit, file_data, &recorder);
-                   CHECK(status.ok()) << status;
-                 });
+
+  const std::string index_file = absl::GetFlag(FLAGS_index_file);
+  const std::string cache_dir = absl::GetFlag(FLAGS_descriptor_cache_dir);
+  if (!cache_dir.empty() && ::mkdir(cache_dir.c_str(), 0755) != 0 &&
+      errno != EEXIST) {
+    LOG(ERROR) << "Couldn't create --descriptor_cache_dir " << cache_dir
+               << "; continuing without the persistent cache.";
+  }
+  int jobs = absl::GetFlag(FLAGS_jobs);
+  if (jobs <= 1) {
+    KytheGraphRecorder recorder(&kythe_output);
+    DescriptorPoolCache pool_cache;
+    if (!cache_dir.empty()) {
+      pool_cache.set_persistent_dir(cache_dir);
+    }
+    DecodeKzipFile(index_file, [&](const proto::CompilationUnit& unit,
+                                   std::vector<proto::FileData> file_data) {
+      absl::Status status = lang_textproto::AnalyzeCompilationUnit(
+          unit, file_data, &recorder, &pool_cache);
+      CHECK(status.ok()) << status;
+    });
+    return 0;
+  }
+
+  // Scan the kzip once for unit digests, then let the workers read and
+  // analyze units independently: each worker opens its own reader and keeps
+  // its own descriptor-pool cache, and a finished unit's entries are replayed
+  // into the shared output under a lock. The entry stream is unordered, so
+  // emitting each unit as one group is all the coordination required.
+  proto::BuildDetails needed_for_proto_deserialization;
+  std::vector<std::string> digests;
+  {
+    StatusOr<IndexReader> reader = kythe::KzipReader::Open(index_file);
+    CHECK(reader) << "Couldn't open kzip from " << index_file;
+    auto status = reader->Scan([&](absl::string_view digest) {
+      digests.push_back(std::string(digest));
+      return true;
+    });
+    CHECK(status.ok()) << status.ToString();
+  }
+  CHECK(!digests.empty()) << "Missing compilation in " << index_file;
+
+  std::atomic<size_t> next_unit{0};
+  std::mutex output_mutex;
+  auto worker = [&] {
+    StatusOr<IndexReader> reader = kythe::KzipReader::Open(index_file);
+    CHECK(reader) << "Couldn't open kzip from " << index_file;
+    DescriptorPoolCache pool_cache;
+    if (!cache_dir.empty()) {
+      pool_cache.set_persistent_dir(cache_dir);
+    }
+    for (size_t i = next_unit.fetch_add(1); i < digests.size();
+         i = next_unit.fetch_add(1)) {
+      proto::CompilationUnit unit;
+      std::vector<proto::FileData> file_data;
+      ReadCompilation(&*reader, digests[i], &unit, &file_data);
+      BufferingOutputStream buffer;
+      KytheGraphRecorder recorder(&buffer);
+      absl::Status status = lang_textproto::AnalyzeCompilationUnit(
+          unit, file_data, &recorder, &pool_cache);
+      CHECK(status.ok()) << status;
+      std::lock_guard<std::mutex> lock(output_mutex);
+      buffer.ReplayTo(&kythe_output);
+    }
+  };
+  std::vector<std::thread> workers;
+  size_t worker_count = std::min<size_t>(jobs, digests.size());
+  workers.reserve(worker_count);
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back(worker);
+  }
+  for (auto& thread : workers) {
+    thread.join();
+  }
 
   return 0;
 }
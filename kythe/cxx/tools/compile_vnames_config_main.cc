@@ -0,0 +1,58 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// compile_vnames_config: compiles a vnames.json rule file to the binary
+// form that FileVNameGenerator loads without parsing JSON.
+//
+// compile_vnames_config --json_file vnames.json --output_file vnames.bin
+
+#include <cstdio>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "glog/logging.h"
+#include "kythe/cxx/common/file_utils.h"
+#include "kythe/cxx/common/file_vname_generator.h"
+
+ABSL_FLAG(std::string, json_file, "", "The vnames.json file to compile.");
+ABSL_FLAG(std::string, output_file, "",
+          "Where to write the compiled binary rule file.");
+
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  absl::SetProgramUsageMessage(
+      "compile_vnames_config: compile vnames.json to the binary rule format");
+  absl::ParseCommandLine(argc, argv);
+  const std::string json_file = absl::GetFlag(FLAGS_json_file);
+  const std::string output_file = absl::GetFlag(FLAGS_output_file);
+  CHECK(!json_file.empty()) << "Please provide --json_file.";
+  CHECK(!output_file.empty()) << "Please provide --output_file.";
+  auto json = kythe::MappedFile::Open(json_file);
+  CHECK(json.ok()) << "Couldn't open " << json_file << ": " << json.status();
+  kythe::FileVNameGenerator generator;
+  std::string error_text;
+  CHECK(generator.LoadJsonString(json->content(), &error_text))
+      << "Couldn't parse " << json_file << ": " << error_text;
+  std::string compiled;
+  generator.SerializeToBinary(&compiled);
+  FILE* out = fopen(output_file.c_str(), "wb");
+  CHECK(out != nullptr) << "Couldn't open " << output_file;
+  CHECK_EQ(fwrite(compiled.data(), 1, compiled.size(), out), compiled.size())
+      << "Couldn't write " << output_file;
+  CHECK_NE(fclose(out), EOF) << "Couldn't close " << output_file;
+  return 0;
+}
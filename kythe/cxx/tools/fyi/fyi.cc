@@ -16,6 +16,8 @@
 
 #include "kythe/cxx/tools/fyi/fyi.h"
 
+#include <mutex>
+
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
@@ -657,6 +659,10 @@ bool ActionFactory::runInvocation(
   if (action->tracker()->state() != FileTracker::State::kFailure) {
     const auto buffer = action->tracker()->backing_store();
     if (!buffer.empty()) {
+      // Batch-mode workers share stdout; keep whole-file outputs from
+      // interleaving.
+      static std::mutex output_mutex;
+      std::lock_guard<std::mutex> lock(output_mutex);
       absl::PrintF("%s", buffer.str());
     }
   }
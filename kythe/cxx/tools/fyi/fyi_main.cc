@@ -14,6 +14,11 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "absl/flags/usage.h"
 #include "absl/memory/memory.h"
 #include "clang/Tooling/CommonOptionsParser.h"
@@ -32,6 +37,9 @@ static cl::OptionCategory fyi_options("Tool options");
 static cl::opt<std::string> xrefs("xrefs",
                                   cl::desc("Base URI for xrefs service"),
                                   cl::init("http://localhost:8080"));
+static cl::opt<unsigned> jobs(
+    "j", cl::desc("Number of source files to repair concurrently"),
+    cl::init(1), cl::cat(fyi_options));
 
 int main(int argc, const char** argv) {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -39,10 +47,43 @@ int main(int argc, const char** argv) {
   absl::SetProgramUsageMessage("fyi: repair a C++ file with missing includes");
   clang::tooling::CommonOptionsParser options(argc, argv, fyi_options);
   kythe::JsonClient::InitNetwork();
-  auto xrefs_db = absl::make_unique<kythe::XrefsJsonClient>(
-      absl::make_unique<kythe::JsonClient>(), xrefs);
-  clang::tooling::ClangTool tool(options.getCompilations(),
-                                 options.getSourcePathList());
-  kythe::fyi::ActionFactory factory(std::move(xrefs_db), 5);
-  return tool.run(&factory);
+  const std::vector<std::string> sources = options.getSourcePathList();
+  unsigned worker_count =
+      std::min<unsigned>(std::max(1u, jobs.getValue()), sources.size());
+  if (worker_count <= 1) {
+    auto xrefs_db = absl::make_unique<kythe::XrefsJsonClient>(
+        absl::make_unique<kythe::JsonClient>(), xrefs);
+    clang::tooling::ClangTool tool(options.getCompilations(), sources);
+    kythe::fyi::ActionFactory factory(std::move(xrefs_db), 5);
+    return tool.run(&factory);
+  }
+  // Batch mode: workers pull one file at a time, each with its own tool and
+  // factory. The factory owns the repair state (and iteration budget) for one
+  // file's fixpoint, and the JSON client wraps a single curl handle, so
+  // neither may be shared across threads. The compilation database is only
+  // read and is shared by all workers.
+  std::atomic<size_t> next_source{0};
+  std::atomic<int> exit_code{0};
+  auto worker = [&] {
+    for (size_t i = next_source.fetch_add(1); i < sources.size();
+         i = next_source.fetch_add(1)) {
+      auto xrefs_db = absl::make_unique<kythe::XrefsJsonClient>(
+          absl::make_unique<kythe::JsonClient>(), xrefs);
+      clang::tooling::ClangTool tool(options.getCompilations(), {sources[i]});
+      kythe::fyi::ActionFactory factory(std::move(xrefs_db), 5);
+      int result = tool.run(&factory);
+      if (result != 0) {
+        exit_code.store(result);
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(worker_count);
+  for (unsigned i = 0; i < worker_count; ++i) {
+    workers.emplace_back(worker);
+  }
+  for (auto& thread : workers) {
+    thread.join();
+  }
+  return exit_code.load();
 }
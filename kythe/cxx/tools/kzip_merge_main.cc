@@ -0,0 +1,220 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// kzip_merge: merges and filters kzip archives without recompression.
+//
+// kzip_merge --output corpus.kzip input1.kzip input2.kzip ...
+//   copies the entries of the input archives into the output archive. Entries
+//   are transferred as raw compressed data (libzip's zip_source_zip copies a
+//   whole entry without inflating it), so merging is an I/O-bound copy.
+//   Entries are named by content digest, so identical units and files across
+//   inputs are deduplicated by name. If --corpus or --language is set, only
+//   compilation units matching the filters — and the files they reference —
+//   are transferred; filtering decodes only the (small) unit entries.
+
+#include <zip.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "glog/logging.h"
+#include "kythe/cxx/common/kzip_reader.h"
+#include "kythe/proto/analysis.pb.h"
+
+ABSL_FLAG(std::string, output, "", "Path of the kzip archive to create.");
+ABSL_FLAG(std::string, corpus, "",
+          "If nonempty, only transfer compilation units from this corpus "
+          "(and the files they reference).");
+ABSL_FLAG(std::string, language, "",
+          "If nonempty, only transfer compilation units for this language "
+          "(and the files they reference).");
+
+namespace kythe {
+namespace {
+
+/// \brief Per-entry classification of a kzip archive member.
+enum class EntryKind { kUnit, kFile, kOther };
+
+EntryKind ClassifyEntry(absl::string_view name, absl::string_view* digest) {
+  // Entries are <root>/units/<digest>, <root>/pbunits/<digest>, or
+  // <root>/files/<digest>; archives may use differing root directory names.
+  auto slashpos = name.find('/');
+  if (slashpos == name.npos) return EntryKind::kOther;
+  name.remove_prefix(slashpos + 1);
+  if (absl::ConsumePrefix(&name, "units/") ||
+      absl::ConsumePrefix(&name, "pbunits/")) {
+    *digest = name;
+    return name.empty() ? EntryKind::kOther : EntryKind::kUnit;
+  }
+  if (absl::ConsumePrefix(&name, "files/")) {
+    *digest = name;
+    return name.empty() ? EntryKind::kOther : EntryKind::kFile;
+  }
+  return EntryKind::kOther;
+}
+
+/// \brief Renames `name` to live under the canonical "root/" directory so
+/// inputs with differing root names merge cleanly.
+std::string CanonicalName(absl::string_view name) {
+  auto slashpos = name.find('/');
+  return absl::StrCat("root", name.substr(slashpos));
+}
+
+class KzipMerger {
+ public:
+  explicit KzipMerger(zip_t* output) : output_(output) {}
+
+  /// \brief Transfers the matching entries of the archive at `path` into the
+  /// output. Returns false on error.
+  bool Merge(const std::string& path) {
+    int error;
+    zip_t* input = zip_open(path.c_str(), ZIP_RDONLY, &error);
+    if (input == nullptr) {
+      LOG(ERROR) << "Unable to open " << path << ": libzip error " << error;
+      return false;
+    }
+    // When filtering, decode the unit entries (only) to find the digests of
+    // the units and files to keep; raw transfer then proceeds name by name.
+    absl::flat_hash_set<std::string> kept_digests;
+    const bool filtering = !absl::GetFlag(FLAGS_corpus).empty() ||
+                           !absl::GetFlag(FLAGS_language).empty();
+    if (filtering && !SelectDigests(path, &kept_digests)) {
+      zip_discard(input);
+      return false;
+    }
+    bool ok = true;
+    const zip_int64_t entries = zip_get_num_entries(input, 0);
+    for (zip_int64_t index = 0; index < entries; ++index) {
+      absl::string_view name = zip_get_name(input, index, 0);
+      absl::string_view digest;
+      const EntryKind kind = ClassifyEntry(name, &digest);
+      if (kind == EntryKind::kOther) continue;
+      if (filtering && !kept_digests.contains(digest)) continue;
+      const std::string target = CanonicalName(name);
+      if (!transferred_.insert(target).second) continue;  // Duplicate digest.
+      // zip_source_zip transfers the whole entry as raw compressed data;
+      // nothing is inflated or deflated on this path.
+      zip_source_t* source = zip_source_zip(output_, input, index, 0, 0, -1);
+      if (source == nullptr ||
+          zip_file_add(output_, target.c_str(), source, ZIP_FL_ENC_UTF_8) <
+              0) {
+        if (source != nullptr) zip_source_free(source);
+        LOG(ERROR) << "Unable to transfer " << name << " from " << path
+                   << ": " << zip_strerror(output_);
+        transferred_.erase(target);
+        ok = false;
+        break;
+      }
+    }
+    zip_discard(input);
+    return ok;
+  }
+
+ private:
+  /// \brief Decodes the units of the archive at `path` and collects the
+  /// digests of matching units and of every file they reference.
+  bool SelectDigests(const std::string& path,
+                     absl::flat_hash_set<std::string>* kept) {
+    auto reader = KzipReader::Open(path);
+    if (!reader.ok()) {
+      LOG(ERROR) << "Unable to read " << path << ": " << reader.status();
+      return false;
+    }
+    const std::string corpus = absl::GetFlag(FLAGS_corpus);
+    const std::string language = absl::GetFlag(FLAGS_language);
+    auto status = reader->ScanUnits(
+        [&](absl::string_view digest,
+            StatusOr<kythe::proto::IndexedCompilation> unit) {
+          if (!unit.ok()) {
+            LOG(WARNING) << "Error decoding unit " << digest << ": "
+                         << unit.status();
+            return true;
+          }
+          const auto& vname = unit->unit().v_name();
+          if ((corpus.empty() || vname.corpus() == corpus) &&
+              (language.empty() || vname.language() == language)) {
+            kept->insert(std::string(digest));
+            for (const auto& input : unit->unit().required_input()) {
+              kept->insert(input.info().digest());
+            }
+          }
+          return true;
+        });
+    if (!status.ok()) {
+      LOG(ERROR) << "Unable to scan " << path << ": " << status;
+      return false;
+    }
+    return true;
+  }
+
+  zip_t* output_;
+  /// Canonical names already added to the output.
+  absl::flat_hash_set<std::string> transferred_;
+};
+
+int Merge(const std::vector<std::string>& inputs, const std::string& output) {
+  int error;
+  zip_t* archive = zip_open(output.c_str(), ZIP_CREATE | ZIP_EXCL, &error);
+  if (archive == nullptr) {
+    LOG(ERROR) << "Unable to create " << output << ": libzip error " << error;
+    return 1;
+  }
+  // The kzip format requires the root directory entry.
+  if (zip_dir_add(archive, "root", ZIP_FL_ENC_UTF_8) < 0) {
+    LOG(ERROR) << "Unable to create root entry: " << zip_strerror(archive);
+    zip_discard(archive);
+    return 1;
+  }
+  KzipMerger merger(archive);
+  for (const auto& input : inputs) {
+    if (!merger.Merge(input)) {
+      zip_discard(archive);
+      return 1;
+    }
+  }
+  if (zip_close(archive) != 0) {
+    LOG(ERROR) << "Unable to close " << output << ": "
+               << zip_strerror(archive);
+    zip_discard(archive);
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace kythe
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  absl::SetProgramUsageMessage(
+      "kzip_merge --output corpus.kzip input1.kzip input2.kzip ...");
+  std::vector<char*> remain = absl::ParseCommandLine(argc, argv);
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (output.empty() || remain.size() < 2) {
+    absl::FPrintF(stderr, "usage: %s\n", absl::ProgramUsageMessage());
+    return 1;
+  }
+  std::vector<std::string> inputs(remain.begin() + 1, remain.end());
+  return kythe::Merge(inputs, output);
+}
@@ -54,7 +54,10 @@ constexpr absl::string_view kAnnotationPragmaParam = "annotation_pragma_name";
 constexpr absl::string_view kAnnotationPragmaInline = "kythe_inline_metadata";
 constexpr absl::string_view kAnnotationPragmaCompress =
     "kythe_inline_gzip_metadata";
-constexpr int kMetadataLineLength = 76;
+// Base64 turns every 3 input bytes into 4 output characters, so 57-byte
+// chunks encode to exactly 76-character lines; only the final chunk may be
+// shorter or padded, just as when escaping the whole buffer at once.
+constexpr int kBase64BytesPerLine = 57;
 
 absl::string_view NextChunk(absl::string_view* data, int size) {
   if (data->empty()) {
@@ -65,10 +68,16 @@ absl::string_view NextChunk(absl::string_view* data, int size) {
   return result;
 }
 
-void WriteLines(absl::string_view metadata, Printer* printer) {
-  while (!metadata.empty()) {
-    absl::string_view chunk = NextChunk(&metadata, kMetadataLineLength);
-    printer->WriteRaw(chunk.data(), chunk.size());
+// Streams `contents` to `printer` as base64 lines, encoding one line at a
+// time; the metadata (which can run to megabytes for large generated
+// headers) is never base64-escaped into a second in-memory copy.
+void WriteBase64Lines(absl::string_view contents, Printer* printer) {
+  std::string line;
+  while (!contents.empty()) {
+    absl::string_view chunk = NextChunk(&contents, kBase64BytesPerLine);
+    line.clear();
+    absl::Base64Escape(chunk, &line);
+    printer->WriteRaw(line.data(), line.size());
     printer->PrintRaw("\n");
   }
 }
@@ -84,9 +93,7 @@ std::string WriteMetadata(absl::string_view metafile,
   printer.PrintRaw("/* ");
   printer.WriteRaw(metafile.data(), metafile.size());
   printer.PrintRaw("\n");
-  std::string metadata;
-  absl::Base64Escape(contents, &metadata);
-  WriteLines(metadata, &printer);
+  WriteBase64Lines(contents, &printer);
   printer.PrintRaw("*/\n");
 
   return "";
@@ -22,12 +22,18 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <set>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/flags/usage.h"
@@ -37,6 +43,8 @@
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "kythe/cxx/common/kzip_reader.h"
+#include "kythe/cxx/common/mapped_claim_table.h"
+#include "kythe/cxx/common/vname_key.h"
 #include "kythe/cxx/common/vname_ordering.h"
 #include "kythe/proto/analysis.pb.h"
 #include "kythe/proto/claim.pb.h"
@@ -47,7 +55,12 @@ using kythe::proto::CompilationUnit;
 using kythe::proto::VName;
 
 ABSL_FLAG(bool, text, false, "Dump output as text instead of protobuf.");
+ABSL_FLAG(bool, binary_table, false,
+          "Write the compact fingerprint table format that indexers can "
+          "memory-map instead of delimited protobufs.");
 ABSL_FLAG(bool, show_stats, false, "Show some statistics.");
+ABSL_FLAG(int, jobs, 1,
+          "Number of threads used to read and digest compilation units.");
 
 struct Claimable;
 
@@ -125,6 +138,64 @@ class FileContextRows {
   kythe::proto::ContextDependentVersion context_;
 };
 
+/// \brief Claim-relevant data digested from a single compilation unit.
+///
+/// Building one of these touches only the unit itself, so it can be done on
+/// a worker thread before the results are merged into the global maps.
+struct CompilationClaims {
+  /// \brief The unit's VName.
+  VName claimant;
+  /// \brief VNames of the unit's claimable inputs, deduplicated.
+  std::vector<VName> claimables;
+  /// \brief Number of required inputs in the unit.
+  size_t input_count = 0;
+  /// \brief Number of #includes in the unit.
+  size_t include_count = 0;
+};
+
+/// \brief Digests `unit`'s required inputs (and their different transcripts)
+/// into a `CompilationClaims`.
+static CompilationClaims ExtractClaims(const CompilationUnit& unit) {
+  CompilationClaims claims;
+  claims.claimant = unit.v_name();
+  absl::flat_hash_set<std::string> seen_claimables;
+  auto add_claimable = [&](VName vname) {
+    if (seen_claimables.insert(vname.SerializeAsString()).second) {
+      claims.claimables.push_back(std::move(vname));
+    }
+  };
+  for (auto& input : unit.required_input()) {
+    ++claims.input_count;
+    FileContextRows context_rows(input);
+    if (!context_rows.empty()) {
+      VName input_vname = input.v_name();
+      if (!input_vname.signature().empty()) {
+        // We generally expect that file vnames have no signature.
+        // If this happens, we'll emit a warning, but we'll also be sure to
+        // keep the signature around as a suffix when building vnames for
+        // contexts.
+        LOG(WARNING) << "Input " << input_vname.DebugString()
+                     << " has a nonempty signature.\n";
+      }
+      for (const auto& row : context_rows) {
+        // If we have a (r, h, c) entry, we'd better have an input entry for
+        // the file included at h with context c (otherwise the index file
+        // isn't well-formed). We therefore only need to claim each unique
+        // row.
+        ++claims.include_count;
+        VName cxt_vname = input_vname;
+        cxt_vname.set_signature(row.source_context() +
+                                input_vname.signature());
+        add_claimable(std::move(cxt_vname));
+      }
+    } else {
+      ++claims.include_count;
+      add_claimable(input.v_name());
+    }
+  }
+  return claims;
+}
+
 /// \brief Generates and exports a mapping from claimants to claimables.
 class ClaimTool {
  public:
@@ -164,6 +235,21 @@ class ClaimTool {
       }
       return;
     }
+    if (absl::GetFlag(FLAGS_binary_table)) {
+      std::vector<std::pair<uint64_t, uint64_t>> entries;
+      entries.reserve(claimables_.size());
+      for (auto& claimable : claimables_) {
+        if (claimable.second.elected_claimant) {
+          entries.emplace_back(
+              kythe::VNameFingerprint(claimable.second.vname),
+              kythe::VNameFingerprint(
+                  claimable.second.elected_claimant->vname));
+        }
+      }
+      CHECK(kythe::MappedClaimTable::Write(out_fd, std::move(entries)));
+      CHECK(::close(out_fd) == 0) << "errno was: " << errno;
+      return;
+    }
     {
       namespace io = google::protobuf::io;
       io::FileOutputStream file_output_stream(out_fd);
@@ -189,47 +275,28 @@ class ClaimTool {
   /// \brief Add `unit` as a possible claimant and remember all of its
   /// dependencies (and their different transcripts) as claimables.
   void HandleCompilationUnit(const CompilationUnit& unit) {
+    HandleClaims(ExtractClaims(unit));
+  }
+
+  /// \brief Merge pre-digested `claims` into the claimant and claimable maps.
+  ///
+  /// Both maps are sorted by VName, so the final assignment is independent of
+  /// the order in which units' claims are merged.
+  void HandleClaims(const CompilationClaims& claims) {
     auto insert_result =
-        claimants_.emplace(unit.v_name(), Claimant{unit.v_name()});
+        claimants_.emplace(claims.claimant, Claimant{claims.claimant});
     if (!insert_result.second) {
       LOG(WARNING) << "Compilation unit with name "
-                   << unit.v_name().DebugString()
+                   << claims.claimant.DebugString()
                    << " had the same VName as another previous unit.";
     }
-    for (auto& input : unit.required_input()) {
-      ++total_input_count_;
-      FileContextRows context_rows(input);
-      if (!context_rows.empty()) {
-        VName input_vname = input.v_name();
-        if (!input_vname.signature().empty()) {
-          // We generally expect that file vnames have no signature.
-          // If this happens, we'll emit a warning, but we'll also be sure to
-          // keep the signature around as a suffix when building vnames for
-          // contexts.
-          LOG(WARNING) << "Input " << input_vname.DebugString()
-                       << " has a nonempty signature.\n";
-        }
-        for (const auto& row : context_rows) {
-          // If we have a (r, h, c) entry, we'd better have an input entry for
-          // the file included at h with context c (otherwise the index file
-          // isn't well-formed). We therefore only need to claim each unique
-          // row.
-          ++total_include_count_;
-          VName cxt_vname = input_vname;
-          cxt_vname.set_signature(row.source_context() +
-                                  input_vname.signature());
-          auto input_insert_result =
-              claimables_.emplace(cxt_vname, Claimable{cxt_vname, nullptr});
-          input_insert_result.first->second.claimants.insert(
-              &insert_result.first->second);
-        }
-      } else {
-        ++total_include_count_;
-        auto input_insert_result = claimables_.emplace(
-            input.v_name(), Claimable{input.v_name(), nullptr});
-        input_insert_result.first->second.claimants.insert(
-            &insert_result.first->second);
-      }
+    total_input_count_ += claims.input_count;
+    total_include_count_ += claims.include_count;
+    for (const auto& vname : claims.claimables) {
+      auto input_insert_result =
+          claimables_.emplace(vname, Claimable{vname, nullptr});
+      input_insert_result.first->second.claimants.insert(
+          &insert_result.first->second);
     }
   }
 
@@ -254,20 +321,54 @@ int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   absl::SetProgramUsageMessage("static_claim: assign ownership for analysis");
   absl::ParseCommandLine(argc, argv);
+  std::vector<std::string> index_files;
   std::string next_index_file;
-  ClaimTool tool;
   while (std::getline(std::cin, next_index_file)) {
     if (next_index_file.empty()) {
       continue;
     }
-    for (CompilationUnit unit : ReadCompilationUnits(next_index_file)) {
-      tool.HandleCompilationUnit(unit);
-    }
+    index_files.push_back(next_index_file);
   }
   if (!std::cin.eof()) {
     absl::FPrintF(stderr, "Error reading from standard input.\n");
     return 1;
   }
+  ClaimTool tool;
+  int jobs = std::max(absl::GetFlag(FLAGS_jobs), 1);
+  if (jobs == 1) {
+    for (const auto& index_file : index_files) {
+      for (CompilationUnit unit : ReadCompilationUnits(index_file)) {
+        tool.HandleCompilationUnit(unit);
+      }
+    }
+  } else {
+    // Workers read and digest kzips in parallel, recording their results per
+    // input file; the shards are then merged in input order so the output is
+    // identical to a single-threaded run.
+    std::vector<std::vector<CompilationClaims>> shards(index_files.size());
+    std::atomic<size_t> next_file{0};
+    std::vector<std::thread> workers;
+    workers.reserve(jobs);
+    for (int i = 0; i < jobs; ++i) {
+      workers.emplace_back([&] {
+        for (size_t file; (file = next_file.fetch_add(1)) < index_files.size();
+             /**/) {
+          for (const CompilationUnit& unit :
+               ReadCompilationUnits(index_files[file])) {
+            shards[file].push_back(ExtractClaims(unit));
+          }
+        }
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    for (const auto& shard : shards) {
+      for (const auto& claims : shard) {
+        tool.HandleClaims(claims);
+      }
+    }
+  }
   tool.AssignClaims();
   tool.WriteClaimFile(STDOUT_FILENO);
   if (absl::GetFlag(FLAGS_show_stats)) {
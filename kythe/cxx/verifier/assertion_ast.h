@@ -44,17 +44,14 @@ class SymbolTable {
 
   /// \brief Returns the `Symbol` associated with `string`, or makes a new one.
   Symbol intern(const std::string& string) {
-    const auto old = symbols_.find(string);
-    if (old != symbols_.end()) {
-      return old->second;
+    const auto inserted = symbols_.emplace(string, reverse_map_.size());
+    if (inserted.second) {
+      // Note that references to elements of `unordered_map` are not
+      // invalidated upon insert (really, upon rehash), so keeping around
+      // pointers in `reverse_map_` is safe.
+      reverse_map_.push_back(&inserted.first->first);
     }
-    Symbol next_symbol = reverse_map_.size();
-    symbols_[string] = next_symbol;
-    // Note that references to elements of `unordered_map` are not invalidated
-    // upon insert (really, upon rehash), so keeping around pointers in
-    // `reverse_map_` is safe.
-    reverse_map_.push_back(&symbols_.find(string)->first);
-    return next_symbol;
+    return inserted.first->second;
   }
   /// \brief Returns the text associated with `symbol`.
   const std::string& text(Symbol symbol) const { return *reverse_map_[symbol]; }
@@ -79,6 +76,14 @@ class SymbolTable {
     return reverse_map_.size() - 1;
   }
 
+  /// \brief Returns whether `symbol` was created by `unique()`.
+  bool IsUnique(Symbol symbol) const {
+    return reverse_map_[symbol] == &unique_symbol_;
+  }
+
+  /// \brief Returns the number of `Symbol`s issued so far.
+  size_t size() const { return reverse_map_.size(); }
+
  private:
   /// Maps text to unique `Symbol`s.
   std::unordered_map<std::string, Symbol> symbols_;
@@ -138,8 +143,10 @@ class Arena {
   const size_t kPointerSize = sizeof(void*);
   /// `kPointerSize` (a power of two) sign-extended from its first set bit.
   const size_t kPointerSizeMask = ((~kPointerSize) + 1);
-  /// The size of allocation requests to make from the normal heap.
-  const size_t kBlockSize = 1024 * 64;
+  /// The size of allocation requests to make from the normal heap. Large
+  /// fact files allocate tens of millions of nodes, so use big blocks to
+  /// keep the heap metadata overhead (and block-chaining frequency) low.
+  const size_t kBlockSize = 1024 * 1024;
 
   /// The next offset in the current block to allocate. Should always be
   /// `<= kBlockSize`. If it is `== kBlockSize`, the current block is
@@ -311,6 +318,9 @@ class Identifier : public AstNode {
       : AstNode(location), symbol_(symbol) {}
   /// \brief The `Symbol` this `Identifier` represents.
   Symbol symbol() const { return symbol_; }
+  /// \brief Rebinds this `Identifier` to `symbol`. Used only when merging
+  /// chunk-local symbols into a global `SymbolTable`.
+  void set_symbol(Symbol symbol) { symbol_ = symbol; }
   Identifier* AsIdentifier() override { return this; }
   void Dump(const SymbolTable&, PrettyPrinter*) override;
 
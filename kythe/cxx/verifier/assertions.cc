@@ -16,6 +16,7 @@
 
 #include "assertions.h"
 
+#include <cstring>
 #include <sstream>
 
 #include "kythe/cxx/common/file_utils.h"
@@ -86,6 +87,23 @@ bool AssertionParser::ParseInlineRuleString(const std::string& content,
   return result == 0 && !had_errors_;
 }
 
+bool AssertionParser::ParseInlinePremarkedString(
+    std::string* premarked, const std::string& fake_filename, Symbol path,
+    Symbol root, Symbol corpus) {
+  path_ = path;
+  root_ = root;
+  corpus_ = corpus;
+  had_errors_ = false;
+  files_.push_back(fake_filename);
+  ResetLine();
+  SetScanBuffer(premarked, trace_lex_);
+  yy::AssertionParserImpl parser(*this);
+  parser.set_debug_level(trace_parse_);
+  int result = parser.parse();
+  ScanEnd(last_eof_, last_eof_ofs_);
+  return result == 0 && !had_errors_;
+}
+
 bool AssertionParser::ParseInlineRuleFile(const std::string& filename,
                                           Symbol path, Symbol root,
                                           Symbol corpus,
@@ -506,24 +524,47 @@ void AssertionParser::ExitGoalGroup(const yy::location& location) {
   inside_goal_group_ = false;
 }
 
-void AssertionParser::ScanBeginString(const RE2& goal_comment_regex,
-                                      const std::string& data,
-                                      bool trace_scanning) {
+void AssertionParser::BuildScanBuffer(const RE2& goal_comment_regex,
+                                      const std::string& goal_marker,
+                                      absl::string_view data,
+                                      std::string* out) {
   // Preprocess the input by adding a - to the left of every goal line and a
   // . to the left of every non-goal line. From every goal line remove any
   // character that is not part of the goal regex's capture group. This means
   // that we don't have to push RE2 deeper into the lexer; it also preserves
   // file locations for diagnostics (after taking into account the constant
   // 1 offset).
-  std::string yy_buf;
+  std::string& yy_buf = *out;
+  yy_buf.clear();
+  yy_buf.reserve(data.size() + 2);
+  // When the goal regex was built from a literal prefix, a line without that
+  // prefix can't match; a memchr sweep rejects it without running RE2.
+  auto line_may_be_goal = [&](const char* begin, size_t length) {
+    if (goal_marker.empty()) {
+      return true;
+    }
+    const char* end = begin + length;
+    const char* candidate = begin;
+    while ((candidate = static_cast<const char*>(memchr(
+                candidate, goal_marker[0], end - candidate))) != nullptr) {
+      if (static_cast<size_t>(end - candidate) >= goal_marker.size() &&
+          memcmp(candidate, goal_marker.data(), goal_marker.size()) == 0) {
+        return true;
+      }
+      ++candidate;
+    }
+    return false;
+  };
   size_t next_line_begin = 0;
   auto append_line = [&](size_t line_end) {
     re2::StringPiece match_region;
     size_t line_length = line_end - next_line_begin;
-    auto is_goal = RE2::FullMatch(
-        re2::StringPiece(data.data() + next_line_begin, line_length),
-        goal_comment_regex, &match_region);
-    if (is_goal == 1) {
+    auto is_goal =
+        line_may_be_goal(data.data() + next_line_begin, line_length) &&
+        RE2::FullMatch(
+            re2::StringPiece(data.data() + next_line_begin, line_length),
+            goal_comment_regex, &match_region);
+    if (is_goal) {
       yy_buf.push_back('-');
       size_t pre_pad = match_region.data() - data.data() - next_line_begin;
       for (size_t s = 0; s < pre_pad; ++s) {
@@ -536,7 +577,7 @@ void AssertionParser::ScanBeginString(const RE2& goal_comment_regex,
       }
     } else {
       yy_buf.push_back('.');
-      yy_buf.append(data, next_line_begin, line_length);
+      yy_buf.append(data.data() + next_line_begin, line_length);
     }
     if (line_end != data.size()) {
       yy_buf.push_back('\n');
@@ -544,12 +585,18 @@ void AssertionParser::ScanBeginString(const RE2& goal_comment_regex,
     next_line_begin = line_end + 1;
   };
   auto endline = data.find('\n');
-  while (endline != std::string::npos) {
+  while (endline != absl::string_view::npos) {
     append_line(endline);
     endline = data.find('\n', next_line_begin);
   }
   append_line(data.size());
-  SetScanBuffer(yy_buf, trace_scanning);
+}
+
+void AssertionParser::ScanBeginString(const RE2& goal_comment_regex,
+                                      absl::string_view data,
+                                      bool trace_scanning) {
+  BuildScanBuffer(goal_comment_regex, goal_marker_hint_, data, &scan_buffer_);
+  SetScanBuffer(&scan_buffer_, trace_scanning);
 }
 
 void AssertionParser::ScanBeginFile(const RE2& goal_comment_regex,
@@ -558,8 +605,10 @@ void AssertionParser::ScanBeginFile(const RE2& goal_comment_regex,
     Error("will not read goals from stdin");
     exit(EXIT_FAILURE);
   }
-  std::string buffer = LoadFileOrDie(file());
-  ScanBeginString(goal_comment_regex, buffer, trace_scanning);
+  auto buffer = MappedFile::Open(file());
+  CHECK(buffer.ok()) << "Couldn't open input file " << file() << ": "
+                     << buffer.status();
+  ScanBeginString(goal_comment_regex, buffer->content(), trace_scanning);
 }
 
 }  // namespace verifier
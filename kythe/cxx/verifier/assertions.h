@@ -21,6 +21,8 @@
 #include <unordered_map>
 #include <vector>
 
+#include "absl/strings/string_view.h"
+
 namespace yy {
 class AssertionParserImpl;
 }
@@ -77,6 +79,34 @@ class AssertionParser {
                              Symbol root, Symbol corpus,
                              const RE2& goal_comment_regex);
 
+  /// \brief Like `ParseInlineRuleString`, but scanning `premarked`, a buffer
+  /// previously prepared by `BuildScanBuffer`.
+  ///
+  /// The lexer scans `premarked` in place, so it must stay live and owned by
+  /// the caller until this returns.
+  /// \return true if there were no errors
+  bool ParseInlinePremarkedString(std::string* premarked,
+                                  const std::string& fake_filename, Symbol path,
+                                  Symbol root, Symbol corpus);
+
+  /// \brief Preprocesses `data` into the premarked form the lexer scans.
+  ///
+  /// This is a pure function of its arguments, so buffers for distinct files
+  /// may be built concurrently and later consumed one at a time by
+  /// `ParseInlinePremarkedString`.
+  /// \param goal_marker If nonempty, a literal substring every goal line must
+  /// contain. Lines without it are marked as non-goals with a memchr scan and
+  /// never touch `goal_comment_regex`.
+  static void BuildScanBuffer(const RE2& goal_comment_regex,
+                              const std::string& goal_marker,
+                              absl::string_view data, std::string* out);
+
+  /// \brief Sets the literal substring used to pre-filter goal lines.
+  /// \sa BuildScanBuffer
+  void SetGoalMarkerHint(const std::string& marker) {
+    goal_marker_hint_ = marker;
+  }
+
   /// \brief The name of the current file being read. It is safe to take
   /// the address of this string (which shares the lifetime of this object.)
   std::string& file() { return files_.back(); }
@@ -121,9 +151,11 @@ class AssertionParser {
   friend class yy::AssertionParserImpl;
 
   /// \brief Sets the scan buffer to a premarked string and turns on
-  /// tracing.
+  /// tracing. The lexer scans `scan_buffer` in place (appending the
+  /// terminator characters flex requires), so the string must stay live
+  /// and unmodified until `ScanEnd`.
   /// \note Implemented in `assertions.lex`.
-  void SetScanBuffer(const std::string& scan_buffer, bool trace_scanning);
+  void SetScanBuffer(std::string* scan_buffer, bool trace_scanning);
 
   /// \brief Resets recorded source text.
   void ResetLine();
@@ -170,7 +202,7 @@ class AssertionParser {
 
   /// \brief Initializes the lexer to scan from a string.
   /// \param goal_comment_regex regex to identify goal comments.
-  void ScanBeginString(const RE2& goal_comment_regex, const std::string& data,
+  void ScanBeginString(const RE2& goal_comment_regex, absl::string_view data,
                        bool trace_scanning);
 
   /// \brief Handles end-of-scan actions and destroys any buffers.
@@ -315,6 +347,12 @@ class AssertionParser {
   /// Files we've parsed or are parsing (pushed onto the back).
   /// Note that location records will have internal pointers to these strings.
   std::deque<std::string> files_;
+  /// Preprocessed goal text for the file currently being scanned. Kept as a
+  /// member so its storage is reused when many small goal files are parsed
+  /// in sequence; the lexer scans it in place.
+  std::string scan_buffer_;
+  /// \sa SetGoalMarkerHint
+  std::string goal_marker_hint_;
   std::string line_;
   /// Did we encounter errors during lexing or parsing?
   bool had_errors_ = false;
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fact_snapshot.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
+namespace kythe {
+namespace verifier {
+namespace {
+
+/// The on-disk layout is the header, `string_count` `uint32_t` string
+/// lengths, the concatenated string bytes (zero-padded to a multiple of
+/// four so the record array stays aligned), then `fact_count` records.
+struct SnapshotHeader {
+  /// Identifies the format; bump the trailing digit on layout changes.
+  char magic[8];
+  /// 0x01020304 in the writer's byte order; snapshots are host-local caches
+  /// and are rejected rather than byte-swapped on mismatch.
+  uint32_t endian;
+  /// Reserved; zero.
+  uint32_t reserved;
+  /// The number of string table entries.
+  uint64_t string_count;
+  /// The padded length of the concatenated string bytes.
+  uint64_t string_bytes;
+  /// The number of fact records.
+  uint64_t fact_count;
+};
+
+constexpr char kSnapshotMagic[8] = {'K', 'y', 'F', 'a', 'c', 't', 'S', '1'};
+constexpr uint32_t kEndianCheck = 0x01020304;
+
+}  // anonymous namespace
+
+uint32_t FactSnapshotWriter::InternString(absl::string_view text) {
+  auto it = string_ids_.find(text);
+  if (it != string_ids_.end()) {
+    return it->second;
+  }
+  uint32_t id = strings_.size();
+  strings_.emplace_back(text);
+  string_ids_.emplace(strings_.back(), id);
+  return id;
+}
+
+void FactSnapshotWriter::AddEntry(const kythe::proto::Entry& entry) {
+  FactSnapshotRecord record;
+  record.flags = (entry.has_source() ? FactSnapshotRecord::kHasSource : 0) |
+                 (entry.has_target() ? FactSnapshotRecord::kHasTarget : 0);
+  auto intern_vname = [&](const kythe::proto::VName& vname, uint32_t* fields) {
+    fields[0] = InternString(vname.signature());
+    fields[1] = InternString(vname.corpus());
+    fields[2] = InternString(vname.root());
+    fields[3] = InternString(vname.path());
+    fields[4] = InternString(vname.language());
+  };
+  intern_vname(entry.source(), record.source);
+  record.edge_kind = InternString(entry.edge_kind());
+  intern_vname(entry.target(), record.target);
+  record.fact_name = InternString(entry.fact_name());
+  record.fact_value = InternString(entry.fact_value());
+  records_.push_back(record);
+}
+
+bool FactSnapshotWriter::Write(const std::string& path) const {
+  std::string tmp_path = absl::StrCat(path, ".", getpid(), ".tmp");
+  FILE* file = ::fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  auto write_all = [&](const void* data, size_t size) {
+    return size == 0 || ::fwrite(data, size, 1, file) == 1;
+  };
+  uint64_t string_bytes = 0;
+  for (const std::string& text : strings_) {
+    string_bytes += text.size();
+  }
+  size_t padding = (4 - string_bytes % 4) % 4;
+  string_bytes += padding;
+  SnapshotHeader header;
+  memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.endian = kEndianCheck;
+  header.reserved = 0;
+  header.string_count = strings_.size();
+  header.string_bytes = string_bytes;
+  header.fact_count = records_.size();
+  bool ok = write_all(&header, sizeof(header));
+  for (const std::string& text : strings_) {
+    uint32_t length = text.size();
+    ok = ok && write_all(&length, sizeof(length));
+  }
+  for (const std::string& text : strings_) {
+    ok = ok && write_all(text.data(), text.size());
+  }
+  const char zeros[4] = {0, 0, 0, 0};
+  ok = ok && write_all(zeros, padding);
+  ok = ok &&
+       write_all(records_.data(), records_.size() * sizeof(FactSnapshotRecord));
+  if (::fclose(file) != 0) {
+    ok = false;
+  }
+  if (!ok || ::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<FactSnapshot> FactSnapshot::Load(const std::string& path) {
+  StatusOr<MappedFile> file = MappedFile::Open(path);
+  if (!file) {
+    return nullptr;
+  }
+  auto snapshot = absl::WrapUnique(new FactSnapshot(std::move(*file)));
+  absl::string_view content = snapshot->file_.content();
+  if (content.size() < sizeof(SnapshotHeader)) {
+    return nullptr;
+  }
+  SnapshotHeader header;
+  memcpy(&header, content.data(), sizeof(header));
+  if (memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0 ||
+      header.endian != kEndianCheck) {
+    return nullptr;
+  }
+  size_t offset = sizeof(header);
+  if (header.string_count > (content.size() - offset) / sizeof(uint32_t)) {
+    return nullptr;
+  }
+  const uint32_t* lengths =
+      reinterpret_cast<const uint32_t*>(content.data() + offset);
+  offset += header.string_count * sizeof(uint32_t);
+  if (header.string_bytes % 4 != 0 ||
+      header.string_bytes > content.size() - offset) {
+    return nullptr;
+  }
+  const char* bytes = content.data() + offset;
+  offset += header.string_bytes;
+  if (header.fact_count >
+      (content.size() - offset) / sizeof(FactSnapshotRecord)) {
+    return nullptr;
+  }
+  snapshot->records_ =
+      reinterpret_cast<const FactSnapshotRecord*>(content.data() + offset);
+  snapshot->fact_count_ = header.fact_count;
+  snapshot->strings_.reserve(header.string_count);
+  size_t string_offset = 0;
+  for (uint64_t i = 0; i < header.string_count; ++i) {
+    if (lengths[i] > header.string_bytes - string_offset) {
+      return nullptr;
+    }
+    snapshot->strings_.emplace_back(bytes + string_offset, lengths[i]);
+    string_offset += lengths[i];
+  }
+  // Every record's string ids must land in the table.
+  for (size_t i = 0; i < snapshot->fact_count_; ++i) {
+    const FactSnapshotRecord& record = snapshot->records_[i];
+    const uint32_t ids[] = {record.source[0], record.source[1],
+                            record.source[2], record.source[3],
+                            record.source[4], record.edge_kind,
+                            record.target[0], record.target[1],
+                            record.target[2], record.target[3],
+                            record.target[4], record.fact_name,
+                            record.fact_value};
+    for (uint32_t id : ids) {
+      if (id >= snapshot->strings_.size()) {
+        return nullptr;
+      }
+    }
+  }
+  return snapshot;
+}
+
+}  // namespace verifier
+}  // namespace kythe
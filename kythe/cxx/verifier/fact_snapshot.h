@@ -0,0 +1,130 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KYTHE_CXX_VERIFIER_FACT_SNAPSHOT_H_
+#define KYTHE_CXX_VERIFIER_FACT_SNAPSHOT_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "kythe/cxx/common/file_utils.h"
+#include "kythe/proto/storage.pb.h"
+
+namespace kythe {
+namespace verifier {
+
+/// \brief One fact in snapshot form. String-valued fields are indices into
+/// the snapshot's string table, so a record is fixed-width and a snapshot
+/// file can be consumed directly out of a memory mapping.
+struct FactSnapshotRecord {
+  /// `flags` bit set when the fact had a source VName. (A missing VName and
+  /// an empty one convert to different facts.)
+  static constexpr uint32_t kHasSource = 1;
+  /// `flags` bit set when the fact had a target VName.
+  static constexpr uint32_t kHasTarget = 2;
+
+  /// A combination of `kHasSource` and `kHasTarget`.
+  uint32_t flags;
+  /// The source VName's signature, corpus, root, path, and language.
+  uint32_t source[5];
+  /// The edge kind.
+  uint32_t edge_kind;
+  /// The target VName's signature, corpus, root, path, and language.
+  uint32_t target[5];
+  /// The fact name.
+  uint32_t fact_name;
+  /// The fact value.
+  uint32_t fact_value;
+};
+
+/// \brief Accumulates an entry stream in snapshot form: a table of unique
+/// strings plus one `FactSnapshotRecord` per fact.
+///
+/// Later runs load the written file with `FactSnapshot::Load` and feed it to
+/// `Verifier::AssertSnapshotFacts`, skipping proto decoding entirely and
+/// interning each unique string once instead of once per occurrence.
+class FactSnapshotWriter {
+ public:
+  /// \brief Appends `entry` to the snapshot.
+  void AddEntry(const kythe::proto::Entry& entry);
+
+  /// \brief Writes the snapshot to `path`.
+  ///
+  /// Write-then-rename, so concurrent runs never observe a torn snapshot.
+  /// \return false if the file could not be written.
+  bool Write(const std::string& path) const;
+
+  /// \brief The number of facts added so far.
+  size_t fact_count() const { return records_.size(); }
+
+ private:
+  /// \brief Returns the string table index for `text`, adding it if new.
+  uint32_t InternString(absl::string_view text);
+
+  /// Unique strings in first-seen order; a string's index is its id.
+  std::vector<std::string> strings_;
+  /// Maps each string in `strings_` to its index.
+  absl::flat_hash_map<std::string, uint32_t> string_ids_;
+  /// One record per fact, in stream order.
+  std::vector<FactSnapshotRecord> records_;
+};
+
+/// \brief A read-only view over a snapshot file written by
+/// `FactSnapshotWriter`.
+///
+/// The string table and record array are used in place out of the mapping;
+/// nothing is copied or decoded at load time.
+class FactSnapshot {
+ public:
+  /// \brief Opens the snapshot at `path`.
+  /// \return null if the file is missing, malformed, or from an incompatible
+  /// writer.
+  static std::unique_ptr<FactSnapshot> Load(const std::string& path);
+
+  /// \brief The number of unique strings in the snapshot.
+  size_t string_count() const { return strings_.size(); }
+  /// \brief The string with id `index`; valid for this object's lifetime.
+  absl::string_view string(uint32_t index) const { return strings_[index]; }
+  /// \brief The number of fact records in the snapshot.
+  size_t fact_count() const { return fact_count_; }
+  /// \brief The `index`th fact record.
+  const FactSnapshotRecord& record(size_t index) const {
+    return records_[index];
+  }
+  /// \brief The raw snapshot bytes (e.g., for content hashing).
+  absl::string_view content() const { return file_.content(); }
+
+ private:
+  explicit FactSnapshot(MappedFile file) : file_(std::move(file)) {}
+
+  /// The mapping that backs `strings_` and `records_`.
+  MappedFile file_;
+  /// Views into `file_`, one per string table entry.
+  std::vector<absl::string_view> strings_;
+  /// The record array inside `file_`.
+  const FactSnapshotRecord* records_ = nullptr;
+  /// The number of entries in `records_`.
+  size_t fact_count_ = 0;
+};
+
+}  // namespace verifier
+}  // namespace kythe
+
+#endif  // KYTHE_CXX_VERIFIER_FACT_SNAPSHOT_H_
@@ -21,8 +21,17 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <thread>
+#include <utility>
+
 #include "absl/memory/memory.h"
 #include "assertions.h"
+#include "fact_snapshot.h"
 #include "glog/logging.h"
 #include "google/protobuf/text_format.h"
 #include "kythe/cxx/common/kythe_uri.h"
@@ -325,6 +334,69 @@ static bool FastLookupFactLessThan(AstNode* a, AstNode* b) {
   return false;
 }
 
+/// \brief Returns whether all five fields of a VName key are concrete.
+static bool VNameKeyComplete(Identifier* const* vname) {
+  for (size_t i = 0; i < 5; ++i) {
+    if (vname[i] == nullptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// \brief Hashes the five (uniqued) symbols of a VName key. Used to build
+/// and probe the secondary fact indexes; collisions are resolved by
+/// unification.
+static uint64_t VNameIdentHash(Identifier* const* vname) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < 5; ++i) {
+    hash = (hash ^ static_cast<uint64_t>(vname[i]->symbol())) *
+           1099511628211ull;
+  }
+  return hash;
+}
+
+/// \brief If `node` is a `vname(...)` application over five identifiers,
+/// returns its hash through `hash`.
+static bool HashVNameNode(AstNode* vname_head, AstNode* node, uint64_t* hash) {
+  auto* app = node->AsApp();
+  if (app == nullptr || app->lhs() != vname_head) {
+    return false;
+  }
+  Tuple* tuple = app->rhs()->AsTuple();
+  if (tuple == nullptr || tuple->size() != 5) {
+    return false;
+  }
+  Identifier* fields[5];
+  for (size_t i = 0; i < 5; ++i) {
+    fields[i] = tuple->element(i)->AsIdentifier();
+    if (fields[i] == nullptr) {
+      return false;
+    }
+  }
+  *hash = VNameIdentHash(fields);
+  return true;
+}
+
+// Orders anchor entries by their (begin, end) offset ranges. The mixed
+// overloads let binary searches use a bare offset range as the key.
+struct AnchorRangeLess {
+  bool operator()(const AnchorMap::value_type& lhs,
+                  const AnchorMap::value_type& rhs) const {
+    return lhs.first < rhs.first;
+  }
+  bool operator()(const AnchorMap::value_type& lhs,
+                  const std::pair<size_t, size_t>& rhs) const {
+    return lhs.first < rhs;
+  }
+  bool operator()(const std::pair<size_t, size_t>& lhs,
+                  const AnchorMap::value_type& rhs) const {
+    return lhs < rhs.first;
+  }
+};
+
+void CollectEVars(AstNode* node, std::set<EVar*>* evars);
+
 // The Solver acts in a closed world: any universal quantification can be
 // exhaustively tested against database facts.
 // Based on _A Semi-Functional Implementation of a Higher-Order Logic
@@ -337,8 +409,7 @@ class Solver {
  public:
   using Inspection = AssertionParser::Inspection;
 
-  Solver(Verifier* context, Database& database,
-         std::multimap<std::pair<size_t, size_t>, AstNode*>& anchors,
+  Solver(Verifier* context, Database& database, const AnchorMap& anchors,
          std::function<bool(Verifier*, const Inspection&)>& inspect)
       : context_(*context),
         database_(database),
@@ -439,6 +510,30 @@ class Solver {
         if (auto* tuple = app->rhs()->AsTuple()) {
           if (tuple->size() == 5) {
             AtomFactKey key(context_.vname_id(), tuple);
+            if (key.edge_kind == nullptr) {
+              // The sort-order prefix is unbound, so the binary search below
+              // would degenerate to a scan; try the secondary vname indexes.
+              const std::unordered_multimap<uint64_t, AstNode*>* index =
+                  nullptr;
+              uint64_t hash = 0;
+              if (VNameKeyComplete(key.source_vname)) {
+                index = &context_.source_fact_index();
+                hash = VNameIdentHash(key.source_vname);
+              } else if (VNameKeyComplete(key.target_vname)) {
+                index = &context_.target_fact_index();
+                hash = VNameIdentHash(key.target_vname);
+              }
+              if (index != nullptr) {
+                auto range = index->equal_range(hash);
+                for (auto i = range.first; i != range.second; ++i) {
+                  ThunkRet exc = Unify(atom, i->second, cut, f);
+                  if (exc != kNoException) {
+                    return exc;
+                  }
+                }
+                return kNoException;
+              }
+            }
             // Make use of the fast lookup sort order.
             auto begin = std::lower_bound(database_.begin(), database_.end(),
                                           &key, FastLookupFactLessThanKey);
@@ -488,7 +583,9 @@ class Solver {
     if (auto* tu = MatchEqualsArgs(atom)) {
       if (Range* r = tu->element(0)->AsRange()) {
         auto anchors =
-            anchors_.equal_range(std::make_pair(r->begin(), r->end()));
+            std::equal_range(anchors_.begin(), anchors_.end(),
+                             std::make_pair(r->begin(), r->end()),
+                             AnchorRangeLess{});
         if (anchors.first == anchors.second) {
           // There's no anchor with this range in the database.
           // This goal can therefore never succeed.
@@ -519,17 +616,134 @@ class Solver {
     }
   }
 
-  ThunkRet SolveGoalArray(AssertionParser::GoalGroup* group, size_t cur,
+  /// \brief Estimates how many candidate bindings `goal` would enumerate if
+  /// solved while the EVars in `bound` carry assignments.
+  ///
+  /// Goals the executor can answer with an index probe right now are counted
+  /// exactly against the database; goals whose selectivity depends on
+  /// earlier bindings get fixed tier costs between "indexed" and "scan".
+  size_t EstimateGoalCost(AstNode* goal, const std::set<EVar*>& evars,
+                          const std::set<EVar*>& bound) {
+    // Equality constraints only bind or test; they are never worth delaying.
+    if (MatchEqualsArgs(goal) != nullptr) {
+      return 0;
+    }
+    size_t free_evars = 0;
+    for (EVar* evar : evars) {
+      if (evar->current() == nullptr && bound.find(evar) == bound.end()) {
+        ++free_evars;
+      }
+    }
+    if (auto* app = goal->AsApp()) {
+      if (app->lhs() == context_.fact_id()) {
+        if (auto* tuple = app->rhs()->AsTuple()) {
+          if (tuple->size() == 5) {
+            AtomFactKey key(context_.vname_id(), tuple);
+            if (key.edge_kind != nullptr) {
+              // The fast-lookup sort order applies; count the candidate
+              // range exactly.
+              auto begin =
+                  std::lower_bound(database_.begin(), database_.end(), &key,
+                                   FastLookupFactLessThanKey);
+              auto end = std::upper_bound(database_.begin(), database_.end(),
+                                          &key, FastLookupKeyLessThanFact);
+              return static_cast<size_t>(end - begin) + free_evars;
+            }
+            if (VNameKeyComplete(key.source_vname)) {
+              return context_.source_fact_index().count(
+                         VNameIdentHash(key.source_vname)) +
+                     free_evars;
+            }
+            if (VNameKeyComplete(key.target_vname)) {
+              return context_.target_fact_index().count(
+                         VNameIdentHash(key.target_vname)) +
+                     free_evars;
+            }
+            // Nothing is bound yet, but earlier planned goals may bind
+            // enough for an indexed probe at execution time.
+            constexpr size_t kPrefixBoundCost = 16;
+            constexpr size_t kVNameBoundCost = 64;
+            auto will_be_ground = [&](AstNode* node) {
+              std::set<EVar*> node_evars;
+              CollectEVars(node, &node_evars);
+              for (EVar* evar : node_evars) {
+                if (evar->current() == nullptr &&
+                    bound.find(evar) == bound.end()) {
+                  return false;
+                }
+              }
+              return true;
+            };
+            if (will_be_ground(tuple->element(1))) {
+              return kPrefixBoundCost + free_evars;
+            }
+            if (will_be_ground(tuple->element(0)) ||
+                will_be_ground(tuple->element(2))) {
+              return kVNameBoundCost + free_evars;
+            }
+          }
+        }
+      }
+    }
+    return database_.size() + free_evars;
+  }
+
+  /// \brief Computes a solve order for `group`'s goals, most selective
+  /// first.
+  ///
+  /// A greedy join plan: repeatedly pick the cheapest remaining goal under
+  /// the current binding set (ties broken by program order, so plans are
+  /// deterministic), then treat its EVars as bound for the goals that
+  /// follow. Conjunctive goals within a group are order-independent, so
+  /// reordering only changes how much backtracking the executor does.
+  std::vector<size_t> PlanGoalOrder(AssertionParser::GoalGroup* group) {
+    size_t goal_count = group->goals.size();
+    std::vector<std::set<EVar*>> goal_evars(goal_count);
+    for (size_t i = 0; i < goal_count; ++i) {
+      CollectEVars(group->goals[i], &goal_evars[i]);
+    }
+    std::set<EVar*> bound;
+    std::vector<bool> planned(goal_count, false);
+    std::vector<size_t> plan;
+    plan.reserve(goal_count);
+    while (plan.size() < goal_count) {
+      size_t best = goal_count;
+      size_t best_cost = 0;
+      for (size_t i = 0; i < goal_count; ++i) {
+        if (planned[i]) {
+          continue;
+        }
+        size_t cost = EstimateGoalCost(group->goals[i], goal_evars[i], bound);
+        if (best == goal_count || cost < best_cost) {
+          best = i;
+          best_cost = cost;
+        }
+      }
+      planned[best] = true;
+      plan.push_back(best);
+      bound.insert(goal_evars[best].begin(), goal_evars[best].end());
+    }
+    return plan;
+  }
+
+  ThunkRet SolveGoalArray(AssertionParser::GoalGroup* group,
+                          const std::vector<size_t>* plan, size_t cur,
                           ThunkRet cut, Thunk f) {
-    if (cur > highest_goal_reached_) {
-      highest_goal_reached_ = cur;
+    size_t goal_index =
+        (plan != nullptr && cur < plan->size()) ? (*plan)[cur] : cur;
+    if (cur >= highest_goal_position_) {
+      // Report progress in terms of the original goal index so error dumps
+      // point at real goals even when a plan reordered them.
+      highest_goal_position_ = cur;
+      highest_goal_reached_ = goal_index;
     }
     if (cur == group->goals.size()) {
       return f();
     }
-    return SolveGoal(group->goals[cur], cut, [this, group, cur, cut, &f]() {
-      return SolveGoalArray(group, cur + 1, cut, f);
-    });
+    return SolveGoal(group->goals[goal_index], cut,
+                     [this, group, plan, cur, cut, &f]() {
+                       return SolveGoalArray(group, plan, cur + 1, cut, f);
+                     });
   }
 
   bool PerformInspection() {
@@ -547,9 +761,15 @@ class Solver {
       auto* group = &context->groups()[cur];
       if (cur > highest_group_reached_) {
         highest_goal_reached_ = 0;
+        highest_goal_position_ = 0;
         highest_group_reached_ = cur;
       }
-      ThunkRet result = SolveGoalArray(group, 0, cut, [cut]() { return cut; });
+      std::vector<size_t> plan;
+      if (context_.goal_reordering()) {
+        plan = PlanGoalOrder(group);
+      }
+      ThunkRet result = SolveGoalArray(group, plan.empty() ? nullptr : &plan,
+                                       0, cut, [cut]() { return cut; });
       // Lots of unwinding later...
       if (result == cut) {
         // That last goal group succeeded.
@@ -573,6 +793,27 @@ class Solver {
     return exn == kSolved;
   }
 
+  /// \brief Solves only the goal group at `group_index`, without running
+  /// inspections.
+  /// \return the group's cut token if its goals were satisfied; otherwise
+  /// `kNoException`, `kImpossible`, or an error token.
+  ThunkRet SolveSingleGroup(size_t group_index) {
+    auto* group = &context_.parser()->groups()[group_index];
+    ThunkRet cut = kFirstCut + group_index;
+    std::vector<size_t> plan;
+    if (context_.goal_reordering()) {
+      plan = PlanGoalOrder(group);
+    }
+    return SolveGoalArray(group, plan.empty() ? nullptr : &plan, 0, cut,
+                          [cut]() { return cut; });
+  }
+
+  /// \brief The cut token `SolveSingleGroup` reports on success for
+  /// `group_index`.
+  static ThunkRet GroupCut(size_t group_index) {
+    return kFirstCut + group_index;
+  }
+
   size_t highest_group_reached() const { return highest_group_reached_; }
 
   size_t highest_goal_reached() const { return highest_goal_reached_; }
@@ -580,11 +821,47 @@ class Solver {
  private:
   Verifier& context_;
   Database& database_;
-  std::multimap<std::pair<size_t, size_t>, AstNode*>& anchors_;
+  const AnchorMap& anchors_;
   std::function<bool(Verifier*, const Inspection&)>& inspect_;
   size_t highest_group_reached_ = 0;
   size_t highest_goal_reached_ = 0;
+  /// The deepest position reached in the (possibly reordered) goal array;
+  /// `highest_goal_reached_` holds the original index of that goal.
+  size_t highest_goal_position_ = 0;
 };
+
+/// \brief Collects every `EVar` reachable from `node` into `evars`.
+void CollectEVars(AstNode* node, std::set<EVar*>* evars) {
+  if (node == nullptr) {
+    return;
+  }
+  if (EVar* evar = node->AsEVar()) {
+    evars->insert(evar);
+  } else if (App* app = node->AsApp()) {
+    CollectEVars(app->lhs(), evars);
+    CollectEVars(app->rhs(), evars);
+  } else if (Tuple* tuple = node->AsTuple()) {
+    for (size_t i = 0, c = tuple->size(); i != c; ++i) {
+      CollectEVars(tuple->element(i), evars);
+    }
+  }
+}
+
+/// \brief Returns whether `lhs` and `rhs` have any element in common.
+bool SetsIntersect(const std::set<EVar*>& lhs, const std::set<EVar*>& rhs) {
+  auto li = lhs.begin(), ri = rhs.begin();
+  while (li != lhs.end() && ri != rhs.end()) {
+    if (*li == *ri) {
+      return true;
+    }
+    if (*li < *ri) {
+      ++li;
+    } else {
+      ++ri;
+    }
+  }
+  return false;
+}
 }  // namespace
 
 Verifier::Verifier(bool trace_lex, bool trace_parse)
@@ -648,6 +925,10 @@ void Verifier::SetGoalCommentPrefix(const std::string& it) {
   std::string error;
   auto escaped = RE2::QuoteMeta(it);
   CHECK(SetGoalCommentRegex("\\s*" + escaped + "(.*)", &error)) << error;
+  // The regex is a literal prefix match, so lines without the prefix can be
+  // rejected with a substring scan.
+  goal_comment_marker_ = it;
+  parser_.SetGoalMarkerHint(goal_comment_marker_);
 }
 
 bool Verifier::SetGoalCommentRegex(const std::string& regex,
@@ -670,6 +951,8 @@ bool Verifier::SetGoalCommentRegex(const std::string& regex,
     }
   }
   goal_comment_regex_ = std::move(re2);
+  goal_comment_marker_.clear();
+  parser_.SetGoalMarkerHint(goal_comment_marker_);
   return true;
 }
 
@@ -710,6 +993,11 @@ bool Verifier::LoadInlineRuleFile(const std::string& filename) {
     LOG(ERROR) << "Can't read " << filename;
     return false;
   }
+  return LoadInlineRuleContent(filename, content);
+}
+
+bool Verifier::LoadInlineRuleContent(const std::string& filename,
+                                     const std::string& content) {
   Symbol content_sym = symbol_table_.intern(content);
   if (file_vnames_) {
     auto vname = content_to_vname_.find(content_sym);
@@ -720,13 +1008,13 @@ bool Verifier::LoadInlineRuleFile(const std::string& filename) {
     return LoadInMemoryRuleFile(filename, vname->second, content_sym);
   } else {
     kythe::proto::VName empty;
-    auto* vname = ConvertVName(yy::location{}, empty);
+    auto* vname = ConvertVName(MainFactContext(), yy::location{}, empty);
     return LoadInMemoryRuleFile(filename, vname, content_sym);
   }
 }
 
 bool Verifier::LoadInMemoryRuleFile(const std::string& filename, AstNode* vname,
-                                    Symbol text) {
+                                    Symbol text, std::string* premarked) {
   Tuple* checked_tuple = nullptr;
   if (auto* app = vname->AsApp()) {
     if (auto* tuple = app->rhs()->AsTuple()) {
@@ -743,6 +1031,13 @@ bool Verifier::LoadInMemoryRuleFile(const std::string& filename, AstNode* vname,
   StringPrettyPrinter printer;
   vname->Dump(symbol_table_, &printer);
   fake_files_[printer.str()] = text;
+  if (premarked != nullptr) {
+    return parser_.ParseInlinePremarkedString(
+        premarked, filename.empty() ? printer.str() : filename,
+        checked_tuple->element(3)->AsIdentifier()->symbol(),
+        checked_tuple->element(2)->AsIdentifier()->symbol(),
+        checked_tuple->element(1)->AsIdentifier()->symbol());
+  }
   return parser_.ParseInlineRuleString(
       symbol_table_.text(text), filename.empty() ? printer.str() : filename,
       checked_tuple->element(3)->AsIdentifier()->symbol(),
@@ -916,9 +1211,18 @@ void Verifier::DumpErrorGoal(size_t group, size_t index) {
 
 bool Verifier::VerifyAllGoals(
     std::function<bool(Verifier*, const Solver::Inspection&)> inspect) {
+  // Deferred code facts only matter if some goal can reach the subgraphs
+  // they would produce.
+  if (!pending_code_facts_.empty() && GoalsTouchMarkedSource() &&
+      !MaterializeCodeFacts()) {
+    return false;
+  }
   if (!PrepareDatabase()) {
     return false;
   }
+  if (solver_threads_ > 1 && parser_.groups().size() > 1) {
+    return SolveGoalGroupsInParallel(inspect);
+  }
   Solver solver(this, facts_, anchors_, inspect);
   bool result = solver.Solve();
   highest_goal_reached_ = solver.highest_goal_reached();
@@ -926,6 +1230,92 @@ bool Verifier::VerifyAllGoals(
   return result;
 }
 
+bool Verifier::SolveGoalGroupsInParallel(
+    std::function<bool(Verifier*, const Solver::Inspection&)>& inspect) {
+  const auto& groups = parser_.groups();
+  // Find the EVars each group can bind. Groups with disjoint EVar sets can't
+  // observe each other's bindings, so they may be solved concurrently; a
+  // group that shares an EVar with an earlier group must wait for it.
+  std::vector<std::set<EVar*>> group_evars(groups.size());
+  for (size_t g = 0; g < groups.size(); ++g) {
+    for (AstNode* goal : groups[g].goals) {
+      CollectEVars(goal, &group_evars[g]);
+    }
+  }
+  // Batch together runs of consecutive, pairwise-independent groups. Closing
+  // a batch at the first conflict keeps dependent groups in program order.
+  std::vector<std::vector<size_t>> batches;
+  for (size_t g = 0; g < groups.size(); ++g) {
+    bool conflicts = batches.empty();
+    if (!batches.empty()) {
+      for (size_t member : batches.back()) {
+        if (SetsIntersect(group_evars[member], group_evars[g])) {
+          conflicts = true;
+          break;
+        }
+      }
+    }
+    if (conflicts) {
+      batches.emplace_back();
+    }
+    batches.back().push_back(g);
+  }
+  struct GroupResult {
+    ThunkRet ret = kNoException;
+    size_t highest_goal = 0;
+  };
+  std::vector<GroupResult> results(groups.size());
+  // Aggregation happens in program order after each batch, mirroring the
+  // sequential solver's verdict, counters, and inspection points.
+  Solver inspection_solver(this, facts_, anchors_, inspect);
+  for (const auto& batch : batches) {
+    size_t workers = std::min(solver_threads_, batch.size());
+    auto solve_stride = [&](size_t offset) {
+      for (size_t i = offset; i < batch.size(); i += workers) {
+        size_t group_index = batch[i];
+        Solver solver(this, facts_, anchors_, inspect);
+        results[group_index].ret = solver.SolveSingleGroup(group_index);
+        results[group_index].highest_goal = solver.highest_goal_reached();
+      }
+    };
+    if (workers <= 1) {
+      solve_stride(0);
+    } else {
+      std::vector<std::thread> threads;
+      threads.reserve(workers);
+      for (size_t w = 0; w < workers; ++w) {
+        threads.emplace_back(solve_stride, w);
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    }
+    for (size_t group_index : batch) {
+      highest_group_reached_ = group_index;
+      highest_goal_reached_ = results[group_index].highest_goal;
+      const auto& group = groups[group_index];
+      ThunkRet result = results[group_index].ret;
+      if (result == Solver::GroupCut(group_index)) {
+        // The group succeeded, but was expected to fail.
+        if (group.accept_if != AssertionParser::GoalGroup::kNoneMayFail) {
+          inspection_solver.PerformInspection();
+          return false;
+        }
+      } else if (result == kNoException || result == kImpossible) {
+        // The group failed, but was expected to succeed.
+        if (group.accept_if != AssertionParser::GoalGroup::kSomeMustFail) {
+          inspection_solver.PerformInspection();
+          return false;
+        }
+      } else {
+        // An error (e.g., an invalid program) escaped the group.
+        return false;
+      }
+    }
+  }
+  return inspection_solver.PerformInspection();
+}
+
 bool Verifier::VerifyAllGoals() {
   return VerifyAllGoals([this](Verifier* context,
                                const Solver::Inspection& inspection) {
@@ -1071,6 +1461,9 @@ bool Verifier::PrepareDatabase() {
   AstNode* last_anchor_vname = nullptr;
   AstNode* last_file_vname = nullptr;
   size_t last_anchor_start = ~0;
+  // File nodes whose text should be parsed for goals, deferred so their scan
+  // buffers can be premarked in parallel below.
+  std::vector<std::pair<AstNode*, Symbol>> pending_rule_files;
   for (size_t f = 0; f < facts_.size(); ++f) {
     AstNode* fb = facts_[f];
 
@@ -1097,11 +1490,8 @@ bool Verifier::PrepareDatabase() {
                  EncodedIdentEqualTo(tb->element(3), text_id_)) {
         if (EncodedVNameOrIdentEqualTo(last_file_vname, tb->element(0))) {
           if (assertions_from_file_nodes_) {
-            if (!LoadInMemoryRuleFile(
-                    "", tb->element(0),
-                    tb->element(4)->AsIdentifier()->symbol())) {
-              is_ok = false;
-            }
+            pending_rule_files.emplace_back(
+                tb->element(0), tb->element(4)->AsIdentifier()->symbol());
           } else {
             content_to_vname_[tb->element(4)->AsIdentifier()->symbol()] =
                 tb->element(0);
@@ -1203,60 +1593,164 @@ bool Verifier::PrepareDatabase() {
       is_ok = false;
     }
   }
+  if (!pending_rule_files.empty()) {
+    // Premarking (per-line goal detection) is a pure function of each file's
+    // text, so it can fan out across threads; parsing stays serial since the
+    // parser, arena, and symbol table are shared.
+    std::vector<std::string> premarked(pending_rule_files.size());
+    size_t worker_count =
+        std::min(pending_rule_files.size(),
+                 static_cast<size_t>(
+                     std::max(1u, std::thread::hardware_concurrency())));
+    if (worker_count > 1) {
+      std::atomic<size_t> next_file(0);
+      std::vector<std::thread> workers;
+      for (size_t w = 0; w < worker_count; ++w) {
+        workers.emplace_back([&] {
+          for (size_t i = next_file.fetch_add(1);
+               i < pending_rule_files.size(); i = next_file.fetch_add(1)) {
+            AssertionParser::BuildScanBuffer(
+                *goal_comment_regex_, goal_comment_marker_,
+                symbol_table_.text(pending_rule_files[i].second),
+                &premarked[i]);
+          }
+        });
+      }
+      for (auto& worker : workers) {
+        worker.join();
+      }
+    } else {
+      for (size_t i = 0; i < pending_rule_files.size(); ++i) {
+        AssertionParser::BuildScanBuffer(
+            *goal_comment_regex_, goal_comment_marker_,
+            symbol_table_.text(pending_rule_files[i].second), &premarked[i]);
+      }
+    }
+    for (size_t i = 0; i < pending_rule_files.size(); ++i) {
+      if (!LoadInMemoryRuleFile("", pending_rule_files[i].first,
+                                pending_rule_files[i].second,
+                                &premarked[i])) {
+        is_ok = false;
+      }
+    }
+  }
   if (is_ok) {
     std::sort(facts_.begin(), facts_.end(), FastLookupFactLessThan);
+    // Anchors were appended in fact order above; sort them once so goal
+    // solving can binary-search by offset range.
+    std::stable_sort(anchors_.begin(), anchors_.end(), AnchorRangeLess{});
+    // Build the secondary vname indexes used when a goal's edge kind is
+    // unbound (where the fast lookup sort order can't narrow the search).
+    source_fact_index_.clear();
+    target_fact_index_.clear();
+    for (AstNode* fact : facts_) {
+      Tuple* tuple = fact->AsApp()->rhs()->AsTuple();
+      uint64_t hash;
+      if (HashVNameNode(vname_id_, tuple->element(0), &hash)) {
+        source_fact_index_.emplace(hash, fact);
+      }
+      if (HashVNameNode(vname_id_, tuple->element(2), &hash)) {
+        target_fact_index_.emplace(hash, fact);
+      }
+    }
   }
   database_prepared_ = is_ok;
   return is_ok;
 }
 
-AstNode* Verifier::ConvertVName(const yy::location& loc,
+Verifier::FactContext Verifier::MainFactContext() {
+  return FactContext{&arena_, &symbol_table_, &facts_, nullptr,
+                     &pending_code_facts_, code_id_->AsIdentifier()->symbol()};
+}
+
+Identifier* Verifier::IdentifierFor(const FactContext& context,
+                                    const yy::location& location,
+                                    const std::string& token) {
+  Symbol symbol = context.symbols->intern(token);
+  auto* identifier = new (context.arena) Identifier(location, symbol);
+  if (context.identifiers != nullptr) {
+    context.identifiers->push_back(identifier);
+  }
+  return identifier;
+}
+
+AstNode* Verifier::MakePredicate(const FactContext& context,
+                                 const yy::location& location, AstNode* head,
+                                 std::initializer_list<AstNode*> values) {
+  size_t values_count = values.size();
+  AstNode** body =
+      (AstNode**)context.arena->New(values_count * sizeof(AstNode*));
+  size_t vn = 0;
+  for (AstNode* v : values) {
+    body[vn] = v;
+    ++vn;
+  }
+  AstNode* tuple = new (context.arena) Tuple(location, values_count, body);
+  return new (context.arena) App(location, head, tuple);
+}
+
+AstNode* Verifier::ConvertVName(const FactContext& context,
+                                const yy::location& loc,
                                 const kythe::proto::VName& vname) {
-  AstNode** values = (AstNode**)arena_.New(sizeof(AstNode*) * 5);
-  values[0] = vname.signature().empty() ? empty_string_id_
-                                        : IdentifierFor(loc, vname.signature());
-  values[1] = vname.corpus().empty() ? empty_string_id_
-                                     : IdentifierFor(loc, vname.corpus());
+  AstNode** values = (AstNode**)context.arena->New(sizeof(AstNode*) * 5);
+  values[0] = vname.signature().empty()
+                  ? empty_string_id_
+                  : IdentifierFor(context, loc, vname.signature());
+  values[1] = vname.corpus().empty()
+                  ? empty_string_id_
+                  : IdentifierFor(context, loc, vname.corpus());
   values[2] = vname.root().empty() ? empty_string_id_
-                                   : IdentifierFor(loc, vname.root());
+                                   : IdentifierFor(context, loc, vname.root());
   values[3] = vname.path().empty() ? empty_string_id_
-                                   : IdentifierFor(loc, vname.path());
-  values[4] = vname.language().empty() ? empty_string_id_
-                                       : IdentifierFor(loc, vname.language());
-  AstNode* tuple = new (&arena_) Tuple(loc, 5, values);
-  return new (&arena_) App(vname_id_, tuple);
+                                   : IdentifierFor(context, loc, vname.path());
+  values[4] = vname.language().empty()
+                  ? empty_string_id_
+                  : IdentifierFor(context, loc, vname.language());
+  AstNode* tuple = new (context.arena) Tuple(loc, 5, values);
+  return new (context.arena) App(vname_id_, tuple);
 }
 
 AstNode* Verifier::NewUniqueVName(const yy::location& loc) {
-  return MakePredicate(
-      loc, vname_id_,
-      {new (&arena_) Identifier(loc, symbol_table_.unique()), empty_string_id_,
-       empty_string_id_, empty_string_id_, empty_string_id_});
+  return NewUniqueVName(MainFactContext(), loc);
 }
 
-AstNode* Verifier::ConvertCodeFact(const yy::location& loc,
+AstNode* Verifier::NewUniqueVName(const FactContext& context,
+                                  const yy::location& loc) {
+  auto* unique_id =
+      new (context.arena) Identifier(loc, context.symbols->unique());
+  if (context.identifiers != nullptr) {
+    context.identifiers->push_back(unique_id);
+  }
+  return MakePredicate(context, loc, vname_id_,
+                       {unique_id, empty_string_id_, empty_string_id_,
+                        empty_string_id_, empty_string_id_});
+}
+
+AstNode* Verifier::ConvertCodeFact(const FactContext& context,
+                                   const yy::location& loc,
                                    const google::protobuf::string& code_data) {
   proto::common::MarkedSource marked_source;
   if (!marked_source.ParseFromString(code_data)) {
     std::cerr << loc << ": can't parse code protobuf" << std::endl;
     return nullptr;
   }
-  return ConvertMarkedSource(loc, marked_source);
+  return ConvertMarkedSource(context, loc, marked_source);
 }
 
 AstNode* Verifier::ConvertMarkedSource(
-    const yy::location& loc, const proto::common::MarkedSource& source) {
+    const FactContext& context, const yy::location& loc,
+    const proto::common::MarkedSource& source) {
   // Explode each MarkedSource message into a node with an unutterable vname.
-  auto* vname = NewUniqueVName(loc);
+  auto* vname = NewUniqueVName(context, loc);
   for (int child = 0; child < source.child_size(); ++child) {
-    auto* child_vname = ConvertMarkedSource(loc, source.child(child));
+    auto* child_vname = ConvertMarkedSource(context, loc, source.child(child));
     if (child_vname == nullptr) {
       return nullptr;
     }
-    facts_.push_back(MakePredicate(
-        loc, fact_id_,
+    context.facts->push_back(MakePredicate(
+        context, loc, fact_id_,
         {vname, marked_source_child_id_, child_vname, ordinal_id_,
-         IdentifierFor(builtin_location_, std::to_string(child))}));
+         IdentifierFor(context, builtin_location_, std::to_string(child))}));
   }
   for (const auto& link : source.link()) {
     if (link.definition_size() != 1) {
@@ -1268,14 +1762,15 @@ AstNode* Verifier::ConvertMarkedSource(
       std::cerr << loc << ": bad URI in link" << std::endl;
       return nullptr;
     }
-    facts_.push_back(MakePredicate(loc, fact_id_,
-                                   {vname, marked_source_link_id_,
-                                    ConvertVName(loc, from_uri.second.v_name()),
-                                    root_id_, empty_string_id_}));
+    context.facts->push_back(MakePredicate(
+        context, loc, fact_id_,
+        {vname, marked_source_link_id_,
+         ConvertVName(context, loc, from_uri.second.v_name()), root_id_,
+         empty_string_id_}));
   }
   auto emit_fact = [&](AstNode* fact_id, AstNode* fact_value) {
-    facts_.push_back(MakePredicate(
-        loc, fact_id_,
+    context.facts->push_back(MakePredicate(
+        context, loc, fact_id_,
         {vname, empty_string_id_, empty_string_id_, fact_id, fact_value}));
   };
   switch (source.kind()) {
@@ -1316,33 +1811,34 @@ AstNode* Verifier::ConvertMarkedSource(
     default:
       std::cerr << loc << ": unknown source kind for MarkedSource" << std::endl;
   }
-  emit_fact(marked_source_pre_text_id_, IdentifierFor(loc, source.pre_text()));
+  emit_fact(marked_source_pre_text_id_,
+            IdentifierFor(context, loc, source.pre_text()));
   emit_fact(marked_source_post_child_text_id_,
-            IdentifierFor(loc, source.post_child_text()));
+            IdentifierFor(context, loc, source.post_child_text()));
   emit_fact(marked_source_post_text_id_,
-            IdentifierFor(loc, source.post_text()));
+            IdentifierFor(context, loc, source.post_text()));
   emit_fact(marked_source_lookup_index_id_,
-            IdentifierFor(loc, std::to_string(source.lookup_index())));
-  emit_fact(
-      marked_source_default_children_count_id_,
-      IdentifierFor(loc, std::to_string(source.default_children_count())));
+            IdentifierFor(context, loc, std::to_string(source.lookup_index())));
+  emit_fact(marked_source_default_children_count_id_,
+            IdentifierFor(context, loc,
+                          std::to_string(source.default_children_count())));
   emit_fact(marked_source_add_final_list_token_id_,
             source.add_final_list_token() ? marked_source_true_id_
                                           : marked_source_false_id_);
   return vname;
 }
 
-bool Verifier::AssertSingleFact(std::string* database, unsigned int fact_id,
-                                const kythe::proto::Entry& entry) {
+bool Verifier::ConvertSingleFact(const FactContext& context,
+                                 std::string* database, unsigned int fact_id,
+                                 const kythe::proto::Entry& entry) {
   yy::location loc;
   loc.initialize(database);
   loc.begin.column = 1;
   loc.begin.line = fact_id;
   loc.end = loc.begin;
-  Symbol code_symbol = code_id_->AsIdentifier()->symbol();
-  AstNode** values = (AstNode**)arena_.New(sizeof(AstNode*) * 5);
-  values[0] =
-      entry.has_source() ? ConvertVName(loc, entry.source()) : empty_string_id_;
+  AstNode** values = (AstNode**)context.arena->New(sizeof(AstNode*) * 5);
+  values[0] = entry.has_source() ? ConvertVName(context, loc, entry.source())
+                                 : empty_string_id_;
   // We're removing support for ordinal facts. Support them during the
   // transition, but also support the new dot-separated edge kinds that serve
   // the same purpose.
@@ -1350,21 +1846,31 @@ bool Verifier::AssertSingleFact(std::string* database, unsigned int fact_id,
   bool is_code = false;
   if (dot_pos != std::string::npos && dot_pos > 0 &&
       dot_pos < entry.edge_kind().size() - 1) {
-    values[1] = IdentifierFor(loc, entry.edge_kind().substr(0, dot_pos));
+    values[1] =
+        IdentifierFor(context, loc, entry.edge_kind().substr(0, dot_pos));
     values[3] = ordinal_id_;
-    values[4] = IdentifierFor(loc, entry.edge_kind().substr(dot_pos + 1));
+    values[4] =
+        IdentifierFor(context, loc, entry.edge_kind().substr(dot_pos + 1));
   } else {
     values[1] = entry.edge_kind().empty()
                     ? empty_string_id_
-                    : IdentifierFor(loc, entry.edge_kind());
+                    : IdentifierFor(context, loc, entry.edge_kind());
     values[3] = entry.fact_name().empty()
                     ? empty_string_id_
-                    : IdentifierFor(loc, entry.fact_name());
-    if (values[3]->AsIdentifier()->symbol() == code_symbol &&
+                    : IdentifierFor(context, loc, entry.fact_name());
+    if (values[3]->AsIdentifier()->symbol() == context.code_symbol &&
         convert_marked_source_) {
+      if (lazy_marked_source_) {
+        // Keep the raw bytes; `MaterializeCodeFacts` builds the subgraph
+        // later if anything can reach it.
+        context.pending_code_facts->push_back(
+            PendingCodeFact{values[0], entry.fact_value(), loc});
+        return true;
+      }
       // Code facts are turned into subgraphs, so this fact entry will turn
       // into an edge entry.
-      if ((values[2] = ConvertCodeFact(loc, entry.fact_value())) == nullptr) {
+      if ((values[2] = ConvertCodeFact(context, loc, entry.fact_value())) ==
+          nullptr) {
         return false;
       }
       values[1] = marked_source_code_edge_id_;
@@ -1374,24 +1880,290 @@ bool Verifier::AssertSingleFact(std::string* database, unsigned int fact_id,
     } else {
       values[4] = entry.fact_value().empty()
                       ? empty_string_id_
-                      : IdentifierFor(loc, entry.fact_value());
+                      : IdentifierFor(context, loc, entry.fact_value());
     }
   }
   if (!is_code) {
-    values[2] = entry.has_target() ? ConvertVName(loc, entry.target())
+    values[2] = entry.has_target() ? ConvertVName(context, loc, entry.target())
                                    : empty_string_id_;
   }
 
-  AstNode* tuple = new (&arena_) Tuple(loc, 5, values);
-  AstNode* fact = new (&arena_) App(fact_id_, tuple);
+  AstNode* tuple = new (context.arena) Tuple(loc, 5, values);
+  AstNode* fact = new (context.arena) App(fact_id_, tuple);
+
+  context.facts->push_back(fact);
+  return true;
+}
+
+bool Verifier::AssertSingleFact(std::string* database, unsigned int fact_id,
+                                const kythe::proto::Entry& entry) {
+  database_prepared_ = false;
+  return ConvertSingleFact(MainFactContext(), database, fact_id, entry);
+}
 
+bool Verifier::AssertSnapshotFacts(const FactSnapshot& snapshot,
+                                   std::string* database) {
   database_prepared_ = false;
-  facts_.push_back(fact);
+  FactContext context = MainFactContext();
+  yy::location loc;
+  loc.initialize(database);
+  loc.begin.column = 1;
+  loc.end = loc.begin;
+  // One identifier per unique snapshot string: allocation and interning
+  // happen `string_count` times, not once per occurrence.
+  std::vector<AstNode*> identifiers(snapshot.string_count());
+  for (uint32_t id = 0; id < identifiers.size(); ++id) {
+    absl::string_view text = snapshot.string(id);
+    identifiers[id] = text.empty()
+                          ? empty_string_id_
+                          : IdentifierFor(context, loc, std::string(text));
+  }
+  // Dot-separated (ordinal-style) edge kinds also split once per unique
+  // string.
+  struct SplitEdgeKind {
+    AstNode* base = nullptr;
+    AstNode* ordinal = nullptr;
+  };
+  std::vector<SplitEdgeKind> split_edge_kinds(snapshot.string_count());
+  facts_.reserve(facts_.size() + snapshot.fact_count());
+  for (size_t i = 0; i < snapshot.fact_count(); ++i) {
+    const FactSnapshotRecord& record = snapshot.record(i);
+    loc.begin.line = i;
+    loc.end = loc.begin;
+    auto convert_vname = [&](const uint32_t* fields) {
+      AstNode** values = (AstNode**)context.arena->New(sizeof(AstNode*) * 5);
+      for (size_t field = 0; field < 5; ++field) {
+        values[field] = identifiers[fields[field]];
+      }
+      AstNode* tuple = new (context.arena) Tuple(loc, 5, values);
+      return new (context.arena) App(vname_id_, tuple);
+    };
+    AstNode** values = (AstNode**)context.arena->New(sizeof(AstNode*) * 5);
+    values[0] = (record.flags & FactSnapshotRecord::kHasSource)
+                    ? convert_vname(record.source)
+                    : empty_string_id_;
+    // This mirrors `ConvertSingleFact`'s handling of dot-separated edge
+    // kinds and /kythe/code facts, reading from the string table instead of
+    // an `Entry`.
+    absl::string_view edge_kind = snapshot.string(record.edge_kind);
+    auto dot_pos = edge_kind.rfind('.');
+    bool is_code = false;
+    if (dot_pos != absl::string_view::npos && dot_pos > 0 &&
+        dot_pos < edge_kind.size() - 1) {
+      SplitEdgeKind& split = split_edge_kinds[record.edge_kind];
+      if (split.base == nullptr) {
+        split.base = IdentifierFor(context, loc,
+                                   std::string(edge_kind.substr(0, dot_pos)));
+        split.ordinal = IdentifierFor(
+            context, loc, std::string(edge_kind.substr(dot_pos + 1)));
+      }
+      values[1] = split.base;
+      values[3] = ordinal_id_;
+      values[4] = split.ordinal;
+    } else {
+      values[1] = identifiers[record.edge_kind];
+      values[3] = identifiers[record.fact_name];
+      if (values[3]->AsIdentifier()->symbol() == context.code_symbol &&
+          convert_marked_source_) {
+        std::string code_data(snapshot.string(record.fact_value));
+        if (lazy_marked_source_) {
+          context.pending_code_facts->push_back(
+              PendingCodeFact{values[0], std::move(code_data), loc});
+          continue;
+        }
+        if ((values[2] = ConvertCodeFact(context, loc, code_data)) ==
+            nullptr) {
+          return false;
+        }
+        values[1] = marked_source_code_edge_id_;
+        values[3] = root_id_;
+        values[4] = empty_string_id_;
+        is_code = true;
+      } else {
+        values[4] = identifiers[record.fact_value];
+      }
+    }
+    if (!is_code) {
+      values[2] = (record.flags & FactSnapshotRecord::kHasTarget)
+                      ? convert_vname(record.target)
+                      : empty_string_id_;
+    }
+    AstNode* tuple = new (context.arena) Tuple(loc, 5, values);
+    context.facts->push_back(new (context.arena) App(fact_id_, tuple));
+  }
   return true;
 }
 
+std::unique_ptr<FactChunk> Verifier::NewFactChunk() {
+  auto chunk = std::make_unique<FactChunk>();
+  chunk->code_symbol_ = chunk->symbols_.intern("/kythe/code");
+  return chunk;
+}
+
+bool Verifier::AssertChunkFact(FactChunk* chunk, std::string* database,
+                               unsigned int fact_id,
+                               const kythe::proto::Entry& entry) {
+  // Everything read from `this` during conversion (constant nodes and
+  // configuration) is immutable while chunks load, so distinct chunks can
+  // convert concurrently.
+  FactContext context{&chunk->arena_,       &chunk->symbols_,
+                      &chunk->facts_,       &chunk->identifiers_,
+                      &chunk->pending_code_facts_, chunk->code_symbol_};
+  return ConvertSingleFact(context, database, fact_id, entry);
+}
+
+void Verifier::MergeFactChunk(std::unique_ptr<FactChunk> chunk) {
+  // Re-intern the chunk's symbols. Doing this chunk by chunk in a fixed
+  // order makes the final symbol numbering independent of load scheduling.
+  std::vector<Symbol> remap(chunk->symbols_.size());
+  for (Symbol symbol = 0; symbol < remap.size(); ++symbol) {
+    remap[symbol] = chunk->symbols_.IsUnique(symbol)
+                        ? symbol_table_.unique()
+                        : symbol_table_.intern(chunk->symbols_.text(symbol));
+  }
+  // Constant nodes (like `empty_string_id_`) emitted into chunk facts are
+  // the verifier's own and already carry main-table symbols; only
+  // identifiers allocated in the chunk need rebinding.
+  for (Identifier* identifier : chunk->identifiers_) {
+    identifier->set_symbol(remap[identifier->symbol()]);
+  }
+  facts_.insert(facts_.end(), chunk->facts_.begin(), chunk->facts_.end());
+  pending_code_facts_.insert(
+      pending_code_facts_.end(),
+      std::make_move_iterator(chunk->pending_code_facts_.begin()),
+      std::make_move_iterator(chunk->pending_code_facts_.end()));
+  chunk->facts_.clear();
+  chunk->facts_.shrink_to_fit();
+  chunk->pending_code_facts_.clear();
+  chunk->pending_code_facts_.shrink_to_fit();
+  chunk->identifiers_.clear();
+  chunk->identifiers_.shrink_to_fit();
+  database_prepared_ = false;
+  // The merged facts point into the chunk's arena, so keep it alive.
+  merged_chunks_.push_back(std::move(chunk));
+}
+
+/// \brief Returns whether any `Identifier` in `node` carries a symbol from
+/// `symbols`.
+static bool AstMentionsSymbol(AstNode* node, const std::set<Symbol>& symbols) {
+  if (node == nullptr) {
+    return false;
+  }
+  if (Identifier* ident = node->AsIdentifier()) {
+    return symbols.count(ident->symbol()) != 0;
+  }
+  if (App* app = node->AsApp()) {
+    return AstMentionsSymbol(app->lhs(), symbols) ||
+           AstMentionsSymbol(app->rhs(), symbols);
+  }
+  if (Tuple* tuple = node->AsTuple()) {
+    for (size_t i = 0, c = tuple->size(); i != c; ++i) {
+      if (AstMentionsSymbol(tuple->element(i), symbols)) {
+        return true;
+      }
+    }
+  }
+  if (EVar* evar = node->AsEVar()) {
+    return AstMentionsSymbol(evar->current(), symbols);
+  }
+  return false;
+}
+
+bool Verifier::GoalsTouchMarkedSource() {
+  std::set<Symbol> symbols;
+  for (AstNode* id :
+       {marked_source_code_edge_id_, marked_source_child_id_,
+        marked_source_link_id_, marked_source_kind_id_,
+        marked_source_pre_text_id_, marked_source_post_child_text_id_,
+        marked_source_post_text_id_, marked_source_lookup_index_id_,
+        marked_source_default_children_count_id_,
+        marked_source_add_final_list_token_id_}) {
+    symbols.insert(id->AsIdentifier()->symbol());
+  }
+  for (const auto& group : parser_.groups()) {
+    for (AstNode* goal : group.goals) {
+      if (AstMentionsSymbol(goal, symbols)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool Verifier::MaterializeCodeFacts() {
+  if (pending_code_facts_.empty()) {
+    return true;
+  }
+  FactContext context = MainFactContext();
+  for (const auto& pending : pending_code_facts_) {
+    // Identical code values share one decoded subgraph. Goals unify against
+    // its structure, so sharing is unobservable to them.
+    AstNode*& subgraph = converted_code_cache_[pending.code_data];
+    if (subgraph == nullptr &&
+        (subgraph = ConvertCodeFact(context, pending.location,
+                                    pending.code_data)) == nullptr) {
+      return false;
+    }
+    facts_.push_back(MakePredicate(
+        context, pending.location, fact_id_,
+        {pending.vname, marked_source_code_edge_id_, subgraph, root_id_,
+         empty_string_id_}));
+  }
+  pending_code_facts_.clear();
+  pending_code_facts_.shrink_to_fit();
+  database_prepared_ = false;
+  return true;
+}
+
+bool Verifier::SetDumpFilters(const std::string& node_regex,
+                              const std::string& edge_kind_regex,
+                              std::string* error) {
+  if (!node_regex.empty()) {
+    auto re2 = absl::make_unique<RE2>(node_regex);
+    if (re2->error_code() != RE2::NoError) {
+      if (error) {
+        *error = re2->error();
+      }
+      return false;
+    }
+    dump_node_regex_ = std::move(re2);
+  }
+  if (!edge_kind_regex.empty()) {
+    auto re2 = absl::make_unique<RE2>(edge_kind_regex);
+    if (re2->error_code() != RE2::NoError) {
+      if (error) {
+        *error = re2->error();
+      }
+      return false;
+    }
+    dump_edge_kind_regex_ = std::move(re2);
+  }
+  return true;
+}
+
+bool Verifier::DumpFiltersAllowNode(AstNode* vname) {
+  if (dump_node_regex_ == nullptr) {
+    return true;
+  }
+  StringPrettyPrinter printer;
+  vname->Dump(symbol_table_, &printer);
+  return RE2::PartialMatch(printer.str(), *dump_node_regex_);
+}
+
+bool Verifier::DumpFiltersAllowEdge(Tuple* fact) {
+  if (dump_edge_kind_regex_ != nullptr) {
+    StringPrettyPrinter printer;
+    fact->element(1)->Dump(symbol_table_, &printer);
+    if (!RE2::PartialMatch(printer.str(), *dump_edge_kind_regex_)) {
+      return false;
+    }
+  }
+  return DumpFiltersAllowNode(fact->element(0)) &&
+         DumpFiltersAllowNode(fact->element(2));
+}
+
 void Verifier::DumpAsJson() {
-  if (!PrepareDatabase()) {
+  if (!MaterializeCodeFacts() || !PrepareDatabase()) {
     return;
   }
   // Use the same sort order as we do with Graphviz.
@@ -1428,22 +2200,30 @@ void Verifier::DumpAsJson() {
     }
   };
   printer.Print("[");
+  bool need_comma = false;
   for (size_t i = 0; i < facts_.size(); ++i) {
     AstNode* fact = facts_[i];
     Tuple* t = fact->AsApp()->rhs()->AsTuple();
-    printer.Print("{");
+    // Evaluate filters during the walk so excluded facts are never rendered.
+    if (t->element(1) == empty_string_id()
+            ? !DumpFiltersAllowNode(t->element(0))
+            : !DumpFiltersAllowEdge(t)) {
+      continue;
+    }
+    printer.Print(need_comma ? ",{" : "{");
+    need_comma = true;
     DumpVName("\"source\":", t->element(0));
     DumpAsJson(",\"edge_kind\":", t->element(1));
     DumpVName(",\"target\":", t->element(2));
     DumpAsJson(",\"fact_name\":", t->element(3));
     DumpAsJson(",\"fact_value\":", t->element(4));
-    printer.Print(i + 1 == facts_.size() ? "}" : "},");
+    printer.Print("}");
   }
   printer.Print("]\n");
 }
 
 void Verifier::DumpAsDot() {
-  if (!PrepareDatabase()) {
+  if (!MaterializeCodeFacts() || !PrepareDatabase()) {
     return;
   }
   std::map<std::string, std::string> vname_labels;
@@ -1488,6 +2268,22 @@ void Verifier::DumpAsDot() {
   for (size_t i = 0; i < facts_.size(); ++i) {
     AstNode* fact = facts_[i];
     Tuple* t = fact->AsApp()->rhs()->AsTuple();
+    if (t->element(1) == empty_string_id()) {
+      if (!DumpFiltersAllowNode(t->element(0))) {
+        // Skip this node's whole (sorted-adjacent) fact block.
+        for (; i < facts_.size(); ++i) {
+          Tuple* nt = facts_[i]->AsApp()->rhs()->AsTuple();
+          if (!EncodedVNameOrIdentEqualTo(nt->element(0), t->element(0)) ||
+              nt->element(1) != empty_string_id()) {
+            break;
+          }
+        }
+        --i;  // Don't skip the fact following the block.
+        continue;
+      }
+    } else if (!DumpFiltersAllowEdge(t)) {
+      continue;
+    }
     printer.Print("\"");
     t->element(0)->Dump(symbol_table_, &quote_printer);
     printer.Print("\"");
@@ -18,7 +18,11 @@
 #define KYTHE_CXX_VERIFIER_H_
 
 #include <functional>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "assertions.h"
@@ -28,6 +32,55 @@
 namespace kythe {
 namespace verifier {
 
+/// \brief Anchor offset ranges paired with anchor VName tuples. Kept flat and
+/// sorted by range (see `Verifier::PrepareDatabase`) so lookups during solving
+/// are binary searches over contiguous storage.
+using AnchorMap =
+    std::vector<std::pair<std::pair<size_t, size_t>, AstNode*>>;
+
+/// \brief A /kythe/code fact whose MarkedSource conversion was deferred.
+/// \sa Verifier::ConvertMarkedSourceLazily
+struct PendingCodeFact {
+  /// The VName node the code fact was attached to.
+  AstNode* vname;
+  /// The undecoded MarkedSource bytes.
+  std::string code_data;
+  /// The location recorded for conversion diagnostics.
+  yy::location location;
+};
+
+/// \brief Facts loaded into thread-private storage, to be merged into a
+/// `Verifier` afterward.
+///
+/// A `FactChunk` owns its own `Arena` and `SymbolTable`, so distinct chunks
+/// may be filled concurrently (via `Verifier::AssertChunkFact`) without
+/// synchronization. `Verifier::MergeFactChunk` then re-interns each chunk's
+/// symbols into the verifier's table; merging chunks in a fixed order yields
+/// the same symbol assignment on every run regardless of thread scheduling.
+class FactChunk {
+ public:
+  /// \brief The number of facts loaded into this chunk.
+  size_t size() const { return facts_.size(); }
+
+ private:
+  friend class Verifier;
+  /// Storage for this chunk's AST nodes; adopted by the merging `Verifier`.
+  Arena arena_;
+  /// Chunk-local symbols; remapped during the merge.
+  SymbolTable symbols_;
+  /// Facts loaded into this chunk, in load order.
+  std::vector<AstNode*> facts_;
+  /// Every `Identifier` allocated in `arena_`, recorded so the merge can
+  /// rebind chunk-local symbols without walking fact trees.
+  std::vector<Identifier*> identifiers_;
+  /// Code facts held back for lazy MarkedSource conversion.
+  std::vector<PendingCodeFact> pending_code_facts_;
+  /// The chunk-local symbol for the /kythe/code fact name.
+  Symbol code_symbol_;
+};
+
+class FactSnapshot;
+
 /// \brief Runs logic programs.
 ///
 /// The `Verifier` combines an `AssertionContext` with a database of Kythe
@@ -43,9 +96,11 @@ class Verifier {
   /// \param filename The name to use for the file; may be blank.
   /// \param vname The AstNode of the vname for the file.
   /// \param text The symbol for the text to load
+  /// \param premarked If non-null, a scan buffer already built from `text`
+  /// (see `AssertionParser::BuildScanBuffer`); must outlive the call.
   /// \return false if we failed.
   bool LoadInMemoryRuleFile(const std::string& filename, AstNode* vname,
-                            Symbol text);
+                            Symbol text, std::string* premarked = nullptr);
 
   /// \brief Loads a source file with goal comments indicating rules and data.
   /// The VName for the source file will be determined by matching its content
@@ -54,6 +109,15 @@ class Verifier {
   /// \return false if we failed
   bool LoadInlineRuleFile(const std::string& filename);
 
+  /// \brief Loads in-memory source text with goal comments indicating rules
+  /// and data, as `LoadInlineRuleFile` does for files on disk. The VName for
+  /// the source will be determined by matching `content` against file nodes.
+  /// \param filename The name to report for the source in diagnostics.
+  /// \param content The source text to load.
+  /// \return false if we failed
+  bool LoadInlineRuleContent(const std::string& filename,
+                             const std::string& content);
+
   /// \brief Loads a text proto with goal comments indicating rules and data.
   /// The VName for the source file will be blank.
   /// \param file_data The data to load
@@ -101,6 +165,40 @@ class Verifier {
   bool AssertSingleFact(std::string* database_name, unsigned int fact_id,
                         const kythe::proto::Entry& entry);
 
+  /// \brief Adds every fact in `snapshot` to the database.
+  ///
+  /// Identifier nodes are shared per unique snapshot string, so each string
+  /// allocates and interns once no matter how many facts mention it. Shared
+  /// identifiers carry the snapshot's location in diagnostics rather than a
+  /// per-fact one; fact tuples still carry their own fact id.
+  /// \param database_name some name used to define the database; should live
+  /// as long as the `Verifier`. Used only for diagnostics.
+  /// \return false if something went wrong.
+  bool AssertSnapshotFacts(const FactSnapshot& snapshot,
+                           std::string* database_name);
+
+  /// \brief Creates an empty `FactChunk` configured for this `Verifier`.
+  std::unique_ptr<FactChunk> NewFactChunk();
+
+  /// \brief Adds a single Kythe fact to `chunk` instead of the database.
+  ///
+  /// Distinct chunks may be filled from distinct threads concurrently, but
+  /// not concurrently with any other use of this `Verifier`.
+  /// \param database_name some name used to define the database; should live
+  /// as long as the `Verifier`. Used only for diagnostics.
+  /// \param fact_id some identifier for the fact. Used only for diagnostics.
+  /// \return false if something went wrong.
+  bool AssertChunkFact(FactChunk* chunk, std::string* database_name,
+                       unsigned int fact_id,
+                       const kythe::proto::Entry& entry);
+
+  /// \brief Moves `chunk`'s facts into the database, re-interning its
+  /// symbols into this `Verifier`'s symbol table.
+  ///
+  /// Merging the same chunks in the same order always produces the same
+  /// symbol assignment, independent of how their loads were scheduled.
+  void MergeFactChunk(std::unique_ptr<FactChunk> chunk);
+
   /// \brief Perform basic well-formedness checks on the input database.
   /// \pre The database contains only fact-shaped terms, as generated by
   /// `AssertSingleFact`.
@@ -179,9 +277,31 @@ class Verifier {
   /// \brief Convert MarkedSource-valued facts to graphs.
   void ConvertMarkedSource() { convert_marked_source_ = true; }
 
+  /// \brief Like `ConvertMarkedSource`, but defer building subgraphs.
+  ///
+  /// Code facts keep their raw bytes at load time and are exploded into
+  /// subgraphs only once goals that can reach MarkedSource-derived facts are
+  /// known to exist (or before a graph dump). Identical code values share one
+  /// decoded subgraph.
+  void ConvertMarkedSourceLazily() {
+    convert_marked_source_ = true;
+    lazy_marked_source_ = true;
+  }
+
   /// \brief Show anchor locations in graph dumps (instead of @).
   void ShowAnchors() { show_anchors_ = true; }
 
+  /// \brief Restrict graph dumps to matching facts.
+  ///
+  /// Filters are evaluated while walking the sorted fact store, so excluded
+  /// subgraphs are never rendered. A node is kept if `node_regex` partially
+  /// matches its printed VName; an edge is kept if both of its endpoints are
+  /// kept and `edge_kind_regex` partially matches its kind. Empty patterns
+  /// match everything.
+  /// \return false (filling in `*error`) if a pattern fails to compile.
+  bool SetDumpFilters(const std::string& node_regex,
+                      const std::string& edge_kind_regex, std::string* error);
+
   /// \brief Check for singleton EVars.
   /// \return true if there were singletons.
   bool CheckForSingletonEVars() { return parser_.CheckForSingletonEVars(); }
@@ -189,16 +309,88 @@ class Verifier {
   /// \brief Don't search for file vnames.
   void IgnoreFileVnames() { file_vnames_ = false; }
 
+  /// \brief Solve independent goal groups concurrently on up to `threads`
+  /// threads. Groups that share EVars are still solved in program order.
+  void SetSolverThreads(size_t threads) { solver_threads_ = threads; }
+
+  /// \brief Reorder goals within each group by estimated selectivity before
+  /// solving. Conjunctive goals are order-independent, so this only changes
+  /// how much backtracking the solver does.
+  void UseGoalReordering() { reorder_goals_ = true; }
+
+  /// \sa UseGoalReordering
+  bool goal_reordering() const { return reorder_goals_; }
+
+  /// \brief Secondary index from hashed source VName to facts with that
+  /// source. Valid once `PrepareDatabase` has succeeded.
+  const std::unordered_multimap<uint64_t, AstNode*>& source_fact_index()
+      const {
+    return source_fact_index_;
+  }
+
+  /// \brief Secondary index from hashed target VName to facts with that
+  /// target. Valid once `PrepareDatabase` has succeeded.
+  const std::unordered_multimap<uint64_t, AstNode*>& target_fact_index()
+      const {
+    return target_fact_index_;
+  }
+
  private:
+  /// \brief Solves goal groups on a pool of threads, batching together
+  /// consecutive groups that share no EVars.
+  /// \param inspect function to call on any inspection request
+  /// \return true if all goals could be satisfied.
+  bool SolveGoalGroupsInParallel(
+      std::function<bool(Verifier* context, const AssertionParser::Inspection&)>&
+          inspect);
+
   /// \brief Generate a VName that will not conflict with any other VName.
   AstNode* NewUniqueVName(const yy::location& loc);
 
+  /// \brief The storage a fact conversion allocates from and interns into:
+  /// either the `Verifier`'s own members or a `FactChunk`'s.
+  ///
+  /// Constant nodes (like `empty_string_id_`) are always the `Verifier`'s and
+  /// are emitted by pointer; their symbols belong to the main table and are
+  /// never compared against context-local symbols.
+  struct FactContext {
+    /// Storage for converted nodes.
+    Arena* arena;
+    /// Table that converted identifiers intern into.
+    SymbolTable* symbols;
+    /// Sink for converted facts.
+    std::vector<AstNode*>* facts;
+    /// If non-null, records every `Identifier` allocated so chunk merges can
+    /// rebind their symbols. Null when converting into the main database.
+    std::vector<Identifier*>* identifiers;
+    /// Sink for code facts held back for lazy MarkedSource conversion.
+    std::vector<PendingCodeFact>* pending_code_facts;
+    /// `symbols`' interning of the /kythe/code fact name.
+    Symbol code_symbol;
+  };
+
+  /// \brief Returns the `FactContext` backed by this `Verifier`'s members.
+  FactContext MainFactContext();
+
+  /// \sa IdentifierFor, but allocating and interning in `context`.
+  Identifier* IdentifierFor(const FactContext& context,
+                            const yy::location& location,
+                            const std::string& token);
+
+  /// \sa MakePredicate, but allocating in `context`.
+  AstNode* MakePredicate(const FactContext& context,
+                         const yy::location& location, AstNode* head,
+                         std::initializer_list<AstNode*> values);
+
+  /// \sa NewUniqueVName, but allocating and interning in `context`.
+  AstNode* NewUniqueVName(const FactContext& context, const yy::location& loc);
+
   /// \brief Converts an encoded /kythe/code fact to a form that's useful
   /// to the verifier.
   /// \param loc The location to use in diagnostics.
   /// \return null if something went wrong; otherwise, an AstNode corresponding
   /// to a VName of a synthetic node for `code_data`.
-  AstNode* ConvertCodeFact(const yy::location& loc,
+  AstNode* ConvertCodeFact(const FactContext& context, const yy::location& loc,
                            const google::protobuf::string& code_data);
 
   /// \brief Converts a MarkedSource message to a form that's useful
@@ -207,18 +399,42 @@ class Verifier {
   /// \return null if something went wrong; otherwise, an AstNode corresponding
   /// to a VName of a synthetic node for `marked_source`.
   AstNode* ConvertMarkedSource(
-      const yy::location& loc,
+      const FactContext& context, const yy::location& loc,
       const kythe::proto::common::MarkedSource& marked_source);
 
   /// \brief Converts a VName proto to its AST representation.
-  AstNode* ConvertVName(const yy::location& location,
+  AstNode* ConvertVName(const FactContext& context,
+                        const yy::location& location,
                         const kythe::proto::VName& vname);
 
+  /// \brief Converts `entry` in `context`; the body of `AssertSingleFact`
+  /// and `AssertChunkFact`.
+  bool ConvertSingleFact(const FactContext& context, std::string* database,
+                         unsigned int fact_id,
+                         const kythe::proto::Entry& entry);
+
   /// \brief Adds an anchor VName.
   void AddAnchor(AstNode* vname, size_t begin, size_t end) {
-    anchors_.emplace(std::make_pair(begin, end), vname);
+    anchors_.emplace_back(std::make_pair(begin, end), vname);
   }
 
+  /// \brief Converts any deferred code facts into subgraphs.
+  /// \return false if a deferred code fact failed to convert.
+  /// \sa ConvertMarkedSourceLazily
+  bool MaterializeCodeFacts();
+
+  /// \brief Whether any loaded goal mentions a MarkedSource-derived edge
+  /// kind or fact name, making deferred code facts reachable.
+  bool GoalsTouchMarkedSource();
+
+  /// \brief Whether graph dumps should include the node `vname`.
+  /// \sa SetDumpFilters
+  bool DumpFiltersAllowNode(AstNode* vname);
+
+  /// \brief Whether graph dumps should include the edge in `fact`.
+  /// \sa SetDumpFilters
+  bool DumpFiltersAllowEdge(Tuple* fact);
+
   /// \sa parser()
   AssertionParser parser_;
 
@@ -231,12 +447,28 @@ class Verifier {
   /// All known facts.
   std::vector<AstNode*> facts_;
 
-  /// Multimap from anchor offsets to anchor VName tuples.
-  std::multimap<std::pair<size_t, size_t>, AstNode*> anchors_;
+  /// Merged chunks, retained because `facts_` points into their arenas.
+  std::vector<std::unique_ptr<FactChunk>> merged_chunks_;
+
+  /// Map from anchor offsets to anchor VName tuples, sorted by offset range
+  /// during `PrepareDatabase`.
+  AnchorMap anchors_;
+
+  /// \sa source_fact_index()
+  std::unordered_multimap<uint64_t, AstNode*> source_fact_index_;
+
+  /// \sa target_fact_index()
+  std::unordered_multimap<uint64_t, AstNode*> target_fact_index_;
 
   /// Has the database been prepared?
   bool database_prepared_ = false;
 
+  /// Number of threads to use when solving goal groups.
+  size_t solver_threads_ = 1;
+
+  /// Reorder goals within groups by estimated selectivity before solving?
+  bool reorder_goals_ = false;
+
   /// Ignore duplicate facts during verification?
   bool ignore_dups_ = false;
 
@@ -314,14 +546,36 @@ class Verifier {
   /// group.
   std::unique_ptr<RE2> goal_comment_regex_;
 
+  /// When `goal_comment_regex_` was built from a literal prefix, that prefix;
+  /// used to pre-filter candidate goal lines without running the regex.
+  /// Empty for arbitrary regexes.
+  std::string goal_comment_marker_;
+
   /// If true, convert MarkedSource-valued facts to subgraphs. If false,
   /// MarkedSource-valued facts will be replaced with opaque but unique
   /// identifiers.
   bool convert_marked_source_ = false;
 
+  /// If true, hold code facts back as `pending_code_facts_` at load time and
+  /// convert them via `MaterializeCodeFacts` only when they are reachable.
+  bool lazy_marked_source_ = false;
+
+  /// Code facts whose conversion has been deferred.
+  std::vector<PendingCodeFact> pending_code_facts_;
+
+  /// Maps already-decoded code values to their subgraph VNames so duplicate
+  /// MarkedSource messages convert once.
+  std::unordered_map<std::string, AstNode*> converted_code_cache_;
+
   /// If true, show anchor locations in graph dumps (instead of @).
   bool show_anchors_ = false;
 
+  /// If set, graph dumps include only nodes whose printed VNames match.
+  std::unique_ptr<RE2> dump_node_regex_;
+
+  /// If set, graph dumps include only edges whose kinds match.
+  std::unique_ptr<RE2> dump_edge_kind_regex_;
+
   /// Identifier for MarkedSource child edges.
   AstNode* marked_source_child_id_;
 
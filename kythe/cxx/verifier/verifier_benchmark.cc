@@ -0,0 +1,159 @@
+/*
+ * Copyright 2020 The Kythe Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks for the verifier's load, database-preparation, and solve
+// phases, run against parameterized synthetic fact databases so solver and
+// loader changes have a tracked baseline.
+//
+// The synthetic database models the common indexer output shape: for each
+// "function" there is a function node carrying a distinguishing name fact,
+// an anchor node with location facts, and a defines/binding edge from the
+// anchor to the function. Goals bind fresh EVars per goal group, so the
+// solve benchmarks scale both in database size and in EVar count.
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "benchmark/benchmark.h"
+#include "glog/logging.h"
+#include "kythe/proto/storage.pb.h"
+#include "verifier.h"
+
+namespace kythe {
+namespace verifier {
+namespace {
+
+/// Diagnostic database name passed to `AssertSingleFact`; must outlive every
+/// `Verifier` in the process.
+std::string* const kBenchmarkDatabase = new std::string("benchmark");
+
+proto::VName NodeVName(absl::string_view prefix, int index) {
+  proto::VName vname;
+  vname.set_signature(absl::StrCat(prefix, index));
+  vname.set_language("benchmark");
+  return vname;
+}
+
+void AddFact(std::vector<proto::Entry>* entries, const proto::VName& source,
+             absl::string_view name, absl::string_view value) {
+  proto::Entry entry;
+  *entry.mutable_source() = source;
+  entry.set_fact_name(absl::StrCat("/kythe/", name));
+  entry.set_fact_value(std::string(value));
+  entries->push_back(std::move(entry));
+}
+
+void AddEdge(std::vector<proto::Entry>* entries, const proto::VName& source,
+             absl::string_view kind, const proto::VName& target) {
+  proto::Entry entry;
+  *entry.mutable_source() = source;
+  entry.set_edge_kind(absl::StrCat("/kythe/edge/", kind));
+  *entry.mutable_target() = target;
+  entry.set_fact_name("/");
+  entries->push_back(std::move(entry));
+}
+
+/// \brief Builds a database with `functions` function nodes, each with a
+/// uniquely named anchor bound to it, for seven entries per function.
+std::vector<proto::Entry> MakeFactDatabase(int functions) {
+  std::vector<proto::Entry> entries;
+  entries.reserve(functions * 7);
+  for (int i = 0; i < functions; ++i) {
+    proto::VName function = NodeVName("function", i);
+    proto::VName anchor = NodeVName("anchor", i);
+    AddFact(&entries, function, "node/kind", "function");
+    AddFact(&entries, function, "name", absl::StrCat("name", i));
+    AddFact(&entries, anchor, "node/kind", "anchor");
+    AddFact(&entries, anchor, "loc/start", absl::StrCat(i * 10));
+    AddFact(&entries, anchor, "loc/end", absl::StrCat(i * 10 + 5));
+    AddEdge(&entries, anchor, "defines/binding", function);
+    AddEdge(&entries, anchor, "childof", NodeVName("file", 0));
+  }
+  return entries;
+}
+
+/// \brief Builds `groups` goal groups, each binding two fresh EVars: an
+/// anchor, the function it defines, and the function's distinguishing name
+/// fact (so every group has exactly one solution).
+std::string MakeGoals(int groups) {
+  std::string goals;
+  for (int g = 0; g < groups; ++g) {
+    absl::StrAppend(&goals, "#- Anchor", g, ".node/kind anchor\n",
+                    "#- Anchor", g, " defines/binding Function", g, "\n",
+                    "#- Function", g, ".name \"name", g, "\"\n");
+  }
+  return goals;
+}
+
+void LoadFacts(Verifier* verifier, const std::vector<proto::Entry>& entries) {
+  for (size_t i = 0; i < entries.size(); ++i) {
+    CHECK(verifier->AssertSingleFact(kBenchmarkDatabase, i, entries[i]));
+  }
+}
+
+void BM_LoadFacts(benchmark::State& state) {
+  const std::vector<proto::Entry> entries = MakeFactDatabase(state.range(0));
+  for (auto _ : state) {
+    Verifier verifier;
+    LoadFacts(&verifier, entries);
+    benchmark::DoNotOptimize(verifier.arena());
+  }
+  state.SetItemsProcessed(state.iterations() * entries.size());
+}
+BENCHMARK(BM_LoadFacts)->Range(64, 16 << 10);
+
+void BM_PrepareDatabase(benchmark::State& state) {
+  const std::vector<proto::Entry> entries = MakeFactDatabase(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    Verifier verifier;
+    LoadFacts(&verifier, entries);
+    state.ResumeTiming();
+    CHECK(verifier.PrepareDatabase());
+  }
+  state.SetItemsProcessed(state.iterations() * entries.size());
+}
+BENCHMARK(BM_PrepareDatabase)->Range(64, 16 << 10);
+
+void BM_Solve(benchmark::State& state) {
+  const std::vector<proto::Entry> entries = MakeFactDatabase(state.range(0));
+  const std::string goals = MakeGoals(state.range(1));
+  for (auto _ : state) {
+    state.PauseTiming();
+    Verifier verifier;
+    LoadFacts(&verifier, entries);
+    // The goal text contains no entries; this parses only the #- comments.
+    CHECK(verifier.LoadInlineProtoFile(goals));
+    CHECK(verifier.PrepareDatabase());
+    state.ResumeTiming();
+    CHECK(verifier.VerifyAllGoals());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_Solve)
+    ->Args({256, 4})
+    ->Args({256, 32})
+    ->Args({1 << 10, 32})
+    ->Args({1 << 12, 32})
+    ->Args({1 << 12, 256});
+
+}  // anonymous namespace
+}  // namespace verifier
+}  // namespace kythe
+
+BENCHMARK_MAIN();
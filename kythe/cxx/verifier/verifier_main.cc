@@ -14,20 +14,41 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/sha.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/flags/usage.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
 #include "assertion_ast.h"
+#include "fact_snapshot.h"
 #include "glog/logging.h"
-#include "google/protobuf/io/coded_stream.h"
-#include "google/protobuf/io/zero_copy_stream.h"
-#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "kythe/cxx/common/entry_stream_reader.h"
+#include "kythe/cxx/common/kzip_reader.h"
+#include "kythe/proto/analysis.pb.h"
 #include "kythe/proto/storage.pb.h"
 #include "verifier.h"
 
@@ -49,9 +70,89 @@ ABSL_FLAG(std::string, goal_regex, "",
           "The regex must match the entire line. Expects one capture group.");
 ABSL_FLAG(bool, convert_marked_source, false,
           "Convert MarkedSource-valued facts to subgraphs.");
+ABSL_FLAG(bool, lazy_marked_source, false,
+          "With --convert_marked_source, defer building MarkedSource "
+          "subgraphs until some goal (or a graph dump) can reach them.");
 ABSL_FLAG(bool, show_anchors, false, "Show anchor locations instead of @s");
+ABSL_FLAG(std::string, dump_node_regex, "",
+          "If nonempty, graph dumps include only nodes whose printed VNames "
+          "match this regex (and edges between them).");
+ABSL_FLAG(std::string, dump_edge_regex, "",
+          "If nonempty, graph dumps include only edges whose kinds match "
+          "this regex.");
 ABSL_FLAG(bool, file_vnames, true,
           "Find file vnames by matching file content.");
+ABSL_FLAG(int, solver_threads, 1,
+          "Solve independent goal groups on this many threads.");
+ABSL_FLAG(std::string, cache_dir, "",
+          "If nonempty, cache verification results in this directory, keyed "
+          "by the fact database and goal file contents. Cached runs replay "
+          "their recorded inspection output. Dump flags (like --graphviz or "
+          "--show_protos) disable the cache.");
+ABSL_FLAG(bool, reorder_goals, false,
+          "Reorder goals within each group by estimated selectivity before "
+          "solving.");
+ABSL_FLAG(int, load_threads, 1,
+          "Load input facts on this many threads. Falls back to "
+          "single-threaded loading when --show_protos is set.");
+ABSL_FLAG(std::string, fact_snapshot, "",
+          "If nonempty, a snapshot of the fact database. When the file "
+          "exists, load facts from it instead of standard input; otherwise "
+          "read standard input and write the snapshot there for later runs "
+          "against the same database. --show_protos disables the snapshot.");
+ABSL_FLAG(std::string, index_archive, "",
+          "If nonempty, a kzip archive to read goal sources from. Rule files "
+          "named on the command line are looked up among the archive's "
+          "compilation unit source files instead of on the filesystem; when "
+          "none are named, every source file in the archive is scanned for "
+          "goals. A source shared by several units is loaded once, keyed by "
+          "its content digest.");
+
+namespace {
+
+/// \brief Updates `sha` with `data`, length-framed so field boundaries
+/// can't alias.
+void HashCacheField(SHA256_CTX* sha, absl::string_view data) {
+  uint64_t size = data.size();
+  ::SHA256_Update(sha, &size, sizeof(size));
+  ::SHA256_Update(sha, data.data(), data.size());
+}
+
+/// \brief Updates `sha` with every field of `vname`.
+void HashCacheVName(SHA256_CTX* sha, const kythe::proto::VName& vname) {
+  HashCacheField(sha, vname.signature());
+  HashCacheField(sha, vname.corpus());
+  HashCacheField(sha, vname.root());
+  HashCacheField(sha, vname.path());
+  HashCacheField(sha, vname.language());
+}
+
+/// \brief Updates `sha` with the content-identifying fields of `entry`.
+void HashCacheEntry(SHA256_CTX* sha, const kythe::proto::Entry& entry) {
+  // A missing vname and an empty one convert to different facts.
+  uint8_t presence = (entry.has_source() ? 1 : 0) | (entry.has_target() ? 2 : 0);
+  ::SHA256_Update(sha, &presence, sizeof(presence));
+  HashCacheVName(sha, entry.source());
+  HashCacheField(sha, entry.edge_kind());
+  HashCacheVName(sha, entry.target());
+  HashCacheField(sha, entry.fact_name());
+  HashCacheField(sha, entry.fact_value());
+}
+
+/// \brief Reads all of `path` into `out`.
+/// \return false if the file could not be opened.
+bool ReadFileBytes(const std::string& path, std::string* out) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  std::ostringstream stream;
+  stream << in.rdbuf();
+  *out = stream.str();
+  return true;
+}
+
+}  // anonymous namespace
 
 int main(int argc, char** argv) {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -92,42 +193,416 @@ Example:
   }
 
   if (absl::GetFlag(FLAGS_convert_marked_source)) {
-    v.ConvertMarkedSource();
+    if (absl::GetFlag(FLAGS_lazy_marked_source)) {
+      v.ConvertMarkedSourceLazily();
+    } else {
+      v.ConvertMarkedSource();
+    }
   }
 
   if (absl::GetFlag(FLAGS_show_anchors)) {
     v.ShowAnchors();
   }
 
+  {
+    std::string error;
+    if (!v.SetDumpFilters(absl::GetFlag(FLAGS_dump_node_regex),
+                          absl::GetFlag(FLAGS_dump_edge_regex), &error)) {
+      absl::FPrintF(stderr, "While parsing dump filter regex: %s\n", error);
+      return 1;
+    }
+  }
+
   if (!absl::GetFlag(FLAGS_file_vnames)) {
     v.IgnoreFileVnames();
   }
 
+  if (absl::GetFlag(FLAGS_solver_threads) > 1) {
+    v.SetSolverThreads(absl::GetFlag(FLAGS_solver_threads));
+  }
+
+  if (absl::GetFlag(FLAGS_reorder_goals)) {
+    v.UseGoalReordering();
+  }
+
+  // Goal sources streamed from --index_archive, as (path, content) pairs in
+  // archive order. Collected up front so the result cache can key on them
+  // the same way it keys on rule files read from disk.
+  std::vector<std::pair<std::string, std::string>> archive_goals;
+  const std::string archive_path = absl::GetFlag(FLAGS_index_archive);
+  if (!archive_path.empty()) {
+    auto reader = kythe::KzipReader::Open(archive_path);
+    if (!reader) {
+      absl::FPrintF(stderr, "Could not open %s: %s\n", archive_path,
+                    reader.status().ToString());
+      return 1;
+    }
+    absl::flat_hash_set<std::string> requested;
+    for (auto it = remain.begin() + 1; it != remain.end(); ++it) {
+      if (**it != '\0') {
+        requested.insert(*it);
+      }
+    }
+    // The same source (and often the same generated header) appears in many
+    // units; its digest keys it so it is decompressed and scanned once.
+    absl::flat_hash_set<std::string> loaded_digests;
+    absl::flat_hash_set<std::string> found_paths;
+    bool archive_ok = true;
+    absl::Status scan_status = reader->Scan([&](absl::string_view digest) {
+      auto unit = reader->ReadUnit(digest);
+      if (!unit) {
+        absl::FPrintF(stderr, "Could not read unit %s: %s\n",
+                      std::string(digest), unit.status().ToString());
+        archive_ok = false;
+        return false;
+      }
+      const auto& cu = unit->unit();
+      for (const std::string& source : cu.source_file()) {
+        if (!requested.empty() && !requested.contains(source)) {
+          continue;
+        }
+        for (const auto& input : cu.required_input()) {
+          if (input.info().path() != source) {
+            continue;
+          }
+          found_paths.insert(source);
+          if (loaded_digests.insert(input.info().digest()).second) {
+            auto content = reader->ReadFile(input.info().digest());
+            if (!content) {
+              absl::FPrintF(stderr, "Could not read %s: %s\n", source,
+                            content.status().ToString());
+              archive_ok = false;
+              return false;
+            }
+            archive_goals.emplace_back(source, *std::move(content));
+          }
+          break;
+        }
+      }
+      return true;
+    });
+    if (!scan_status.ok()) {
+      absl::FPrintF(stderr, "Could not scan %s: %s\n", archive_path,
+                    scan_status.ToString());
+      return 1;
+    }
+    if (!archive_ok) {
+      return 1;
+    }
+    for (const std::string& path : requested) {
+      if (!found_paths.contains(path)) {
+        absl::FPrintF(stderr, "No source file %s in %s\n", path, archive_path);
+        return 1;
+      }
+    }
+  }
+
+  // Dump flags change what a run prints without changing its verdict, so a
+  // cached replay would be wrong for them.
+  bool cache_enabled = !absl::GetFlag(FLAGS_cache_dir).empty() &&
+                       !absl::GetFlag(FLAGS_graphviz) &&
+                       !absl::GetFlag(FLAGS_annotated_graphviz) &&
+                       !absl::GetFlag(FLAGS_show_protos) &&
+                       !absl::GetFlag(FLAGS_show_goals);
+  SHA256_CTX fact_sha;
+  ::SHA256_Init(&fact_sha);
+
   std::string dbname = "database";
   size_t facts = 0;
-  kythe::proto::Entry entry;
-  google::protobuf::uint32 byte_size;
-  google::protobuf::io::FileInputStream raw_input(STDIN_FILENO);
-  for (;;) {
-    google::protobuf::io::CodedInputStream coded_input(&raw_input);
-    coded_input.SetTotalBytesLimit(INT_MAX, -1);
-    if (!coded_input.ReadVarint32(&byte_size)) {
-      break;
-    }
-    auto limit = coded_input.PushLimit(byte_size);
-    if (!entry.ParseFromCodedStream(&coded_input)) {
+  constexpr size_t kEntriesPerBatch = 256;
+  const size_t load_threads =
+      std::max(1, absl::GetFlag(FLAGS_load_threads));
+  // A usable snapshot replaces the standard input stream entirely; when the
+  // flag names a file that does not exist yet, this run records one.
+  const std::string snapshot_path = absl::GetFlag(FLAGS_fact_snapshot);
+  std::unique_ptr<kythe::verifier::FactSnapshot> snapshot;
+  if (!snapshot_path.empty() && !absl::GetFlag(FLAGS_show_protos)) {
+    snapshot = kythe::verifier::FactSnapshot::Load(snapshot_path);
+  }
+  kythe::verifier::FactSnapshotWriter snapshot_writer;
+  const bool write_snapshot = !snapshot_path.empty() &&
+                              !absl::GetFlag(FLAGS_show_protos) &&
+                              snapshot == nullptr;
+  if (snapshot != nullptr) {
+    if (!v.AssertSnapshotFacts(*snapshot, &dbname)) {
+      absl::FPrintF(stderr, "Error asserting facts from snapshot %s\n",
+                    snapshot_path);
+      return 1;
+    }
+    facts = snapshot->fact_count();
+    if (cache_enabled) {
+      // The snapshot's bytes determine its facts, so hash them in place of
+      // the per-entry digest. (Snapshot and stdin runs of the same facts
+      // key differently and miss each other's cache entries once.)
+      ::SHA256_Update(&fact_sha, snapshot->content().data(),
+                      snapshot->content().size());
+    }
+  } else if (load_threads > 1 && !absl::GetFlag(FLAGS_show_protos)) {
+    // Chunk-parallel load: this thread parses the delimited stream into
+    // batches and deals them round-robin to a fixed worker, each of which
+    // converts facts into its own chunk. Chunks merge in worker order, so
+    // symbol numbering is independent of scheduling.
+    constexpr size_t kMaxQueuedBatchesPerWorker = 16;
+    struct WorkerQueue {
+      std::mutex mu;
+      std::condition_variable cv;
+      std::deque<std::pair<size_t, std::unique_ptr<kythe::EntryBatch>>>
+          batches;
+      bool done = false;
+    };
+    std::vector<WorkerQueue> queues(load_threads);
+    std::vector<std::unique_ptr<kythe::verifier::FactChunk>> chunks;
+    for (size_t w = 0; w < load_threads; ++w) {
+      chunks.push_back(v.NewFactChunk());
+    }
+    std::atomic<bool> load_failed(false);
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < load_threads; ++w) {
+      workers.emplace_back([&, w] {
+        WorkerQueue& queue = queues[w];
+        kythe::verifier::FactChunk* chunk = chunks[w].get();
+        for (;;) {
+          size_t fact_id;
+          std::unique_ptr<kythe::EntryBatch> batch;
+          {
+            std::unique_lock<std::mutex> lock(queue.mu);
+            queue.cv.wait(
+                lock, [&] { return queue.done || !queue.batches.empty(); });
+            if (queue.batches.empty()) {
+              return;
+            }
+            fact_id = queue.batches.front().first;
+            batch = std::move(queue.batches.front().second);
+            queue.batches.pop_front();
+          }
+          queue.cv.notify_all();
+          for (const kythe::proto::Entry* entry : batch->entries) {
+            if (!v.AssertChunkFact(chunk, &dbname, fact_id, *entry)) {
+              absl::FPrintF(stderr, "Error asserting fact %zu\n", fact_id);
+              load_failed.store(true, std::memory_order_relaxed);
+              // Wake the dispatcher if it is waiting for this queue to drain.
+              queue.cv.notify_all();
+              return;
+            }
+            ++fact_id;
+          }
+        }
+      });
+    }
+    kythe::EntryStreamReader entry_reader(STDIN_FILENO);
+    bool more = true;
+    size_t next_worker = 0;
+    while (more && !load_failed.load(std::memory_order_relaxed)) {
+      auto batch = std::make_unique<kythe::EntryBatch>();
+      more = entry_reader.ReadBatch(batch.get(), kEntriesPerBatch);
+      if (batch->entries.empty()) {
+        continue;
+      }
+      if (cache_enabled || write_snapshot) {
+        for (const kythe::proto::Entry* entry : batch->entries) {
+          if (cache_enabled) {
+            HashCacheEntry(&fact_sha, *entry);
+          }
+          if (write_snapshot) {
+            snapshot_writer.AddEntry(*entry);
+          }
+        }
+      }
+      size_t batch_size = batch->entries.size();
+      WorkerQueue& queue = queues[next_worker];
+      {
+        std::unique_lock<std::mutex> lock(queue.mu);
+        // Also wake on failure, since a failed worker stops draining its
+        // queue.
+        queue.cv.wait(lock, [&] {
+          return load_failed.load(std::memory_order_relaxed) ||
+                 queue.batches.size() < kMaxQueuedBatchesPerWorker;
+        });
+        queue.batches.emplace_back(facts, std::move(batch));
+      }
+      queue.cv.notify_all();
+      facts += batch_size;
+      next_worker = (next_worker + 1) % load_threads;
+    }
+    for (auto& queue : queues) {
+      {
+        std::lock_guard<std::mutex> lock(queue.mu);
+        queue.done = true;
+      }
+      queue.cv.notify_all();
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    if (load_failed.load(std::memory_order_relaxed)) {
+      return 1;
+    }
+    if (entry_reader.error()) {
       absl::FPrintF(stderr, "Error reading around fact %zu\n", facts);
       return 1;
     }
-    if (absl::GetFlag(FLAGS_show_protos)) {
-      entry.PrintDebugString();
-      putchar('\n');
+    for (auto& chunk : chunks) {
+      v.MergeFactChunk(std::move(chunk));
+    }
+  } else {
+    // Decoding a multi-gigabyte entry stream is pipelined with fact assertion:
+    // a reader thread parses the delimited stream into batches of
+    // arena-allocated entries while this thread loads them into the database.
+    constexpr size_t kMaxQueuedBatches = 64;
+    std::mutex queue_mu;
+    std::condition_variable queue_cv;
+    std::deque<std::unique_ptr<kythe::EntryBatch>> batch_queue;
+    bool read_done = false;
+    bool read_failed = false;
+    bool cancelled = false;
+    std::thread reader([&] {
+      kythe::EntryStreamReader entry_reader(STDIN_FILENO);
+      bool at_end = false;
+      while (!at_end) {
+        auto batch = std::make_unique<kythe::EntryBatch>();
+        at_end = !entry_reader.ReadBatch(batch.get(), kEntriesPerBatch);
+        std::unique_lock<std::mutex> lock(queue_mu);
+        queue_cv.wait(lock, [&] {
+          return cancelled || batch_queue.size() < kMaxQueuedBatches;
+        });
+        if (cancelled) {
+          return;
+        }
+        if (!batch->entries.empty()) {
+          batch_queue.push_back(std::move(batch));
+        }
+        if (at_end) {
+          read_done = true;
+          read_failed = entry_reader.error();
+        }
+        lock.unlock();
+        queue_cv.notify_all();
+      }
+    });
+    auto abort_read = [&] {
+      {
+        std::lock_guard<std::mutex> lock(queue_mu);
+        cancelled = true;
+      }
+      queue_cv.notify_all();
+      reader.join();
+    };
+    for (;;) {
+      std::unique_ptr<kythe::EntryBatch> batch;
+      {
+        std::unique_lock<std::mutex> lock(queue_mu);
+        queue_cv.wait(lock, [&] { return read_done || !batch_queue.empty(); });
+        if (batch_queue.empty()) {
+          break;
+        }
+        batch = std::move(batch_queue.front());
+        batch_queue.pop_front();
+      }
+      queue_cv.notify_all();
+      for (const kythe::proto::Entry* batch_entry : batch->entries) {
+        const kythe::proto::Entry& entry = *batch_entry;
+        if (absl::GetFlag(FLAGS_show_protos)) {
+          entry.PrintDebugString();
+          putchar('\n');
+        }
+        if (cache_enabled) {
+          HashCacheEntry(&fact_sha, entry);
+        }
+        if (write_snapshot) {
+          snapshot_writer.AddEntry(entry);
+        }
+        if (!v.AssertSingleFact(&dbname, facts, entry)) {
+          absl::FPrintF(stderr, "Error asserting fact %zu\n", facts);
+          abort_read();
+          return 1;
+        }
+        ++facts;
+      }
     }
-    if (!v.AssertSingleFact(&dbname, facts, entry)) {
-      absl::FPrintF(stderr, "Error asserting fact %zu\n", facts);
+    reader.join();
+    if (read_failed) {
+      absl::FPrintF(stderr, "Error reading around fact %zu\n", facts);
       return 1;
     }
-    ++facts;
+  }
+
+  // Snapshot write failures degrade to uncached behavior, like the result
+  // cache's.
+  if (write_snapshot && !snapshot_writer.Write(snapshot_path)) {
+    absl::FPrintF(stderr, "Could not write fact snapshot %s\n", snapshot_path);
+  }
+
+  std::string cache_path;
+  if (cache_enabled) {
+    // The key covers everything that can change the verdict or the printed
+    // inspections: the goal syntax flags, the semantic flags, every rule
+    // file's name and content, and a digest of the fact stream.
+    SHA256_CTX key_sha;
+    ::SHA256_Init(&key_sha);
+    HashCacheField(&key_sha, "kythe-verifier-cache-1");
+    HashCacheField(&key_sha, absl::GetFlag(FLAGS_goal_prefix));
+    HashCacheField(&key_sha, absl::GetFlag(FLAGS_goal_regex));
+    HashCacheField(
+        &key_sha,
+        absl::StrCat(absl::GetFlag(FLAGS_use_file_nodes),
+                     absl::GetFlag(FLAGS_convert_marked_source),
+                     absl::GetFlag(FLAGS_lazy_marked_source),
+                     absl::GetFlag(FLAGS_ignore_dups),
+                     absl::GetFlag(FLAGS_check_for_singletons),
+                     absl::GetFlag(FLAGS_show_anchors),
+                     absl::GetFlag(FLAGS_file_vnames)));
+    if (!archive_path.empty()) {
+      for (const auto& goal : archive_goals) {
+        HashCacheField(&key_sha, goal.first);
+        HashCacheField(&key_sha, goal.second);
+      }
+    } else {
+      for (auto it = remain.begin() + 1; it != remain.end(); ++it) {
+        std::string rule_file = *it;
+        if (rule_file.empty()) {
+          continue;
+        }
+        std::string content;
+        if (!ReadFileBytes(rule_file, &content)) {
+          // Let the normal load path report the error.
+          cache_enabled = false;
+          break;
+        }
+        HashCacheField(&key_sha, rule_file);
+        HashCacheField(&key_sha, content);
+      }
+    }
+    if (cache_enabled) {
+      unsigned char fact_digest[SHA256_DIGEST_LENGTH];
+      ::SHA256_Final(fact_digest, &fact_sha);
+      ::SHA256_Update(&key_sha, fact_digest, sizeof(fact_digest));
+      unsigned char key_digest[SHA256_DIGEST_LENGTH];
+      ::SHA256_Final(key_digest, &key_sha);
+      if (::mkdir(absl::GetFlag(FLAGS_cache_dir).c_str(), 0755) != 0 &&
+          errno != EEXIST) {
+        absl::FPrintF(stderr, "Could not create cache directory %s\n",
+                      absl::GetFlag(FLAGS_cache_dir));
+        cache_enabled = false;
+      } else {
+        cache_path = absl::StrCat(
+            absl::GetFlag(FLAGS_cache_dir), "/",
+            absl::BytesToHexString(absl::string_view(
+                reinterpret_cast<const char*>(key_digest),
+                sizeof(key_digest))));
+        std::string cached;
+        if (ReadFileBytes(cache_path, &cached) && cached.size() >= 2 &&
+            (cached[0] == '0' || cached[0] == '1') && cached[1] == '\n') {
+          fwrite(cached.data() + 2, 1, cached.size() - 2, stdout);
+          if (cached[0] == '0') {
+            return 0;
+          }
+          // Goal-by-goal diagnostics go to stderr and are not recorded, so a
+          // cached failure only restates the verdict.
+          fputs("Could not verify all goals (cached result).\n", stderr);
+          return 1;
+        }
+      }
+    }
   }
 
   if (!v.PrepareDatabase()) {
@@ -135,19 +610,33 @@ Example:
   }
 
   if (!absl::GetFlag(FLAGS_graphviz)) {
-    std::vector<std::string> rule_files(remain.begin() + 1, remain.end());
-    if (rule_files.empty() && !absl::GetFlag(FLAGS_use_file_nodes)) {
-      absl::FPrintF(stderr, "No rule files specified\n");
-      return 1;
-    }
-
-    for (const auto& rule_file : rule_files) {
-      if (rule_file.empty()) {
-        continue;
+    if (!archive_path.empty()) {
+      if (archive_goals.empty() && !absl::GetFlag(FLAGS_use_file_nodes)) {
+        absl::FPrintF(stderr, "No goal sources found in %s\n", archive_path);
+        return 1;
+      }
+      for (const auto& goal : archive_goals) {
+        if (!v.LoadInlineRuleContent(goal.first, goal.second)) {
+          absl::FPrintF(stderr, "Failed loading %s from %s.\n", goal.first,
+                        archive_path);
+          return 2;
+        }
       }
-      if (!v.LoadInlineRuleFile(rule_file)) {
-        absl::FPrintF(stderr, "Failed loading %s.\n", rule_file);
-        return 2;
+    } else {
+      std::vector<std::string> rule_files(remain.begin() + 1, remain.end());
+      if (rule_files.empty() && !absl::GetFlag(FLAGS_use_file_nodes)) {
+        absl::FPrintF(stderr, "No rule files specified\n");
+        return 1;
+      }
+
+      for (const auto& rule_file : rule_files) {
+        if (rule_file.empty()) {
+          continue;
+        }
+        if (!v.LoadInlineRuleFile(rule_file)) {
+          absl::FPrintF(stderr, "Failed loading %s.\n", rule_file);
+          return 2;
+        }
       }
     }
   }
@@ -162,6 +651,23 @@ Example:
 
   int result = 0;
 
+  // Inspections print to stdout during solving, so a cacheable run redirects
+  // stdout to a scratch file, replays it afterward, and stores it with the
+  // verdict.
+  int saved_stdout = -1;
+  std::string capture_path;
+  if (!cache_path.empty()) {
+    capture_path = absl::StrCat(cache_path, ".out.", getpid());
+    int capture_fd =
+        ::open(capture_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (capture_fd >= 0) {
+      fflush(stdout);
+      saved_stdout = ::dup(STDOUT_FILENO);
+      ::dup2(capture_fd, STDOUT_FILENO);
+      ::close(capture_fd);
+    }
+  }
+
   if (!v.VerifyAllGoals()) {
     absl::FPrintF(
         stderr, "Could not verify all goals. The furthest we reached was:\n  ");
@@ -169,6 +675,24 @@ Example:
     result = 1;
   }
 
+  if (saved_stdout >= 0) {
+    fflush(stdout);
+    ::dup2(saved_stdout, STDOUT_FILENO);
+    ::close(saved_stdout);
+    std::string captured;
+    ReadFileBytes(capture_path, &captured);
+    ::unlink(capture_path.c_str());
+    fwrite(captured.data(), 1, captured.size(), stdout);
+    // Write-then-rename so concurrent runs never observe a torn entry.
+    std::string tmp_path = absl::StrCat(cache_path, ".tmp.", getpid());
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out << (result == 0 ? "0\n" : "1\n") << captured;
+    out.close();
+    if (!out || ::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+      ::unlink(tmp_path.c_str());
+    }
+  }
+
   if (absl::GetFlag(FLAGS_graphviz) ||
       absl::GetFlag(FLAGS_annotated_graphviz)) {
     v.DumpAsDot();
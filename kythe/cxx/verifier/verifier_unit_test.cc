@@ -14,8 +14,11 @@
  * limitations under the License.
  */
 
+#include <cstdlib>
+#include <memory>
 #include <regex>
 
+#include "fact_snapshot.h"
 #include "glog/logging.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
@@ -128,6 +131,42 @@ TEST(VerifierUnitTest, NoRulesIsOk) {
   ASSERT_TRUE(v.VerifyAllGoals());
 }
 
+TEST(VerifierUnitTest, FactSnapshotRoundTrip) {
+  kythe::proto::Entry node_fact;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(R"(
+    source { root: "1" }
+    fact_name: "/kythe/node/kind"
+    fact_value: "record"
+  )",
+                                                            &node_fact));
+  kythe::proto::Entry edge_fact;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(R"(
+    source { root: "1" }
+    edge_kind: "/kythe/edge/defines"
+    target { root: "2" }
+    fact_name: "/"
+    fact_value: ""
+  )",
+                                                            &edge_fact));
+  FactSnapshotWriter writer;
+  writer.AddEntry(node_fact);
+  writer.AddEntry(edge_fact);
+  std::string path =
+      std::string(std::getenv("TEST_TMPDIR")) + "/facts.snapshot";
+  ASSERT_TRUE(writer.Write(path));
+  std::unique_ptr<FactSnapshot> snapshot = FactSnapshot::Load(path);
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_EQ(2, snapshot->fact_count());
+  Verifier v;
+  std::string dbname = "snapshot";
+  ASSERT_TRUE(v.AssertSnapshotFacts(*snapshot, &dbname));
+  ASSERT_TRUE(v.LoadInlineProtoFile(R"(
+#- vname(_,_,"1",_,_) defines vname(_,_,"2",_,_)
+)"));
+  ASSERT_TRUE(v.PrepareDatabase());
+  ASSERT_TRUE(v.VerifyAllGoals());
+}
+
 TEST(VerifierUnitTest, DuplicateFactsNotWellFormed) {
   Verifier v;
   ASSERT_TRUE(v.LoadInlineProtoFile(R"(entries {
@@ -2633,6 +2672,33 @@ fact_value: "//- A.node/kind file\n"
   ASSERT_TRUE(v.VerifyAllGoals());
 }
 
+TEST(VerifierUnitTest, ReadGoalsFromMultipleFileNodes) {
+  Verifier v;
+  ASSERT_TRUE(v.LoadInlineProtoFile(R"(entries {
+source { path:"test1" }
+fact_name: "/kythe/node/kind"
+fact_value: "file"
+}
+entries {
+source { path:"test1" }
+fact_name: "/kythe/text"
+fact_value: "//- A.node/kind file\n"
+}
+entries {
+source { path:"test2" }
+fact_name: "/kythe/node/kind"
+fact_value: "file"
+}
+entries {
+source { path:"test2" }
+fact_name: "/kythe/text"
+fact_value: "//- B.node/kind file\n"
+})"));
+  v.UseFileNodes();
+  ASSERT_TRUE(v.PrepareDatabase());
+  ASSERT_TRUE(v.VerifyAllGoals());
+}
+
 TEST(VerifierUnitTest, ReadGoalsFromFileNodeFailParse) {
   Verifier v;
   ASSERT_TRUE(v.LoadInlineProtoFile(R"(entries {
@@ -2697,6 +2763,34 @@ TEST(VerifierUnitTest, ConvertMarkedSource) {
   ASSERT_TRUE(v.VerifyAllGoals());
 }
 
+TEST(VerifierUnitTest, LazyConvertMarkedSource) {
+  Verifier v;
+  v.ConvertMarkedSourceLazily();
+  MarkedSource source;
+  google::protobuf::string source_string;
+  ASSERT_TRUE(source.SerializeToString(&source_string));
+  google::protobuf::TextFormat::FieldValuePrinter printer;
+  google::protobuf::string enc_source = printer.PrintBytes(source_string);
+  ASSERT_TRUE(v.LoadInlineProtoFile(R"(
+  entries {
+    source { signature:"test" }
+    fact_name: "/kythe/code"
+    fact_value: )" + enc_source + R"(
+  }
+  #- !{vname("test","","","","").code _}
+  #- vname("test","","","","") code Tree
+  #- Tree.kind "BOX"
+  #- Tree.pre_text ""
+  #- Tree.post_child_text ""
+  #- Tree.post_text ""
+  #- Tree.lookup_index 0
+  #- Tree.default_children_count 0
+  #- Tree.add_final_list_token false
+  )"));
+  ASSERT_TRUE(v.PrepareDatabase());
+  ASSERT_TRUE(v.VerifyAllGoals());
+}
+
 TEST(VerifierUnitTest, ConvertMarkedSourceKindEnums) {
   for (int kind = MarkedSource::Kind_MIN; kind <= MarkedSource::Kind_MAX;
        ++kind) {
@@ -2934,6 +3028,80 @@ TEST(VerifierUnitTest, ConvertMarkedSourceDuplicateFactsWellFormed) {
   ASSERT_TRUE(v.VerifyAllGoals());
 }
 
+TEST(VerifierUnitTest, DumpFiltersRejectBadRegex) {
+  Verifier v;
+  std::string error;
+  EXPECT_TRUE(v.SetDumpFilters("", "", &error));
+  EXPECT_TRUE(v.SetDumpFilters("root:.*", "/kythe/edge/ref", &error));
+  EXPECT_FALSE(v.SetDumpFilters("(", "", &error));
+  EXPECT_FALSE(error.empty());
+  error.clear();
+  EXPECT_FALSE(v.SetDumpFilters("", "(", &error));
+  EXPECT_FALSE(error.empty());
+}
+
+TEST(VerifierUnitTest, ChunkLoadedFactsVerify) {
+  Verifier v;
+  std::string dbname = "database";
+  auto chunk = v.NewFactChunk();
+  kythe::proto::Entry entry;
+  entry.mutable_source()->set_root("1");
+  entry.set_fact_name("testname");
+  entry.set_fact_value("testvalue");
+  ASSERT_TRUE(v.AssertChunkFact(chunk.get(), &dbname, 0, entry));
+  entry.mutable_source()->set_root("2");
+  ASSERT_TRUE(v.AssertChunkFact(chunk.get(), &dbname, 1, entry));
+  ASSERT_EQ(2u, chunk->size());
+  v.MergeFactChunk(std::move(chunk));
+  ASSERT_TRUE(v.PrepareDatabase());
+  ASSERT_TRUE(v.VerifyAllGoals());
+}
+
+TEST(VerifierUnitTest, GoalReorderingStillSolves) {
+  Verifier v;
+  v.UseGoalReordering();
+  ASSERT_TRUE(v.LoadInlineProtoFile(R"(entries {
+#- One is vname(_,_,Two = "2",_,_)
+#- One is vname(_,_,Three = "3",_,_)
+source { root:"1" }
+fact_name: "/"
+fact_value: ""
+edge_kind: "/kythe/edge/is"
+target { root:"2" }
+} entries {
+source { root:"1" }
+fact_name: "/"
+fact_value: ""
+edge_kind: "/kythe/edge/is"
+target { root:"3" }
+})"));
+  ASSERT_TRUE(v.PrepareDatabase());
+  ASSERT_TRUE(v.VerifyAllGoals());
+}
+
+TEST(VerifierUnitTest, GoalReorderingStillFailsUnsatisfiableGroups) {
+  Verifier v;
+  v.UseGoalReordering();
+  ASSERT_TRUE(v.LoadInlineProtoFile(R"(entries {
+#- One is vname(_,_,Two = "2",_,_)
+#- One is vname(_,_,Three = "3",_,_)
+#- One is vname(_,_,Two = Three,_,_)
+source { root:"1" }
+fact_name: "/"
+fact_value: ""
+edge_kind: "/kythe/edge/is"
+target { root:"2" }
+} entries {
+source { root:"1" }
+fact_name: "/"
+fact_value: ""
+edge_kind: "/kythe/edge/is"
+target { root:"3" }
+})"));
+  ASSERT_TRUE(v.PrepareDatabase());
+  ASSERT_FALSE(v.VerifyAllGoals());
+}
+
 }  // anonymous namespace
 }  // namespace verifier
 }  // namespace kythe
@@ -6,6 +6,8 @@
 set -e
 
 FILENAME=${1:?Missing required source path}
+# Number of parallel shards used when combining entries.
+JOBS=${JOBS:-$(nproc)}
 bazel build \
   --experimental_action_listener=//kythe/cxx/tools/generate_compile_commands:extract_json \
   --noshow_progress \
@@ -16,14 +18,35 @@ bazel build \
 
 BAZEL_ROOT="$(bazel info execution_root)"
 pushd "$BAZEL_ROOT" > /dev/null
-find . -name '*.compile_command.json' -print0 | while read -r -d '' fname; do
-  sed -e "s|@BAZEL_ROOT@|$BAZEL_ROOT|g" < "$fname" >> compile_commands.json
-  echo "" >> compile_commands.json
-done
-# Decompose, insert and keep the most recent entry for a given file, then
-# recombine.
-sed 's/\(^[[]\)\|\([],]$\)//;/^$/d;' < compile_commands.json \
-  | tac | sort -u -t, -k1,1 \
+
+# Entries are emitted per action by extract_compile_command and named by
+# action id, so bazel only regenerates those whose action changed. If no entry
+# is newer than the existing database, the database is already up to date.
+if [[ -f compile_commands.json && -z "$(find . -name '*.compile_command.json' \
+    -newer compile_commands.json -print -quit)" ]]; then
+  popd > /dev/null
+  exit 0
+fi
+
+# Concatenate the entries in parallel shards, each writing its own buffer;
+# the @BAZEL_ROOT@ substitution then runs once over the combined stream
+# instead of spawning a sed per entry.
+SHARD_DIR="$(mktemp -d)"
+trap 'rm -rf "$SHARD_DIR"' EXIT
+export SHARD_DIR
+find . -name '*.compile_command.json' -print0 \
+  | xargs -0 -r -n 256 -P "$JOBS" \
+      sh -c 'awk "{print}" "$@" > "$(mktemp "$SHARD_DIR/shard.XXXXXX")"' _
+
+# Merge the existing database with the new entries, keep the most recent
+# entry for a given file, then recombine.
+{
+  if [[ -f compile_commands.json ]]; then
+    sed 's/\(^[[]\)\|\([],]$\)//;/^$/d;' < compile_commands.json
+  fi
+  cat "$SHARD_DIR"/shard.* 2> /dev/null \
+    | sed -e "s|@BAZEL_ROOT@|$BAZEL_ROOT|g"
+} | tac | sort -u -t, -k1,1 \
   | sed '1s/^./[\0/;s/}$/},/;$s/,$/]/' > compile_commands.json.tmp
 mv compile_commands.json{.tmp,}
 popd > /dev/null